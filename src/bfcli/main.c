@@ -3,9 +3,12 @@
  * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
  */
 
+#include <arpa/inet.h>
 #include <argp.h>
+#include <endian.h>
 #include <errno.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,13 +17,20 @@
 #include "bfcli/lexer.h"
 #include "bfcli/parser.h"
 #include "core/chain.h"
+#include "core/check.h"
+#include "core/counter.h"
 #include "core/helper.h"
 #include "core/hook.h"
 #include "core/list.h"
 #include "core/logger.h"
+#include "core/pcap.h"
+#include "core/phase.h"
 #include "core/request.h"
 #include "core/response.h"
 #include "core/set.h"
+#include "core/sim.h"
+#include "core/telemetry.h"
+#include "core/verdict.h"
 #include "libbpfilter/bpfilter.h"
 #include "version.h"
 
@@ -30,8 +40,29 @@ struct bf_ruleset_set_opts
 {
     const char *input_file;
     const char *input_string;
+    bool timings;
 };
 
+/**
+ * Print the control-plane timings of a request sent to the daemon.
+ *
+ * The timings are printed on a single line, as @c key=value pairs, with one
+ * key per phase (see @ref bf_phase ), so they can be parsed easily.
+ *
+ * @param timings Duration of each phase, in nanoseconds, as returned by the
+ *        daemon. Can't be NULL.
+ */
+static void _bf_print_timings(const uint64_t *timings)
+{
+    bf_assert(timings);
+
+    for (size_t i = 0; i < _BF_PHASE_MAX; ++i) {
+        (void)printf("%s%s_ns=%lu", i ? " " : "", bf_phase_to_str(i),
+                     timings[i]);
+    }
+    (void)printf("\n");
+}
+
 static error_t _bf_ruleset_set_opts_parser(int key, const char *arg,
                                            struct argp_state *state)
 {
@@ -44,6 +75,9 @@ static error_t _bf_ruleset_set_opts_parser(int key, const char *arg,
     case 's':
         opts->input_string = arg;
         break;
+    case 't':
+        opts->timings = true;
+        break;
     case ARGP_KEY_END:
         if (!opts->input_file && !opts->input_string)
             return bf_err_r(-EINVAL, "--file or --str argument is required");
@@ -103,6 +137,8 @@ int _bf_do_ruleset_set(int argc, char *argv[])
     static struct argp_option options[] = {
         {"file", 'f', "INPUT_FILE", 0, "Input file to use a rules source", 0},
         {"str", 's', "INPUT_STRING", 0, "String to use as rules", 0},
+        {"timings", 't', 0, 0,
+         "Print the time spent by the daemon in each phase", 0},
         {0},
     };
     struct argp argp = {
@@ -114,6 +150,8 @@ int _bf_do_ruleset_set(int argc, char *argv[])
     struct bf_ruleset ruleset = {
         .chains = bf_chain_list(),
         .sets = bf_set_list(),
+        .targets = bf_ruleset_target_list(),
+        .named_sets = bf_ruleset_set_list(),
     };
     int r;
 
@@ -146,23 +184,988 @@ int _bf_do_ruleset_set(int argc, char *argv[])
     // Send the chains to the daemon
     bf_list_foreach (&ruleset.chains, chain_node) {
         const struct bf_chain *chain = bf_list_node_get_data(chain_node);
+        uint64_t timings[_BF_PHASE_MAX];
+        bool changed;
 
-        r = bf_cli_set_chain(chain);
+        r = bf_cli_set_chain_changed(chain, &changed,
+                                     opts.timings ? timings : NULL);
         if (r < 0) {
             bf_err("failed to set chain for '%s', skipping remaining chains",
                    bf_hook_to_str(chain->hook));
             goto end_clean;
         }
+
+        if (!changed)
+            bf_info("chain for '%s' is unchanged", bf_hook_to_str(chain->hook));
+
+        if (opts.timings)
+            _bf_print_timings(timings);
+    }
+
+end_clean:
+    bf_list_clean(&ruleset.chains);
+    bf_list_clean(&ruleset.sets);
+    bf_list_clean(&ruleset.targets);
+    bf_list_clean(&ruleset.named_sets);
+
+    return r;
+}
+
+struct bf_rule_patch_opts
+{
+    const char *input_file;
+    const char *input_string;
+    bool has_handle;
+    uint32_t handle;
+    bool after;
+    bool timings;
+};
+
+static int _bf_parse_handle(const char *arg, uint32_t *handle)
+{
+    unsigned long value;
+    char *end;
+
+    errno = 0;
+    value = strtoul(arg, &end, 0);
+    if (errno || *end != '\0' || end == arg || value > UINT32_MAX)
+        return bf_err_r(-EINVAL, "invalid rule handle '%s'", arg);
+
+    *handle = (uint32_t)value;
+
+    return 0;
+}
+
+static error_t _bf_rule_patch_opts_parser(int key, const char *arg,
+                                          struct argp_state *state)
+{
+    struct bf_rule_patch_opts *opts = state->input;
+    int r;
+
+    switch (key) {
+    case 'f':
+        opts->input_file = arg;
+        break;
+    case 's':
+        opts->input_string = arg;
+        break;
+    case 'a':
+    case 'b':
+    case 'h':
+        if (opts->has_handle)
+            return bf_err_r(-EINVAL, "only one rule handle can be specified");
+
+        r = _bf_parse_handle(arg, &opts->handle);
+        if (r)
+            return r;
+
+        opts->has_handle = true;
+        opts->after = key == 'a';
+        break;
+    case 't':
+        opts->timings = true;
+        break;
+    case ARGP_KEY_END:
+        if (!opts->input_file && !opts->input_string)
+            return bf_err_r(-EINVAL, "--file or --str argument is required");
+        if (opts->input_file && opts->input_string)
+            return bf_err_r(-EINVAL, "--file is incompatible with --str");
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+/**
+ * Insert, delete, or replace a single rule of a chain.
+ *
+ * The chain is defined using the same syntax as for @c "ruleset set" , and
+ * identifies the chain to patch using its hook and hook options. It must
+ * contain the rule to insert or the new rule (for @c "rule insert" and
+ * @c "rule replace" ), its policy is ignored. The rule to patch is
+ * identified by its handle: rules are numbered from 1 when a chain is
+ * created, and new rules get the next available handle.
+ */
+static int _bf_do_rule_patch(int argc, char *argv[], const char *action)
+{
+    static struct bf_rule_patch_opts opts = {};
+    static struct argp_option options[] = {
+        {"file", 'f', "INPUT_FILE", 0, "Input file to use as chain source",
+         0},
+        {"str", 's', "INPUT_STRING", 0, "String to use as chain", 0},
+        {"before", 'b', "HANDLE", 0, "Insert the rule before rule HANDLE", 0},
+        {"after", 'a', "HANDLE", 0, "Insert the rule after rule HANDLE", 0},
+        {"handle", 'h', "HANDLE", 0, "Handle of the rule to patch", 0},
+        {"timings", 't', 0, 0,
+         "Print the time spent by the daemon in each phase", 0},
+        {0},
+    };
+    struct argp argp = {
+        options, (argp_parser_t)_bf_rule_patch_opts_parser,
+        NULL,    NULL,
+        0,       NULL,
+        NULL,
+    };
+    struct bf_ruleset ruleset = {
+        .chains = bf_chain_list(),
+        .sets = bf_set_list(),
+        .targets = bf_ruleset_target_list(),
+        .named_sets = bf_ruleset_set_list(),
+    };
+    const struct bf_chain *chain;
+    uint32_t new_handle;
+    uint64_t timings[_BF_PHASE_MAX];
+    int r;
+
+    r = argp_parse(&argp, argc, argv, 0, 0, &opts);
+    if (r) {
+        bf_err_r(r, "failed to parse arguments");
+        goto end_clean;
+    }
+
+    if (opts.input_file)
+        r = _bf_cli_parse_file(opts.input_file, &ruleset);
+    else
+        r = _bf_cli_parse_str(opts.input_string, &ruleset);
+    if (r) {
+        bf_err_r(r, "failed to parse chain");
+        goto end_clean;
+    }
+
+    if (bf_list_size(&ruleset.chains) != 1) {
+        r = bf_err_r(-EINVAL, "expecting exactly 1 chain to patch");
+        goto end_clean;
+    }
+
+    chain = bf_list_get_at(&ruleset.chains, 0);
+
+    if (bf_streq(action, "insert")) {
+        r = bf_cli_insert_rule(chain, opts.handle, opts.after, &new_handle,
+                               opts.timings ? timings : NULL);
+        if (!r)
+            bf_info("inserted rule with handle %u", new_handle);
+    } else if (!opts.has_handle) {
+        r = bf_err_r(-EINVAL, "--handle is required to %s a rule", action);
+    } else if (bf_streq(action, "delete")) {
+        r = bf_cli_delete_rule(chain, opts.handle,
+                               opts.timings ? timings : NULL);
+    } else {
+        r = bf_cli_replace_rule(chain, opts.handle,
+                                opts.timings ? timings : NULL);
+    }
+
+    if (r)
+        bf_err_r(r, "failed to %s rule", action);
+    else if (opts.timings)
+        _bf_print_timings(timings);
+
+end_clean:
+    bf_list_clean(&ruleset.chains);
+    bf_list_clean(&ruleset.sets);
+    bf_list_clean(&ruleset.targets);
+    bf_list_clean(&ruleset.named_sets);
+
+    return r;
+}
+
+struct bf_set_top_opts
+{
+    const char *input_file;
+    const char *input_string;
+    bool has_set_index;
+    uint32_t set_index;
+    uint32_t limit;
+    bool by_bytes;
+};
+
+static error_t _bf_set_top_opts_parser(int key, const char *arg,
+                                       struct argp_state *state)
+{
+    struct bf_set_top_opts *opts = state->input;
+    unsigned long value;
+    char *end;
+
+    switch (key) {
+    case 'f':
+        opts->input_file = arg;
+        break;
+    case 's':
+        opts->input_string = arg;
+        break;
+    case 'i':
+    case 'l':
+        errno = 0;
+        value = strtoul(arg, &end, 0);
+        if (errno || *end != '\0' || end == arg || value > UINT32_MAX)
+            return bf_err_r(-EINVAL, "invalid value '%s'", arg);
+
+        if (key == 'i') {
+            opts->set_index = (uint32_t)value;
+            opts->has_set_index = true;
+        } else {
+            opts->limit = (uint32_t)value;
+        }
+        break;
+    case 'b':
+        opts->by_bytes = true;
+        break;
+    case ARGP_KEY_END:
+        if (!opts->input_file && !opts->input_string)
+            return bf_err_r(-EINVAL, "--file or --str argument is required");
+        if (opts->input_file && opts->input_string)
+            return bf_err_r(-EINVAL, "--file is incompatible with --str");
+        if (!opts->has_set_index)
+            return bf_err_r(-EINVAL, "--set argument is required");
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+/**
+ * Print a set element, formatted according to the set's type.
+ *
+ * @param type Type of the set the element belongs to.
+ * @param elem Element to print. Can't be NULL.
+ */
+static void _bf_print_set_elem(enum bf_set_type type, const void *elem)
+{
+    char addr[INET6_ADDRSTRLEN];
+
+    switch (type) {
+    case BF_SET_IP4:
+        inet_ntop(AF_INET, elem, addr, sizeof(addr));
+        (void)printf("%-40s", addr);
+        break;
+    case BF_SET_SRCIP6:
+        inet_ntop(AF_INET6, elem, addr, sizeof(addr));
+        (void)printf("%-40s", addr);
+        break;
+    case BF_SET_SRCIP6PORT: {
+        char addr_port[INET6_ADDRSTRLEN + 8];
+        uint16_t port;
+
+        inet_ntop(AF_INET6, elem, addr, sizeof(addr));
+        memcpy(&port, (const uint8_t *)elem + 16, sizeof(port));
+        (void)snprintf(addr_port, sizeof(addr_port), "[%s]:%u", addr,
+                       be16toh(port));
+        (void)printf("%-40s", addr_port);
+        break;
+    }
+    default:
+        (void)printf("%-40s", "<unknown>");
+        break;
+    }
+}
+
+/**
+ * Print the elements of a set with the highest per-element counters.
+ *
+ * The chain containing the set is defined using the same syntax as for
+ * @c "ruleset set" : its hook and hook options identify the chain, the rest
+ * is ignored. Sets are identified by their index in the chain, in the order
+ * they are defined.
+ */
+static int _bf_do_set_top(int argc, char *argv[])
+{
+    static struct bf_set_top_opts opts = {
+        .limit = 10,
+    };
+    static struct argp_option options[] = {
+        {"file", 'f', "INPUT_FILE", 0, "Input file to use as chain source",
+         0},
+        {"str", 's', "INPUT_STRING", 0, "String to use as chain", 0},
+        {"set", 'i', "INDEX", 0, "Index of the set in the chain", 0},
+        {"limit", 'l', "N", 0,
+         "Number of elements to print, 0 for all of them (default 10)", 0},
+        {"bytes", 'b', NULL, 0, "Sort elements by bytes instead of packets",
+         0},
+        {0},
+    };
+    struct argp argp = {
+        options, (argp_parser_t)_bf_set_top_opts_parser,
+        NULL,    NULL,
+        0,       NULL,
+        NULL,
+    };
+    struct bf_ruleset ruleset = {
+        .chains = bf_chain_list(),
+        .sets = bf_set_list(),
+        .targets = bf_ruleset_target_list(),
+        .named_sets = bf_ruleset_set_list(),
+    };
+    _cleanup_bf_set_ struct bf_set *set = NULL;
+    _cleanup_free_ struct bf_counter *counters = NULL;
+    size_t idx = 0;
+    int r;
+
+    r = argp_parse(&argp, argc, argv, 0, 0, &opts);
+    if (r) {
+        bf_err_r(r, "failed to parse arguments");
+        goto end_clean;
+    }
+
+    if (opts.input_file)
+        r = _bf_cli_parse_file(opts.input_file, &ruleset);
+    else
+        r = _bf_cli_parse_str(opts.input_string, &ruleset);
+    if (r) {
+        bf_err_r(r, "failed to parse chain");
+        goto end_clean;
+    }
+
+    if (bf_list_size(&ruleset.chains) != 1) {
+        r = bf_err_r(-EINVAL, "expecting exactly 1 chain");
+        goto end_clean;
+    }
+
+    r = bf_cli_get_set_counters(bf_list_get_at(&ruleset.chains, 0),
+                                opts.set_index, opts.limit, opts.by_bytes,
+                                &set, &counters);
+    if (r) {
+        bf_err_r(r, "failed to get set counters");
+        goto end_clean;
+    }
+
+    (void)printf("%-40s %20s %20s\n", "ELEMENT", "PACKETS", "BYTES");
+    bf_list_foreach (&set->elems, elem_node) {
+        _bf_print_set_elem(set->type, bf_list_node_get_data(elem_node));
+        (void)printf(" %20lu %20lu\n", counters[idx].packets,
+                     counters[idx].bytes);
+        ++idx;
+    }
+
+end_clean:
+    bf_list_clean(&ruleset.chains);
+    bf_list_clean(&ruleset.sets);
+    bf_list_clean(&ruleset.targets);
+    bf_list_clean(&ruleset.named_sets);
+
+    return r;
+}
+
+/**
+ * Print the counters of a chain, and the datapath telemetry counters.
+ *
+ * The chain is defined using the same syntax as for @c "ruleset set" : its
+ * hook and hook options identify the chain, the rest is ignored.
+ */
+static int _bf_do_chain_counters(int argc, char *argv[])
+{
+    static struct bf_ruleset_set_opts opts = {
+        .input_file = NULL,
+    };
+    static struct argp_option options[] = {
+        {"file", 'f', "INPUT_FILE", 0, "Input file to use as chain source",
+         0},
+        {"str", 's', "INPUT_STRING", 0, "String to use as chain", 0},
+        {0},
+    };
+    struct argp argp = {
+        options, (argp_parser_t)_bf_ruleset_set_opts_parser,
+        NULL,    NULL,
+        0,       NULL,
+        NULL,
+    };
+    struct bf_ruleset ruleset = {
+        .chains = bf_chain_list(),
+        .sets = bf_set_list(),
+        .targets = bf_ruleset_target_list(),
+        .named_sets = bf_ruleset_set_list(),
+    };
+    _cleanup_free_ struct bf_counter *counters = NULL;
+    _cleanup_free_ struct bf_counter *telemetry = NULL;
+    size_t n_counters;
+    size_t n_telemetry;
+    char name[32];
+    int r;
+
+    r = argp_parse(&argp, argc, argv, 0, 0, &opts);
+    if (r) {
+        bf_err_r(r, "failed to parse arguments");
+        goto end_clean;
+    }
+
+    if (opts.input_file)
+        r = _bf_cli_parse_file(opts.input_file, &ruleset);
+    else
+        r = _bf_cli_parse_str(opts.input_string, &ruleset);
+    if (r) {
+        bf_err_r(r, "failed to parse chain");
+        goto end_clean;
+    }
+
+    if (bf_list_size(&ruleset.chains) != 1) {
+        r = bf_err_r(-EINVAL, "expecting exactly 1 chain");
+        goto end_clean;
+    }
+
+    r = bf_cli_get_counters(bf_list_get_at(&ruleset.chains, 0), &counters,
+                            &n_counters, &telemetry, &n_telemetry);
+    if (r) {
+        bf_err_r(r, "failed to get counters");
+        goto end_clean;
+    }
+
+    if (n_counters < 2) {
+        r = bf_err_r(-EINVAL, "missing policy and errors counters");
+        goto end_clean;
+    }
+
+    (void)printf("%-20s %20s %20s\n", "COUNTER", "PACKETS", "BYTES");
+    for (size_t i = 0; i < n_counters; ++i) {
+        if (i == n_counters - 2)
+            (void)snprintf(name, sizeof(name), "policy");
+        else if (i == n_counters - 1)
+            (void)snprintf(name, sizeof(name), "errors");
+        else
+            (void)snprintf(name, sizeof(name), "rule %lu", i);
+
+        (void)printf("%-20s %20lu %20lu\n", name, counters[i].packets,
+                     counters[i].bytes);
+    }
+
+    for (size_t i = 0; i < n_telemetry && i < _BF_TELEMETRY_MAX; ++i) {
+        (void)printf("%-20s %20lu %20lu\n", bf_telemetry_to_str(i),
+                     telemetry[i].packets, telemetry[i].bytes);
+    }
+
+end_clean:
+    bf_list_clean(&ruleset.chains);
+    bf_list_clean(&ruleset.sets);
+    bf_list_clean(&ruleset.targets);
+    bf_list_clean(&ruleset.named_sets);
+
+    return r;
+}
+
+/**
+ * Get the upper bound of the histogram bucket containing a percentile.
+ *
+ * @param hist Histogram of @ref BF_PROFILE_N_BUCKETS buckets. Can't be NULL.
+ * @param n_samples Number of samples in @p hist .
+ * @param percentile Percentile to get, between 0 and 100.
+ * @return Upper bound of the bucket containing @p percentile , in
+ *         nanoseconds.
+ */
+static uint64_t _bf_profile_percentile(const uint64_t *hist,
+                                       uint64_t n_samples,
+                                       unsigned int percentile)
+{
+    uint64_t threshold = (n_samples * percentile + 99) / 100;
+    uint64_t seen = 0;
+    size_t i;
+
+    for (i = 0; i < BF_PROFILE_N_BUCKETS - 1; ++i) {
+        seen += hist[i];
+        if (seen >= threshold)
+            break;
+    }
+
+    return 1ULL << (i + 1);
+}
+
+/**
+ * Print the profiling histograms of a chain.
+ *
+ * The chain is defined using the same syntax as for @c "ruleset set" : its
+ * hook and hook options identify the chain, the rest is ignored. Percentiles
+ * are approximated to the upper bound of their histogram bucket.
+ */
+static int _bf_do_chain_profile(int argc, char *argv[])
+{
+    static struct bf_ruleset_set_opts opts = {
+        .input_file = NULL,
+    };
+    static struct argp_option options[] = {
+        {"file", 'f', "INPUT_FILE", 0, "Input file to use as chain source",
+         0},
+        {"str", 's', "INPUT_STRING", 0, "String to use as chain", 0},
+        {0},
+    };
+    struct argp argp = {
+        options, (argp_parser_t)_bf_ruleset_set_opts_parser,
+        NULL,    NULL,
+        0,       NULL,
+        NULL,
+    };
+    struct bf_ruleset ruleset = {
+        .chains = bf_chain_list(),
+        .sets = bf_set_list(),
+        .targets = bf_ruleset_target_list(),
+        .named_sets = bf_ruleset_set_list(),
+    };
+    _cleanup_free_ uint64_t *hist = NULL;
+    uint32_t block_size;
+    size_t n_blocks;
+    char name[32];
+    int r;
+
+    r = argp_parse(&argp, argc, argv, 0, 0, &opts);
+    if (r) {
+        bf_err_r(r, "failed to parse arguments");
+        goto end_clean;
+    }
+
+    if (opts.input_file)
+        r = _bf_cli_parse_file(opts.input_file, &ruleset);
+    else
+        r = _bf_cli_parse_str(opts.input_string, &ruleset);
+    if (r) {
+        bf_err_r(r, "failed to parse chain");
+        goto end_clean;
+    }
+
+    if (bf_list_size(&ruleset.chains) != 1) {
+        r = bf_err_r(-EINVAL, "expecting exactly 1 chain");
+        goto end_clean;
+    }
+
+    r = bf_cli_get_profile(bf_list_get_at(&ruleset.chains, 0), &block_size,
+                           &hist, &n_blocks);
+    if (r == -ENOENT) {
+        bf_err_r(r, "profiling is disabled, start the daemon with --profile");
+        goto end_clean;
+    }
+    if (r) {
+        bf_err_r(r, "failed to get profiling histograms");
+        goto end_clean;
+    }
+
+    (void)printf("%-20s %20s %12s %12s %12s\n", "BLOCK", "SAMPLES", "P50 (ns)",
+                 "P90 (ns)", "P99 (ns)");
+    for (size_t i = 0; i < n_blocks; ++i) {
+        const uint64_t *block_hist = &hist[i * BF_PROFILE_N_BUCKETS];
+        uint64_t n_samples = 0;
+
+        for (size_t bucket = 0; bucket < BF_PROFILE_N_BUCKETS; ++bucket)
+            n_samples += block_hist[bucket];
+
+        if (i == 0) {
+            (void)snprintf(name, sizeof(name), "prologue");
+        } else {
+            (void)snprintf(name, sizeof(name), "rules %lu-%lu",
+                           (i - 1) * block_size, i * block_size - 1);
+        }
+
+        if (!n_samples) {
+            (void)printf("%-20s %20d %12s %12s %12s\n", name, 0, "-", "-",
+                         "-");
+            continue;
+        }
+
+        (void)printf("%-20s %20lu %12lu %12lu %12lu\n", name, n_samples,
+                     _bf_profile_percentile(block_hist, n_samples, 50),
+                     _bf_profile_percentile(block_hist, n_samples, 90),
+                     _bf_profile_percentile(block_hist, n_samples, 99));
+    }
+
+end_clean:
+    bf_list_clean(&ruleset.chains);
+    bf_list_clean(&ruleset.sets);
+    bf_list_clean(&ruleset.targets);
+    bf_list_clean(&ruleset.named_sets);
+
+    return r;
+}
+
+/**
+ * Print the kernel's runtime statistics of the programs of every chain.
+ *
+ * The run count and average run time are only available if the
+ * @c kernel.bpf_stats_enabled sysctl is set.
+ */
+static int _bf_do_ruleset_stats(void)
+{
+    _cleanup_free_ struct bf_chain **chains = NULL;
+    _cleanup_free_ struct bf_prog_stats *stats = NULL;
+    size_t n_chains;
+    int r;
+
+    r = bf_cli_get_prog_stats(&chains, &stats, &n_chains);
+    if (r)
+        return bf_err_r(r, "failed to get program statistics");
+
+    (void)printf("%-24s %-16s %8s %8s %8s %8s %12s %10s %12s\n", "HOOK",
+                 "NAME", "PROG ID", "INSNS", "JITED", "VERIFIED", "RUNS",
+                 "AVG (ns)", "MAPS (B)");
+    for (size_t i = 0; i < n_chains; ++i) {
+        const struct bf_prog_stats *s = &stats[i];
+
+        (void)printf("%-24s %-16s %8u %8u %8u %8u %12lu %10lu %12lu\n",
+                     bf_hook_to_str(chains[i]->hook),
+                     chains[i]->hook_opts.name ?: "-", s->id, s->n_insns,
+                     s->jited_size, s->verified_insns, s->run_cnt,
+                     s->run_cnt ? s->run_time_ns / s->run_cnt : 0,
+                     s->maps_size);
+
+        bf_chain_free(&chains[i]);
+    }
+
+    return 0;
+}
+
+struct bf_ruleset_simulate_opts
+{
+    const char *input_file;
+    const char *input_string;
+    const char *pcap;
+    uint32_t repeat;
+};
+
+static error_t _bf_ruleset_simulate_opts_parser(int key, const char *arg,
+                                                struct argp_state *state)
+{
+    struct bf_ruleset_simulate_opts *opts = state->input;
+    unsigned long value;
+    char *end;
+
+    switch (key) {
+    case 'f':
+        opts->input_file = arg;
+        break;
+    case 's':
+        opts->input_string = arg;
+        break;
+    case 'p':
+        opts->pcap = arg;
+        break;
+    case 'r':
+        errno = 0;
+        value = strtoul(arg, &end, 0);
+        if (errno || *end != '\0' || end == arg || !value ||
+            value > UINT32_MAX)
+            return bf_err_r(-EINVAL, "invalid repeat count '%s'", arg);
+        opts->repeat = (uint32_t)value;
+        break;
+    case ARGP_KEY_END:
+        if (!opts->input_file && !opts->input_string)
+            return bf_err_r(-EINVAL, "--file or --str argument is required");
+        if (opts->input_file && opts->input_string)
+            return bf_err_r(-EINVAL, "--file is incompatible with --str");
+        if (!opts->pcap)
+            return bf_err_r(-EINVAL, "--pcap argument is required");
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static int _bf_sim_duration_cmp(const void *lhs, const void *rhs)
+{
+    uint32_t a = *(const uint32_t *)lhs;
+    uint32_t b = *(const uint32_t *)rhs;
+
+    return (a > b) - (a < b);
+}
+
+/**
+ * Replay the packets of a capture file through a chain, and print the
+ * results.
+ *
+ * The chain is loaded by the daemon but never attached, and the existing
+ * ruleset is not modified. For each packet, the program is run @c repeat
+ * times using @c BPF_PROG_TEST_RUN , so no network interface is required.
+ * The per-packet run time percentiles, the verdicts distribution, and the
+ * number of packets matched by each rule are printed.
+ */
+static int _bf_do_ruleset_simulate(int argc, char *argv[])
+{
+    static struct bf_ruleset_simulate_opts opts = {
+        .repeat = BF_SIM_DEFAULT_REPEAT,
+    };
+    static struct argp_option options[] = {
+        {"file", 'f', "INPUT_FILE", 0, "Input file to use as chain source",
+         0},
+        {"str", 's', "INPUT_STRING", 0, "String to use as chain", 0},
+        {"pcap", 'p', "PCAP_FILE", 0,
+         "Capture file containing the packets to replay", 0},
+        {"repeat", 'r', "N", 0, "Number of runs per packet, default to 100",
+         0},
+        {0},
+    };
+    struct argp argp = {
+        options, (argp_parser_t)_bf_ruleset_simulate_opts_parser,
+        NULL,    NULL,
+        0,       NULL,
+        NULL,
+    };
+    struct bf_ruleset ruleset = {
+        .chains = bf_chain_list(),
+        .sets = bf_set_list(),
+        .targets = bf_ruleset_target_list(),
+        .named_sets = bf_ruleset_set_list(),
+    };
+    _cleanup_free_ void *pkts = NULL;
+    _cleanup_free_ struct bf_sim_result *results = NULL;
+    _cleanup_free_ struct bf_counter *counters = NULL;
+    _cleanup_free_ uint32_t *durations = NULL;
+    size_t verdicts[_BF_VERDICT_MAX + 1] = {};
+    size_t n_durations = 0;
+    size_t n_errors = 0;
+    size_t n_counters;
+    size_t n_results;
+    size_t pkts_len;
+    size_t n_pkts;
+    char name[32];
+    int r;
+
+    r = argp_parse(&argp, argc, argv, 0, 0, &opts);
+    if (r) {
+        bf_err_r(r, "failed to parse arguments");
+        goto end_clean;
+    }
+
+    if (opts.input_file)
+        r = _bf_cli_parse_file(opts.input_file, &ruleset);
+    else
+        r = _bf_cli_parse_str(opts.input_string, &ruleset);
+    if (r) {
+        bf_err_r(r, "failed to parse chain");
+        goto end_clean;
+    }
+
+    if (bf_list_size(&ruleset.chains) != 1) {
+        r = bf_err_r(-EINVAL, "expecting exactly 1 chain");
+        goto end_clean;
+    }
+
+    r = bf_pcap_read(opts.pcap, &pkts, &pkts_len, &n_pkts);
+    if (r)
+        goto end_clean;
+
+    if (!n_pkts) {
+        r = bf_err_r(-ENOENT, "no packet to replay in %s", opts.pcap);
+        goto end_clean;
+    }
+
+    r = bf_cli_simulate(bf_list_get_at(&ruleset.chains, 0), pkts, pkts_len,
+                        opts.repeat, &results, &n_results, &counters,
+                        &n_counters);
+    if (r) {
+        bf_err_r(r, "failed to simulate chain");
+        goto end_clean;
+    }
+
+    if (n_counters < 2) {
+        r = bf_err_r(-EINVAL, "missing policy and errors counters");
+        goto end_clean;
+    }
+
+    durations = calloc(n_results ?: 1, sizeof(*durations));
+    if (!durations) {
+        r = -ENOMEM;
+        goto end_clean;
+    }
+
+    for (size_t i = 0; i < n_results; ++i) {
+        if (results[i].error) {
+            ++n_errors;
+            continue;
+        }
+
+        durations[n_durations++] = results[i].duration;
+        if (results[i].verdict >= 0 && results[i].verdict < _BF_VERDICT_MAX)
+            ++verdicts[results[i].verdict];
+        else
+            ++verdicts[_BF_VERDICT_MAX];
+    }
+
+    qsort(durations, n_durations, sizeof(*durations), _bf_sim_duration_cmp);
+
+    (void)printf("%lu packets, %u runs per packet\n\n", n_results,
+                 opts.repeat);
+
+    (void)printf("%-20s %12s %12s %12s %12s\n", "LATENCY", "P50 (ns)",
+                 "P90 (ns)", "P99 (ns)", "MAX (ns)");
+    if (n_durations) {
+        (void)printf("%-20s %12u %12u %12u %12u\n", "per packet",
+                     durations[(n_durations - 1) * 50 / 100],
+                     durations[(n_durations - 1) * 90 / 100],
+                     durations[(n_durations - 1) * 99 / 100],
+                     durations[n_durations - 1]);
+    } else {
+        (void)printf("%-20s %12s %12s %12s %12s\n", "per packet", "-", "-",
+                     "-", "-");
+    }
+
+    (void)printf("\n%-20s %20s\n", "VERDICT", "PACKETS");
+    for (int i = 0; i < _BF_VERDICT_MAX; ++i)
+        (void)printf("%-20s %20lu\n", bf_verdict_to_str(i), verdicts[i]);
+    (void)printf("%-20s %20lu\n", "other", verdicts[_BF_VERDICT_MAX]);
+    (void)printf("%-20s %20lu\n", "not run", n_errors);
+
+    (void)printf("\n%-20s %20s %20s\n", "COUNTER", "PACKETS", "BYTES");
+    for (size_t i = 0; i < n_counters; ++i) {
+        if (i == n_counters - 2)
+            (void)snprintf(name, sizeof(name), "policy");
+        else if (i == n_counters - 1)
+            (void)snprintf(name, sizeof(name), "errors");
+        else
+            (void)snprintf(name, sizeof(name), "rule %lu", i);
+
+        (void)printf("%-20s %20lu %20lu\n", name, counters[i].packets,
+                     counters[i].bytes);
+    }
+
+end_clean:
+    bf_list_clean(&ruleset.chains);
+    bf_list_clean(&ruleset.sets);
+    bf_list_clean(&ruleset.targets);
+    bf_list_clean(&ruleset.named_sets);
+
+    return r;
+}
+
+struct bf_ruleset_check_opts
+{
+    const char *input_file;
+    const char *input_string;
+    bool verify;
+};
+
+static error_t _bf_ruleset_check_opts_parser(int key, const char *arg,
+                                             struct argp_state *state)
+{
+    struct bf_ruleset_check_opts *opts = state->input;
+
+    switch (key) {
+    case 'f':
+        opts->input_file = arg;
+        break;
+    case 's':
+        opts->input_string = arg;
+        break;
+    case 'v':
+        opts->verify = true;
+        break;
+    case ARGP_KEY_END:
+        if (!opts->input_file && !opts->input_string)
+            return bf_err_r(-EINVAL, "--file or --str argument is required");
+        if (opts->input_file && opts->input_string)
+            return bf_err_r(-EINVAL, "--file is incompatible with --str");
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static void _bf_print_check_cost(uint64_t cost)
+{
+    if (cost == BF_CHECK_COST_UNKNOWN)
+        (void)printf(" %14s", "-");
+    else
+        (void)printf(" %14lu", cost);
+}
+
+/**
+ * Generate the program of each chain of a ruleset, without loading nor
+ * attaching it, and print its cost.
+ *
+ * For each chain, the number of instructions of the program, and the
+ * estimated number of instructions executed per packet for each
+ * @ref bf_check_class are printed. With @c --verify , the program is also
+ * loaded (but not attached) to be verified, and the number of instructions
+ * processed by the verifier is printed. Every chain is checked, even if the
+ * verifier rejects some of them.
+ */
+static int _bf_do_ruleset_check(int argc, char *argv[])
+{
+    static struct bf_ruleset_check_opts opts = {};
+    static struct argp_option options[] = {
+        {"file", 'f', "INPUT_FILE", 0, "Input file to use a rules source", 0},
+        {"str", 's', "INPUT_STRING", 0, "String to use as rules", 0},
+        {"verify", 'v', 0, 0,
+         "Load the programs to run the verifier, without attaching them", 0},
+        {0},
+    };
+    struct argp argp = {
+        options, (argp_parser_t)_bf_ruleset_check_opts_parser,
+        NULL,    NULL,
+        0,       NULL,
+        NULL,
+    };
+    struct bf_ruleset ruleset = {
+        .chains = bf_chain_list(),
+        .sets = bf_set_list(),
+        .targets = bf_ruleset_target_list(),
+        .named_sets = bf_ruleset_set_list(),
+    };
+    int verify_error = 0;
+    int r;
+
+    r = argp_parse(&argp, argc, argv, 0, 0, &opts);
+    if (r) {
+        bf_err_r(r, "failed to parse arguments");
+        goto end_clean;
+    }
+
+    if (opts.input_file)
+        r = _bf_cli_parse_file(opts.input_file, &ruleset);
+    else
+        r = _bf_cli_parse_str(opts.input_string, &ruleset);
+    if (r) {
+        bf_err_r(r, "failed to parse ruleset");
+        goto end_clean;
+    }
+
+    bf_list_foreach (&ruleset.chains, chain_node) {
+        const struct bf_chain *chain = bf_list_node_get_data(chain_node);
+        struct bf_check_report report;
+
+        r = bf_cli_check(chain, opts.verify, &report);
+        if (r) {
+            bf_err_r(r, "failed to check chain for '%s'",
+                     bf_hook_to_str(chain->hook));
+            goto end_clean;
+        }
+
+        if (!bf_list_is_head(&ruleset.chains, chain_node))
+            (void)printf("\n");
+
+        (void)printf("%s (%s): %u instructions", bf_hook_to_str(chain->hook),
+                     chain->hook_opts.name ?: "-", report.n_insns);
+        if (!report.verify) {
+            (void)printf(", not verified\n");
+        } else if (report.verify_error) {
+            (void)printf(", rejected by the verifier: %s\n",
+                         bf_strerror(report.verify_error));
+            verify_error = verify_error ?: report.verify_error;
+        } else {
+            (void)printf(", %u instructions processed by the verifier\n",
+                         report.verified_insns);
+        }
+
+        (void)printf("%-20s %14s %14s\n", "PACKETS", "BEST (insns)",
+                     "WORST (insns)");
+        for (int i = 0; i < _BF_CHECK_CLASS_MAX; ++i) {
+            (void)printf("%-20s", bf_check_class_to_str(i));
+            _bf_print_check_cost(report.costs[i].best);
+            _bf_print_check_cost(report.costs[i].worst);
+            (void)printf("\n");
+        }
     }
 
+    r = verify_error;
+
 end_clean:
     bf_list_clean(&ruleset.chains);
     bf_list_clean(&ruleset.sets);
+    bf_list_clean(&ruleset.targets);
+    bf_list_clean(&ruleset.named_sets);
 
     return r;
 }
 
-#define streq(str, expected) (str) && bf_streq(str, expected)
+#define streq(str, expected) ((str) && bf_streq(str, expected))
 
 int main(int argc, char *argv[])
 {
@@ -199,6 +1202,22 @@ int main(int argc, char *argv[])
         r = _bf_do_ruleset_set(argc, argv);
     } else if (streq(obj_str, "ruleset") && streq(action_str, "flush")) {
         r = bf_cli_ruleset_flush();
+    } else if (streq(obj_str, "ruleset") && streq(action_str, "stats")) {
+        r = _bf_do_ruleset_stats();
+    } else if (streq(obj_str, "ruleset") && streq(action_str, "simulate")) {
+        r = _bf_do_ruleset_simulate(argc, argv);
+    } else if (streq(obj_str, "ruleset") && streq(action_str, "check")) {
+        r = _bf_do_ruleset_check(argc, argv);
+    } else if (streq(obj_str, "rule") &&
+               (streq(action_str, "insert") || streq(action_str, "delete") ||
+                streq(action_str, "replace"))) {
+        r = _bf_do_rule_patch(argc, argv, action_str);
+    } else if (streq(obj_str, "set") && streq(action_str, "top")) {
+        r = _bf_do_set_top(argc, argv);
+    } else if (streq(obj_str, "chain") && streq(action_str, "counters")) {
+        r = _bf_do_chain_counters(argc, argv);
+    } else if (streq(obj_str, "chain") && streq(action_str, "profile")) {
+        r = _bf_do_chain_profile(argc, argv);
     } else {
         return bf_err_r(-EINVAL, "unrecognized object '%s' and action '%s'",
                         obj_str, action_str);
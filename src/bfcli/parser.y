@@ -20,6 +20,7 @@
 %}
 
 %code requires {
+    #include <errno.h>
     #include <linux/in.h>
     #include <linux/in6.h>
     #include <linux/if_ether.h>
@@ -31,11 +32,15 @@
     #include "core/rule.h"
     #include "core/chain.h"
     #include "core/set.h"
+    #include "core/subchain.h"
 
     extern int inet_pton(int af, const char *restrict src, void *restrict dst);
 
+    // Users of the parser might include <arpa/inet.h> already.
+    #ifndef AF_INET
     #define AF_INET     2
     #define AF_INET6    10
+    #endif
 
     #define min(a,b)             \
     ({                           \
@@ -50,11 +55,76 @@
         YYABORT;                                                               \
     })
 
+    /**
+     * Name of the sub-chain a rule jumps to. Sub-chains are referred to by
+     * name in the ruleset, but by index in @ref bf_rule::target , so the
+     * target is resolved once the chain has been parsed.
+     */
+    struct bf_ruleset_target
+    {
+        struct bf_rule *rule;
+        char *name;
+    };
+
+    static inline void bf_ruleset_target_free(struct bf_ruleset_target **target)
+    {
+        if (!*target)
+            return;
+
+        free((*target)->name);
+        freep((void *)target);
+    }
+
+    #define bf_ruleset_target_list()                                           \
+        ((bf_list) {.ops = {.free = (bf_list_ops_free)bf_ruleset_target_free}})
+
+    /**
+     * Named set declared in the chain being parsed. Rules refer to named sets
+     * as @c @name , which is resolved to the index of the set in the chain.
+     */
+    struct bf_ruleset_set
+    {
+        char *name;
+        uint32_t index;
+    };
+
+    static inline void bf_ruleset_set_free(struct bf_ruleset_set **set)
+    {
+        if (!*set)
+            return;
+
+        free((*set)->name);
+        freep((void *)set);
+    }
+
+    #define bf_ruleset_set_list()                                              \
+        ((bf_list) {.ops = {.free = (bf_list_ops_free)bf_ruleset_set_free}})
+
+    /// Default maximum number of elements of a named set.
+    #define BF_RULESET_SET_DEFAULT_SIZE 65536
+
     struct bf_ruleset
     {
         bf_list chains;
         bf_list sets;
+        // Targets of the rules of the chain being parsed.
+        bf_list targets;
+        // Named sets of the chain being parsed.
+        bf_list named_sets;
     };
+
+    static inline int bf_ruleset_get_set_index(struct bf_ruleset *ruleset,
+                                               const char *name)
+    {
+        bf_list_foreach (&ruleset->named_sets, set_node) {
+            struct bf_ruleset_set *set = bf_list_node_get_data(set_node);
+
+            if (bf_streq(set->name, name))
+                return (int)set->index;
+        }
+
+        return -ENOENT;
+    }
 }
 
 %define parse.error detailed
@@ -62,6 +132,7 @@
 
 %union {
     bool bval;
+    int ival;
     char *sval;
     enum bf_verdict verdict;
     enum bf_hook hook;
@@ -70,14 +141,19 @@
     struct bf_matcher *matcher;
     struct bf_rule *rule;
     struct bf_chain *chain;
+    struct bf_subchain *subchain;
     enum bf_matcher_op matcher_op;
 }
 
 // Tokens
 %token CHAIN
+%token SUBCHAIN
 %token POLICY
 %token RULE
 %token COUNTER
+%token SET
+%token ADD
+%token <sval> SET_TYPE SET_OPT SET_NAME
 %token <sval> HOOK_OPT
 %token <sval> MATCHER_META_IFINDEX  MATCHER_META_L3_PROTO MATCHER_META_L4_PROTO
 %token <sval> MATCHER_IP_PROTO MATCHER_IPADDR
@@ -86,15 +162,22 @@
 %token <sval> MATCHER_PORT MATCHER_PORT_RANGE
 %token <sval> STRING
 %token <sval> HOOK VERDICT MATCHER_TYPE MATCHER_OP MATCHER_TCP_FLAGS
+%token <sval> MATCHER_CT_STATE
+%token <sval> SUBCHAIN_VERDICT
 
 // Grammar types
 %type <bval> counter
 
+%type <ival> set_add
+
 %type <hook> hook
 
 %type <list> raw_hook_opts
 %destructor { bf_list_free(&$$); } raw_hook_opts
 
+%type <list> set_opts
+%destructor { bf_list_free(&$$); } set_opts
+
 %type <verdict> verdict
 
 %type <matcher_type> matcher_type
@@ -116,6 +199,12 @@
 %type <chain> chain
 %destructor { bf_chain_free(&$$); } chain
 
+%type <list> subchains
+%destructor { bf_list_free(&$$); } subchains
+
+%type <subchain> subchain
+%destructor { bf_subchain_free(&$$); } subchain
+
 %%
 chains          : chain
                 {
@@ -133,25 +222,179 @@ chains          : chain
                 }
                 ;
 
-chain           : CHAIN hook raw_hook_opts POLICY verdict rules
+chain           : CHAIN hook raw_hook_opts POLICY verdict sets rules subchains
                 {
                     _cleanup_bf_chain_ struct bf_chain *chain = NULL;
                     _cleanup_bf_list_ bf_list *raw_hook_opts = $3;
-                    _cleanup_bf_list_ bf_list *rules = $6;
+                    _cleanup_bf_list_ bf_list *rules = $7;
+                    _cleanup_bf_list_ bf_list *subchains = $8;
+                    int r;
 
                     if ($5 >= _BF_TERMINAL_VERDICT_MAX)
                         bf_parse_err("'%s' is not supported for chains\n", bf_verdict_to_str($5));
 
+                    if (rules) {
+                        bf_list_foreach (rules, rule_node) {
+                            struct bf_rule *rule = bf_list_node_get_data(rule_node);
+
+                            if (rule->verdict == BF_VERDICT_RETURN)
+                                bf_parse_err("'RETURN' is only supported in sub-chains\n");
+                        }
+                    }
+
                     if (bf_chain_new(&chain, $2, $5, &ruleset->sets, rules) < 0)
                         bf_parse_err("failed to create a new bf_chain\n");
 
                     if (bf_hook_opts_init(&chain->hook_opts, chain->hook, raw_hook_opts) < 0)
                         bf_parse_err("failed to parse hook options");
 
+                    if (subchains) {
+                        bf_list_foreach (subchains, subchain_node) {
+                            struct bf_subchain *subchain = bf_list_node_get_data(subchain_node);
+
+                            if (bf_chain_add_subchain(chain, subchain) < 0)
+                                bf_parse_err("failed to add sub-chain '%s'\n", subchain->name);
+
+                            bf_list_node_take_data(subchain_node);
+                        }
+                    }
+
+                    bf_list_foreach (&ruleset->targets, target_node) {
+                        struct bf_ruleset_target *target = bf_list_node_get_data(target_node);
+
+                        r = bf_chain_get_subchain_index(chain, target->name);
+                        if (r < 0)
+                            bf_parse_err("undefined sub-chain '%s'\n", target->name);
+
+                        target->rule->target = (uint32_t)r;
+                    }
+
+                    bf_list_clean(&ruleset->targets);
+                    bf_list_clean(&ruleset->named_sets);
 
                     $$ = TAKE_PTR(chain);
                 }
 
+sets            : %empty
+                | sets set
+                ;
+
+set             : SET STRING SET_TYPE set_opts
+                {
+                    _cleanup_bf_set_ struct bf_set *set = NULL;
+                    _cleanup_bf_list_ bf_list *set_opts = $4;
+                    __attribute__((cleanup(bf_ruleset_set_free))) struct bf_ruleset_set *named_set = NULL;
+                    enum bf_set_type type;
+
+                    if (bf_ruleset_get_set_index(ruleset, $2) >= 0)
+                        bf_parse_err("set '%s' is already defined\n", $2);
+
+                    if (bf_set_type_from_str($3, &type) < 0)
+                        bf_parse_err("unknown set type '%s'\n", $3);
+
+                    free($3);
+
+                    if (bf_set_new(&set, type) < 0)
+                        bf_parse_err("failed to create a new set\n");
+
+                    // Named sets are populated from the datapath.
+                    set->max_elems = BF_RULESET_SET_DEFAULT_SIZE;
+
+                    if (set_opts) {
+                        bf_list_foreach (set_opts, opt_node) {
+                            const char *opt = bf_list_node_get_data(opt_node);
+                            const char *value = strchr(opt, '=') + 1;
+                            unsigned long raw_val;
+
+                            errno = 0;
+                            raw_val = strtoul(value, NULL, 10);
+                            if (errno || raw_val > UINT32_MAX)
+                                bf_parse_err("invalid set option '%s'\n", opt);
+
+                            if (strncmp(opt, "size=", 5) == 0) {
+                                if (!raw_val)
+                                    bf_parse_err("set size can't be 0\n");
+                                set->max_elems = (uint32_t)raw_val;
+                            } else {
+                                set->timeout = (uint32_t)raw_val;
+                            }
+                        }
+                    }
+
+                    named_set = malloc(sizeof(*named_set));
+                    if (!named_set)
+                        bf_parse_err("failed to allocate a new bf_ruleset_set\n");
+
+                    named_set->name = $2;
+                    named_set->index = bf_list_size(&ruleset->sets);
+
+                    if (bf_list_add_tail(&ruleset->named_sets, named_set) < 0)
+                        bf_parse_err("failed to insert named set into bf_list\n");
+                    TAKE_PTR(named_set);
+
+                    if (bf_list_add_tail(&ruleset->sets, set) < 0)
+                        bf_parse_err("failed to add new set to list of sets\n");
+                    TAKE_PTR(set);
+                }
+                ;
+
+set_opts        : %empty { $$ = NULL; }
+                | set_opts SET_OPT
+                {
+                    if (!$1) {
+                        if (bf_list_new(&$1, (bf_list_ops[]){{.free = (bf_list_ops_free)freep}}) < 0)
+                            bf_parse_err("failed to allocate a new bf_list for set options");
+                    }
+
+                    if (bf_list_add_tail($1, $2) < 0)
+                        bf_parse_err("failed to insert set option '%s' in list", $2);
+
+                    $$ = TAKE_PTR($1);
+                }
+                ;
+
+set_add         : %empty { $$ = -1; }
+                | ADD SET_NAME
+                {
+                    int index = bf_ruleset_get_set_index(ruleset, $2);
+
+                    if (index < 0)
+                        bf_parse_err("undefined set '%s'\n", $2);
+
+                    free($2);
+                    $$ = index;
+                }
+                ;
+
+subchains       : %empty { $$ = NULL; }
+                | subchains subchain
+                {
+                    if (!$1) {
+                        if (bf_list_new(&$1, (bf_list_ops[]){{.free = (bf_list_ops_free)bf_subchain_free, .marsh = (bf_list_ops_marsh)bf_subchain_marsh}}) < 0)
+                            bf_parse_err("failed to allocate a new bf_list for bf_subchain\n");
+                    }
+
+                    if (bf_list_add_tail($1, $2) < 0)
+                        bf_parse_err("failed to insert sub-chain into bf_list\n");
+
+                    TAKE_PTR($2);
+                    $$ = TAKE_PTR($1);
+                }
+                ;
+
+subchain        : SUBCHAIN STRING rules
+                {
+                    _cleanup_bf_subchain_ struct bf_subchain *subchain = NULL;
+                    _cleanup_bf_list_ bf_list *rules = $3;
+
+                    if (bf_subchain_new(&subchain, $2, rules) < 0)
+                        bf_parse_err("failed to create sub-chain '%s'\n", $2);
+
+                    free($2);
+                    $$ = TAKE_PTR(subchain);
+                }
+                ;
+
 verdict         : VERDICT
                 {
                     enum bf_verdict verdict;
@@ -204,7 +447,7 @@ rules           : %empty { $$ = NULL; }
                     $$ = TAKE_PTR($1);
                 }
                 ;
-rule            : RULE matchers counter verdict
+rule            : RULE matchers counter set_add verdict
                 {
                     _cleanup_bf_rule_ struct bf_rule *rule = NULL;
 
@@ -212,7 +455,9 @@ rule            : RULE matchers counter verdict
                         bf_parse_err("failed to create a new bf_rule\n");
 
                     rule->counters = $3;
-                    rule->verdict = $4;
+                    rule->set_add = $4 >= 0;
+                    rule->set_index = $4 >= 0 ? (uint32_t)$4 : 0;
+                    rule->verdict = $5;
 
                     bf_list_foreach ($2, matcher_node) {
                         struct bf_matcher *matcher = bf_list_node_get_data(matcher_node);
@@ -226,6 +471,49 @@ rule            : RULE matchers counter verdict
                     bf_list_free(&$2);
                     $$ = TAKE_PTR(rule);
                 }
+                | RULE matchers counter set_add SUBCHAIN_VERDICT STRING
+                {
+                    _cleanup_bf_rule_ struct bf_rule *rule = NULL;
+                    __attribute__((cleanup(bf_ruleset_target_free))) struct bf_ruleset_target *target = NULL;
+                    enum bf_verdict verdict;
+
+                    if (bf_verdict_from_str($5, &verdict) < 0)
+                        bf_parse_err("unknown verdict '%s'\n", $5);
+
+                    free($5);
+
+                    if (bf_rule_new(&rule) < 0)
+                        bf_parse_err("failed to create a new bf_rule\n");
+
+                    rule->counters = $3;
+                    rule->set_add = $4 >= 0;
+                    rule->set_index = $4 >= 0 ? (uint32_t)$4 : 0;
+                    rule->verdict = verdict;
+
+                    bf_list_foreach ($2, matcher_node) {
+                        struct bf_matcher *matcher = bf_list_node_get_data(matcher_node);
+
+                        if (bf_list_add_tail(&rule->matchers, matcher) < 0)
+                            bf_parse_err("failed to add matcher to the rule\n");
+
+                        bf_list_node_take_data(matcher_node);
+                    }
+
+                    bf_list_free(&$2);
+
+                    target = malloc(sizeof(*target));
+                    if (!target)
+                        bf_parse_err("failed to allocate a new bf_ruleset_target\n");
+
+                    target->rule = rule;
+                    target->name = $6;
+
+                    if (bf_list_add_tail(&ruleset->targets, target) < 0)
+                        bf_parse_err("failed to insert rule target into bf_list\n");
+
+                    TAKE_PTR(target);
+                    $$ = TAKE_PTR(rule);
+                }
                 ;
 
 matchers        : matcher
@@ -366,20 +654,23 @@ matcher         : matcher_type matcher_op MATCHER_META_IFINDEX
 
                     $$ = TAKE_PTR(matcher);
                 }
-                | matcher_type matcher_op MATCHER_IP_ADDR_SET
+                | matcher_type matcher_op counter MATCHER_IP_ADDR_SET
                 {
                     _cleanup_bf_matcher_ struct bf_matcher *matcher = NULL;
                     _cleanup_bf_set_ struct bf_set *set = NULL;
                     uint32_t set_id = bf_list_size(&ruleset->sets);
                     int r;
 
-                    char *data = $3 + 1;
+                    char *data = $4 + 1;
                     data[strlen(data) - 1] = '\0';
 
                     r = bf_set_new(&set, BF_SET_IP4);
                     if (r < 0)
                         bf_parse_err("failed to create a new set\n");
 
+                    // Count the packets and bytes matching each element.
+                    set->counters = $3;
+
                     char *ip;
                     char *next = data;
                     do {
@@ -414,13 +705,46 @@ matcher         : matcher_type matcher_op MATCHER_META_IFINDEX
 
                     TAKE_PTR(set);
 
-                    free($3);
+                    free($4);
 
                     if (bf_matcher_new(&matcher, $1, $2, &set_id, sizeof(set_id)))
                         bf_parse_err("failed to create a new matcher\n");
 
                     $$ = TAKE_PTR(matcher);
                 }
+                | matcher_type matcher_op SET_NAME
+                {
+                    _cleanup_bf_matcher_ struct bf_matcher *matcher = NULL;
+                    enum bf_matcher_type type = $1;
+                    const struct bf_set *set;
+                    uint32_t set_id;
+                    int r;
+
+                    if ($2 != BF_MATCHER_IN)
+                        bf_parse_err("named sets can only be used with the 'in' operator\n");
+
+                    r = bf_ruleset_get_set_index(ruleset, $3);
+                    if (r < 0)
+                        bf_parse_err("undefined set '%s'\n", $3);
+
+                    set_id = (uint32_t)r;
+                    set = bf_list_get_at(&ruleset->sets, set_id);
+
+                    // IPv6 sets have their own matcher types.
+                    if (type == BF_MATCHER_IP6_SADDR && set->type == BF_SET_SRCIP6)
+                        type = BF_MATCHER_SET_SRCIP6;
+                    else if (type == BF_MATCHER_IP6_SADDR && set->type == BF_SET_SRCIP6PORT)
+                        type = BF_MATCHER_SET_SRCIP6PORT;
+                    else if ((type != BF_MATCHER_IP4_SRC_ADDR && type != BF_MATCHER_IP4_DST_ADDR) || set->type != BF_SET_IP4)
+                        bf_parse_err("set '%s' can't be used with '%s'\n", $3, bf_matcher_type_to_str(type));
+
+                    free($3);
+
+                    if (bf_matcher_new(&matcher, type, $2, &set_id, sizeof(set_id)))
+                        bf_parse_err("failed to create a new matcher\n");
+
+                    $$ = TAKE_PTR(matcher);
+                }
                 | matcher_type matcher_op MATCHER_IP6_ADDR
                 {
                     _cleanup_bf_matcher_ struct bf_matcher *matcher = NULL;
@@ -537,6 +861,36 @@ matcher         : matcher_type matcher_op MATCHER_META_IFINDEX
 
                     $$ = TAKE_PTR(matcher);
                 }
+                | matcher_type matcher_op MATCHER_CT_STATE
+                {
+                    _cleanup_bf_matcher_ struct bf_matcher *matcher = NULL;
+                    uint8_t states = 0;
+                    char *states_str;
+                    char *saveptr;
+                    char *token;
+                    int r;
+
+                    for (states_str = $3; ; states_str = NULL) {
+                        enum bf_matcher_ct_state state;
+
+                        token = strtok_r(states_str, ",", &saveptr);
+                        if (!token)
+                            break;
+
+                        r = bf_matcher_ct_state_from_str(token, &state);
+                        if (r)
+                            bf_parse_err("unknown connection tracking state '%s'\n", token);
+
+                        states |= 1 << state;
+                    }
+
+                    free($3);
+
+                    if (bf_matcher_new(&matcher, $1, $2, &states, sizeof(states)))
+                        bf_parse_err("failed to create a new matcher\n");
+
+                    $$ = TAKE_PTR(matcher);
+                }
                 ;
 matcher_type    : MATCHER_TYPE
                 {
@@ -6,13 +6,17 @@
 #include "bpfilter/cgen/cgen.h"
 
 #include <errno.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "bpfilter/cgen/dump.h"
+#include "bpfilter/cgen/interp.h"
 #include "bpfilter/cgen/program.h"
+#include "bpfilter/cgen/prog/map.h"
+#include "bpfilter/ctx.h"
 #include "core/chain.h"
 #include "core/dump.h"
 #include "core/front.h"
@@ -21,14 +25,76 @@
 #include "core/list.h"
 #include "core/logger.h"
 #include "core/marsh.h"
+#include "core/matcher.h"
 #include "core/opts.h"
 #include "core/rule.h"
+#include "core/set.h"
+#include "core/subchain.h"
+#include "core/telemetry.h"
+
+#include "external/murmur3.h"
+
+/**
+ * Compute the hash of a chain.
+ *
+ * The chain is serialized, and the hash is computed from the serialized data,
+ * so two chains with the same content always have the same hash. Rule handles
+ * are not part of the chain's content: they depend on the rules patched into
+ * the chain since it was created, so the hash is computed on a copy of the
+ * chain with all the handles reset to 0.
+ *
+ * @param chain Chain to compute the hash of. Can't be NULL.
+ * @param hash Buffer to store the hash into, must be at least
+ *        @ref BF_CGEN_CHAIN_HASH_LEN bytes long. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_cgen_hash_chain(const struct bf_chain *chain, uint8_t *hash)
+{
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+    _cleanup_bf_chain_ struct bf_chain *canonical = NULL;
+    int r;
+
+    bf_assert(chain && hash);
+
+    r = bf_chain_marsh(chain, &marsh);
+    if (r)
+        return bf_err_r(r, "failed to serialize chain to compute its hash");
+
+    r = bf_chain_new_from_marsh(&canonical, marsh);
+    if (r)
+        return bf_err_r(r, "failed to copy chain to compute its hash");
+
+    bf_list_foreach (&canonical->rules, rule_node) {
+        struct bf_rule *rule = bf_list_node_get_data(rule_node);
+
+        rule->handle = 0;
+    }
+
+    bf_marsh_free(&marsh);
+    r = bf_chain_marsh(canonical, &marsh);
+    if (r)
+        return bf_err_r(r, "failed to serialize chain to compute its hash");
+
+    if (bf_marsh_size(marsh) > INT_MAX)
+        return bf_err_r(-E2BIG, "serialized chain is too large to be hashed");
+
+    murmur3_x64_128(marsh, (int)bf_marsh_size(marsh), 0, hash);
+
+    return 0;
+}
 
 int bf_cgen_new(struct bf_cgen **cgen, enum bf_front front,
                 struct bf_chain **chain)
 {
+    uint8_t hash[BF_CGEN_CHAIN_HASH_LEN];
+    int r;
+
     bf_assert(cgen && chain && *chain);
 
+    r = _bf_cgen_hash_chain(*chain, hash);
+    if (r)
+        return r;
+
     *cgen = malloc(sizeof(struct bf_cgen));
     if (!*cgen)
         return -ENOMEM;
@@ -36,6 +102,7 @@ int bf_cgen_new(struct bf_cgen **cgen, enum bf_front front,
     (*cgen)->front = front;
     (*cgen)->program = NULL;
     (*cgen)->chain = TAKE_PTR(*chain);
+    memcpy((*cgen)->chain_hash, hash, BF_CGEN_CHAIN_HASH_LEN);
 
     return 0;
 }
@@ -153,6 +220,10 @@ int bf_cgen_unload(struct bf_cgen *cgen)
 {
     bf_assert(cgen);
 
+    // The codegen's chain might be part of another codegen's program.
+    if (!cgen->program)
+        return 0;
+
     return bf_program_unload(cgen->program);
 }
 
@@ -185,39 +256,462 @@ void bf_cgen_dump(const struct bf_cgen *cgen, prefix_t *prefix)
     bf_dump_prefix_pop(prefix);
 }
 
+/**
+ * Get the codegens sharing a program with a codegen.
+ *
+ * BPF Netfilter programs can't be attached more than once to the same hook
+ * with the same priority, so the chains of all the codegens defined for a
+ * Netfilter hook are compiled into a single program, owned by the first
+ * codegen. Those codegens are sorted by priority in the context.
+ *
+ * For other hooks, a codegen's program only contains its own chain.
+ *
+ * @param cgen Codegen to get the group of. If @p cgen is not part of the
+ *        context yet, it is inserted in the group according to its priority.
+ *        Can't be NULL.
+ * @param group List to fill with the codegens, in the order their chains are
+ *        evaluated. The list doesn't own the codegens. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_cgen_get_group(const struct bf_cgen *cgen, bf_list *group)
+{
+    _clean_bf_list_ bf_list _group = bf_list_default(NULL, NULL);
+    bf_list_node *next = NULL;
+    int r;
+
+    bf_assert(cgen && group);
+
+    if (bf_hook_is_nf(cgen->chain->hook)) {
+        r = bf_ctx_get_cgens_for_hook(&_group, cgen->chain->hook);
+        if (r)
+            return r;
+    }
+
+    bf_list_foreach (&_group, cgen_node) {
+        struct bf_cgen *cur = bf_list_node_get_data(cgen_node);
+
+        if (cur == cgen) {
+            *group = bf_list_move(_group);
+            return 0;
+        }
+
+        if (!next &&
+            cur->chain->hook_opts.priority > cgen->chain->hook_opts.priority)
+            next = cgen_node;
+    }
+
+    r = next ? bf_list_add_before(&_group, next, (void *)cgen) :
+               bf_list_add_tail(&_group, (void *)cgen);
+    if (r)
+        return r;
+
+    *group = bf_list_move(_group);
+
+    return 0;
+}
+
+/**
+ * Get the program containing a codegen's chain, and the chain's location in
+ * the program.
+ *
+ * @param cgen Codegen to get the program for. Can't be NULL.
+ * @param program On success, points to the program containing the chain.
+ *        Can't be NULL.
+ * @param section On success, points to the chain's section in the program.
+ *        Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. Returns
+ *         -ENOENT if the codegen's chain is not part of any program.
+ */
+static int _bf_cgen_get_section(const struct bf_cgen *cgen,
+                                struct bf_program **program,
+                                const struct bf_program_section **section)
+{
+    _clean_bf_list_ bf_list group = bf_list_default(NULL, NULL);
+    struct bf_program *_program = NULL;
+    size_t index = 0;
+    size_t i = 0;
+    int r;
+
+    bf_assert(cgen && program && section);
+
+    r = _bf_cgen_get_group(cgen, &group);
+    if (r)
+        return r;
+
+    bf_list_foreach (&group, cgen_node) {
+        struct bf_cgen *cur = bf_list_node_get_data(cgen_node);
+
+        if (cur->program)
+            _program = cur->program;
+        if (cur == cgen)
+            index = i;
+        ++i;
+    }
+
+    if (!_program || index >= _program->n_sections)
+        return -ENOENT;
+
+    *program = _program;
+    *section = &_program->sections[index];
+
+    return 0;
+}
+
 int bf_cgen_get_counter(const struct bf_cgen *cgen,
                         enum bf_counter_type counter_idx,
                         struct bf_counter *counter)
 {
+    const struct bf_program_section *section;
+    struct bf_program *program;
+    uint32_t idx;
+    int r;
+
     bf_assert(cgen && counter);
 
-    /* There are two more counter than rules. The special counters must
-     * be accessed via the specific values, to avoid confusion. */
-    enum bf_counter_type rule_count = bf_list_size(&cgen->chain->rules);
+    r = _bf_cgen_get_section(cgen, &program, &section);
+    if (r)
+        return bf_err_r(r, "failed to find the program of the codegen");
+
+    /* The chain has one more counter than rules, and the errors counter is
+     * shared by all the chains of the program. The special counters must be
+     * accessed via the specific values, to avoid confusion. */
+    enum bf_counter_type rule_count = section->n_counters - 1;
     if (counter_idx == BF_COUNTER_POLICY) {
-        counter_idx = rule_count;
+        idx = section->counters_offset + rule_count;
     } else if (counter_idx == BF_COUNTER_ERRORS) {
-        counter_idx = rule_count + 1;
+        idx = program->num_counters - 1;
     } else if (counter_idx < 0 || counter_idx >= rule_count) {
         return -EINVAL;
+    } else {
+        idx = section->counters_offset + counter_idx;
     }
 
-    return bf_program_get_counter(cgen->program, counter_idx, counter);
+    return bf_program_get_counter(program, idx, counter);
 }
 
-int bf_cgen_up(struct bf_cgen *cgen)
+int bf_cgen_get_counters(const struct bf_cgen *cgen,
+                         struct bf_counter **counters, size_t *n_counters)
+{
+    _cleanup_free_ struct bf_counter *_counters = NULL;
+    const struct bf_program_section *section;
+    struct bf_program *program;
+    int r;
+
+    bf_assert(cgen && counters && n_counters);
+
+    r = _bf_cgen_get_section(cgen, &program, &section);
+    if (r)
+        return bf_err_r(r, "failed to find the program of the codegen");
+
+    _counters = calloc(section->n_counters, sizeof(*_counters));
+    if (!_counters)
+        return -ENOMEM;
+
+    r = bf_program_get_counters(program, section->counters_offset,
+                                section->n_counters, _counters);
+    if (r)
+        return r;
+
+    *counters = TAKE_PTR(_counters);
+    *n_counters = section->n_counters;
+
+    return 0;
+}
+
+int bf_cgen_get_telemetry(const struct bf_cgen *cgen,
+                          struct bf_counter *counters)
 {
+    const struct bf_program_section *section;
+    struct bf_program *program;
+    int r;
+
+    bf_assert(cgen && counters);
+
+    r = _bf_cgen_get_section(cgen, &program, &section);
+    if (r)
+        return bf_err_r(r, "failed to find the program of the codegen");
+
+    return bf_program_get_telemetry(program, counters);
+}
+
+int bf_cgen_get_stats(const struct bf_cgen *cgen, struct bf_prog_stats *stats)
+{
+    const struct bf_program_section *section;
+    struct bf_program *program;
+    int r;
+
+    bf_assert(cgen && stats);
+
+    r = _bf_cgen_get_section(cgen, &program, &section);
+    if (r)
+        return bf_err_r(r, "failed to find the program of the codegen");
+
+    return bf_program_get_stats(program, stats);
+}
+
+int bf_cgen_get_profile(const struct bf_cgen *cgen, uint32_t *block_size,
+                        uint64_t **hist, size_t *n_blocks)
+{
+    const struct bf_program_section *section;
+    _cleanup_free_ uint64_t *_hist = NULL;
+    struct bf_program *program;
+    int r;
+
+    bf_assert(cgen && block_size && hist && n_blocks);
+
+    r = _bf_cgen_get_section(cgen, &program, &section);
+    if (r)
+        return bf_err_r(r, "failed to find the program of the codegen");
+
+    if (!program->prmap)
+        return -ENOENT;
+
+    _hist = calloc((1 + section->n_profile_blocks) * BF_PROFILE_N_BUCKETS,
+                   sizeof(*_hist));
+    if (!_hist)
+        return -ENOMEM;
+
+    r = bf_program_get_profile(program, 0, 1, _hist);
+    if (r)
+        return r;
+
+    r = bf_program_get_profile(program, section->profile_offset,
+                               section->n_profile_blocks,
+                               &_hist[BF_PROFILE_N_BUCKETS]);
+    if (r)
+        return r;
+
+    *block_size = section->profile_block;
+    *n_blocks = 1 + section->n_profile_blocks;
+    *hist = TAKE_PTR(_hist);
+
+    return 0;
+}
+
+/**
+ * Copy a counter of an old program to a new program.
+ *
+ * @param new_prog Program to copy the counter to. Can't be NULL.
+ * @param new_idx Index of the counter in @p new_prog .
+ * @param old_counters Counters of the old program. Can't be NULL.
+ * @param base If NULL, the counter of @p new_prog is set to the old
+ *        counter. Otherwise, the difference between the old counter and
+ *        @p base is added to the counter of @p new_prog .
+ * @param old_idx Index of the counter in @p old_counters and @p base .
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_cgen_copy_counter(struct bf_program *new_prog, size_t new_idx,
+                                 const struct bf_counter *old_counters,
+                                 const struct bf_counter *base, size_t old_idx)
+{
+    struct bf_counter counter = old_counters[old_idx];
+
+    if (!base)
+        return bf_program_set_counter(new_prog, new_idx, &counter);
+
+    counter.packets -= base[old_idx].packets;
+    counter.bytes -= base[old_idx].bytes;
+    if (!counter.packets && !counter.bytes)
+        return 0;
+
+    return bf_program_add_counter(new_prog, new_idx, &counter);
+}
+
+/**
+ * Copy the counters from an old program to a new one.
+ *
+ * The counters of each chain of @p group are copied from the chain's section
+ * in the old program to its section in @p new_prog . The counters of
+ * @p cgen 's chain are only copied if @p old_indexes is not NULL.
+ *
+ * The counters are copied in two passes: before @p new_prog is attached,
+ * they are set to the old program's counters (@p base is NULL). Once
+ * @p new_prog is attached, the packets counted by the old program in the
+ * meantime are added to them (@p base contains the counters copied during
+ * the first pass).
+ *
+ * @param group Codegens sharing the new program, see @ref _bf_cgen_get_group .
+ *        Can't be NULL.
+ * @param cgen Codegen the new program has been generated for. Can't be NULL.
+ * @param new_prog Program to copy the counters to. Can't be NULL.
+ * @param old_prog Program to copy the counters from. Can't be NULL.
+ * @param old_counters Every counter of @p old_prog . Can't be NULL.
+ * @param base Counters of @p old_prog copied during the first pass, or NULL
+ *        for the first pass.
+ * @param is_new If true, @p cgen 's chain is not part of @p old_prog .
+ * @param old_indexes For each rule of @p cgen 's chain, index of the same rule
+ *        in the old chain, or @c UINT32_MAX if the rule is new. Can be NULL.
+ */
+static void _bf_cgen_copy_counters(const bf_list *group,
+                                   const struct bf_cgen *cgen,
+                                   struct bf_program *new_prog,
+                                   const struct bf_program *old_prog,
+                                   const struct bf_counter *old_counters,
+                                   const struct bf_counter *base, bool is_new,
+                                   const uint32_t *old_indexes)
+{
+    size_t old_idx = 0;
+    size_t new_idx = 0;
+    int r = 0;
+
+    bf_assert(group && cgen && new_prog && old_prog && old_counters);
+
+    bf_list_foreach (group, cgen_node) {
+        const struct bf_cgen *cur = bf_list_node_get_data(cgen_node);
+        const struct bf_program_section *old_sec;
+        const struct bf_program_section *new_sec;
+        size_t n_sub;
+        size_t i = 0;
+
+        if (cur == cgen && is_new) {
+            ++new_idx;
+            continue;
+        }
+
+        if (old_idx >= old_prog->n_sections || new_idx >= new_prog->n_sections)
+            break;
+
+        old_sec = &old_prog->sections[old_idx++];
+        new_sec = &new_prog->sections[new_idx++];
+
+        if (cur != cgen) {
+            for (i = 0; i < bf_min(old_sec->n_counters, new_sec->n_counters);
+                 ++i) {
+                r |= _bf_cgen_copy_counter(
+                    new_prog, new_sec->counters_offset + i, old_counters, base,
+                    old_sec->counters_offset + i);
+            }
+            continue;
+        }
+
+        if (!old_indexes)
+            continue;
+
+        bf_list_foreach (&cgen->chain->rules, rule_node) {
+            struct bf_rule *rule = bf_list_node_get_data(rule_node);
+
+            if (rule->counters && old_indexes[i] != UINT32_MAX) {
+                r |= _bf_cgen_copy_counter(
+                    new_prog, new_sec->counters_offset + i, old_counters, base,
+                    old_sec->counters_offset + old_indexes[i]);
+            }
+
+            ++i;
+        }
+
+        /* Sub-chains counters, located between the chain's rules and the
+         * policy. Rules are only updated in the main chain, so the sub-chains
+         * are the same in both programs. */
+        n_sub = new_sec->n_counters - 1 - i;
+        if (old_sec->n_counters - 1 >= n_sub) {
+            size_t old_start = old_sec->n_counters - 1 - n_sub;
+
+            for (size_t j = 0; j < n_sub; ++j) {
+                r |= _bf_cgen_copy_counter(
+                    new_prog, new_sec->counters_offset + i + j, old_counters,
+                    base, old_sec->counters_offset + old_start + j);
+            }
+        }
+
+        // Policy counter
+        r |= _bf_cgen_copy_counter(
+            new_prog, new_sec->counters_offset + new_sec->n_counters - 1,
+            old_counters, base,
+            old_sec->counters_offset + old_sec->n_counters - 1);
+    }
+
+    // Errors counter, shared by all the chains
+    if (old_indexes || bf_list_size(group) > 1) {
+        r |= _bf_cgen_copy_counter(new_prog, new_prog->num_counters - 1,
+                                   old_counters, base,
+                                   old_prog->num_counters - 1);
+    }
+
+    if (r)
+        bf_warn("failed to copy some counters to the new program");
+}
+
+/**
+ * Read every counter of a program.
+ *
+ * @param program Program to read the counters of. Can't be NULL.
+ * @param counters On success, points to an array of
+ *        @c program->num_counters counters, owned by the caller. Can't be
+ *        NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_cgen_read_counters(const struct bf_program *program,
+                                  struct bf_counter **counters)
+{
+    _cleanup_free_ struct bf_counter *_counters = NULL;
+    int r;
+
+    bf_assert(program && counters);
+
+    _counters = calloc(program->num_counters, sizeof(*_counters));
+    if (!_counters)
+        return -ENOMEM;
+
+    r = bf_program_get_counters(program, 0, program->num_counters, _counters);
+    if (r)
+        return r;
+
+    *counters = TAKE_PTR(_counters);
+
+    return 0;
+}
+
+/**
+ * Generate and load the program containing a codegen's chain.
+ *
+ * The program is generated from the chains of every codegen sharing a
+ * program with @p cgen (see @ref _bf_cgen_get_group ), and replaces the
+ * current program, if any. On success, the new program is owned by the first
+ * codegen of the group, and the counters of the other chains are carried over
+ * to the new program.
+ *
+ * @param cgen Codegen to generate the program for. Can't be NULL.
+ * @param is_new If true, @p cgen 's chain is not part of the current program.
+ * @param old_indexes See @ref _bf_cgen_copy_counters . Can be NULL.
+ * @return 0 on success, or a negative errno value on failure. On failure, the
+ *         current program is left unchanged.
+ */
+static int _bf_cgen_load(struct bf_cgen *cgen, bool is_new,
+                         const uint32_t *old_indexes)
+{
+    _clean_bf_list_ bf_list group = bf_list_default(NULL, NULL);
     _cleanup_bf_program_ struct bf_program *prog = NULL;
+    _cleanup_free_ struct bf_counter *counters = NULL;
+    _cleanup_free_ struct bf_counter *base = NULL;
+    struct bf_cgen *owner = NULL;
+    struct bf_cgen *first;
     int r;
 
     bf_assert(cgen);
 
-    if (bf_opts_is_verbose(BF_VERBOSE_DEBUG))
-        bf_cgen_dump(cgen, EMPTY_PREFIX);
+    r = _bf_cgen_get_group(cgen, &group);
+    if (r)
+        return bf_err_r(r, "failed to get the codegens sharing the program");
 
-    r = bf_program_new(&prog, cgen->chain->hook, cgen->front, cgen->chain);
+    first = bf_list_node_get_data(bf_list_get_head(&group));
+
+    r = bf_program_new(&prog, first->chain->hook, first->front, first->chain);
     if (r < 0)
-        return r;
+        return bf_err_r(r, "failed to create a new bf_program");
+
+    bf_list_foreach (&group, cgen_node) {
+        struct bf_cgen *cur = bf_list_node_get_data(cgen_node);
+
+        if (cur->program)
+            owner = cur;
+
+        if (cur == first)
+            continue;
+
+        r = bf_program_add_chain(prog, cur->chain);
+        if (r)
+            return bf_err_r(r, "failed to add chain to the new bf_program");
+    }
 
     r = bf_program_generate(prog);
     if (r < 0) {
@@ -225,43 +719,818 @@ int bf_cgen_up(struct bf_cgen *cgen)
                         bf_hook_to_str(cgen->chain->hook));
     }
 
-    r = bf_program_load(prog, NULL);
+    r = bf_program_load_detached(prog);
     if (r < 0)
         return r;
 
-    cgen->program = TAKE_PTR(prog);
+    /* Copy the counters before the new program is attached, as the packets
+     * it processes are counted as soon as it is attached. */
+    if (owner) {
+        r = _bf_cgen_read_counters(owner->program, &base);
+        if (r) {
+            bf_warn_r(r, "failed to read the counters of the old program");
+        } else {
+            _bf_cgen_copy_counters(&group, cgen, prog, owner->program, base,
+                                   NULL, is_new, old_indexes);
+        }
+    }
+
+    r = bf_program_attach(prog, owner ? owner->program : NULL);
+    if (r < 0)
+        return r;
+
+    if (owner) {
+        // Add the packets counted by the old program since the first copy.
+        if (base && !_bf_cgen_read_counters(owner->program, &counters)) {
+            _bf_cgen_copy_counters(&group, cgen, prog, owner->program,
+                                   counters, base, is_new, old_indexes);
+        }
+        if (bf_program_copy_telemetry(prog, owner->program))
+            bf_warn("failed to copy telemetry counters to the new program");
+        bf_program_free(&owner->program);
+    }
+
+    first->program = TAKE_PTR(prog);
+
+    return 0;
+}
+
+/**
+ * Regenerate the codegen's program from its unchanged chain.
+ *
+ * Used when the program's maps have to be recreated while the chain's rules
+ * didn't change: the counters of every rule are carried over to the new
+ * program.
+ *
+ * @param cgen Codegen to regenerate the program for. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. On failure, the
+ *         current program is left unchanged.
+ */
+static int _bf_cgen_reload(struct bf_cgen *cgen)
+{
+    _cleanup_free_ uint32_t *old_indexes = NULL;
+    size_t n_rules;
+
+    bf_assert(cgen);
+
+    n_rules = bf_list_size(&cgen->chain->rules);
+
+    // Never NULL, so the counters of the policy are copied too.
+    old_indexes = malloc(bf_max(n_rules, (size_t)1) * sizeof(*old_indexes));
+    if (!old_indexes)
+        return -ENOMEM;
+
+    for (size_t i = 0; i < n_rules; ++i)
+        old_indexes[i] = i;
+
+    return _bf_cgen_load(cgen, false, old_indexes);
+}
+
+int bf_cgen_up(struct bf_cgen *cgen)
+{
+    bf_assert(cgen);
+
+    if (bf_opts_is_verbose(BF_VERBOSE_DEBUG))
+        bf_cgen_dump(cgen, EMPTY_PREFIX);
 
-    return r;
+    return _bf_cgen_load(cgen, true, NULL);
 }
 
 int bf_cgen_update(struct bf_cgen *cgen, struct bf_chain **new_chain)
 {
-    _cleanup_bf_program_ struct bf_program *new_prog = NULL;
+    uint8_t hash[BF_CGEN_CHAIN_HASH_LEN];
     int r;
 
     bf_assert(cgen && new_chain);
 
-    r = bf_program_new(&new_prog, (*new_chain)->hook, cgen->front, *new_chain);
-    if (r < 0)
-        return bf_err_r(r, "failed to create a new bf_program");
+    r = _bf_cgen_hash_chain(*new_chain, hash);
+    if (r)
+        return r;
 
-    r = bf_program_generate(new_prog);
-    if (r < 0) {
-        return bf_err_r(r,
-                        "failed to generate the bytecode for a new bf_program");
-    }
+    bf_swap(cgen->chain, *new_chain);
 
-    r = bf_program_load(new_prog, cgen->program);
+    r = _bf_cgen_load(cgen, false, NULL);
     if (r < 0) {
+        bf_swap(cgen->chain, *new_chain);
         return bf_err_r(
             r, "failed to attach the new bf_program, keeping the old one");
     }
 
-    bf_swap(cgen->program, new_prog);
-    bf_swap(cgen->chain, *new_chain);
+    memcpy(cgen->chain_hash, hash, BF_CGEN_CHAIN_HASH_LEN);
 
     if (bf_opts_is_verbose(BF_VERBOSE_DEBUG))
         bf_cgen_dump(cgen, EMPTY_PREFIX);
 
     return 0;
 }
+
+bool bf_cgen_is_chain_current(const struct bf_cgen *cgen,
+                              const struct bf_chain *chain)
+{
+    uint8_t hash[BF_CGEN_CHAIN_HASH_LEN];
+
+    bf_assert(cgen && chain);
+
+    if (_bf_cgen_hash_chain(chain, hash))
+        return false;
+
+    return !memcmp(cgen->chain_hash, hash, BF_CGEN_CHAIN_HASH_LEN);
+}
+
+/**
+ * Update the codegen's chain hash after its chain has been modified in place.
+ *
+ * If the hash can't be computed, it is reset, so the chain will never be
+ * considered identical to another one.
+ *
+ * @param cgen Codegen to update the chain hash of. Can't be NULL.
+ */
+static void _bf_cgen_rehash(struct bf_cgen *cgen)
+{
+    bf_assert(cgen);
+
+    if (_bf_cgen_hash_chain(cgen->chain, cgen->chain_hash)) {
+        bf_warn("failed to update chain hash, resetting it");
+        memset(cgen->chain_hash, 0, BF_CGEN_CHAIN_HASH_LEN);
+    }
+}
+
+/**
+ * Release the rules of a list without freeing them.
+ *
+ * Used as a cleanup function for lists borrowing rules owned by another
+ * list.
+ *
+ * @param rules List to clean. Can't be NULL.
+ */
+static void _bf_cgen_release_rules(bf_list *rules)
+{
+    bf_assert(rules);
+
+    bf_list_foreach (rules, rule_node)
+        bf_list_node_take_data(rule_node);
+
+    bf_list_clean(rules);
+}
+
+/**
+ * Create the list of rules of a chain once patched.
+ *
+ * The rules in @p patched are borrowed from @p chain and from the caller
+ * (for @p rule ), they should be released with @ref _bf_cgen_release_rules
+ * instead of being freed.
+ *
+ * @param chain Chain to patch. Can't be NULL.
+ * @param op Patch operation.
+ * @param handle Handle of the rule to patch.
+ * @param rule Rule to insert into the chain. Unused for
+ *        @ref BF_CHAIN_PATCH_DELETE .
+ * @param patched List to fill with the patched chain's rules. Must be empty.
+ *        Can't be NULL.
+ * @param removed On success, points to the rule of @p chain that is not part
+ *        of @p patched anymore, if any. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_cgen_patch_rules(const struct bf_chain *chain,
+                                enum bf_chain_patch_op op, uint32_t handle,
+                                struct bf_rule *rule, bf_list *patched,
+                                struct bf_rule **removed)
+{
+    bool found = false;
+    int r;
+
+    bf_assert(chain && patched && removed);
+
+    *removed = NULL;
+
+    bf_list_foreach (&chain->rules, rule_node) {
+        struct bf_rule *cur = bf_list_node_get_data(rule_node);
+
+        if (!handle || cur->handle != handle) {
+            r = bf_list_add_tail(patched, cur);
+            if (r)
+                return r;
+            continue;
+        }
+
+        found = true;
+
+        switch (op) {
+        case BF_CHAIN_PATCH_INSERT_BEFORE:
+            r = bf_list_add_tail(patched, rule);
+            r = r ?: bf_list_add_tail(patched, cur);
+            break;
+        case BF_CHAIN_PATCH_INSERT_AFTER:
+            r = bf_list_add_tail(patched, cur);
+            r = r ?: bf_list_add_tail(patched, rule);
+            break;
+        case BF_CHAIN_PATCH_DELETE:
+            *removed = cur;
+            r = 0;
+            break;
+        case BF_CHAIN_PATCH_REPLACE:
+            *removed = cur;
+            r = bf_list_add_tail(patched, rule);
+            break;
+        default:
+            return -EINVAL;
+        }
+
+        if (r)
+            return r;
+    }
+
+    if (!handle && op == BF_CHAIN_PATCH_INSERT_BEFORE)
+        return bf_list_add_tail(patched, rule);
+    if (!handle && op == BF_CHAIN_PATCH_INSERT_AFTER)
+        return bf_list_add_head(patched, rule);
+
+    return found ? 0 : -ENOENT;
+}
+
+/**
+ * Write the patched rules of an interpreted chain to its program's rules map.
+ *
+ * The counters of the chain are read first, then the records are written, and
+ * the counters of the rules are moved to their new index. No program is
+ * generated nor loaded.
+ *
+ * The program is running while the counters are moved: the difference between
+ * the value a counter must have and the value it had before the records were
+ * written is added atomically to it, so the packets counted since the records
+ * have been written are not lost.
+ *
+ * @param cgen Codegen of the interpreted chain, its rules have already been
+ *        patched. Can't be NULL.
+ * @param old_indexes See @ref _bf_cgen_copy_counters . Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure, in which case
+ *         the program must be reloaded. Returns @c -E2BIG if the rules don't
+ *         fit in the chain's records.
+ */
+static int _bf_cgen_patch_interpreted(struct bf_cgen *cgen,
+                                      const uint32_t *old_indexes)
+{
+    _cleanup_free_ struct bf_counter *counters = NULL;
+    const struct bf_program_section *section;
+    struct bf_program *program;
+    size_t n_rules;
+    int r;
+
+    bf_assert(cgen && old_indexes);
+
+    r = _bf_cgen_get_section(cgen, &program, &section);
+    if (r)
+        return r;
+
+    n_rules = bf_list_size(&cgen->chain->rules);
+    if (n_rules > section->n_rules)
+        return -E2BIG;
+
+    counters = calloc(section->n_counters, sizeof(*counters));
+    if (!counters && section->n_counters)
+        return -ENOMEM;
+
+    // Read all the counters before writing any, as rules might have moved.
+    r = bf_program_get_counters(program, section->counters_offset,
+                                section->n_counters, counters);
+    if (r)
+        return r;
+
+    r = bf_interp_write_rules(program, section - program->sections,
+                              cgen->chain);
+    if (r)
+        return r;
+
+    for (size_t i = 0; i < n_rules; ++i) {
+        struct bf_counter delta = {};
+
+        if (old_indexes[i] != UINT32_MAX) {
+            if (old_indexes[i] >= section->n_counters)
+                return -EINVAL;
+
+            delta = counters[old_indexes[i]];
+        }
+
+        // Unsigned arithmetic: the delta wraps around if it's negative.
+        delta.packets -= counters[i].packets;
+        delta.bytes -= counters[i].bytes;
+        if (!delta.packets && !delta.bytes)
+            continue;
+
+        r = bf_program_add_counter(program, section->counters_offset + i,
+                                   &delta);
+        if (r)
+            return r;
+    }
+
+    return 0;
+}
+
+int bf_cgen_patch_rule(struct bf_cgen *cgen, enum bf_chain_patch_op op,
+                       uint32_t handle, struct bf_rule **rule,
+                       uint32_t *new_handle)
+{
+    __attribute__((cleanup(_bf_cgen_release_rules))) bf_list patched =
+        bf_rule_list();
+    _cleanup_free_ uint32_t *old_indexes = NULL;
+    struct bf_rule *new_rule = NULL;
+    struct bf_rule *removed;
+    size_t i = 0;
+    int r;
+
+    bf_assert(cgen);
+    bf_assert(0 <= op && op < _BF_CHAIN_PATCH_MAX);
+    bf_assert(op == BF_CHAIN_PATCH_DELETE || (rule && *rule));
+
+    if (op != BF_CHAIN_PATCH_DELETE) {
+        new_rule = *rule;
+        new_rule->handle = op == BF_CHAIN_PATCH_REPLACE ?
+                               handle :
+                               cgen->chain->next_handle;
+    }
+
+    r = _bf_cgen_patch_rules(cgen->chain, op, handle, new_rule, &patched,
+                             &removed);
+    if (r == -ENOENT)
+        return bf_err_r(r, "no rule with handle %u in chain", handle);
+    if (r)
+        return bf_err_r(r, "failed to patch the chain's rules");
+
+    old_indexes = malloc(bf_list_size(&patched) * sizeof(*old_indexes));
+    if (!old_indexes && !bf_list_is_empty(&patched))
+        return -ENOMEM;
+
+    // Keep track of the original indexes, to restore them or copy counters.
+    bf_list_foreach (&patched, rule_node) {
+        struct bf_rule *cur = bf_list_node_get_data(rule_node);
+
+        old_indexes[i] = cur == new_rule ? UINT32_MAX : cur->index;
+        cur->index = i++;
+    }
+
+    bf_swap(cgen->chain->rules, patched);
+
+    // Interpreted chains are patched in place, if the rules still fit.
+    r = -ENOTSUP;
+    if (cgen->chain->hook_opts.mode == BF_HOOK_MODE_INTERPRETED) {
+        r = _bf_cgen_patch_interpreted(cgen, old_indexes);
+        if (r && r != -E2BIG)
+            bf_warn_r(r, "failed to patch the rules map, reloading");
+    }
+
+    if (r)
+        r = _bf_cgen_load(cgen, false, old_indexes);
+    if (r) {
+        bf_swap(cgen->chain->rules, patched);
+
+        i = 0;
+        bf_list_foreach (&patched, rule_node) {
+            struct bf_rule *cur = bf_list_node_get_data(rule_node);
+
+            if (old_indexes[i] != UINT32_MAX)
+                cur->index = old_indexes[i];
+            ++i;
+        }
+
+        /* The rules map might have been partially written, restore the
+         * original rules on a best effort basis. */
+        if (cgen->chain->hook_opts.mode == BF_HOOK_MODE_INTERPRETED) {
+            struct bf_program *program;
+            const struct bf_program_section *section;
+
+            if (!_bf_cgen_get_section(cgen, &program, &section)) {
+                (void)bf_interp_write_rules(
+                    program, section - program->sections, cgen->chain);
+            }
+        }
+
+        return bf_err_r(r, "failed to load the patched program");
+    }
+
+    /* patched now contains the original list of rules: it will be released
+     * by the cleanup function, but the removed rule has to be freed. */
+    bf_rule_free(&removed);
+
+    if (new_rule) {
+        if (new_handle)
+            *new_handle = new_rule->handle;
+        if (op != BF_CHAIN_PATCH_REPLACE)
+            ++cgen->chain->next_handle;
+        *rule = NULL;
+    }
+
+    _bf_cgen_rehash(cgen);
+
+    if (bf_opts_is_verbose(BF_VERBOSE_DEBUG))
+        bf_cgen_dump(cgen, EMPTY_PREFIX);
+
+    return 0;
+}
+
+/**
+ * Get the BPF map used by the codegen's program for a given set.
+ *
+ * @param cgen Codegen to get the set map from. Can't be NULL.
+ * @param set_index Index of the set in the codegen's chain.
+ * @return The set's BPF map, or NULL if the program doesn't use it (yet).
+ */
+static struct bf_map *_bf_cgen_get_set_map(const struct bf_cgen *cgen,
+                                           size_t set_index)
+{
+    const struct bf_program_section *section;
+    struct bf_program *program;
+
+    bf_assert(cgen);
+
+    if (_bf_cgen_get_section(cgen, &program, &section) ||
+        set_index >= section->n_sets)
+        return NULL;
+
+    return bf_list_get_at(&program->sets, section->sets_offset + set_index);
+}
+
+/**
+ * Regenerate the codegen's program to grow a full set map.
+ *
+ * The new set map is filled from the set's content, with per-element
+ * counters starting from 0: if the set has counters, they are read from the
+ * current map before the program is regenerated, and written back into the
+ * new map. Packets matching the set while the program is regenerated are
+ * not counted.
+ *
+ * @param cgen Codegen to regenerate the program for. Can't be NULL.
+ * @param set_index Index of the full set in the codegen's chain.
+ * @return 0 on success, or a negative errno value on failure. On failure, the
+ *         current program is left unchanged.
+ */
+static int _bf_cgen_grow_set_map(struct bf_cgen *cgen, size_t set_index)
+{
+    _cleanup_free_ void *keys = NULL;
+    _cleanup_free_ void *values = NULL;
+    const struct bf_set *set;
+    struct bf_map *map;
+    size_t n_elems = 0;
+    int r;
+
+    bf_assert(cgen);
+
+    set = bf_list_get_at(&cgen->chain->sets, set_index);
+    if (set->counters) {
+        map = _bf_cgen_get_set_map(cgen, set_index);
+        r = bf_map_get_elems(map, &keys, &values, &n_elems);
+        if (r)
+            return bf_err_r(r, "failed to read the counters of set map");
+    }
+
+    r = _bf_cgen_reload(cgen);
+    if (r)
+        return r;
+
+    if (!n_elems)
+        return 0;
+
+    map = _bf_cgen_get_set_map(cgen, set_index);
+    if (!map || bf_map_set_elems(map, keys, values, n_elems))
+        bf_warn("failed to restore the per-element counters of a set");
+
+    return 0;
+}
+
+int bf_cgen_add_set_elem(struct bf_cgen *cgen, size_t set_index, void *elem)
+{
+    _cleanup_free_ void *counters = NULL;
+    struct bf_set *set;
+    struct bf_map *map;
+    uint64_t expiry = BF_PROG_SET_NO_EXPIRY;
+    uint8_t value = 1;
+    void *map_value = &value;
+    bool grow = false;
+    int r;
+
+    bf_assert(cgen && elem);
+
+    set = bf_list_get_at(&cgen->chain->sets, set_index);
+    if (!set)
+        return bf_err_r(-ENOENT, "no set at index %lu", set_index);
+
+    map = _bf_cgen_get_set_map(cgen, set_index);
+    if (map) {
+        if (set->counters) {
+            ssize_t value_buf_size = bf_map_value_buf_size(map);
+            if (value_buf_size < 0)
+                return (int)value_buf_size;
+
+            counters = calloc(1, value_buf_size);
+            if (!counters)
+                return -ENOMEM;
+            map_value = counters;
+        } else if (bf_set_is_dynamic(set)) {
+            // Elements added from userspace to a dynamic set never expire.
+            map_value = &expiry;
+        }
+
+        r = bf_map_set_elem(map, elem, map_value);
+        if (r == -E2BIG)
+            grow = true;
+        else if (r)
+            return bf_err_r(r, "failed to add element to set map %s",
+                            map->name);
+    }
+
+    r = bf_set_add_elem(set, elem);
+    if (r) {
+        if (map && !grow)
+            (void)bf_map_delete_elem(map, elem);
+        return bf_err_r(r, "failed to add element to set");
+    }
+
+    /* The set map is full: regenerate the program, its set map is sized
+     * after the set's new content. */
+    if (grow) {
+        bf_info("set map %s is full (%lu elements), regenerating the program",
+                map->name, map->n_elems);
+
+        r = _bf_cgen_grow_set_map(cgen, set_index);
+        if (r) {
+            (void)bf_set_remove_elem(set, elem);
+            return bf_err_r(r, "set map %s is full and can't be grown",
+                            map->name);
+        }
+    }
+
+    _bf_cgen_rehash(cgen);
+
+    return 0;
+}
+
+int bf_cgen_remove_set_elem(struct bf_cgen *cgen, size_t set_index,
+                            void *elem)
+{
+    struct bf_set *set;
+    struct bf_map *map;
+    int r;
+
+    bf_assert(cgen && elem);
+
+    set = bf_list_get_at(&cgen->chain->sets, set_index);
+    if (!set)
+        return bf_err_r(-ENOENT, "no set at index %lu", set_index);
+
+    map = _bf_cgen_get_set_map(cgen, set_index);
+    if (map) {
+        r = bf_map_delete_elem(map, elem);
+        if (r && r != -ENOENT) {
+            return bf_err_r(r, "failed to remove element from set map %s",
+                            map->name);
+        }
+    }
+
+    r = bf_set_remove_elem(set, elem);
+    if (r)
+        return bf_err_r(r, "element is not part of the set");
+
+    _bf_cgen_rehash(cgen);
+
+    return 0;
+}
+
+/**
+ * Check whether a matcher looks up the packet into one of the chain's sets.
+ *
+ * The payload of such matchers is the index of the set in the chain.
+ *
+ * @param matcher Matcher to check. Can't be NULL.
+ * @return True if @p matcher refers to a set, false otherwise.
+ */
+static bool _bf_cgen_matcher_uses_set(const struct bf_matcher *matcher)
+{
+    bf_assert(matcher);
+
+    return matcher->op == BF_MATCHER_IN ||
+           matcher->type == BF_MATCHER_SET_SRCIP6PORT ||
+           matcher->type == BF_MATCHER_SET_SRCIP6;
+}
+
+/**
+ * Check whether one of the rules of a list refers to a given set.
+ *
+ * @param rules List of rules to check. Can't be NULL.
+ * @param set_index Index of the set in the rules' chain.
+ * @return True if a rule matches against, or adds elements to, the set.
+ */
+static bool _bf_cgen_rules_use_set(const bf_list *rules, uint32_t set_index)
+{
+    bf_assert(rules);
+
+    bf_list_foreach (rules, rule_node) {
+        const struct bf_rule *rule = bf_list_node_get_data(rule_node);
+
+        if (rule->set_add && rule->set_index == set_index)
+            return true;
+
+        bf_list_foreach (&rule->matchers, matcher_node) {
+            const struct bf_matcher *matcher =
+                bf_list_node_get_data(matcher_node);
+
+            if (_bf_cgen_matcher_uses_set(matcher) &&
+                *(uint32_t *)matcher->payload == set_index)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Shift the references of a list of rules to the sets of their chain.
+ *
+ * @param rules List of rules to update. Can't be NULL.
+ * @param from References to the sets at this index and after are updated.
+ * @param shift Value to add to the references to update.
+ */
+static void _bf_cgen_rules_shift_sets(bf_list *rules, uint32_t from, int shift)
+{
+    bf_assert(rules);
+
+    bf_list_foreach (rules, rule_node) {
+        struct bf_rule *rule = bf_list_node_get_data(rule_node);
+
+        if (rule->set_add && rule->set_index >= from)
+            rule->set_index += shift;
+
+        bf_list_foreach (&rule->matchers, matcher_node) {
+            struct bf_matcher *matcher = bf_list_node_get_data(matcher_node);
+            uint32_t *index = (uint32_t *)matcher->payload;
+
+            if (_bf_cgen_matcher_uses_set(matcher) && *index >= from)
+                *index += shift;
+        }
+    }
+}
+
+/**
+ * Shift the references of a chain's rules and sub-chains to its sets.
+ *
+ * See @ref _bf_cgen_rules_shift_sets .
+ *
+ * @param chain Chain to update. Can't be NULL.
+ * @param from References to the sets at this index and after are updated.
+ * @param shift Value to add to the references to update.
+ */
+static void _bf_cgen_chain_shift_sets(struct bf_chain *chain, uint32_t from,
+                                      int shift)
+{
+    bf_assert(chain);
+
+    _bf_cgen_rules_shift_sets(&chain->rules, from, shift);
+
+    bf_list_foreach (&chain->subchains, subchain_node) {
+        struct bf_subchain *subchain = bf_list_node_get_data(subchain_node);
+
+        _bf_cgen_rules_shift_sets(&subchain->rules, from, shift);
+    }
+}
+
+int bf_cgen_remove_set(struct bf_cgen *cgen, size_t set_index)
+{
+    _cleanup_bf_set_ struct bf_set *set = NULL;
+    bf_list_node *set_node = NULL;
+    bf_list_node *next_node;
+    bool reload;
+    size_t i = 0;
+    int r;
+
+    bf_assert(cgen);
+
+    bf_list_foreach (&cgen->chain->sets, node) {
+        if (i++ == set_index) {
+            set_node = node;
+            break;
+        }
+    }
+    if (!set_node)
+        return bf_err_r(-ENOENT, "no set at index %lu", set_index);
+
+    if (_bf_cgen_rules_use_set(&cgen->chain->rules, set_index))
+        return bf_err_r(-EBUSY, "set at index %lu is in use", set_index);
+
+    bf_list_foreach (&cgen->chain->subchains, subchain_node) {
+        struct bf_subchain *subchain = bf_list_node_get_data(subchain_node);
+
+        if (_bf_cgen_rules_use_set(&subchain->rules, set_index))
+            return bf_err_r(-EBUSY, "set at index %lu is in use", set_index);
+    }
+
+    /* The program's set maps are ordered like the chain's sets: if the
+     * program has a map for the set, the maps of the following sets have to
+     * be shifted too, which requires a new program. */
+    reload = _bf_cgen_get_set_map(cgen, set_index) != NULL;
+    next_node = bf_list_node_next(set_node);
+
+    set = bf_list_node_take_data(set_node);
+    bf_list_delete(&cgen->chain->sets, set_node);
+    _bf_cgen_chain_shift_sets(cgen->chain, set_index + 1, -1);
+
+    if (reload) {
+        r = _bf_cgen_reload(cgen);
+        if (r) {
+            int restore_r;
+
+            _bf_cgen_chain_shift_sets(cgen->chain, set_index, 1);
+            if (next_node) {
+                restore_r =
+                    bf_list_add_before(&cgen->chain->sets, next_node, set);
+            } else {
+                restore_r = bf_list_add_tail(&cgen->chain->sets, set);
+            }
+            if (restore_r)
+                return bf_err_r(restore_r, "failed to restore removed set");
+            TAKE_PTR(set);
+
+            return bf_err_r(r, "failed to regenerate the program");
+        }
+    }
+
+    _bf_cgen_rehash(cgen);
+
+    return 0;
+}
+
+static int _bf_cgen_cmp_packets(const void *lhs, const void *rhs)
+{
+    const struct bf_counter *l = lhs;
+    const struct bf_counter *r = rhs;
+
+    return (l->packets < r->packets) - (l->packets > r->packets);
+}
+
+static int _bf_cgen_cmp_bytes(const void *lhs, const void *rhs)
+{
+    const struct bf_counter *l = lhs;
+    const struct bf_counter *r = rhs;
+
+    return (l->bytes < r->bytes) - (l->bytes > r->bytes);
+}
+
+int bf_cgen_get_set_top(const struct bf_cgen *cgen, size_t set_index,
+                        size_t limit, bool by_bytes, void **entries,
+                        size_t *n_entries)
+{
+    _cleanup_free_ uint8_t *keys = NULL;
+    _cleanup_free_ uint8_t *values = NULL;
+    _cleanup_free_ uint8_t *_entries = NULL;
+    const struct bf_set *set;
+    const struct bf_map *map;
+    ssize_t value_buf_size;
+    size_t entry_size;
+    size_t n_elems;
+    size_t n_cpus;
+    int r;
+
+    bf_assert(cgen && entries && n_entries);
+
+    set = bf_list_get_at(&cgen->chain->sets, set_index);
+    if (!set)
+        return bf_err_r(-ENOENT, "no set at index %lu", set_index);
+    if (!set->counters)
+        return bf_err_r(-ENOTSUP, "set %lu has no counters", set_index);
+
+    map = _bf_cgen_get_set_map(cgen, set_index);
+    if (!map)
+        return bf_err_r(-ENOENT, "set %lu is not loaded", set_index);
+
+    value_buf_size = bf_map_value_buf_size(map);
+    if (value_buf_size < 0)
+        return (int)value_buf_size;
+    n_cpus = value_buf_size / sizeof(struct bf_counter);
+
+    r = bf_map_get_elems(map, (void **)&keys, (void **)&values, &n_elems);
+    if (r)
+        return r;
+
+    entry_size = sizeof(struct bf_counter) + set->elem_size;
+    _entries = calloc(n_elems ?: 1, entry_size);
+    if (!_entries)
+        return -ENOMEM;
+
+    for (size_t i = 0; i < n_elems; ++i) {
+        struct bf_counter *entry = (void *)(_entries + (i * entry_size));
+        const struct bf_counter *percpu =
+            (void *)(values + (i * value_buf_size));
+
+        for (size_t cpu = 0; cpu < n_cpus; ++cpu) {
+            entry->packets += percpu[cpu].packets;
+            entry->bytes += percpu[cpu].bytes;
+        }
+
+        memcpy(entry + 1, keys + (i * set->elem_size), set->elem_size);
+    }
+
+    qsort(_entries, n_elems, entry_size,
+          by_bytes ? _bf_cgen_cmp_bytes : _bf_cgen_cmp_packets);
+
+    *entries = TAKE_PTR(_entries);
+    *n_entries = limit ? bf_min(limit, n_elems) : n_elems;
+
+    return 0;
+}
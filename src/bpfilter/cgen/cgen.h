@@ -5,18 +5,24 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "core/chain.h"
 #include "core/counter.h"
 #include "core/dump.h"
 #include "core/front.h"
 
-struct bf_chain;
 struct bf_marsh;
+struct bf_prog_stats;
 struct bf_program;
+struct bf_rule;
 
 #define _cleanup_bf_cgen_ __attribute__((cleanup(bf_cgen_free)))
 
+/// Size of a chain's hash, in bytes.
+#define BF_CGEN_CHAIN_HASH_LEN 16
+
 /**
  * Convenience macro to initialize a list of @ref bf_cgen .
  *
@@ -42,6 +48,11 @@ struct bf_cgen
 
     /// Program generated by the codegen.
     struct bf_program *program;
+
+    /** Hash of the chain's serialized content, used to detect when a chain
+     * identical to the codegen's chain is applied again. Not serialized, as
+     * it is computed when the codegen is created. */
+    uint8_t chain_hash[BF_CGEN_CHAIN_HASH_LEN];
 };
 
 /**
@@ -105,6 +116,132 @@ int bf_cgen_marsh(const struct bf_cgen *cgen, struct bf_marsh **marsh);
  */
 int bf_cgen_update(struct bf_cgen *cgen, struct bf_chain **chain);
 
+/**
+ * Check whether a chain is identical to the codegen's chain.
+ *
+ * The comparison is based on a hash of the chain's serialized data: hook,
+ * hook options, policy, sets, and rules (including their matchers, but not
+ * their handles). It can be used to skip @ref bf_cgen_update when the same
+ * chain is applied again, which would otherwise regenerate and reload the
+ * program, and reset its counters.
+ *
+ * @param cgen Codegen to compare the chain to. Can't be NULL.
+ * @param chain Chain to compare. Can't be NULL.
+ * @return True if @p chain is identical to the codegen's chain, false
+ *         otherwise (or if the chain's hash can't be computed).
+ */
+bool bf_cgen_is_chain_current(const struct bf_cgen *cgen,
+                              const struct bf_chain *chain);
+
+/**
+ * Patch a single rule of the codegen's chain, and update the BPF program.
+ *
+ * The patch is applied to the rules of the codegen's chain directly: the
+ * rules that are not modified are reused as-is. The program is regenerated
+ * and replaces the current one, and the counters of the rules that haven't
+ * been modified (as well as the policy and error counters) are carried over
+ * to the new program. The counters are copied before the new program is
+ * attached, then the packets counted by the old program until it is replaced
+ * are added to them, so no packet is lost.
+ *
+ * If the program can't be updated, the chain is left unchanged.
+ *
+ * @param cgen Codegen to patch. Can't be NULL.
+ * @param op Patch operation to apply to the chain.
+ * @param handle Handle of the rule to patch, see @ref bf_chain_patch_op for
+ *        the meaning of @p handle for each operation.
+ * @param rule Rule to insert into the chain. Ignored for
+ *        @ref BF_CHAIN_PATCH_DELETE , must point to a valid rule otherwise. On
+ *        success, the codegen takes ownership of the rule and @p *rule is set
+ *        to NULL.
+ * @param new_handle On success, contains the handle of the inserted rule.
+ *        Ignored for @ref BF_CHAIN_PATCH_DELETE . Can be NULL.
+ * @return 0 on success, or a negative errno value on failure. Returns
+ *         -ENOENT if there is no rule with the handle @p handle .
+ */
+int bf_cgen_patch_rule(struct bf_cgen *cgen, enum bf_chain_patch_op op,
+                       uint32_t handle, struct bf_rule **rule,
+                       uint32_t *new_handle);
+
+/**
+ * Add an element to one of the codegen's sets.
+ *
+ * The element is added to the chain's set, and to the corresponding BPF map
+ * if the codegen's program uses it already. The program is not regenerated:
+ * the change is visible to the packets processed after the map update.
+ *
+ * If the program doesn't have a map for this set yet (the set has been
+ * added to the chain after the program was generated), only the chain is
+ * updated, the map will be filled during the next program generation.
+ *
+ * If the set map is full, the program is regenerated with a set map sized
+ * after the set's new content. The per-element counters of the sets are
+ * not carried over to the new program.
+ *
+ * @param cgen Codegen containing the set to update. Can't be NULL.
+ * @param set_index Index of the set in the codegen's chain.
+ * @param elem Element to add to the set. Must be as large as the set's
+ *        elements. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_cgen_add_set_elem(struct bf_cgen *cgen, size_t set_index, void *elem);
+
+/**
+ * Remove an element from one of the codegen's sets.
+ *
+ * See @ref bf_cgen_add_set_elem for details about how the change is applied.
+ *
+ * @param cgen Codegen containing the set to update. Can't be NULL.
+ * @param set_index Index of the set in the codegen's chain.
+ * @param elem Element to remove from the set. Must be as large as the set's
+ *        elements. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_cgen_remove_set_elem(struct bf_cgen *cgen, size_t set_index,
+                            void *elem);
+
+/**
+ * Remove a set from the codegen's chain.
+ *
+ * The set can't be removed while a rule of the chain uses it. The references
+ * of the rules to the sets following the removed one are updated. If the
+ * program has a map for the set, it is regenerated, as the set maps are
+ * ordered like the chain's sets.
+ *
+ * @param cgen Codegen containing the set to remove. Can't be NULL.
+ * @param set_index Index of the set in the codegen's chain.
+ * @return 0 on success, or a negative errno value on failure, including:
+ *         - @c -ENOENT : there is no set at @p set_index .
+ *         - @c -EBUSY : a rule of the chain uses the set.
+ *         On failure, the chain and its program are left unchanged.
+ */
+int bf_cgen_remove_set(struct bf_cgen *cgen, size_t set_index);
+
+/**
+ * Get the elements of a set with the highest per-element counters.
+ *
+ * The set must have been created with per-element counters (see
+ * @ref bf_set::counters ). The counters of each element are summed across
+ * all the CPUs, and the elements are sorted by decreasing number of packets
+ * or bytes.
+ *
+ * @param cgen Codegen containing the set. Can't be NULL.
+ * @param set_index Index of the set in the codegen's chain.
+ * @param limit Maximum number of elements to return. If 0, all the elements
+ *        of the set are returned.
+ * @param by_bytes If true, sort the elements by number of bytes, otherwise
+ *        sort them by number of packets.
+ * @param entries On success, points to an array of @p n_entries entries owned
+ *        by the caller. Each entry is a @ref bf_counter followed by the
+ *        element's key. Can't be NULL.
+ * @param n_entries On success, contains the number of entries in
+ *        @p entries . Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_cgen_get_set_top(const struct bf_cgen *cgen, size_t set_index,
+                        size_t limit, bool by_bytes, void **entries,
+                        size_t *n_entries);
+
 /**
  * Create a @ref bf_program for each interface, generate the program, load it,
  * and attach it to the kernel.
@@ -112,6 +249,13 @@ int bf_cgen_update(struct bf_cgen *cgen, struct bf_chain **chain);
  * Simplify @ref bf_program management by providing a single call to add the
  * programs to the systems, starting from a new @ref bf_cgen.
  *
+ * The codegen should be added to the context (see @ref bf_ctx_set_cgen )
+ * before its program is generated: on Netfilter hooks, the chain is compiled
+ * into the program shared by all the codegens of the hook, which would
+ * otherwise keep a reference to the chain if the codegen was freed. If the
+ * program can't be generated, remove the codegen from the context with
+ * @ref bf_ctx_unset_cgen .
+ *
  * @param cgen Codegen to generate the programs for, and load to the system.
  * @return 0 on success, or negative errno value on failure.
  */
@@ -157,3 +301,66 @@ enum bf_counter_type
 int bf_cgen_get_counter(const struct bf_cgen *cgen,
                         enum bf_counter_type counter_idx,
                         struct bf_counter *counter);
+
+/**
+ * Get all the counters of a codegen's chain.
+ *
+ * The counters are read in a single batch from the program's counters map.
+ *
+ * @param cgen Codegen to get the counters for. Can't be NULL.
+ * @param counters On success, points to an array of @p *n_counters counters:
+ *        one per rule, in the rules' order, followed by the policy counter.
+ *        The caller owns the array. Can't be NULL.
+ * @param n_counters On success, contains the number of counters in
+ *        @p *counters . Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_cgen_get_counters(const struct bf_cgen *cgen,
+                         struct bf_counter **counters, size_t *n_counters);
+
+/**
+ * Get the telemetry counters of the program containing a codegen's chain.
+ *
+ * Telemetry counters are shared by all the chains of a program.
+ *
+ * @param cgen Codegen to get the telemetry counters for. Can't be NULL.
+ * @param counters Array of @ref _BF_TELEMETRY_MAX counters to fill, indexed
+ *        by @ref bf_telemetry . Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. Returns
+ *         @c -ENOENT if the program has no telemetry map.
+ */
+int bf_cgen_get_telemetry(const struct bf_cgen *cgen,
+                          struct bf_counter *counters);
+
+/**
+ * Get the kernel's runtime statistics of the program containing a codegen's
+ * chain.
+ *
+ * Chains sharing a program share its statistics.
+ *
+ * @param cgen Codegen to get the statistics for. Can't be NULL.
+ * @param stats Statistics to fill. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_cgen_get_stats(const struct bf_cgen *cgen, struct bf_prog_stats *stats);
+
+/**
+ * Get the profiling histograms of a codegen's chain.
+ *
+ * The first histogram is the program's prologue, shared by all the chains of
+ * the program. It is followed by one histogram per block of @p block_size
+ * rules of the chain. Each histogram contains @ref BF_PROFILE_N_BUCKETS
+ * values.
+ *
+ * @param cgen Codegen to get the profiling histograms for. Can't be NULL.
+ * @param block_size On success, contains the number of rules per profiling
+ *        block. Can't be NULL.
+ * @param hist On success, points to an array of @p n_blocks histograms.
+ *        Owned by the caller. Can't be NULL.
+ * @param n_blocks On success, contains the number of histograms in @p hist .
+ *        Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. Returns
+ *         @c -ENOENT if the program has no profiling map.
+ */
+int bf_cgen_get_profile(const struct bf_cgen *cgen, uint32_t *block_size,
+                        uint64_t **hist, size_t *n_blocks);
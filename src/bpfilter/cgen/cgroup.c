@@ -7,7 +7,13 @@
 
 #include <linux/bpf_common.h>
 #include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
 
+#include <errno.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/socket.h>
@@ -23,6 +29,7 @@
 #include "core/hook.h"
 #include "core/list.h"
 #include "core/logger.h"
+#include "core/matcher.h"
 #include "core/verdict.h"
 #include "linux/bpf.h"
 
@@ -36,6 +43,9 @@ static int _bf_cgroup_attach_prog(
     int (*get_new_link_cb)(struct bf_program *prog, struct bf_link *old_link,
                            struct bf_link **new_link));
 static int _bf_cgroup_detach_prog(struct bf_program *program);
+static int _bf_cgroup_sock_addr_gen_inline_prologue(struct bf_program *program);
+static int _bf_cgroup_sock_addr_check_matcher(const struct bf_program *program,
+                                              const struct bf_matcher *matcher);
 
 const struct bf_flavor_ops bf_flavor_ops_cgroup = {
     .gen_inline_prologue = _bf_cgroup_gen_inline_prologue,
@@ -45,6 +55,17 @@ const struct bf_flavor_ops bf_flavor_ops_cgroup = {
     .detach_prog = _bf_cgroup_detach_prog,
 };
 
+/* Socket address programs are attached to a cgroup the same way as the
+ * cgroup_skb programs, and share the same return codes. */
+const struct bf_flavor_ops bf_flavor_ops_cgroup_sock_addr = {
+    .gen_inline_prologue = _bf_cgroup_sock_addr_gen_inline_prologue,
+    .gen_inline_epilogue = _bf_cgroup_gen_inline_epilogue,
+    .get_verdict = _bf_cgroup_get_verdict,
+    .check_matcher = _bf_cgroup_sock_addr_check_matcher,
+    .attach_prog = _bf_cgroup_attach_prog,
+    .detach_prog = _bf_cgroup_detach_prog,
+};
+
 // Forward definition to avoid headers clusterfuck.
 uint16_t htons(uint16_t hostshort);
 
@@ -194,3 +215,155 @@ static int _bf_cgroup_detach_prog(struct bf_program *program)
 
     return bf_link_detach(bf_list_get_at(&program->links, 0));
 }
+
+static inline bool _bf_cgroup_sock_addr_hook_is_ip4(enum bf_hook hook)
+{
+    return hook == BF_HOOK_CGROUP_INET4_CONNECT ||
+           hook == BF_HOOK_CGROUP_UDP4_SENDMSG;
+}
+
+static inline bool _bf_cgroup_sock_addr_hook_is_sendmsg(enum bf_hook hook)
+{
+    return hook == BF_HOOK_CGROUP_UDP4_SENDMSG ||
+           hook == BF_HOOK_CGROUP_UDP6_SENDMSG;
+}
+
+/**
+ * Generate the prologue of a socket address program.
+ *
+ * There is no packet to parse for socket address programs, instead the
+ * destination address and port are read from the @c bpf_sock_addr context.
+ * To reuse the existing matchers, the L3 and L4 headers are built in the
+ * runtime context from the @c bpf_sock_addr fields: the destination address,
+ * destination port, and L4 protocol are always defined. For @c sendmsg()
+ * hooks, the source address is defined as well. Every other field is set to
+ * 0, and the matchers relying on them are rejected by
+ * @ref _bf_cgroup_sock_addr_check_matcher .
+ *
+ * @param program Program to generate the prologue for. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_cgroup_sock_addr_gen_inline_prologue(struct bf_program *program)
+{
+    bool is_ip4;
+    bool is_sendmsg;
+
+    bf_assert(program);
+
+    is_ip4 = _bf_cgroup_sock_addr_hook_is_ip4(program->hook);
+    is_sendmsg = _bf_cgroup_sock_addr_hook_is_sendmsg(program->hook);
+
+    // No packet to count: the counters only count calls
+    EMIT(program, BPF_ST_MEM(BPF_DW, BPF_REG_10, BF_PROG_CTX_OFF(pkt_size), 0));
+    EMIT(program, BPF_ST_MEM(BPF_W, BPF_REG_10, BF_PROG_CTX_OFF(ifindex), 0));
+    EMIT(program, BPF_ST_MEM(BPF_W, BPF_REG_10, BF_PROG_CTX_OFF(l3_offset), 0));
+    EMIT(program, BPF_ST_MEM(BPF_W, BPF_REG_10, BF_PROG_CTX_OFF(l4_offset), 0));
+
+    for (size_t i = 0; i < sizeof(union _bf_l3); i += sizeof(uint64_t)) {
+        EMIT(program,
+             BPF_ST_MEM(BPF_DW, BPF_REG_10, BF_PROG_CTX_OFF(l3) + i, 0));
+    }
+
+    for (size_t i = 0; i < sizeof(union _bf_l4); i += sizeof(uint64_t)) {
+        EMIT(program,
+             BPF_ST_MEM(BPF_DW, BPF_REG_10, BF_PROG_CTX_OFF(l4) + i, 0));
+    }
+
+    EMIT(program,
+         BPF_MOV64_IMM(BPF_REG_7, htons(is_ip4 ? ETH_P_IP : ETH_P_IPV6)));
+    EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_8, BPF_REG_1,
+                              offsetof(struct bpf_sock_addr, protocol)));
+
+    if (is_ip4) {
+        EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+                                  offsetof(struct bpf_sock_addr, user_ip4)));
+        EMIT(program, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_2,
+                                  BF_PROG_CTX_OFF(l3.ip4.daddr)));
+
+        if (is_sendmsg) {
+            EMIT(program,
+                 BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+                             offsetof(struct bpf_sock_addr, msg_src_ip4)));
+            EMIT(program, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_2,
+                                      BF_PROG_CTX_OFF(l3.ip4.saddr)));
+        }
+
+        EMIT(program, BPF_STX_MEM(BPF_B, BPF_REG_10, BPF_REG_8,
+                                  BF_PROG_CTX_OFF(l3.ip4.protocol)));
+    } else {
+        for (size_t i = 0; i < 4; ++i) {
+            EMIT(program,
+                 BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+                             offsetof(struct bpf_sock_addr, user_ip6[i])));
+            EMIT(program, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_2,
+                                      BF_PROG_CTX_OFF(l3.ip6.daddr) +
+                                          i * sizeof(uint32_t)));
+
+            if (!is_sendmsg)
+                continue;
+
+            EMIT(program,
+                 BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+                             offsetof(struct bpf_sock_addr, msg_src_ip6[i])));
+            EMIT(program, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_2,
+                                      BF_PROG_CTX_OFF(l3.ip6.saddr) +
+                                          i * sizeof(uint32_t)));
+        }
+
+        EMIT(program, BPF_STX_MEM(BPF_B, BPF_REG_10, BPF_REG_8,
+                                  BF_PROG_CTX_OFF(l3.ip6.nexthdr)));
+    }
+
+    /* user_port contains the port in network byte order in its lower 16
+     * bits. The destination port is located at the same offset in the TCP
+     * and UDP headers. */
+    static_assert(offsetof(struct tcphdr, dest) ==
+                  offsetof(struct udphdr, dest));
+    EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+                              offsetof(struct bpf_sock_addr, user_port)));
+    EMIT(program, BPF_STX_MEM(BPF_H, BPF_REG_10, BPF_REG_2,
+                              BF_PROG_CTX_OFF(l4.tcp.dest)));
+
+    // Point the matchers to the headers built in the runtime context
+    EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_10));
+    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, BF_PROG_CTX_OFF(l3)));
+    EMIT(program,
+         BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_2, BF_PROG_CTX_OFF(l3_hdr)));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_10));
+    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, BF_PROG_CTX_OFF(l4)));
+    EMIT(program,
+         BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_2, BF_PROG_CTX_OFF(l4_hdr)));
+
+    return 0;
+}
+
+static int _bf_cgroup_sock_addr_check_matcher(const struct bf_program *program,
+                                              const struct bf_matcher *matcher)
+{
+    bf_assert(program && matcher);
+
+    switch (matcher->type) {
+    case BF_MATCHER_META_L3_PROTO:
+    case BF_MATCHER_META_L4_PROTO:
+    case BF_MATCHER_META_DPORT:
+    case BF_MATCHER_IP4_DST_ADDR:
+    case BF_MATCHER_IP4_PROTO:
+    case BF_MATCHER_IP6_DADDR:
+    case BF_MATCHER_TCP_DPORT:
+    case BF_MATCHER_UDP_DPORT:
+        return 0;
+    case BF_MATCHER_IP4_SRC_ADDR:
+    case BF_MATCHER_IP6_SADDR:
+    case BF_MATCHER_SET_SRCIP6:
+        // The source address is only known when sendmsg() is called
+        if (_bf_cgroup_sock_addr_hook_is_sendmsg(program->hook))
+            return 0;
+        break;
+    default:
+        break;
+    }
+
+    return bf_err_r(-ENOTSUP, "matcher '%s' is not supported by %s",
+                    bf_matcher_type_to_str(matcher->type),
+                    bf_hook_to_str(program->hook));
+}
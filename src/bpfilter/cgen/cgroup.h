@@ -8,3 +8,16 @@
 #include "core/flavor.h"
 
 extern const struct bf_flavor_ops bf_flavor_ops_cgroup;
+
+/**
+ * Flavor operations for the cgroup socket address hooks
+ * (@c BF_HOOK_CGROUP_*_CONNECT and @c BF_HOOK_CGROUP_*_SENDMSG ).
+ *
+ * cgroup socket address programs are called on @c connect() and
+ * @c sendmsg() instead of for every packet:
+ * - Input: <tt>struct bpf_sock_addr</tt>
+ * - Headers available: none, the destination address and port are read from
+ *   the context.
+ * - Return code: 0 to reject the call, 1 to allow it
+ */
+extern const struct bf_flavor_ops bf_flavor_ops_cgroup_sock_addr;
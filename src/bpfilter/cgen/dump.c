@@ -12,6 +12,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "bpfilter/cgen/program.h"
 #include "core/btf.h"
@@ -35,14 +36,19 @@ static void _bf_print_insn(void *private_data, const char *fmt, ...)
 {
     va_list args;
     struct bf_dump_data *bfdd = private_data;
+    char insn[256];
+    size_t len;
 
     va_start(args, fmt);
-    (void)fprintf(stderr, "%s%-7s%s: %s %4ld: ",
-                  bf_logger_get_color(BF_COLOR_BLUE, BF_STYLE_BOLD), "debug",
-                  bf_logger_get_color(BF_COLOR_RESET, BF_STYLE_RESET),
-                  *(bfdd->prefix), bfdd->idx);
-    (void)vfprintf(stderr, fmt, args);
+    (void)vsnprintf(insn, sizeof(insn), fmt, args);
     va_end(args);
+
+    // The instruction ends with a newline, which is added by the logger.
+    len = strlen(insn);
+    if (len && insn[len - 1] == '\n')
+        insn[len - 1] = '\0';
+
+    bf_log(BF_LOG_DBG, "%s %4ld: %s", *(bfdd->prefix), bfdd->idx, insn);
 }
 
 static const char *_bf_print_call(void *private_data,
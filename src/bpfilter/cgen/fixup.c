@@ -43,10 +43,16 @@ static const char *_bf_fixup_type_to_str(enum bf_fixup_type type)
 {
     static const char *str[] = {
         [BF_FIXUP_TYPE_JMP_NEXT_RULE] = "BF_FIXUP_TYPE_JMP_NEXT_RULE",
+        [BF_FIXUP_TYPE_JMP_NEXT_CHAIN] = "BF_FIXUP_TYPE_JMP_NEXT_CHAIN",
         [BF_FIXUP_TYPE_COUNTERS_MAP_FD] = "BF_FIXUP_TYPE_COUNTERS_MAP_FD",
         [BF_FIXUP_TYPE_PRINTER_MAP_FD] = "BF_FIXUP_TYPE_PRINTER_MAP_FD",
         [BF_FIXUP_TYPE_SET_MAP_FD] = "BF_FIXUP_TYPE_SET_MAP_FD",
+        [BF_FIXUP_TYPE_TELEMETRY_MAP_FD] = "BF_FIXUP_TYPE_TELEMETRY_MAP_FD",
+        [BF_FIXUP_TYPE_PROFILE_MAP_FD] = "BF_FIXUP_TYPE_PROFILE_MAP_FD",
+        [BF_FIXUP_TYPE_RULES_MAP_FD] = "BF_FIXUP_TYPE_RULES_MAP_FD",
+        [BF_FIXUP_TYPE_TSS_MAP_FD] = "BF_FIXUP_TYPE_TSS_MAP_FD",
         [BF_FIXUP_TYPE_FUNC_CALL] = "BF_FIXUP_TYPE_FUNC_CALL",
+        [BF_FIXUP_TYPE_SUBCHAIN_CALL] = "BF_FIXUP_TYPE_SUBCHAIN_CALL",
     };
 
     bf_assert(0 <= type && type < _BF_FIXUP_TYPE_MAX);
@@ -59,6 +65,10 @@ static const char *_bf_fixup_func_to_str(enum bf_fixup_func func)
 {
     static const char *str[] = {
         [BF_FIXUP_FUNC_UPDATE_COUNTERS] = "BF_FIXUP_FUNC_UPDATE_COUNTERS",
+        [BF_FIXUP_FUNC_CT_LOOKUP] = "BF_FIXUP_FUNC_CT_LOOKUP",
+        [BF_FIXUP_FUNC_UPDATE_TELEMETRY] = "BF_FIXUP_FUNC_UPDATE_TELEMETRY",
+        [BF_FIXUP_FUNC_PROFILE] = "BF_FIXUP_FUNC_PROFILE",
+        [BF_FIXUP_FUNC_INTERP_RULE] = "BF_FIXUP_FUNC_INTERP_RULE",
     };
 
     bf_assert(0 <= func && func < _BF_FIXUP_FUNC_MAX);
@@ -81,17 +91,28 @@ void bf_fixup_dump(const struct bf_fixup *fixup, prefix_t *prefix)
 
     switch (fixup->type) {
     case BF_FIXUP_TYPE_JMP_NEXT_RULE:
+    case BF_FIXUP_TYPE_JMP_NEXT_CHAIN:
     case BF_FIXUP_TYPE_COUNTERS_MAP_FD:
     case BF_FIXUP_TYPE_PRINTER_MAP_FD:
+    case BF_FIXUP_TYPE_TELEMETRY_MAP_FD:
+    case BF_FIXUP_TYPE_PROFILE_MAP_FD:
+    case BF_FIXUP_TYPE_RULES_MAP_FD:
         // No specific value to dump
         break;
     case BF_FIXUP_TYPE_SET_MAP_FD:
         DUMP(prefix, "set_index: %lu", fixup->attr.set_index);
         break;
+    case BF_FIXUP_TYPE_TSS_MAP_FD:
+        DUMP(prefix, "tuple_index: %lu", fixup->attr.tuple_index);
+        break;
     case BF_FIXUP_TYPE_FUNC_CALL:
         DUMP(prefix, "function: %s",
              _bf_fixup_func_to_str(fixup->attr.function));
         break;
+    case BF_FIXUP_TYPE_SUBCHAIN_CALL:
+        DUMP(prefix, "subchain: section %u, index %u",
+             fixup->attr.subchain.section, fixup->attr.subchain.index);
+        break;
     default:
         DUMP(prefix, "unsupported bf_fixup_type: %d", fixup->type);
         break;
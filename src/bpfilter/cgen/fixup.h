@@ -6,6 +6,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "core/dump.h"
 
@@ -28,6 +29,10 @@ enum bf_fixup_insn
 enum bf_fixup_func
 {
     BF_FIXUP_FUNC_UPDATE_COUNTERS,
+    BF_FIXUP_FUNC_CT_LOOKUP,
+    BF_FIXUP_FUNC_UPDATE_TELEMETRY,
+    BF_FIXUP_FUNC_PROFILE,
+    BF_FIXUP_FUNC_INTERP_RULE,
     _BF_FIXUP_FUNC_MAX,
 };
 
@@ -40,21 +45,47 @@ enum bf_fixup_type
 {
     /// Jump to the beginning of the next rule.
     BF_FIXUP_TYPE_JMP_NEXT_RULE,
+    /** Jump to the beginning of the next chain, for programs generated from
+     * multiple chains. */
+    BF_FIXUP_TYPE_JMP_NEXT_CHAIN,
     /// Set the counters map file descriptor in the @c BPF_LD_MAP_FD instruction.
     BF_FIXUP_TYPE_COUNTERS_MAP_FD,
     /// Set the printer map file descriptor in the @c BPF_LD_MAP_FD instruction.
     BF_FIXUP_TYPE_PRINTER_MAP_FD,
     /// Set a set map file descriptor in the @c BPF_LD_MAP_FD instruction.
     BF_FIXUP_TYPE_SET_MAP_FD,
-    /// Jump to a custom function.
+    /// Set the telemetry map file descriptor in the @c BPF_LD_MAP_FD
+    /// instruction.
+    BF_FIXUP_TYPE_TELEMETRY_MAP_FD,
+    /// Set the profiling map file descriptor in the @c BPF_LD_MAP_FD
+    /// instruction.
+    BF_FIXUP_TYPE_PROFILE_MAP_FD,
+    /// Set the rules map file descriptor in the @c BPF_LD_MAP_FD instruction.
+    BF_FIXUP_TYPE_RULES_MAP_FD,
+    /// Set a classifier tuple map file descriptor in the @c BPF_LD_MAP_FD
+    /// instruction.
+    BF_FIXUP_TYPE_TSS_MAP_FD,
+    /// Jump to a custom function, or load its address if the instruction is
+    /// a @c BPF_LD_IMM64 with @c BPF_PSEUDO_FUNC .
     BF_FIXUP_TYPE_FUNC_CALL,
+    /// Call the function generated for a sub-chain.
+    BF_FIXUP_TYPE_SUBCHAIN_CALL,
     _BF_FIXUP_TYPE_MAX
 };
 
 union bf_fixup_attr
 {
     size_t set_index;
+    /// Index of the tuple's map in @ref bf_program.tss .
+    size_t tuple_index;
     enum bf_fixup_func function;
+    /// Sub-chain to call: index of its chain's section in the program, and
+    /// index of the sub-chain in the chain.
+    struct
+    {
+        uint32_t section;
+        uint32_t index;
+    } subchain;
 };
 
 struct bf_fixup
@@ -0,0 +1,636 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "bpfilter/cgen/interp.h"
+
+#include <linux/bpf.h>
+#include <linux/bpf_common.h>
+#include <linux/if_ether.h>
+#include <linux/in.h> // NOLINT
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+
+#include <endian.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bpfilter/cgen/fixup.h"
+#include "bpfilter/cgen/jmp.h"
+#include "bpfilter/cgen/program.h"
+#include "bpfilter/cgen/prog/map.h"
+#include "core/bpf.h"
+#include "core/chain.h"
+#include "core/helper.h"
+#include "core/hook.h"
+#include "core/list.h"
+#include "core/logger.h"
+#include "core/matcher.h"
+#include "core/rule.h"
+#include "core/verdict.h"
+
+#include "external/filter.h"
+
+/* Layout of the scratch area while the rules of an interpreted chain are
+ * evaluated: the verdict of the matching rule, the index of the chain's
+ * first record in the rules map, and the L3 and L4 protocol IDs, as the
+ * registers of the main function are not available to the callback function
+ * of bpf_loop(). */
+#define _BF_INTERP_SCR_VERDICT 0
+#define _BF_INTERP_SCR_OFFSET 4
+#define _BF_INTERP_SCR_L3_PROTO 8
+#define _BF_INTERP_SCR_L4_PROTO 16
+
+static int _bf_interp_cond_encode(struct bf_interp_cond *cond,
+                                  const struct bf_matcher *matcher)
+{
+    const struct bf_matcher_ip4_addr *ip4;
+    const struct bf_matcher_ip6_addr *ip6;
+    uint8_t ip6_value[16];
+
+    bf_assert(cond && matcher);
+
+    if (matcher->op != BF_MATCHER_EQ && matcher->op != BF_MATCHER_NE) {
+        return bf_err_r(-ENOTSUP,
+                        "operator '%s' can't be used in interpreted mode",
+                        bf_matcher_op_to_str(matcher->op));
+    }
+
+    *cond = (struct bf_interp_cond) {
+        .field = matcher->type,
+        .op = matcher->op,
+        .mask = {UINT64_MAX, 0},
+    };
+
+    switch (matcher->type) {
+    case BF_MATCHER_META_IFINDEX:
+        cond->value[0] = *(uint32_t *)matcher->payload;
+        break;
+    case BF_MATCHER_META_L3_PROTO:
+        cond->value[0] = htobe16(*(uint16_t *)matcher->payload);
+        break;
+    case BF_MATCHER_META_L4_PROTO:
+    case BF_MATCHER_IP4_PROTO:
+        cond->value[0] = *(uint8_t *)matcher->payload;
+        break;
+    case BF_MATCHER_META_SPORT:
+    case BF_MATCHER_META_DPORT:
+    case BF_MATCHER_TCP_SPORT:
+    case BF_MATCHER_TCP_DPORT:
+    case BF_MATCHER_UDP_SPORT:
+    case BF_MATCHER_UDP_DPORT:
+        cond->value[0] = htobe16(*(uint16_t *)matcher->payload);
+        break;
+    case BF_MATCHER_IP4_SRC_ADDR:
+    case BF_MATCHER_IP4_DST_ADDR:
+        ip4 = (const void *)matcher->payload;
+        cond->value[0] = ip4->addr & ip4->mask;
+        cond->mask[0] = ip4->mask;
+        break;
+    case BF_MATCHER_IP6_SADDR:
+    case BF_MATCHER_IP6_DADDR:
+        ip6 = (const void *)matcher->payload;
+        for (size_t i = 0; i < sizeof(ip6_value); ++i)
+            ip6_value[i] = ip6->addr[i] & ip6->mask[i];
+
+        memcpy(cond->value, ip6_value, sizeof(ip6_value));
+        memcpy(cond->mask, ip6->mask, sizeof(ip6->mask));
+        break;
+    default:
+        return bf_err_r(-ENOTSUP,
+                        "matcher '%s' can't be used in interpreted mode",
+                        bf_matcher_type_to_str(matcher->type));
+    }
+
+    return 0;
+}
+
+int bf_interp_rule_encode(struct bf_interp_rule *record,
+                          const struct bf_rule *rule, uint32_t counter)
+{
+    size_t i = 0;
+    int r;
+
+    bf_assert(record && rule);
+
+    switch (rule->verdict) {
+    case BF_VERDICT_ACCEPT:
+    case BF_VERDICT_DROP:
+    case BF_VERDICT_CONTINUE:
+        break;
+    default:
+        return bf_err_r(-ENOTSUP,
+                        "verdict '%s' can't be used in interpreted mode",
+                        bf_verdict_to_str(rule->verdict));
+    }
+
+    if (rule->set_add)
+        return bf_err_r(-ENOTSUP, "sets can't be used in interpreted mode");
+
+    if (bf_list_size(&rule->matchers) > BF_INTERP_MAX_CONDS) {
+        return bf_err_r(-ENOTSUP,
+                        "interpreted rules can't have more than %d matchers",
+                        BF_INTERP_MAX_CONDS);
+    }
+
+    *record = (struct bf_interp_rule) {
+        .flags = rule->counters ? BF_INTERP_RULE_COUNTERS : 0,
+        .n_conds = bf_list_size(&rule->matchers),
+        .verdict = rule->verdict,
+        .counter = counter,
+    };
+
+    bf_list_foreach (&rule->matchers, matcher_node) {
+        r = _bf_interp_cond_encode(&record->conds[i++],
+                                   bf_list_node_get_data(matcher_node));
+        if (r)
+            return r;
+    }
+
+    return 0;
+}
+
+/**
+ * Generate the bytecode to load a packet's field matched by an interpreted
+ * rule.
+ *
+ * The field is loaded into @c r1 , and @c r2 for the 64 MSB of IPv6
+ * addresses. If the packet doesn't contain the field's header, jump to the
+ * next rule.
+ *
+ * @param program Program to generate the bytecode for. Can't be NULL.
+ * @param field Field to load.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_interp_generate_field(struct bf_program *program,
+                                     enum bf_matcher_type field)
+{
+    bf_assert(program);
+
+    switch (field) {
+    case BF_MATCHER_META_IFINDEX:
+        EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_9,
+                                  BF_PROG_CTX_OFF(ifindex)));
+        break;
+    case BF_MATCHER_META_L3_PROTO:
+        EMIT(program, BPF_MOV64_REG(BPF_REG_1, BPF_REG_7));
+        break;
+    case BF_MATCHER_META_L4_PROTO:
+        EMIT(program, BPF_MOV64_REG(BPF_REG_1, BPF_REG_8));
+        break;
+    case BF_MATCHER_META_SPORT:
+    case BF_MATCHER_META_DPORT: {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+            program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_8, IPPROTO_TCP, 0));
+
+        EMIT_FIXUP_JMP_NEXT_RULE(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_8, IPPROTO_UDP, 0));
+    }
+        // TCP and UDP headers start with the source and destination ports.
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_4, BPF_REG_9,
+                                  BF_PROG_CTX_OFF(l4_hdr)));
+        EMIT(program, BPF_LDX_MEM(BPF_H, BPF_REG_1, BPF_REG_4,
+                                  field == BF_MATCHER_META_SPORT ?
+                                      offsetof(struct tcphdr, source) :
+                                      offsetof(struct tcphdr, dest)));
+        break;
+    case BF_MATCHER_IP4_SRC_ADDR:
+    case BF_MATCHER_IP4_DST_ADDR:
+    case BF_MATCHER_IP4_PROTO:
+        EMIT_FIXUP_JMP_NEXT_RULE(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_7, htobe16(ETH_P_IP), 0));
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_4, BPF_REG_9,
+                                  BF_PROG_CTX_OFF(l3_hdr)));
+        if (field == BF_MATCHER_IP4_PROTO) {
+            EMIT(program, BPF_LDX_MEM(BPF_B, BPF_REG_1, BPF_REG_4,
+                                      offsetof(struct iphdr, protocol)));
+        } else {
+            EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_4,
+                                      field == BF_MATCHER_IP4_SRC_ADDR ?
+                                          offsetof(struct iphdr, saddr) :
+                                          offsetof(struct iphdr, daddr)));
+        }
+        break;
+    case BF_MATCHER_IP6_SADDR:
+    case BF_MATCHER_IP6_DADDR: {
+        size_t offset = field == BF_MATCHER_IP6_SADDR ?
+                            offsetof(struct ipv6hdr, saddr) :
+                            offsetof(struct ipv6hdr, daddr);
+
+        EMIT_FIXUP_JMP_NEXT_RULE(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_7, htobe16(ETH_P_IPV6), 0));
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_4, BPF_REG_9,
+                                  BF_PROG_CTX_OFF(l3_hdr)));
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_4, offset));
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_4, offset + 8));
+        break;
+    }
+    case BF_MATCHER_TCP_SPORT:
+    case BF_MATCHER_TCP_DPORT:
+        EMIT_FIXUP_JMP_NEXT_RULE(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_8, IPPROTO_TCP, 0));
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_4, BPF_REG_9,
+                                  BF_PROG_CTX_OFF(l4_hdr)));
+        EMIT(program, BPF_LDX_MEM(BPF_H, BPF_REG_1, BPF_REG_4,
+                                  field == BF_MATCHER_TCP_SPORT ?
+                                      offsetof(struct tcphdr, source) :
+                                      offsetof(struct tcphdr, dest)));
+        break;
+    case BF_MATCHER_UDP_SPORT:
+    case BF_MATCHER_UDP_DPORT:
+        EMIT_FIXUP_JMP_NEXT_RULE(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_8, IPPROTO_UDP, 0));
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_4, BPF_REG_9,
+                                  BF_PROG_CTX_OFF(l4_hdr)));
+        EMIT(program, BPF_LDX_MEM(BPF_H, BPF_REG_1, BPF_REG_4,
+                                  field == BF_MATCHER_UDP_SPORT ?
+                                      offsetof(struct udphdr, source) :
+                                      offsetof(struct udphdr, dest)));
+        break;
+    default:
+        return bf_err_r(-ENOTSUP, "can't interpret matcher type %d", field);
+    }
+
+    return 0;
+}
+
+/**
+ * Generate the bytecode to evaluate a condition of an interpreted rule.
+ *
+ * The field is dispatched at runtime, according to the condition's
+ * @ref bf_interp_cond::field . If the condition doesn't match, jump to the
+ * next rule.
+ *
+ * @param program Program to generate the bytecode for. Can't be NULL.
+ * @param off Offset of the @ref bf_interp_cond in the record, which address
+ *        is in @c r6 .
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_interp_generate_cond(struct bf_program *program, size_t off)
+{
+    static const enum bf_matcher_type fields[] = {
+        BF_MATCHER_META_IFINDEX, BF_MATCHER_META_L3_PROTO,
+        BF_MATCHER_META_L4_PROTO, BF_MATCHER_META_SPORT,
+        BF_MATCHER_META_DPORT,   BF_MATCHER_IP4_SRC_ADDR,
+        BF_MATCHER_IP4_DST_ADDR, BF_MATCHER_IP4_PROTO,
+        BF_MATCHER_IP6_SADDR,    BF_MATCHER_IP6_DADDR,
+        BF_MATCHER_TCP_SPORT,    BF_MATCHER_TCP_DPORT,
+        BF_MATCHER_UDP_SPORT,    BF_MATCHER_UDP_DPORT,
+    };
+    struct bf_jmpctx loaded[ARRAY_SIZE(fields)];
+    struct bf_jmpctx done;
+    struct bf_jmpctx ne;
+    int r;
+
+    bf_assert(program);
+
+    EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_6,
+                              off + offsetof(struct bf_interp_cond, field)));
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_2, 0));
+
+    for (size_t i = 0; i < ARRAY_SIZE(fields); ++i) {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_3, fields[i], 0));
+
+        r = _bf_interp_generate_field(program, fields[i]);
+        if (r)
+            return r;
+
+        loaded[i] = bf_jmpctx_get(program, BPF_JMP_A(0));
+    }
+
+    // Unknown field, the rule can't match
+    EMIT_FIXUP_JMP_NEXT_RULE(program, BPF_JMP_A(0));
+
+    for (size_t i = 0; i < ARRAY_SIZE(fields); ++i)
+        bf_jmpctx_cleanup(&loaded[i]);
+
+    EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_3, BPF_REG_6,
+                              off + offsetof(struct bf_interp_cond, mask)));
+    EMIT(program, BPF_ALU64_REG(BPF_AND, BPF_REG_1, BPF_REG_3));
+    EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_3, BPF_REG_6,
+                              off + offsetof(struct bf_interp_cond, mask) + 8));
+    EMIT(program, BPF_ALU64_REG(BPF_AND, BPF_REG_2, BPF_REG_3));
+    EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_3, BPF_REG_6,
+                              off + offsetof(struct bf_interp_cond, value)));
+    EMIT(program,
+         BPF_LDX_MEM(BPF_DW, BPF_REG_4, BPF_REG_6,
+                     off + offsetof(struct bf_interp_cond, value) + 8));
+    EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_5, BPF_REG_6,
+                              off + offsetof(struct bf_interp_cond, op)));
+
+    ne = bf_jmpctx_get(program,
+                       BPF_JMP_IMM(BPF_JEQ, BPF_REG_5, BF_MATCHER_NE, 0));
+
+    // BF_MATCHER_EQ: both words must be equal
+    EMIT_FIXUP_JMP_NEXT_RULE(program,
+                             BPF_JMP_REG(BPF_JNE, BPF_REG_1, BPF_REG_3, 0));
+    EMIT_FIXUP_JMP_NEXT_RULE(program,
+                             BPF_JMP_REG(BPF_JNE, BPF_REG_2, BPF_REG_4, 0));
+    done = bf_jmpctx_get(program, BPF_JMP_A(0));
+
+    // BF_MATCHER_NE: at least one word must be different
+    bf_jmpctx_cleanup(&ne);
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+            program, BPF_JMP_REG(BPF_JNE, BPF_REG_1, BPF_REG_3, 0));
+
+        EMIT_FIXUP_JMP_NEXT_RULE(
+            program, BPF_JMP_REG(BPF_JEQ, BPF_REG_2, BPF_REG_4, 0));
+    }
+
+    bf_jmpctx_cleanup(&done);
+
+    return 0;
+}
+
+int bf_interp_generate_rule(struct bf_program *program)
+{
+    const struct bpf_insn ld_insn[2] = {BPF_LD_MAP_FD(BPF_REG_1, 0)};
+    struct bf_jmpctx matched[BF_INTERP_MAX_CONDS];
+    int r;
+
+    bf_assert(program);
+
+    EMIT(program, BPF_MOV64_REG(BPF_REG_9, BPF_REG_2));
+    EMIT(program,
+         BPF_LDX_MEM(BPF_DW, BPF_REG_7, BPF_REG_9,
+                     BF_PROG_SCR_OFF(_BF_INTERP_SCR_L3_PROTO)));
+    EMIT(program,
+         BPF_LDX_MEM(BPF_DW, BPF_REG_8, BPF_REG_9,
+                     BF_PROG_SCR_OFF(_BF_INTERP_SCR_L4_PROTO)));
+
+    // Get the record from the rules map
+    EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_9,
+                              BF_PROG_SCR_OFF(_BF_INTERP_SCR_OFFSET)));
+    EMIT(program, BPF_ALU32_REG(BPF_ADD, BPF_REG_1, BPF_REG_2));
+    EMIT(program, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, -8));
+    r = bf_program_emit_fixup(program, BF_FIXUP_TYPE_RULES_MAP_FD, ld_insn[0],
+                              NULL);
+    if (r)
+        return r;
+    EMIT(program, ld_insn[1]);
+    EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_10));
+    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -8));
+    EMIT(program, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_6, BPF_REG_0));
+
+    // Stop if the record doesn't exist, or follows the chain's last rule
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_0, 1));
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+            bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JNE, BPF_REG_6, 0, 0));
+
+        EMIT(program, BPF_EXIT_INSN());
+    }
+
+    EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_6,
+                              offsetof(struct bf_interp_rule, flags)));
+    EMIT(program, BPF_ALU32_IMM(BPF_AND, BPF_REG_1, BF_INTERP_RULE_END));
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+            bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_1, 0, 0));
+
+        EMIT(program, BPF_EXIT_INSN());
+    }
+
+    /* The conditions are unrolled, so the function's size doesn't depend on
+     * the rules. Once all the record's conditions matched, jump to the
+     * verdict. */
+    for (size_t i = 0; i < BF_INTERP_MAX_CONDS; ++i) {
+        EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_6,
+                                  offsetof(struct bf_interp_rule, n_conds)));
+        matched[i] =
+            bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JLE, BPF_REG_1, i, 0));
+
+        r = _bf_interp_generate_cond(
+            program, offsetof(struct bf_interp_rule, conds) +
+                         (i * sizeof(struct bf_interp_cond)));
+        if (r)
+            return r;
+    }
+
+    for (size_t i = 0; i < BF_INTERP_MAX_CONDS; ++i)
+        bf_jmpctx_cleanup(&matched[i]);
+
+    EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_6,
+                              offsetof(struct bf_interp_rule, flags)));
+    EMIT(program, BPF_ALU32_IMM(BPF_AND, BPF_REG_1, BF_INTERP_RULE_COUNTERS));
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+            bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_1, 0, 0));
+
+        EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_6,
+                                  offsetof(struct bf_interp_rule, counter)));
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_9,
+                                  BF_PROG_CTX_OFF(pkt_size)));
+        EMIT_FIXUP_CALL(program, BF_FIXUP_FUNC_UPDATE_COUNTERS);
+    }
+
+    EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_6,
+                              offsetof(struct bf_interp_rule, verdict)));
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_0, 0));
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_1, BF_VERDICT_CONTINUE, 0));
+
+        EMIT(program, BPF_EXIT_INSN());
+    }
+
+    EMIT(program,
+         BPF_STX_MEM(BPF_W, BPF_REG_9, BPF_REG_1,
+                     BF_PROG_SCR_OFF(_BF_INTERP_SCR_VERDICT)));
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_0, 1));
+    EMIT(program, BPF_EXIT_INSN());
+
+    // The rule doesn't match, continue with the next record
+    r = bf_program_fixup(program, BF_FIXUP_TYPE_JMP_NEXT_RULE);
+    if (r)
+        return bf_err_r(r, "failed to generate next rule fixups");
+
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_0, 0));
+    EMIT(program, BPF_EXIT_INSN());
+
+    return 0;
+}
+
+int bf_interp_generate_chain(struct bf_program *program)
+{
+    const struct bf_chain *chain = program->runtime.cur_chain;
+    const struct bf_program_section *section = program->runtime.cur_section;
+    union bf_fixup_attr attr = {.function = BF_FIXUP_FUNC_INTERP_RULE};
+    const struct bpf_insn ld_insn[2] = {
+        BPF_LD_IMM64_RAW(BPF_REG_2, BPF_PSEUDO_FUNC, 0)};
+    struct bf_interp_rule record;
+    int r;
+
+    bf_assert(chain && section);
+
+    bf_list_foreach (&chain->rules, rule_node) {
+        r = bf_interp_rule_encode(&record, bf_list_node_get_data(rule_node),
+                                  0);
+        if (r)
+            return bf_err_r(r, "failed to encode interpreted rule");
+    }
+
+    EMIT(program,
+         BPF_ST_MEM(BPF_W, BPF_REG_9,
+                    BF_PROG_SCR_OFF(_BF_INTERP_SCR_VERDICT),
+                    BF_VERDICT_CONTINUE));
+    EMIT(program, BPF_ST_MEM(BPF_W, BPF_REG_9,
+                             BF_PROG_SCR_OFF(_BF_INTERP_SCR_OFFSET),
+                             section->rules_offset));
+    EMIT(program,
+         BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_7,
+                     BF_PROG_SCR_OFF(_BF_INTERP_SCR_L3_PROTO)));
+    EMIT(program,
+         BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_8,
+                     BF_PROG_SCR_OFF(_BF_INTERP_SCR_L4_PROTO)));
+
+    // bpf_loop(n_rules, interp_rule, ctx, 0)
+    EMIT(program, BPF_MOV32_IMM(BPF_REG_1, section->n_rules));
+    r = bf_program_emit_fixup(program, BF_FIXUP_TYPE_FUNC_CALL, ld_insn[0],
+                              &attr);
+    if (r)
+        return r;
+    EMIT(program, ld_insn[1]);
+    EMIT(program, BPF_MOV64_REG(BPF_REG_3, BPF_REG_9));
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_4, 0));
+    EMIT(program, BPF_EMIT_CALL(BPF_FUNC_loop));
+
+    // Apply the matching rule's verdict, if any
+    EMIT(program,
+         BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_9,
+                     BF_PROG_SCR_OFF(_BF_INTERP_SCR_VERDICT)));
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_1, BF_VERDICT_ACCEPT, 0));
+
+        r = bf_program_generate_verdict(program, BF_VERDICT_ACCEPT);
+        if (r)
+            return r;
+    }
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_1, BF_VERDICT_DROP, 0));
+
+        r = bf_program_generate_verdict(program, BF_VERDICT_DROP);
+        if (r)
+            return r;
+    }
+
+    return 0;
+}
+
+int bf_interp_load_rules_map(struct bf_program *program)
+{
+    const struct bf_program_section *last;
+    size_t i = 0;
+    int r;
+
+    bf_assert(program);
+
+    if (!program->rmap)
+        return 0;
+
+    last = &program->sections[program->n_sections - 1];
+    r = bf_map_set_n_elems(program->rmap, last->rules_offset + last->n_rules);
+    if (r < 0)
+        return r;
+
+    r = bf_map_create(program->rmap, 0);
+    if (r < 0)
+        return r;
+
+    bf_list_foreach (&program->runtime.chains, chain_node) {
+        const struct bf_chain *chain = bf_list_node_get_data(chain_node);
+
+        if (chain->hook_opts.mode == BF_HOOK_MODE_INTERPRETED) {
+            r = bf_interp_write_rules(program, i, chain);
+            if (r)
+                goto err_destroy_map;
+        }
+
+        ++i;
+    }
+
+    r = bf_program_fixup(program, BF_FIXUP_TYPE_RULES_MAP_FD);
+    if (r < 0) {
+        bf_err_r(r, "failed to fixup rules map FD");
+        goto err_destroy_map;
+    }
+
+    return 0;
+
+err_destroy_map:
+    bf_map_destroy(program->rmap);
+    return r;
+}
+
+int bf_interp_write_rules(struct bf_program *program, size_t section,
+                          const struct bf_chain *chain)
+{
+    _cleanup_free_ struct bf_interp_rule *records = NULL;
+    _cleanup_free_ uint32_t *keys = NULL;
+    const struct bf_program_section *sec;
+    union bpf_attr attr = {};
+    size_t n_records;
+    size_t i = 0;
+    int r;
+
+    bf_assert(program && chain);
+    bf_assert(section < program->n_sections);
+
+    sec = &program->sections[section];
+    if (chain->hook_opts.mode != BF_HOOK_MODE_INTERPRETED || !program->rmap)
+        return bf_err_r(-EINVAL, "chain %lu is not interpreted", section);
+
+    if (bf_list_size(&chain->rules) > sec->n_rules) {
+        bf_dbg("chain %lu has %lu rules, only %u records available", section,
+               bf_list_size(&chain->rules), sec->n_rules);
+        return -E2BIG;
+    }
+
+    // Write the end of chain marker, unless the section is full.
+    n_records = bf_min(bf_list_size(&chain->rules) + 1, (size_t)sec->n_rules);
+
+    records = calloc(n_records, sizeof(*records));
+    keys = calloc(n_records, sizeof(*keys));
+    if (!records || !keys)
+        return bf_err_r(-ENOMEM, "failed to allocate rules map records");
+
+    bf_list_foreach (&chain->rules, rule_node) {
+        const struct bf_rule *rule = bf_list_node_get_data(rule_node);
+
+        r = bf_interp_rule_encode(&records[i], rule,
+                                  sec->counters_offset + rule->index);
+        if (r)
+            return bf_err_r(r, "failed to encode rule %u", rule->index);
+
+        keys[i] = sec->rules_offset + i;
+        ++i;
+    }
+
+    if (i < n_records) {
+        records[i].flags = BF_INTERP_RULE_END;
+        keys[i] = sec->rules_offset + i;
+    }
+
+    attr.batch.map_fd = program->rmap->fd;
+    attr.batch.keys = (unsigned long long)keys;
+    attr.batch.values = (unsigned long long)records;
+    attr.batch.count = n_records;
+    attr.batch.flags = BPF_ANY;
+
+    r = bf_bpf(BPF_MAP_UPDATE_BATCH, &attr);
+    if (r < 0)
+        return bf_err_r(r, "failed to write rules of chain %lu", section);
+
+    return 0;
+}
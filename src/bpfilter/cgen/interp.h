@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file interp.h
+ *
+ * Chains can be generated in two modes, defined by the @c mode hook option:
+ * - @c compiled (default): each rule is translated into BPF bytecode, the
+ *   program has to be generated and verified again every time a rule changes.
+ * - @c interpreted : the rules are stored as fixed-size records in the
+ *   program's rules map, and evaluated by a generic BPF function called for
+ *   each record with @c bpf_loop() . The program's size doesn't depend on the
+ *   number of rules, and rules can be inserted, removed, or replaced by
+ *   updating the map, without loading a new program.
+ *
+ * Interpreted chains are slower to evaluate, as each rule requires a map
+ * lookup and the matched fields are dispatched at runtime. Only a subset of
+ * the rules can be interpreted: up to @ref BF_INTERP_MAX_CONDS matchers, using
+ * @c BF_MATCHER_EQ or @c BF_MATCHER_NE on the packet's headers, and the
+ * @c ACCEPT , @c DROP , or @c CONTINUE verdicts.
+ *
+ * The rules of a chain are stored contiguously in the map, the record
+ * following the chain's last rule is flagged with @ref BF_INTERP_RULE_END to
+ * stop the evaluation.
+ */
+
+struct bf_chain;
+struct bf_program;
+struct bf_rule;
+
+/// Maximum number of matchers of an interpreted rule.
+#define BF_INTERP_MAX_CONDS 4
+
+enum bf_interp_rule_flag
+{
+    /// The record follows the chain's last rule: stop the evaluation.
+    BF_INTERP_RULE_END = 1 << 0,
+    /// Update the counters at index @ref bf_interp_rule::counter if the rule
+    /// matches.
+    BF_INTERP_RULE_COUNTERS = 1 << 1,
+};
+
+/**
+ * Condition of an interpreted rule, equivalent to a @ref bf_matcher .
+ *
+ * The program loads the field from the packet with a load of the field's
+ * width, so it is in network byte order and zero-extended to 64 bits. IPv6
+ * addresses are loaded as two 64 bits words. The loaded value is masked with
+ * @c mask and compared to @c value .
+ */
+struct bf_interp_cond
+{
+    /// Field to match, as a @ref bf_matcher_type .
+    uint32_t field;
+    /// Comparison operator: @c BF_MATCHER_EQ or @c BF_MATCHER_NE .
+    uint32_t op;
+    /// Value to compare the masked field to, already masked.
+    uint64_t value[2];
+    /// Mask to apply to the field before comparing it.
+    uint64_t mask[2];
+};
+
+/**
+ * Record representing an interpreted rule in the rules map.
+ */
+struct bf_interp_rule
+{
+    /// Flags of the record, see @ref bf_interp_rule_flag .
+    uint32_t flags;
+    /// Number of valid conditions in @c conds .
+    uint32_t n_conds;
+    /// Verdict to apply if all the conditions match, as a @ref bf_verdict .
+    uint32_t verdict;
+    /// Index of the rule's counters in the program's counters map.
+    uint32_t counter;
+    struct bf_interp_cond conds[BF_INTERP_MAX_CONDS];
+};
+
+/**
+ * Encode a rule into a rules map record.
+ *
+ * @param record Record to fill. Can't be NULL.
+ * @param rule Rule to encode. Can't be NULL.
+ * @param counter Index of the rule's counters in the program's counters map.
+ * @return 0 on success, or a negative errno value on failure. If the rule
+ *         can't be interpreted, @c -ENOTSUP is returned.
+ */
+int bf_interp_rule_encode(struct bf_interp_rule *record,
+                          const struct bf_rule *rule, uint32_t counter);
+
+/**
+ * Generate the BPF function evaluating a record of the rules map.
+ *
+ * This function is the callback of the @c bpf_loop() call generated for each
+ * interpreted chain (see @ref bf_interp_generate_chain ), it is shared
+ * by all the interpreted chains of the program. If the rule matches, its
+ * counters are updated, and its verdict is stored in the scratch area,
+ * unless it is @c BF_VERDICT_CONTINUE .
+ *
+ * Parameters:
+ * - @c r1 : index of the record, relative to the chain's first record.
+ * - @c r2 : address of the runtime context.
+ * Returns:
+ * 0 to evaluate the next record, or 1 to stop the evaluation.
+ *
+ * @param program Program to emit the function into. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_interp_generate_rule(struct bf_program *program);
+
+/**
+ * Generate the bytecode evaluating the rules of an interpreted chain.
+ *
+ * The chain's records are evaluated by @c bpf_loop() , calling the
+ * @c BF_FIXUP_FUNC_INTERP_RULE function for each record, until a rule matches
+ * with a terminal verdict, or the end of the chain is reached. The generated
+ * bytecode doesn't depend on the chain's rules, but the rules are encoded
+ * ahead of time, so rules which can't be interpreted are rejected during the
+ * generation.
+ *
+ * @param program Program to generate the bytecode for. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_interp_generate_chain(struct bf_program *program);
+
+/**
+ * Create the program's rules map and write the rules of its interpreted
+ * chains into it.
+ *
+ * Does nothing if the program doesn't contain any interpreted chain.
+ *
+ * @param program Program to create the rules map for. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. On failure, the
+ *         rules map is destroyed.
+ */
+int bf_interp_load_rules_map(struct bf_program *program);
+
+/**
+ * Write the rules of an interpreted chain into the program's rules map.
+ *
+ * Every rule of @p chain is encoded (see @ref bf_interp_rule_encode ) before
+ * the map is updated, so the map is left unchanged if a rule can't be
+ * interpreted. The rules are evaluated by the program as soon as they are
+ * written, without loading a new program. The map is updated in a single
+ * batch, but packets processed while the batch is written might see a mix of
+ * the old and new rules.
+ *
+ * @param program Program containing the chain. Its rules map must have been
+ *        created. Can't be NULL.
+ * @param section Index of the chain's section in the program.
+ * @param chain Interpreted chain to write the rules of. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. Returns
+ *         @c -E2BIG if the section can't hold all the rules of @p chain , in
+ *         which case a new program must be generated.
+ */
+int bf_interp_write_rules(struct bf_program *program, size_t section,
+                          const struct bf_chain *chain);
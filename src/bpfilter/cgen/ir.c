@@ -0,0 +1,568 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "bpfilter/cgen/ir.h"
+
+#include <linux/bpf.h>
+#include <linux/bpf_common.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "core/helper.h"
+#include "core/logger.h"
+
+static bool _bf_ir_insn_is_jmp(const struct bf_ir_insn *insn)
+{
+    return insn->ref == BF_IR_REF_JMP || insn->ref == BF_IR_REF_JMP_LONG;
+}
+
+static bool _bf_ir_insn_is_ja(const struct bf_ir_insn *insn)
+{
+    return _bf_ir_insn_is_jmp(insn) && BPF_OP(insn->insn[0].code) == BPF_JA;
+}
+
+static bool _bf_ir_insn_is_exit(const struct bf_ir_insn *insn)
+{
+    return BPF_CLASS(insn->insn[0].code) == BPF_JMP &&
+           BPF_OP(insn->insn[0].code) == BPF_EXIT;
+}
+
+int bf_ir_new(struct bf_ir **ir, const struct bpf_insn *img, size_t img_size)
+{
+    _cleanup_bf_ir_ struct bf_ir *_ir = NULL;
+    _cleanup_free_ size_t *slots = NULL;
+    size_t n = 0;
+
+    bf_assert(ir && img);
+
+    _ir = calloc(1, sizeof(*_ir));
+    if (!_ir)
+        return -ENOMEM;
+
+    _ir->insns = calloc(img_size, sizeof(*_ir->insns));
+    slots = calloc(img_size, sizeof(*slots));
+    if ((!_ir->insns || !slots) && img_size)
+        return -ENOMEM;
+
+    // Decode the instructions, the targets are still BPF instruction indexes
+    for (size_t i = 0; i < img_size; ++n) {
+        struct bf_ir_insn *insn = &_ir->insns[n];
+        const struct bpf_insn *raw = &img[i];
+        int64_t target = -1;
+
+        insn->insn[0] = *raw;
+        insn->n_slots = 1;
+        insn->ref = BF_IR_REF_NONE;
+        insn->target = BF_IR_NO_TARGET;
+        insn->orig = i;
+
+        if (raw->code == (BPF_LD | BPF_IMM | BPF_DW)) {
+            if (i + 1 >= img_size)
+                return bf_err_r(-EINVAL, "truncated BPF_LD_IMM64 at %lu", i);
+
+            insn->insn[1] = img[i + 1];
+            insn->n_slots = 2;
+            if (raw->src_reg == BPF_PSEUDO_FUNC) {
+                insn->ref = BF_IR_REF_FUNC;
+                target = (int64_t)i + 1 + raw->imm;
+            }
+        } else if (BPF_CLASS(raw->code) == BPF_JMP ||
+                   BPF_CLASS(raw->code) == BPF_JMP32) {
+            if (BPF_OP(raw->code) == BPF_CALL) {
+                if (raw->src_reg == BPF_PSEUDO_CALL) {
+                    insn->ref = BF_IR_REF_CALL;
+                    target = (int64_t)i + 1 + raw->imm;
+                }
+            } else if (BPF_OP(raw->code) == BPF_EXIT) {
+                // No target
+            } else if (BPF_OP(raw->code) == BPF_JA &&
+                       BPF_CLASS(raw->code) == BPF_JMP32) {
+                insn->ref = BF_IR_REF_JMP_LONG;
+                target = (int64_t)i + 1 + raw->imm;
+            } else {
+                insn->ref = BF_IR_REF_JMP;
+                target = (int64_t)i + 1 + raw->off;
+            }
+        }
+
+        if (insn->ref != BF_IR_REF_NONE) {
+            if (target < 0 || target >= (int64_t)img_size) {
+                return bf_err_r(-EINVAL,
+                                "instruction %lu refers to out of bounds "
+                                "instruction %ld",
+                                i, target);
+            }
+            insn->target = (size_t)target;
+        }
+
+        // Second halves of BPF_LD_IMM64 can't be referred to
+        slots[i] = n;
+        if (insn->n_slots == 2)
+            slots[i + 1] = BF_IR_NO_TARGET;
+
+        i += insn->n_slots;
+    }
+
+    _ir->n_insns = n;
+
+    // Convert the targets into IR instruction indexes
+    for (size_t i = 0; i < _ir->n_insns; ++i) {
+        struct bf_ir_insn *insn = &_ir->insns[i];
+
+        if (insn->ref == BF_IR_REF_NONE)
+            continue;
+
+        insn->target = slots[insn->target];
+        if (insn->target == BF_IR_NO_TARGET) {
+            return bf_err_r(-EINVAL,
+                            "instruction %lu refers to the middle of an "
+                            "instruction",
+                            insn->orig);
+        }
+    }
+
+    *ir = TAKE_PTR(_ir);
+
+    return 0;
+}
+
+void bf_ir_free(struct bf_ir **ir)
+{
+    bf_assert(ir);
+
+    if (!*ir)
+        return;
+
+    free((*ir)->insns);
+    freep((void *)ir);
+}
+
+/**
+ * Value of a register, as known by the path cost analysis.
+ */
+struct bf_ir_reg
+{
+    /// If true, the register contains @c value on every path.
+    bool known;
+    int64_t value;
+};
+
+/**
+ * Set of paths reaching an instruction.
+ */
+struct bf_ir_paths
+{
+    /// Number of instructions executed on the shortest path.
+    uint64_t best;
+    /// Number of instructions executed on the longest path.
+    uint64_t worst;
+    /// Value of the registers, merged from every path.
+    struct bf_ir_reg regs[MAX_BPF_REG];
+};
+
+/**
+ * Context of the path cost analysis.
+ */
+struct bf_ir_cost_ctx
+{
+    const struct bf_ir *ir;
+    /// Value of @c r7 and @c r8 for the analysed protocols.
+    int64_t protos[2];
+    /// If true, the instruction is the entry point of a function.
+    bool *is_func;
+    /// Cost of each function, indexed by entry point.
+    uint64_t *func_best;
+    uint64_t *func_worst;
+    /// 0 if the function's cost is unknown, 1 while it is being computed,
+    /// 2 once it is known.
+    uint8_t *func_state;
+};
+
+static void _bf_ir_reg_set(const struct bf_ir_cost_ctx *ctx,
+                           struct bf_ir_reg *regs, uint8_t reg,
+                           struct bf_ir_reg value)
+{
+    /* r7 and r8 contain the packet's L3 and L4 protocol IDs (see
+     * bpfilter/cgen/program.h): unless a constant is written to them, they
+     * are assumed to contain the analysed protocols. */
+    if (!value.known && (reg == BPF_REG_7 || reg == BPF_REG_8)) {
+        value = (struct bf_ir_reg) {.known = true,
+                                    .value = ctx->protos[reg - BPF_REG_7]};
+    }
+
+    regs[reg] = value;
+}
+
+/**
+ * Update the registers' value after an instruction which is not a jump.
+ */
+static void _bf_ir_cost_transfer(const struct bf_ir_cost_ctx *ctx,
+                                 const struct bf_ir_insn *insn,
+                                 struct bf_ir_reg *regs)
+{
+    const struct bpf_insn *raw = &insn->insn[0];
+    const struct bf_ir_reg unknown = {};
+    uint8_t class = BPF_CLASS(raw->code);
+
+    switch (class) {
+    case BPF_ALU:
+    case BPF_ALU64:
+        if (raw->dst_reg >= MAX_BPF_REG || raw->src_reg >= MAX_BPF_REG)
+            break;
+
+        if (BPF_OP(raw->code) == BPF_MOV && !raw->off) {
+            struct bf_ir_reg value = {.known = true, .value = raw->imm};
+
+            if (BPF_SRC(raw->code) == BPF_X)
+                value = regs[raw->src_reg];
+            if (value.known && class == BPF_ALU)
+                value.value = (uint32_t)value.value;
+
+            _bf_ir_reg_set(ctx, regs, raw->dst_reg, value);
+        } else {
+            _bf_ir_reg_set(ctx, regs, raw->dst_reg, unknown);
+        }
+        break;
+    case BPF_LD:
+        if (raw->code == (BPF_LD | BPF_IMM | BPF_DW)) {
+            if (raw->dst_reg < MAX_BPF_REG)
+                _bf_ir_reg_set(ctx, regs, raw->dst_reg, unknown);
+            break;
+        }
+        // BPF_ABS and BPF_IND clobber the same registers as a call
+        for (uint8_t reg = BPF_REG_0; reg <= BPF_REG_5; ++reg)
+            _bf_ir_reg_set(ctx, regs, reg, unknown);
+        break;
+    case BPF_LDX:
+        if (raw->dst_reg < MAX_BPF_REG)
+            _bf_ir_reg_set(ctx, regs, raw->dst_reg, unknown);
+        break;
+    case BPF_STX:
+        // Atomic operations can write to r0 and to the source register
+        if (BPF_MODE(raw->code) == BPF_ATOMIC && raw->src_reg < MAX_BPF_REG) {
+            _bf_ir_reg_set(ctx, regs, BPF_REG_0, unknown);
+            _bf_ir_reg_set(ctx, regs, raw->src_reg, unknown);
+        }
+        break;
+    case BPF_JMP:
+    case BPF_JMP32:
+        if (BPF_OP(raw->code) == BPF_CALL) {
+            for (uint8_t reg = BPF_REG_0; reg <= BPF_REG_5; ++reg)
+                _bf_ir_reg_set(ctx, regs, reg, unknown);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Evaluate a conditional jump.
+ *
+ * @return 1 if the jump is always taken, 0 if it is never taken, or -1 if
+ *         both branches can be taken.
+ */
+static int _bf_ir_cost_eval_jmp(const struct bf_ir_insn *insn,
+                                const struct bf_ir_reg *regs)
+{
+    const struct bpf_insn *raw = &insn->insn[0];
+    bool is32 = BPF_CLASS(raw->code) == BPF_JMP32;
+    int64_t lhs;
+    int64_t rhs;
+    uint64_t ulhs;
+    uint64_t urhs;
+
+    if (raw->dst_reg >= MAX_BPF_REG || !regs[raw->dst_reg].known)
+        return -1;
+    lhs = regs[raw->dst_reg].value;
+
+    if (BPF_SRC(raw->code) == BPF_X) {
+        if (raw->src_reg >= MAX_BPF_REG || !regs[raw->src_reg].known)
+            return -1;
+        rhs = regs[raw->src_reg].value;
+    } else {
+        rhs = raw->imm;
+    }
+
+    if (is32) {
+        lhs = (int32_t)lhs;
+        rhs = (int32_t)rhs;
+        ulhs = (uint32_t)lhs;
+        urhs = (uint32_t)rhs;
+    } else {
+        ulhs = (uint64_t)lhs;
+        urhs = (uint64_t)rhs;
+    }
+
+    switch (BPF_OP(raw->code)) {
+    case BPF_JEQ:
+        return ulhs == urhs;
+    case BPF_JNE:
+        return ulhs != urhs;
+    case BPF_JGT:
+        return ulhs > urhs;
+    case BPF_JGE:
+        return ulhs >= urhs;
+    case BPF_JLT:
+        return ulhs < urhs;
+    case BPF_JLE:
+        return ulhs <= urhs;
+    case BPF_JSGT:
+        return lhs > rhs;
+    case BPF_JSGE:
+        return lhs >= rhs;
+    case BPF_JSLT:
+        return lhs < rhs;
+    case BPF_JSLE:
+        return lhs <= rhs;
+    case BPF_JSET:
+        return !!(ulhs & urhs);
+    default:
+        return -1;
+    }
+}
+
+/**
+ * Merge a path into a set of paths.
+ *
+ * The best and worst costs are updated, registers which don't have the same
+ * value on both are marked unknown.
+ */
+static void _bf_ir_cost_merge(const struct bf_ir_cost_ctx *ctx,
+                              struct bf_ir_paths *paths,
+                              const struct bf_ir_paths *path)
+{
+    if (path->best < paths->best)
+        paths->best = path->best;
+    if (path->worst > paths->worst)
+        paths->worst = path->worst;
+
+    for (uint8_t reg = 0; reg < MAX_BPF_REG; ++reg) {
+        const struct bf_ir_reg *a = &paths->regs[reg];
+        const struct bf_ir_reg *b = &path->regs[reg];
+
+        if (a->known && b->known && a->value == b->value)
+            continue;
+
+        _bf_ir_reg_set(ctx, paths->regs, reg, (struct bf_ir_reg) {});
+    }
+}
+
+/**
+ * Add a path to the set of paths reaching a jump's target.
+ *
+ * @param ctx Analysis context. Can't be NULL.
+ * @param paths Set of paths reaching the target. If it points to NULL, a new
+ *        set is allocated. Can't be NULL.
+ * @param path Path to add. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_ir_cost_add_path(const struct bf_ir_cost_ctx *ctx,
+                                struct bf_ir_paths **paths,
+                                const struct bf_ir_paths *path)
+{
+    if (*paths) {
+        _bf_ir_cost_merge(ctx, *paths, path);
+        return 0;
+    }
+
+    *paths = malloc(sizeof(**paths));
+    if (!*paths)
+        return -ENOMEM;
+
+    **paths = *path;
+
+    return 0;
+}
+
+static int _bf_ir_cost_func(struct bf_ir_cost_ctx *ctx, size_t entry);
+
+/**
+ * Compute the cost of the function starting at @p entry .
+ *
+ * The function's instructions are visited in order, each instruction merges
+ * the paths reaching it into the paths reaching its successors. As this
+ * requires every jump to go forward, -ENOTSUP is returned for loops.
+ */
+static int _bf_ir_cost_func_paths(struct bf_ir_cost_ctx *ctx, size_t entry,
+                                  uint64_t *best, uint64_t *worst)
+{
+    const struct bf_ir *ir = ctx->ir;
+    _cleanup_free_ struct bf_ir_paths **pending = NULL;
+    struct bf_ir_paths cur = {};
+    bool reached = true;
+    bool exited = false;
+    size_t end = entry + 1;
+    int r = 0;
+
+    while (end < ir->n_insns && !ctx->is_func[end])
+        ++end;
+
+    pending = calloc(end - entry, sizeof(*pending));
+    if (!pending)
+        return -ENOMEM;
+
+    *best = UINT64_MAX;
+    *worst = 0;
+
+    for (size_t i = entry; i < end; ++i) {
+        const struct bf_ir_insn *insn = &ir->insns[i];
+        struct bf_ir_paths **in = &pending[i - entry];
+        uint64_t callee_best = 0;
+        uint64_t callee_worst = 0;
+        size_t target;
+        int taken = 1;
+
+        if (*in) {
+            if (reached)
+                _bf_ir_cost_merge(ctx, &cur, *in);
+            else
+                cur = **in;
+            reached = true;
+            freep((void *)in);
+        }
+
+        if (!reached)
+            continue;
+
+        if (insn->ref == BF_IR_REF_CALL) {
+            target = insn->target;
+            r = _bf_ir_cost_func(ctx, target);
+            if (r)
+                goto end_free;
+            callee_best = ctx->func_best[target];
+            callee_worst = ctx->func_worst[target];
+        }
+
+        cur.best += 1 + callee_best;
+        cur.worst += 1 + callee_worst;
+
+        if (_bf_ir_insn_is_exit(insn)) {
+            *best = cur.best < *best ? cur.best : *best;
+            *worst = cur.worst > *worst ? cur.worst : *worst;
+            exited = true;
+            reached = false;
+            continue;
+        }
+
+        if (!_bf_ir_insn_is_jmp(insn)) {
+            _bf_ir_cost_transfer(ctx, insn, cur.regs);
+            continue;
+        }
+
+        target = insn->target;
+        if (target <= i) {
+            r = -ENOTSUP;
+            goto end_free;
+        }
+        if (target >= end) {
+            r = bf_err_r(-EINVAL, "instruction %lu jumps out of its function",
+                         insn->orig);
+            goto end_free;
+        }
+
+        if (!_bf_ir_insn_is_ja(insn))
+            taken = _bf_ir_cost_eval_jmp(insn, cur.regs);
+
+        if (taken) {
+            r = _bf_ir_cost_add_path(ctx, &pending[target - entry], &cur);
+            if (r)
+                goto end_free;
+        }
+
+        // The jump is always taken, the next instruction is not reached
+        if (taken == 1)
+            reached = false;
+    }
+
+    if (reached) {
+        r = bf_err_r(-EINVAL, "function at instruction %lu doesn't exit",
+                     ir->insns[entry].orig);
+    } else if (!exited) {
+        *best = 0;
+        *worst = 0;
+    }
+
+end_free:
+    for (size_t i = 0; i < end - entry; ++i)
+        free(pending[i]);
+
+    return r;
+}
+
+static int _bf_ir_cost_func(struct bf_ir_cost_ctx *ctx, size_t entry)
+{
+    int r;
+
+    if (ctx->func_state[entry] == 2)
+        return 0;
+
+    // BPF doesn't support recursive functions, but don't loop forever
+    if (ctx->func_state[entry] == 1)
+        return -ENOTSUP;
+
+    ctx->func_state[entry] = 1;
+
+    r = _bf_ir_cost_func_paths(ctx, entry, &ctx->func_best[entry],
+                               &ctx->func_worst[entry]);
+    if (r)
+        return r;
+
+    ctx->func_state[entry] = 2;
+
+    return 0;
+}
+
+int bf_ir_path_cost(const struct bf_ir *ir, uint16_t l3_proto,
+                    uint8_t l4_proto, uint64_t *best, uint64_t *worst)
+{
+    _cleanup_free_ bool *is_func = NULL;
+    _cleanup_free_ uint64_t *func_best = NULL;
+    _cleanup_free_ uint64_t *func_worst = NULL;
+    _cleanup_free_ uint8_t *func_state = NULL;
+    struct bf_ir_cost_ctx ctx;
+    int r;
+
+    bf_assert(ir && best && worst);
+
+    if (!ir->n_insns)
+        return -EINVAL;
+
+    is_func = calloc(ir->n_insns, sizeof(*is_func));
+    func_best = calloc(ir->n_insns, sizeof(*func_best));
+    func_worst = calloc(ir->n_insns, sizeof(*func_worst));
+    func_state = calloc(ir->n_insns, sizeof(*func_state));
+    if (!is_func || !func_best || !func_worst || !func_state)
+        return -ENOMEM;
+
+    for (size_t i = 0; i < ir->n_insns; ++i) {
+        const struct bf_ir_insn *insn = &ir->insns[i];
+
+        if (insn->ref == BF_IR_REF_CALL || insn->ref == BF_IR_REF_FUNC)
+            is_func[insn->target] = true;
+    }
+
+    ctx = (struct bf_ir_cost_ctx) {
+        .ir = ir,
+        .protos = {l3_proto, l4_proto},
+        .is_func = is_func,
+        .func_best = func_best,
+        .func_worst = func_worst,
+        .func_state = func_state,
+    };
+
+    // The program's entry point is its first instruction
+    r = _bf_ir_cost_func(&ctx, 0);
+    if (r)
+        return r;
+
+    *best = func_best[0];
+    *worst = func_worst[0];
+
+    return 0;
+}
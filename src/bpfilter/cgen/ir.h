@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#pragma once
+
+#include <linux/bpf.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file ir.h
+ *
+ * Intermediate representation of a generated program, used to analyse it.
+ *
+ * Matchers and flavors emit BPF instructions into the program's image, jumps
+ * are resolved with @ref bf_jmpctx and @ref bf_fixup as the image is
+ * generated. Once the whole program is generated, the image can be lifted
+ * into a @ref bf_ir : each jump, call, and function address refers to its
+ * target instruction symbolically, instead of with a relative offset. The IR
+ * is read-only, the program is loaded from its original image.
+ */
+
+/// Value of @ref bf_ir_insn.target for instructions without target.
+#define BF_IR_NO_TARGET SIZE_MAX
+
+#define _cleanup_bf_ir_ __attribute__((cleanup(bf_ir_free)))
+
+/**
+ * Kind of reference an instruction holds to another instruction.
+ */
+enum bf_ir_ref
+{
+    /// The instruction doesn't refer to another instruction.
+    BF_IR_REF_NONE,
+    /// Conditional or unconditional jump, the offset is in @c off .
+    BF_IR_REF_JMP,
+    /// Long unconditional jump (@c gotol ), the offset is in @c imm .
+    BF_IR_REF_JMP_LONG,
+    /// Call to a BPF function, the offset is in @c imm .
+    BF_IR_REF_CALL,
+    /// Address of a BPF function, used as callback. The offset is in the
+    /// @c imm of the @c BPF_LD_IMM64 instruction's first half.
+    BF_IR_REF_FUNC,
+    _BF_IR_REF_MAX,
+};
+
+/**
+ * Instruction of the IR.
+ */
+struct bf_ir_insn
+{
+    /// BPF instruction, the second half is only used by @c BPF_LD_IMM64 .
+    struct bpf_insn insn[2];
+    /// Number of BPF instructions: 2 for @c BPF_LD_IMM64 , 1 otherwise.
+    uint8_t n_slots;
+    /// Kind of reference to @c target .
+    enum bf_ir_ref ref;
+    /// Index of the target instruction in @ref bf_ir.insns , or
+    /// @ref BF_IR_NO_TARGET .
+    size_t target;
+    /// Index of the instruction in the original image.
+    size_t orig;
+};
+
+/**
+ * Intermediate representation of a program.
+ */
+struct bf_ir
+{
+    struct bf_ir_insn *insns;
+    size_t n_insns;
+};
+
+/**
+ * Lift a BPF image into an IR.
+ *
+ * @param ir On success, points to the new IR. Can't be NULL.
+ * @param img BPF image to lift. Every jump, call, and function address must
+ *        be resolved. Can't be NULL.
+ * @param img_size Number of BPF instructions in @p img .
+ * @return 0 on success, or a negative errno value on failure. @c -EINVAL is
+ *         returned if an instruction refers to an instruction out of the
+ *         image.
+ */
+int bf_ir_new(struct bf_ir **ir, const struct bpf_insn *img, size_t img_size);
+
+/**
+ * Free an IR.
+ *
+ * @param ir IR to free. If @p ir points to NULL, nothing is done. Can't be
+ *        NULL.
+ */
+void bf_ir_free(struct bf_ir **ir);
+
+/**
+ * Estimate the number of instructions executed by the program, for a given
+ * packet's protocols.
+ *
+ * Every path from the program's entry point to its exit is walked. The L3 and
+ * L4 protocol IDs are stored in @c r7 and @c r8 (see
+ * bpfilter/cgen/program.h), so @c r7 and @c r8 are assumed to contain
+ * @p l3_proto and @p l4_proto , unless a constant is written to them:
+ * conditional jumps comparing known values only follow one branch. Other
+ * conditional jumps follow both branches.
+ *
+ * Instructions of the called BPF functions are counted, but not the
+ * instructions executed by helpers, nor by callbacks (e.g. for
+ * @c bpf_loop() ).
+ *
+ * @param ir IR to analyse. Can't be NULL.
+ * @param l3_proto Value of @c r7 : the L3 protocol ID, in network byte order,
+ *        or 0 for packets which are not IP.
+ * @param l4_proto Value of @c r8 : the L4 protocol ID, or 0.
+ * @param best On success, contains the number of instructions executed on the
+ *        shortest path. Can't be NULL.
+ * @param worst On success, contains the number of instructions executed on
+ *        the longest path. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. @c -ENOTSUP is
+ *         returned if the program contains loops.
+ */
+int bf_ir_path_cost(const struct bf_ir *ir, uint16_t l3_proto,
+                    uint8_t l4_proto, uint64_t *best, uint64_t *worst);
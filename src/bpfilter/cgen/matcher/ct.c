@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "bpfilter/cgen/matcher/ct.h"
+
+#include <linux/bpf.h>
+#include <linux/bpf_common.h>
+
+#include <errno.h>
+#include <stdint.h>
+
+#include "bpfilter/cgen/fixup.h"
+#include "bpfilter/cgen/jmp.h"
+#include "bpfilter/cgen/program.h"
+#include "core/flavor.h"
+#include "core/helper.h"
+#include "core/hook.h"
+#include "core/logger.h"
+#include "core/matcher.h"
+
+#include "external/filter.h"
+
+static int _bf_matcher_generate_ct_state(struct bf_program *program,
+                                         const struct bf_matcher *matcher)
+{
+    uint8_t states = *(uint8_t *)matcher->payload;
+
+    if (!program->runtime.ops->gen_ct_lookup) {
+        return bf_err_r(-ENOTSUP,
+                        "connection tracking is not supported for %s",
+                        bf_hook_to_str(program->hook));
+    }
+
+    EMIT(program,
+         BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_9, BF_PROG_CTX_OFF(ct_state)));
+
+    // Lookup the connection only if it hasn't been done for this packet yet
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+            bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JNE, BPF_REG_1, 0, 0));
+
+        EMIT(program, BPF_MOV64_REG(BPF_REG_1, BPF_REG_9));
+        EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_7));
+        EMIT(program, BPF_MOV64_REG(BPF_REG_3, BPF_REG_8));
+        EMIT_FIXUP_CALL(program, BF_FIXUP_FUNC_CT_LOOKUP);
+        EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_9,
+                                  BF_PROG_CTX_OFF(ct_state)));
+    }
+
+    EMIT(program, BPF_ALU32_IMM(BPF_AND, BPF_REG_1, states));
+
+    switch (matcher->op) {
+    case BF_MATCHER_EQ:
+        EMIT_FIXUP_JMP_NEXT_RULE(program,
+                                 BPF_JMP_IMM(BPF_JEQ, BPF_REG_1, 0, 0));
+        break;
+    case BF_MATCHER_NE:
+        EMIT_FIXUP_JMP_NEXT_RULE(program,
+                                 BPF_JMP_IMM(BPF_JNE, BPF_REG_1, 0, 0));
+        break;
+    default:
+        return bf_err_r(-EINVAL, "unknown matcher operator '%s' (%d)",
+                        bf_matcher_op_to_str(matcher->op), matcher->op);
+    }
+
+    return 0;
+}
+
+int bf_matcher_generate_ct(struct bf_program *program,
+                           const struct bf_matcher *matcher)
+{
+    bf_assert(program && matcher);
+
+    switch (matcher->type) {
+    case BF_MATCHER_CT_STATE:
+        return _bf_matcher_generate_ct_state(program, matcher);
+    default:
+        return bf_err_r(-EINVAL, "unknown matcher type %d", matcher->type);
+    };
+}
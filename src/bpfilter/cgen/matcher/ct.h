@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#pragma once
+
+struct bf_matcher;
+struct bf_program;
+
+/**
+ * Generate the bytecode for a connection tracking matcher.
+ *
+ * The packet's connection is looked up the first time a connection tracking
+ * matcher is evaluated, the result is cached in the runtime context for the
+ * subsequent matchers.
+ *
+ * @param program Program to generate the bytecode into. Can't be NULL.
+ * @param matcher Matcher to generate the bytecode for. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. If the program's
+ *         flavor doesn't support connection tracking, -ENOTSUP is returned.
+ */
+int bf_matcher_generate_ct(struct bf_program *program,
+                           const struct bf_matcher *matcher);
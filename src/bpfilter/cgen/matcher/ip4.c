@@ -15,6 +15,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "bpfilter/cgen/matcher/set.h"
 #include "bpfilter/cgen/program.h"
 #include "core/helper.h"
 #include "core/list.h"
@@ -60,7 +61,7 @@ static int _bf_matcher_generate_ip4_addr_set(struct bf_program *program,
     bf_assert(matcher);
 
     set_id = *(uint32_t *)matcher->payload;
-    set = bf_list_get_at(&program->runtime.chain->sets, set_id);
+    set = bf_list_get_at(&program->runtime.cur_chain->sets, set_id);
 
     switch (set->type) {
     case BF_SET_IP4:
@@ -69,23 +70,14 @@ static int _bf_matcher_generate_ip4_addr_set(struct bf_program *program,
                      offsetof(struct iphdr, daddr);
         EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_6, offset));
         EMIT(program,
-             BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_2, BF_PROG_SCR_OFF(0)));
+             BPF_STX_MEM(BPF_W, BPF_REG_9, BPF_REG_2, BF_PROG_SCR_OFF(0)));
         break;
     default:
         return bf_err_r(-EINVAL, "unsupported set type: %s",
                         bf_set_type_to_str(set->type));
     }
 
-    EMIT_LOAD_SET_FD_FIXUP(program, BPF_REG_1, set_id);
-    EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_10));
-    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, BF_PROG_SCR_OFF(0)));
-
-    EMIT(program, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
-
-    // Jump to the next rule if map_lookup_elem returned 0
-    EMIT_FIXUP_JMP_NEXT_RULE(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 0));
-
-    return 0;
+    return bf_matcher_generate_set_lookup(program, set_id);
 }
 
 static int _bf_matcher_generate_ip4_addr(struct bf_program *program,
@@ -127,7 +119,7 @@ int bf_matcher_generate_ip4(struct bf_program *program,
         program, BPF_JMP_IMM(BPF_JNE, BPF_REG_7, htobe16(ETH_P_IP), 0));
 
     EMIT(program,
-         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_10, BF_PROG_CTX_OFF(l3_hdr)));
+         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_9, BF_PROG_CTX_OFF(l3_hdr)));
 
     switch (matcher->type) {
     case BF_MATCHER_IP4_SRC_ADDR:
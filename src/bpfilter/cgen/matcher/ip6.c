@@ -164,7 +164,7 @@ int bf_matcher_generate_ip6(struct bf_program *program,
         program, BPF_JMP_IMM(BPF_JNE, BPF_REG_7, htobe16(ETH_P_IPV6), 0));
 
     EMIT(program,
-         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_10, BF_PROG_CTX_OFF(l3_hdr)));
+         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_9, BF_PROG_CTX_OFF(l3_hdr)));
 
     switch (matcher->type) {
     case BF_MATCHER_IP6_SADDR:
@@ -27,7 +27,7 @@ static int _bf_matcher_generate_meta_ifindex(struct bf_program *program,
                                              const struct bf_matcher *matcher)
 {
     EMIT(program,
-         BPF_LDX_MEM(BPF_H, BPF_REG_1, BPF_REG_10, BF_PROG_CTX_OFF(ifindex)));
+         BPF_LDX_MEM(BPF_H, BPF_REG_1, BPF_REG_9, BF_PROG_CTX_OFF(ifindex)));
     EMIT_FIXUP_JMP_NEXT_RULE(
         program,
         BPF_JMP_IMM(BPF_JNE, BPF_REG_1, *(uint32_t *)&matcher->payload, 0));
@@ -64,7 +64,7 @@ static int _bf_matcher_generate_meta_port(struct bf_program *program,
 
     // Load L4 header address into r6
     EMIT(program,
-         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_10, BF_PROG_CTX_OFF(l4_hdr)));
+         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_9, BF_PROG_CTX_OFF(l4_hdr)));
 
     // Get the packet's port into r1
     swich = bf_swich_get(program, BPF_REG_8);
@@ -20,12 +20,66 @@
 
 #include "bpfilter/cgen/program.h"
 #include "bpfilter/cgen/swich.h"
+#include "core/counter.h"
 #include "core/helper.h"
+#include "core/list.h"
 #include "core/logger.h"
 #include "core/matcher.h"
+#include "core/set.h"
 
 #include "external/filter.h"
 
+int bf_matcher_generate_set_lookup(struct bf_program *program,
+                                   uint32_t set_id)
+{
+    const struct bf_set *set;
+
+    bf_assert(program);
+
+    set = bf_list_get_at(&program->runtime.cur_chain->sets, set_id);
+    if (!set)
+        return bf_err_r(-ENOENT, "no set at index %u", set_id);
+
+    // Call bpf_map_lookup_elem(r1=map_fd, r2=key_addr)
+    EMIT_LOAD_SET_FD_FIXUP(program, BPF_REG_1, set_id);
+    EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_9));
+    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, BF_PROG_SCR_OFF(0)));
+    EMIT(program, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
+
+    // Key not found? Jump to the next rule
+    EMIT_FIXUP_JMP_NEXT_RULE(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 0));
+
+    if (set->counters) {
+        // r0 points to the current CPU's counters for the element
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_0,
+                                  offsetof(struct bf_counter, packets)));
+        EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_1, 1));
+        EMIT(program, BPF_STX_MEM(BPF_DW, BPF_REG_0, BPF_REG_1,
+                                  offsetof(struct bf_counter, packets)));
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_9,
+                                  BF_PROG_CTX_OFF(pkt_size)));
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_0,
+                                  offsetof(struct bf_counter, bytes)));
+        EMIT(program, BPF_ALU64_REG(BPF_ADD, BPF_REG_2, BPF_REG_1));
+        EMIT(program, BPF_STX_MEM(BPF_DW, BPF_REG_0, BPF_REG_2,
+                                  offsetof(struct bf_counter, bytes)));
+    }
+
+    if (!bf_set_is_dynamic(set))
+        return 0;
+
+    /* Dynamic sets elements contain their expiry timestamp. Elements are
+     * not removed from the map when they expire (the LRU will eventually
+     * evict them), so compare it to the current time. r6 is reloaded by
+     * every matcher, it can be clobbered. */
+    EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_0, 0));
+    EMIT(program, BPF_EMIT_CALL(BPF_FUNC_ktime_get_ns));
+    EMIT_FIXUP_JMP_NEXT_RULE(program,
+                             BPF_JMP_REG(BPF_JGT, BPF_REG_0, BPF_REG_6, 0));
+
+    return 0;
+}
+
 int _bf_matcher_generate_set_ip6port(struct bf_program *program,
                                      const struct bf_matcher *matcher)
 {
@@ -44,7 +98,7 @@ int _bf_matcher_generate_set_ip6port(struct bf_program *program,
 
     // Get the source port into r2. If l4_proto is not UDP or TCP, jump to the next rule
     EMIT(program,
-         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_10, BF_PROG_CTX_OFF(l4_hdr)));
+         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_9, BF_PROG_CTX_OFF(l4_hdr)));
     swich = bf_swich_get(program, BPF_REG_8);
     EMIT_SWICH_OPTION(&swich, IPPROTO_TCP,
                       BPF_LDX_MEM(BPF_H, BPF_REG_3, BPF_REG_6,
@@ -60,7 +114,7 @@ int _bf_matcher_generate_set_ip6port(struct bf_program *program,
 
     // Copy the source IPv6 address into r1 and r2
     EMIT(program,
-         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_10, BF_PROG_CTX_OFF(l3_hdr)));
+         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_9, BF_PROG_CTX_OFF(l3_hdr)));
     EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_6,
                               offsetof(struct ipv6hdr, saddr)));
     EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_6,
@@ -68,22 +122,13 @@ int _bf_matcher_generate_set_ip6port(struct bf_program *program,
 
     //  Prepare the key
     EMIT(program,
-         BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_1, BF_PROG_SCR_OFF(0)));
+         BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_1, BF_PROG_SCR_OFF(0)));
     EMIT(program,
-         BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_2, BF_PROG_SCR_OFF(8)));
+         BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_2, BF_PROG_SCR_OFF(8)));
     EMIT(program,
-         BPF_STX_MEM(BPF_H, BPF_REG_10, BPF_REG_3, BF_PROG_SCR_OFF(16)));
+         BPF_STX_MEM(BPF_H, BPF_REG_9, BPF_REG_3, BF_PROG_SCR_OFF(16)));
 
-    // Call bpf_map_lookup_elem(r1=map_fd, r2=key_addr)
-    EMIT_LOAD_SET_FD_FIXUP(program, BPF_REG_1, set_id);
-    EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_10));
-    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, BF_PROG_SCR_OFF(0)));
-    EMIT(program, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
-
-    // Key not found? Jump to the next rule
-    EMIT_FIXUP_JMP_NEXT_RULE(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 0));
-
-    return 0;
+    return bf_matcher_generate_set_lookup(program, set_id);
 }
 
 int _bf_matcher_generate_set_ip6(struct bf_program *program,
@@ -99,7 +144,7 @@ int _bf_matcher_generate_set_ip6(struct bf_program *program,
     EMIT_FIXUP_JMP_NEXT_RULE(
         program, BPF_JMP_IMM(BPF_JNE, BPF_REG_7, htobe16(ETH_P_IPV6), 0));
     EMIT(program,
-         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_10, BF_PROG_CTX_OFF(l3_hdr)));
+         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_9, BF_PROG_CTX_OFF(l3_hdr)));
 
     // Copy the source IPv6 address into r1 and r2
     EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_6,
@@ -109,20 +154,11 @@ int _bf_matcher_generate_set_ip6(struct bf_program *program,
 
     //  Prepare the key
     EMIT(program,
-         BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_1, BF_PROG_SCR_OFF(0)));
+         BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_1, BF_PROG_SCR_OFF(0)));
     EMIT(program,
-         BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_2, BF_PROG_SCR_OFF(8)));
+         BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_2, BF_PROG_SCR_OFF(8)));
 
-    // Call bpf_map_lookup_elem(r1=map_fd, r2=key_addr)
-    EMIT_LOAD_SET_FD_FIXUP(program, BPF_REG_1, set_id);
-    EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_10));
-    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, BF_PROG_SCR_OFF(0)));
-    EMIT(program, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
-
-    // Key not found? Jump to the next rule
-    EMIT_FIXUP_JMP_NEXT_RULE(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 0));
-
-    return 0;
+    return bf_matcher_generate_set_lookup(program, set_id);
 }
 
 int bf_matcher_generate_set(struct bf_program *program,
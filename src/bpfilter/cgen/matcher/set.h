@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 struct bf_matcher;
 struct bf_program;
 
@@ -17,3 +19,19 @@ struct bf_program;
  */
 int bf_matcher_generate_set(struct bf_program *program,
                             const struct bf_matcher *matcher);
+
+/**
+ * Generate the bytecode to look up the key stored in the scratch area.
+ *
+ * The key must be stored at @c BF_PROG_SCR_OFF(0) . If the key is not found
+ * in the set, the program jumps to the next rule. For dynamic sets, the
+ * element's expiry timestamp is compared to the current time, and expired
+ * elements are considered as not found. For sets with per-element counters,
+ * the counters of the element found are updated.
+ *
+ * @param program Program to generate the bytecode into. Can't be NULL.
+ * @param set_id Index of the set in the chain being generated.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_matcher_generate_set_lookup(struct bf_program *program,
+                                   uint32_t set_id);
@@ -62,7 +62,7 @@ int bf_matcher_generate_udp(struct bf_program *program,
     EMIT_FIXUP_JMP_NEXT_RULE(program,
                              BPF_JMP_IMM(BPF_JNE, BPF_REG_8, IPPROTO_UDP, 0));
     EMIT(program,
-         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_10, BF_PROG_CTX_OFF(l4_hdr)));
+         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_9, BF_PROG_CTX_OFF(l4_hdr)));
 
     switch (matcher->type) {
     case BF_MATCHER_UDP_SPORT:
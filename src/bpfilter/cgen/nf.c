@@ -9,6 +9,7 @@
 #include <linux/bpf_common.h>
 #include <linux/if_ether.h>
 #include <linux/netfilter.h>
+#include <linux/netfilter/nf_conntrack_common.h>
 
 #include <stdbool.h>
 #include <stddef.h>
@@ -26,6 +27,7 @@
 #include "core/hook.h"
 #include "core/list.h"
 #include "core/logger.h"
+#include "core/matcher.h"
 #include "core/verdict.h"
 
 #include "external/filter.h"
@@ -33,9 +35,13 @@
 #define BF_NF_PRIO_EVEN 2
 #define BF_NF_PRIO_ODD 1
 
+/// Mask of the ip_conntrack_info bits in sk_buff._nfct.
+#define BF_NF_CT_INFOMASK 7
+
 static int _bf_nf_gen_inline_prologue(struct bf_program *program);
 static int _bf_nf_gen_inline_epilogue(struct bf_program *program);
 static int _bf_nf_get_verdict(enum bf_verdict verdict);
+static int _bf_nf_gen_ct_lookup(struct bf_program *program);
 static int _bf_nf_attach_prog(
     struct bf_program *new_prog, struct bf_program *old_prog,
     int (*get_new_link_cb)(struct bf_program *prog, struct bf_link *old_link,
@@ -46,6 +52,7 @@ const struct bf_flavor_ops bf_flavor_ops_nf = {
     .gen_inline_prologue = _bf_nf_gen_inline_prologue,
     .gen_inline_epilogue = _bf_nf_gen_inline_epilogue,
     .get_verdict = _bf_nf_get_verdict,
+    .gen_ct_lookup = _bf_nf_gen_ct_lookup,
     .attach_prog = _bf_nf_attach_prog,
     .detach_prog = _bf_nf_detach_prog,
 };
@@ -164,6 +171,74 @@ static int _bf_nf_get_verdict(enum bf_verdict verdict)
     return verdicts[verdict];
 }
 
+/**
+ * Generate the bytecode to get the packet's connection tracking state.
+ *
+ * The conntrack lookup kfuncs are not available to Netfilter programs, but
+ * the packet has already been processed by conntrack at this point, so the
+ * state is read from the @c sk_buff._nfct field: the lower bits contain the
+ * @c ip_conntrack_info value, the upper bits the address of the connection.
+ * Untracked packets are considered invalid.
+ *
+ * @param program Program to generate the bytecode into. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_nf_gen_ct_lookup(struct bf_program *program)
+{
+    int offset;
+    int r;
+
+    bf_assert(program);
+
+    EMIT(program,
+         BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_9, BF_PROG_CTX_OFF(arg)));
+    if ((offset = bf_btf_get_field_off("bpf_nf_ctx", "skb")) < 0)
+        return offset;
+    EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_1, offset));
+    if ((offset = bf_btf_get_field_off("sk_buff", "_nfct")) < 0)
+        return offset;
+    EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_1, offset));
+
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_3, 1 << BF_MATCHER_CT_STATE_INVALID));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_1));
+    EMIT(program, BPF_ALU64_IMM(BPF_AND, BPF_REG_2, ~BF_NF_CT_INFOMASK));
+
+    // No connection attached to the packet: the state is invalid
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+            bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_2, 0, 0));
+        _cleanup_bf_swich_ struct bf_swich swich =
+            bf_swich_get(program, BPF_REG_1);
+
+        EMIT(program, BPF_ALU64_IMM(BPF_AND, BPF_REG_1, BF_NF_CT_INFOMASK));
+
+        EMIT_SWICH_OPTION(&swich, IP_CT_ESTABLISHED,
+                          BPF_MOV64_IMM(BPF_REG_3,
+                                        1 << BF_MATCHER_CT_STATE_ESTABLISHED));
+        EMIT_SWICH_OPTION(&swich, IP_CT_ESTABLISHED_REPLY,
+                          BPF_MOV64_IMM(BPF_REG_3,
+                                        1 << BF_MATCHER_CT_STATE_ESTABLISHED));
+        EMIT_SWICH_OPTION(&swich, IP_CT_RELATED,
+                          BPF_MOV64_IMM(BPF_REG_3,
+                                        1 << BF_MATCHER_CT_STATE_RELATED));
+        EMIT_SWICH_OPTION(&swich, IP_CT_RELATED_REPLY,
+                          BPF_MOV64_IMM(BPF_REG_3,
+                                        1 << BF_MATCHER_CT_STATE_RELATED));
+        EMIT_SWICH_OPTION(&swich, IP_CT_NEW,
+                          BPF_MOV64_IMM(BPF_REG_3,
+                                        1 << BF_MATCHER_CT_STATE_NEW));
+
+        r = bf_swich_generate(&swich);
+        if (r)
+            return r;
+    }
+
+    EMIT(program, BPF_STX_MEM(BPF_W, BPF_REG_9, BPF_REG_3,
+                              BF_PROG_CTX_OFF(ct_state)));
+
+    return 0;
+}
+
 static int _bf_nf_attach_prog(struct bf_program *new_prog,
                               struct bf_program *old_prog,
                               int (*get_new_link_cb)(struct bf_program *prog,
@@ -8,6 +8,7 @@
 #include <linux/bpf.h>
 
 #include <bpf/btf.h>
+#include <bpf/libbpf.h>
 #include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -160,6 +161,10 @@ static const char *_bf_map_type_to_str(enum bf_map_type type)
         [BF_MAP_TYPE_COUNTERS] = "BF_MAP_TYPE_COUNTERS",
         [BF_MAP_TYPE_PRINTER] = "BF_MAP_TYPE_PRINTER",
         [BF_MAP_TYPE_SET] = "BF_MAP_TYPE_SET",
+        [BF_MAP_TYPE_TELEMETRY] = "BF_MAP_TYPE_TELEMETRY",
+        [BF_MAP_TYPE_PROFILE] = "BF_MAP_TYPE_PROFILE",
+        [BF_MAP_TYPE_RULES] = "BF_MAP_TYPE_RULES",
+        [BF_MAP_TYPE_TSS] = "BF_MAP_TYPE_TSS",
     };
 
     static_assert(ARRAY_SIZE(type_strs) == _BF_MAP_TYPE_MAX,
@@ -200,6 +205,9 @@ _bf_map_bpf_type_to_kernel_type(enum bf_map_bpf_type bpf_type)
     static const enum bpf_map_type _kernel_types[] = {
         [BF_MAP_BPF_TYPE_ARRAY] = BPF_MAP_TYPE_ARRAY,
         [BF_MAP_BPF_TYPE_HASH] = BPF_MAP_TYPE_HASH,
+        [BF_MAP_BPF_TYPE_LRU_HASH] = BPF_MAP_TYPE_LRU_HASH,
+        [BF_MAP_BPF_TYPE_PERCPU_HASH] = BPF_MAP_TYPE_PERCPU_HASH,
+        [BF_MAP_BPF_TYPE_PERCPU_ARRAY] = BPF_MAP_TYPE_PERCPU_ARRAY,
     };
 
     bf_assert(0 <= bpf_type && bpf_type < _BF_MAP_BPF_TYPE_MAX);
@@ -272,14 +280,30 @@ static struct bf_btf *_bf_map_make_btf(const struct bf_map *map)
 
     switch (map->type) {
     case BF_MAP_TYPE_COUNTERS:
+        // A single value containing an array of counters
+        btf__add_int(kbtf, "u64", 8, 0);
+        btf->key_type_id = btf__add_int(kbtf, "u32", 4, 0);
+        btf__add_struct(kbtf, "bf_counters", 16);
+        btf__add_field(kbtf, "packets", 1, 0, 0);
+        btf__add_field(kbtf, "bytes", 1, 64, 0);
+        btf->value_type_id =
+            btf__add_array(kbtf, btf->key_type_id, 3, map->value_size / 16);
+        break;
+    case BF_MAP_TYPE_TELEMETRY:
         btf__add_int(kbtf, "u64", 8, 0);
         btf->key_type_id = btf__add_int(kbtf, "u32", 4, 0);
         btf->value_type_id = btf__add_struct(kbtf, "bf_counters", 16);
         btf__add_field(kbtf, "packets", 1, 0, 0);
         btf__add_field(kbtf, "bytes", 1, 64, 0);
         break;
+    case BF_MAP_TYPE_PROFILE:
+        btf->value_type_id = btf__add_int(kbtf, "u64", 8, 0);
+        btf->key_type_id = btf__add_int(kbtf, "u32", 4, 0);
+        break;
     case BF_MAP_TYPE_PRINTER:
     case BF_MAP_TYPE_SET:
+    case BF_MAP_TYPE_RULES:
+    case BF_MAP_TYPE_TSS:
         bf_warn("bf_map type %s is not yet supported",
                 _bf_map_type_to_str(map->type));
         return NULL;
@@ -450,9 +474,128 @@ int bf_map_set_elem(const struct bf_map *map, void *key, void *value)
     return bf_bpf(BPF_MAP_UPDATE_ELEM, &attr);
 }
 
+int bf_map_delete_elem(const struct bf_map *map, void *key)
+{
+    union bpf_attr attr = {};
+
+    bf_assert(map && key);
+
+    attr.map_fd = map->fd;
+    attr.key = (unsigned long long)key;
+
+    return bf_bpf(BPF_MAP_DELETE_ELEM, &attr);
+}
+
+ssize_t bf_map_value_buf_size(const struct bf_map *map)
+{
+    int n_cpus;
+
+    bf_assert(map);
+
+    if (map->bpf_type != BF_MAP_BPF_TYPE_PERCPU_HASH &&
+        map->bpf_type != BF_MAP_BPF_TYPE_PERCPU_ARRAY)
+        return (ssize_t)map->value_size;
+
+    n_cpus = libbpf_num_possible_cpus();
+    if (n_cpus < 0)
+        return bf_err_r(n_cpus, "failed to get number of possible CPUs");
+
+    return (ssize_t)(((map->value_size + 7) & ~(size_t)7) * n_cpus);
+}
+
+ssize_t bf_map_mem_size(const struct bf_map *map)
+{
+    struct bpf_map_info info = {};
+    ssize_t value_buf_size;
+    int r;
+
+    bf_assert(map);
+
+    r = bf_bpf_obj_get_info(map->fd, &info, sizeof(info));
+    if (r < 0)
+        return bf_err_r(r, "failed to get info for map %s", map->name);
+
+    // Per-CPU maps store one value per possible CPU
+    value_buf_size = bf_map_value_buf_size(map);
+    if (value_buf_size < 0)
+        return value_buf_size;
+
+    return (ssize_t)((info.key_size + value_buf_size) * info.max_entries);
+}
+
+int bf_map_get_elems(const struct bf_map *map, void **keys, void **values,
+                     size_t *n_elems)
+{
+    _cleanup_free_ uint8_t *_keys = NULL;
+    _cleanup_free_ uint8_t *_values = NULL;
+    uint64_t batch_token = 0;
+    ssize_t value_buf_size;
+    size_t count = 0;
+    int r;
+
+    bf_assert(map && keys && values && n_elems);
+
+    value_buf_size = bf_map_value_buf_size(map);
+    if (value_buf_size < 0)
+        return (int)value_buf_size;
+
+    _keys = malloc(map->key_size * map->n_elems);
+    _values = malloc(value_buf_size * map->n_elems);
+    if (!_keys || !_values)
+        return -ENOMEM;
+
+    /* Hash maps can't contain more than n_elems elements, so there is always
+     * enough room for the next batch. The kernel returns -ENOENT once the
+     * whole map has been read. */
+    do {
+        union bpf_attr attr = {};
+
+        attr.batch.in_batch = count ? bf_ptr_to_u64(&batch_token) : 0;
+        attr.batch.out_batch = bf_ptr_to_u64(&batch_token);
+        attr.batch.keys = bf_ptr_to_u64(_keys + (count * map->key_size));
+        attr.batch.values = bf_ptr_to_u64(_values + (count * value_buf_size));
+        attr.batch.count = map->n_elems - count;
+        attr.batch.map_fd = map->fd;
+
+        r = bf_bpf(BPF_MAP_LOOKUP_BATCH, &attr);
+        if (r < 0 && r != -ENOENT)
+            return bf_err_r(r, "failed to read elements of map %s", map->name);
+
+        count += attr.batch.count;
+    } while (r != -ENOENT && count < map->n_elems);
+
+    *keys = TAKE_PTR(_keys);
+    *values = TAKE_PTR(_values);
+    *n_elems = count;
+
+    return 0;
+}
+
+int bf_map_set_elems(const struct bf_map *map, void *keys, void *values,
+                     size_t n_elems)
+{
+    union bpf_attr attr = {};
+
+    bf_assert(map && keys && values);
+
+    if (!n_elems)
+        return 0;
+
+    attr.batch.map_fd = map->fd;
+    attr.batch.keys = bf_ptr_to_u64(keys);
+    attr.batch.values = bf_ptr_to_u64(values);
+    attr.batch.count = n_elems;
+    attr.batch.flags = BPF_ANY;
+
+    return bf_bpf(BPF_MAP_UPDATE_BATCH, &attr);
+}
+
 static const char *_bf_map_bpf_type_strs[] = {
     [BF_MAP_BPF_TYPE_ARRAY] = "BF_MAP_BPF_TYPE_ARRAY",
     [BF_MAP_BPF_TYPE_HASH] = "BF_MAP_BPF_TYPE_HASH",
+    [BF_MAP_BPF_TYPE_LRU_HASH] = "BF_MAP_BPF_TYPE_LRU_HASH",
+    [BF_MAP_BPF_TYPE_PERCPU_HASH] = "BF_MAP_BPF_TYPE_PERCPU_HASH",
+    [BF_MAP_BPF_TYPE_PERCPU_ARRAY] = "BF_MAP_BPF_TYPE_PERCPU_ARRAY",
 };
 
 static_assert(ARRAY_SIZE(_bf_map_bpf_type_strs) == _BF_MAP_BPF_TYPE_MAX,
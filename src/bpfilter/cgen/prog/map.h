@@ -9,6 +9,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #include "core/dump.h"
 
@@ -16,6 +17,9 @@ enum bf_map_bpf_type
 {
     BF_MAP_BPF_TYPE_ARRAY,
     BF_MAP_BPF_TYPE_HASH,
+    BF_MAP_BPF_TYPE_LRU_HASH,
+    BF_MAP_BPF_TYPE_PERCPU_HASH,
+    BF_MAP_BPF_TYPE_PERCPU_ARRAY,
     _BF_MAP_BPF_TYPE_MAX,
 };
 
@@ -24,6 +28,10 @@ enum bf_map_type
     BF_MAP_TYPE_COUNTERS,
     BF_MAP_TYPE_PRINTER,
     BF_MAP_TYPE_SET,
+    BF_MAP_TYPE_TELEMETRY,
+    BF_MAP_TYPE_PROFILE,
+    BF_MAP_TYPE_RULES,
+    BF_MAP_TYPE_TSS,
     _BF_MAP_TYPE_MAX,
 };
 
@@ -230,6 +238,76 @@ int bf_map_set_n_elems(struct bf_map *map, size_t n_elems);
  */
 int bf_map_set_elem(const struct bf_map *map, void *key, void *value);
 
+/**
+ * Remove an element from the map.
+ *
+ * @param map BPF map to update. Can't be NULL.
+ * @param key Pointer to the key of the element to remove. The key size has
+ *            been defined with @ref bf_map_new . Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. If no element
+ *         exists for @p key , @c -ENOENT is returned.
+ */
+int bf_map_delete_elem(const struct bf_map *map, void *key);
+
+/**
+ * Get the size of the buffer required to store a single value of the map.
+ *
+ * Values of per-CPU maps are read and written from userspace as an array
+ * containing one value per possible CPU, each value being aligned on 8 bytes.
+ * For other maps, this is the size of a value.
+ *
+ * @param map BPF map to get the value buffer size of. Can't be NULL.
+ * @return Size of the buffer to use for a single value, or a negative errno
+ *         value on failure.
+ */
+ssize_t bf_map_value_buf_size(const struct bf_map *map);
+
+/**
+ * Estimate the memory used by a BPF map.
+ *
+ * The estimate is based on the map's @c bpf_map_info : it is the size of the
+ * keys and values of the maximum number of entries the map can contain,
+ * without the kernel's bookkeeping overhead.
+ *
+ * @param map BPF map to get the memory usage of. The map must have been
+ *        created. Can't be NULL.
+ * @return Estimated memory used by the map, in bytes, or a negative errno
+ *         value on failure.
+ */
+ssize_t bf_map_mem_size(const struct bf_map *map);
+
+/**
+ * Read all the elements of the map using batched lookups.
+ *
+ * @p keys and @p values are allocated by this function and owned by the
+ * caller. Values are stored in buffers of @ref bf_map_value_buf_size bytes.
+ *
+ * @param map BPF map to read the elements from. The map must be a hash map.
+ *        Can't be NULL.
+ * @param keys On success, points to an array of @p n_elems keys. Can't be
+ *        NULL.
+ * @param values On success, points to an array of @p n_elems values. Can't be
+ *        NULL.
+ * @param n_elems On success, contains the number of elements read from the
+ *        map. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_map_get_elems(const struct bf_map *map, void **keys, void **values,
+                     size_t *n_elems);
+
+/**
+ * Insert or update multiple elements of the map using a batched update.
+ *
+ * @param map BPF map to update. Can't be NULL.
+ * @param keys Array of @p n_elems keys. Can't be NULL.
+ * @param values Array of @p n_elems values, stored in buffers of
+ *        @ref bf_map_value_buf_size bytes. Can't be NULL.
+ * @param n_elems Number of elements to update.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_map_set_elems(const struct bf_map *map, void *keys, void *values,
+                     size_t n_elems);
+
 /**
  * Convert a @ref bf_map_bpf_type to a string.
  *
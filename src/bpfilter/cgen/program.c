@@ -7,22 +7,34 @@
 
 #include <linux/bpf.h>
 #include <linux/bpf_common.h>
+#include <linux/if_ether.h>
+#include <linux/in.h> // NOLINT
+#include <linux/ip.h>
+#include <linux/ipv6.h>
 #include <linux/limits.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
 
+#include <endian.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "bpfilter/cgen/cgroup.h"
 #include "bpfilter/cgen/dump.h"
 #include "bpfilter/cgen/fixup.h"
+#include "bpfilter/cgen/interp.h"
+#include "bpfilter/cgen/ir.h"
 #include "bpfilter/cgen/jmp.h"
+#include "bpfilter/cgen/matcher/ct.h"
 #include "bpfilter/cgen/matcher/ip4.h"
 #include "bpfilter/cgen/matcher/ip6.h"
 #include "bpfilter/cgen/matcher/meta.h"
@@ -34,12 +46,15 @@
 #include "bpfilter/cgen/prog/link.h"
 #include "bpfilter/cgen/prog/map.h"
 #include "bpfilter/cgen/stub.h"
+#include "bpfilter/cgen/swich.h"
 #include "bpfilter/cgen/tc.h"
+#include "bpfilter/cgen/tss.h"
 #include "bpfilter/cgen/xdp.h"
 #include "bpfilter/ctx.h"
 #include "core/bpf.h"
 #include "core/btf.h"
 #include "core/chain.h"
+#include "core/check.h"
 #include "core/counter.h"
 #include "core/dump.h"
 #include "core/flavor.h"
@@ -52,8 +67,12 @@
 #include "core/marsh.h"
 #include "core/matcher.h"
 #include "core/opts.h"
+#include "core/phase.h"
 #include "core/rule.h"
 #include "core/set.h"
+#include "core/sim.h"
+#include "core/subchain.h"
+#include "core/telemetry.h"
 #include "core/verdict.h"
 
 #include "external/filter.h"
@@ -61,6 +80,21 @@
 
 #define _BF_PROGRAM_DEFAULT_IMG_SIZE (1 << 6)
 
+/** Minimum number of elements to reserve room for in a set map. Sets can be
+ * modified while the program is loaded (see @ref bf_cgen_add_set_elem ), so
+ * the map must be able to grow beyond its initial content. */
+#define _BF_PROGRAM_SET_MIN_N_ELEMS (1 << 10)
+
+/** Minimum number of records to reserve for an interpreted chain in the rules
+ * map. Rules can be added to an interpreted chain without loading a new
+ * program, as long as the map has room for them. */
+#define _BF_PROGRAM_INTERP_MIN_N_RULES (1 << 6)
+
+/** Maximum depth of nested sub-chains calls. The verifier limits the call
+ * depth to 8 frames: the main function, the sub-chains, and the update
+ * counters function called from the deepest sub-chain. */
+#define _BF_PROGRAM_MAX_SUBCHAIN_DEPTH 6
+
 static const struct bf_flavor_ops *bf_flavor_ops_get(enum bf_hook hook)
 {
     static const struct bf_flavor_ops *flavor_ops[] = {
@@ -74,6 +108,10 @@ static const struct bf_flavor_ops *bf_flavor_ops_get(enum bf_hook hook)
         [BF_HOOK_NF_LOCAL_OUT] = &bf_flavor_ops_nf,
         [BF_HOOK_NF_POST_ROUTING] = &bf_flavor_ops_nf,
         [BF_HOOK_TC_EGRESS] = &bf_flavor_ops_tc,
+        [BF_HOOK_CGROUP_INET4_CONNECT] = &bf_flavor_ops_cgroup_sock_addr,
+        [BF_HOOK_CGROUP_INET6_CONNECT] = &bf_flavor_ops_cgroup_sock_addr,
+        [BF_HOOK_CGROUP_UDP4_SENDMSG] = &bf_flavor_ops_cgroup_sock_addr,
+        [BF_HOOK_CGROUP_UDP6_SENDMSG] = &bf_flavor_ops_cgroup_sock_addr,
     };
 
     bf_assert(0 <= hook && hook < _BF_HOOK_MAX);
@@ -114,6 +152,10 @@ static int _bf_program_genid(struct bf_program *program)
         [BF_HOOK_NF_LOCAL_OUT] = "nfo",
         [BF_HOOK_NF_POST_ROUTING] = "nfr",
         [BF_HOOK_TC_EGRESS] = "tce",
+        [BF_HOOK_CGROUP_INET4_CONNECT] = "c4c",
+        [BF_HOOK_CGROUP_INET6_CONNECT] = "c6c",
+        [BF_HOOK_CGROUP_UDP4_SENDMSG] = "u4s",
+        [BF_HOOK_CGROUP_UDP6_SENDMSG] = "u6s",
     };
     static_assert(ARRAY_SIZE(flavor_keys) == _BF_HOOK_MAX,
                   "missing entries in flavor_keys array");
@@ -146,6 +188,10 @@ static int _bf_program_genid(struct bf_program *program)
         break;
     case BF_HOOK_CGROUP_INGRESS:
     case BF_HOOK_CGROUP_EGRESS:
+    case BF_HOOK_CGROUP_INET4_CONNECT:
+    case BF_HOOK_CGROUP_INET6_CONNECT:
+    case BF_HOOK_CGROUP_UDP4_SENDMSG:
+    case BF_HOOK_CGROUP_UDP6_SENDMSG:
         (void)snprintf(buf, PATH_MAX, "%s_%s", flavor_keys[program->hook],
                        program->runtime.chain->hook_opts.cgroup);
         break;
@@ -166,7 +212,6 @@ int bf_program_new(struct bf_program **program, enum bf_hook hook,
 {
     _cleanup_bf_program_ struct bf_program *_program = NULL;
     char name[BPF_OBJ_NAME_LEN];
-    uint32_t set_idx = 0;
     int r;
 
     bf_assert(chain);
@@ -179,6 +224,8 @@ int bf_program_new(struct bf_program **program, enum bf_hook hook,
     _program->front = front;
     _program->runtime.ops = bf_flavor_ops_get(hook);
     _program->runtime.chain = chain;
+    _program->runtime.chains = bf_list_default(NULL, NULL);
+    _program->runtime.tuples = bf_tss_tuple_list();
 
     r = _bf_program_genid(_program);
     if (r) {
@@ -193,7 +240,7 @@ int bf_program_new(struct bf_program **program, enum bf_hook hook,
     (void)snprintf(name, BPF_OBJ_NAME_LEN, "%s_cmp", _program->id);
     r = bf_map_new(&_program->cmap, name, BF_MAP_TYPE_COUNTERS,
                    BF_MAP_BPF_TYPE_ARRAY, sizeof(uint32_t),
-                   sizeof(struct bf_counter), 1);
+                   BF_MAP_VALUE_SIZE_UNKNOWN, 1);
     if (r < 0)
         return bf_err_r(r, "failed to create the counters bf_map object");
 
@@ -204,23 +251,29 @@ int bf_program_new(struct bf_program **program, enum bf_hook hook,
     if (r < 0)
         return bf_err_r(r, "failed to create the printer bf_map object");
 
-    _program->sets = bf_map_list();
-    bf_list_foreach (&chain->sets, set_node) {
-        struct bf_set *set = bf_list_node_get_data(set_node);
-        _cleanup_bf_map_ struct bf_map *map = NULL;
-
-        (void)snprintf(name, BPF_OBJ_NAME_LEN, "%s_s%02x", _program->id,
-                       (uint8_t)set_idx++);
-        r = bf_map_new(&map, name, BF_MAP_TYPE_SET, BF_MAP_BPF_TYPE_HASH,
-                       set->elem_size, 1, bf_list_size(&set->elems));
+    if (bf_opts_telemetry()) {
+        (void)snprintf(name, BPF_OBJ_NAME_LEN, "%s_tlm", _program->id);
+        r = bf_map_new(&_program->tmap, name, BF_MAP_TYPE_TELEMETRY,
+                       BF_MAP_BPF_TYPE_PERCPU_ARRAY, sizeof(uint32_t),
+                       sizeof(struct bf_counter), _BF_TELEMETRY_MAX);
         if (r < 0)
-            return r;
+            return bf_err_r(r, "failed to create the telemetry bf_map object");
+    }
 
-        r = bf_list_add_tail(&_program->sets, map);
+    if (bf_opts_profile_rate()) {
+        (void)snprintf(name, BPF_OBJ_NAME_LEN, "%s_prf", _program->id);
+        r = bf_map_new(&_program->prmap, name, BF_MAP_TYPE_PROFILE,
+                       BF_MAP_BPF_TYPE_PERCPU_ARRAY, sizeof(uint32_t),
+                       sizeof(uint64_t), BF_MAP_N_ELEMS_UNKNOWN);
         if (r < 0)
-            return r;
-        TAKE_PTR(map);
-    };
+            return bf_err_r(r, "failed to create the profiling bf_map object");
+    }
+
+    _program->sets = bf_map_list();
+    _program->tss = bf_map_list();
+    r = bf_program_add_chain(_program, chain);
+    if (r)
+        return r;
 
     _program->links = bf_link_list();
 
@@ -232,12 +285,52 @@ int bf_program_new(struct bf_program **program, enum bf_hook hook,
                  (bf_list_ops[]) {{.free = (bf_list_ops_free)bf_fixup_free}});
 
     _program->runtime.prog_fd = -1;
+    _program->runtime.cur_profile_block = BF_PROGRAM_NO_PROFILE_BLOCK;
 
     *program = TAKE_PTR(_program);
 
     return 0;
 }
 
+/**
+ * Map the counters of a program into the daemon's memory.
+ *
+ * The counters map has a single value containing every counter, which can be
+ * mapped directly (the map is created with @c BPF_F_MMAPABLE ): counters are
+ * read and written in place, without copying the whole value. The mapping is
+ * kept until the program is unloaded or freed.
+ *
+ * @param program Program to map the counters of. Its counters map must have
+ *        been created or restored. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_program_map_counters(struct bf_program *program)
+{
+    void *addr;
+
+    bf_assert(program && !program->counters);
+
+    addr = mmap(NULL, program->cmap->value_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED, program->cmap->fd, 0);
+    if (addr == MAP_FAILED)
+        return bf_err_r(-errno, "failed to map the counters map");
+
+    program->counters = addr;
+
+    return 0;
+}
+
+static void _bf_program_unmap_counters(struct bf_program *program)
+{
+    bf_assert(program);
+
+    if (!program->counters)
+        return;
+
+    (void)munmap(program->counters, program->cmap->value_size);
+    program->counters = NULL;
+}
+
 void bf_program_free(struct bf_program **program)
 {
     if (!*program)
@@ -253,16 +346,145 @@ void bf_program_free(struct bf_program **program)
      * safely. */
     closep(&(*program)->runtime.prog_fd);
 
+    _bf_program_unmap_counters(*program);
     bf_map_free(&(*program)->cmap);
     bf_map_free(&(*program)->pmap);
+    bf_map_free(&(*program)->tmap);
+    bf_map_free(&(*program)->prmap);
+    bf_map_free(&(*program)->rmap);
     bf_list_clean(&(*program)->sets);
+    bf_list_clean(&(*program)->tss);
     bf_list_clean(&(*program)->links);
     bf_printer_free(&(*program)->printer);
+    bf_list_clean(&(*program)->runtime.chains);
+    bf_list_clean(&(*program)->runtime.tuples);
+    free((*program)->sections);
 
     free(*program);
     *program = NULL;
 }
 
+int bf_program_add_chain(struct bf_program *program,
+                         const struct bf_chain *chain)
+{
+    struct bf_program_section *section;
+    char name[BPF_OBJ_NAME_LEN];
+    int r;
+
+    bf_assert(program && chain);
+
+    r = bf_realloc((void **)&program->sections,
+                   (program->n_sections + 1) * sizeof(*program->sections));
+    if (r)
+        return bf_err_r(r, "failed to allocate a new program section");
+
+    section = &program->sections[program->n_sections];
+    *section = (struct bf_program_section) {
+        .n_counters = bf_chain_get_subchain_counters_offset(
+                          chain, bf_list_size(&chain->subchains)) +
+                      1,
+        .sets_offset = bf_list_size(&program->sets),
+        .n_sets = bf_list_size(&chain->sets),
+        .n_subchains = bf_list_size(&chain->subchains),
+        .profile_offset = 1,
+    };
+
+    /* Interpreted chains reserve records in the rules map, and the matching
+     * counters, so rules can be added without loading a new program. The
+     * rules map is shared by all the interpreted chains of the program. */
+    if (chain->hook_opts.mode == BF_HOOK_MODE_INTERPRETED) {
+        if (!bf_list_is_empty(&chain->subchains)) {
+            return bf_err_r(-ENOTSUP,
+                            "sub-chains can't be used in interpreted mode");
+        }
+
+        section->n_rules = bf_max(bf_list_size(&chain->rules) * 2,
+                                  (size_t)_BF_PROGRAM_INTERP_MIN_N_RULES);
+        section->n_counters = section->n_rules + 1;
+
+        if (!program->rmap) {
+            (void)snprintf(name, BPF_OBJ_NAME_LEN, "%s_rls", program->id);
+            r = bf_map_new(&program->rmap, name, BF_MAP_TYPE_RULES,
+                           BF_MAP_BPF_TYPE_ARRAY, sizeof(uint32_t),
+                           sizeof(struct bf_interp_rule),
+                           BF_MAP_N_ELEMS_UNKNOWN);
+            if (r < 0)
+                return bf_err_r(r, "failed to create the rules bf_map object");
+        }
+    }
+
+    if (program->prmap) {
+        section->profile_block = bf_opts_profile_block();
+        section->n_profile_blocks =
+            (bf_list_size(&chain->rules) + section->profile_block - 1) /
+            section->profile_block;
+
+        // Interpreted rules are evaluated by a loop, profiled as a whole.
+        if (chain->hook_opts.mode == BF_HOOK_MODE_INTERPRETED) {
+            section->profile_block = section->n_rules;
+            section->n_profile_blocks = 1;
+        }
+    }
+
+    if (program->n_sections) {
+        const struct bf_program_section *prev = section - 1;
+        section->counters_offset = prev->counters_offset + prev->n_counters;
+        section->subchains_offset = prev->subchains_offset + prev->n_subchains;
+        section->profile_offset =
+            prev->profile_offset + prev->n_profile_blocks;
+        section->rules_offset = prev->rules_offset + prev->n_rules;
+    }
+
+    bf_list_foreach (&chain->sets, set_node) {
+        struct bf_set *set = bf_list_node_get_data(set_node);
+        _cleanup_bf_map_ struct bf_map *map = NULL;
+
+        (void)snprintf(name, BPF_OBJ_NAME_LEN, "%s_s%02x", program->id,
+                       (uint8_t)bf_list_size(&program->sets));
+        if (set->counters && bf_set_is_dynamic(set)) {
+            return bf_err_r(-ENOTSUP,
+                            "dynamic sets don't support per-element counters");
+        }
+
+        if (set->counters) {
+            // Per-CPU counters: no need for atomic operations on update.
+            r = bf_map_new(&map, name, BF_MAP_TYPE_SET,
+                           BF_MAP_BPF_TYPE_PERCPU_HASH, set->elem_size,
+                           sizeof(struct bf_counter),
+                           bf_max(bf_list_size(&set->elems) * 2,
+                                  (size_t)_BF_PROGRAM_SET_MIN_N_ELEMS));
+        } else if (bf_set_is_dynamic(set)) {
+            // Dynamic sets are populated from the datapath: let the kernel
+            // evict the least recently used elements once the set is full.
+            r = bf_map_new(&map, name, BF_MAP_TYPE_SET,
+                           BF_MAP_BPF_TYPE_LRU_HASH, set->elem_size,
+                           sizeof(uint64_t),
+                           bf_max((size_t)set->max_elems,
+                                  bf_list_size(&set->elems)));
+        } else {
+            r = bf_map_new(&map, name, BF_MAP_TYPE_SET, BF_MAP_BPF_TYPE_HASH,
+                           set->elem_size, 1,
+                           bf_max(bf_list_size(&set->elems) * 2,
+                                  (size_t)_BF_PROGRAM_SET_MIN_N_ELEMS));
+        }
+        if (r < 0)
+            return r;
+
+        r = bf_list_add_tail(&program->sets, map);
+        if (r < 0)
+            return r;
+        TAKE_PTR(map);
+    };
+
+    r = bf_list_add_tail(&program->runtime.chains, (void *)chain);
+    if (r)
+        return r;
+
+    ++program->n_sections;
+
+    return 0;
+}
+
 int bf_program_marsh(const struct bf_program *program, struct bf_marsh **marsh)
 {
     _cleanup_bf_marsh_ struct bf_marsh *_marsh = NULL;
@@ -307,6 +529,55 @@ int bf_program_marsh(const struct bf_program *program, struct bf_marsh **marsh)
             return r;
     }
 
+    {
+        /* Serialize bf_program.tmap, or an empty child if the program has
+         * no telemetry map. */
+        _cleanup_bf_marsh_ struct bf_marsh *tmap_elem = NULL;
+
+        if (program->tmap)
+            r = bf_map_marsh(program->tmap, &tmap_elem);
+        else
+            r = bf_marsh_new(&tmap_elem, NULL, 0);
+        if (r < 0)
+            return r;
+
+        r = bf_marsh_add_child_obj(&_marsh, tmap_elem);
+        if (r < 0)
+            return r;
+    }
+
+    {
+        // Serialize bf_program.prmap, similarly to bf_program.tmap
+        _cleanup_bf_marsh_ struct bf_marsh *prmap_elem = NULL;
+
+        if (program->prmap)
+            r = bf_map_marsh(program->prmap, &prmap_elem);
+        else
+            r = bf_marsh_new(&prmap_elem, NULL, 0);
+        if (r < 0)
+            return r;
+
+        r = bf_marsh_add_child_obj(&_marsh, prmap_elem);
+        if (r < 0)
+            return r;
+    }
+
+    {
+        // Serialize bf_program.rmap, similarly to bf_program.tmap
+        _cleanup_bf_marsh_ struct bf_marsh *rmap_elem = NULL;
+
+        if (program->rmap)
+            r = bf_map_marsh(program->rmap, &rmap_elem);
+        else
+            r = bf_marsh_new(&rmap_elem, NULL, 0);
+        if (r < 0)
+            return r;
+
+        r = bf_marsh_add_child_obj(&_marsh, rmap_elem);
+        if (r < 0)
+            return r;
+    }
+
     {
         // Serialize bf_program.sets
         _cleanup_bf_marsh_ struct bf_marsh *sets_elem = NULL;
@@ -323,6 +594,19 @@ int bf_program_marsh(const struct bf_program *program, struct bf_marsh **marsh)
         }
     }
 
+    {
+        // Serialize bf_program.tss
+        _cleanup_bf_marsh_ struct bf_marsh *tss_elem = NULL;
+
+        r = bf_list_marsh(&program->tss, &tss_elem);
+        if (r < 0)
+            return r;
+
+        r = bf_marsh_add_child_obj(&_marsh, tss_elem);
+        if (r < 0)
+            return r;
+    }
+
     {
         // Serialize bf_program.links
         _cleanup_bf_marsh_ struct bf_marsh *links_elem = NULL;
@@ -356,6 +640,9 @@ int bf_program_marsh(const struct bf_program *program, struct bf_marsh **marsh)
                                 sizeof(program->num_counters));
     r |= bf_marsh_add_child_raw(&_marsh, program->img,
                                 program->img_size * sizeof(struct bpf_insn));
+    r |= bf_marsh_add_child_raw(&_marsh, program->sections,
+                                program->n_sections *
+                                    sizeof(struct bf_program_section));
     if (r)
         return bf_err_r(r, "Failed to serialize program");
 
@@ -412,6 +699,35 @@ int bf_program_unmarsh(const struct bf_marsh *marsh,
     if (r < 0)
         return r;
 
+    /* The program keeps its telemetry map, even if --telemetry is not used
+     * anymore: the bytecode depends on it. */
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return -EINVAL;
+    bf_map_free(&_program->tmap);
+    if (child->data_len) {
+        r = bf_map_new_from_marsh(&_program->tmap, pindir_fd, child);
+        if (r < 0)
+            return r;
+    }
+
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return -EINVAL;
+    bf_map_free(&_program->prmap);
+    if (child->data_len) {
+        r = bf_map_new_from_marsh(&_program->prmap, pindir_fd, child);
+        if (r < 0)
+            return r;
+    }
+
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return -EINVAL;
+    bf_map_free(&_program->rmap);
+    if (child->data_len) {
+        r = bf_map_new_from_marsh(&_program->rmap, pindir_fd, child);
+        if (r < 0)
+            return r;
+    }
+
     /** @todo Avoid creating and filling the list in @ref bf_program_new before
      * trashing it all here. Eventually, this function will be replaced with
      * @c bf_program_new_from_marsh and this issue could be solved by **not**
@@ -440,6 +756,27 @@ int bf_program_unmarsh(const struct bf_marsh *marsh,
         }
     }
 
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return -EINVAL;
+    {
+        // Unmarsh bf_program.tss
+        struct bf_marsh *tss_elem = NULL;
+
+        while ((tss_elem = bf_marsh_next_child(child, tss_elem))) {
+            _cleanup_bf_map_ struct bf_map *map = NULL;
+
+            r = bf_map_new_from_marsh(&map, pindir_fd, tss_elem);
+            if (r < 0)
+                return r;
+
+            r = bf_list_add_tail(&_program->tss, map);
+            if (r < 0)
+                return r;
+
+            TAKE_PTR(map);
+        }
+    }
+
     // Unmarsh bf_program.links
     if (!(child = bf_marsh_next_child(marsh, child)))
         return -EINVAL;
@@ -476,12 +813,22 @@ int bf_program_unmarsh(const struct bf_marsh *marsh,
     memcpy(&_program->num_counters, child->data,
            sizeof(_program->num_counters));
 
+    r = _bf_program_map_counters(_program);
+    if (r)
+        return r;
+
     if (!(child = bf_marsh_next_child(marsh, child)))
         return -EINVAL;
     _program->img = bf_memdup(child->data, child->data_len);
     _program->img_size = child->data_len / sizeof(struct bpf_insn);
     _program->img_cap = child->data_len / sizeof(struct bpf_insn);
 
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return -EINVAL;
+    freep((void *)&_program->sections);
+    _program->sections = bf_memdup(child->data, child->data_len);
+    _program->n_sections = child->data_len / sizeof(struct bf_program_section);
+
     if (bf_marsh_next_child(marsh, child))
         bf_warn("codegen marsh has more children than expected");
 
@@ -508,6 +855,30 @@ void bf_program_dump(const struct bf_program *program, prefix_t *prefix)
     DUMP(prefix, "hook: %s", bf_hook_to_str(program->hook));
     DUMP(prefix, "front: %s", bf_front_to_str(program->front));
     DUMP(prefix, "num_counters: %lu", program->num_counters);
+
+    DUMP(prefix, "sections: struct bf_program_section[%lu]",
+         program->n_sections);
+    bf_dump_prefix_push(prefix);
+    for (size_t i = 0; i < program->n_sections; ++i) {
+        const struct bf_program_section *section = &program->sections[i];
+
+        if (i == program->n_sections - 1)
+            bf_dump_prefix_last(prefix);
+
+        DUMP(prefix,
+             "counters: %u-%u, sets: %u-%u, subchains: %u-%u, profile: %u-%u, "
+             "rules: %u-%u",
+             section->counters_offset,
+             section->counters_offset + section->n_counters,
+             section->sets_offset, section->sets_offset + section->n_sets,
+             section->subchains_offset,
+             section->subchains_offset + section->n_subchains,
+             section->profile_offset,
+             section->profile_offset + section->n_profile_blocks,
+             section->rules_offset, section->rules_offset + section->n_rules);
+    }
+    bf_dump_prefix_pop(prefix);
+
     DUMP(prefix, "prog_name: %s", program->prog_name);
 
     DUMP(prefix, "cmap: struct bf_map *");
@@ -520,6 +891,33 @@ void bf_program_dump(const struct bf_program *program, prefix_t *prefix)
     bf_map_dump(program->pmap, bf_dump_prefix_last(prefix));
     bf_dump_prefix_pop(prefix);
 
+    if (program->tmap) {
+        DUMP(prefix, "tmap: struct bf_map *");
+        bf_dump_prefix_push(prefix);
+        bf_map_dump(program->tmap, bf_dump_prefix_last(prefix));
+        bf_dump_prefix_pop(prefix);
+    } else {
+        DUMP(prefix, "tmap: struct bf_map * (NULL)");
+    }
+
+    if (program->prmap) {
+        DUMP(prefix, "prmap: struct bf_map *");
+        bf_dump_prefix_push(prefix);
+        bf_map_dump(program->prmap, bf_dump_prefix_last(prefix));
+        bf_dump_prefix_pop(prefix);
+    } else {
+        DUMP(prefix, "prmap: struct bf_map * (NULL)");
+    }
+
+    if (program->rmap) {
+        DUMP(prefix, "rmap: struct bf_map *");
+        bf_dump_prefix_push(prefix);
+        bf_map_dump(program->rmap, bf_dump_prefix_last(prefix));
+        bf_dump_prefix_pop(prefix);
+    } else {
+        DUMP(prefix, "rmap: struct bf_map * (NULL)");
+    }
+
     DUMP(prefix, "sets: bf_list<bf_map>[%lu]", bf_list_size(&program->sets));
     bf_dump_prefix_push(prefix);
     bf_list_foreach (&program->sets, map_node) {
@@ -532,6 +930,18 @@ void bf_program_dump(const struct bf_program *program, prefix_t *prefix)
     }
     bf_dump_prefix_pop(prefix);
 
+    DUMP(prefix, "tss: bf_list<bf_map>[%lu]", bf_list_size(&program->tss));
+    bf_dump_prefix_push(prefix);
+    bf_list_foreach (&program->tss, map_node) {
+        struct bf_map *map = bf_list_node_get_data(map_node);
+
+        if (bf_list_is_tail(&program->tss, map_node))
+            bf_dump_prefix_last(prefix);
+
+        bf_map_dump(map, prefix);
+    }
+    bf_dump_prefix_pop(prefix);
+
     DUMP(prefix, "links: bf_list<bf_link>[%lu]", bf_list_size(&program->links));
     bf_dump_prefix_push(prefix);
     bf_list_foreach (&program->links, link_node) {
@@ -569,7 +979,9 @@ void bf_program_dump(const struct bf_program *program, prefix_t *prefix)
     DUMP(bf_dump_prefix_last(prefix), "runtime: <anonymous>");
     bf_dump_prefix_push(prefix);
     DUMP(prefix, "prog_fd: %d", program->runtime.prog_fd);
-    DUMP(bf_dump_prefix_last(prefix), "ops: %p", program->runtime.ops);
+    DUMP(prefix, "ops: %p", program->runtime.ops);
+    DUMP(bf_dump_prefix_last(prefix), "chains: bf_list<bf_chain>[%lu]",
+         bf_list_size(&program->runtime.chains));
     bf_dump_prefix_pop(prefix);
 
     bf_dump_prefix_pop(prefix);
@@ -629,8 +1041,27 @@ static void _bf_program_fixup_insn(struct bpf_insn *insn,
     }
 }
 
-static int _bf_program_fixup(struct bf_program *program,
-                             enum bf_fixup_type type)
+/**
+ * Get the location of a sub-chain's function in the program.
+ *
+ * @param program Program being generated. Can't be NULL.
+ * @param section Index of the section of the chain the sub-chain belongs to.
+ * @param index Index of the sub-chain in its chain.
+ * @return Pointer to the location of the sub-chain's function, which is 0 if
+ *         the function hasn't been generated yet.
+ */
+static uint32_t *_bf_program_subchain_location(struct bf_program *program,
+                                               uint32_t section, uint32_t index)
+{
+    bf_assert(program && program->runtime.subchains_location);
+    bf_assert(section < program->n_sections);
+    bf_assert(index < program->sections[section].n_subchains);
+
+    return &program->runtime.subchains_location
+                [program->sections[section].subchains_offset + index];
+}
+
+int bf_program_fixup(struct bf_program *program, enum bf_fixup_type type)
 {
     bf_assert(program);
     bf_assert(type >= 0 && type < _BF_FIXUP_TYPE_MAX);
@@ -651,6 +1082,13 @@ static int _bf_program_fixup(struct bf_program *program,
             insn_type = BF_FIXUP_INSN_OFF;
             value = (int)(program->img_size - fixup->insn - 1U);
             break;
+        case BF_FIXUP_TYPE_JMP_NEXT_CHAIN:
+            // gotol: the offset is stored in the immediate value.
+            insn_type = BF_FIXUP_INSN_IMM;
+            offset = program->img_size - fixup->insn - 1;
+            bf_assert(offset < INT_MAX);
+            value = (int32_t)offset;
+            break;
         case BF_FIXUP_TYPE_COUNTERS_MAP_FD:
             insn_type = BF_FIXUP_INSN_IMM;
             value = program->cmap->fd;
@@ -659,11 +1097,35 @@ static int _bf_program_fixup(struct bf_program *program,
             insn_type = BF_FIXUP_INSN_IMM;
             value = program->pmap->fd;
             break;
+        case BF_FIXUP_TYPE_TELEMETRY_MAP_FD:
+            bf_assert(program->tmap);
+            insn_type = BF_FIXUP_INSN_IMM;
+            value = program->tmap->fd;
+            break;
+        case BF_FIXUP_TYPE_PROFILE_MAP_FD:
+            bf_assert(program->prmap);
+            insn_type = BF_FIXUP_INSN_IMM;
+            value = program->prmap->fd;
+            break;
+        case BF_FIXUP_TYPE_RULES_MAP_FD:
+            bf_assert(program->rmap);
+            insn_type = BF_FIXUP_INSN_IMM;
+            value = program->rmap->fd;
+            break;
         case BF_FIXUP_TYPE_SET_MAP_FD:
-            map = bf_list_get_at(&program->sets, insn->imm);
+            map = bf_list_get_at(&program->sets, fixup->attr.set_index);
+            if (!map) {
+                return bf_err_r(-ENOENT, "can't find set map at index %lu",
+                                fixup->attr.set_index);
+            }
+            insn_type = BF_FIXUP_INSN_IMM;
+            value = map->fd;
+            break;
+        case BF_FIXUP_TYPE_TSS_MAP_FD:
+            map = bf_list_get_at(&program->tss, fixup->attr.tuple_index);
             if (!map) {
-                return bf_err_r(-ENOENT, "can't find set map at index %d",
-                                insn->imm);
+                return bf_err_r(-ENOENT, "can't find tuple map at index %lu",
+                                fixup->attr.tuple_index);
             }
             insn_type = BF_FIXUP_INSN_IMM;
             value = map->fd;
@@ -675,6 +1137,15 @@ static int _bf_program_fixup(struct bf_program *program,
             bf_assert(offset < INT_MAX);
             value = (int32_t)offset;
             break;
+        case BF_FIXUP_TYPE_SUBCHAIN_CALL:
+            insn_type = BF_FIXUP_INSN_IMM;
+            offset = *_bf_program_subchain_location(
+                         program, fixup->attr.subchain.section,
+                         fixup->attr.subchain.index) -
+                     fixup->insn - 1;
+            bf_assert(offset < INT_MAX);
+            value = (int32_t)offset;
+            break;
         default:
             bf_abort("unsupported fixup type, this should not happen: %d",
                      type);
@@ -688,32 +1159,327 @@ static int _bf_program_fixup(struct bf_program *program,
     return 0;
 }
 
-static int _bf_program_generate_rule(struct bf_program *program,
-                                     struct bf_rule *rule)
+/**
+ * Check whether the chain currently generated is the last chain of the
+ * program.
+ *
+ * @param program Program being generated. Can't be NULL.
+ * @return True if the chain currently generated is the last one, false
+ *         otherwise.
+ */
+static bool _bf_program_is_last_chain(const struct bf_program *program)
+{
+    bf_assert(program && program->runtime.cur_section);
+
+    return program->runtime.cur_section ==
+           &program->sections[program->n_sections - 1];
+}
+
+/**
+ * Emit the bytecode closing a profiling block.
+ *
+ * Non-sampled packets only pay for a load and a branch. Nothing is emitted if
+ * profiling is disabled.
+ *
+ * @param program Program to emit the bytecode into. Can't be NULL.
+ * @param block Index of the profiling block to close.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_program_emit_profile(struct bf_program *program,
+                                    uint32_t block)
+{
+    bf_assert(program);
+
+    if (!program->prmap)
+        return 0;
+
+    EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_9,
+                              BF_PROG_CTX_OFF(profile_ts)));
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+            bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_1, 0, 0));
+
+        EMIT(program, BPF_MOV32_IMM(BPF_REG_1, block));
+        EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_9));
+        EMIT_FIXUP_CALL(program, BF_FIXUP_FUNC_PROFILE);
+    }
+
+    return 0;
+}
+
+int bf_program_generate_verdict(struct bf_program *program,
+                                enum bf_verdict verdict)
 {
     int r;
 
     bf_assert(program);
-    bf_assert(rule);
 
-    bf_list_foreach (&rule->matchers, matcher_node) {
-        struct bf_matcher *matcher = bf_list_node_get_data(matcher_node);
+    if (program->runtime.cur_subchain) {
+        EMIT(program, BPF_MOV64_IMM(BPF_REG_0, verdict));
+        EMIT(program, BPF_EXIT_INSN());
+        return 0;
+    }
 
-        switch (matcher->type) {
-        case BF_MATCHER_META_IFINDEX:
-        case BF_MATCHER_META_L3_PROTO:
-        case BF_MATCHER_META_L4_PROTO:
-        case BF_MATCHER_META_SPORT:
-        case BF_MATCHER_META_DPORT:
-            r = bf_matcher_generate_meta(program, matcher);
-            if (r)
-                return r;
-            break;
-        case BF_MATCHER_IP4_SRC_ADDR:
-        case BF_MATCHER_IP4_DST_ADDR:
-        case BF_MATCHER_IP4_PROTO:
-            r = bf_matcher_generate_ip4(program, matcher);
-            if (r)
+    // The packet leaves the profiling block, record its sample.
+    if (program->runtime.cur_profile_block != BF_PROGRAM_NO_PROFILE_BLOCK) {
+        r = _bf_program_emit_profile(program,
+                                     program->runtime.cur_profile_block);
+        if (r)
+            return r;
+    }
+
+    if (verdict == BF_VERDICT_ACCEPT && !_bf_program_is_last_chain(program)) {
+        /* Chains can be large, use gotol as the next chain might not be
+         * reachable with a 16 bits offset. gotol is supported by every kernel
+         * supporting BPF_PROG_TYPE_NETFILTER programs. */
+        EMIT_FIXUP(program, BF_FIXUP_TYPE_JMP_NEXT_CHAIN, BPF_JMP32_A(0));
+        return 0;
+    }
+
+    EMIT(program,
+         BPF_MOV64_IMM(BPF_REG_0, program->runtime.ops->get_verdict(verdict)));
+    EMIT(program, BPF_EXIT_INSN());
+
+    return 0;
+}
+
+/**
+ * Generate the bytecode to apply the policy of the chain currently generated.
+ *
+ * @param program Program to generate the bytecode for. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_program_generate_policy(struct bf_program *program)
+{
+    const struct bf_program_section *section = program->runtime.cur_section;
+
+    bf_assert(!program->runtime.cur_subchain);
+
+    EMIT(program,
+         BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_9, BF_PROG_CTX_OFF(pkt_size)));
+    EMIT_UPDATE_COUNTERS(program,
+                         section->counters_offset + section->n_counters - 1);
+
+    return bf_program_generate_verdict(program,
+                                       program->runtime.cur_chain->policy);
+}
+
+/**
+ * Generate the bytecode to call a sub-chain, and process its return value.
+ *
+ * The sub-chain function returns the terminal verdict to apply, or
+ * @c BF_VERDICT_RETURN if no terminal verdict has been applied. In the later
+ * case, @c BF_VERDICT_JUMP continues with the next rule, while
+ * @c BF_VERDICT_GOTO returns to the caller of the current sub-chain, or
+ * applies the policy if a chain's rule is generated.
+ *
+ * @param program Program to generate the bytecode for. Can't be NULL.
+ * @param rule Rule with a @c BF_VERDICT_JUMP or @c BF_VERDICT_GOTO verdict.
+ *        Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_program_generate_subchain_call(struct bf_program *program,
+                                              const struct bf_rule *rule)
+{
+    union bf_fixup_attr attr;
+    int r;
+
+    bf_assert(program && rule);
+
+    if (rule->target >= bf_list_size(&program->runtime.cur_chain->subchains))
+        return bf_err_r(-EINVAL, "undefined sub-chain %u", rule->target);
+
+    attr.subchain.section = program->runtime.cur_section - program->sections;
+    attr.subchain.index = rule->target;
+
+    EMIT(program, BPF_MOV64_REG(BPF_REG_1, BPF_REG_9));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_7));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_3, BPF_REG_8));
+    r = bf_program_emit_fixup(program, BF_FIXUP_TYPE_SUBCHAIN_CALL,
+                              BPF_CALL_REL(0), &attr);
+    if (r)
+        return r;
+
+    if (rule->verdict == BF_VERDICT_JUMP) {
+        EMIT_FIXUP_JMP_NEXT_RULE(
+            program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, BF_VERDICT_RETURN, 0));
+    }
+
+    // Sub-chains return their verdict to the caller as-is.
+    if (program->runtime.cur_subchain) {
+        EMIT(program, BPF_EXIT_INSN());
+        return 0;
+    }
+
+    if (rule->verdict == BF_VERDICT_GOTO) {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_0, BF_VERDICT_RETURN, 0));
+
+        r = _bf_program_generate_policy(program);
+        if (r)
+            return r;
+    }
+
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_0, BF_VERDICT_ACCEPT, 0));
+
+        r = bf_program_generate_verdict(program, BF_VERDICT_ACCEPT);
+        if (r)
+            return r;
+    }
+
+    return bf_program_generate_verdict(program, BF_VERDICT_DROP);
+}
+
+/**
+ * Generate the bytecode to add the packet's source to a dynamic set.
+ *
+ * The key is built in the scratch area, from the packet's headers, according
+ * to the set's type. If the packet doesn't contain the required headers (e.g.
+ * IPv6 packet and @c BF_SET_IP4 set), nothing is added to the set. The
+ * element's value is its expiry timestamp, or @ref BF_PROG_SET_NO_EXPIRY if
+ * the set has no timeout. Failing to update the map is not fatal: the rule's
+ * verdict is applied anyway.
+ *
+ * @param program Program to generate the bytecode for. Can't be NULL.
+ * @param rule Rule with @c bf_rule::set_add set. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_program_generate_set_add(struct bf_program *program,
+                                        const struct bf_rule *rule)
+{
+    const struct bf_set *set;
+    uint16_t l3_proto;
+    int r;
+
+    bf_assert(program && rule);
+
+    set = bf_list_get_at(&program->runtime.cur_chain->sets, rule->set_index);
+    if (!set)
+        return bf_err_r(-EINVAL, "undefined set %u", rule->set_index);
+    if (!bf_set_is_dynamic(set)) {
+        return bf_err_r(-EINVAL, "can't add elements to static set %u",
+                        rule->set_index);
+    }
+
+    switch (set->type) {
+    case BF_SET_IP4:
+        l3_proto = ETH_P_IP;
+        break;
+    case BF_SET_SRCIP6PORT:
+    case BF_SET_SRCIP6:
+        l3_proto = ETH_P_IPV6;
+        break;
+    default:
+        return bf_err_r(-ENOTSUP, "can't add to set of type %s",
+                        bf_set_type_to_str(set->type));
+    }
+
+    _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+        program, BPF_JMP_IMM(BPF_JNE, BPF_REG_7, htobe16(l3_proto), 0));
+
+    // Store the key at the beginning of the scratch area
+    EMIT(program,
+         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_9, BF_PROG_CTX_OFF(l3_hdr)));
+    if (set->type == BF_SET_IP4) {
+        EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_6,
+                                  offsetof(struct iphdr, saddr)));
+        EMIT(program,
+             BPF_STX_MEM(BPF_W, BPF_REG_9, BPF_REG_1, BF_PROG_SCR_OFF(0)));
+    } else {
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_6,
+                                  offsetof(struct ipv6hdr, saddr)));
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_6,
+                                  offsetof(struct ipv6hdr, saddr) + 8));
+        EMIT(program,
+             BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_1, BF_PROG_SCR_OFF(0)));
+        EMIT(program,
+             BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_2, BF_PROG_SCR_OFF(8)));
+    }
+
+    if (set->type == BF_SET_SRCIP6PORT) {
+        _cleanup_bf_swich_ struct bf_swich swich =
+            bf_swich_get(program, BPF_REG_8);
+
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_9,
+                                  BF_PROG_CTX_OFF(l4_hdr)));
+        EMIT_SWICH_OPTION(&swich, IPPROTO_TCP,
+                          BPF_LDX_MEM(BPF_H, BPF_REG_1, BPF_REG_6,
+                                      offsetof(struct tcphdr, source)));
+        EMIT_SWICH_OPTION(&swich, IPPROTO_UDP,
+                          BPF_LDX_MEM(BPF_H, BPF_REG_1, BPF_REG_6,
+                                      offsetof(struct udphdr, source)));
+        EMIT_SWICH_DEFAULT(&swich, BPF_MOV64_IMM(BPF_REG_1, 0));
+        r = bf_swich_generate(&swich);
+        if (r)
+            return bf_err_r(r, "failed to generate swich for set add");
+
+        EMIT(program,
+             BPF_STX_MEM(BPF_H, BPF_REG_9, BPF_REG_1, BF_PROG_SCR_OFF(16)));
+    }
+
+    // Store the element's expiry timestamp after the key
+    if (set->timeout) {
+        const struct bpf_insn ld_insn[2] = {
+            BPF_LD_IMM64(BPF_REG_1, (uint64_t)set->timeout * 1000000000ULL)};
+
+        EMIT(program, BPF_EMIT_CALL(BPF_FUNC_ktime_get_ns));
+        EMIT(program, ld_insn[0]);
+        EMIT(program, ld_insn[1]);
+        EMIT(program, BPF_ALU64_REG(BPF_ADD, BPF_REG_0, BPF_REG_1));
+        EMIT(program,
+             BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_0, BF_PROG_SCR_OFF(24)));
+    } else {
+        // BPF_ST_MEM sign-extends its immediate: -1 is stored as UINT64_MAX
+        EMIT(program,
+             BPF_ST_MEM(BPF_DW, BPF_REG_9, BF_PROG_SCR_OFF(24), -1));
+    }
+
+    // Call bpf_map_update_elem(r1=map_fd, r2=key, r3=value, r4=BPF_ANY)
+    EMIT_LOAD_SET_FD_FIXUP(program, BPF_REG_1, rule->set_index);
+    EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_9));
+    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, BF_PROG_SCR_OFF(0)));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_3, BPF_REG_9));
+    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_3, BF_PROG_SCR_OFF(24)));
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_4, BPF_ANY));
+    EMIT(program, BPF_EMIT_CALL(BPF_FUNC_map_update_elem));
+
+    return 0;
+}
+
+static int _bf_program_generate_rule(struct bf_program *program,
+                                     struct bf_rule *rule)
+{
+    int r;
+
+    bf_assert(program);
+    bf_assert(rule);
+
+    bf_list_foreach (&rule->matchers, matcher_node) {
+        struct bf_matcher *matcher = bf_list_node_get_data(matcher_node);
+
+        if (program->runtime.ops->check_matcher) {
+            r = program->runtime.ops->check_matcher(program, matcher);
+            if (r)
+                return r;
+        }
+
+        switch (matcher->type) {
+        case BF_MATCHER_META_IFINDEX:
+        case BF_MATCHER_META_L3_PROTO:
+        case BF_MATCHER_META_L4_PROTO:
+        case BF_MATCHER_META_SPORT:
+        case BF_MATCHER_META_DPORT:
+            r = bf_matcher_generate_meta(program, matcher);
+            if (r)
+                return r;
+            break;
+        case BF_MATCHER_IP4_SRC_ADDR:
+        case BF_MATCHER_IP4_DST_ADDR:
+        case BF_MATCHER_IP4_PROTO:
+            r = bf_matcher_generate_ip4(program, matcher);
+            if (r)
                 return r;
             break;
         case BF_MATCHER_IP6_SADDR:
@@ -741,36 +1507,61 @@ static int _bf_program_generate_rule(struct bf_program *program,
             if (r)
                 return r;
             break;
+        case BF_MATCHER_CT_STATE:
+            r = bf_matcher_generate_ct(program, matcher);
+            if (r)
+                return r;
+            break;
         default:
             return bf_err_r(-EINVAL, "unknown matcher type %d", matcher->type);
         };
     }
 
     if (rule->counters) {
-        EMIT(program, BPF_MOV32_IMM(BPF_REG_1, rule->index));
-        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_10,
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_9,
                                   BF_PROG_CTX_OFF(pkt_size)));
-        EMIT_FIXUP_CALL(program, BF_FIXUP_FUNC_UPDATE_COUNTERS);
+        EMIT_UPDATE_COUNTERS(program, program->runtime.cur_counters_offset +
+                                          rule->index);
+    }
+
+    if (rule->set_add) {
+        r = _bf_program_generate_set_add(program, rule);
+        if (r)
+            return r;
     }
 
     switch (rule->verdict) {
     case BF_VERDICT_ACCEPT:
     case BF_VERDICT_DROP:
-        EMIT(program,
-             BPF_MOV64_IMM(BPF_REG_0,
-                           program->runtime.ops->get_verdict(rule->verdict)));
-        EMIT(program, BPF_EXIT_INSN());
+        r = bf_program_generate_verdict(program, rule->verdict);
+        if (r)
+            return r;
         break;
     case BF_VERDICT_CONTINUE:
         // Fall through to next rule or default chain policy.
         break;
+    case BF_VERDICT_JUMP:
+    case BF_VERDICT_GOTO:
+        r = _bf_program_generate_subchain_call(program, rule);
+        if (r)
+            return r;
+        break;
+    case BF_VERDICT_RETURN:
+        if (!program->runtime.cur_subchain) {
+            return bf_err_r(-EINVAL,
+                            "RETURN verdict is only supported in sub-chains");
+        }
+
+        EMIT(program, BPF_MOV64_IMM(BPF_REG_0, BF_VERDICT_RETURN));
+        EMIT(program, BPF_EXIT_INSN());
+        break;
     default:
         bf_abort("unsupported verdict, this should not happen: %d",
                  rule->verdict);
         break;
     }
 
-    r = _bf_program_fixup(program, BF_FIXUP_TYPE_JMP_NEXT_RULE);
+    r = bf_program_fixup(program, BF_FIXUP_TYPE_JMP_NEXT_RULE);
     if (r)
         return bf_err_r(r, "failed to generate next rule fixups");
 
@@ -778,32 +1569,42 @@ static int _bf_program_generate_rule(struct bf_program *program,
 }
 
 /**
- * Generate the BPF function to update a rule's counters.
+ * Generate a BPF function to update a @ref bf_counter in a map.
  *
  * This function defines a new function **in** the generated BPF program to
  * be called during packet processing.
  *
  * Parameters:
- * - @c r1 : index of the rule to update the counters for.
+ * - @c r1 : index of the counter to update.
  * - @c r2 : size of the packet.
  * Returns:
  * 0 on success, non-zero on error.
  *
  * @param program Program to emit the function into. Can not be NULL.
+ * @param map_fixup Fixup used to load the file descriptor of the map
+ *        containing the counters, e.g. @c BF_FIXUP_TYPE_TELEMETRY_MAP_FD .
  * @return 0 on success, or negative errno value on error.
  */
-static int _bf_program_generate_update_counters(struct bf_program *program)
+static int _bf_program_generate_update_map(struct bf_program *program,
+                                           enum bf_fixup_type map_fixup)
 {
-    // Move the counters key in scratch[0..4] and the packet size in scratch[8..15]
-    EMIT(program,
-         BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, BF_PROG_SCR_OFF(0)));
-    EMIT(program,
-         BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_2, BF_PROG_SCR_OFF(8)));
+    const struct bpf_insn ld_insn[2] = {BPF_LD_MAP_FD(BPF_REG_1, 0)};
+    int r;
+
+    /* Move the counters key on the stack, and the packet size in r6. Only use
+     * the bare minimum amount of stack, as the function can be called from
+     * nested sub-chains, and the stack size is limited for the whole call
+     * chain. */
+    EMIT(program, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, -8));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_6, BPF_REG_2));
 
     // Call bpf_map_lookup_elem()
-    EMIT_LOAD_COUNTERS_FD_FIXUP(program, BPF_REG_1);
+    r = bf_program_emit_fixup(program, map_fixup, ld_insn[0], NULL);
+    if (r)
+        return r;
+    EMIT(program, ld_insn[1]);
     EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_10));
-    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, BF_PROG_SCR_OFF(0)));
+    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -8));
     EMIT(program, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
 
     // If the counters doesn't exist, return from the function
@@ -812,7 +1613,7 @@ static int _bf_program_generate_update_counters(struct bf_program *program)
             bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, 0));
 
         if (bf_opts_is_verbose(BF_VERBOSE_BPF))
-            EMIT_PRINT(program, "failed to fetch the rule's counters");
+            EMIT_PRINT(program, "failed to fetch the counters");
 
         EMIT(program, BPF_MOV32_IMM(BPF_REG_0, 1));
         EMIT(program, BPF_EXIT_INSN());
@@ -828,9 +1629,7 @@ static int _bf_program_generate_update_counters(struct bf_program *program)
     // Increase the total byte by the size of the packet.
     EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_0,
                               offsetof(struct bf_counter, bytes)));
-    EMIT(program,
-         BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_10, BF_PROG_SCR_OFF(8)));
-    EMIT(program, BPF_ALU64_REG(BPF_ADD, BPF_REG_1, BPF_REG_2));
+    EMIT(program, BPF_ALU64_REG(BPF_ADD, BPF_REG_1, BPF_REG_6));
     EMIT(program, BPF_STX_MEM(BPF_DW, BPF_REG_0, BPF_REG_1,
                               offsetof(struct bf_counter, bytes)));
 
@@ -841,15 +1640,329 @@ static int _bf_program_generate_update_counters(struct bf_program *program)
     return 0;
 }
 
+/**
+ * Generate the BPF function to update a rule's counters.
+ *
+ * Used when the index of the counters is only known at runtime (interpreted
+ * rules and classifiers), otherwise @ref EMIT_UPDATE_COUNTERS updates the
+ * counters inline. The counters' address is computed from the counters map's
+ * value address, the index is bounded by the number of counters to please
+ * the verifier.
+ *
+ * Parameters:
+ * - @c r1 : index of the counter to update.
+ * - @c r2 : size of the packet.
+ * Returns:
+ * 0 on success, non-zero on error.
+ *
+ * @param program Program to emit the function into. Can not be NULL.
+ * @return 0 on success, or negative errno value on error.
+ */
+static int _bf_program_generate_update_counters(struct bf_program *program)
+{
+    struct bpf_insn ld_insn[2] = {BPF_LD_MAP_FD(BPF_REG_3, 0)};
+    int r;
+
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+            program,
+            BPF_JMP_IMM(BPF_JLT, BPF_REG_1, program->num_counters, 0));
+
+        if (bf_opts_is_verbose(BF_VERBOSE_BPF))
+            EMIT_PRINT(program, "counters index out of bounds");
+
+        EMIT(program, BPF_MOV32_IMM(BPF_REG_0, 1));
+        EMIT(program, BPF_EXIT_INSN());
+    }
+
+    ld_insn[0].src_reg = BPF_PSEUDO_MAP_VALUE;
+    r = bf_program_emit_fixup(program, BF_FIXUP_TYPE_COUNTERS_MAP_FD,
+                              ld_insn[0], NULL);
+    if (r)
+        return r;
+    EMIT(program, ld_insn[1]);
+
+    EMIT(program,
+         BPF_ALU64_IMM(BPF_MUL, BPF_REG_1, sizeof(struct bf_counter)));
+    EMIT(program, BPF_ALU64_REG(BPF_ADD, BPF_REG_3, BPF_REG_1));
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_1, 1));
+    EMIT(program, BPF_ATOMIC_OP(BPF_DW, BPF_ADD, BPF_REG_3, BPF_REG_1,
+                                offsetof(struct bf_counter, packets)));
+    EMIT(program, BPF_ATOMIC_OP(BPF_DW, BPF_ADD, BPF_REG_3, BPF_REG_2,
+                                offsetof(struct bf_counter, bytes)));
+
+    // On success, return 0
+    EMIT(program, BPF_MOV32_IMM(BPF_REG_0, 0));
+    EMIT(program, BPF_EXIT_INSN());
+
+    return 0;
+}
+
+/**
+ * Generate the BPF function to update a telemetry counter.
+ *
+ * See @ref _bf_program_generate_update_map , @c r1 contains the
+ * @ref bf_telemetry counter to update. The telemetry map is a per-CPU map, so
+ * the counters can be updated without atomic operations.
+ *
+ * @param program Program to emit the function into. Can not be NULL.
+ * @return 0 on success, or negative errno value on error.
+ */
+static int _bf_program_generate_update_telemetry(struct bf_program *program)
+{
+    return _bf_program_generate_update_map(program,
+                                           BF_FIXUP_TYPE_TELEMETRY_MAP_FD);
+}
+
+/**
+ * Generate the BPF function closing a profiling block.
+ *
+ * The function computes the time elapsed since the previous profiling block
+ * boundary, increments the matching bucket of the block's histogram, and
+ * stores the current time in the runtime context for the next block.
+ *
+ * Parameters:
+ * - @c r1 : index of the profiling block to close.
+ * - @c r2 : address of the runtime context.
+ * Returns:
+ * 0 on success, non-zero on error.
+ *
+ * @param program Program to emit the function into. Can not be NULL.
+ * @return 0 on success, or negative errno value on error.
+ */
+static int _bf_program_generate_profile(struct bf_program *program)
+{
+    const struct bpf_insn ld_insn[2] = {BPF_LD_MAP_FD(BPF_REG_1, 0)};
+    int r;
+
+    EMIT(program, BPF_MOV64_REG(BPF_REG_6, BPF_REG_1));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_7, BPF_REG_2));
+
+    // r0 = time elapsed since the previous boundary
+    EMIT(program, BPF_EMIT_CALL(BPF_FUNC_ktime_get_ns));
+    EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_7,
+                              BF_PROG_CTX_OFF(profile_ts)));
+    EMIT(program, BPF_STX_MEM(BPF_DW, BPF_REG_7, BPF_REG_0,
+                              BF_PROG_CTX_OFF(profile_ts)));
+    EMIT(program, BPF_ALU64_REG(BPF_SUB, BPF_REG_0, BPF_REG_1));
+
+    // r2 = log2(r0), computed with a binary search on the highest bit set
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_2, 0));
+    for (int shift = 32; shift; shift /= 2) {
+        EMIT(program, BPF_MOV64_REG(BPF_REG_1, BPF_REG_0));
+        EMIT(program, BPF_ALU64_IMM(BPF_RSH, BPF_REG_1, shift));
+        {
+            _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+                bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_1, 0, 0));
+
+            EMIT(program, BPF_MOV64_REG(BPF_REG_0, BPF_REG_1));
+            EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, shift));
+        }
+    }
+
+    // Slow samples are accounted for in the last bucket
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+            program,
+            BPF_JMP_IMM(BPF_JLT, BPF_REG_2, BF_PROFILE_N_BUCKETS, 0));
+
+        EMIT(program, BPF_MOV64_IMM(BPF_REG_2, BF_PROFILE_N_BUCKETS - 1));
+    }
+
+    // Store the bucket's key on the stack
+    EMIT(program, BPF_ALU64_IMM(BPF_MUL, BPF_REG_6, BF_PROFILE_N_BUCKETS));
+    EMIT(program, BPF_ALU64_REG(BPF_ADD, BPF_REG_6, BPF_REG_2));
+    EMIT(program, BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_6, -8));
+
+    // Call bpf_map_lookup_elem()
+    r = bf_program_emit_fixup(program, BF_FIXUP_TYPE_PROFILE_MAP_FD,
+                              ld_insn[0], NULL);
+    if (r)
+        return r;
+    EMIT(program, ld_insn[1]);
+    EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_10));
+    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -8));
+    EMIT(program, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
+
+    // If the bucket doesn't exist, return from the function
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+            bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, 0));
+
+        EMIT(program, BPF_MOV32_IMM(BPF_REG_0, 1));
+        EMIT(program, BPF_EXIT_INSN());
+    }
+
+    // The map is a per-CPU map, no need for an atomic increment
+    EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_0, 0));
+    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_1, 1));
+    EMIT(program, BPF_STX_MEM(BPF_DW, BPF_REG_0, BPF_REG_1, 0));
+
+    EMIT(program, BPF_MOV32_IMM(BPF_REG_0, 0));
+    EMIT(program, BPF_EXIT_INSN());
+
+    return 0;
+}
+
+/**
+ * Emit the bytecode deciding whether the packet is sampled for profiling.
+ *
+ * One packet out of @c --profile is sampled, its profiling timestamp is
+ * initialized to the current time. The profiling timestamp of the other
+ * packets is set to 0. @c r1 is clobbered.
+ *
+ * @param program Program to emit the bytecode into. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_program_emit_profile_sampling(struct bf_program *program)
+{
+    unsigned int rate = bf_opts_profile_rate();
+
+    bf_assert(program);
+
+    if (!program->prmap)
+        return 0;
+
+    EMIT(program,
+         BPF_ST_MEM(BPF_DW, BPF_REG_10, BF_PROG_CTX_OFF(profile_ts), 0));
+
+    // Every packet is sampled
+    if (rate == 1) {
+        EMIT(program, BPF_EMIT_CALL(BPF_FUNC_ktime_get_ns));
+        EMIT(program, BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_0,
+                                  BF_PROG_CTX_OFF(profile_ts)));
+        return 0;
+    }
+
+    EMIT(program, BPF_EMIT_CALL(BPF_FUNC_get_prandom_u32));
+    EMIT(program, BPF_ALU32_IMM(BPF_MOD, BPF_REG_0, rate));
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+            bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, 0));
+
+        EMIT(program, BPF_EMIT_CALL(BPF_FUNC_ktime_get_ns));
+        EMIT(program, BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_0,
+                                  BF_PROG_CTX_OFF(profile_ts)));
+    }
+
+    return 0;
+}
+
+/**
+ * Generate the function looking up the packet's connection.
+ *
+ * The function is called with the address of the runtime context in @c r1 ,
+ * and the L3 and L4 protocol IDs in @c r2 and @c r3 . The lookup itself is
+ * flavor-specific, it stores the connection tracking state in the runtime
+ * context.
+ *
+ * @param program Program to emit the function into. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_program_generate_ct_lookup(struct bf_program *program)
+{
+    int r;
+
+    bf_assert(program && program->runtime.ops->gen_ct_lookup);
+
+    EMIT(program, BPF_MOV64_REG(BPF_REG_9, BPF_REG_1));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_7, BPF_REG_2));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_8, BPF_REG_3));
+
+    r = program->runtime.ops->gen_ct_lookup(program);
+    if (r)
+        return r;
+
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_0, 0));
+    EMIT(program, BPF_EXIT_INSN());
+
+    return 0;
+}
+
+/**
+ * Generate the BPF function for a sub-chain.
+ *
+ * The function is called with the address of the runtime context in @c r1 ,
+ * and the L3 and L4 protocol IDs in @c r2 and @c r3 . It returns the
+ * terminal verdict to apply, or @c BF_VERDICT_RETURN .
+ *
+ * @param program Program to emit the function into. Can't be NULL.
+ * @param section Index of the section of the chain the sub-chain belongs to.
+ * @param index Index of the sub-chain in its chain.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_program_generate_subchain(struct bf_program *program,
+                                         uint32_t section, uint32_t index)
+{
+    const struct bf_chain *chain =
+        bf_list_get_at(&program->runtime.chains, section);
+    const struct bf_subchain *subchain;
+    int r;
+
+    bf_assert(chain);
+
+    subchain = bf_list_get_at(&chain->subchains, index);
+    bf_assert(subchain);
+
+    program->runtime.cur_chain = chain;
+    program->runtime.cur_section = &program->sections[section];
+    program->runtime.cur_subchain = subchain;
+    program->runtime.cur_counters_offset =
+        program->runtime.cur_section->counters_offset +
+        bf_chain_get_subchain_counters_offset(chain, index);
+
+    EMIT(program, BPF_MOV64_REG(BPF_REG_9, BPF_REG_1));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_7, BPF_REG_2));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_8, BPF_REG_3));
+
+    bf_list_foreach (&subchain->rules, rule_node) {
+        r = _bf_program_generate_rule(program,
+                                      bf_list_node_get_data(rule_node));
+        if (r)
+            return r;
+    }
+
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_0, BF_VERDICT_RETURN));
+    EMIT(program, BPF_EXIT_INSN());
+
+    program->runtime.cur_chain = NULL;
+    program->runtime.cur_section = NULL;
+    program->runtime.cur_subchain = NULL;
+
+    return 0;
+}
+
 static int _bf_program_generate_functions(struct bf_program *program)
 {
     int r;
 
     bf_assert(program);
 
-    bf_list_foreach (&program->fixups, fixup_node) {
+    /* Generating a function can add new fixups to the list (e.g. a sub-chain
+     * calling another sub-chain), so the next node is only fetched once the
+     * current fixup has been processed. */
+    for (bf_list_node *fixup_node = bf_list_get_head(&program->fixups);
+         fixup_node; fixup_node = bf_list_node_next(fixup_node)) {
         struct bf_fixup *fixup = bf_list_node_get_data(fixup_node);
         size_t off = program->img_size;
+        uint32_t *location;
+
+        if (fixup->type == BF_FIXUP_TYPE_SUBCHAIN_CALL) {
+            location = _bf_program_subchain_location(
+                program, fixup->attr.subchain.section,
+                fixup->attr.subchain.index);
+            if (*location)
+                continue;
+
+            r = _bf_program_generate_subchain(program,
+                                              fixup->attr.subchain.section,
+                                              fixup->attr.subchain.index);
+            if (r)
+                return r;
+
+            *location = off;
+            continue;
+        }
 
         if (fixup->type != BF_FIXUP_TYPE_FUNC_CALL)
             continue;
@@ -867,6 +1980,26 @@ static int _bf_program_generate_functions(struct bf_program *program)
             if (r)
                 return r;
             break;
+        case BF_FIXUP_FUNC_CT_LOOKUP:
+            r = _bf_program_generate_ct_lookup(program);
+            if (r)
+                return r;
+            break;
+        case BF_FIXUP_FUNC_UPDATE_TELEMETRY:
+            r = _bf_program_generate_update_telemetry(program);
+            if (r)
+                return r;
+            break;
+        case BF_FIXUP_FUNC_PROFILE:
+            r = _bf_program_generate_profile(program);
+            if (r)
+                return r;
+            break;
+        case BF_FIXUP_FUNC_INTERP_RULE:
+            r = bf_interp_generate_rule(program);
+            if (r)
+                return r;
+            break;
         default:
             bf_abort("unsupported fixup function, this should not happen: %d",
                      fixup->attr.function);
@@ -984,23 +2117,249 @@ int bf_program_emit_fixup_call(struct bf_program *program,
     return 0;
 }
 
+/**
+ * Generate the bytecode for the chain currently generated.
+ *
+ * @param program Program to generate the bytecode for. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_program_generate_chain(struct bf_program *program)
+{
+    const struct bf_chain *chain = program->runtime.cur_chain;
+    const struct bf_program_section *section = program->runtime.cur_section;
+    uint32_t i = 0;
+    int r;
+
+    bf_assert(chain && section);
+
+    program->runtime.cur_counters_offset = section->counters_offset;
+    program->runtime.cur_profile_block = section->n_profile_blocks ?
+                                             section->profile_offset :
+                                             BF_PROGRAM_NO_PROFILE_BLOCK;
+
+    if (chain->hook_opts.mode == BF_HOOK_MODE_INTERPRETED) {
+        r = bf_interp_generate_chain(program);
+        if (r)
+            return r;
+    } else {
+        size_t n_skip = 0;
+
+        bf_list_foreach (&chain->rules, rule_node) {
+            // Rules replaced by a classifier are not profiled individually.
+            if (n_skip) {
+                --n_skip;
+                ++i;
+                continue;
+            }
+
+            // Close the previous profiling block before its first rule.
+            if (section->n_profile_blocks && i &&
+                i % section->profile_block == 0) {
+                uint32_t block =
+                    section->profile_offset + i / section->profile_block;
+
+                r = _bf_program_emit_profile(program, block - 1);
+                if (r)
+                    return r;
+
+                program->runtime.cur_profile_block = block;
+            }
+
+            if (chain->hook_opts.mode == BF_HOOK_MODE_CLASSIFIER) {
+                r = bf_tss_generate(program, rule_node, &n_skip);
+                if (r)
+                    return r;
+
+                if (n_skip) {
+                    --n_skip;
+                    ++i;
+                    continue;
+                }
+            }
+
+            r = _bf_program_generate_rule(program,
+                                          bf_list_node_get_data(rule_node));
+            if (r)
+                return r;
+
+            ++i;
+        }
+    }
+
+    if (section->n_profile_blocks) {
+        r = _bf_program_emit_profile(
+            program, section->profile_offset + section->n_profile_blocks - 1);
+        if (r)
+            return r;
+    }
+
+    // The policy isn't part of the last profiling block.
+    program->runtime.cur_profile_block = BF_PROGRAM_NO_PROFILE_BLOCK;
+
+    if (_bf_program_is_last_chain(program)) {
+        r = program->runtime.ops->gen_inline_epilogue(program);
+        if (r)
+            return r;
+    }
+
+    return _bf_program_generate_policy(program);
+}
+
+/**
+ * Get the depth of a sub-chain, which is the number of nested sub-chain
+ * calls it performs, including itself.
+ *
+ * @param chain Chain the sub-chain belongs to. Can't be NULL.
+ * @param index Index of the sub-chain in @p chain .
+ * @param depths Depth of each sub-chain of @p chain , used to process each
+ *        sub-chain only once: 0 if the depth is unknown, -1 if it is being
+ *        computed. Can't be NULL.
+ * @return Depth of the sub-chain on success, or a negative errno value on
+ *         failure.
+ */
+static int _bf_program_get_subchain_depth(const struct bf_chain *chain,
+                                          size_t index, int *depths)
+{
+    const struct bf_subchain *subchain;
+    int depth = 1;
+    int r;
+
+    bf_assert(chain && depths);
+
+    subchain = bf_list_get_at(&chain->subchains, index);
+    if (!subchain)
+        return bf_err_r(-EINVAL, "undefined sub-chain %lu", index);
+
+    if (depths[index] < 0) {
+        return bf_err_r(-ELOOP, "sub-chain '%s' is called recursively",
+                        subchain->name);
+    }
+
+    if (depths[index])
+        return depths[index];
+
+    depths[index] = -1;
+
+    bf_list_foreach (&subchain->rules, rule_node) {
+        struct bf_rule *rule = bf_list_node_get_data(rule_node);
+
+        if (rule->verdict != BF_VERDICT_JUMP &&
+            rule->verdict != BF_VERDICT_GOTO)
+            continue;
+
+        r = _bf_program_get_subchain_depth(chain, rule->target, depths);
+        if (r < 0)
+            return r;
+
+        depth = bf_max(depth, r + 1);
+    }
+
+    depths[index] = depth;
+
+    return depth;
+}
+
+/**
+ * Ensure the sub-chains called by a chain can be loaded.
+ *
+ * The BPF verifier doesn't support recursive calls, and limits the number of
+ * nested calls.
+ *
+ * @param chain Chain to check the sub-chains of. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_program_check_subchains(const struct bf_chain *chain)
+{
+    _cleanup_free_ int *depths = NULL;
+    int r;
+
+    bf_assert(chain);
+
+    if (bf_list_is_empty(&chain->subchains))
+        return 0;
+
+    depths = calloc(bf_list_size(&chain->subchains), sizeof(*depths));
+    if (!depths)
+        return -ENOMEM;
+
+    bf_list_foreach (&chain->rules, rule_node) {
+        struct bf_rule *rule = bf_list_node_get_data(rule_node);
+
+        if (rule->verdict != BF_VERDICT_JUMP &&
+            rule->verdict != BF_VERDICT_GOTO)
+            continue;
+
+        r = _bf_program_get_subchain_depth(chain, rule->target, depths);
+        if (r < 0)
+            return r;
+
+        if (r > _BF_PROGRAM_MAX_SUBCHAIN_DEPTH) {
+            return bf_err_r(-E2BIG,
+                            "sub-chains can't be nested more than %d times",
+                            _BF_PROGRAM_MAX_SUBCHAIN_DEPTH);
+        }
+    }
+
+    return 0;
+}
+
 int bf_program_generate(struct bf_program *program)
 {
-    const struct bf_chain *chain = program->runtime.chain;
+    _cleanup_free_ uint32_t *subchains_location = NULL;
+    _cleanup_bf_phase_timer_ struct bf_phase_timer _ =
+        bf_phase_timer_start(BF_PHASE_GENERATE);
+    const struct bf_program_section *last;
+    size_t i = 0;
     int r;
 
+    bf_assert(program && program->n_sections);
+
     bf_info("generating program for %s::%s", bf_front_to_str(program->front),
             bf_hook_to_str(program->hook));
 
-    /* Add 1 to the number of counters for the policy counter, and 1
-     * for the first reserved error slot. This must be done ahead of
-     * generation, as we will index into the error counters. */
-    program->num_counters = bf_list_size(&chain->rules) + 2;
+    bf_list_foreach (&program->runtime.chains, chain_node) {
+        r = _bf_program_check_subchains(bf_list_node_get_data(chain_node));
+        if (r)
+            return r;
+    }
+
+    /* Each chain has a counter per rule (including its sub-chains' rules),
+     * and one for its policy. Add 1 to the number of counters for the error
+     * slot, shared by all the chains and located at the end of the map. This
+     * must be done ahead of generation, as we will index into the error
+     * counters. */
+    last = &program->sections[program->n_sections - 1];
+    program->num_counters = last->counters_offset + last->n_counters + 1;
+
+    if (last->subchains_offset + last->n_subchains) {
+        subchains_location =
+            calloc(last->subchains_offset + last->n_subchains,
+                   sizeof(*subchains_location));
+        if (!subchains_location)
+            return -ENOMEM;
+    }
+    program->runtime.subchains_location = subchains_location;
 
     // Save the program's argument into the context.
     EMIT(program,
          BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_1, BF_PROG_CTX_OFF(arg)));
 
+    // Sample the packet for profiling, this clobbers the argument registers
+    if (program->prmap) {
+        r = _bf_program_emit_profile_sampling(program);
+        if (r)
+            return r;
+
+        EMIT(program,
+             BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_10, BF_PROG_CTX_OFF(arg)));
+    }
+
+    // Keep the runtime context address available to the sub-chain functions
+    EMIT(program, BPF_MOV64_REG(BPF_REG_9, BPF_REG_10));
+
+    // The packet's connection hasn't been looked up yet
+    EMIT(program, BPF_ST_MEM(BPF_W, BPF_REG_10, BF_PROG_CTX_OFF(ct_state), 0));
+
     // Reset the protocol ID registers
     EMIT(program, BPF_MOV64_IMM(BPF_REG_7, 0));
     EMIT(program, BPF_MOV64_IMM(BPF_REG_8, 0));
@@ -1009,35 +2368,41 @@ int bf_program_generate(struct bf_program *program)
     if (r)
         return r;
 
-    bf_list_foreach (&chain->rules, rule_node) {
-        r = _bf_program_generate_rule(program,
-                                      bf_list_node_get_data(rule_node));
-        if (r)
-            return r;
-    }
-
-    r = program->runtime.ops->gen_inline_epilogue(program);
+    // Profiling block 0 is the prologue
+    r = _bf_program_emit_profile(program, 0);
     if (r)
         return r;
 
-    // Call the update counters function
-    EMIT(program, BPF_MOV32_IMM(BPF_REG_1, bf_list_size(&chain->rules)));
-    EMIT(program,
-         BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_10, BF_PROG_CTX_OFF(pkt_size)));
-    EMIT_FIXUP_CALL(program, BF_FIXUP_FUNC_UPDATE_COUNTERS);
+    bf_list_foreach (&program->runtime.chains, chain_node) {
+        program->runtime.cur_chain = bf_list_node_get_data(chain_node);
+        program->runtime.cur_section = &program->sections[i++];
 
-    EMIT(program, BPF_MOV64_IMM(BPF_REG_0, program->runtime.ops->get_verdict(
-                                               chain->policy)));
-    EMIT(program, BPF_EXIT_INSN());
+        r = bf_program_fixup(program, BF_FIXUP_TYPE_JMP_NEXT_CHAIN);
+        if (r)
+            return bf_err_r(r, "failed to generate next chain fixups");
+
+        r = _bf_program_generate_chain(program);
+        if (r)
+            return r;
+    }
+
+    program->runtime.cur_chain = NULL;
+    program->runtime.cur_section = NULL;
 
     r = _bf_program_generate_functions(program);
     if (r)
         return r;
 
-    r = _bf_program_fixup(program, BF_FIXUP_TYPE_FUNC_CALL);
+    r = bf_program_fixup(program, BF_FIXUP_TYPE_FUNC_CALL);
     if (r)
         return bf_err_r(r, "failed to generate function call fixups");
 
+    r = bf_program_fixup(program, BF_FIXUP_TYPE_SUBCHAIN_CALL);
+    if (r)
+        return bf_err_r(r, "failed to generate sub-chain call fixups");
+
+    program->runtime.subchains_location = NULL;
+
     return 0;
 }
 
@@ -1056,6 +2421,8 @@ static void _bf_program_unpin(const struct bf_program *program,
 static int _bf_program_pin(const struct bf_program *program)
 {
     _cleanup_close_ int pindir_fd = -1;
+    _cleanup_bf_phase_timer_ struct bf_phase_timer _ =
+        bf_phase_timer_start(BF_PHASE_PIN);
     char dir[PATH_MAX];
     int r;
 
@@ -1092,12 +2459,36 @@ static int _bf_program_pin(const struct bf_program *program)
     if (r < 0)
         goto err_pmap_pin;
 
+    if (program->tmap) {
+        r = bf_map_pin(program->tmap, pindir_fd);
+        if (r < 0)
+            goto err_tmap_pin;
+    }
+
+    if (program->prmap) {
+        r = bf_map_pin(program->prmap, pindir_fd);
+        if (r < 0)
+            goto err_prmap_pin;
+    }
+
+    if (program->rmap) {
+        r = bf_map_pin(program->rmap, pindir_fd);
+        if (r < 0)
+            goto err_rmap_pin;
+    }
+
     bf_list_foreach (&program->sets, set_node) {
         r = bf_map_pin(bf_list_node_get_data(set_node), pindir_fd);
         if (r < 0)
             goto err_set_pin;
     }
 
+    bf_list_foreach (&program->tss, map_node) {
+        r = bf_map_pin(bf_list_node_get_data(map_node), pindir_fd);
+        if (r < 0)
+            goto err_tss_pin;
+    }
+
     bf_list_foreach (&program->links, link_node) {
         r = bf_link_pin(bf_list_node_get_data(link_node), pindir_fd);
         if (r < 0)
@@ -1109,9 +2500,21 @@ static int _bf_program_pin(const struct bf_program *program)
 err_link_pin:
     bf_list_foreach (&program->links, link_node)
         bf_link_unpin(bf_list_node_get_data(link_node), pindir_fd);
+err_tss_pin:
+    bf_list_foreach (&program->tss, map_node)
+        bf_map_unpin(bf_list_node_get_data(map_node), pindir_fd);
 err_set_pin:
     bf_list_foreach (&program->sets, set_node)
         bf_map_unpin(bf_list_node_get_data(set_node), pindir_fd);
+    if (program->rmap)
+        bf_map_unpin(program->rmap, pindir_fd);
+err_rmap_pin:
+    if (program->prmap)
+        bf_map_unpin(program->prmap, pindir_fd);
+err_prmap_pin:
+    if (program->tmap)
+        bf_map_unpin(program->tmap, pindir_fd);
+err_tmap_pin:
     bf_map_unpin(program->pmap, pindir_fd);
 err_pmap_pin:
     bf_map_unpin(program->cmap, pindir_fd);
@@ -1157,8 +2560,16 @@ static void _bf_program_unpin(const struct bf_program *program, const char *dir)
     unlinkat(pindir_fd, program->prog_name, 0);
     bf_map_unpin(program->pmap, pindir_fd);
     bf_map_unpin(program->cmap, pindir_fd);
+    if (program->tmap)
+        bf_map_unpin(program->tmap, pindir_fd);
+    if (program->prmap)
+        bf_map_unpin(program->prmap, pindir_fd);
+    if (program->rmap)
+        bf_map_unpin(program->rmap, pindir_fd);
     bf_list_foreach (&program->sets, set_node)
         bf_map_unpin(bf_list_node_get_data(set_node), pindir_fd);
+    bf_list_foreach (&program->tss, map_node)
+        bf_map_unpin(bf_list_node_get_data(map_node), pindir_fd);
     bf_list_foreach (&program->links, link_node)
         bf_link_unpin(bf_list_node_get_data(link_node), pindir_fd);
 
@@ -1179,50 +2590,113 @@ static int _bf_program_load_printer_map(struct bf_program *program)
 
     bf_assert(program);
 
-    r = bf_printer_assemble(program->printer, &pstr, &pstr_len);
-    if (r)
-        return bf_err_r(r, "failed to assemble printer map string");
-
-    r = bf_map_set_value_size(program->pmap, pstr_len);
-    if (r < 0)
-        return r;
+    r = bf_printer_assemble(program->printer, &pstr, &pstr_len);
+    if (r)
+        return bf_err_r(r, "failed to assemble printer map string");
+
+    r = bf_map_set_value_size(program->pmap, pstr_len);
+    if (r < 0)
+        return r;
+
+    r = bf_map_create(program->pmap, 0);
+    if (r < 0)
+        return r;
+
+    r = bf_map_set_elem(program->pmap, &key, pstr);
+    if (r)
+        return r;
+
+    r = bf_program_fixup(program, BF_FIXUP_TYPE_PRINTER_MAP_FD);
+    if (r) {
+        bf_map_destroy(program->pmap);
+        return bf_err_r(r, "failed to fixup printer map FD");
+    }
+
+    return 0;
+}
+
+static int _bf_program_load_counters_map(struct bf_program *program)
+{
+    _cleanup_close_ int _fd = -1;
+    int r;
+
+    bf_assert(program);
+
+    /* All the counters are stored in a single value, so the generated code can
+     * address them directly, see EMIT_UPDATE_COUNTERS(). */
+    r = bf_map_set_value_size(program->cmap, program->num_counters *
+                                                 sizeof(struct bf_counter));
+    if (r < 0)
+        return r;
+
+    r = bf_map_create(program->cmap, BPF_F_MMAPABLE);
+    if (r < 0)
+        return r;
+
+    r = _bf_program_map_counters(program);
+    if (r < 0) {
+        bf_map_destroy(program->cmap);
+        return r;
+    }
+
+    r = bf_program_fixup(program, BF_FIXUP_TYPE_COUNTERS_MAP_FD);
+    if (r < 0) {
+        _bf_program_unmap_counters(program);
+        bf_map_destroy(program->cmap);
+        return bf_err_r(r, "failed to fixup counters map FD");
+    }
+
+    return 0;
+}
+
+static int _bf_program_load_telemetry_map(struct bf_program *program)
+{
+    int r;
+
+    bf_assert(program);
+
+    if (!program->tmap)
+        return 0;
 
-    r = bf_map_create(program->pmap, 0);
+    r = bf_map_create(program->tmap, 0);
     if (r < 0)
         return r;
 
-    r = bf_map_set_elem(program->pmap, &key, pstr);
-    if (r)
-        return r;
-
-    r = _bf_program_fixup(program, BF_FIXUP_TYPE_PRINTER_MAP_FD);
-    if (r) {
-        bf_map_destroy(program->pmap);
-        return bf_err_r(r, "failed to fixup printer map FD");
+    r = bf_program_fixup(program, BF_FIXUP_TYPE_TELEMETRY_MAP_FD);
+    if (r < 0) {
+        bf_map_destroy(program->tmap);
+        return bf_err_r(r, "failed to fixup telemetry map FD");
     }
 
     return 0;
 }
 
-static int _bf_program_load_counters_map(struct bf_program *program)
+static int _bf_program_load_profile_map(struct bf_program *program)
 {
-    _cleanup_close_ int _fd = -1;
+    const struct bf_program_section *last;
     int r;
 
     bf_assert(program);
 
-    r = bf_map_set_n_elems(program->cmap, program->num_counters);
+    if (!program->prmap)
+        return 0;
+
+    last = &program->sections[program->n_sections - 1];
+    r = bf_map_set_n_elems(program->prmap,
+                           (size_t)(last->profile_offset +
+                                    last->n_profile_blocks) *
+                               BF_PROFILE_N_BUCKETS);
     if (r < 0)
         return r;
 
-    r = bf_map_create(program->cmap, 0);
+    r = bf_map_create(program->prmap, 0);
     if (r < 0)
         return r;
 
-    r = _bf_program_fixup(program, BF_FIXUP_TYPE_COUNTERS_MAP_FD);
+    r = bf_program_fixup(program, BF_FIXUP_TYPE_PROFILE_MAP_FD);
     if (r < 0) {
-        bf_map_destroy(program->cmap);
-        return bf_err_r(r, "failed to fixup counters map FD");
+        bf_map_destroy(program->prmap);
+        return bf_err_r(r, "failed to fixup profiling map FD");
     }
 
     return 0;
@@ -1230,13 +2704,27 @@ static int _bf_program_load_counters_map(struct bf_program *program)
 
 static int _bf_program_load_sets_maps(struct bf_program *new_prog)
 {
+    _clean_bf_list_ bf_list sets = bf_list_default(NULL, NULL);
+    _cleanup_bf_phase_timer_ struct bf_phase_timer _ =
+        bf_phase_timer_start(BF_PHASE_SETS);
     const bf_list_node *set_node;
     const bf_list_node *map_node;
     int r;
 
     bf_assert(new_prog);
 
-    set_node = bf_list_get_head(&new_prog->runtime.chain->sets);
+    // Sets maps are sorted by chain, then by index in the chain.
+    bf_list_foreach (&new_prog->runtime.chains, chain_node) {
+        const struct bf_chain *chain = bf_list_node_get_data(chain_node);
+
+        bf_list_foreach (&chain->sets, chain_set_node) {
+            r = bf_list_add_tail(&sets, bf_list_node_get_data(chain_set_node));
+            if (r)
+                return r;
+        }
+    }
+
+    set_node = bf_list_get_head(&sets);
     map_node = bf_list_get_head(&new_prog->sets);
 
     // Fill the bf_map with the sets content
@@ -1247,6 +2735,7 @@ static int _bf_program_load_sets_maps(struct bf_program *new_prog)
         struct bf_map *map = bf_list_node_get_data(map_node);
         size_t nelems = bf_list_size(&set->elems);
         union bpf_attr attr = {};
+        ssize_t value_buf_size;
         size_t idx = 0;
 
         r = bf_map_create(map, 0);
@@ -1255,7 +2744,17 @@ static int _bf_program_load_sets_maps(struct bf_program *new_prog)
             goto err_destroy_maps;
         }
 
-        values = malloc(nelems);
+        if (!nelems)
+            goto next_set;
+
+        value_buf_size = bf_map_value_buf_size(map);
+        if (value_buf_size < 0) {
+            r = (int)value_buf_size;
+            goto err_destroy_maps;
+        }
+
+        // Per-element counters start from 0
+        values = calloc(nelems, value_buf_size);
         if (!values) {
             r = bf_err_r(errno, "failed to allocate map values");
             goto err_destroy_maps;
@@ -1271,7 +2770,14 @@ static int _bf_program_load_sets_maps(struct bf_program *new_prog)
             void *elem = bf_list_node_get_data(elem_node);
 
             memcpy(keys + (idx * set->elem_size), elem, set->elem_size);
-            values[idx] = 1;
+            if (bf_set_is_dynamic(set)) {
+                uint64_t expiry = BF_PROG_SET_NO_EXPIRY;
+
+                memcpy(values + (idx * value_buf_size), &expiry,
+                       sizeof(expiry));
+            } else if (!set->counters) {
+                values[idx] = 1;
+            }
             ++idx;
         }
 
@@ -1287,11 +2793,12 @@ static int _bf_program_load_sets_maps(struct bf_program *new_prog)
             goto err_destroy_maps;
         }
 
+next_set:
         set_node = bf_list_node_next(set_node);
         map_node = bf_list_node_next(map_node);
     }
 
-    r = _bf_program_fixup(new_prog, BF_FIXUP_TYPE_SET_MAP_FD);
+    r = bf_program_fixup(new_prog, BF_FIXUP_TYPE_SET_MAP_FD);
     if (r < 0)
         goto err_destroy_maps;
 
@@ -1354,45 +2861,94 @@ static int _bf_program_get_new_link(struct bf_program *prog,
     return 0;
 }
 
-int bf_program_load(struct bf_program *new_prog, struct bf_program *old_prog)
+int bf_program_load_detached(struct bf_program *program)
 {
-    char dir[PATH_MAX];
-    char tmpdir[PATH_MAX];
     int r;
 
-    bf_assert(new_prog);
+    bf_assert(program);
 
-    r = _bf_program_load_sets_maps(new_prog);
+    r = _bf_program_load_sets_maps(program);
     if (r < 0)
         return r;
 
-    r = _bf_program_load_counters_map(new_prog);
+    r = _bf_program_load_counters_map(program);
+    if (r)
+        return r;
+
+    r = _bf_program_load_printer_map(program);
+    if (r)
+        return r;
+
+    r = _bf_program_load_telemetry_map(program);
+    if (r)
+        return r;
+
+    r = _bf_program_load_profile_map(program);
+    if (r)
+        return r;
+
+    r = bf_interp_load_rules_map(program);
     if (r)
         return r;
 
-    r = _bf_program_load_printer_map(new_prog);
+    r = bf_tss_load_maps(program);
     if (r)
         return r;
 
     if (bf_opts_is_verbose(BF_VERBOSE_BYTECODE))
-        bf_program_dump_bytecode(new_prog);
+        bf_program_dump_bytecode(program);
 
-    r = bf_bpf_prog_load(
-        new_prog->prog_name, bf_hook_to_bpf_prog_type(new_prog->hook),
-        new_prog->img, new_prog->img_size,
-        bf_hook_to_attach_type(new_prog->hook), &new_prog->runtime.prog_fd);
+    {
+        _cleanup_bf_phase_timer_ struct bf_phase_timer _ =
+            bf_phase_timer_start(BF_PHASE_LOAD);
+
+        r = bf_bpf_prog_load(program->prog_name,
+                             bf_hook_to_bpf_prog_type(program->hook),
+                             program->img, program->img_size,
+                             bf_hook_to_attach_type(program->hook),
+                             &program->runtime.prog_fd);
+    }
     if (r)
         return bf_err_r(r, "failed to load new bf_program");
 
+    return 0;
+}
+
+int bf_program_load(struct bf_program *new_prog, struct bf_program *old_prog)
+{
+    int r;
+
+    bf_assert(new_prog);
+
+    r = bf_program_load_detached(new_prog);
+    if (r)
+        return r;
+
+    return bf_program_attach(new_prog, old_prog);
+}
+
+int bf_program_attach(struct bf_program *new_prog, struct bf_program *old_prog)
+{
+    char dir[PATH_MAX];
+    char tmpdir[PATH_MAX];
+    int r;
+
+    bf_assert(new_prog);
+
+    /* The ID of a program generated from multiple chains depends on its
+     * first chain, so the old program might have a different ID. */
     if (old_prog) {
-        (void)snprintf(dir, PATH_MAX, "%s/%s", BF_PIN_DIR, new_prog->id);
-        (void)snprintf(tmpdir, PATH_MAX, "%s/%s_tmp", BF_PIN_DIR, new_prog->id);
+        (void)snprintf(dir, PATH_MAX, "%s/%s", BF_PIN_DIR, old_prog->id);
+        (void)snprintf(tmpdir, PATH_MAX, "%s/%s_tmp", BF_PIN_DIR, old_prog->id);
     }
 
     if (old_prog && !bf_opts_transient() && (r = rename(dir, tmpdir)))
         return bf_err_r(r, "failed to rename old bf_program pin directory");
 
     if (new_prog->runtime.chain->hook_opts.attach) {
+        _cleanup_bf_phase_timer_ struct bf_phase_timer _ =
+            bf_phase_timer_start(BF_PHASE_ATTACH);
+
         r = new_prog->runtime.ops->attach_prog(new_prog, old_prog,
                                                _bf_program_get_new_link);
         if (r) {
@@ -1440,12 +2996,22 @@ int bf_program_unload(struct bf_program *program)
 
     closep(&program->runtime.prog_fd);
 
+    _bf_program_unmap_counters(program);
     bf_map_destroy(program->cmap);
     bf_map_destroy(program->pmap);
+    if (program->tmap)
+        bf_map_destroy(program->tmap);
+    if (program->prmap)
+        bf_map_destroy(program->prmap);
+    if (program->rmap)
+        bf_map_destroy(program->rmap);
 
     bf_list_foreach (&program->sets, map_node)
         bf_map_destroy(bf_list_node_get_data(map_node));
 
+    bf_list_foreach (&program->tss, map_node)
+        bf_map_destroy(bf_list_node_get_data(map_node));
+
     bf_list_foreach (&program->links, link_node)
         bf_link_detach(bf_list_node_get_data(link_node));
 
@@ -1455,17 +3021,170 @@ int bf_program_unload(struct bf_program *program)
     return 0;
 }
 
+int bf_program_test_run(const struct bf_program *program, const void *pkt,
+                        size_t pkt_len, uint32_t repeat,
+                        struct bf_sim_result *result)
+{
+    /* Context of BPF_PROG_TYPE_NETFILTER programs, see
+     * bpf_prog_test_run_nf(): only the hook and protocol family are used,
+     * the other fields must be 0. */
+    struct
+    {
+        uint8_t hook;
+        uint8_t pf;
+        void *in;
+        void *out;
+        void *sk;
+        void *net;
+        void *okfn;
+    } nf_ctx = {};
+    const void *ctx = NULL;
+    size_t ctx_len = 0;
+    uint32_t duration;
+    uint16_t ethertype;
+    uint32_t retval;
+    int r;
+
+    bf_assert(program && pkt && result);
+
+    result->verdict = _BF_VERDICT_MAX;
+
+    if (bf_hook_is_sock_addr(program->hook)) {
+        result->error = -ENOTSUP;
+        return 0;
+    }
+
+    if (pkt_len < ETH_HLEN) {
+        result->error = -EINVAL;
+        return 0;
+    }
+
+    if (bf_hook_is_nf(program->hook)) {
+        memcpy(&ethertype,
+               (const uint8_t *)pkt + offsetof(struct ethhdr, h_proto),
+               sizeof(ethertype));
+        if (ethertype == htobe16(ETH_P_IP)) {
+            nf_ctx.pf = NFPROTO_IPV4;
+        } else if (ethertype == htobe16(ETH_P_IPV6)) {
+            nf_ctx.pf = NFPROTO_IPV6;
+        } else {
+            // Netfilter programs only process IPv4 and IPv6 packets
+            result->error = -EPROTONOSUPPORT;
+            return 0;
+        }
+
+        nf_ctx.hook = bf_hook_to_nf_hook(program->hook);
+        ctx = &nf_ctx;
+        ctx_len = sizeof(nf_ctx);
+
+        /* bpf_prog_test_run_nf() doesn't reset the network header for
+         * NF_INET_LOCAL_OUT: the packet must start with the network header. */
+        if (nf_ctx.hook == NF_INET_LOCAL_OUT) {
+            pkt = (const uint8_t *)pkt + ETH_HLEN;
+            pkt_len -= ETH_HLEN;
+            if (!pkt_len) {
+                result->error = -EINVAL;
+                return 0;
+            }
+        }
+    }
+
+    r = bf_bpf_prog_test_run(program->runtime.prog_fd, pkt, pkt_len, ctx,
+                             ctx_len, repeat, &retval, &duration);
+    if (r == -EBADF || r == -EFAULT)
+        return bf_err_r(r, "failed to run the program");
+
+    result->error = r;
+    if (r)
+        return 0;
+
+    result->retval = retval;
+    result->duration = duration;
+
+    if ((int)retval == program->runtime.ops->get_verdict(BF_VERDICT_ACCEPT))
+        result->verdict = BF_VERDICT_ACCEPT;
+    else if ((int)retval ==
+             program->runtime.ops->get_verdict(BF_VERDICT_DROP))
+        result->verdict = BF_VERDICT_DROP;
+
+    return 0;
+}
+
 int bf_program_get_counter(const struct bf_program *program,
                            uint32_t counter_idx, struct bf_counter *counter)
 {
     bf_assert(program);
     bf_assert(counter);
 
-    int r;
+    return bf_program_get_counters(program, counter_idx, 1, counter);
+}
 
-    r = bf_bpf_map_lookup_elem(program->cmap->fd, &counter_idx, counter);
-    if (r < 0)
-        return bf_err_r(errno, "failed to lookup counters map");
+int bf_program_get_counters(const struct bf_program *program, uint32_t offset,
+                            uint32_t n_counters, struct bf_counter *counters)
+{
+    bf_assert(program && counters);
+
+    if (!n_counters)
+        return 0;
+
+    if ((size_t)offset + n_counters > program->num_counters) {
+        return bf_err_r(-ENOENT, "counters %u to %u are out of bounds", offset,
+                        offset + n_counters - 1);
+    }
+
+    if (!program->counters)
+        return bf_err_r(-ENOENT, "counters map is not loaded");
+
+    memcpy(counters, &program->counters[offset],
+           n_counters * sizeof(*counters));
+
+    return 0;
+}
+
+int bf_program_set_counter(struct bf_program *program, uint32_t counter_idx,
+                           struct bf_counter *counter)
+{
+    uint64_t *value;
+
+    bf_assert(program && counter);
+
+    if (counter_idx >= program->num_counters)
+        return bf_err_r(-ENOENT, "counter %u is out of bounds", counter_idx);
+
+    if (!program->counters)
+        return bf_err_r(-ENOENT, "counters map is not loaded");
+
+    /* The program updates the counters with atomic operations, the fields
+     * are stored atomically so they are never torn. Packets counted by the
+     * program between the two stores are overwritten: use
+     * bf_program_add_counter() if they must be kept. The mapping is
+     * page-aligned, so the fields of the packed bf_counter are naturally
+     * aligned. */
+    value = (void *)&program->counters[counter_idx];
+    __atomic_store_n(&value[0], counter->packets, __ATOMIC_RELAXED);
+    __atomic_store_n(&value[1], counter->bytes, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+int bf_program_add_counter(struct bf_program *program, uint32_t counter_idx,
+                           const struct bf_counter *delta)
+{
+    uint64_t *value;
+
+    bf_assert(program && delta);
+
+    if (counter_idx >= program->num_counters)
+        return bf_err_r(-ENOENT, "counter %u is out of bounds", counter_idx);
+
+    if (!program->counters)
+        return bf_err_r(-ENOENT, "counters map is not loaded");
+
+    /* The program updates the counters with atomic operations: do the same,
+     * so concurrent updates are not lost. */
+    value = (void *)&program->counters[counter_idx];
+    __atomic_fetch_add(&value[0], delta->packets, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&value[1], delta->bytes, __ATOMIC_RELAXED);
 
     return 0;
 }
@@ -1478,3 +3197,280 @@ int bf_cgen_set_counters(struct bf_program *program,
 
     return -ENOTSUP;
 }
+
+int bf_program_get_telemetry(const struct bf_program *program,
+                             struct bf_counter *counters)
+{
+    _cleanup_free_ struct bf_counter *values = NULL;
+    ssize_t value_buf_size;
+    size_t n_cpus;
+    int r;
+
+    bf_assert(program && counters);
+
+    if (!program->tmap)
+        return -ENOENT;
+
+    value_buf_size = bf_map_value_buf_size(program->tmap);
+    if (value_buf_size < 0)
+        return (int)value_buf_size;
+
+    // struct bf_counter is 16 bytes, so per-CPU values are not padded.
+    n_cpus = value_buf_size / sizeof(*values);
+
+    values = malloc(value_buf_size);
+    if (!values)
+        return -ENOMEM;
+
+    for (uint32_t i = 0; i < _BF_TELEMETRY_MAX; ++i) {
+        r = bf_bpf_map_lookup_elem(program->tmap->fd, &i, values);
+        if (r < 0)
+            return bf_err_r(r, "failed to lookup telemetry map");
+
+        counters[i] = (struct bf_counter) {};
+        for (size_t cpu = 0; cpu < n_cpus; ++cpu) {
+            counters[i].packets += values[cpu].packets;
+            counters[i].bytes += values[cpu].bytes;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Add the estimated memory usage of a map to a program's statistics.
+ *
+ * @param map Map to add the memory usage of. If NULL, nothing is done.
+ * @param stats Statistics to update. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_program_add_map_size(const struct bf_map *map,
+                                    struct bf_prog_stats *stats)
+{
+    ssize_t size;
+
+    bf_assert(stats);
+
+    if (!map)
+        return 0;
+
+    size = bf_map_mem_size(map);
+    if (size < 0)
+        return (int)size;
+
+    stats->maps_size += size;
+
+    return 0;
+}
+
+int bf_program_get_stats(const struct bf_program *program,
+                         struct bf_prog_stats *stats)
+{
+    struct bpf_prog_info info = {};
+    int r;
+
+    bf_assert(program && stats);
+
+    if (program->runtime.prog_fd < 0)
+        return -ENOENT;
+
+    r = bf_bpf_obj_get_info(program->runtime.prog_fd, &info, sizeof(info));
+    if (r < 0)
+        return bf_err_r(r, "failed to get info for program %s",
+                        program->prog_name);
+
+    *stats = (struct bf_prog_stats) {
+        .id = info.id,
+        .n_insns = info.xlated_prog_len / sizeof(struct bpf_insn),
+        .jited_size = info.jited_prog_len,
+        .verified_insns = info.verified_insns,
+        .run_cnt = info.run_cnt,
+        .run_time_ns = info.run_time_ns,
+    };
+
+    r = _bf_program_add_map_size(program->cmap, stats);
+    if (r)
+        return r;
+
+    r = _bf_program_add_map_size(program->pmap, stats);
+    if (r)
+        return r;
+
+    r = _bf_program_add_map_size(program->tmap, stats);
+    if (r)
+        return r;
+
+    r = _bf_program_add_map_size(program->prmap, stats);
+    if (r)
+        return r;
+
+    r = _bf_program_add_map_size(program->rmap, stats);
+    if (r)
+        return r;
+
+    bf_list_foreach (&program->sets, map_node) {
+        r = _bf_program_add_map_size(bf_list_node_get_data(map_node), stats);
+        if (r)
+            return r;
+    }
+
+    bf_list_foreach (&program->tss, map_node) {
+        r = _bf_program_add_map_size(bf_list_node_get_data(map_node), stats);
+        if (r)
+            return r;
+    }
+
+    return 0;
+}
+
+int bf_program_estimate_costs(const struct bf_program *program,
+                              struct bf_check_cost *costs)
+{
+    static const struct
+    {
+        uint16_t l3_proto;
+        uint8_t l4_proto;
+    } protos[] = {
+        [BF_CHECK_CLASS_IPV4_TCP] = {ETH_P_IP, IPPROTO_TCP},
+        [BF_CHECK_CLASS_IPV4_UDP] = {ETH_P_IP, IPPROTO_UDP},
+        [BF_CHECK_CLASS_IPV4_ICMP] = {ETH_P_IP, IPPROTO_ICMP},
+        [BF_CHECK_CLASS_IPV6_TCP] = {ETH_P_IPV6, IPPROTO_TCP},
+        [BF_CHECK_CLASS_IPV6_UDP] = {ETH_P_IPV6, IPPROTO_UDP},
+        [BF_CHECK_CLASS_IPV6_ICMPV6] = {ETH_P_IPV6, IPPROTO_ICMPV6},
+        // Unsupported protocols are identified by 0
+        [BF_CHECK_CLASS_OTHER] = {0, 0},
+    };
+    _cleanup_bf_ir_ struct bf_ir *ir = NULL;
+    uint64_t best;
+    uint64_t worst;
+    int r;
+
+    static_assert(ARRAY_SIZE(protos) == _BF_CHECK_CLASS_MAX,
+                  "missing entries in the check class protocols array");
+
+    bf_assert(program && costs);
+
+    r = bf_ir_new(&ir, program->img, program->img_size);
+    if (r)
+        return bf_err_r(r, "failed to create IR to estimate program cost");
+
+    for (size_t i = 0; i < _BF_CHECK_CLASS_MAX; ++i) {
+        r = bf_ir_path_cost(ir, htobe16(protos[i].l3_proto),
+                            protos[i].l4_proto, &best, &worst);
+        if (r == -ENOTSUP) {
+            best = BF_CHECK_COST_UNKNOWN;
+            worst = BF_CHECK_COST_UNKNOWN;
+        } else if (r) {
+            return bf_err_r(r, "failed to estimate cost for %s packets",
+                            bf_check_class_to_str(i));
+        }
+
+        costs[i] = (struct bf_check_cost) {.best = best, .worst = worst};
+    }
+
+    return 0;
+}
+
+int bf_program_get_profile(const struct bf_program *program, uint32_t block,
+                           uint32_t n_blocks, uint64_t *hist)
+{
+    _cleanup_free_ uint32_t *keys = NULL;
+    _cleanup_free_ uint64_t *values = NULL;
+    uint32_t n_buckets = n_blocks * BF_PROFILE_N_BUCKETS;
+    uint32_t first = block * BF_PROFILE_N_BUCKETS;
+    uint32_t in_batch = first - 1;
+    uint32_t out_batch;
+    uint32_t count = 0;
+    ssize_t value_buf_size;
+    size_t n_cpus;
+    int r;
+
+    bf_assert(program && hist);
+
+    if (!program->prmap)
+        return -ENOENT;
+
+    if (!n_buckets)
+        return 0;
+
+    value_buf_size = bf_map_value_buf_size(program->prmap);
+    if (value_buf_size < 0)
+        return (int)value_buf_size;
+
+    n_cpus = value_buf_size / sizeof(*values);
+
+    keys = malloc(n_buckets * sizeof(*keys));
+    values = malloc(n_buckets * value_buf_size);
+    if (!keys || !values)
+        return -ENOMEM;
+
+    /* The batch lookup starts after the key in @c in_batch , the buckets of
+     * the first block are read from the beginning of the map. The kernel
+     * returns -ENOENT once the end of the map has been reached. */
+    while (count < n_buckets) {
+        uint32_t n = n_buckets - count;
+
+        r = bf_bpf_map_lookup_batch(
+            program->prmap->fd, first || count ? &in_batch : NULL, &out_batch,
+            keys + count, (uint8_t *)values + count * value_buf_size, &n);
+        if (r < 0 && r != -ENOENT)
+            return bf_err_r(r, "failed to lookup profiling map");
+
+        count += n;
+        in_batch = out_batch;
+
+        if (r == -ENOENT || !n)
+            break;
+    }
+
+    if (count != n_buckets)
+        return bf_err_r(-ENOENT, "profiling map has less than %u buckets",
+                        first + n_buckets);
+
+    for (uint32_t i = 0; i < n_buckets; ++i) {
+        const uint64_t *value =
+            (void *)((uint8_t *)values + i * value_buf_size);
+
+        hist[i] = 0;
+        for (size_t cpu = 0; cpu < n_cpus; ++cpu)
+            hist[i] += value[cpu];
+    }
+
+    return 0;
+}
+
+int bf_program_copy_telemetry(struct bf_program *new_prog,
+                              const struct bf_program *old_prog)
+{
+    _cleanup_free_ struct bf_counter *values = NULL;
+    struct bf_counter counters[_BF_TELEMETRY_MAX];
+    ssize_t value_buf_size;
+    int r;
+
+    bf_assert(new_prog && old_prog);
+
+    if (!new_prog->tmap || !old_prog->tmap)
+        return 0;
+
+    r = bf_program_get_telemetry(old_prog, counters);
+    if (r)
+        return r;
+
+    value_buf_size = bf_map_value_buf_size(new_prog->tmap);
+    if (value_buf_size < 0)
+        return (int)value_buf_size;
+
+    values = calloc(1, value_buf_size);
+    if (!values)
+        return -ENOMEM;
+
+    // Store the sum of the per-CPU values into the first CPU's slot.
+    for (uint32_t i = 0; i < _BF_TELEMETRY_MAX; ++i) {
+        values[0] = counters[i];
+        r = bf_map_set_elem(new_prog->tmap, &i, values);
+        if (r)
+            return bf_err_r(r, "failed to update telemetry map");
+    }
+
+    return 0;
+}
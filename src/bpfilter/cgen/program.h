@@ -32,6 +32,14 @@
 #define PIN_PATH_LEN 64
 #define BF_PROG_ID_LEN (BPF_OBJ_NAME_LEN - 4)
 
+/** Value of a dynamic set element that never expires. Dynamic sets map each
+ * element to the @c bpf_ktime_get_ns() timestamp after which it expires. */
+#define BF_PROG_SET_NO_EXPIRY UINT64_MAX
+
+/** Value of @c bf_program.runtime.cur_profile_block when no profiling block
+ * is open. */
+#define BF_PROGRAM_NO_PROFILE_BLOCK UINT32_MAX
+
 /**
  * @file program.h
  *
@@ -57,13 +65,21 @@
  * - @c r6 : address of the header currently filtered on
  * - @c r7 : L3 protocol ID
  * - @c r8 : L4 protocol ID
- * - @c r9 : unused
+ * - @c r9 : address of the program's runtime context (see
+ *   @ref bf_program_context ), which is the frame pointer of the main function
  * - @c r10 : frame pointer
  *
  * This convention is followed throughout the project and must be followed all
  * the time to prevent incompatibilities. Debugging this kind of issues is not
  * fun, so stick to it.
  *
+ * Sub-chains (see @ref bf_subchain ) are generated as BPF functions, which have
+ * their own frame pointer in @c r10 . Hence, the runtime context must be
+ * accessed through @c r9 when generating the rules. Sub-chain functions are
+ * called with the runtime context address in @c r1 , and the L3 and L4
+ * protocol IDs in @c r2 and @c r3 , and restore @c r7 to @c r9 from those
+ * arguments.
+ *
  * @warning L3 and L4 protocol IDs **must** be stored in registers, no on the
  * stack, as older verifier aren't able to keep track of scalar values located
  * on the stack. This means the verification will fail because the verifier
@@ -110,7 +126,8 @@
  */
 
 /** Convenience macro to get the offset of a field in @ref
- * bf_program_context based on the frame pointer in @c BPF_REG_10 .
+ * bf_program_context based on the frame pointer of the main function (in
+ * @c BPF_REG_10 for the main function, and @c BPF_REG_9 for every function).
  */
 #define BF_PROG_CTX_OFF(field)                                                 \
     (-(int)sizeof(struct bf_program_context) +                                 \
@@ -158,16 +175,36 @@
             return __r;                                                        \
     })
 
-#define EMIT_LOAD_COUNTERS_FD_FIXUP(program, reg)                              \
+/**
+ * Emit the bytecode to update the counters at a constant index.
+ *
+ * The counters map has a single value containing every counter of the
+ * program, so the address of the counters is loaded directly (as a
+ * @c BPF_PSEUDO_MAP_VALUE ) and updated with atomic additions, without
+ * calling any function or helper. The packet size must be in @c r2 , @c r1
+ * and @c r3 are clobbered.
+ *
+ * @param program Program to emit the bytecode into. Can't be NULL.
+ * @param index Index of the counters to update.
+ */
+#define EMIT_UPDATE_COUNTERS(program, index)                                   \
     ({                                                                         \
-        const struct bpf_insn ld_insn[2] = {BPF_LD_MAP_FD(reg, 0)};            \
-        int __r = bf_program_emit_fixup(                                       \
-            (program), BF_FIXUP_TYPE_COUNTERS_MAP_FD, ld_insn[0], NULL);       \
-        if (__r < 0)                                                           \
-            return __r;                                                        \
-        __r = bf_program_emit((program), ld_insn[1]);                          \
+        struct bpf_insn __ld_insn[2] = {BPF_LD_MAP_FD(BPF_REG_1, 0)};          \
+        int __r;                                                               \
+        __ld_insn[0].src_reg = BPF_PSEUDO_MAP_VALUE;                           \
+        __ld_insn[1].imm = (int)((index) * sizeof(struct bf_counter));         \
+        __r = bf_program_emit_fixup((program), BF_FIXUP_TYPE_COUNTERS_MAP_FD,  \
+                                    __ld_insn[0], NULL);                       \
         if (__r < 0)                                                           \
             return __r;                                                        \
+        EMIT((program), __ld_insn[1]);                                         \
+        EMIT((program), BPF_MOV64_IMM(BPF_REG_3, 1));                          \
+        EMIT((program),                                                        \
+             BPF_ATOMIC_OP(BPF_DW, BPF_ADD, BPF_REG_1, BPF_REG_3,              \
+                           offsetof(struct bf_counter, packets)));             \
+        EMIT((program),                                                        \
+             BPF_ATOMIC_OP(BPF_DW, BPF_ADD, BPF_REG_1, BPF_REG_2,              \
+                           offsetof(struct bf_counter, bytes)));               \
     })
 
 /**
@@ -179,11 +216,14 @@
  *
  * @param program Program to generate the bytecode for. Can't be NULL.
  * @param reg Register to store the set file descriptor in.
- * @param index Index of the set in the program.
+ * @param index Index of the set in the chain being generated.
  */
 #define EMIT_LOAD_SET_FD_FIXUP(program, reg, index)                            \
     ({                                                                         \
-        union bf_fixup_attr __attr = {.set_index = (index)};                   \
+        union bf_fixup_attr __attr = {                                         \
+            .set_index =                                                       \
+                (program)->runtime.cur_section->sets_offset + (index),         \
+        };                                                                     \
         const struct bpf_insn ld_insn[2] = {BPF_LD_MAP_FD(reg, 0)};            \
         int __r = bf_program_emit_fixup((program), BF_FIXUP_TYPE_SET_MAP_FD,   \
                                         ld_insn[0], &__attr);                  \
@@ -197,7 +237,11 @@
 struct bf_chain;
 struct bf_map;
 struct bf_marsh;
+struct bf_check_cost;
 struct bf_counter;
+struct bf_prog_stats;
+struct bf_sim_result;
+struct bf_subchain;
 
 /**
  * BPF program runtime context.
@@ -247,6 +291,16 @@ struct bf_program_context
      * output interface. */
     uint32_t ifindex;
 
+    /** Connection tracking state of the packet, as a bitmask of
+     * @ref bf_matcher_ct_state . Set to 0 until the connection is looked up,
+     * which is done at most once per packet. */
+    uint32_t ct_state;
+
+    /** If profiling is enabled (see @c --profile ) and the packet is
+     * sampled, @c bpf_ktime_get_ns() value at the last profiling block
+     * boundary. 0 if the packet is not sampled. */
+    uint64_t profile_ts;
+
     /** Pointer to the L2 protocol header. */
     void *l2_hdr;
 
@@ -284,6 +338,43 @@ struct bf_program_context
 static_assert(sizeof(struct bf_program_context) % 8 == 0,
               "struct bf_program_context must be 8-bytes aligned");
 
+/**
+ * Location of a chain's data in a program.
+ *
+ * A program can be generated from multiple chains (see
+ * @ref bf_program_add_chain ), each chain has its own counters and sets in
+ * the program's maps.
+ */
+struct bf_program_section
+{
+    /// Index of the chain's first counter in the counters map.
+    uint32_t counters_offset;
+    /// Number of counters used by the chain: one per rule, and the policy.
+    uint32_t n_counters;
+    /// Index of the chain's first set in @ref bf_program.sets .
+    uint32_t sets_offset;
+    /// Number of sets of the chain.
+    uint32_t n_sets;
+    /// Index of the chain's first sub-chain, amongst all the program's
+    /// sub-chains.
+    uint32_t subchains_offset;
+    /// Number of sub-chains of the chain.
+    uint32_t n_subchains;
+    /// Index of the chain's first profiling block in the profiling map.
+    /// Block 0 is reserved for the program's prologue.
+    uint32_t profile_offset;
+    /// Number of profiling blocks of the chain, 0 if profiling is disabled.
+    uint32_t n_profile_blocks;
+    /// Number of rules per profiling block.
+    uint32_t profile_block;
+    /// Index of the chain's first record in the rules map, if the chain is
+    /// interpreted.
+    uint32_t rules_offset;
+    /// Number of records reserved for the chain in the rules map, 0 if the
+    /// chain is compiled.
+    uint32_t n_rules;
+};
+
 struct bf_program
 {
     char id[BF_PROG_ID_LEN];
@@ -297,10 +388,22 @@ struct bf_program
 
     /// Counters map
     struct bf_map *cmap;
+    /** Value of the counters map, mapped into the daemon's memory when the
+     * map is created or restored. NULL if the map hasn't been created yet. */
+    struct bf_counter *counters;
     /// Printer map
     struct bf_map *pmap;
+    /// Telemetry map, NULL if the daemon runs without @c --telemetry .
+    struct bf_map *tmap;
+    /// Profiling histograms map, NULL if the daemon runs without
+    /// @c --profile .
+    struct bf_map *prmap;
+    /// Rules map, NULL if none of the program's chains is interpreted.
+    struct bf_map *rmap;
     /// List of set maps
     bf_list sets;
+    /// List of classifier tuple maps, see @c bpfilter/cgen/tss.h .
+    bf_list tss;
 
     /// Link objects attaching the program to a hook.
     bf_list links;
@@ -310,6 +413,11 @@ struct bf_program
      * codegen. */
     size_t num_counters;
 
+    /** Location of each chain's data in the program, in the order the chains
+     * are evaluated. */
+    struct bf_program_section *sections;
+    size_t n_sections;
+
     /* Bytecode */
     uint32_t functions_location[_BF_FIXUP_FUNC_MAX];
     struct bpf_insn *img;
@@ -326,9 +434,46 @@ struct bf_program
         /** Hook-specific ops to use to generate the program. */
         const struct bf_flavor_ops *ops;
 
-        /** Chain the program is generated from. This is a non-owning pointer:
-         * the @ref bf_program doesn't have to manage its lifetime. */
+        /** First chain the program is generated from, its hook options are
+         * used for the whole program. This is a non-owning pointer: the
+         * @ref bf_program doesn't have to manage its lifetime. */
         const struct bf_chain *chain;
+
+        /** Chains the program is generated from, in the order they are
+         * evaluated. The list doesn't own the chains. Only @c chain is
+         * available if the program has been restored from serialized data. */
+        bf_list chains;
+
+        /** Chain currently generated, and its location in the program. Only
+         * valid during @ref bf_program_generate . */
+        const struct bf_chain *cur_chain;
+        const struct bf_program_section *cur_section;
+
+        /** Sub-chain currently generated, or NULL if the chain's rules are
+         * generated. Only valid during @ref bf_program_generate . */
+        const struct bf_subchain *cur_subchain;
+
+        /** Index of the counter of the first rule currently generated. Only
+         * valid during @ref bf_program_generate . */
+        uint32_t cur_counters_offset;
+
+        /** Profiling block currently generated, closed by the rules applying
+         * a terminal verdict. Set to @ref BF_PROGRAM_NO_PROFILE_BLOCK if
+         * profiling is disabled, or outside of a chain's rules. Only valid
+         * during @ref bf_program_generate . */
+        uint32_t cur_profile_block;
+
+        /** Location of each sub-chain function in the program, indexed by
+         * @ref bf_program_section::subchains_offset and the sub-chain's index.
+         * Set to 0 if the sub-chain function hasn't been generated. Only
+         * valid during @ref bf_program_generate . */
+        uint32_t *subchains_location;
+
+        /** Rules of each classifier tuple, in the same order as
+         * @ref bf_program.tss , used to fill the tuples' maps when the
+         * program is loaded. Empty if the program has been restored from
+         * serialized data. */
+        bf_list tuples;
     } runtime;
 };
 
@@ -337,6 +482,27 @@ struct bf_program
 int bf_program_new(struct bf_program **program, enum bf_hook hook,
                    enum bf_front front, const struct bf_chain *chain);
 void bf_program_free(struct bf_program **program);
+
+/**
+ * Add a chain to a program.
+ *
+ * A program is created for a single chain (see @ref bf_program_new ), but
+ * more chains can be added to it before it is generated. The chains are
+ * evaluated in the order they have been added: if a chain accepts a packet
+ * (because of a rule or its policy), the packet is evaluated by the next
+ * chain. Only the last chain can accept a packet, while every chain can drop
+ * it.
+ *
+ * The chains share the program's prologue and error counter, but each chain
+ * has its own counters and sets (see @ref bf_program_section ).
+ *
+ * @param program Program to add the chain to. Can't be NULL.
+ * @param chain Chain to add to the program. The program doesn't take
+ *        ownership of the chain. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_program_add_chain(struct bf_program *program,
+                         const struct bf_chain *chain);
 int bf_program_marsh(const struct bf_program *program, struct bf_marsh **marsh);
 int bf_program_unmarsh(const struct bf_marsh *marsh,
                        struct bf_program **program,
@@ -351,6 +517,38 @@ int bf_program_emit_fixup(struct bf_program *program, enum bf_fixup_type type,
                           const union bf_fixup_attr *attr);
 int bf_program_emit_fixup_call(struct bf_program *program,
                                enum bf_fixup_func function);
+
+/**
+ * Resolve the fixups of a given type.
+ *
+ * The fixups are resolved using the program's current state (maps file
+ * descriptors, functions location...), and removed from the program.
+ *
+ * @param program Program to resolve the fixups of. Can't be NULL.
+ * @param type Type of the fixups to resolve.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_program_fixup(struct bf_program *program, enum bf_fixup_type type);
+
+/**
+ * Generate the bytecode to apply a terminal verdict.
+ *
+ * If the program is generated from multiple chains, a packet accepted by a
+ * chain is evaluated by the next chain: only the last chain of the program
+ * can return @c BF_VERDICT_ACCEPT . Dropped packets are dropped immediately.
+ *
+ * Sub-chain functions return the verdict to their caller as a
+ * @ref bf_verdict value, the caller is responsible for applying it.
+ *
+ * If a profiling block is open, it is closed before the verdict is applied,
+ * so packets terminated by a rule are sampled as well.
+ *
+ * @param program Program to generate the bytecode for. Can't be NULL.
+ * @param verdict Terminal verdict to apply.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_program_generate_verdict(struct bf_program *program,
+                                enum bf_verdict verdict);
 int bf_program_generate(struct bf_program *program);
 
 /**
@@ -366,9 +564,174 @@ int bf_program_generate(struct bf_program *program);
  */
 int bf_program_load(struct bf_program *new_prog, struct bf_program *old_prog);
 
+/**
+ * Attach a program loaded with @ref bf_program_load_detached to the kernel.
+ *
+ * The program is attached and pinned. If a similar program already exists,
+ * @p old_prog should be a pointer to it, and will be replaced.
+ *
+ * @param new_prog Loaded program to attach. Can't be NULL.
+ * @param old_prog Existing program to replace. Can be NULL.
+ * @return 0 on success, or negative errno value on failure.
+ */
+int bf_program_attach(struct bf_program *new_prog, struct bf_program *old_prog);
+
+/**
+ * Load the program to the kernel, without attaching nor pinning it.
+ *
+ * The program's maps are created and the program is loaded, so it can be
+ * run with @c BPF_PROG_TEST_RUN (see @ref bf_program_test_run ). The program
+ * and its maps are removed from the kernel when the program is freed.
+ *
+ * @param program Program to load. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_program_load_detached(struct bf_program *program);
+
 int bf_program_unload(struct bf_program *program);
 
+/**
+ * Run a packet through a loaded program, using @c BPF_PROG_TEST_RUN .
+ *
+ * The context is defined according to the program's flavor: Netfilter
+ * programs are given the hook of the program, and the protocol family of the
+ * packet. Failing to run the program for this specific packet (e.g. because
+ * it is too large, or not supported by the program's flavor) is not an
+ * error: the error is reported in @p result .
+ *
+ * @param program Program to run, must be loaded. Can't be NULL.
+ * @param pkt Packet to run the program with, starting with the Ethernet
+ *        header. Can't be NULL.
+ * @param pkt_len Size of @p pkt , in bytes.
+ * @param repeat Number of times to run the program. Can't be 0.
+ * @param result Result of the test run. Can't be NULL.
+ * @return 0 on success, or a negative errno value if the program can't be
+ *         run at all.
+ */
+int bf_program_test_run(const struct bf_program *program, const void *pkt,
+                        size_t pkt_len, uint32_t repeat,
+                        struct bf_sim_result *result);
+
 int bf_program_get_counter(const struct bf_program *program,
                            uint32_t counter_idx, struct bf_counter *counter);
+
+/**
+ * Get a range of counters from a program's counters map.
+ *
+ * The counters are copied from the counters map's value, mapped into memory,
+ * instead of one system call per counter.
+ *
+ * @param program Program to get the counters from. Can't be NULL.
+ * @param offset Index of the first counter to get.
+ * @param n_counters Number of counters to get.
+ * @param counters Array of @p n_counters counters to fill. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_program_get_counters(const struct bf_program *program, uint32_t offset,
+                            uint32_t n_counters, struct bf_counter *counters);
+
+/**
+ * Set the value of a counter in a program's counters map.
+ *
+ * The fields of the counter are stored atomically, but the packets counted
+ * by the program concurrently are overwritten: use
+ * @ref bf_program_add_counter to keep them.
+ *
+ * @param program Program to set the counter for. Can't be NULL.
+ * @param counter_idx Index of the counter to set.
+ * @param counter Value to set the counter to. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_program_set_counter(struct bf_program *program, uint32_t counter_idx,
+                           struct bf_counter *counter);
+
+/**
+ * Atomically add a value to a counter in a program's counters map.
+ *
+ * Contrary to @ref bf_program_set_counter , the packets counted by the
+ * program while the counter is updated are not lost.
+ *
+ * @param program Program to update the counter for. Can't be NULL.
+ * @param counter_idx Index of the counter to update.
+ * @param delta Value to add to the counter. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_program_add_counter(struct bf_program *program, uint32_t counter_idx,
+                           const struct bf_counter *delta);
 int bf_program_set_counters(struct bf_program *program,
                             const struct bf_counter *counters);
+
+/**
+ * Get the telemetry counters of a program.
+ *
+ * The per-CPU values of each counter are summed up.
+ *
+ * @param program Program to get the telemetry counters from. Can't be NULL.
+ * @param counters Array of @ref _BF_TELEMETRY_MAX counters to fill, indexed
+ *        by @ref bf_telemetry . Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. Returns
+ *         @c -ENOENT if the program has no telemetry map.
+ */
+int bf_program_get_telemetry(const struct bf_program *program,
+                             struct bf_counter *counters);
+
+/**
+ * Get the kernel's runtime statistics of a program.
+ *
+ * The memory usage of the program's maps is estimated from their
+ * @c bpf_map_info , see @ref bf_map_mem_size .
+ *
+ * @param program Program to get the statistics of. Can't be NULL.
+ * @param stats Statistics to fill. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. Returns
+ *         @c -ENOENT if the program is not loaded.
+ */
+int bf_program_get_stats(const struct bf_program *program,
+                         struct bf_prog_stats *stats);
+
+/**
+ * Estimate the number of instructions executed by a generated program, for
+ * each @ref bf_check_class .
+ *
+ * The program's control flow graph is walked from its entry point, see
+ * @ref bf_ir_path_cost . The program doesn't need to be loaded.
+ *
+ * @param program Program to estimate the cost of, must be generated. Can't be
+ *        NULL.
+ * @param costs Array of @c _BF_CHECK_CLASS_MAX costs to fill. If the cost of
+ *        the program can't be estimated (e.g. it contains loops), it is set
+ *        to @ref BF_CHECK_COST_UNKNOWN . Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_program_estimate_costs(const struct bf_program *program,
+                              struct bf_check_cost *costs);
+
+/**
+ * Copy the telemetry counters of a program into another one.
+ *
+ * Used when a program is replaced, so the telemetry counters are not reset
+ * every time the ruleset is updated. Nothing is done if any of the programs
+ * has no telemetry map.
+ *
+ * @param new_prog Program to copy the counters to. Can't be NULL.
+ * @param old_prog Program to copy the counters from. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_program_copy_telemetry(struct bf_program *new_prog,
+                              const struct bf_program *old_prog);
+
+/**
+ * Get the profiling histograms of a program.
+ *
+ * The per-CPU values of each bucket are summed up.
+ *
+ * @param program Program to get the histograms from. Can't be NULL.
+ * @param block Index of the first profiling block to get the histogram of.
+ * @param n_blocks Number of profiling blocks to get the histogram of.
+ * @param hist Array of @c n_blocks * @ref BF_PROFILE_N_BUCKETS values to
+ *        fill. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. Returns
+ *         @c -ENOENT if the program has no profiling map.
+ */
+int bf_program_get_profile(const struct bf_program *program, uint32_t block,
+                           uint32_t n_blocks, uint64_t *hist);
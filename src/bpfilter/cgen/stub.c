@@ -13,10 +13,13 @@
 #include <linux/in6.h>
 #include <linux/ip.h>
 #include <linux/ipv6.h>
+#include <linux/netfilter/nf_conntrack_common.h>
+#include <linux/netfilter/nf_conntrack_tuple_common.h>
 #include <linux/tcp.h>
 #include <linux/udp.h>
 
 #include <endian.h>
+#include <errno.h>
 #include <stddef.h>
 
 #include "bpfilter/cgen/fixup.h"
@@ -24,13 +27,43 @@
 #include "bpfilter/cgen/printer.h"
 #include "bpfilter/cgen/program.h"
 #include "bpfilter/cgen/swich.h"
+#include "core/btf.h"
+#include "core/counter.h"
 #include "core/flavor.h"
 #include "core/helper.h"
+#include "core/matcher.h"
 #include "core/opts.h"
+#include "core/telemetry.h"
 #include "core/verdict.h"
 
 #include "external/filter.h"
 
+/**
+ * Update a telemetry counter.
+ *
+ * Nothing is emitted if the program has no telemetry map (see
+ * @c --telemetry ), so telemetry doesn't cost anything when disabled.
+ *
+ * @param program Program to generate the stub for. Must not be NULL.
+ * @param counter Telemetry counter to update.
+ * @return 0 on success, or negative errno value on error.
+ */
+static int _bf_stub_update_telemetry(struct bf_program *program,
+                                     enum bf_telemetry counter)
+{
+    bf_assert(program);
+
+    if (!program->tmap)
+        return 0;
+
+    EMIT(program, BPF_MOV32_IMM(BPF_REG_1, counter));
+    EMIT(program,
+         BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_10, BF_PROG_CTX_OFF(pkt_size)));
+    EMIT_FIXUP_CALL(program, BF_FIXUP_FUNC_UPDATE_TELEMETRY);
+
+    return 0;
+}
+
 /**
  * Generate stub to create a dynptr.
  *
@@ -43,6 +76,8 @@
 static int _bf_stub_make_ctx_dynptr(struct bf_program *program, int arg_reg,
                                     const char *kfunc)
 {
+    int r;
+
     bf_assert(program && kfunc);
 
     // Call bpf_dynptr_from_xxx()
@@ -59,10 +94,13 @@ static int _bf_stub_make_ctx_dynptr(struct bf_program *program, int arg_reg,
             bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 0));
 
         // Update the error counter
-        EMIT(program, BPF_MOV32_IMM(BPF_REG_1, program->num_counters - 1));
         EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_10,
                                   BF_PROG_CTX_OFF(pkt_size)));
-        EMIT_FIXUP_CALL(program, BF_FIXUP_FUNC_UPDATE_COUNTERS);
+        EMIT_UPDATE_COUNTERS(program, program->num_counters - 1);
+
+        r = _bf_stub_update_telemetry(program, BF_TELEMETRY_ERR_DYNPTR);
+        if (r)
+            return r;
 
         if (bf_opts_is_verbose(BF_VERBOSE_BPF))
             EMIT_PRINT(program, "failed to create a new dynamic pointer");
@@ -92,6 +130,8 @@ int bf_stub_make_ctx_skb_dynptr(struct bf_program *program, int skb_reg)
 
 int bf_stub_parse_l2_ethhdr(struct bf_program *program)
 {
+    int r;
+
     bf_assert(program);
 
     // Call bpf_dynptr_slice()
@@ -109,10 +149,13 @@ int bf_stub_parse_l2_ethhdr(struct bf_program *program)
             bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, 0));
 
         // Update the error counter
-        EMIT(program, BPF_MOV32_IMM(BPF_REG_1, program->num_counters - 1));
         EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_10,
                                   BF_PROG_CTX_OFF(pkt_size)));
-        EMIT_FIXUP_CALL(program, BF_FIXUP_FUNC_UPDATE_COUNTERS);
+        EMIT_UPDATE_COUNTERS(program, program->num_counters - 1);
+
+        r = _bf_stub_update_telemetry(program, BF_TELEMETRY_ERR_L2_SLICE);
+        if (r)
+            return r;
 
         if (bf_opts_is_verbose(BF_VERBOSE_BPF))
             EMIT_PRINT(program, "failed to create L2 dynamic pointer slice");
@@ -145,6 +188,27 @@ int bf_stub_parse_l3_hdr(struct bf_program *program)
 
     bf_assert(program);
 
+    // Count the packets per L3 protocol, before r1 to r5 are used below
+    if (program->tmap) {
+        _cleanup_bf_swich_ struct bf_swich swich =
+            bf_swich_get(program, BPF_REG_7);
+
+        EMIT_SWICH_OPTION(&swich, htobe16(ETH_P_IP),
+                          BPF_MOV32_IMM(BPF_REG_1, BF_TELEMETRY_L3_IPV4));
+        EMIT_SWICH_OPTION(&swich, htobe16(ETH_P_IPV6),
+                          BPF_MOV32_IMM(BPF_REG_1, BF_TELEMETRY_L3_IPV6));
+        EMIT_SWICH_DEFAULT(&swich, BPF_MOV32_IMM(BPF_REG_1,
+                                                 BF_TELEMETRY_L3_UNSUPPORTED));
+
+        r = bf_swich_generate(&swich);
+        if (r)
+            return r;
+
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_10,
+                                  BF_PROG_CTX_OFF(pkt_size)));
+        EMIT_FIXUP_CALL(program, BF_FIXUP_FUNC_UPDATE_TELEMETRY);
+    }
+
     /* Store the size of the L3 protocol header in r4, depending on the protocol
      * ID stored in r7. If the protocol is not supported, we store 0 into r7
      * and we skip the instructions below. */
@@ -179,10 +243,13 @@ int bf_stub_parse_l3_hdr(struct bf_program *program)
             bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, 0));
 
         // Update the error counter
-        EMIT(program, BPF_MOV32_IMM(BPF_REG_1, program->num_counters - 1));
         EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_10,
                                   BF_PROG_CTX_OFF(pkt_size)));
-        EMIT_FIXUP_CALL(program, BF_FIXUP_FUNC_UPDATE_COUNTERS);
+        EMIT_UPDATE_COUNTERS(program, program->num_counters - 1);
+
+        r = _bf_stub_update_telemetry(program, BF_TELEMETRY_ERR_L3_SLICE);
+        if (r)
+            return r;
 
         if (bf_opts_is_verbose(BF_VERBOSE_BPF))
             EMIT_PRINT(program, "failed to create L3 dynamic pointer slice");
@@ -240,6 +307,34 @@ int bf_stub_parse_l4_hdr(struct bf_program *program)
 
     bf_assert(program);
 
+    /* Count the packets per L4 protocol, only if the L3 protocol is supported:
+     * otherwise, the L4 protocol is unknown. */
+    if (program->tmap) {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+            bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_7, 0, 0));
+        _cleanup_bf_swich_ struct bf_swich swich =
+            bf_swich_get(program, BPF_REG_8);
+
+        EMIT_SWICH_OPTION(&swich, IPPROTO_TCP,
+                          BPF_MOV32_IMM(BPF_REG_1, BF_TELEMETRY_L4_TCP));
+        EMIT_SWICH_OPTION(&swich, IPPROTO_UDP,
+                          BPF_MOV32_IMM(BPF_REG_1, BF_TELEMETRY_L4_UDP));
+        EMIT_SWICH_OPTION(&swich, IPPROTO_ICMP,
+                          BPF_MOV32_IMM(BPF_REG_1, BF_TELEMETRY_L4_ICMP));
+        EMIT_SWICH_OPTION(&swich, IPPROTO_ICMPV6,
+                          BPF_MOV32_IMM(BPF_REG_1, BF_TELEMETRY_L4_ICMPV6));
+        EMIT_SWICH_DEFAULT(&swich, BPF_MOV32_IMM(BPF_REG_1,
+                                                 BF_TELEMETRY_L4_UNSUPPORTED));
+
+        r = bf_swich_generate(&swich);
+        if (r)
+            return r;
+
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_10,
+                                  BF_PROG_CTX_OFF(pkt_size)));
+        EMIT_FIXUP_CALL(program, BF_FIXUP_FUNC_UPDATE_TELEMETRY);
+    }
+
     /* Parse the L4 protocol and handle unuspported protocol, similarly to
      * bf_stub_parse_l3_hdr() above. */
     {
@@ -277,10 +372,13 @@ int bf_stub_parse_l4_hdr(struct bf_program *program)
             bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, 0));
 
         // Update the error counter
-        EMIT(program, BPF_MOV32_IMM(BPF_REG_1, program->num_counters - 1));
         EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_10,
                                   BF_PROG_CTX_OFF(pkt_size)));
-        EMIT_FIXUP_CALL(program, BF_FIXUP_FUNC_UPDATE_COUNTERS);
+        EMIT_UPDATE_COUNTERS(program, program->num_counters - 1);
+
+        r = _bf_stub_update_telemetry(program, BF_TELEMETRY_ERR_L4_SLICE);
+        if (r)
+            return r;
 
         if (bf_opts_is_verbose(BF_VERBOSE_BPF))
             EMIT_PRINT(program, "failed to create L4 dynamic pointer slice");
@@ -297,3 +395,144 @@ int bf_stub_parse_l4_hdr(struct bf_program *program)
 
     return 0;
 }
+
+/// Size of the @c bpf_ct_opts structure expected by the conntrack kfuncs.
+#define _BF_CT_OPTS_SZ 12
+
+int bf_stub_ct_lookup(struct bf_program *program, const char *kfunc)
+{
+    const int opts_off = BF_PROG_SCR_OFF(40);
+    int status_off;
+    int r;
+
+    bf_assert(program && kfunc);
+
+    status_off = bf_btf_get_field_off("nf_conn", "status");
+    if (status_off < 0)
+        return status_off;
+
+    // Only TCP and UDP connections can be looked up
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx tcp = bf_jmpctx_get(
+            program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_8, IPPROTO_TCP, 0));
+        _cleanup_bf_jmpctx_ struct bf_jmpctx udp = bf_jmpctx_get(
+            program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_8, IPPROTO_UDP, 0));
+
+        EMIT(program, BPF_ST_MEM(BPF_W, BPF_REG_9, BF_PROG_CTX_OFF(ct_state),
+                                 1 << BF_MATCHER_CT_STATE_INVALID));
+        EMIT(program, BPF_MOV64_IMM(BPF_REG_0, 0));
+        EMIT(program, BPF_EXIT_INSN());
+    }
+
+    /* Write the packet's bpf_sock_tuple into the scratch area, and store the
+     * tuple's size in r3. */
+    EMIT(program,
+         BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_9, BF_PROG_CTX_OFF(l3_hdr)));
+    {
+        _cleanup_bf_swich_ struct bf_swich swich =
+            bf_swich_get(program, BPF_REG_7);
+
+        EMIT_SWICH_OPTION(&swich, htobe16(ETH_P_IP),
+                          BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_6,
+                                      offsetof(struct iphdr, saddr)),
+                          BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_1,
+                                      BF_PROG_SCR_OFF(0)),
+                          BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_9,
+                                      BF_PROG_CTX_OFF(l4_hdr)),
+                          BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_6, 0),
+                          BPF_STX_MEM(BPF_W, BPF_REG_9, BPF_REG_1,
+                                      BF_PROG_SCR_OFF(8)),
+                          BPF_MOV64_IMM(BPF_REG_3, 12));
+        EMIT_SWICH_OPTION(&swich, htobe16(ETH_P_IPV6),
+                          BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_6,
+                                      offsetof(struct ipv6hdr, saddr)),
+                          BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_1,
+                                      BF_PROG_SCR_OFF(0)),
+                          BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_6,
+                                      offsetof(struct ipv6hdr, saddr) + 8),
+                          BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_1,
+                                      BF_PROG_SCR_OFF(8)),
+                          BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_6,
+                                      offsetof(struct ipv6hdr, daddr)),
+                          BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_1,
+                                      BF_PROG_SCR_OFF(16)),
+                          BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_6,
+                                      offsetof(struct ipv6hdr, daddr) + 8),
+                          BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_1,
+                                      BF_PROG_SCR_OFF(24)),
+                          BPF_LDX_MEM(BPF_DW, BPF_REG_6, BPF_REG_9,
+                                      BF_PROG_CTX_OFF(l4_hdr)),
+                          BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_6, 0),
+                          BPF_STX_MEM(BPF_W, BPF_REG_9, BPF_REG_1,
+                                      BF_PROG_SCR_OFF(32)),
+                          BPF_MOV64_IMM(BPF_REG_3, 36));
+        EMIT_SWICH_DEFAULT(&swich,
+                           BPF_ST_MEM(BPF_W, BPF_REG_9,
+                                      BF_PROG_CTX_OFF(ct_state),
+                                      1 << BF_MATCHER_CT_STATE_INVALID),
+                           BPF_MOV64_IMM(BPF_REG_0, 0), BPF_EXIT_INSN());
+
+        r = bf_swich_generate(&swich);
+        if (r)
+            return r;
+    }
+
+    // Fill the bpf_ct_opts structure, right after the tuple
+    EMIT(program, BPF_ST_MEM(BPF_W, BPF_REG_9, opts_off, -1));
+    EMIT(program, BPF_ST_MEM(BPF_W, BPF_REG_9, opts_off + 4, 0));
+    EMIT(program, BPF_STX_MEM(BPF_B, BPF_REG_9, BPF_REG_8, opts_off + 8));
+    EMIT(program, BPF_ST_MEM(BPF_B, BPF_REG_9, opts_off + 9, 0));
+    EMIT(program, BPF_ST_MEM(BPF_H, BPF_REG_9, opts_off + 10, 0));
+
+    // Call the lookup kfunc
+    EMIT(program,
+         BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_9, BF_PROG_CTX_OFF(arg)));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_9));
+    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, BF_PROG_SCR_OFF(0)));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_4, BPF_REG_9));
+    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_4, opts_off));
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_5, _BF_CT_OPTS_SZ));
+    EMIT_KFUNC_CALL(program, kfunc);
+
+    /* No conntrack entry: the connection is new if the lookup failed with
+     * -ENOENT, the packet is invalid otherwise. */
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+            bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, 0));
+
+        EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_9, opts_off + 4));
+        EMIT(program, BPF_MOV64_IMM(BPF_REG_2, 1 << BF_MATCHER_CT_STATE_NEW));
+        EMIT(program, BPF_JMP32_IMM(BPF_JEQ, BPF_REG_1, -ENOENT, 1));
+        EMIT(program,
+             BPF_MOV64_IMM(BPF_REG_2, 1 << BF_MATCHER_CT_STATE_INVALID));
+        EMIT(program, BPF_STX_MEM(BPF_W, BPF_REG_9, BPF_REG_2,
+                                  BF_PROG_CTX_OFF(ct_state)));
+        EMIT(program, BPF_MOV64_IMM(BPF_REG_0, 0));
+        EMIT(program, BPF_EXIT_INSN());
+    }
+
+    /* Derive the connection's state from the conntrack entry, the same way
+     * Netfilter does: established if a reply has been seen or if the packet
+     * is in the reply direction, related if the connection is expected, new
+     * otherwise. */
+    EMIT(program, BPF_MOV64_REG(BPF_REG_6, BPF_REG_0));
+    EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_6, status_off));
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_2, 1 << BF_MATCHER_CT_STATE_NEW));
+    EMIT(program, BPF_MOV64_REG(BPF_REG_3, BPF_REG_1));
+    EMIT(program, BPF_ALU64_IMM(BPF_AND, BPF_REG_3, IPS_EXPECTED));
+    EMIT(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_3, 0, 1));
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_2, 1 << BF_MATCHER_CT_STATE_RELATED));
+    EMIT(program, BPF_JMP_IMM(BPF_JSET, BPF_REG_1, IPS_SEEN_REPLY, 2));
+    EMIT(program, BPF_LDX_MEM(BPF_B, BPF_REG_3, BPF_REG_9, opts_off + 9));
+    EMIT(program, BPF_JMP_IMM(BPF_JNE, BPF_REG_3, IP_CT_DIR_REPLY, 1));
+    EMIT(program,
+         BPF_MOV64_IMM(BPF_REG_2, 1 << BF_MATCHER_CT_STATE_ESTABLISHED));
+    EMIT(program, BPF_STX_MEM(BPF_W, BPF_REG_9, BPF_REG_2,
+                              BF_PROG_CTX_OFF(ct_state)));
+
+    // Release the reference to the conntrack entry
+    EMIT(program, BPF_MOV64_REG(BPF_REG_1, BPF_REG_6));
+    EMIT_KFUNC_CALL(program, "bpf_ct_release");
+
+    return 0;
+}
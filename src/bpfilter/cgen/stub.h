@@ -86,3 +86,24 @@ int bf_stub_parse_l3_hdr(struct bf_program *program);
  * @return 0 on success, or negative errno value on error.
  */
 int bf_stub_parse_l4_hdr(struct bf_program *program);
+
+/**
+ * Emit instructions to lookup the packet's connection using a conntrack kfunc.
+ *
+ * The instructions are meant to be emitted in the connection tracking lookup
+ * function (see @ref BF_FIXUP_FUNC_CT_LOOKUP ), where @c r9 contains the
+ * address of the runtime context, and @c r7 and @c r8 contain the L3 and L4
+ * protocol IDs. The connection is looked up from the packet's 5-tuple, only
+ * TCP and UDP packets over IPv4 or IPv6 can be looked up, other packets are
+ * considered invalid.
+ *
+ * The connection's state is derived from the conntrack entry returned by
+ * @p kfunc and stored in @c bf_program_context.ct_state . The reference to the
+ * conntrack entry is released before returning.
+ *
+ * @param program Program to emit instructions into. Can't be NULL.
+ * @param kfunc Name of the kfunc used to lookup the connection, e.g.
+ *        @c bpf_xdp_ct_lookup or @c bpf_skb_ct_lookup . Can't be NULL.
+ * @return 0 on success, or negative errno value on error.
+ */
+int bf_stub_ct_lookup(struct bf_program *program, const char *kfunc);
@@ -28,6 +28,7 @@
 static int _bf_tc_gen_inline_prologue(struct bf_program *program);
 static int _bf_tc_gen_inline_epilogue(struct bf_program *program);
 static int _bf_tc_get_verdict(enum bf_verdict verdict);
+static int _bf_tc_gen_ct_lookup(struct bf_program *program);
 static int _bf_tc_attach_prog(
     struct bf_program *new_prog, struct bf_program *old_prog,
     int (*get_new_link_cb)(struct bf_program *prog, struct bf_link *old_link,
@@ -38,6 +39,7 @@ const struct bf_flavor_ops bf_flavor_ops_tc = {
     .gen_inline_prologue = _bf_tc_gen_inline_prologue,
     .gen_inline_epilogue = _bf_tc_gen_inline_epilogue,
     .get_verdict = _bf_tc_get_verdict,
+    .gen_ct_lookup = _bf_tc_gen_ct_lookup,
     .attach_prog = _bf_tc_attach_prog,
     .detach_prog = _bf_tc_detach_prog,
 };
@@ -117,6 +119,11 @@ static int _bf_tc_get_verdict(enum bf_verdict verdict)
     return verdicts[verdict];
 }
 
+static int _bf_tc_gen_ct_lookup(struct bf_program *program)
+{
+    return bf_stub_ct_lookup(program, "bpf_skb_ct_lookup");
+}
+
 static int _bf_tc_attach_prog(struct bf_program *new_prog,
                               struct bf_program *old_prog,
                               int (*get_new_link_cb)(struct bf_program *prog,
@@ -0,0 +1,587 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "bpfilter/cgen/tss.h"
+
+#include <linux/bpf.h>
+#include <linux/bpf_common.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+
+#include <endian.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bpfilter/cgen/fixup.h"
+#include "bpfilter/cgen/jmp.h"
+#include "bpfilter/cgen/program.h"
+#include "bpfilter/cgen/prog/map.h"
+#include "core/bpf.h"
+#include "core/flavor.h"
+#include "core/helper.h"
+#include "core/list.h"
+#include "core/logger.h"
+#include "core/matcher.h"
+#include "core/rule.h"
+#include "core/verdict.h"
+
+#include "external/filter.h"
+
+#define _BF_TSS_TUPLE_MIN_CAP 16
+
+/** Minimum number of consecutive rules to replace with a classifier, for
+ * chains in classifier mode. Shorter runs of rules are compiled, as the
+ * classifier has a fixed cost of one map lookup per tuple. */
+#define _BF_TSS_MIN_N_RULES (1 << 3)
+
+/* Layout of the scratch area while a classifier is evaluated: the packet's
+ * key, the key masked with the current tuple's mask, and the priority of the
+ * best matching rule found so far. */
+#define _BF_TSS_SCR_KEY 0
+#define _BF_TSS_SCR_MASKED 16
+#define _BF_TSS_SCR_PRIORITY 32
+#define _BF_TSS_SCR_KEY_OFF(field)                                             \
+    BF_PROG_SCR_OFF(_BF_TSS_SCR_KEY + (int)offsetof(struct bf_tss_key, field))
+
+/**
+ * Set a field of a tuple's key and mask.
+ *
+ * If the field is already set by another matcher of the rule, the values
+ * must be identical, otherwise the rule can't match any packet and it is not
+ * classified.
+ */
+#define _bf_tss_set(key, mask, field, value, field_mask)                       \
+    ({                                                                         \
+        int __r = 0;                                                           \
+        if ((mask)->field && ((mask)->field != (field_mask) ||                 \
+                              (key)->field != (value)))                        \
+            __r = -ENOTSUP;                                                    \
+        (key)->field = (value);                                                \
+        (mask)->field = (field_mask);                                          \
+        __r;                                                                   \
+    })
+
+static int _bf_tss_matcher_encode(const struct bf_matcher *matcher,
+                                  struct bf_tss_key *key,
+                                  struct bf_tss_key *mask, uint32_t *flags)
+{
+    const struct bf_matcher_ip4_addr *addr = (const void *)matcher->payload;
+    uint16_t port = htobe16(*(uint16_t *)matcher->payload);
+    uint8_t proto = *(uint8_t *)matcher->payload;
+
+    if (matcher->op != BF_MATCHER_EQ)
+        return -ENOTSUP;
+
+    switch (matcher->type) {
+    case BF_MATCHER_META_L3_PROTO:
+        if (*(uint16_t *)matcher->payload != ETH_P_IP)
+            return -ENOTSUP;
+        *flags |= BF_TSS_TUPLE_IP4;
+        return 0;
+    case BF_MATCHER_META_L4_PROTO:
+        return _bf_tss_set(key, mask, l4_proto, proto, 0xff);
+    case BF_MATCHER_IP4_PROTO:
+        *flags |= BF_TSS_TUPLE_IP4;
+        return _bf_tss_set(key, mask, l4_proto, proto, 0xff);
+    case BF_MATCHER_IP4_SRC_ADDR:
+        *flags |= BF_TSS_TUPLE_IP4;
+        return _bf_tss_set(key, mask, saddr, addr->addr & addr->mask,
+                           addr->mask);
+    case BF_MATCHER_IP4_DST_ADDR:
+        *flags |= BF_TSS_TUPLE_IP4;
+        return _bf_tss_set(key, mask, daddr, addr->addr & addr->mask,
+                           addr->mask);
+    case BF_MATCHER_TCP_SPORT:
+    case BF_MATCHER_TCP_DPORT:
+    case BF_MATCHER_UDP_SPORT:
+    case BF_MATCHER_UDP_DPORT:
+        proto = matcher->type == BF_MATCHER_TCP_SPORT ||
+                        matcher->type == BF_MATCHER_TCP_DPORT ?
+                    IPPROTO_TCP :
+                    IPPROTO_UDP;
+        if (_bf_tss_set(key, mask, l4_proto, proto, 0xff))
+            return -ENOTSUP;
+        // Fallthrough
+    case BF_MATCHER_META_SPORT:
+    case BF_MATCHER_META_DPORT:
+        /* Packets without TCP nor UDP header have their ports set to 0 in
+         * the key, so rules matching port 0 can't be classified. */
+        if (!port)
+            return -ENOTSUP;
+
+        if (matcher->type == BF_MATCHER_META_SPORT ||
+            matcher->type == BF_MATCHER_TCP_SPORT ||
+            matcher->type == BF_MATCHER_UDP_SPORT)
+            return _bf_tss_set(key, mask, sport, port, 0xffff);
+
+        return _bf_tss_set(key, mask, dport, port, 0xffff);
+    default:
+        return -ENOTSUP;
+    }
+}
+
+int bf_tss_rule_encode(const struct bf_rule *rule, struct bf_tss_key *key,
+                       struct bf_tss_key *mask, uint32_t *flags)
+{
+    int r;
+
+    bf_assert(rule && key && mask && flags);
+
+    if (rule->verdict != BF_VERDICT_ACCEPT && rule->verdict != BF_VERDICT_DROP)
+        return -ENOTSUP;
+
+    if (rule->set_add)
+        return -ENOTSUP;
+
+    *key = (struct bf_tss_key) {};
+    *mask = (struct bf_tss_key) {};
+    *flags = 0;
+
+    bf_list_foreach (&rule->matchers, matcher_node) {
+        r = _bf_tss_matcher_encode(bf_list_node_get_data(matcher_node), key,
+                                   mask, flags);
+        if (r)
+            return r;
+    }
+
+    return 0;
+}
+
+void bf_tss_tuple_free(struct bf_tss_tuple **tuple)
+{
+    bf_assert(tuple);
+
+    if (!*tuple)
+        return;
+
+    free((*tuple)->keys);
+    free((*tuple)->values);
+    freep((void *)tuple);
+}
+
+static struct bf_tss_tuple *_bf_tss_get_tuple(bf_list *tuples,
+                                              const struct bf_tss_key *mask,
+                                              uint32_t flags)
+{
+    bf_list_foreach (tuples, tuple_node) {
+        struct bf_tss_tuple *tuple = bf_list_node_get_data(tuple_node);
+
+        if (tuple->flags == flags && !memcmp(&tuple->mask, mask, sizeof(*mask)))
+            return tuple;
+    }
+
+    return NULL;
+}
+
+int bf_tss_add_rule(bf_list *tuples, const struct bf_rule *rule,
+                    uint32_t counter)
+{
+    struct bf_tss_tuple *tuple;
+    struct bf_tss_key mask;
+    struct bf_tss_key key;
+    uint32_t flags;
+    int r;
+
+    bf_assert(tuples && rule);
+
+    r = bf_tss_rule_encode(rule, &key, &mask, &flags);
+    if (r)
+        return bf_err_r(r, "rule %u can't be classified", rule->index);
+
+    tuple = _bf_tss_get_tuple(tuples, &mask, flags);
+    if (!tuple) {
+        _cleanup_bf_tss_tuple_ struct bf_tss_tuple *_tuple = NULL;
+
+        _tuple = calloc(1, sizeof(*_tuple));
+        if (!_tuple)
+            return -ENOMEM;
+
+        _tuple->mask = mask;
+        _tuple->flags = flags;
+        _tuple->min_priority = rule->index;
+
+        r = bf_list_add_tail(tuples, _tuple);
+        if (r)
+            return r;
+
+        tuple = TAKE_PTR(_tuple);
+    }
+
+    if (tuple->n_elems == tuple->cap) {
+        size_t cap = bf_max(tuple->cap * 2, (size_t)_BF_TSS_TUPLE_MIN_CAP);
+
+        r = bf_realloc((void **)&tuple->keys, cap * sizeof(*tuple->keys));
+        if (r)
+            return r;
+
+        r = bf_realloc((void **)&tuple->values, cap * sizeof(*tuple->values));
+        if (r)
+            return r;
+
+        tuple->cap = cap;
+    }
+
+    tuple->keys[tuple->n_elems] = key;
+    tuple->values[tuple->n_elems] = (struct bf_tss_value) {
+        .priority = rule->index,
+        .verdict = rule->verdict,
+        .counter = counter,
+        .flags = rule->counters ? BF_TSS_VALUE_COUNTERS : 0,
+    };
+    ++tuple->n_elems;
+
+    return 0;
+}
+
+/**
+ * Generate the bytecode to look up the packet's key in a classifier's tuple.
+ *
+ * If a rule of the tuple matches with a lower priority than the best rule
+ * found so far, its priority is stored in the scratch area, and its
+ * @ref bf_tss_value is stored in @c r6 .
+ *
+ * @param program Program to generate the bytecode for. Can't be NULL.
+ * @param tuple Tuple to generate the bytecode for. Can't be NULL.
+ * @param index Index of the tuple's map in @ref bf_program.tss .
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_tss_generate_tuple(struct bf_program *program,
+                                  const struct bf_tss_tuple *tuple,
+                                  size_t index)
+{
+    const struct bpf_insn ld_insn[2] = {BPF_LD_MAP_FD(BPF_REG_1, 0)};
+    union bf_fixup_attr attr = {.tuple_index = index};
+    struct bf_jmpctx not_ip4 = {};
+    uint64_t mask[2];
+    int r;
+
+    bf_assert(program && tuple);
+
+    if (tuple->flags & BF_TSS_TUPLE_IP4) {
+        not_ip4 = bf_jmpctx_get(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_7, htobe16(ETH_P_IP), 0));
+    }
+
+    // Mask the packet's key, one 64 bits word at a time
+    memcpy(mask, &tuple->mask, sizeof(mask));
+    for (size_t i = 0; i < ARRAY_SIZE(mask); ++i) {
+        const struct bpf_insn ld_mask[2] = {BPF_LD_IMM64(BPF_REG_2, mask[i])};
+        const int off = (int)(i * sizeof(*mask));
+
+        if (!mask[i]) {
+            EMIT(program,
+                 BPF_ST_MEM(BPF_DW, BPF_REG_9,
+                            BF_PROG_SCR_OFF(_BF_TSS_SCR_MASKED + off),
+                            0));
+            continue;
+        }
+
+        EMIT(program,
+             BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_9,
+                         BF_PROG_SCR_OFF(_BF_TSS_SCR_KEY + off)));
+        if (mask[i] != UINT64_MAX) {
+            EMIT(program, ld_mask[0]);
+            EMIT(program, ld_mask[1]);
+            EMIT(program, BPF_ALU64_REG(BPF_AND, BPF_REG_1, BPF_REG_2));
+        }
+        EMIT(program,
+             BPF_STX_MEM(BPF_DW, BPF_REG_9, BPF_REG_1,
+                         BF_PROG_SCR_OFF(_BF_TSS_SCR_MASKED + off)));
+    }
+
+    // Look up the masked key in the tuple's map
+    r = bf_program_emit_fixup(program, BF_FIXUP_TYPE_TSS_MAP_FD, ld_insn[0],
+                              &attr);
+    if (r)
+        return r;
+    EMIT(program, ld_insn[1]);
+    EMIT(program, BPF_MOV64_REG(BPF_REG_2, BPF_REG_9));
+    EMIT(program, BPF_ALU64_IMM(BPF_ADD, BPF_REG_2,
+                                BF_PROG_SCR_OFF(_BF_TSS_SCR_MASKED)));
+    EMIT(program, BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem));
+
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+            bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 0));
+
+        // Keep the rule if it has the lowest priority so far
+        EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_0,
+                                  offsetof(struct bf_tss_value, priority)));
+        EMIT(program,
+             BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_9,
+                         BF_PROG_SCR_OFF(_BF_TSS_SCR_PRIORITY)));
+        {
+            _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+                program, BPF_JMP_REG(BPF_JGE, BPF_REG_1, BPF_REG_2, 0));
+
+            EMIT(program,
+                 BPF_STX_MEM(BPF_W, BPF_REG_9, BPF_REG_1,
+                             BF_PROG_SCR_OFF(_BF_TSS_SCR_PRIORITY)));
+            EMIT(program, BPF_MOV64_REG(BPF_REG_6, BPF_REG_0));
+        }
+    }
+
+    if (tuple->flags & BF_TSS_TUPLE_IP4)
+        bf_jmpctx_cleanup(&not_ip4);
+
+    return 0;
+}
+
+int bf_tss_generate(struct bf_program *program, const bf_list_node *rule_node,
+                    size_t *n_rules)
+{
+    _clean_bf_list_ bf_list tuples = bf_tss_tuple_list();
+    _cleanup_free_ struct bf_jmpctx *done = NULL;
+    const bf_list_node *node = rule_node;
+    struct bf_tss_key key;
+    struct bf_tss_key mask;
+    size_t index = bf_list_size(&program->tss);
+    size_t n = 0;
+    size_t i = 0;
+    uint32_t flags;
+    int r;
+
+    bf_assert(program && rule_node && n_rules);
+
+    *n_rules = 0;
+
+    while (node && !bf_tss_rule_encode(bf_list_node_get_data(node), &key,
+                                       &mask, &flags)) {
+        ++n;
+        node = bf_list_node_next(node);
+    }
+
+    if (n < _BF_TSS_MIN_N_RULES)
+        return 0;
+
+    node = rule_node;
+    for (i = 0; i < n; ++i) {
+        const struct bf_rule *rule = bf_list_node_get_data(node);
+
+        if (program->runtime.ops->check_matcher) {
+            bf_list_foreach (&rule->matchers, matcher_node) {
+                r = program->runtime.ops->check_matcher(
+                    program, bf_list_node_get_data(matcher_node));
+                if (r)
+                    return r;
+            }
+        }
+
+        r = bf_tss_add_rule(&tuples, rule,
+                            program->runtime.cur_counters_offset +
+                                rule->index);
+        if (r)
+            return r;
+
+        node = bf_list_node_next(node);
+    }
+
+    done = calloc(bf_list_size(&tuples), sizeof(*done));
+    if (!done)
+        return -ENOMEM;
+
+    // Build the packet's key, fields not available in the packet are 0
+    EMIT(program, BPF_ST_MEM(BPF_DW, BPF_REG_9,
+                             BF_PROG_SCR_OFF(_BF_TSS_SCR_KEY), 0));
+    EMIT(program, BPF_ST_MEM(BPF_DW, BPF_REG_9,
+                             BF_PROG_SCR_OFF(_BF_TSS_SCR_KEY + 8), 0));
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_7, htobe16(ETH_P_IP), 0));
+
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_9,
+                                  BF_PROG_CTX_OFF(l3_hdr)));
+        EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+                                  offsetof(struct iphdr, saddr)));
+        EMIT(program, BPF_STX_MEM(BPF_W, BPF_REG_9, BPF_REG_2,
+                                  _BF_TSS_SCR_KEY_OFF(saddr)));
+        EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+                                  offsetof(struct iphdr, daddr)));
+        EMIT(program, BPF_STX_MEM(BPF_W, BPF_REG_9, BPF_REG_2,
+                                  _BF_TSS_SCR_KEY_OFF(daddr)));
+    }
+    EMIT(program, BPF_STX_MEM(BPF_B, BPF_REG_9, BPF_REG_8,
+                              _BF_TSS_SCR_KEY_OFF(l4_proto)));
+    {
+        // TCP and UDP headers start with the source and destination ports
+        struct bf_jmpctx is_tcp = bf_jmpctx_get(
+            program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_8, IPPROTO_TCP, 0));
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+            program, BPF_JMP_IMM(BPF_JNE, BPF_REG_8, IPPROTO_UDP, 0));
+
+        bf_jmpctx_cleanup(&is_tcp);
+
+        EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_9,
+                                  BF_PROG_CTX_OFF(l4_hdr)));
+        EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_1,
+                                  offsetof(struct tcphdr, source)));
+        EMIT(program, BPF_STX_MEM(BPF_W, BPF_REG_9, BPF_REG_2,
+                                  _BF_TSS_SCR_KEY_OFF(sport)));
+    }
+
+    EMIT(program,
+         BPF_ST_MEM(BPF_W, BPF_REG_9,
+                    BF_PROG_SCR_OFF(_BF_TSS_SCR_PRIORITY), -1));
+    EMIT(program, BPF_MOV64_IMM(BPF_REG_6, 0));
+
+    i = 0;
+    bf_list_foreach (&tuples, tuple_node) {
+        const struct bf_tss_tuple *tuple = bf_list_node_get_data(tuple_node);
+        _cleanup_bf_map_ struct bf_map *map = NULL;
+        char name[BPF_OBJ_NAME_LEN];
+
+        /* Tuples are sorted by increasing priority of their first rule: if a
+         * rule with a lower priority has been found, stop. */
+        if (i) {
+            EMIT(program,
+                 BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_9,
+                             BF_PROG_SCR_OFF(_BF_TSS_SCR_PRIORITY)));
+            done[i] = bf_jmpctx_get(
+                program,
+                BPF_JMP_IMM(BPF_JLT, BPF_REG_1, tuple->min_priority, 0));
+        }
+
+        r = _bf_tss_generate_tuple(program, tuple, index + i);
+        if (r)
+            return r;
+
+        (void)snprintf(name, BPF_OBJ_NAME_LEN, "%s_t%02x", program->id,
+                       (uint8_t)(index + i));
+        r = bf_map_new(&map, name, BF_MAP_TYPE_TSS, BF_MAP_BPF_TYPE_HASH,
+                       sizeof(struct bf_tss_key), sizeof(struct bf_tss_value),
+                       tuple->n_elems);
+        if (r)
+            return bf_err_r(r, "failed to create the tuple bf_map object");
+
+        r = bf_list_add_tail(&program->tss, map);
+        if (r)
+            return r;
+        TAKE_PTR(map);
+
+        ++i;
+    }
+
+    for (i = 1; i < bf_list_size(&tuples); ++i)
+        bf_jmpctx_cleanup(&done[i]);
+
+    // Apply the verdict of the best matching rule, if any
+    {
+        _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+            bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_6, 0, 0));
+
+        EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_6,
+                                  offsetof(struct bf_tss_value, flags)));
+        EMIT(program, BPF_ALU32_IMM(BPF_AND, BPF_REG_1, BF_TSS_VALUE_COUNTERS));
+        {
+            _cleanup_bf_jmpctx_ struct bf_jmpctx _ =
+                bf_jmpctx_get(program, BPF_JMP_IMM(BPF_JEQ, BPF_REG_1, 0, 0));
+
+            EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_6,
+                                      offsetof(struct bf_tss_value, counter)));
+            EMIT(program, BPF_LDX_MEM(BPF_DW, BPF_REG_2, BPF_REG_9,
+                                      BF_PROG_CTX_OFF(pkt_size)));
+            EMIT_FIXUP_CALL(program, BF_FIXUP_FUNC_UPDATE_COUNTERS);
+        }
+
+        EMIT(program, BPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_6,
+                                  offsetof(struct bf_tss_value, verdict)));
+        {
+            _cleanup_bf_jmpctx_ struct bf_jmpctx _ = bf_jmpctx_get(
+                program, BPF_JMP_IMM(BPF_JNE, BPF_REG_1, BF_VERDICT_ACCEPT, 0));
+
+            r = bf_program_generate_verdict(program, BF_VERDICT_ACCEPT);
+            if (r)
+                return r;
+        }
+
+        r = bf_program_generate_verdict(program, BF_VERDICT_DROP);
+        if (r)
+            return r;
+    }
+
+    // The tuples' rules are written to the maps when the program is loaded
+    bf_list_foreach (&tuples, tuple_node) {
+        r = bf_list_add_tail(&program->runtime.tuples,
+                             bf_list_node_take_data(tuple_node));
+        if (r)
+            return r;
+    }
+
+    *n_rules = n;
+
+    return 0;
+}
+
+int bf_tss_load_maps(struct bf_program *program)
+{
+    const bf_list_node *tuple_node;
+    const bf_list_node *map_node;
+    int r;
+
+    bf_assert(program);
+
+    tuple_node = bf_list_get_head(&program->runtime.tuples);
+    map_node = bf_list_get_head(&program->tss);
+
+    while (tuple_node && map_node) {
+        _cleanup_free_ struct bf_tss_value *values = NULL;
+        _cleanup_free_ struct bf_tss_key *keys = NULL;
+        const struct bf_tss_tuple *tuple = bf_list_node_get_data(tuple_node);
+        struct bf_map *map = bf_list_node_get_data(map_node);
+        union bpf_attr attr = {};
+
+        r = bf_map_create(map, 0);
+        if (r < 0) {
+            bf_err_r(r, "failed to create tuple BPF map");
+            goto err_destroy_maps;
+        }
+
+        keys = calloc(tuple->n_elems, sizeof(*keys));
+        values = calloc(tuple->n_elems, sizeof(*values));
+        if (!keys || !values) {
+            r = bf_err_r(-ENOMEM, "failed to allocate tuple map elements");
+            goto err_destroy_maps;
+        }
+
+        /* Rules sharing the same key are written in reverse order, so the
+         * rule with the lowest priority overwrites the others. */
+        for (size_t i = 0; i < tuple->n_elems; ++i) {
+            keys[i] = tuple->keys[tuple->n_elems - i - 1];
+            values[i] = tuple->values[tuple->n_elems - i - 1];
+        }
+
+        attr.batch.map_fd = map->fd;
+        attr.batch.keys = (unsigned long long)keys;
+        attr.batch.values = (unsigned long long)values;
+        attr.batch.count = tuple->n_elems;
+        attr.batch.flags = BPF_ANY;
+
+        r = bf_bpf(BPF_MAP_UPDATE_BATCH, &attr);
+        if (r < 0) {
+            bf_err_r(r, "failed to add rules to the tuple map");
+            goto err_destroy_maps;
+        }
+
+        tuple_node = bf_list_node_next(tuple_node);
+        map_node = bf_list_node_next(map_node);
+    }
+
+    r = bf_program_fixup(program, BF_FIXUP_TYPE_TSS_MAP_FD);
+    if (r < 0) {
+        bf_err_r(r, "failed to fixup tuple map FD");
+        goto err_destroy_maps;
+    }
+
+    return 0;
+
+err_destroy_maps:
+    bf_list_foreach (&program->tss, map_node)
+        bf_map_destroy(bf_list_node_get_data(map_node));
+    return r;
+}
@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "core/list.h"
+
+/**
+ * @file tss.h
+ *
+ * Tuple space search classifier, used by chains in @c classifier mode.
+ *
+ * Large rulesets often consist of rules matching the same header fields with
+ * different masks (e.g. a source prefix and a destination port). Such rules
+ * can't be stored in a single set, as the set's key is the exact value of
+ * the fields. Instead, rules are grouped by tuple: the mask applied to each
+ * field. Each tuple is stored in its own hash map, keyed by the masked
+ * fields. To classify a packet, its fields are masked with each tuple's mask
+ * and looked up in the tuple's map, the matching rule with the lowest
+ * priority (its index in the chain) wins. The number of lookups depends on
+ * the number of tuples, not on the number of rules.
+ *
+ * Only rules matching IPv4 addresses, the L4 protocol, and the source and
+ * destination ports for equality, with an @c ACCEPT or @c DROP verdict, can
+ * be classified (see @ref bf_tss_rule_encode ). Runs of consecutive rules
+ * that can be classified are replaced with a single classifier, other rules
+ * are compiled.
+ */
+
+struct bf_program;
+struct bf_rule;
+
+/**
+ * Key of the tuples' maps: the packet's fields, masked with the tuple's mask.
+ *
+ * Fields are stored in network byte order. If the packet is not IPv4, or has
+ * no TCP nor UDP header, the matching fields are 0.
+ */
+struct bf_tss_key
+{
+    uint32_t saddr;
+    uint32_t daddr;
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t l4_proto;
+    uint8_t pad[3];
+};
+
+static_assert(sizeof(struct bf_tss_key) == 16,
+              "struct bf_tss_key is loaded as two 64 bits words");
+
+enum bf_tss_tuple_flag
+{
+    /// The packet must be IPv4 for the tuple to match.
+    BF_TSS_TUPLE_IP4 = 1 << 0,
+};
+
+enum bf_tss_value_flag
+{
+    /// Update the counters at index @ref bf_tss_value::counter on match.
+    BF_TSS_VALUE_COUNTERS = 1 << 0,
+};
+
+/**
+ * Value of the tuples' maps: the rule matching the key.
+ */
+struct bf_tss_value
+{
+    /// Priority of the rule, the lowest priority wins.
+    uint32_t priority;
+    /// Verdict of the rule, @c BF_VERDICT_ACCEPT or @c BF_VERDICT_DROP .
+    uint32_t verdict;
+    /// Index of the rule's counters in the program's counters map.
+    uint32_t counter;
+    /// Flags of the rule, see @ref bf_tss_value_flag .
+    uint32_t flags;
+};
+
+/**
+ * Rules sharing the same mask.
+ */
+struct bf_tss_tuple
+{
+    /// Mask applied to the packet's fields.
+    struct bf_tss_key mask;
+    /// Flags of the tuple, see @ref bf_tss_tuple_flag .
+    uint32_t flags;
+    /// Lowest priority of the tuple's rules.
+    uint32_t min_priority;
+    /// Number of rules in the tuple.
+    size_t n_elems;
+    /// Number of rules @c keys and @c values can store.
+    size_t cap;
+    /// Key of each rule, in the order they were added.
+    struct bf_tss_key *keys;
+    /// Value of each rule, in the order they were added.
+    struct bf_tss_value *values;
+};
+
+#define _cleanup_bf_tss_tuple_ __attribute__((cleanup(bf_tss_tuple_free)))
+
+/**
+ * Free a tuple.
+ *
+ * @param tuple Tuple to free. If @p tuple points to NULL, nothing is done.
+ *        Can't be NULL.
+ */
+void bf_tss_tuple_free(struct bf_tss_tuple **tuple);
+
+/**
+ * Create an empty list of @ref bf_tss_tuple .
+ *
+ * @return An empty list, owning its tuples.
+ */
+#define bf_tss_tuple_list()                                                    \
+    ((bf_list) {.ops = {.free = (bf_list_ops_free)bf_tss_tuple_free}})
+
+/**
+ * Encode a rule into a tuple's key and mask.
+ *
+ * @param rule Rule to encode. Can't be NULL.
+ * @param key Key to fill, already masked. Can't be NULL.
+ * @param mask Mask to fill. Can't be NULL.
+ * @param flags Tuple flags to fill, see @ref bf_tss_tuple_flag . Can't be
+ *        NULL.
+ * @return 0 on success, or @c -ENOTSUP if the rule can't be classified. No
+ *         error is logged, as this function is used to find out which rules
+ *         can be classified.
+ */
+int bf_tss_rule_encode(const struct bf_rule *rule, struct bf_tss_key *key,
+                       struct bf_tss_key *mask, uint32_t *flags);
+
+/**
+ * Add a rule to its tuple, create the tuple if it doesn't exist.
+ *
+ * Rules must be added by increasing priority: new tuples are added at the end
+ * of @p tuples , so the tuples are sorted by increasing
+ * @ref bf_tss_tuple::min_priority .
+ *
+ * @param tuples List of @ref bf_tss_tuple to add the rule to. Can't be NULL.
+ * @param rule Rule to add, its index is used as priority. Can't be NULL.
+ * @param counter Index of the rule's counters in the counters map.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_tss_add_rule(bf_list *tuples, const struct bf_rule *rule,
+                    uint32_t counter);
+
+/**
+ * Generate a classifier for a run of rules of the chain currently generated.
+ *
+ * Starting from @p rule_node , the longest run of consecutive rules that can
+ * be classified (see @ref bf_tss_rule_encode ) is grouped into tuples, each
+ * tuple is stored in its own hash map. The generated bytecode probes the
+ * tuples by increasing priority of their first rule, and stops as soon as the
+ * best rule found has a lower priority than the next tuple's first rule. If a
+ * rule matches, its counters are updated and its verdict is applied,
+ * otherwise the packet continues with the rule following the run.
+ *
+ * @param program Program to generate the bytecode for. Can't be NULL.
+ * @param rule_node Node of the first rule of the run. Can't be NULL.
+ * @param n_rules On success, contains the number of rules replaced by the
+ *        classifier, or 0 if the run is too short to be classified, in which
+ *        case nothing is generated. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_tss_generate(struct bf_program *program, const bf_list_node *rule_node,
+                    size_t *n_rules);
+
+/**
+ * Create the maps of the program's classifiers and add the rules of each
+ * tuple into its map.
+ *
+ * @param program Program to create the tuples' maps for. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. On failure, the
+ *         tuples' maps are destroyed.
+ */
+int bf_tss_load_maps(struct bf_program *program);
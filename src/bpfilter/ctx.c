@@ -65,23 +65,30 @@ static struct bf_cgen *_bf_ctx_get_xdp_cgen(const bf_list *list,
 /**
  * Get the requested BF_HOOK_NF_* codegen from the list.
  *
- * There can be only one codegen defined for each BF_HOOK_NF_* hook, so we
- * return the first of the list, if defined.
+ * Multiple codegens can be defined for each BF_HOOK_NF_* hook, as long as
+ * their chains have a different priority: use @c opts->priority to find the
+ * expected codegen.
  *
  * @param list List containing all the BF_HOOK_NF_* codegens. Can't be NULL.
- * @param opts Unused.
+ * @param opts Hook options, @c opts->priority is used to find the correct
+ *        codegen. If NULL, the codegen with priority 0 is returned.
  * @return The requested codegen, or NULL if not found.
  */
 static struct bf_cgen *_bf_ctx_get_nf_cgen(const bf_list *list,
                                            const struct bf_hook_opts *opts)
 {
-    UNUSED(opts);
-    struct bf_list_node *node;
+    int32_t priority = opts ? opts->priority : 0;
 
     bf_assert(list);
 
-    node = bf_list_get_head(list);
-    return node ? bf_list_node_get_data(node) : NULL;
+    bf_list_foreach (list, cgen_node) {
+        struct bf_cgen *cgen = bf_list_node_get_data(cgen_node);
+
+        if (cgen->chain->hook_opts.priority == priority)
+            return cgen;
+    }
+
+    return NULL;
 }
 
 static struct bf_cgen *_bf_ctx_get_cgroup_cgen(const bf_list *list,
@@ -109,6 +116,10 @@ static struct bf_cgen *(*_bf_cgen_getters[])(
     [BF_HOOK_NF_LOCAL_OUT] = _bf_ctx_get_nf_cgen,
     [BF_HOOK_NF_POST_ROUTING] = _bf_ctx_get_nf_cgen,
     [BF_HOOK_TC_EGRESS] = _bf_ctx_get_xdp_cgen,
+    [BF_HOOK_CGROUP_INET4_CONNECT] = _bf_ctx_get_cgroup_cgen,
+    [BF_HOOK_CGROUP_INET6_CONNECT] = _bf_ctx_get_cgroup_cgen,
+    [BF_HOOK_CGROUP_UDP4_SENDMSG] = _bf_ctx_get_cgroup_cgen,
+    [BF_HOOK_CGROUP_UDP6_SENDMSG] = _bf_ctx_get_cgroup_cgen,
 };
 
 static_assert(ARRAY_SIZE(_bf_cgen_getters) == _BF_HOOK_MAX,
@@ -327,17 +338,80 @@ static int _bf_ctx_get_cgens_for_front(const struct bf_ctx *ctx, bf_list *cgens,
     return 0;
 }
 
+/**
+ * See @ref bf_ctx_get_cgens_for_hook for details.
+ */
+static int _bf_ctx_get_cgens_for_hook(const struct bf_ctx *ctx, bf_list *cgens,
+                                      enum bf_hook hook)
+{
+    _clean_bf_list_ bf_list _cgens = bf_list_default(NULL, bf_cgen_marsh);
+    int r;
+
+    bf_assert(ctx && cgens);
+
+    bf_list_foreach (&ctx->cgens[hook], cgen_node) {
+        r = bf_list_add_tail(&_cgens, bf_list_node_get_data(cgen_node));
+        if (r)
+            return bf_err_r(r, "failed to insert codegen into list");
+    }
+
+    *cgens = bf_list_move(_cgens);
+
+    return 0;
+}
+
 /**
  * See @ref bf_ctx_set_cgen for details.
  */
 static int _bf_ctx_set_cgen(struct bf_ctx *ctx, struct bf_cgen *cgen)
 {
+    bf_list *list;
+
     bf_assert(ctx && cgen);
 
     if (_bf_ctx_get_cgen(ctx, cgen->chain->hook, &cgen->chain->hook_opts))
         return bf_err_r(-EEXIST, "codegen already exists in context");
 
-    return bf_list_add_tail(&ctx->cgens[cgen->chain->hook], cgen);
+    list = &ctx->cgens[cgen->chain->hook];
+
+    // Netfilter codegens are sorted by priority: they are compiled in order.
+    if (bf_hook_is_nf(cgen->chain->hook)) {
+        int32_t priority = cgen->chain->hook_opts.priority;
+
+        bf_list_foreach (list, cgen_node) {
+            struct bf_cgen *cur = bf_list_node_get_data(cgen_node);
+
+            if (cur->chain->hook_opts.priority > priority)
+                return bf_list_add_before(list, cgen_node, cgen);
+        }
+    }
+
+    return bf_list_add_tail(list, cgen);
+}
+
+/**
+ * See @ref bf_ctx_unset_cgen for details.
+ */
+static int _bf_ctx_unset_cgen(struct bf_ctx *ctx, struct bf_cgen *cgen)
+{
+    bf_list *list;
+
+    bf_assert(ctx && cgen);
+
+    list = &ctx->cgens[cgen->chain->hook];
+
+    bf_list_foreach (list, cgen_node) {
+        if (bf_list_node_get_data(cgen_node) != cgen)
+            continue;
+
+        // The caller owns the codegen again, it must not be freed.
+        bf_list_node_take_data(cgen_node);
+        bf_list_delete(list, cgen_node);
+
+        return 0;
+    }
+
+    return -ENOENT;
 }
 
 int bf_ctx_setup(void)
@@ -461,7 +535,17 @@ int bf_ctx_get_cgens_for_front(bf_list *cgens, enum bf_front front)
     return _bf_ctx_get_cgens_for_front(_bf_global_ctx, cgens, front);
 }
 
+int bf_ctx_get_cgens_for_hook(bf_list *cgens, enum bf_hook hook)
+{
+    return _bf_ctx_get_cgens_for_hook(_bf_global_ctx, cgens, hook);
+}
+
 int bf_ctx_set_cgen(struct bf_cgen *cgen)
 {
     return _bf_ctx_set_cgen(_bf_global_ctx, cgen);
 }
+
+int bf_ctx_unset_cgen(struct bf_cgen *cgen)
+{
+    return _bf_ctx_unset_cgen(_bf_global_ctx, cgen);
+}
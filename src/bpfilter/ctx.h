@@ -116,12 +116,42 @@ struct bf_cgen *bf_ctx_get_cgen(enum bf_hook hook,
  */
 int bf_ctx_get_cgens_for_front(bf_list *cgens, enum bf_front front);
 
+/**
+ * Get the list of @ref bf_cgen defined for a given @p hook .
+ *
+ * The codegens are returned in the order they are stored in the context:
+ * codegens defined for a Netfilter hook are sorted by priority. The @p cgens
+ * list returned to the caller does not own the codegens.
+ *
+ * @param cgens List of @ref bf_cgen to fill. The list will be initialised by
+ *        this function. Can't be NULL. On failure, @p cgens is left unchanged.
+ * @param hook Hook to get the list of @ref bf_cgen for.
+ * @return 0 on success, or negative errno value on failure.
+ */
+int bf_ctx_get_cgens_for_hook(bf_list *cgens, enum bf_hook hook);
+
 /**
  * Add a codegen to the global context.
  *
  * @param cgen Codegen to add to the context. Can't be NULL.
  * @return 0 on success, or a negative errno value on failure. If a similar
  *         codegen already exists (criteria defining what "similar" means
- *         depend on the hook), @c -EEXIT is returned.
+ *         depend on the hook), @c -EEXIT is returned. Codegens defined
+ *         for a Netfilter hook are similar if their chains have the same
+ *         priority.
  */
 int bf_ctx_set_cgen(struct bf_cgen *cgen);
+
+/**
+ * Remove a codegen from the global context, without freeing it.
+ *
+ * Codegens are added to the context before their program is generated, so
+ * the program can be shared with the other codegens of the hook (see
+ * @ref bf_cgen_up ). This function removes such a codegen if its program
+ * can't be generated.
+ *
+ * @param cgen Codegen to remove from the context. Can't be NULL. On success,
+ *        the caller owns @p cgen .
+ * @return 0 on success, or @c -ENOENT if @p cgen is not part of the context.
+ */
+int bf_ctx_unset_cgen(struct bf_cgen *cgen);
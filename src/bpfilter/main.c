@@ -4,6 +4,7 @@
  */
 
 #include <errno.h>
+#include <poll.h>
 #include <signal.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -11,6 +12,7 @@
 #include <unistd.h>
 
 #include "bpfilter/ctx.h"
+#include "bpfilter/metrics.h"
 #include "bpfilter/xlate/front.h"
 #include "core/btf.h"
 #include "core/dump.h"
@@ -20,6 +22,7 @@
 #include "core/logger.h"
 #include "core/marsh.h"
 #include "core/opts.h"
+#include "core/phase.h"
 #include "core/request.h"
 #include "core/response.h"
 
@@ -140,6 +143,8 @@ static int _bf_load(const char *path)
 static int _bf_save(const char *path)
 {
     _cleanup_free_ struct bf_marsh *marsh = NULL;
+    _cleanup_bf_phase_timer_ struct bf_phase_timer _ =
+        bf_phase_timer_start(BF_PHASE_SAVE);
     int r;
 
     bf_assert(path);
@@ -216,6 +221,8 @@ static int _bf_save(const char *path)
 static int _bf_init(int argc, char *argv[])
 {
     struct sigaction sighandler = {.sa_handler = _bf_sig_handler};
+    uint64_t start_ns = bf_phase_now_ns();
+    uint64_t restore_ns = 0;
     int r = 0;
 
     if (sigaction(SIGINT, &sighandler, NULL) < 0)
@@ -228,15 +235,23 @@ static int _bf_init(int argc, char *argv[])
     if (r < 0)
         return bf_err_r(r, "failed to parse command line arguments");
 
+    if (bf_opts_log_async()) {
+        r = bf_logger_start_async();
+        if (r < 0)
+            return bf_err_r(r, "failed to start the asynchronous logger");
+    }
+
     r = bf_ensure_dir(BF_RUNTIME_DIR);
     if (r)
         return bf_err_r(r, "failed to ensure runtime directory exists");
 
     // Either load context, or initialize it from scratch.
     if (!bf_opts_transient()) {
+        restore_ns = bf_phase_now_ns();
         r = _bf_load(ctx_path);
         if (r < 0)
             return bf_err_r(r, "failed to restore bpfilter context");
+        restore_ns = bf_phase_now_ns() - restore_ns;
     }
 
     if (bf_opts_transient() || r == 0) {
@@ -267,6 +282,16 @@ static int _bf_init(int argc, char *argv[])
         }
     }
 
+    if (bf_opts_metrics()) {
+        r = bf_metrics_setup();
+        if (r < 0)
+            return bf_err_r(r, "failed to setup metrics socket");
+    }
+
+    // Same format as the request timings, see _bf_log_timings().
+    bf_info("startup timings: restore_ns=%lu total_ns=%lu", restore_ns,
+            bf_phase_now_ns() - start_ns);
+
     return 0;
 }
 
@@ -279,6 +304,8 @@ static int _bf_clean(void)
 {
     int r;
 
+    bf_metrics_teardown();
+
     for (enum bf_front front = 0; front < _BF_FRONT_MAX; ++front) {
         if (!bf_opts_is_front_enabled(front))
             continue;
@@ -298,6 +325,41 @@ static int _bf_clean(void)
     return 0;
 }
 
+/**
+ * Log the time spent in each control-plane phase to process a request.
+ *
+ * The durations are logged at debug level, as a single line of @c key=value
+ * pairs, so they can be parsed easily. Nothing is logged if no phase has been
+ * timed.
+ *
+ * @param request Request the durations are for. Can't be NULL.
+ * @param timings Duration of each phase, in nanoseconds, indexed by
+ *        @ref bf_phase . Can't be NULL.
+ */
+static void _bf_log_timings(const struct bf_request *request,
+                            const uint64_t *timings)
+{
+    char buf[256];
+    size_t len = 0;
+    uint64_t total = 0;
+
+    bf_assert(request && timings);
+
+    for (int i = 0; i < _BF_PHASE_MAX; ++i) {
+        total += timings[i];
+        len += snprintf(buf + len, sizeof(buf) - len, " %s_ns=%lu",
+                        bf_phase_to_str(i), timings[i]);
+        if (len >= sizeof(buf))
+            break;
+    }
+
+    if (!total)
+        return;
+
+    bf_dbg("request timings: front=%s cmd=%d total_ns=%lu%s",
+           bf_front_to_str(request->front), request->cmd, total, buf);
+}
+
 /**
  * Process a request.
  *
@@ -320,6 +382,8 @@ static int _bf_process_request(struct bf_request *request,
                                struct bf_response **response)
 {
     const struct bf_front_ops *ops;
+    uint64_t timings[_BF_PHASE_MAX];
+    uint64_t start_ns = bf_phase_now_ns();
     int r;
 
     bf_assert(request);
@@ -333,6 +397,8 @@ static int _bf_process_request(struct bf_request *request,
 
     bf_info("received a request from %s", bf_front_to_str(request->front));
 
+    bf_phase_reset();
+
     ops = bf_front_ops_get(request->front);
     r = ops->request_handler(request, response);
     if (r) {
@@ -343,20 +409,40 @@ static int _bf_process_request(struct bf_request *request,
     }
 
     if (!bf_opts_transient() && (request->cmd == BF_REQ_RULESET_FLUSH ||
-                                 request->cmd == BF_REQ_RULES_SET))
+                                 request->cmd == BF_REQ_RULES_SET ||
+                                 request->cmd == BF_REQ_RULES_PATCH))
         r = _bf_save(ctx_path);
 
+    if (!*response)
+        return r;
+
+    bf_phase_get(timings);
+    _bf_log_timings(request, timings);
+    bf_metrics_record_request(request->front,
+                              (*response)->type == BF_RES_FAILURE,
+                              bf_phase_now_ns() - start_ns, timings);
+
+    // The response isn't sent back if r is non-zero.
+    if (!r && request->flags & BF_REQ_FLAG_TIMINGS &&
+        (*response)->type == BF_RES_SUCCESS) {
+        r = bf_response_add_timings(response, timings);
+        if (r)
+            return bf_err_r(r, "failed to add timings to the response");
+    }
+
     return r;
 }
 
 /**
  * Loop and process requests.
  *
- * Create a socket and perform blocking accept() calls. For each connection,
- * receive a request, process it, and send the response back.
+ * Create a socket and wait for connections with poll(). For each connection,
+ * receive a request, process it, and send the response back. If the metrics
+ * socket is enabled, its events are served in the same loop, without
+ * blocking (see @ref bf_metrics_serve ).
  *
  * If a signal is received, @ref _bf_stop_received will be set to 1 by @ref
- * _bf_sig_handler and blocking call to `accept()` will be interrupted.
+ * _bf_sig_handler and blocking call to `poll()` will be interrupted.
  *
  * @return 0 on success, negative error code on failure.
  */
@@ -388,6 +474,30 @@ static int _bf_run(void)
         _cleanup_close_ int client_fd = -1;
         _cleanup_bf_request_ struct bf_request *request = NULL;
         _cleanup_bf_response_ struct bf_response *response = NULL;
+        struct pollfd fds[] = {
+            {.fd = fd, .events = POLLIN},
+            {.fd = bf_metrics_get_fd(), .events = POLLIN},
+        };
+
+        // poll() ignores negative file descriptors: metrics can be disabled.
+        r = poll(fds, ARRAY_SIZE(fds), -1);
+        if (r < 0) {
+            if (_bf_stop_received) {
+                bf_info("received stop signal, exiting...");
+                continue;
+            }
+
+            if (errno == EINTR)
+                continue;
+
+            return bf_err_r(errno, "failed to wait for connections");
+        }
+
+        if (fds[1].revents & POLLIN)
+            bf_metrics_serve();
+
+        if (!(fds[0].revents & POLLIN))
+            continue;
 
         client_fd = accept(fd, NULL, NULL);
         if (client_fd < 0) {
@@ -440,5 +550,7 @@ int main(int argc, char *argv[])
 
     unlink(BF_SOCKET_PATH); // Remove socket file.
 
+    bf_logger_teardown();
+
     return r;
 }
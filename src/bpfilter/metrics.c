@@ -0,0 +1,660 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "bpfilter/metrics.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "bpfilter/cgen/cgen.h"
+#include "bpfilter/ctx.h"
+#include "core/chain.h"
+#include "core/counter.h"
+#include "core/helper.h"
+#include "core/hook.h"
+#include "core/io.h"
+#include "core/list.h"
+#include "core/logger.h"
+#include "core/phase.h"
+#include "core/rule.h"
+#include "core/set.h"
+#include "core/telemetry.h"
+
+/// Upper bound of each bucket of the requests latency histograms, in ns.
+static const uint64_t _bf_metrics_buckets_ns[BF_METRICS_N_BUCKETS] = {
+    1000000ULL,   5000000ULL,   10000000ULL,  25000000ULL,   50000000ULL,
+    100000000ULL, 250000000ULL, 500000000ULL, 1000000000ULL, 5000000000ULL,
+};
+
+/**
+ * Requests statistics of a front.
+ */
+struct bf_metrics_requests
+{
+    /// Number of requests in each bucket (not cumulative).
+    uint64_t buckets[BF_METRICS_N_BUCKETS];
+    /// Total number of requests.
+    uint64_t count;
+    /// Number of failed requests.
+    uint64_t failures;
+    /// Total time spent processing the requests, in nanoseconds.
+    uint64_t sum_ns;
+};
+
+/**
+ * Metrics client, which hasn't received the whole statistics yet.
+ */
+struct bf_metrics_client
+{
+    int fd;
+    char *buf;
+    size_t len;
+    size_t off;
+};
+
+static struct bf_metrics_requests _bf_metrics_requests[_BF_FRONT_MAX];
+
+/// Total time spent in each control-plane phase, in nanoseconds.
+static uint64_t _bf_metrics_phases_ns[_BF_PHASE_MAX];
+
+static int _bf_metrics_sock_fd = -1;
+static int _bf_metrics_epoll_fd = -1;
+static struct bf_metrics_client _bf_metrics_clients[BF_METRICS_MAX_CLIENTS];
+
+void bf_metrics_record_request(enum bf_front front, bool failed,
+                               uint64_t duration_ns, const uint64_t *timings)
+{
+    struct bf_metrics_requests *requests;
+
+    bf_assert(0 <= front && front < _BF_FRONT_MAX);
+    bf_assert(timings);
+
+    requests = &_bf_metrics_requests[front];
+
+    for (size_t i = 0; i < BF_METRICS_N_BUCKETS; ++i) {
+        if (duration_ns <= _bf_metrics_buckets_ns[i]) {
+            ++requests->buckets[i];
+            break;
+        }
+    }
+
+    ++requests->count;
+    requests->sum_ns += duration_ns;
+    if (failed)
+        ++requests->failures;
+
+    for (size_t i = 0; i < _BF_PHASE_MAX; ++i)
+        _bf_metrics_phases_ns[i] += timings[i];
+}
+
+/**
+ * Statistics of a codegen, collected before the metrics are written, as
+ * OpenMetrics requires all the samples of a metric to be contiguous.
+ */
+struct bf_metrics_chain
+{
+    const struct bf_cgen *cgen;
+    /// Rules counters followed by the policy counter, NULL if unavailable.
+    struct bf_counter *counters;
+    size_t n_counters;
+    struct bf_prog_stats stats;
+    bool has_stats;
+};
+
+struct bf_metrics_snapshot
+{
+    struct bf_metrics_chain *chains;
+    size_t n_chains;
+};
+
+#define _clean_bf_metrics_snapshot_                                            \
+    __attribute__((cleanup(_bf_metrics_snapshot_clean)))
+
+static void _bf_metrics_snapshot_clean(struct bf_metrics_snapshot *snapshot)
+{
+    for (size_t i = 0; i < snapshot->n_chains; ++i)
+        freep((void *)&snapshot->chains[i].counters);
+
+    freep((void *)&snapshot->chains);
+    snapshot->n_chains = 0;
+}
+
+static int _bf_metrics_snapshot_add(struct bf_metrics_snapshot *snapshot,
+                                    const struct bf_cgen *cgen)
+{
+    struct bf_metrics_chain *chains;
+    struct bf_metrics_chain *chain;
+    int r;
+
+    chains = reallocarray(snapshot->chains, snapshot->n_chains + 1,
+                          sizeof(*chains));
+    if (!chains)
+        return -ENOMEM;
+
+    snapshot->chains = chains;
+    chain = &chains[snapshot->n_chains++];
+    *chain = (struct bf_metrics_chain) {.cgen = cgen};
+
+    // A codegen without program has no statistics, but its sets are known.
+    r = bf_cgen_get_counters(cgen, &chain->counters, &chain->n_counters);
+    if (r)
+        bf_dbg("no counters available for the metrics, skipping");
+
+    chain->has_stats = bf_cgen_get_stats(cgen, &chain->stats) == 0;
+
+    return 0;
+}
+
+static int _bf_metrics_snapshot_init(struct bf_metrics_snapshot *snapshot)
+{
+    int r;
+
+    for (enum bf_front front = 0; front < _BF_FRONT_MAX; ++front) {
+        _clean_bf_list_ bf_list cgens = bf_list_default(NULL, NULL);
+
+        r = bf_ctx_get_cgens_for_front(&cgens, front);
+        if (r)
+            return bf_err_r(r, "failed to collect codegens for %s",
+                            bf_front_to_str(front));
+
+        bf_list_foreach (&cgens, cgen_node) {
+            r = _bf_metrics_snapshot_add(snapshot,
+                                         bf_list_node_get_data(cgen_node));
+            if (r)
+                return r;
+        }
+    }
+
+    return 0;
+}
+
+static void _bf_metrics_write_family(FILE *file, const char *name,
+                                     const char *type, const char *unit,
+                                     const char *help)
+{
+    (void)fprintf(file, "# TYPE %s %s\n", name, type);
+    if (unit)
+        (void)fprintf(file, "# UNIT %s %s\n", name, unit);
+    (void)fprintf(file, "# HELP %s %s\n", name, help);
+}
+
+static void _bf_metrics_write_str(FILE *file, const char *str)
+{
+    for (; *str; ++str) {
+        if (*str == '\\' || *str == '"')
+            (void)fputc('\\', file);
+
+        if (*str == '\n')
+            (void)fputs("\\n", file);
+        else
+            (void)fputc(*str, file);
+    }
+}
+
+static void _bf_metrics_write_seconds(FILE *file, uint64_t ns)
+{
+    (void)fprintf(file, "%lu.%09lu", ns / 1000000000UL, ns % 1000000000UL);
+}
+
+/**
+ * Write the labels identifying a codegen's chain: its front, hook, and hook
+ * options.
+ */
+static void _bf_metrics_write_chain_labels(FILE *file,
+                                           const struct bf_cgen *cgen)
+{
+    const struct bf_hook_opts *opts = &cgen->chain->hook_opts;
+
+    (void)fprintf(file, "front=\"%s\",hook=\"%s\"",
+                  bf_front_to_str(cgen->front),
+                  bf_hook_to_str(cgen->chain->hook));
+
+    if (opts->used_opts & (1 << BF_HOOK_OPT_IFINDEX))
+        (void)fprintf(file, ",ifindex=\"%u\"", opts->ifindex);
+
+    if (opts->used_opts & (1 << BF_HOOK_OPT_CGROUP)) {
+        (void)fputs(",cgroup=\"", file);
+        _bf_metrics_write_str(file, opts->cgroup);
+        (void)fputc('"', file);
+    }
+
+    if (opts->used_opts & (1 << BF_HOOK_OPT_NAME)) {
+        (void)fputs(",name=\"", file);
+        _bf_metrics_write_str(file, opts->name);
+        (void)fputc('"', file);
+    }
+}
+
+static void _bf_metrics_write_requests(FILE *file)
+{
+    const char *hist = "bpfilter_request_duration_seconds";
+
+    _bf_metrics_write_family(file, "bpfilter_requests_failed", "counter", NULL,
+                             "Number of requests which failed.");
+    for (enum bf_front front = 0; front < _BF_FRONT_MAX; ++front) {
+        (void)fprintf(file,
+                      "bpfilter_requests_failed_total{front=\"%s\"} %lu\n",
+                      bf_front_to_str(front),
+                      _bf_metrics_requests[front].failures);
+    }
+
+    _bf_metrics_write_family(file, hist, "histogram", "seconds",
+                             "Time spent processing requests.");
+    for (enum bf_front front = 0; front < _BF_FRONT_MAX; ++front) {
+        const struct bf_metrics_requests *requests =
+            &_bf_metrics_requests[front];
+        const char *front_str = bf_front_to_str(front);
+        uint64_t count = 0;
+
+        for (size_t i = 0; i < BF_METRICS_N_BUCKETS; ++i) {
+            count += requests->buckets[i];
+            (void)fprintf(file, "%s_bucket{front=\"%s\",le=\"", hist,
+                          front_str);
+            _bf_metrics_write_seconds(file, _bf_metrics_buckets_ns[i]);
+            (void)fprintf(file, "\"} %lu\n", count);
+        }
+
+        (void)fprintf(file, "%s_bucket{front=\"%s\",le=\"+Inf\"} %lu\n", hist,
+                      front_str, requests->count);
+        (void)fprintf(file, "%s_sum{front=\"%s\"} ", hist, front_str);
+        _bf_metrics_write_seconds(file, requests->sum_ns);
+        (void)fprintf(file, "\n%s_count{front=\"%s\"} %lu\n", hist, front_str,
+                      requests->count);
+    }
+
+    _bf_metrics_write_family(
+        file, "bpfilter_phase_duration_seconds", "counter", "seconds",
+        "Time spent in each control-plane phase, see bf_phase.");
+    for (enum bf_phase phase = 0; phase < _BF_PHASE_MAX; ++phase) {
+        (void)fprintf(file,
+                      "bpfilter_phase_duration_seconds_total{phase=\"%s\"} ",
+                      bf_phase_to_str(phase));
+        _bf_metrics_write_seconds(file, _bf_metrics_phases_ns[phase]);
+        (void)fputc('\n', file);
+    }
+}
+
+static void _bf_metrics_write_counters(FILE *file,
+                                       const struct bf_metrics_snapshot *snap,
+                                       const char *metric, bool bytes)
+{
+    for (size_t i = 0; i < snap->n_chains; ++i) {
+        const struct bf_metrics_chain *chain = &snap->chains[i];
+        size_t rule_idx = 0;
+
+        if (!chain->counters)
+            continue;
+
+        bf_list_foreach (&chain->cgen->chain->rules, rule_node) {
+            const struct bf_rule *rule = bf_list_node_get_data(rule_node);
+            const struct bf_counter *counter = &chain->counters[rule_idx++];
+
+            if (!rule->counters)
+                continue;
+
+            (void)fprintf(file, "%s_total{", metric);
+            _bf_metrics_write_chain_labels(file, chain->cgen);
+            (void)fprintf(file, ",rule=\"%u\"} %lu\n", rule->handle,
+                          bytes ? counter->bytes : counter->packets);
+        }
+
+        (void)fprintf(file, "%s_total{", metric);
+        _bf_metrics_write_chain_labels(file, chain->cgen);
+        (void)fprintf(file, ",rule=\"policy\"} %lu\n",
+                      bytes ? chain->counters[chain->n_counters - 1].bytes :
+                              chain->counters[chain->n_counters - 1].packets);
+    }
+}
+
+static void _bf_metrics_write_rules(FILE *file,
+                                    const struct bf_metrics_snapshot *snap)
+{
+    _bf_metrics_write_family(
+        file, "bpfilter_rule_packets", "counter", NULL,
+        "Number of packets matched by each rule, and by the chain's policy.");
+    _bf_metrics_write_counters(file, snap, "bpfilter_rule_packets", false);
+
+    _bf_metrics_write_family(
+        file, "bpfilter_rule_bytes", "counter", "bytes",
+        "Number of bytes matched by each rule, and by the chain's policy.");
+    _bf_metrics_write_counters(file, snap, "bpfilter_rule_bytes", true);
+}
+
+/**
+ * Write one of the programs' statistics.
+ *
+ * @param offset Offset of the statistic in @ref bf_prog_stats , either a
+ *        @c uint32_t or a @c uint64_t depending on @p is_u64 .
+ */
+static void _bf_metrics_write_prog_stat(FILE *file,
+                                        const struct bf_metrics_snapshot *snap,
+                                        const char *sample, size_t offset,
+                                        bool is_u64, bool is_ns)
+{
+    for (size_t i = 0; i < snap->n_chains; ++i) {
+        const struct bf_metrics_chain *chain = &snap->chains[i];
+        const char *stat = (const char *)&chain->stats + offset;
+        uint64_t value;
+
+        if (!chain->has_stats)
+            continue;
+
+        value = is_u64 ? *(const uint64_t *)stat : *(const uint32_t *)stat;
+
+        (void)fprintf(file, "%s{", sample);
+        _bf_metrics_write_chain_labels(file, chain->cgen);
+        (void)fprintf(file, ",prog_id=\"%u\"} ", chain->stats.id);
+        if (is_ns)
+            _bf_metrics_write_seconds(file, value);
+        else
+            (void)fprintf(file, "%lu", value);
+        (void)fputc('\n', file);
+    }
+}
+
+static void _bf_metrics_write_programs(FILE *file,
+                                       const struct bf_metrics_snapshot *snap)
+{
+    _bf_metrics_write_family(
+        file, "bpfilter_program_runs", "counter", NULL,
+        "Number of times the program ran, if kernel.bpf_stats_enabled is set.");
+    _bf_metrics_write_prog_stat(file, snap, "bpfilter_program_runs_total",
+                                offsetof(struct bf_prog_stats, run_cnt), true,
+                                false);
+
+    _bf_metrics_write_family(
+        file, "bpfilter_program_run_seconds", "counter", "seconds",
+        "Time spent running the program, if kernel.bpf_stats_enabled is set.");
+    _bf_metrics_write_prog_stat(file, snap,
+                                "bpfilter_program_run_seconds_total",
+                                offsetof(struct bf_prog_stats, run_time_ns),
+                                true, true);
+
+    _bf_metrics_write_family(file, "bpfilter_program_instructions", "gauge",
+                             NULL, "Number of instructions of the program.");
+    _bf_metrics_write_prog_stat(file, snap, "bpfilter_program_instructions",
+                                offsetof(struct bf_prog_stats, n_insns), false,
+                                false);
+
+    _bf_metrics_write_family(
+        file, "bpfilter_program_verified_instructions", "gauge", NULL,
+        "Number of instructions processed by the verifier.");
+    _bf_metrics_write_prog_stat(file, snap,
+                                "bpfilter_program_verified_instructions",
+                                offsetof(struct bf_prog_stats, verified_insns),
+                                false, false);
+
+    _bf_metrics_write_family(file, "bpfilter_program_jited_bytes", "gauge",
+                             "bytes", "Size of the JITed program.");
+    _bf_metrics_write_prog_stat(file, snap, "bpfilter_program_jited_bytes",
+                                offsetof(struct bf_prog_stats, jited_size),
+                                false, false);
+
+    _bf_metrics_write_family(file, "bpfilter_program_maps_bytes", "gauge",
+                             "bytes",
+                             "Estimated memory used by the program's maps.");
+    _bf_metrics_write_prog_stat(file, snap, "bpfilter_program_maps_bytes",
+                                offsetof(struct bf_prog_stats, maps_size), true,
+                                false);
+}
+
+static void _bf_metrics_write_sets(FILE *file,
+                                   const struct bf_metrics_snapshot *snap)
+{
+    _bf_metrics_write_family(
+        file, "bpfilter_set_elements", "gauge", NULL,
+        "Number of elements defined in each set, excluding the elements added "
+        "by the rules to a dynamic set.");
+
+    for (size_t i = 0; i < snap->n_chains; ++i) {
+        const struct bf_metrics_chain *chain = &snap->chains[i];
+        size_t set_idx = 0;
+
+        bf_list_foreach (&chain->cgen->chain->sets, set_node) {
+            const struct bf_set *set = bf_list_node_get_data(set_node);
+
+            (void)fputs("bpfilter_set_elements{", file);
+            _bf_metrics_write_chain_labels(file, chain->cgen);
+            (void)fprintf(file, ",set=\"%lu\"} %lu\n", set_idx++,
+                          bf_list_size(&set->elems));
+        }
+    }
+}
+
+static void _bf_metrics_write_memory(FILE *file)
+{
+    FILE *statm;
+    unsigned long size;
+    unsigned long resident;
+    int r;
+
+    statm = fopen("/proc/self/statm", "r");
+    if (!statm) {
+        bf_warn_r(errno, "failed to open /proc/self/statm, skipping");
+        return;
+    }
+
+    r = fscanf(statm, "%lu %lu", &size, &resident);
+    (void)fclose(statm);
+    if (r != 2) {
+        bf_warn("failed to read the daemon's memory usage, skipping");
+        return;
+    }
+
+    _bf_metrics_write_family(file, "bpfilter_daemon_resident_memory_bytes",
+                             "gauge", "bytes",
+                             "Resident memory of the daemon.");
+    (void)fprintf(file, "bpfilter_daemon_resident_memory_bytes %lu\n",
+                  resident * (unsigned long)sysconf(_SC_PAGESIZE));
+}
+
+int bf_metrics_write(FILE *file)
+{
+    _clean_bf_metrics_snapshot_ struct bf_metrics_snapshot snapshot = {};
+    int r;
+
+    bf_assert(file);
+
+    r = _bf_metrics_snapshot_init(&snapshot);
+    if (r)
+        return r;
+
+    _bf_metrics_write_requests(file);
+    _bf_metrics_write_rules(file, &snapshot);
+    _bf_metrics_write_programs(file, &snapshot);
+    _bf_metrics_write_sets(file, &snapshot);
+    _bf_metrics_write_memory(file);
+    (void)fputs("# EOF\n", file);
+
+    return ferror(file) ? -EIO : 0;
+}
+
+static void _bf_metrics_client_close(struct bf_metrics_client *client)
+{
+    if (client->fd >= 0) {
+        (void)epoll_ctl(_bf_metrics_epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+        closep(&client->fd);
+    }
+
+    freep((void *)&client->buf);
+    client->len = 0;
+    client->off = 0;
+}
+
+/**
+ * Send the remaining statistics to a client, without blocking.
+ *
+ * The client is closed once all the statistics have been sent, or on error.
+ */
+static void _bf_metrics_client_send(struct bf_metrics_client *client)
+{
+    while (client->off < client->len) {
+        ssize_t n = send(client->fd, client->buf + client->off,
+                         client->len - client->off,
+                         MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+
+            bf_warn_r(errno, "failed to send metrics, closing connection");
+            break;
+        }
+
+        client->off += n;
+    }
+
+    _bf_metrics_client_close(client);
+}
+
+static void _bf_metrics_accept(void)
+{
+    while (true) {
+        _cleanup_close_ int fd = -1;
+        _cleanup_free_ char *buf = NULL;
+        struct bf_metrics_client *client = NULL;
+        struct epoll_event event;
+        FILE *file;
+        size_t len;
+        int r;
+
+        // The sends are non-blocking, see _bf_metrics_client_send().
+        fd = accept(_bf_metrics_sock_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                bf_warn_r(errno, "failed to accept metrics connection");
+            return;
+        }
+
+        for (size_t i = 0; i < BF_METRICS_MAX_CLIENTS; ++i) {
+            if (_bf_metrics_clients[i].fd < 0) {
+                client = &_bf_metrics_clients[i];
+                break;
+            }
+        }
+
+        if (!client) {
+            bf_warn("too many metrics clients, closing connection");
+            continue;
+        }
+
+        file = open_memstream(&buf, &len);
+        if (!file) {
+            bf_warn_r(errno, "failed to create metrics buffer");
+            continue;
+        }
+
+        r = bf_metrics_write(file);
+        if (fclose(file) || r) {
+            bf_warn_r(r ?: -EIO, "failed to write metrics");
+            continue;
+        }
+
+        event = (struct epoll_event) {.events = EPOLLOUT, .data.ptr = client};
+        r = epoll_ctl(_bf_metrics_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        if (r < 0) {
+            bf_warn_r(errno, "failed to register metrics client");
+            continue;
+        }
+
+        *client = (struct bf_metrics_client) {
+            .fd = TAKE_FD(fd),
+            .buf = TAKE_PTR(buf),
+            .len = len,
+        };
+
+        _bf_metrics_client_send(client);
+    }
+}
+
+int bf_metrics_setup(void)
+{
+    _cleanup_close_ int sock_fd = -1;
+    _cleanup_close_ int epoll_fd = -1;
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+
+    for (size_t i = 0; i < BF_METRICS_MAX_CLIENTS; ++i)
+        _bf_metrics_clients[i] = (struct bf_metrics_client) {.fd = -1};
+
+    sock_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock_fd < 0)
+        return bf_err_r(errno, "failed to create metrics socket");
+
+    strncpy(addr.sun_path, BF_METRICS_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+
+    // The socket file is left behind if the daemon didn't stop cleanly.
+    (void)unlink(BF_METRICS_SOCKET_PATH);
+
+    if (bind(sock_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        return bf_err_r(errno, "failed to bind metrics socket to %s",
+                        BF_METRICS_SOCKET_PATH);
+    }
+
+    if (listen(sock_fd, BF_METRICS_MAX_CLIENTS) < 0)
+        return bf_err_r(errno, "listen() failed for the metrics socket");
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0)
+        return bf_err_r(errno, "failed to create metrics epoll instance");
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock_fd, &event) < 0)
+        return bf_err_r(errno, "failed to register metrics socket");
+
+    _bf_metrics_sock_fd = TAKE_FD(sock_fd);
+    _bf_metrics_epoll_fd = TAKE_FD(epoll_fd);
+
+    bf_info("serving metrics on %s", BF_METRICS_SOCKET_PATH);
+
+    return 0;
+}
+
+void bf_metrics_teardown(void)
+{
+    if (_bf_metrics_sock_fd < 0)
+        return;
+
+    for (size_t i = 0; i < BF_METRICS_MAX_CLIENTS; ++i)
+        _bf_metrics_client_close(&_bf_metrics_clients[i]);
+
+    closep(&_bf_metrics_epoll_fd);
+    closep(&_bf_metrics_sock_fd);
+    (void)unlink(BF_METRICS_SOCKET_PATH);
+}
+
+int bf_metrics_get_fd(void)
+{
+    return _bf_metrics_epoll_fd;
+}
+
+void bf_metrics_serve(void)
+{
+    struct epoll_event events[BF_METRICS_MAX_CLIENTS + 1];
+    int n;
+
+    if (_bf_metrics_epoll_fd < 0)
+        return;
+
+    n = epoll_wait(_bf_metrics_epoll_fd, events, ARRAY_SIZE(events), 0);
+    if (n < 0) {
+        if (errno != EINTR)
+            bf_warn_r(errno, "failed to wait for metrics events");
+        return;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        struct bf_metrics_client *client = events[i].data.ptr;
+
+        if (!client)
+            _bf_metrics_accept();
+        else if (client->fd >= 0)
+            _bf_metrics_client_send(client);
+    }
+}
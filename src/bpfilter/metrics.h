@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "core/front.h"
+
+/**
+ * @file metrics.h
+ *
+ * Daemon statistics in the OpenMetrics text format. When the daemon is
+ * started with @c --metrics , it listens on @ref BF_METRICS_SOCKET_PATH in
+ * addition to the requests socket. Each connection to the metrics socket
+ * receives the current statistics, then the connection is closed.
+ *
+ * The metrics socket is served by the main loop, between requests, and never
+ * blocks: clients are accepted without blocking, and each client gets a
+ * snapshot of the statistics, sent as the client reads it. At most
+ * @ref BF_METRICS_MAX_CLIENTS clients can be served at once, other clients
+ * are disconnected.
+ */
+
+/// Maximum number of metrics clients served at once.
+#define BF_METRICS_MAX_CLIENTS 16
+
+/**
+ * Number of buckets of the requests latency histograms, excluding the
+ * @c +Inf bucket.
+ */
+#define BF_METRICS_N_BUCKETS 10
+
+/**
+ * Record the processing of a request.
+ *
+ * @param front Front the request was sent by. Must be valid.
+ * @param failed True if the request failed.
+ * @param duration_ns Time spent processing the request, in nanoseconds.
+ * @param timings Time spent in each control-plane phase, in nanoseconds,
+ *        indexed by @ref bf_phase . Can't be NULL.
+ */
+void bf_metrics_record_request(enum bf_front front, bool failed,
+                               uint64_t duration_ns, const uint64_t *timings);
+
+/**
+ * Write the daemon's statistics in the OpenMetrics text format.
+ *
+ * @param file File to write the statistics to. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_metrics_write(FILE *file);
+
+/**
+ * Create the metrics socket.
+ *
+ * The socket is bound to @ref BF_METRICS_SOCKET_PATH . The pending
+ * connections are tracked by an epoll instance, see @ref bf_metrics_get_fd .
+ *
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_metrics_setup(void);
+
+/**
+ * Close the metrics socket and the pending connections, and remove the
+ * socket file.
+ *
+ * Does nothing if @ref bf_metrics_setup hasn't been called.
+ */
+void bf_metrics_teardown(void);
+
+/**
+ * Get the file descriptor to poll for metrics events.
+ *
+ * The file descriptor is readable when a client connects to the metrics
+ * socket, or when a pending client can receive more data.
+ *
+ * @return File descriptor of the metrics epoll instance, or -1 if
+ *         @ref bf_metrics_setup hasn't been called.
+ */
+int bf_metrics_get_fd(void);
+
+/**
+ * Serve the pending metrics events, without blocking.
+ *
+ * New clients get a snapshot of the statistics, which is sent as the client
+ * reads it: a slow client doesn't delay the daemon. Failures are logged, but
+ * not reported to the caller: serving the metrics should never prevent the
+ * daemon from processing requests.
+ */
+void bf_metrics_serve(void);
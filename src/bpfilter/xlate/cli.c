@@ -4,18 +4,32 @@
  */
 
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "bpfilter/cgen/cgen.h"
+#include "bpfilter/cgen/program.h"
 #include "bpfilter/ctx.h"
 #include "bpfilter/xlate/front.h"
 #include "core/chain.h"
+#include "core/check.h"
+#include "core/counter.h"
 #include "core/front.h"
 #include "core/helper.h"
+#include "core/hook.h"
+#include "core/list.h"
 #include "core/logger.h"
 #include "core/marsh.h"
+#include "core/pcap.h"
+#include "core/phase.h"
 #include "core/request.h"
 #include "core/response.h"
+#include "core/rule.h"
+#include "core/set.h"
+#include "core/sim.h"
+#include "core/telemetry.h"
 
 static int _bf_cli_setup(void);
 static int _bf_cli_teardown(void);
@@ -61,6 +75,7 @@ int _bf_cli_set_rules(const struct bf_request *request,
 {
     _cleanup_bf_chain_ struct bf_chain *chain = NULL;
     struct bf_cgen *cgen;
+    bool changed = true;
     int r;
 
     bf_assert(request);
@@ -69,34 +84,583 @@ int _bf_cli_set_rules(const struct bf_request *request,
     if (request->data_len < sizeof(struct bf_marsh))
         return bf_response_new_failure(response, -EINVAL);
 
-    r = bf_chain_new_from_marsh(&chain, (void *)request->data);
+    {
+        _cleanup_bf_phase_timer_ struct bf_phase_timer _ =
+            bf_phase_timer_start(BF_PHASE_XLATE);
+
+        r = bf_chain_new_from_marsh(&chain, (void *)request->data);
+    }
     if (r)
         return bf_err_r(r, "failed to create chain from marsh");
 
     cgen = bf_ctx_get_cgen(chain->hook, &chain->hook_opts);
+    if (cgen && cgen->front != BF_FRONT_CLI) {
+        return bf_err_r(-EEXIST,
+                        "a %s chain with the same priority exists for %s",
+                        bf_front_to_str(cgen->front),
+                        bf_hook_to_str(chain->hook));
+    }
+
     if (!cgen) {
         r = bf_cgen_new(&cgen, BF_FRONT_CLI, &chain);
         if (r)
             return r;
 
-        r = bf_cgen_up(cgen);
+        /* The codegen is added to the context first, as its chain can be
+         * part of the program shared by the hook's codegens. */
+        r = bf_ctx_set_cgen(cgen);
         if (r < 0) {
             bf_cgen_free(&cgen);
-            return bf_err_r(r, "failed to generate and load new program");
+            return bf_err_r(r, "failed to store codegen in runtime context");
         }
 
-        r = bf_ctx_set_cgen(cgen);
+        r = bf_cgen_up(cgen);
         if (r < 0) {
+            (void)bf_ctx_unset_cgen(cgen);
             bf_cgen_free(&cgen);
-            return bf_err_r(r, "failed to store codegen in runtime context");
+            return bf_err_r(r, "failed to generate and load new program");
         }
+    } else if (bf_cgen_is_chain_current(cgen, chain)) {
+        bf_info("chain for %s is unchanged, skipping update",
+                bf_hook_to_str(chain->hook));
+        changed = false;
     } else {
         r = bf_cgen_update(cgen, &chain);
         if (r < 0)
             return bf_warn_r(r, "failed to update existing codegen");
     }
 
-    return bf_response_new_success(response, NULL, 0);
+    return bf_response_new_success(response, (const char *)&changed,
+                                   sizeof(changed));
+}
+
+int _bf_cli_patch_rules(const struct bf_request *request,
+                        struct bf_response **response)
+{
+    _cleanup_bf_chain_ struct bf_chain *chain = NULL;
+    _cleanup_bf_rule_ struct bf_rule *rule = NULL;
+    struct bf_marsh *marsh = (void *)request->data;
+    struct bf_marsh *child = NULL;
+    enum bf_chain_patch_op op;
+    uint32_t new_handle = 0;
+    struct bf_cgen *cgen;
+    uint32_t handle;
+    int r;
+
+    bf_assert(request);
+    bf_assert(response);
+
+    if (request->data_len < sizeof(struct bf_marsh))
+        return bf_response_new_failure(response, -EINVAL);
+
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return -EINVAL;
+    if (child->data_len != sizeof(op))
+        return bf_err_r(-EINVAL, "invalid chain patch operation");
+    memcpy(&op, child->data, sizeof(op));
+    if (op < 0 || op >= _BF_CHAIN_PATCH_MAX)
+        return bf_err_r(-EINVAL, "invalid chain patch operation %d", op);
+
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return -EINVAL;
+    if (child->data_len != sizeof(handle))
+        return bf_err_r(-EINVAL, "invalid rule handle");
+    memcpy(&handle, child->data, sizeof(handle));
+
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return -EINVAL;
+
+    {
+        _cleanup_bf_phase_timer_ struct bf_phase_timer _ =
+            bf_phase_timer_start(BF_PHASE_XLATE);
+
+        r = bf_chain_new_from_marsh(&chain, child);
+    }
+    if (r)
+        return bf_err_r(r, "failed to create chain from marsh");
+
+    cgen = bf_ctx_get_cgen(chain->hook, &chain->hook_opts);
+    if (!cgen || cgen->front != BF_FRONT_CLI) {
+        return bf_err_r(-ENOENT, "no chain to patch for %s",
+                        bf_hook_to_str(chain->hook));
+    }
+
+    if (!bf_list_is_empty(&chain->sets))
+        return bf_err_r(-ENOTSUP, "patched rules can't use sets");
+
+    if (op != BF_CHAIN_PATCH_DELETE) {
+        if (bf_list_size(&chain->rules) != 1)
+            return bf_err_r(-EINVAL, "chain patch expects exactly 1 rule");
+
+        rule = bf_list_node_take_data(bf_list_get_head(&chain->rules));
+    }
+
+    r = bf_cgen_patch_rule(cgen, op, handle, &rule, &new_handle);
+    if (r)
+        return r;
+
+    return bf_response_new_success(response, (const char *)&new_handle,
+                                   sizeof(new_handle));
+}
+
+int _bf_cli_get_set_counters(const struct bf_request *request,
+                             struct bf_response **response)
+{
+    _cleanup_bf_chain_ struct bf_chain *chain = NULL;
+    _cleanup_bf_set_ struct bf_set *top = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *set_marsh = NULL;
+    _cleanup_free_ struct bf_counter *counters = NULL;
+    _cleanup_free_ uint8_t *entries = NULL;
+    struct bf_marsh *req_marsh = (void *)request->data;
+    struct bf_marsh *child = NULL;
+    const struct bf_set *set;
+    struct bf_cgen *cgen;
+    uint32_t set_index;
+    size_t entry_size;
+    size_t n_entries;
+    uint32_t limit;
+    bool by_bytes;
+    int r;
+
+    bf_assert(request);
+    bf_assert(response);
+
+    if (request->data_len < sizeof(struct bf_marsh))
+        return bf_response_new_failure(response, -EINVAL);
+
+    if (!(child = bf_marsh_next_child(req_marsh, child)))
+        return -EINVAL;
+    r = bf_chain_new_from_marsh(&chain, child);
+    if (r)
+        return bf_err_r(r, "failed to create chain from marsh");
+
+    if (!(child = bf_marsh_next_child(req_marsh, child)))
+        return -EINVAL;
+    memcpy(&set_index, child->data, sizeof(set_index));
+
+    if (!(child = bf_marsh_next_child(req_marsh, child)))
+        return -EINVAL;
+    memcpy(&limit, child->data, sizeof(limit));
+
+    if (!(child = bf_marsh_next_child(req_marsh, child)))
+        return -EINVAL;
+    memcpy(&by_bytes, child->data, sizeof(by_bytes));
+
+    cgen = bf_ctx_get_cgen(chain->hook, &chain->hook_opts);
+    if (!cgen || cgen->front != BF_FRONT_CLI) {
+        return bf_err_r(-ENOENT, "no chain defined for %s",
+                        bf_hook_to_str(chain->hook));
+    }
+
+    set = bf_list_get_at(&cgen->chain->sets, set_index);
+    if (!set)
+        return bf_err_r(-ENOENT, "no set at index %u", set_index);
+
+    r = bf_cgen_get_set_top(cgen, set_index, limit, by_bytes,
+                            (void **)&entries, &n_entries);
+    if (r)
+        return r;
+
+    // Send the elements as a set, and their counters in the same order
+    r = bf_set_new(&top, set->type);
+    if (r)
+        return r;
+
+    counters = calloc(n_entries ?: 1, sizeof(*counters));
+    if (!counters)
+        return -ENOMEM;
+
+    entry_size = sizeof(struct bf_counter) + set->elem_size;
+    for (size_t i = 0; i < n_entries; ++i) {
+        struct bf_counter *entry = (void *)(entries + (i * entry_size));
+
+        counters[i] = *entry;
+        r = bf_set_add_elem(top, entry + 1);
+        if (r)
+            return r;
+    }
+
+    r = bf_marsh_new(&marsh, NULL, 0);
+    if (r)
+        return r;
+
+    r = bf_set_marsh(top, &set_marsh);
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_obj(&marsh, set_marsh);
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, counters,
+                               n_entries * sizeof(*counters));
+    if (r)
+        return r;
+
+    return bf_response_new_success(response, (const char *)marsh,
+                                   bf_marsh_size(marsh));
+}
+
+int _bf_cli_get_counters(const struct bf_request *request,
+                         struct bf_response **response)
+{
+    _cleanup_bf_chain_ struct bf_chain *chain = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+    _cleanup_free_ struct bf_counter *counters = NULL;
+    struct bf_counter telemetry[_BF_TELEMETRY_MAX];
+    size_t n_telemetry = _BF_TELEMETRY_MAX;
+    struct bf_cgen *cgen;
+    size_t n_rules;
+    int r;
+
+    bf_assert(request);
+    bf_assert(response);
+
+    if (request->data_len < sizeof(struct bf_marsh))
+        return bf_response_new_failure(response, -EINVAL);
+
+    r = bf_chain_new_from_marsh(&chain, (void *)request->data);
+    if (r)
+        return bf_err_r(r, "failed to create chain from marsh");
+
+    cgen = bf_ctx_get_cgen(chain->hook, &chain->hook_opts);
+    if (!cgen || cgen->front != BF_FRONT_CLI) {
+        return bf_err_r(-ENOENT, "no chain defined for %s",
+                        bf_hook_to_str(chain->hook));
+    }
+
+    // One counter per rule, then the policy and errors counters.
+    n_rules = bf_list_size(&cgen->chain->rules);
+    counters = calloc(n_rules + 2, sizeof(*counters));
+    if (!counters)
+        return -ENOMEM;
+
+    for (size_t i = 0; i < n_rules; ++i) {
+        r = bf_cgen_get_counter(cgen, i, &counters[i]);
+        if (r)
+            return bf_err_r(r, "failed to get counter for rule %lu", i);
+    }
+
+    r = bf_cgen_get_counter(cgen, BF_COUNTER_POLICY, &counters[n_rules]);
+    if (r)
+        return bf_err_r(r, "failed to get policy counter");
+
+    r = bf_cgen_get_counter(cgen, BF_COUNTER_ERRORS, &counters[n_rules + 1]);
+    if (r)
+        return bf_err_r(r, "failed to get errors counter");
+
+    // Telemetry is only available if the daemon runs with --telemetry
+    r = bf_cgen_get_telemetry(cgen, telemetry);
+    if (r == -ENOENT)
+        n_telemetry = 0;
+    else if (r)
+        return bf_err_r(r, "failed to get telemetry counters");
+
+    r = bf_marsh_new(&marsh, NULL, 0);
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, counters,
+                               (n_rules + 2) * sizeof(*counters));
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, n_telemetry ? telemetry : NULL,
+                               n_telemetry * sizeof(*telemetry));
+    if (r)
+        return r;
+
+    return bf_response_new_success(response, (const char *)marsh,
+                                   bf_marsh_size(marsh));
+}
+
+int _bf_cli_get_profile(const struct bf_request *request,
+                        struct bf_response **response)
+{
+    _cleanup_bf_chain_ struct bf_chain *chain = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+    _cleanup_free_ uint64_t *hist = NULL;
+    struct bf_cgen *cgen;
+    uint32_t block_size;
+    size_t n_blocks;
+    int r;
+
+    bf_assert(request);
+    bf_assert(response);
+
+    if (request->data_len < sizeof(struct bf_marsh))
+        return bf_response_new_failure(response, -EINVAL);
+
+    r = bf_chain_new_from_marsh(&chain, (void *)request->data);
+    if (r)
+        return bf_err_r(r, "failed to create chain from marsh");
+
+    cgen = bf_ctx_get_cgen(chain->hook, &chain->hook_opts);
+    if (!cgen || cgen->front != BF_FRONT_CLI) {
+        return bf_err_r(-ENOENT, "no chain defined for %s",
+                        bf_hook_to_str(chain->hook));
+    }
+
+    // Profiling is only available if the daemon runs with --profile
+    r = bf_cgen_get_profile(cgen, &block_size, &hist, &n_blocks);
+    if (r == -ENOENT)
+        return bf_response_new_failure(response, -ENOENT);
+    if (r)
+        return bf_err_r(r, "failed to get profiling histograms");
+
+    r = bf_marsh_new(&marsh, NULL, 0);
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, &block_size, sizeof(block_size));
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(
+        &marsh, hist, n_blocks * BF_PROFILE_N_BUCKETS * sizeof(*hist));
+    if (r)
+        return r;
+
+    return bf_response_new_success(response, (const char *)marsh,
+                                   bf_marsh_size(marsh));
+}
+
+int _bf_cli_get_stats(const struct bf_request *request,
+                      struct bf_response **response)
+{
+    _clean_bf_list_ bf_list cgens = bf_list_default(NULL, NULL);
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+    int r;
+
+    bf_assert(request);
+    bf_assert(response);
+
+    r = bf_ctx_get_cgens_for_front(&cgens, BF_FRONT_CLI);
+    if (r)
+        return bf_err_r(r, "failed to collect codegens for BF_FRONT_CLI");
+
+    r = bf_marsh_new(&marsh, NULL, 0);
+    if (r)
+        return r;
+
+    // One child per codegen: its chain, and its program's statistics.
+    bf_list_foreach (&cgens, cgen_node) {
+        struct bf_cgen *cgen = bf_list_node_get_data(cgen_node);
+        _cleanup_bf_marsh_ struct bf_marsh *cgen_elem = NULL;
+        _cleanup_bf_marsh_ struct bf_marsh *chain_elem = NULL;
+        struct bf_prog_stats stats;
+
+        r = bf_cgen_get_stats(cgen, &stats);
+        if (r)
+            return bf_err_r(r, "failed to get program statistics");
+
+        r = bf_marsh_new(&cgen_elem, NULL, 0);
+        if (r)
+            return r;
+
+        r = bf_chain_marsh(cgen->chain, &chain_elem);
+        if (r)
+            return r;
+
+        r = bf_marsh_add_child_obj(&cgen_elem, chain_elem);
+        if (r)
+            return r;
+
+        r = bf_marsh_add_child_raw(&cgen_elem, &stats, sizeof(stats));
+        if (r)
+            return r;
+
+        r = bf_marsh_add_child_obj(&marsh, cgen_elem);
+        if (r)
+            return r;
+    }
+
+    return bf_response_new_success(response, (const char *)marsh,
+                                   bf_marsh_size(marsh));
+}
+
+int _bf_cli_simulate(const struct bf_request *request,
+                     struct bf_response **response)
+{
+    _cleanup_bf_chain_ struct bf_chain *chain = NULL;
+    _cleanup_bf_program_ struct bf_program *program = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+    _cleanup_free_ struct bf_sim_result *results = NULL;
+    _cleanup_free_ struct bf_counter *counters = NULL;
+    struct bf_marsh *req_marsh = (void *)request->data;
+    const struct bf_program_section *section;
+    const struct bf_pcap_pkt *pkt = NULL;
+    struct bf_marsh *child = NULL;
+    struct bf_marsh *pkts;
+    size_t n_rules;
+    size_t n_pkts = 0;
+    uint32_t repeat;
+    int r;
+
+    bf_assert(request);
+    bf_assert(response);
+
+    if (request->data_len < sizeof(struct bf_marsh))
+        return bf_response_new_failure(response, -EINVAL);
+
+    if (!(child = bf_marsh_next_child(req_marsh, child)))
+        return -EINVAL;
+    r = bf_chain_new_from_marsh(&chain, child);
+    if (r)
+        return bf_err_r(r, "failed to create chain from marsh");
+
+    if (!(child = bf_marsh_next_child(req_marsh, child)))
+        return -EINVAL;
+    if (child->data_len != sizeof(repeat))
+        return bf_err_r(-EINVAL, "invalid simulation repeat count");
+    memcpy(&repeat, child->data, sizeof(repeat));
+    if (!repeat)
+        return bf_err_r(-EINVAL, "simulation repeat count can't be 0");
+
+    if (!(pkts = bf_marsh_next_child(req_marsh, child)))
+        return -EINVAL;
+
+    // Count the hits of every rule, even if the chain doesn't ask to.
+    bf_list_foreach (&chain->rules, rule_node)
+        ((struct bf_rule *)bf_list_node_get_data(rule_node))->counters = true;
+
+    /* The program is never attached, pinned, nor stored in the context: it
+     * doesn't interfere with the chains of the ruleset, and is unloaded when
+     * freed. */
+    r = bf_program_new(&program, chain->hook, BF_FRONT_CLI, chain);
+    if (r)
+        return bf_err_r(r, "failed to create simulation program");
+
+    r = bf_program_generate(program);
+    if (r)
+        return bf_err_r(r, "failed to generate simulation program");
+
+    r = bf_program_load_detached(program);
+    if (r)
+        return bf_err_r(r, "failed to load simulation program");
+
+    while ((pkt = bf_pcap_pkt_next(pkts->data, pkts->data_len, pkt)))
+        ++n_pkts;
+
+    results = calloc(n_pkts ?: 1, sizeof(*results));
+    if (!results)
+        return -ENOMEM;
+
+    for (size_t i = 0;
+         (pkt = bf_pcap_pkt_next(pkts->data, pkts->data_len, pkt)); ++i) {
+        r = bf_program_test_run(program, pkt->data, pkt->len, repeat,
+                                &results[i]);
+        if (r)
+            return r;
+    }
+
+    /* One counter per rule, then the policy and errors counters. Each packet
+     * has been processed repeat times. */
+    section = &program->sections[0];
+    n_rules = bf_list_size(&chain->rules);
+    counters = calloc(section->n_counters + 1, sizeof(*counters));
+    if (!counters)
+        return -ENOMEM;
+
+    r = bf_program_get_counters(program, section->counters_offset,
+                                section->n_counters, counters);
+    if (r)
+        return bf_err_r(r, "failed to get simulation counters");
+
+    counters[n_rules] = counters[section->n_counters - 1];
+
+    r = bf_program_get_counter(program, program->num_counters - 1,
+                               &counters[n_rules + 1]);
+    if (r)
+        return bf_err_r(r, "failed to get simulation errors counter");
+
+    for (size_t i = 0; i < n_rules + 2; ++i) {
+        counters[i].packets /= repeat;
+        counters[i].bytes /= repeat;
+    }
+
+    r = bf_marsh_new(&marsh, NULL, 0);
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, results, n_pkts * sizeof(*results));
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, counters,
+                               (n_rules + 2) * sizeof(*counters));
+    if (r)
+        return r;
+
+    return bf_response_new_success(response, (const char *)marsh,
+                                   bf_marsh_size(marsh));
+}
+
+int _bf_cli_check(const struct bf_request *request,
+                  struct bf_response **response)
+{
+    _cleanup_bf_chain_ struct bf_chain *chain = NULL;
+    _cleanup_bf_program_ struct bf_program *program = NULL;
+    struct bf_marsh *req_marsh = (void *)request->data;
+    struct bf_check_report report = {};
+    struct bf_prog_stats stats;
+    struct bf_marsh *child = NULL;
+    uint8_t verify;
+    int r;
+
+    bf_assert(request);
+    bf_assert(response);
+
+    if (request->data_len < sizeof(struct bf_marsh))
+        return bf_response_new_failure(response, -EINVAL);
+
+    if (!(child = bf_marsh_next_child(req_marsh, child)))
+        return -EINVAL;
+    r = bf_chain_new_from_marsh(&chain, child);
+    if (r)
+        return bf_err_r(r, "failed to create chain from marsh");
+
+    if (!(child = bf_marsh_next_child(req_marsh, child)))
+        return -EINVAL;
+    if (child->data_len != sizeof(verify))
+        return bf_err_r(-EINVAL, "invalid check verify flag");
+    memcpy(&verify, child->data, sizeof(verify));
+
+    /* Similarly to the simulation, the program is never attached, pinned,
+     * nor stored in the context, and it is unloaded when freed. */
+    r = bf_program_new(&program, chain->hook, BF_FRONT_CLI, chain);
+    if (r)
+        return bf_err_r(r, "failed to create program to check");
+
+    r = bf_program_generate(program);
+    if (r)
+        return bf_err_r(r, "failed to generate program to check");
+
+    report.n_insns = program->img_size;
+
+    r = bf_program_estimate_costs(program, report.costs);
+    if (r)
+        return r;
+
+    if (verify) {
+        report.verify = 1;
+
+        // A program rejected by the verifier is reported, not an error
+        r = bf_program_load_detached(program);
+        if (r) {
+            report.verify_error = r;
+        } else {
+            r = bf_program_get_stats(program, &stats);
+            if (r)
+                return bf_err_r(r, "failed to get checked program stats");
+
+            report.verified_insns = stats.verified_insns;
+        }
+    }
+
+    return bf_response_new_success(response, (const char *)&report,
+                                   sizeof(report));
 }
 
 static int _bf_cli_request_handler(struct bf_request *request,
@@ -114,6 +678,27 @@ static int _bf_cli_request_handler(struct bf_request *request,
     case BF_REQ_RULES_SET:
         r = _bf_cli_set_rules(request, response);
         break;
+    case BF_REQ_RULES_PATCH:
+        r = _bf_cli_patch_rules(request, response);
+        break;
+    case BF_REQ_COUNTERS_GET:
+        r = _bf_cli_get_counters(request, response);
+        break;
+    case BF_REQ_SET_COUNTERS_GET:
+        r = _bf_cli_get_set_counters(request, response);
+        break;
+    case BF_REQ_PROFILE_GET:
+        r = _bf_cli_get_profile(request, response);
+        break;
+    case BF_REQ_PROG_STATS_GET:
+        r = _bf_cli_get_stats(request, response);
+        break;
+    case BF_REQ_RULESET_SIMULATE:
+        r = _bf_cli_simulate(request, response);
+        break;
+    case BF_REQ_RULESET_CHECK:
+        r = _bf_cli_check(request, response);
+        break;
     default:
         r = bf_err_r(-EINVAL, "unsupported command %d for CLI front-end",
                      request->cmd);
@@ -33,9 +33,11 @@
 #include "core/marsh.h"
 #include "core/matcher.h"
 #include "core/opts.h"
+#include "core/phase.h"
 #include "core/request.h"
 #include "core/response.h"
 #include "core/rule.h"
+#include "core/subchain.h"
 #include "core/verdict.h"
 
 /**
@@ -84,7 +86,15 @@
  * supported by @c bpfilter ), however after each @c ipt_entry is located an
  * @c ipt_entry_target to define the rule's verdict. @c ipt_entry_target have
  * different sizes depending on the exact type of target (verdict, jump, ...):
- * @c bpfilter only supports verdict ( @c ipt_standard_target ).
+ * @c bpfilter only supports verdicts and jumps to user-defined chains
+ * ( @c ipt_standard_target ).
+ *
+ * @c iptables user-defined chains are translated into @ref bf_subchain , and
+ * added to every chain defined by @c iptables . In the @c ipt_replace
+ * structure, they are located after the built-in chains: each user-defined
+ * chain starts with an error target entry containing the chain's name, and
+ * ends with an unconditional @c RETURN entry. Jumps to a user-defined chain
+ * use the offset of its first rule as verdict.
  *
  * Then, a last @c ipt_entry is added for the error target, which is expected
  * by @c iptables .
@@ -99,29 +109,69 @@
 #define bf_ipt_replace_size(ipt_replace_ptr)                                   \
     (sizeof(struct ipt_replace) + (ipt_replace_ptr)->size)
 
+/**
+ * User-defined chain in an @c ipt_replace structure.
+ */
+struct bf_ipt_user_chain
+{
+    /// Name of the chain, from the chain's error target entry.
+    const char *name;
+    /// First rule of the chain.
+    struct ipt_entry *first;
+    /// Last entry of the chain, the unconditional @c RETURN .
+    struct ipt_entry *last;
+    /// Offset of @c first from the beginning of the entries.
+    size_t offset;
+};
+
 /**
  * Convert an iptables target to a bpfilter verdict.
  *
- * Only the NF_ACCEPT and NF_DROP standard target are supported, other targets
- * and user-defined chains jumps will be rejected.
+ * Only the NF_ACCEPT, NF_DROP, and RETURN standard targets, as well as the
+ * jumps to user-defined chains, are supported. Other targets will be
+ * rejected.
  *
- * @param ipt_tgt @c iptables target to convert.
- * @param verdict @c bpfilter verdict, corresponding to @p ipt_tgt .
+ * @param entry @c iptables entry to convert the target of. Can't be NULL.
+ * @param user_chains User-defined chains of the ruleset, used to translate
+ *        jumps. Can be NULL if @p n_user_chains is 0.
+ * @param n_user_chains Number of user-defined chains in @p user_chains .
+ * @param verdict @c bpfilter verdict, corresponding to @p entry 's target.
+ *        Can't be NULL.
+ * @param target If @p verdict is a jump, index of the user-defined chain to
+ *        jump to. Can't be NULL.
  * @return 0 on success, or na egative errno value on error.
  */
-static int _bf_ipt_target_to_verdict(struct ipt_entry_target *ipt_tgt,
-                                     enum bf_verdict *verdict)
+static int
+_bf_ipt_target_to_verdict(const struct ipt_entry *entry,
+                          const struct bf_ipt_user_chain *user_chains,
+                          size_t n_user_chains, enum bf_verdict *verdict,
+                          uint32_t *target)
 {
-    bf_assert(ipt_tgt && verdict);
+    struct ipt_entry_target *ipt_tgt;
+
+    bf_assert(entry && verdict && target);
+
+    ipt_tgt = ipt_get_target(entry);
 
     if (bf_streq("", ipt_tgt->u.user.name)) {
         struct ipt_standard_target *std_tgt =
             (struct xt_standard_target *)ipt_tgt;
 
         if (std_tgt->verdict >= 0) {
-            return bf_err_r(
-                -ENOTSUP,
-                "iptables user-defined chains are not supported, rejecting target");
+            for (size_t i = 0; i < n_user_chains; ++i) {
+                if (user_chains[i].offset != (size_t)std_tgt->verdict)
+                    continue;
+
+                *verdict = entry->ip.flags & IPT_F_GOTO ? BF_VERDICT_GOTO :
+                                                          BF_VERDICT_JUMP;
+                *target = i;
+
+                return 0;
+            }
+
+            return bf_err_r(-ENOTSUP,
+                            "iptables jump to unknown offset %d, rejecting",
+                            std_tgt->verdict);
         }
 
         switch (-std_tgt->verdict - 1) {
@@ -131,6 +181,9 @@ static int _bf_ipt_target_to_verdict(struct ipt_entry_target *ipt_tgt,
         case NF_DROP:
             *verdict = BF_VERDICT_DROP;
             break;
+        case NF_REPEAT:
+            *verdict = BF_VERDICT_RETURN;
+            break;
         default:
             return bf_err_r(-ENOTSUP, "unsupported iptables verdict: %d",
                             std_tgt->verdict);
@@ -158,6 +211,9 @@ static int _bf_verdict_to_ipt_target(enum bf_verdict verdict,
     case BF_VERDICT_DROP:
         std_tgt->verdict = -1;
         break;
+    case BF_VERDICT_RETURN:
+        std_tgt->verdict = XT_RETURN;
+        break;
     default:
         return bf_err_r(-ENOTSUP, "unsupported verdict %d", verdict);
     }
@@ -171,12 +227,16 @@ static int _bf_verdict_to_ipt_target(enum bf_verdict verdict,
  * Translate an @c iptables rule into a @c bpfilter rule.
  *
  * @param entry @c iptables rule. Can't be NULL.
+ * @param user_chains User-defined chains of the ruleset. Can be NULL if
+ *        @p n_user_chains is 0.
+ * @param n_user_chains Number of user-defined chains in @p user_chains .
  * @param rule @c bpfilter rule. Can't be NULL. On success, points to a
  *        valid rule.
  * @return 0 on success, or a negative errno value on error.
  */
 static int _bf_ipt_entry_to_rule(const struct ipt_entry *entry,
-                                 struct bf_rule **rule)
+                                 const struct bf_ipt_user_chain *user_chains,
+                                 size_t n_user_chains, struct bf_rule **rule)
 {
     _cleanup_bf_rule_ struct bf_rule *_rule = NULL;
     int r;
@@ -248,7 +308,8 @@ static int _bf_ipt_entry_to_rule(const struct ipt_entry *entry,
             return r;
     }
 
-    r = _bf_ipt_target_to_verdict(ipt_get_target(entry), &_rule->verdict);
+    r = _bf_ipt_target_to_verdict(entry, user_chains, n_user_chains,
+                                  &_rule->verdict, &_rule->target);
     if (r)
         return r;
 
@@ -261,11 +322,15 @@ static int _bf_ipt_entry_to_rule(const struct ipt_entry *entry,
  * Translates a @ref bf_rule object into an @c ipt_entry .
  *
  * @param rule @ref bf_rule to translate. Can't be NULL.
+ * @param subchain_offsets Offset of the first rule of each sub-chain, used to
+ *        translate jumps. Can be NULL if @p n_subchains is 0.
+ * @param n_subchains Number of entries in @p subchain_offsets .
  * @param entry @c ipt_entry created from the @ref bf_rule . Can't be NULL.
  * @return 0 on success, or a negative errno value on error.
  */
 static int _bf_rule_to_ipt_entry(const struct bf_rule *rule,
-                                 struct ipt_entry *entry)
+                                 const size_t *subchain_offsets,
+                                 size_t n_subchains, struct ipt_entry *entry)
 {
     struct bf_matcher_ip4_addr *addr;
 
@@ -298,24 +363,93 @@ static int _bf_rule_to_ipt_entry(const struct bf_rule *rule,
         }
     }
 
+    if (rule->verdict == BF_VERDICT_JUMP || rule->verdict == BF_VERDICT_GOTO) {
+        struct ipt_standard_target *std_tgt =
+            (struct xt_standard_target *)ipt_get_target(entry);
+
+        if (rule->target >= n_subchains)
+            return bf_err_r(-EINVAL, "invalid sub-chain %u", rule->target);
+
+        if (rule->verdict == BF_VERDICT_GOTO)
+            entry->ip.flags |= IPT_F_GOTO;
+
+        std_tgt->verdict = (int)subchain_offsets[rule->target];
+        std_tgt->target.u.target_size = sizeof(*std_tgt);
+
+        return 0;
+    }
+
     return _bf_verdict_to_ipt_target(rule->verdict, ipt_get_target(entry));
 }
 
+/**
+ * Translate the rules of an @c iptables user-defined chain into a sub-chain.
+ *
+ * @param subchain On success, points to the new sub-chain. Can't be NULL.
+ * @param user_chain User-defined chain to translate. Can't be NULL.
+ * @param user_chains User-defined chains of the ruleset. Can't be NULL.
+ * @param n_user_chains Number of user-defined chains in @p user_chains .
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int
+_bf_ipt_user_chain_to_subchain(struct bf_subchain **subchain,
+                               const struct bf_ipt_user_chain *user_chain,
+                               const struct bf_ipt_user_chain *user_chains,
+                               size_t n_user_chains)
+{
+    _cleanup_bf_subchain_ struct bf_subchain *_subchain = NULL;
+    struct ipt_entry *entry = user_chain->first;
+    int r;
+
+    bf_assert(subchain && user_chain && user_chains);
+
+    r = bf_subchain_new(&_subchain, user_chain->name, NULL);
+    if (r)
+        return r;
+
+    while (entry < user_chain->last) {
+        _cleanup_bf_rule_ struct bf_rule *rule = NULL;
+
+        r = _bf_ipt_entry_to_rule(entry, user_chains, n_user_chains, &rule);
+        if (r)
+            return bf_err_r(r, "failed to create rule from ipt_entry");
+
+        r = bf_subchain_add_rule(_subchain, rule);
+        if (r)
+            return r;
+
+        TAKE_PTR(rule);
+        entry = ipt_get_next_rule(entry);
+    }
+
+    *subchain = TAKE_PTR(_subchain);
+
+    return 0;
+}
+
 static int _bf_ipt_entries_to_chain(struct bf_chain **chain, int ipt_hook,
                                     struct ipt_entry *first,
-                                    struct ipt_entry *last)
+                                    struct ipt_entry *last,
+                                    const struct bf_ipt_user_chain *user_chains,
+                                    size_t n_user_chains)
 {
     _cleanup_bf_chain_ struct bf_chain *_chain = NULL;
     enum bf_verdict policy;
+    uint32_t target;
     int r;
 
     bf_assert(chain && first && last);
 
     // The last rule of the chain is the policy.
-    r = _bf_ipt_target_to_verdict(ipt_get_target(last), &policy);
+    r = _bf_ipt_target_to_verdict(last, NULL, 0, &policy, &target);
     if (r)
         return r;
 
+    if (policy >= _BF_TERMINAL_VERDICT_MAX) {
+        return bf_err_r(-ENOTSUP, "unsupported iptables chain policy %s",
+                        bf_verdict_to_str(policy));
+    }
+
     r = bf_chain_new(&_chain, bf_nf_hook_to_hook(ipt_hook), policy, NULL, NULL);
     if (r)
         return r;
@@ -326,10 +460,15 @@ static int _bf_ipt_entries_to_chain(struct bf_chain **chain, int ipt_hook,
     while (first < last) {
         _cleanup_bf_rule_ struct bf_rule *rule = NULL;
 
-        r = _bf_ipt_entry_to_rule(first, &rule);
+        r = _bf_ipt_entry_to_rule(first, user_chains, n_user_chains, &rule);
         if (r)
             return bf_err_r(r, "failed to create rule from ipt_entry");
 
+        if (rule->verdict == BF_VERDICT_RETURN) {
+            return bf_err_r(-ENOTSUP,
+                            "RETURN is not supported in built-in chains");
+        }
+
         r = bf_chain_add_rule(_chain, rule);
         if (r)
             return r;
@@ -338,6 +477,23 @@ static int _bf_ipt_entries_to_chain(struct bf_chain **chain, int ipt_hook,
         first = ipt_get_next_rule(first);
     }
 
+    for (size_t i = 0; i < n_user_chains; ++i) {
+        _cleanup_bf_subchain_ struct bf_subchain *subchain = NULL;
+
+        r = _bf_ipt_user_chain_to_subchain(&subchain, &user_chains[i],
+                                           user_chains, n_user_chains);
+        if (r) {
+            return bf_err_r(r, "failed to translate user-defined chain '%s'",
+                            user_chains[i].name);
+        }
+
+        r = bf_chain_add_subchain(_chain, subchain);
+        if (r)
+            return r;
+
+        TAKE_PTR(subchain);
+    }
+
     *chain = TAKE_PTR(_chain);
 
     return 0;
@@ -423,6 +579,76 @@ static int _bf_ipt_gen_get_ruleset(struct bf_ipt_gen_ruleset_entry *ruleset,
     return 0;
 }
 
+/**
+ * Fill an @c ipt_entry with an error target.
+ *
+ * Error targets are used to mark the beginning of user-defined chains, and the
+ * end of the ruleset.
+ *
+ * @param entry Entry to fill. Can't be NULL.
+ * @param name Name to store in the error target. Can't be NULL.
+ */
+static void _bf_ipt_fill_error_entry(struct ipt_entry *entry, const char *name)
+{
+    struct xt_error_target *err_tgt = (struct xt_error_target *)(entry + 1);
+
+    bf_assert(entry && name);
+
+    entry->target_offset = sizeof(struct ipt_entry);
+    entry->next_offset = sizeof(struct ipt_entry) + sizeof(*err_tgt);
+
+    strncpy(err_tgt->errorname, name, sizeof(err_tgt->errorname) - 1);
+    err_tgt->target.u.target_size = sizeof(struct xt_error_target);
+    err_tgt->target.u.user.target_size = sizeof(struct xt_error_target);
+    strcpy(err_tgt->target.u.user.name, XT_ERROR_TARGET);
+}
+
+/**
+ * Get the counters of a sub-chain's rule.
+ *
+ * Every @c iptables chain contains a copy of the user-defined chains, so the
+ * counters of a user-defined chain's rule are the sum of the counters of the
+ * rule in each chain.
+ *
+ * @param ruleset Codegen and chain for every hook. Can't be NULL.
+ * @param index Index of the sub-chain.
+ * @param rule Rule to get the counters of. Can't be NULL.
+ * @param counter On success, contains the counters. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int
+_bf_ipt_get_subchain_counter(const struct bf_ipt_gen_ruleset_entry *ruleset,
+                             size_t index, const struct bf_rule *rule,
+                             struct bf_counter *counter)
+{
+    int r;
+
+    bf_assert(ruleset && rule && counter);
+
+    *counter = (struct bf_counter) {};
+
+    for (int hook = 0; hook < NF_INET_NUMHOOKS; ++hook) {
+        const struct bf_cgen *cgen = ruleset[hook].cgen;
+        struct bf_counter hook_counter;
+
+        if (!cgen || index >= bf_list_size(&cgen->chain->subchains))
+            continue;
+
+        r = bf_cgen_get_counter(
+            cgen,
+            bf_chain_get_subchain_counters_offset(cgen->chain, index) +
+                rule->index,
+            &hook_counter);
+        if (r)
+            return r;
+
+        counter->packets += hook_counter.packets;
+        counter->bytes += hook_counter.bytes;
+    }
+
+    return 0;
+}
+
 /**
  * Generate the @c ipt_replace structure for the current ruleset.
  *
@@ -435,15 +661,19 @@ static int _bf_ipt_gen_ipt_replace(struct ipt_replace **replace,
                                    bool with_counters)
 {
     _cleanup_free_ struct ipt_replace *_replace = NULL;
+    _cleanup_free_ size_t *subchain_offsets = NULL;
     _clean_bf_list_ bf_list dummy_chains = bf_list_default(bf_chain_free, NULL);
     struct bf_ipt_gen_ruleset_entry ruleset[NF_INET_NUMHOOKS] = {};
+    const bf_list *subchains = NULL;
     struct ipt_entry *entry;
     size_t next_chain_off = 0;
     size_t nrules;
+    size_t n_subchains = 0;
+    size_t n_subchain_rules = 0;
     size_t rule_size =
         sizeof(struct ipt_entry) + sizeof(struct xt_standard_target);
     size_t err_size = sizeof(struct ipt_entry) + sizeof(struct xt_error_target);
-    struct xt_error_target *err_tgt;
+    size_t i = 0;
     int r;
 
     bf_assert(replace);
@@ -452,14 +682,46 @@ static int _bf_ipt_gen_ipt_replace(struct ipt_replace **replace,
     if (r)
         return bf_err_r(r, "failed to collect the BF_FRONT_IPT ruleset");
 
-    _replace = calloc(1, sizeof(*_replace) + (nrules * rule_size) + err_size);
+    /* All the chains defined by iptables contain the same sub-chains (the
+     * user-defined chains), use the first one. */
+    for (int hook = 0; hook < NF_INET_NUMHOOKS; ++hook) {
+        if (ruleset[hook].cgen) {
+            subchains = &ruleset[hook].chain->subchains;
+            break;
+        }
+    }
+
+    if (subchains && !bf_list_is_empty(subchains)) {
+        size_t off = nrules * rule_size;
+
+        n_subchains = bf_list_size(subchains);
+        subchain_offsets = calloc(n_subchains, sizeof(*subchain_offsets));
+        if (!subchain_offsets)
+            return -ENOMEM;
+
+        /* User-defined chains are located after the built-in chains, jumps
+         * target the rule following the chain's error target. */
+        bf_list_foreach (subchains, subchain_node) {
+            struct bf_subchain *subchain = bf_list_node_get_data(subchain_node);
+
+            subchain_offsets[i++] = off + err_size;
+            off += err_size + (bf_list_size(&subchain->rules) + 1) * rule_size;
+            n_subchain_rules += bf_list_size(&subchain->rules);
+        }
+    }
+
+    _replace = calloc(1, sizeof(*_replace) + (nrules * rule_size) +
+                             n_subchains * (err_size + rule_size) +
+                             n_subchain_rules * rule_size + err_size);
     if (!_replace)
         return -ENOMEM;
 
-    // Total number of rules, chain policies, and error entry
-    _replace->num_entries = nrules + 1;
-    _replace->num_counters = nrules + 1;
-    _replace->size = nrules * rule_size + err_size;
+    /* Total number of rules, chain policies, user-defined chains head and
+     * RETURN entries, and error entry */
+    _replace->num_entries = nrules + n_subchain_rules + n_subchains * 2 + 1;
+    _replace->num_counters = _replace->num_entries;
+    _replace->size = nrules * rule_size + n_subchains * (err_size + rule_size) +
+                     n_subchain_rules * rule_size + err_size;
 
     entry = (struct ipt_entry *)(_replace + 1);
     strncpy(_replace->name, "filter", XT_TABLE_MAXNAMELEN);
@@ -473,7 +735,7 @@ static int _bf_ipt_gen_ipt_replace(struct ipt_replace **replace,
 
         /* Rules (struct ipt_entry) always have the same size:
          *   sizeof(ipt_entry) + sizeof(ipt_standard_target)
-         * Matchers and user-defined chains are not supported. */
+         * Matchers are not supported. */
 
         _replace->valid_hooks |= 1 << hook;
         _replace->hook_entry[hook] = next_chain_off;
@@ -486,7 +748,8 @@ static int _bf_ipt_gen_ipt_replace(struct ipt_replace **replace,
             entry->target_offset = sizeof(struct ipt_entry);
             entry->next_offset = rule_size;
 
-            r = _bf_rule_to_ipt_entry(rule, entry);
+            r = _bf_rule_to_ipt_entry(rule, subchain_offsets, n_subchains,
+                                      entry);
             if (r) {
                 return bf_err_r(r,
                                 "failed to translate bf_rule into ipt_entry");
@@ -535,15 +798,60 @@ static int _bf_ipt_gen_ipt_replace(struct ipt_replace **replace,
         next_chain_off += (bf_list_size(&chain->rules) + 1) * rule_size;
     }
 
-    // There is one last entry after the chains for the error target.
-    entry->target_offset = sizeof(struct ipt_entry);
-    entry->next_offset = err_size;
+    // User-defined chains, delimited by an error target and a RETURN.
+    i = 0;
+    if (subchains) {
+        bf_list_foreach (subchains, subchain_node) {
+            struct bf_subchain *subchain = bf_list_node_get_data(subchain_node);
 
-    err_tgt = (struct xt_error_target *)(entry + 1);
-    strcpy(err_tgt->errorname, "ERROR");
-    err_tgt->target.u.target_size = sizeof(struct xt_error_target);
-    err_tgt->target.u.user.target_size = sizeof(struct xt_error_target);
-    strcpy(err_tgt->target.u.user.name, "ERROR");
+            _bf_ipt_fill_error_entry(entry, subchain->name);
+            entry = (void *)entry + err_size;
+
+            bf_list_foreach (&subchain->rules, rule_node) {
+                struct bf_rule *rule = bf_list_node_get_data(rule_node);
+
+                entry->target_offset = sizeof(struct ipt_entry);
+                entry->next_offset = rule_size;
+
+                r = _bf_rule_to_ipt_entry(rule, subchain_offsets, n_subchains,
+                                          entry);
+                if (r) {
+                    return bf_err_r(
+                        r, "failed to translate bf_rule into ipt_entry");
+                }
+
+                if (with_counters) {
+                    struct bf_counter counters;
+
+                    r = _bf_ipt_get_subchain_counter(ruleset, i, rule,
+                                                     &counters);
+                    if (r) {
+                        return bf_err_r(
+                            r, "failed to get counters for iptables rule");
+                    }
+
+                    entry->counters.bcnt = counters.bytes;
+                    entry->counters.pcnt = counters.packets;
+                }
+
+                entry = (void *)entry + rule_size;
+            }
+
+            entry->target_offset = sizeof(struct ipt_entry);
+            entry->next_offset = rule_size;
+
+            r = _bf_verdict_to_ipt_target(BF_VERDICT_RETURN,
+                                          ipt_get_target(entry));
+            if (r)
+                return r;
+
+            entry = (void *)entry + rule_size;
+            ++i;
+        }
+    }
+
+    // There is one last entry after the chains for the error target.
+    _bf_ipt_fill_error_entry(entry, XT_ERROR_TARGET);
 
     *replace = TAKE_PTR(_replace);
 
@@ -552,9 +860,85 @@ static int _bf_ipt_gen_ipt_replace(struct ipt_replace **replace,
     return 0;
 }
 
+/**
+ * Find the user-defined chains of an @c iptables ruleset.
+ *
+ * @param ipt @c iptables ruleset. Can't be NULL.
+ * @param user_chains On success, points to an array of user-defined chains,
+ *        owned by the caller. Can be NULL if there are no user-defined
+ *        chains. Can't be NULL.
+ * @param n_user_chains On success, contains the number of user-defined
+ *        chains. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_ipt_get_user_chains(struct ipt_replace *ipt,
+                                   struct bf_ipt_user_chain **user_chains,
+                                   size_t *n_user_chains)
+{
+    _cleanup_free_ struct bf_ipt_user_chain *_user_chains = NULL;
+    struct bf_ipt_user_chain *cur = NULL;
+    struct ipt_entry *entry = (struct ipt_entry *)ipt->entries;
+    struct ipt_entry *end = (void *)ipt->entries + ipt->size;
+    struct ipt_entry *prev = NULL;
+    size_t n = 0;
+
+    bf_assert(ipt && user_chains && n_user_chains);
+
+    /* Each error target entry is the head of a user-defined chain, except
+     * for the last one, which marks the end of the ruleset. */
+    _user_chains = calloc(ipt->num_entries, sizeof(*_user_chains));
+    if (!_user_chains)
+        return -ENOMEM;
+
+    while (entry < end) {
+        struct ipt_entry_target *tgt = ipt_get_target(entry);
+
+        if (bf_streq(tgt->u.user.name, XT_ERROR_TARGET)) {
+            struct xt_error_target *err_tgt = (struct xt_error_target *)tgt;
+
+            if (cur) {
+                if (prev < cur->first) {
+                    return bf_err_r(-EINVAL,
+                                    "user-defined chain '%s' has no RETURN",
+                                    cur->name);
+                }
+
+                cur->last = prev;
+                cur = NULL;
+            }
+
+            if (strnlen(err_tgt->errorname, sizeof(err_tgt->errorname)) ==
+                sizeof(err_tgt->errorname))
+                return bf_err_r(-EINVAL, "invalid user-defined chain name");
+
+            if (!bf_streq(err_tgt->errorname, XT_ERROR_TARGET)) {
+                cur = &_user_chains[n++];
+                cur->name = err_tgt->errorname;
+                cur->first = ipt_get_next_rule(entry);
+                cur->offset = (void *)cur->first - (void *)ipt->entries;
+            }
+        }
+
+        prev = entry;
+        entry = ipt_get_next_rule(entry);
+    }
+
+    if (cur) {
+        return bf_err_r(-EINVAL, "user-defined chain '%s' is not terminated",
+                        cur->name);
+    }
+
+    *user_chains = TAKE_PTR(_user_chains);
+    *n_user_chains = n;
+
+    return 0;
+}
+
 /**
  * Translate iptables rules into bpfilter format.
  *
+ * The user-defined chains are added as sub-chains to every chain.
+ *
  * @param ipt iptables rules.
  * @param chains Array of chains. The array is big enough to fit one chain per
  *        hook. Can't be NULL.
@@ -564,10 +948,18 @@ static int
 _bf_ipt_xlate_ruleset_set(struct ipt_replace *ipt,
                           struct bf_chain *(*chains)[NF_INET_NUMHOOKS])
 {
+    _cleanup_free_ struct bf_ipt_user_chain *user_chains = NULL;
+    _cleanup_bf_phase_timer_ struct bf_phase_timer _ =
+        bf_phase_timer_start(BF_PHASE_XLATE);
+    size_t n_user_chains;
     int r;
 
     bf_assert(ipt && chains);
 
+    r = _bf_ipt_get_user_chains(ipt, &user_chains, &n_user_chains);
+    if (r)
+        return bf_err_r(r, "failed to find iptables user-defined chains");
+
     for (int i = 0; i < NF_INET_NUMHOOKS; ++i) {
         _cleanup_bf_chain_ struct bf_chain *chain = NULL;
 
@@ -577,7 +969,8 @@ _bf_ipt_xlate_ruleset_set(struct ipt_replace *ipt,
         }
 
         r = _bf_ipt_entries_to_chain(&chain, i, ipt_get_first_rule(ipt, i),
-                                     ipt_get_last_rule(ipt, i));
+                                     ipt_get_last_rule(ipt, i), user_chains,
+                                     n_user_chains);
         if (r) {
             return bf_err_r(r, "failed to create chain for iptables hook %d",
                             i);
@@ -615,6 +1008,25 @@ static int _bf_ipt_ruleset_set(struct ipt_replace *replace, size_t len)
     if (r)
         return bf_err_r(r, "failed to translate iptables ruleset");
 
+    /* iptables chains use the default priority (0): another front could
+     * already own a chain at this priority on the same hook. Check every hook
+     * before applying the ruleset, so it's not partially applied. */
+    for (int i = 0; i < NF_INET_NUMHOOKS; i++) {
+        struct bf_cgen *cgen;
+
+        if (!chains[i])
+            continue;
+
+        cgen = bf_ctx_get_cgen(chains[i]->hook, &chains[i]->hook_opts);
+        if (cgen && cgen->front != BF_FRONT_IPT) {
+            for (int j = 0; j < NF_INET_NUMHOOKS; j++)
+                bf_chain_free(&chains[j]);
+
+            return bf_err_r(-EEXIST,
+                            "iptables hook %d is used by another front", i);
+        }
+    }
+
     /* Copy entries now, so we don't have to unload the programs if the copy
      * fails later. */
     entries = bf_memdup(replace->entries, replace->size);
@@ -634,22 +1046,28 @@ static int _bf_ipt_ruleset_set(struct ipt_replace *replace, size_t len)
             if (r)
                 return r;
 
-            r = bf_cgen_up(cgen);
+            /* The codegen is added to the context first, as its chain can
+             * be part of the program shared by the hook's codegens. */
+            r = bf_ctx_set_cgen(cgen);
             if (r) {
-                bf_err(
-                    "failed to generate and load program for iptables hook %d, skipping",
+                bf_err_r(
+                    r, "failed to store codegen for iptables hook %d, skipping",
                     i);
                 continue;
             }
 
-            r = bf_ctx_set_cgen(cgen);
+            r = bf_cgen_up(cgen);
             if (r) {
-                bf_err_r(
-                    r, "failed to store codegen for iptables hook %d, skipping",
+                (void)bf_ctx_unset_cgen(cgen);
+                bf_err(
+                    "failed to generate and load program for iptables hook %d, skipping",
                     i);
                 continue;
             }
 
+            TAKE_PTR(cgen);
+        } else if (bf_cgen_is_chain_current(cgen, chain)) {
+            bf_info("iptables hook %d is unchanged, skipping update", i);
             TAKE_PTR(cgen);
         } else {
             r = bf_cgen_update(cgen, &chain);
@@ -120,6 +120,59 @@ static const struct nla_policy _bf_nf_verdict_policy[__NFTA_VERDICT_MAX] = {
 };
 const bf_nfpolicy *bf_nf_verdict_policy = _bf_nf_verdict_policy;
 
+static const struct nla_policy _bf_nf_set_policy[__NFTA_SET_MAX] = {
+    [NFTA_SET_TABLE] = {.type = NLA_STRING},
+    [NFTA_SET_NAME] = {.type = NLA_STRING},
+    [NFTA_SET_FLAGS] = {.type = NLA_U32},
+    [NFTA_SET_KEY_TYPE] = {.type = NLA_U32},
+    [NFTA_SET_KEY_LEN] = {.type = NLA_U32},
+    [NFTA_SET_DATA_TYPE] = {.type = NLA_U32},
+    [NFTA_SET_DATA_LEN] = {.type = NLA_U32},
+    [NFTA_SET_POLICY] = {.type = NLA_U32},
+    [NFTA_SET_DESC] = {.type = NLA_NESTED},
+    [NFTA_SET_ID] = {.type = NLA_U32},
+    [NFTA_SET_TIMEOUT] = {.type = NLA_U64},
+    [NFTA_SET_GC_INTERVAL] = {.type = NLA_U32},
+    [NFTA_SET_USERDATA] = {.type = NLA_BINARY},
+    [NFTA_SET_OBJ_TYPE] = {.type = NLA_U32},
+    [NFTA_SET_HANDLE] = {.type = NLA_U64},
+    [NFTA_SET_EXPR] = {.type = NLA_NESTED},
+    [NFTA_SET_EXPRESSIONS] = {.type = NLA_NESTED},
+};
+const bf_nfpolicy *bf_nf_set_policy = _bf_nf_set_policy;
+
+static const struct nla_policy
+    _bf_nf_set_elem_list_policy[__NFTA_SET_ELEM_LIST_MAX] = {
+        [NFTA_SET_ELEM_LIST_TABLE] = {.type = NLA_STRING},
+        [NFTA_SET_ELEM_LIST_SET] = {.type = NLA_STRING},
+        [NFTA_SET_ELEM_LIST_ELEMENTS] = {.type = NLA_NESTED},
+        [NFTA_SET_ELEM_LIST_SET_ID] = {.type = NLA_U32},
+};
+const bf_nfpolicy *bf_nf_set_elem_list_policy = _bf_nf_set_elem_list_policy;
+
+static const struct nla_policy _bf_nf_set_elem_policy[__NFTA_SET_ELEM_MAX] = {
+    [NFTA_SET_ELEM_KEY] = {.type = NLA_NESTED},
+    [NFTA_SET_ELEM_DATA] = {.type = NLA_NESTED},
+    [NFTA_SET_ELEM_FLAGS] = {.type = NLA_U32},
+    [NFTA_SET_ELEM_TIMEOUT] = {.type = NLA_U64},
+    [NFTA_SET_ELEM_EXPIRATION] = {.type = NLA_U64},
+    [NFTA_SET_ELEM_USERDATA] = {.type = NLA_BINARY},
+    [NFTA_SET_ELEM_EXPR] = {.type = NLA_NESTED},
+    [NFTA_SET_ELEM_OBJREF] = {.type = NLA_STRING},
+    [NFTA_SET_ELEM_KEY_END] = {.type = NLA_NESTED},
+    [NFTA_SET_ELEM_EXPRESSIONS] = {.type = NLA_NESTED},
+};
+const bf_nfpolicy *bf_nf_set_elem_policy = _bf_nf_set_elem_policy;
+
+static const struct nla_policy _bf_nf_lookup_policy[__NFTA_LOOKUP_MAX] = {
+    [NFTA_LOOKUP_SET] = {.type = NLA_STRING},
+    [NFTA_LOOKUP_SREG] = {.type = NLA_U32},
+    [NFTA_LOOKUP_DREG] = {.type = NLA_U32},
+    [NFTA_LOOKUP_SET_ID] = {.type = NLA_U32},
+    [NFTA_LOOKUP_FLAGS] = {.type = NLA_U32},
+};
+const bf_nfpolicy *bf_nf_lookup_policy = _bf_nf_lookup_policy;
+
 int bf_nfmsg_new(struct bf_nfmsg **msg, uint8_t command, uint32_t seqnr)
 {
     bf_assert(msg);
@@ -55,6 +55,14 @@ extern const bf_nfpolicy *bf_nf_immediate_policy;
 extern const bf_nfpolicy *bf_nf_data_policy;
 /// Netlink validation policy for @c nft_verdict_attributes
 extern const bf_nfpolicy *bf_nf_verdict_policy;
+/// Netlink validation policy for @c nft_set_attributes
+extern const bf_nfpolicy *bf_nf_set_policy;
+/// Netlink validation policy for @c nft_set_elem_list_attributes
+extern const bf_nfpolicy *bf_nf_set_elem_list_policy;
+/// Netlink validation policy for @c nft_set_elem_attributes
+extern const bf_nfpolicy *bf_nf_set_elem_policy;
+/// Netlink validation policy for @c nft_lookup_attributes
+extern const bf_nfpolicy *bf_nf_lookup_policy;
 
 /**
  * @file nfmsg.h
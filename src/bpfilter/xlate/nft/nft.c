@@ -31,6 +31,7 @@
 #include "core/request.h"
 #include "core/response.h"
 #include "core/rule.h"
+#include "core/set.h"
 #include "core/verdict.h"
 
 struct bf_marsh;
@@ -45,6 +46,15 @@ enum
 static const char *_bf_table_name = "bpfilter";
 static const char *_bf_chain_name = "prerouting";
 
+/* nftables chains are evaluated after the iptables ones (priority 0) when
+ * both fronts define a chain for the same hook. */
+#define BF_NFT_CHAIN_PRIORITY 10
+
+static const struct bf_hook_opts _bf_nft_hook_opts = {
+    .used_opts = 1 << BF_HOOK_OPT_PRIORITY,
+    .priority = BF_NFT_CHAIN_PRIORITY,
+};
+
 static int _bf_nft_setup(void);
 static int _bf_nft_teardown(void);
 static int _bf_nft_request_handler(struct bf_request *request,
@@ -62,6 +72,14 @@ const struct bf_front_ops nft_front = {
 
 static bf_list *_bf_nft_rules = NULL;
 
+/**
+ * Cached @c NFT_MSG_NEWSET messages.
+ *
+ * The index of a set's message in this list is the index of the corresponding
+ * @ref bf_set in the codegen's chain.
+ */
+static bf_list *_bf_nft_sets = NULL;
+
 static int _bf_nft_setup(void)
 {
     int r;
@@ -76,37 +94,98 @@ static int _bf_nft_setup(void)
     if (r < 0)
         return bf_err_r(r, "failed to create bf_list");
 
+    r = bf_list_new(
+        &_bf_nft_sets,
+        (bf_list_ops[]) {{.free = (bf_list_ops_free)bf_nfmsg_free}});
+    if (r < 0) {
+        bf_list_free(&_bf_nft_rules);
+        return bf_err_r(r, "failed to create bf_list");
+    }
+
     return 0;
 }
 
 static int _bf_nft_teardown(void)
 {
     bf_list_free(&_bf_nft_rules);
+    bf_list_free(&_bf_nft_sets);
 
     return 0;
 }
 
-static int _bf_nft_marsh(struct bf_marsh **marsh)
+/**
+ * Serialize a list of cached @ref bf_nfmsg .
+ *
+ * @param msgs List of messages to serialize. Can't be NULL.
+ * @param marsh On success, points to the serialized messages. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_nft_marsh_nfmsgs(const bf_list *msgs, struct bf_marsh **marsh)
 {
+    bf_assert(msgs);
     bf_assert(marsh);
 
-    int r = 0;
+    _cleanup_bf_marsh_ struct bf_marsh *_marsh = NULL;
+    int r;
 
-    bf_list_foreach (_bf_nft_rules, rule_node) {
-        struct bf_nfmsg *msg = bf_list_node_get_data(rule_node);
+    r = bf_marsh_new(&_marsh, NULL, 0);
+    if (r < 0)
+        return r;
+
+    bf_list_foreach (msgs, msg_node) {
+        struct bf_nfmsg *msg = bf_list_node_get_data(msg_node);
 
-        r = bf_marsh_add_child_raw(marsh, bf_nfmsg_hdr(msg), bf_nfmsg_len(msg));
+        r = bf_marsh_add_child_raw(&_marsh, bf_nfmsg_hdr(msg),
+                                   bf_nfmsg_len(msg));
         if (r < 0)
-            return bf_err_r(r, "failed to add rule to marsh");
+            return bf_err_r(r, "failed to add bf_nfmsg to marsh");
     }
 
+    *marsh = TAKE_PTR(_marsh);
+
     return 0;
 }
 
-static int _bf_nft_unmarsh(struct bf_marsh *marsh)
+static int _bf_nft_marsh(struct bf_marsh **marsh)
 {
     bf_assert(marsh);
 
+    _cleanup_bf_marsh_ struct bf_marsh *rules = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *sets = NULL;
+    int r;
+
+    r = _bf_nft_marsh_nfmsgs(_bf_nft_rules, &rules);
+    if (r < 0)
+        return bf_err_r(r, "failed to serialize nft rules");
+
+    r = bf_marsh_add_child_obj(marsh, rules);
+    if (r < 0)
+        return bf_err_r(r, "failed to add rules to marsh");
+
+    r = _bf_nft_marsh_nfmsgs(_bf_nft_sets, &sets);
+    if (r < 0)
+        return bf_err_r(r, "failed to serialize nft sets");
+
+    r = bf_marsh_add_child_obj(marsh, sets);
+    if (r < 0)
+        return bf_err_r(r, "failed to add sets to marsh");
+
+    return 0;
+}
+
+/**
+ * Restore a list of @ref bf_nfmsg from serialized data.
+ *
+ * @param marsh Serialized messages. Can't be NULL.
+ * @param msgs On success, points to a new list containing the messages. Can't
+ *        be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_nft_unmarsh_nfmsgs(const struct bf_marsh *marsh, bf_list **msgs)
+{
+    bf_assert(marsh);
+    bf_assert(msgs);
+
     _cleanup_bf_list_ bf_list *list = NULL;
     struct bf_marsh *child = NULL;
     int r;
@@ -130,7 +209,36 @@ static int _bf_nft_unmarsh(struct bf_marsh *marsh)
         TAKE_PTR(msg);
     }
 
-    _bf_nft_rules = TAKE_PTR(list);
+    *msgs = TAKE_PTR(list);
+
+    return 0;
+}
+
+static int _bf_nft_unmarsh(struct bf_marsh *marsh)
+{
+    bf_assert(marsh);
+
+    _cleanup_bf_list_ bf_list *rules = NULL;
+    _cleanup_bf_list_ bf_list *sets = NULL;
+    struct bf_marsh *child = NULL;
+    int r;
+
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return bf_err_r(-EINVAL, "missing serialized nft rules");
+
+    r = _bf_nft_unmarsh_nfmsgs(child, &rules);
+    if (r < 0)
+        return r;
+
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return bf_err_r(-EINVAL, "missing serialized nft sets");
+
+    r = _bf_nft_unmarsh_nfmsgs(child, &sets);
+    if (r < 0)
+        return r;
+
+    _bf_nft_rules = TAKE_PTR(rules);
+    _bf_nft_sets = TAKE_PTR(sets);
 
     return 0;
 }
@@ -205,6 +313,74 @@ static int _bf_nft_newtable_cb(const struct bf_nfmsg *req)
     return 0;
 }
 
+/**
+ * Remove a set from the nftables chain and from the cached sets.
+ *
+ * @param cgen Codegen of the nftables chain. Can't be NULL.
+ * @param index Index of the set in the chain.
+ * @return 0 on success, or a negative errno value on failure. See
+ *         @ref bf_cgen_remove_set .
+ */
+static int _bf_nft_remove_set(struct bf_cgen *cgen, size_t index)
+{
+    bf_assert(cgen);
+
+    size_t idx = 0;
+    int r;
+
+    r = bf_cgen_remove_set(cgen, index);
+    if (r < 0)
+        return r;
+
+    bf_list_foreach (_bf_nft_sets, set_node) {
+        if (idx++ == index) {
+            bf_list_delete(_bf_nft_sets, set_node);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Remove the anonymous sets from the nftables chain.
+ *
+ * nftables binds anonymous sets to the rule using them: they are released
+ * along with the rule, without any @c NFT_MSG_DELSET request. The rules are
+ * dropped when the chain is replaced, so are the anonymous sets they used.
+ *
+ * Sets still used by a rule are kept. Failures are logged, but not reported:
+ * the sets are left in the chain.
+ *
+ * @param cgen Codegen of the nftables chain. Can't be NULL.
+ */
+static void _bf_nft_gc_sets(struct bf_cgen *cgen)
+{
+    bf_assert(cgen);
+
+    size_t idx = bf_list_size(_bf_nft_sets);
+    int r;
+
+    bf_list_foreach_rev (_bf_nft_sets, set_node) {
+        struct bf_nfmsg *msg = bf_list_node_get_data(set_node);
+        bf_nfattr *set_attrs[__NFTA_SET_MAX] = {};
+
+        --idx;
+
+        r = bf_nfmsg_parse(msg, set_attrs, __NFTA_SET_MAX, bf_nf_set_policy);
+        if (r < 0 || !set_attrs[NFTA_SET_FLAGS] ||
+            !(be32toh(bf_nfattr_get_u32(set_attrs[NFTA_SET_FLAGS])) &
+              NFT_SET_ANONYMOUS))
+            continue;
+
+        r = _bf_nft_remove_set(cgen, idx);
+        if (r < 0 && r != -EBUSY) {
+            bf_warn_r(r, "failed to remove anonymous set '%s'",
+                      bf_nfattr_get_str(set_attrs[NFTA_SET_NAME]));
+        }
+    }
+}
+
 static int _bf_nft_newchain_cb(const struct bf_nfmsg *req)
 {
     bf_assert(req);
@@ -265,11 +441,21 @@ static int _bf_nft_newchain_cb(const struct bf_nfmsg *req)
     if (r < 0)
         return bf_err_r(r, "failed to create new chain");
 
-    cgen = bf_ctx_get_cgen(BF_HOOK_NF_LOCAL_IN, NULL);
+    chain->hook_opts = _bf_nft_hook_opts;
+
+    cgen = bf_ctx_get_cgen(BF_HOOK_NF_LOCAL_IN, &_bf_nft_hook_opts);
     if (cgen && verdict != cgen->chain->policy) {
+        // Sets are defined independently from the chain, keep them.
+        bf_swap(chain->sets, cgen->chain->sets);
+
         r = bf_cgen_update(cgen, &chain);
-        if (r < 0)
+        if (r < 0) {
+            bf_swap(chain->sets, cgen->chain->sets);
             return bf_err_r(r, "failed to update codegen");
+        }
+
+        // Except the anonymous sets, bound to the rules of the old chain.
+        _bf_nft_gc_sets(cgen);
 
         bf_info("existing codegen updated with new policy");
     } else if (!cgen) {
@@ -277,14 +463,16 @@ static int _bf_nft_newchain_cb(const struct bf_nfmsg *req)
         if (r < 0)
             return bf_err_r(r, "failed to create bf_cgen");
 
-        r = bf_cgen_up(cgen);
+        /* The codegen is added to the context first, as its chain can be
+         * part of the program shared by the hook's codegens. */
+        r = bf_ctx_set_cgen(cgen);
         if (r < 0)
-            return bf_err_r(r, "failed to generate codegen");
+            return bf_err_r(r, "failed to store codegen in runtime context");
 
-        r = bf_ctx_set_cgen(cgen);
+        r = bf_cgen_up(cgen);
         if (r < 0) {
-            bf_cgen_unload(cgen);
-            return r;
+            (void)bf_ctx_unset_cgen(cgen);
+            return bf_err_r(r, "failed to generate codegen");
         }
 
         bf_info("new codegen created and loaded");
@@ -309,7 +497,7 @@ static int _bf_nft_getchain_cb(const struct bf_nfmsg *req,
     int r;
 
     // Only BF_HOOK_NF_LOCAL_IN is supported.
-    cgen = bf_ctx_get_cgen(BF_HOOK_NF_LOCAL_IN, NULL);
+    cgen = bf_ctx_get_cgen(BF_HOOK_NF_LOCAL_IN, &_bf_nft_hook_opts);
     if (!cgen) {
         /* If no codegen is found, do not fill the messages group and return
          * success. The response message will then contain only a DONE
@@ -360,6 +548,313 @@ bf_nfmsg_push_failure:
     return bf_err_r(-EINVAL, "failed to add attribute to Netlink message");
 }
 
+/**
+ * Get the index of a cached nftables set.
+ *
+ * nftables refers to sets by name, but anonymous sets created by @c nft all
+ * share the same name template (e.g. @c __set%d ), they are then identified by
+ * their transaction-specific ID. The cached sets are searched from the most
+ * recent to the oldest, so an anonymous set name always resolves to the
+ * latest set using it.
+ *
+ * @param name Name of the set. Can't be NULL.
+ * @param id Set ID attribute from the request, or NULL if the request
+ *        doesn't contain any.
+ * @param index On success, contains the index of the set in the codegen's
+ *        chain. Unchanged on failure. Can't be NULL.
+ * @return 0 on success, @c -ENOENT if the set doesn't exist, or another
+ *         negative errno value on failure.
+ */
+static int _bf_nft_get_set_index(const char *name, bf_nfattr *id,
+                                 size_t *index)
+{
+    bf_assert(name);
+    bf_assert(index);
+
+    size_t idx = bf_list_size(_bf_nft_sets);
+    int r;
+
+    bf_list_foreach_rev (_bf_nft_sets, set_node) {
+        struct bf_nfmsg *msg = bf_list_node_get_data(set_node);
+        bf_nfattr *set_attrs[__NFTA_SET_MAX] = {};
+        uint32_t flags = 0;
+
+        --idx;
+
+        r = bf_nfmsg_parse(msg, set_attrs, __NFTA_SET_MAX, bf_nf_set_policy);
+        if (r < 0)
+            return bf_err_r(r, "failed to parse cached NFT_MSG_NEWSET");
+
+        if (!bf_streq(bf_nfattr_get_str(set_attrs[NFTA_SET_NAME]), name))
+            continue;
+
+        if (set_attrs[NFTA_SET_FLAGS])
+            flags = be32toh(bf_nfattr_get_u32(set_attrs[NFTA_SET_FLAGS]));
+
+        if (flags & NFT_SET_ANONYMOUS &&
+            (!id || !set_attrs[NFTA_SET_ID] ||
+             bf_nfattr_get_u32(id) !=
+                 bf_nfattr_get_u32(set_attrs[NFTA_SET_ID])))
+            continue;
+
+        *index = idx;
+
+        return 0;
+    }
+
+    return -ENOENT;
+}
+
+static int _bf_nft_newset_cb(const struct bf_nfmsg *req)
+{
+    bf_assert(req);
+
+    _cleanup_bf_set_ struct bf_set *set = NULL;
+    _cleanup_bf_nfmsg_ struct bf_nfmsg *req_copy = NULL;
+    bf_nfattr *set_attrs[__NFTA_SET_MAX] = {};
+    struct bf_cgen *cgen;
+    const char *name;
+    uint32_t flags = 0;
+    size_t index;
+    int r;
+
+    r = bf_nfmsg_parse(req, set_attrs, __NFTA_SET_MAX, bf_nf_set_policy);
+    if (r < 0)
+        return bf_err_r(r, "failed to parse NFT_MSG_NEWSET attributes");
+
+    if (!set_attrs[NFTA_SET_TABLE] ||
+        !bf_streq(bf_nfattr_get_str(set_attrs[NFTA_SET_TABLE]),
+                  _bf_table_name))
+        return bf_err_r(-EINVAL, "invalid table name");
+
+    if (!set_attrs[NFTA_SET_NAME])
+        return bf_err_r(-EINVAL, "missing NFTA_SET_NAME attribute");
+    name = bf_nfattr_get_str(set_attrs[NFTA_SET_NAME]);
+
+    if (set_attrs[NFTA_SET_FLAGS])
+        flags = be32toh(bf_nfattr_get_u32(set_attrs[NFTA_SET_FLAGS]));
+
+    if (flags & ~(NFT_SET_ANONYMOUS | NFT_SET_CONSTANT))
+        return bf_err_r(-ENOTSUP, "unsupported set flags 0x%x", flags);
+
+    if (!set_attrs[NFTA_SET_KEY_LEN] ||
+        be32toh(bf_nfattr_get_u32(set_attrs[NFTA_SET_KEY_LEN])) !=
+            sizeof(uint32_t))
+        return bf_err_r(-ENOTSUP, "only IPv4 address sets are supported");
+
+    cgen = bf_ctx_get_cgen(BF_HOOK_NF_LOCAL_IN, &_bf_nft_hook_opts);
+    if (!cgen)
+        return bf_err_r(-EINVAL, "no codegen found for hook");
+
+    if (!(flags & NFT_SET_ANONYMOUS) &&
+        !_bf_nft_get_set_index(name, NULL, &index)) {
+        bf_info("set '%s' already exists, skipping", name);
+        return 0;
+    }
+
+    r = bf_set_new(&set, BF_SET_IP4);
+    if (r < 0)
+        return bf_err_r(r, "failed to create bf_set");
+
+    r = bf_nfmsg_new_from_nlmsghdr(&req_copy, bf_nfmsg_hdr(req));
+    if (r < 0)
+        return bf_err_r(r, "failed to create bf_nfmsg from nlmsghdr");
+
+    r = bf_list_add_tail(_bf_nft_sets, req_copy);
+    if (r < 0)
+        return bf_err_r(r, "failed to add set to bf_list");
+    TAKE_PTR(req_copy);
+
+    /* The program doesn't need to be regenerated: the set map is created
+     * by the next program generation, and filled from the chain's set. */
+    r = bf_list_add_tail(&cgen->chain->sets, set);
+    if (r < 0) {
+        bf_list_delete(_bf_nft_sets, bf_list_get_tail(_bf_nft_sets));
+        return bf_err_r(r, "failed to add set to chain");
+    }
+    TAKE_PTR(set);
+
+    return 0;
+}
+
+static int _bf_nft_delset_cb(const struct bf_nfmsg *req)
+{
+    bf_assert(req);
+
+    bf_nfattr *set_attrs[__NFTA_SET_MAX] = {};
+    struct bf_cgen *cgen;
+    const char *name;
+    size_t index;
+    int r;
+
+    r = bf_nfmsg_parse(req, set_attrs, __NFTA_SET_MAX, bf_nf_set_policy);
+    if (r < 0)
+        return bf_err_r(r, "failed to parse NFT_MSG_DELSET attributes");
+
+    if (!set_attrs[NFTA_SET_TABLE] ||
+        !bf_streq(bf_nfattr_get_str(set_attrs[NFTA_SET_TABLE]),
+                  _bf_table_name))
+        return bf_err_r(-EINVAL, "invalid table name");
+
+    if (!set_attrs[NFTA_SET_NAME])
+        return bf_err_r(-EINVAL, "missing NFTA_SET_NAME attribute");
+    name = bf_nfattr_get_str(set_attrs[NFTA_SET_NAME]);
+
+    cgen = bf_ctx_get_cgen(BF_HOOK_NF_LOCAL_IN, &_bf_nft_hook_opts);
+    if (!cgen)
+        return bf_err_r(-EINVAL, "no codegen found for hook");
+
+    r = _bf_nft_get_set_index(name, set_attrs[NFTA_SET_ID], &index);
+    if (r < 0)
+        return bf_err_r(r, "unknown set '%s'", name);
+
+    r = _bf_nft_remove_set(cgen, index);
+    if (r < 0)
+        return bf_err_r(r, "failed to remove set '%s'", name);
+
+    return 0;
+}
+
+/**
+ * Add or remove elements from an nftables set.
+ *
+ * Elements are added to (or removed from) the set map of the loaded program
+ * directly, the program is not regenerated. See @ref bf_cgen_add_set_elem .
+ *
+ * @param req @c NFT_MSG_NEWSETELEM or @c NFT_MSG_DELSETELEM request. Can't be
+ *        NULL.
+ * @param add If true, the elements are added to the set. Otherwise, they are
+ *        removed from it.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_nft_setelem_cb(const struct bf_nfmsg *req, bool add)
+{
+    bf_assert(req);
+
+    bf_nfattr *list_attrs[__NFTA_SET_ELEM_LIST_MAX] = {};
+    bf_nfattr *elem_attrs[__NFTA_SET_ELEM_MAX] = {};
+    bf_nfattr *data_attrs[__NFTA_DATA_MAX] = {};
+    struct bf_cgen *cgen;
+    const char *name;
+    bf_nfattr *elem;
+    void *key;
+    size_t index;
+    size_t rem;
+    int r;
+
+    r = bf_nfmsg_parse(req, list_attrs, __NFTA_SET_ELEM_LIST_MAX,
+                       bf_nf_set_elem_list_policy);
+    if (r < 0)
+        return bf_err_r(r, "failed to parse NFT_MSG_*SETELEM attributes");
+
+    if (!list_attrs[NFTA_SET_ELEM_LIST_TABLE] ||
+        !bf_streq(bf_nfattr_get_str(list_attrs[NFTA_SET_ELEM_LIST_TABLE]),
+                  _bf_table_name))
+        return bf_err_r(-EINVAL, "invalid table name");
+
+    if (!list_attrs[NFTA_SET_ELEM_LIST_SET])
+        return bf_err_r(-EINVAL, "missing NFTA_SET_ELEM_LIST_SET attribute");
+    name = bf_nfattr_get_str(list_attrs[NFTA_SET_ELEM_LIST_SET]);
+
+    if (!list_attrs[NFTA_SET_ELEM_LIST_ELEMENTS]) {
+        return bf_err_r(-ENOTSUP,
+                        "missing NFTA_SET_ELEM_LIST_ELEMENTS attribute");
+    }
+
+    cgen = bf_ctx_get_cgen(BF_HOOK_NF_LOCAL_IN, &_bf_nft_hook_opts);
+    if (!cgen)
+        return bf_err_r(-EINVAL, "no codegen found for hook");
+
+    r = _bf_nft_get_set_index(name, list_attrs[NFTA_SET_ELEM_LIST_SET_ID],
+                              &index);
+    if (r < 0)
+        return bf_err_r(r, "unknown set '%s'", name);
+
+    rem = bf_nfattr_data_len(list_attrs[NFTA_SET_ELEM_LIST_ELEMENTS]);
+    elem = bf_nfattr_data(list_attrs[NFTA_SET_ELEM_LIST_ELEMENTS]);
+    while (bf_nfattr_is_ok(elem, rem)) {
+        r = bf_nfattr_parse(elem, elem_attrs, __NFTA_SET_ELEM_MAX,
+                            bf_nf_set_elem_policy);
+        if (r < 0)
+            return bf_err_r(r, "failed to parse NFTA_LIST_ELEM attributes");
+
+        if (!elem_attrs[NFTA_SET_ELEM_KEY])
+            return bf_err_r(-EINVAL, "missing NFTA_SET_ELEM_KEY attribute");
+
+        r = bf_nfattr_parse(elem_attrs[NFTA_SET_ELEM_KEY], data_attrs,
+                            __NFTA_DATA_MAX, bf_nf_data_policy);
+        if (r < 0)
+            return bf_err_r(r, "failed to parse NFTA_SET_ELEM_KEY attributes");
+
+        if (!data_attrs[NFTA_DATA_VALUE] ||
+            bf_nfattr_data_len(data_attrs[NFTA_DATA_VALUE]) !=
+                sizeof(uint32_t))
+            return bf_err_r(-EINVAL, "invalid set element key");
+
+        key = bf_nfattr_data(data_attrs[NFTA_DATA_VALUE]);
+        if (add)
+            r = bf_cgen_add_set_elem(cgen, index, key);
+        else
+            r = bf_cgen_remove_set_elem(cgen, index, key);
+        if (r < 0) {
+            return bf_err_r(r, "failed to %s element of set '%s'",
+                            add ? "add" : "remove", name);
+        }
+
+        elem = bf_nfattr_next(elem, &rem);
+    }
+
+    return 0;
+}
+
+/**
+ * Parse an nftables @c lookup expression.
+ *
+ * Only lookups into sets are supported: maps (lookups with a destination
+ * register) and inverted lookups are rejected.
+ *
+ * @param attr @c NFTA_EXPR_DATA attribute of the expression. Can't be NULL.
+ * @param set_index On success, contains the index of the set to lookup into.
+ *        Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+static int _bf_nft_parse_lookup(bf_nfattr *attr, uint32_t *set_index)
+{
+    bf_assert(attr);
+    bf_assert(set_index);
+
+    bf_nfattr *lookup_attrs[__NFTA_LOOKUP_MAX] = {};
+    size_t index;
+    int r;
+
+    r = bf_nfattr_parse(attr, lookup_attrs, __NFTA_LOOKUP_MAX,
+                        bf_nf_lookup_policy);
+    if (r < 0)
+        return bf_err_r(r, "failed to parse NFTA_EXPR_DATA attributes");
+
+    if (!lookup_attrs[NFTA_LOOKUP_SET])
+        return bf_err_r(-EINVAL, "missing NFTA_LOOKUP_SET attribute");
+
+    if (lookup_attrs[NFTA_LOOKUP_DREG])
+        return bf_err_r(-ENOTSUP, "nftables maps are not supported");
+
+    if (lookup_attrs[NFTA_LOOKUP_FLAGS] &&
+        be32toh(bf_nfattr_get_u32(lookup_attrs[NFTA_LOOKUP_FLAGS])) &
+            NFT_LOOKUP_F_INV)
+        return bf_err_r(-ENOTSUP, "inverted lookups are not supported");
+
+    r = _bf_nft_get_set_index(bf_nfattr_get_str(lookup_attrs[NFTA_LOOKUP_SET]),
+                              lookup_attrs[NFTA_LOOKUP_SET_ID], &index);
+    if (r < 0) {
+        return bf_err_r(r, "unknown set '%s'",
+                        bf_nfattr_get_str(lookup_attrs[NFTA_LOOKUP_SET]));
+    }
+
+    *set_index = (uint32_t)index;
+
+    return 0;
+}
+
 static int _bf_nft_newrule_cb(const struct bf_nfmsg *req)
 {
     bf_assert(req);
@@ -437,26 +932,42 @@ static int _bf_nft_newrule_cb(const struct bf_nfmsg *req)
         return bf_err_r(r, "failed to parse NFTA_RULE_EXPRESSIONS attributes");
     }
 
-    if (!expr_attrs[NFTA_EXPR_NAME] ||
-        !bf_streq(bf_nfattr_get_str(expr_attrs[NFTA_EXPR_NAME]), "cmp"))
-        return bf_err_r(-EINVAL, "expecting rule expression 'cmp'");
+    if (!expr_attrs[NFTA_EXPR_NAME])
+        return bf_err_r(-EINVAL, "missing NFTA_EXPR_NAME attribute");
 
-    r = bf_nfattr_parse(expr_attrs[NFTA_EXPR_DATA], cmp_attrs, __NFTA_CMP_MAX,
-                        bf_nf_cmp_policy);
-    if (r < 0)
-        return bf_err_r(r, "failed to parse NFTA_EXPR_DATA attributes");
+    uint32_t cmp_value = 0;
+    uint32_t set_index = 0;
+    bool lookup = false;
+
+    if (bf_streq(bf_nfattr_get_str(expr_attrs[NFTA_EXPR_NAME]), "lookup")) {
+        r = _bf_nft_parse_lookup(expr_attrs[NFTA_EXPR_DATA], &set_index);
+        if (r < 0)
+            return r;
 
-    uint32_t op = be32toh(bf_nfattr_get_u32(cmp_attrs[NFTA_CMP_OP]));
-    if (op != NFT_CMP_EQ)
-        return bf_err_r(-EINVAL, "only NFTA_CMP_OP is supported");
+        if (len != sizeof(uint32_t))
+            return bf_err_r(-ENOTSUP, "only IPv4 address lookups supported");
 
-    r = bf_nfattr_parse(cmp_attrs[NFTA_CMP_DATA], data_attrs, __NFTA_DATA_MAX,
-                        bf_nf_data_policy);
-    if (r < 0)
-        return bf_err_r(r, "failed to parse NFTA_CMP_DATA attributes");
+        lookup = true;
+    } else if (bf_streq(bf_nfattr_get_str(expr_attrs[NFTA_EXPR_NAME]),
+                        "cmp")) {
+        r = bf_nfattr_parse(expr_attrs[NFTA_EXPR_DATA], cmp_attrs,
+                            __NFTA_CMP_MAX, bf_nf_cmp_policy);
+        if (r < 0)
+            return bf_err_r(r, "failed to parse NFTA_EXPR_DATA attributes");
 
-    uint32_t cmp_value =
-        be32toh(bf_nfattr_get_u32(data_attrs[NFTA_DATA_VALUE]));
+        uint32_t op = be32toh(bf_nfattr_get_u32(cmp_attrs[NFTA_CMP_OP]));
+        if (op != NFT_CMP_EQ)
+            return bf_err_r(-EINVAL, "only NFTA_CMP_OP is supported");
+
+        r = bf_nfattr_parse(cmp_attrs[NFTA_CMP_DATA], data_attrs,
+                            __NFTA_DATA_MAX, bf_nf_data_policy);
+        if (r < 0)
+            return bf_err_r(r, "failed to parse NFTA_CMP_DATA attributes");
+
+        cmp_value = be32toh(bf_nfattr_get_u32(data_attrs[NFTA_DATA_VALUE]));
+    } else {
+        return bf_err_r(-EINVAL, "expecting rule expression 'cmp' or 'lookup'");
+    }
 
     attr = bf_nfattr_next(attr, &rem);
     if (!bf_nfattr_is_ok(attr, rem))
@@ -530,7 +1041,7 @@ static int _bf_nft_newrule_cb(const struct bf_nfmsg *req)
     }
 
     // Add the rule to the relevant codegen
-    cgen = bf_ctx_get_cgen(BF_HOOK_NF_LOCAL_IN, NULL);
+    cgen = bf_ctx_get_cgen(BF_HOOK_NF_LOCAL_IN, &_bf_nft_hook_opts);
     if (!cgen)
         return bf_err_r(-EINVAL, "no codegen found for hook");
 
@@ -541,6 +1052,9 @@ static int _bf_nft_newrule_cb(const struct bf_nfmsg *req)
     rule->counters = counter;
     switch (off) {
     case BF_IP4HDR_PROTO_OFFSET:
+        if (lookup)
+            return bf_err_r(-ENOTSUP, "lookup on IPv4 protocol unsupported");
+
         r = bf_rule_add_matcher(rule, BF_MATCHER_IP4_PROTO, BF_MATCHER_EQ,
                                 (uint16_t[]) {htobe32(cmp_value)},
                                 sizeof(uint16_t));
@@ -548,6 +1062,15 @@ static int _bf_nft_newrule_cb(const struct bf_nfmsg *req)
             return r;
         break;
     case BF_IP4HDR_SADDR_OFFSET:
+        if (lookup) {
+            r = bf_rule_add_matcher(rule, BF_MATCHER_IP4_SRC_ADDR,
+                                    BF_MATCHER_IN, &set_index,
+                                    sizeof(set_index));
+            if (r)
+                return r;
+            break;
+        }
+
         r = bf_rule_add_matcher(
             rule, BF_MATCHER_IP4_SRC_ADDR, BF_MATCHER_EQ,
             (struct bf_matcher_ip4_addr[]) {
@@ -557,6 +1080,15 @@ static int _bf_nft_newrule_cb(const struct bf_nfmsg *req)
             return r;
         break;
     case BF_IP4HDR_DADDR_OFFSET:
+        if (lookup) {
+            r = bf_rule_add_matcher(rule, BF_MATCHER_IP4_DST_ADDR,
+                                    BF_MATCHER_IN, &set_index,
+                                    sizeof(set_index));
+            if (r)
+                return r;
+            break;
+        }
+
         r = bf_rule_add_matcher(
             rule, BF_MATCHER_IP4_DST_ADDR, BF_MATCHER_EQ,
             (struct bf_matcher_ip4_addr[]) {
@@ -578,9 +1110,14 @@ static int _bf_nft_newrule_cb(const struct bf_nfmsg *req)
         return bf_err_r(r, "failed to add rule to chain");
     TAKE_PTR(rule);
 
-    r = bf_cgen_update(cgen, &cgen->chain);
-    if (r < 0)
-        return bf_err_r(r, "failed to update codegen");
+    if (bf_cgen_is_chain_current(cgen, cgen->chain)) {
+        bf_info("chain for %s is unchanged, skipping update",
+                bf_hook_to_str(cgen->chain->hook));
+    } else {
+        r = bf_cgen_update(cgen, &cgen->chain);
+        if (r < 0)
+            return bf_err_r(r, "failed to update codegen");
+    }
 
     // Backup the rule in the front-end context
     r = bf_nfmsg_new_from_nlmsghdr(&req_copy, bf_nfmsg_hdr(req));
@@ -654,8 +1191,9 @@ static int _bf_nft_getrule_cb(const struct bf_nfmsg *req,
                     struct bf_counter counter;
 
                     r = bf_cgen_get_counter(
-                        bf_ctx_get_cgen(BF_HOOK_NF_LOCAL_IN, NULL), i,
-                        &counter);
+                        bf_ctx_get_cgen(BF_HOOK_NF_LOCAL_IN,
+                                        &_bf_nft_hook_opts),
+                        i, &counter);
                     if (r < 0)
                         return bf_err_r(r, "failed to get counter");
 
@@ -714,6 +1252,18 @@ static int _bf_nft_request_handle(const struct bf_nfmsg *req,
     case NFT_MSG_NEWRULE:
         r = _bf_nft_newrule_cb(req);
         break;
+    case NFT_MSG_NEWSET:
+        r = _bf_nft_newset_cb(req);
+        break;
+    case NFT_MSG_DELSET:
+        r = _bf_nft_delset_cb(req);
+        break;
+    case NFT_MSG_NEWSETELEM:
+        r = _bf_nft_setelem_cb(req, true);
+        break;
+    case NFT_MSG_DELSETELEM:
+        r = _bf_nft_setelem_cb(req, false);
+        break;
     case NFT_MSG_GETOBJ:
     case NFT_MSG_GETFLOWTABLE:
     case NFT_MSG_GETSET:
@@ -88,6 +88,29 @@ int bf_bpf_map_lookup_elem(int fd, const void *key, void *value)
     return bf_bpf(BPF_MAP_LOOKUP_ELEM, &attr);
 }
 
+int bf_bpf_map_lookup_batch(int fd, const void *in_batch, void *out_batch,
+                            void *keys, void *values, uint32_t *count)
+{
+    union bpf_attr attr = {
+        .batch.map_fd = fd,
+        .batch.in_batch = bf_ptr_to_u64(in_batch),
+        .batch.out_batch = bf_ptr_to_u64(out_batch),
+        .batch.keys = bf_ptr_to_u64(keys),
+        .batch.values = bf_ptr_to_u64(values),
+        .batch.count = *count,
+    };
+    int r;
+
+    bf_assert(out_batch && keys && values && count);
+
+    r = bf_bpf(BPF_MAP_LOOKUP_BATCH, &attr);
+
+    // The number of elements copied is updated even on -ENOENT.
+    *count = attr.batch.count;
+
+    return r;
+}
+
 int bf_bpf_map_update_elem(int fd, const void *key, void *value)
 {
     union bpf_attr attr = {
@@ -139,8 +162,37 @@ int bf_bpf_obj_get(const char *path, int dir_fd, int *fd)
     return 0;
 }
 
+int bf_bpf_obj_get_info(int fd, void *info, uint32_t info_len)
+{
+    union bpf_attr attr = {
+        .info.bpf_fd = fd,
+        .info.info_len = info_len,
+        .info.info = bf_ptr_to_u64(info),
+    };
+
+    bf_assert(info);
+
+    return bf_bpf(BPF_OBJ_GET_INFO_BY_FD, &attr);
+}
+
 int bf_prog_run(int prog_fd, const void *pkt, size_t pkt_len, const void *ctx,
                 size_t ctx_len)
+{
+    uint32_t retval;
+    uint32_t duration;
+    int r;
+
+    r = bf_bpf_prog_test_run(prog_fd, pkt, pkt_len, ctx, ctx_len, 1, &retval,
+                             &duration);
+    if (r)
+        return bf_err_r(r, "failed to run the test program");
+
+    return (int)retval;
+}
+
+int bf_bpf_prog_test_run(int prog_fd, const void *pkt, size_t pkt_len,
+                         const void *ctx, size_t ctx_len, uint32_t repeat,
+                         uint32_t *retval, uint32_t *duration)
 {
     union bpf_attr attr = {};
     int r;
@@ -148,11 +200,13 @@ int bf_prog_run(int prog_fd, const void *pkt, size_t pkt_len, const void *ctx,
     bf_assert(pkt);
     bf_assert(pkt_len > 0);
     bf_assert(!(!!ctx ^ !!ctx_len));
+    bf_assert(repeat > 0);
+    bf_assert(retval && duration);
 
     attr.test.prog_fd = prog_fd;
     attr.test.data_size_in = pkt_len;
     attr.test.data_in = ((unsigned long long)(pkt));
-    attr.test.repeat = 1;
+    attr.test.repeat = repeat;
 
     if (ctx_len) {
         attr.test.ctx_size_in = ctx_len;
@@ -161,7 +215,10 @@ int bf_prog_run(int prog_fd, const void *pkt, size_t pkt_len, const void *ctx,
 
     r = bf_bpf(BPF_PROG_TEST_RUN, &attr);
     if (r)
-        return bf_err_r(r, "failed to run the test program");
+        return r;
+
+    *retval = attr.test.retval;
+    *duration = attr.test.duration;
 
-    return (int)attr.test.retval;
+    return 0;
 }
@@ -57,6 +57,25 @@ int bf_bpf_prog_load(const char *name, unsigned int prog_type, void *img,
  */
 int bf_bpf_map_lookup_elem(int fd, const void *key, void *value);
 
+/**
+ * Get multiple elements from a map in a single system call.
+ *
+ * @param fd File descriptor of the map to search in.
+ * @param in_batch Key to start the lookup after. If NULL, the lookup starts
+ *        from the first element of the map.
+ * @param out_batch On success, contains the key to start the next lookup
+ *        after. Can't be NULL.
+ * @param keys Array of @p *count keys to fill. Can't be NULL.
+ * @param values Array of @p *count values to fill. Can't be NULL.
+ * @param count Number of elements to lookup. On success, contains the number
+ *        of elements copied. Can't be NULL.
+ * @return 0 on success, -ENOENT if the end of the map has been reached (in
+ *         which case @p *count is still updated), or another negative errno
+ *         value on failure.
+ */
+int bf_bpf_map_lookup_batch(int fd, const void *in_batch, void *out_batch,
+                            void *keys, void *values, uint32_t *count);
+
 /**
  * Update (or insert) an element in a map.
  *
@@ -98,6 +117,18 @@ int bf_bpf_obj_pin(const char *path, int fd, int dir_fd);
  */
 int bf_bpf_obj_get(const char *path, int dir_fd, int *fd);
 
+/**
+ * Get information about a BPF object.
+ *
+ * @param fd File descriptor of the BPF object. Must be valid.
+ * @param info Buffer to store the information into, its type depends on the
+ *        type of BPF object (e.g. @c struct bpf_prog_info for a program).
+ *        Can't be NULL.
+ * @param info_len Size of @p info , in bytes.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_bpf_obj_get_info(int fd, void *info, uint32_t info_len);
+
 /**
  * Call `BPF_PROG_TEST_RUN` on @p prog_fd .
  *
@@ -111,3 +142,25 @@ int bf_bpf_obj_get(const char *path, int dir_fd, int *fd);
  */
 int bf_prog_run(int prog_fd, const void *pkt, size_t pkt_len, const void *ctx,
                 size_t ctx_len);
+
+/**
+ * Call `BPF_PROG_TEST_RUN` on @p prog_fd , multiple times.
+ *
+ * Running the program multiple times in a single system call amortizes the
+ * cost of the system call, and provides a more accurate duration.
+ *
+ * @param prog_fd File descriptor of the program to test. Must be valid.
+ * @param pkt Test packet to send to the BPF program. Can't be NULL.
+ * @param pkt_len Size (in bytes) of the test packet. Can't be 0.
+ * @param ctx Context to run the program from. If NULL, @p ctx_len must be 0.
+ * @param ctx_len Size of the program's context. If 0, @p ctx must be NULL.
+ * @param repeat Number of times to run the program. Can't be 0.
+ * @param retval On success, contains the return value of the last run of the
+ *        program. Can't be NULL.
+ * @param duration On success, contains the average duration of a run of the
+ *        program, in nanoseconds. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_bpf_prog_test_run(int prog_fd, const void *pkt, size_t pkt_len,
+                         const void *ctx, size_t ctx_len, uint32_t repeat,
+                         uint32_t *retval, uint32_t *duration);
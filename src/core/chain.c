@@ -17,6 +17,7 @@
 #include "core/marsh.h"
 #include "core/rule.h"
 #include "core/set.h"
+#include "core/subchain.h"
 #include "core/verdict.h"
 
 int bf_chain_new(struct bf_chain **chain, enum bf_hook hook,
@@ -35,11 +36,14 @@ int bf_chain_new(struct bf_chain **chain, enum bf_hook hook,
     _chain->hook = hook;
     _chain->hook_opts = (struct bf_hook_opts) {};
     _chain->policy = policy;
+    _chain->next_handle = 1;
 
     _chain->sets = bf_set_list();
     if (sets)
         bf_swap(_chain->sets, *sets);
 
+    _chain->subchains = bf_subchain_list();
+
     _chain->rules = bf_rule_list();
     if (rules) {
         bf_list_foreach (rules, rule_node) {
@@ -118,6 +122,16 @@ int bf_chain_new_from_marsh(struct bf_chain **chain,
         memcpy(&_chain->hook_opts.attach, list_elem->data,
                sizeof(_chain->hook_opts.attach));
 
+        if (!(list_elem = bf_marsh_next_child(chain_elem, list_elem)))
+            return -EINVAL;
+        memcpy(&_chain->hook_opts.priority, list_elem->data,
+               sizeof(_chain->hook_opts.priority));
+
+        if (!(list_elem = bf_marsh_next_child(chain_elem, list_elem)))
+            return -EINVAL;
+        memcpy(&_chain->hook_opts.mode, list_elem->data,
+               sizeof(_chain->hook_opts.mode));
+
         if (bf_marsh_next_child(chain_elem, list_elem)) {
             return bf_err_r(-E2BIG,
                             "too many serialized fields for bf_hook_opts");
@@ -158,9 +172,28 @@ int bf_chain_new_from_marsh(struct bf_chain **chain,
         if (r)
             return r;
 
+        _chain->next_handle = bf_max(_chain->next_handle, rule->handle + 1);
         TAKE_PTR(rule);
     }
 
+    // Unmarsh bf_chain.subchains
+    if (!(chain_elem = bf_marsh_next_child(marsh, chain_elem)))
+        return -EINVAL;
+    list_elem = NULL;
+    while ((list_elem = bf_marsh_next_child(chain_elem, list_elem))) {
+        _cleanup_bf_subchain_ struct bf_subchain *subchain = NULL;
+
+        r = bf_subchain_new_from_marsh(&subchain, list_elem);
+        if (r)
+            return r;
+
+        r = bf_list_add_tail(&_chain->subchains, subchain);
+        if (r)
+            return r;
+
+        TAKE_PTR(subchain);
+    }
+
     *chain = TAKE_PTR(_chain);
 
     return 0;
@@ -175,6 +208,7 @@ void bf_chain_free(struct bf_chain **chain)
 
     bf_list_clean(&(*chain)->sets);
     bf_list_clean(&(*chain)->rules);
+    bf_list_clean(&(*chain)->subchains);
     bf_hook_opts_clean(&(*chain)->hook_opts);
     freep((void *)chain);
 }
@@ -237,6 +271,16 @@ int bf_chain_marsh(const struct bf_chain *chain, struct bf_marsh **marsh)
         if (r < 0)
             return r;
 
+        r = bf_marsh_add_child_raw(&child, &chain->hook_opts.priority,
+                                   sizeof(chain->hook_opts.priority));
+        if (r < 0)
+            return r;
+
+        r = bf_marsh_add_child_raw(&child, &chain->hook_opts.mode,
+                                   sizeof(chain->hook_opts.mode));
+        if (r < 0)
+            return r;
+
         r = bf_marsh_add_child_obj(&_marsh, child);
         if (r < 0)
             return r;
@@ -268,6 +312,19 @@ int bf_chain_marsh(const struct bf_chain *chain, struct bf_marsh **marsh)
             return r;
     }
 
+    {
+        // Serialize bf_chain.subchains
+        _cleanup_bf_marsh_ struct bf_marsh *child = NULL;
+
+        r = bf_list_marsh(&chain->subchains, &child);
+        if (r < 0)
+            return r;
+
+        r = bf_marsh_add_child_obj(&_marsh, child);
+        if (r < 0)
+            return r;
+    }
+
     *marsh = TAKE_PTR(_marsh);
 
     return 0;
@@ -298,8 +355,7 @@ void bf_chain_dump(const struct bf_chain *chain, prefix_t *prefix)
     }
     bf_dump_prefix_pop(prefix);
 
-    DUMP(bf_dump_prefix_last(prefix), "rules: bf_list<bf_rule>[%lu]",
-         bf_list_size(&chain->rules));
+    DUMP(prefix, "rules: bf_list<bf_rule>[%lu]", bf_list_size(&chain->rules));
     bf_dump_prefix_push(prefix);
     bf_list_foreach (&chain->rules, rule_node) {
         struct bf_rule *rule = bf_list_node_get_data(rule_node);
@@ -309,6 +365,19 @@ void bf_chain_dump(const struct bf_chain *chain, prefix_t *prefix)
 
         bf_rule_dump(rule, prefix);
     }
+    bf_dump_prefix_pop(prefix);
+
+    DUMP(bf_dump_prefix_last(prefix), "subchains: bf_list<bf_subchain>[%lu]",
+         bf_list_size(&chain->subchains));
+    bf_dump_prefix_push(prefix);
+    bf_list_foreach (&chain->subchains, subchain_node) {
+        struct bf_subchain *subchain = bf_list_node_get_data(subchain_node);
+
+        if (bf_list_is_tail(&chain->subchains, subchain_node))
+            bf_dump_prefix_last(prefix);
+
+        bf_subchain_dump(subchain, prefix);
+    }
 
     bf_dump_prefix_pop(prefix);
     bf_dump_prefix_pop(prefix);
@@ -316,10 +385,87 @@ void bf_chain_dump(const struct bf_chain *chain, prefix_t *prefix)
 
 int bf_chain_add_rule(struct bf_chain *chain, struct bf_rule *rule)
 {
+    int r;
+
     bf_assert(chain);
     bf_assert(rule);
 
     rule->index = bf_list_size(&chain->rules);
+    rule->handle = chain->next_handle;
+
+    r = bf_list_add_tail(&chain->rules, rule);
+    if (r)
+        return r;
+
+    ++chain->next_handle;
+
+    return 0;
+}
+
+struct bf_rule *bf_chain_get_rule(const struct bf_chain *chain,
+                                  uint32_t handle)
+{
+    bf_assert(chain);
+
+    bf_list_foreach (&chain->rules, rule_node) {
+        struct bf_rule *rule = bf_list_node_get_data(rule_node);
+
+        if (rule->handle == handle)
+            return rule;
+    }
+
+    return NULL;
+}
+
+int bf_chain_add_subchain(struct bf_chain *chain, struct bf_subchain *subchain)
+{
+    bf_assert(chain && subchain);
+
+    if (bf_chain_get_subchain_index(chain, subchain->name) >= 0) {
+        return bf_err_r(-EEXIST, "sub-chain '%s' is already defined",
+                        subchain->name);
+    }
+
+    return bf_list_add_tail(&chain->subchains, subchain);
+}
+
+int bf_chain_get_subchain_index(const struct bf_chain *chain,
+                                const char *name)
+{
+    int index = 0;
+
+    bf_assert(chain && name);
+
+    bf_list_foreach (&chain->subchains, subchain_node) {
+        struct bf_subchain *subchain = bf_list_node_get_data(subchain_node);
+
+        if (bf_streq(subchain->name, name))
+            return index;
+
+        ++index;
+    }
+
+    return -ENOENT;
+}
+
+size_t bf_chain_get_subchain_counters_offset(const struct bf_chain *chain,
+                                             size_t index)
+{
+    size_t offset;
+
+    bf_assert(chain);
+    bf_assert(index <= bf_list_size(&chain->subchains));
+
+    offset = bf_list_size(&chain->rules);
+
+    bf_list_foreach (&chain->subchains, subchain_node) {
+        struct bf_subchain *subchain = bf_list_node_get_data(subchain_node);
+
+        if (!index--)
+            break;
+
+        offset += bf_list_size(&subchain->rules);
+    }
 
-    return bf_list_add_tail(&chain->rules, rule);
+    return offset;
 }
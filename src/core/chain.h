@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include "core/dump.h"
 #include "core/hook.h"
 #include "core/list.h"
@@ -12,6 +14,7 @@
 
 struct bf_marsh;
 struct bf_rule;
+struct bf_subchain;
 
 #define _cleanup_bf_chain_ __attribute__((cleanup(bf_chain_free)))
 
@@ -24,6 +27,34 @@ struct bf_rule;
     ((bf_list) {.ops = {.free = (bf_list_ops_free)bf_chain_free,               \
                         .marsh = (bf_list_ops_marsh)bf_chain_marsh}})
 
+/**
+ * @enum bf_chain_patch_op
+ *
+ * Operations that can be applied to a single rule of an existing chain,
+ * without sending the whole chain again. Rules are identified by their
+ * handle, see @ref bf_rule::handle .
+ *
+ * @var bf_chain_patch_op::BF_CHAIN_PATCH_INSERT_BEFORE
+ *  Insert a new rule before the rule with the given handle. If the handle is
+ *  0, the new rule is added at the end of the chain.
+ * @var bf_chain_patch_op::BF_CHAIN_PATCH_INSERT_AFTER
+ *  Insert a new rule after the rule with the given handle. If the handle is
+ *  0, the new rule is added at the beginning of the chain.
+ * @var bf_chain_patch_op::BF_CHAIN_PATCH_DELETE
+ *  Delete the rule with the given handle.
+ * @var bf_chain_patch_op::BF_CHAIN_PATCH_REPLACE
+ *  Replace the rule with the given handle. The new rule keeps the handle of
+ *  the rule it replaces.
+ */
+enum bf_chain_patch_op
+{
+    BF_CHAIN_PATCH_INSERT_BEFORE,
+    BF_CHAIN_PATCH_INSERT_AFTER,
+    BF_CHAIN_PATCH_DELETE,
+    BF_CHAIN_PATCH_REPLACE,
+    _BF_CHAIN_PATCH_MAX,
+};
+
 struct bf_chain
 {
     enum bf_hook hook;
@@ -32,6 +63,15 @@ struct bf_chain
     enum bf_verdict policy;
     bf_list sets;
     bf_list rules;
+
+    /** User-defined sub-chains, evaluated by rules with a @c BF_VERDICT_JUMP
+     * or @c BF_VERDICT_GOTO verdict. Identified by their index in this list,
+     * see @ref bf_rule::target . */
+    bf_list subchains;
+
+    /* Handle to assign to the next rule added to the chain. Not serialized,
+     * but computed from the rules' handles when the chain is deserialized. */
+    uint32_t next_handle;
 };
 
 /**
@@ -86,10 +126,61 @@ void bf_chain_dump(const struct bf_chain *chain, prefix_t *prefix);
  * Insert a rule into the chain.
  *
  * The chain will own the rule and is responsible for freeing it. The rule's
- * index will automatically be updated.
+ * index and handle will automatically be updated.
  *
  * @param chain Chain to insert the rule into. Can't be NULL.
  * @param rule Rule to insert into the chain. Can't be NULL.
  * @return 0 on success, or a negative errno value on error.
  */
 int bf_chain_add_rule(struct bf_chain *chain, struct bf_rule *rule);
+
+/**
+ * Get a chain's rule from its handle.
+ *
+ * @param chain Chain to get the rule from. Can't be NULL.
+ * @param handle Handle of the rule to find.
+ * @return The rule with the handle @p handle , or NULL if there is no such
+ *         rule in the chain.
+ */
+struct bf_rule *bf_chain_get_rule(const struct bf_chain *chain,
+                                  uint32_t handle);
+
+/**
+ * Add a sub-chain to a chain.
+ *
+ * The chain will own the sub-chain on success. The sub-chain's index in the
+ * chain is the number of sub-chains defined before it was added.
+ *
+ * @param chain Chain to add the sub-chain to. Can't be NULL.
+ * @param subchain Sub-chain to add. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure. If a sub-chain
+ *         with the same name already exists, @c -EEXIST is returned.
+ */
+int bf_chain_add_subchain(struct bf_chain *chain, struct bf_subchain *subchain);
+
+/**
+ * Get the index of a chain's sub-chain from its name.
+ *
+ * @param chain Chain to get the sub-chain from. Can't be NULL.
+ * @param name Name of the sub-chain. Can't be NULL.
+ * @return Index of the sub-chain in @ref bf_chain::subchains , or
+ *         @c -ENOENT if there is no sub-chain with this name.
+ */
+int bf_chain_get_subchain_index(const struct bf_chain *chain,
+                                const char *name);
+
+/**
+ * Get the index of a sub-chain's first counter.
+ *
+ * The counters of a chain are ordered as follow: one counter per rule of the
+ * chain, one counter per rule of each sub-chain (in the order the sub-chains
+ * are defined), and the policy counter.
+ *
+ * @param chain Chain the sub-chain belongs to. Can't be NULL.
+ * @param index Index of the sub-chain. If @p index is the number of
+ *        sub-chains, the index of the policy counter is returned.
+ * @return Index of the sub-chain's first counter, relative to the chain's
+ *         first counter.
+ */
+size_t bf_chain_get_subchain_counters_offset(const struct bf_chain *chain,
+                                             size_t index);
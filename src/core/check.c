@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "core/check.h"
+
+#include "core/helper.h"
+
+static const char *_bf_check_class_strs[] = {
+    [BF_CHECK_CLASS_IPV4_TCP] = "ipv4/tcp",
+    [BF_CHECK_CLASS_IPV4_UDP] = "ipv4/udp",
+    [BF_CHECK_CLASS_IPV4_ICMP] = "ipv4/icmp",
+    [BF_CHECK_CLASS_IPV6_TCP] = "ipv6/tcp",
+    [BF_CHECK_CLASS_IPV6_UDP] = "ipv6/udp",
+    [BF_CHECK_CLASS_IPV6_ICMPV6] = "ipv6/icmpv6",
+    [BF_CHECK_CLASS_OTHER] = "other",
+};
+
+static_assert(ARRAY_SIZE(_bf_check_class_strs) == _BF_CHECK_CLASS_MAX,
+              "missing entries in the check class array");
+
+const char *bf_check_class_to_str(enum bf_check_class class)
+{
+    bf_assert(0 <= class && class < _BF_CHECK_CLASS_MAX);
+
+    return _bf_check_class_strs[class];
+}
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "core/helper.h"
+
+/**
+ * @file check.h
+ *
+ * Ruleset check: a chain is translated and its program generated by the
+ * daemon, but never attached, pinned, nor stored in the daemon's context.
+ * The program can optionally be loaded, so it goes through the verifier, and
+ * is unloaded right after. The cost of the program is reported in a
+ * @ref bf_check_report .
+ */
+
+/// Cost of a path which can't be estimated (e.g. the program contains loops).
+#define BF_CHECK_COST_UNKNOWN UINT64_MAX
+
+/**
+ * Protocols of the packets the program's cost is estimated for.
+ */
+enum bf_check_class
+{
+    BF_CHECK_CLASS_IPV4_TCP,
+    BF_CHECK_CLASS_IPV4_UDP,
+    BF_CHECK_CLASS_IPV4_ICMP,
+    BF_CHECK_CLASS_IPV6_TCP,
+    BF_CHECK_CLASS_IPV6_UDP,
+    BF_CHECK_CLASS_IPV6_ICMPV6,
+    /// Packets which are neither IPv4 nor IPv6.
+    BF_CHECK_CLASS_OTHER,
+    _BF_CHECK_CLASS_MAX,
+};
+
+/**
+ * Static estimate of the number of BPF instructions executed per packet.
+ */
+struct bf_check_cost
+{
+    /// Instructions executed on the shortest path, or
+    /// @ref BF_CHECK_COST_UNKNOWN .
+    uint64_t best;
+    /// Instructions executed on the longest path, or
+    /// @ref BF_CHECK_COST_UNKNOWN .
+    uint64_t worst;
+} bf_packed;
+
+/**
+ * Result of the check of a chain.
+ */
+struct bf_check_report
+{
+    /// Number of BPF instructions of the generated program.
+    uint32_t n_insns;
+    /// 1 if the program has been loaded to be verified, 0 otherwise.
+    uint32_t verify;
+    /// Number of instructions processed by the verifier. Only valid if the
+    /// program has been verified successfully.
+    uint32_t verified_insns;
+    /// 0 if the program has been verified successfully (or not verified), or
+    /// the negative errno value returned by @c BPF_PROG_LOAD .
+    int32_t verify_error;
+    /// Cost of the program for each @ref bf_check_class .
+    struct bf_check_cost costs[_BF_CHECK_CLASS_MAX];
+} bf_packed;
+
+/**
+ * Convert a check class into a string.
+ *
+ * @param class Class to convert, must be valid.
+ * @return String representation of @p class .
+ */
+const char *bf_check_class_to_str(enum bf_check_class class);
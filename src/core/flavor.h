@@ -7,8 +7,9 @@
 
 #include "core/verdict.h"
 
-struct bf_program;
 struct bf_link;
+struct bf_matcher;
+struct bf_program;
 
 /**
  * @file flavor.h
@@ -82,6 +83,33 @@ struct bf_flavor_ops
      */
     int (*get_verdict)(enum bf_verdict verdict);
 
+    /**
+     * Generate the bytecode to look up the packet's connection.
+     *
+     * The bytecode is generated into a dedicated BPF function, in which
+     * @c BPF_REG_9 contains the address of the runtime context, and
+     * @c BPF_REG_7 and @c BPF_REG_8 the L3 and L4 protocol IDs. It must store
+     * the connection tracking state of the packet into the runtime context's
+     * @c ct_state field as a bitmask of @ref bf_matcher_ct_state .
+     *
+     * Can be NULL if the flavor doesn't support connection tracking.
+     */
+    int (*gen_ct_lookup)(struct bf_program *program);
+
+    /**
+     * Check whether a matcher can be used by a program of this flavor.
+     *
+     * Called for every matcher before generating its bytecode, to reject
+     * matchers relying on data the flavor can't provide.
+     *
+     * Can be NULL if the flavor supports every matcher.
+     *
+     * @return 0 if the matcher is supported, or a negative errno value
+     *         otherwise.
+     */
+    int (*check_matcher)(const struct bf_program *program,
+                         const struct bf_matcher *matcher);
+
     /**
      * Attach a program to a hook on the system.
      *
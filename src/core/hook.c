@@ -35,6 +35,10 @@ static const char *_bf_hook_strs[] = {
     [BF_HOOK_NF_LOCAL_OUT] = "BF_HOOK_NF_LOCAL_OUT",
     [BF_HOOK_NF_POST_ROUTING] = "BF_HOOK_NF_POST_ROUTING",
     [BF_HOOK_TC_EGRESS] = "BF_HOOK_TC_EGRESS",
+    [BF_HOOK_CGROUP_INET4_CONNECT] = "BF_HOOK_CGROUP_INET4_CONNECT",
+    [BF_HOOK_CGROUP_INET6_CONNECT] = "BF_HOOK_CGROUP_INET6_CONNECT",
+    [BF_HOOK_CGROUP_UDP4_SENDMSG] = "BF_HOOK_CGROUP_UDP4_SENDMSG",
+    [BF_HOOK_CGROUP_UDP6_SENDMSG] = "BF_HOOK_CGROUP_UDP6_SENDMSG",
 };
 
 static_assert(ARRAY_SIZE(_bf_hook_strs) == _BF_HOOK_MAX,
@@ -75,6 +79,10 @@ unsigned int bf_hook_to_bpf_prog_type(enum bf_hook hook)
         [BF_HOOK_NF_LOCAL_OUT] = BPF_PROG_TYPE_NETFILTER,
         [BF_HOOK_NF_POST_ROUTING] = BPF_PROG_TYPE_NETFILTER,
         [BF_HOOK_TC_EGRESS] = BPF_PROG_TYPE_SCHED_CLS,
+        [BF_HOOK_CGROUP_INET4_CONNECT] = BPF_PROG_TYPE_CGROUP_SOCK_ADDR,
+        [BF_HOOK_CGROUP_INET6_CONNECT] = BPF_PROG_TYPE_CGROUP_SOCK_ADDR,
+        [BF_HOOK_CGROUP_UDP4_SENDMSG] = BPF_PROG_TYPE_CGROUP_SOCK_ADDR,
+        [BF_HOOK_CGROUP_UDP6_SENDMSG] = BPF_PROG_TYPE_CGROUP_SOCK_ADDR,
     };
 
     bf_assert(0 <= hook && hook < _BF_HOOK_MAX);
@@ -97,6 +105,10 @@ enum bpf_attach_type bf_hook_to_attach_type(enum bf_hook hook)
         [BF_HOOK_NF_LOCAL_OUT] = BPF_NETFILTER,
         [BF_HOOK_NF_POST_ROUTING] = BPF_NETFILTER,
         [BF_HOOK_TC_EGRESS] = BPF_TCX_EGRESS,
+        [BF_HOOK_CGROUP_INET4_CONNECT] = BPF_CGROUP_INET4_CONNECT,
+        [BF_HOOK_CGROUP_INET6_CONNECT] = BPF_CGROUP_INET6_CONNECT,
+        [BF_HOOK_CGROUP_UDP4_SENDMSG] = BPF_CGROUP_UDP4_SENDMSG,
+        [BF_HOOK_CGROUP_UDP6_SENDMSG] = BPF_CGROUP_UDP6_SENDMSG,
     };
 
     bf_assert(0 <= hook && hook < _BF_HOOK_MAX);
@@ -106,6 +118,37 @@ enum bpf_attach_type bf_hook_to_attach_type(enum bf_hook hook)
     return hooks[hook];
 }
 
+bool bf_hook_is_nf(enum bf_hook hook)
+{
+    bf_assert(0 <= hook && hook < _BF_HOOK_MAX);
+
+    switch (hook) {
+    case BF_HOOK_NF_PRE_ROUTING:
+    case BF_HOOK_NF_LOCAL_IN:
+    case BF_HOOK_NF_FORWARD:
+    case BF_HOOK_NF_LOCAL_OUT:
+    case BF_HOOK_NF_POST_ROUTING:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool bf_hook_is_sock_addr(enum bf_hook hook)
+{
+    bf_assert(0 <= hook && hook < _BF_HOOK_MAX);
+
+    switch (hook) {
+    case BF_HOOK_CGROUP_INET4_CONNECT:
+    case BF_HOOK_CGROUP_INET6_CONNECT:
+    case BF_HOOK_CGROUP_UDP4_SENDMSG:
+    case BF_HOOK_CGROUP_UDP6_SENDMSG:
+        return true;
+    default:
+        return false;
+    }
+}
+
 enum nf_inet_hooks bf_hook_to_nf_hook(enum bf_hook hook)
 {
     switch (hook) {
@@ -230,6 +273,61 @@ static void _bf_hook_opt_attach_dump(const struct bf_hook_opts *opts,
     DUMP(prefix, "attach: %s", opts->attach ? "yes" : "no");
 }
 
+static int _bf_hook_opt_priority_parse(struct bf_hook_opts *opts,
+                                       const char *raw_opt)
+{
+    char *end;
+    long priority;
+
+    errno = 0;
+    priority = strtol(raw_opt, &end, 0);
+    if (errno != 0 || end == raw_opt || *end != '\0') {
+        return bf_err_r(errno ? -errno : -EINVAL,
+                        "failed to parse hook options priority=%s", raw_opt);
+    }
+
+    if (priority < INT32_MIN || priority > INT32_MAX)
+        return bf_err_r(-E2BIG, "priority is out of range: %ld", priority);
+
+    opts->priority = (int32_t)priority;
+
+    return 0;
+}
+
+static void _bf_hook_opt_priority_dump(const struct bf_hook_opts *opts,
+                                       prefix_t *prefix)
+{
+    DUMP(prefix, "priority: %d", opts->priority);
+}
+
+static const char *_bf_hook_mode_strs[] = {
+    [BF_HOOK_MODE_COMPILED] = "compiled",
+    [BF_HOOK_MODE_INTERPRETED] = "interpreted",
+    [BF_HOOK_MODE_CLASSIFIER] = "classifier",
+};
+
+static_assert(ARRAY_SIZE(_bf_hook_mode_strs) == _BF_HOOK_MODE_MAX,
+              "missing entries in _bf_hook_mode_strs array");
+
+static int _bf_hook_opt_mode_parse(struct bf_hook_opts *opts,
+                                   const char *raw_opt)
+{
+    for (enum bf_hook_mode mode = 0; mode < _BF_HOOK_MODE_MAX; ++mode) {
+        if (bf_streq(raw_opt, _bf_hook_mode_strs[mode])) {
+            opts->mode = mode;
+            return 0;
+        }
+    }
+
+    return bf_err_r(-EINVAL, "unknown mode value '%s'", raw_opt);
+}
+
+static void _bf_hook_opt_mode_dump(const struct bf_hook_opts *opts,
+                                   prefix_t *prefix)
+{
+    DUMP(prefix, "mode: %s", _bf_hook_mode_strs[opts->mode]);
+}
+
 static struct bf_hook_opt_support
 {
     uint32_t required;
@@ -239,50 +337,79 @@ static struct bf_hook_opt_support
         {
             .required = 1 << BF_HOOK_OPT_IFINDEX,
             .supported = 1 << BF_HOOK_OPT_IFINDEX | 1 << BF_HOOK_OPT_NAME |
-                         1 << BF_HOOK_OPT_ATTACH,
+                         1 << BF_HOOK_OPT_ATTACH | 1 << BF_HOOK_OPT_MODE,
         },
     [BF_HOOK_TC_INGRESS] =
         {
             .required = 1 << BF_HOOK_OPT_IFINDEX,
             .supported = 1 << BF_HOOK_OPT_IFINDEX | 1 << BF_HOOK_OPT_NAME |
-                         1 << BF_HOOK_OPT_ATTACH,
+                         1 << BF_HOOK_OPT_ATTACH | 1 << BF_HOOK_OPT_MODE,
         },
     [BF_HOOK_NF_PRE_ROUTING] =
         {
-            .supported = 1 << BF_HOOK_OPT_NAME | 1 << BF_HOOK_OPT_ATTACH,
+            .supported = 1 << BF_HOOK_OPT_NAME | 1 << BF_HOOK_OPT_ATTACH |
+                         1 << BF_HOOK_OPT_PRIORITY | 1 << BF_HOOK_OPT_MODE,
         },
     [BF_HOOK_NF_LOCAL_IN] =
         {
-            .supported = 1 << BF_HOOK_OPT_NAME | 1 << BF_HOOK_OPT_ATTACH,
+            .supported = 1 << BF_HOOK_OPT_NAME | 1 << BF_HOOK_OPT_ATTACH |
+                         1 << BF_HOOK_OPT_PRIORITY | 1 << BF_HOOK_OPT_MODE,
         },
     [BF_HOOK_CGROUP_INGRESS] =
         {
             .required = 1 << BF_HOOK_OPT_CGROUP,
             .supported = 1 << BF_HOOK_OPT_CGROUP | 1 << BF_HOOK_OPT_NAME |
-                         1 << BF_HOOK_OPT_ATTACH,
+                         1 << BF_HOOK_OPT_ATTACH | 1 << BF_HOOK_OPT_MODE,
         },
     [BF_HOOK_CGROUP_EGRESS] =
         {
             .required = 1 << BF_HOOK_OPT_CGROUP,
             .supported = 1 << BF_HOOK_OPT_CGROUP | 1 << BF_HOOK_OPT_NAME |
-                         1 << BF_HOOK_OPT_ATTACH,
+                         1 << BF_HOOK_OPT_ATTACH | 1 << BF_HOOK_OPT_MODE,
         },
     [BF_HOOK_NF_FORWARD] =
         {
-            .supported = 1 << BF_HOOK_OPT_NAME | 1 << BF_HOOK_OPT_ATTACH,
+            .supported = 1 << BF_HOOK_OPT_NAME | 1 << BF_HOOK_OPT_ATTACH |
+                         1 << BF_HOOK_OPT_PRIORITY | 1 << BF_HOOK_OPT_MODE,
         },
     [BF_HOOK_NF_LOCAL_OUT] =
         {
-            .supported = 1 << BF_HOOK_OPT_NAME | 1 << BF_HOOK_OPT_ATTACH,
+            .supported = 1 << BF_HOOK_OPT_NAME | 1 << BF_HOOK_OPT_ATTACH |
+                         1 << BF_HOOK_OPT_PRIORITY | 1 << BF_HOOK_OPT_MODE,
         },
     [BF_HOOK_NF_POST_ROUTING] =
         {
-            .supported = 1 << BF_HOOK_OPT_NAME | 1 << BF_HOOK_OPT_ATTACH,
+            .supported = 1 << BF_HOOK_OPT_NAME | 1 << BF_HOOK_OPT_ATTACH |
+                         1 << BF_HOOK_OPT_PRIORITY | 1 << BF_HOOK_OPT_MODE,
         },
     [BF_HOOK_TC_EGRESS] =
         {
             .required = 1 << BF_HOOK_OPT_IFINDEX,
             .supported = 1 << BF_HOOK_OPT_IFINDEX | 1 << BF_HOOK_OPT_NAME |
+                         1 << BF_HOOK_OPT_ATTACH | 1 << BF_HOOK_OPT_MODE,
+        },
+    [BF_HOOK_CGROUP_INET4_CONNECT] =
+        {
+            .required = 1 << BF_HOOK_OPT_CGROUP,
+            .supported = 1 << BF_HOOK_OPT_CGROUP | 1 << BF_HOOK_OPT_NAME |
+                         1 << BF_HOOK_OPT_ATTACH,
+        },
+    [BF_HOOK_CGROUP_INET6_CONNECT] =
+        {
+            .required = 1 << BF_HOOK_OPT_CGROUP,
+            .supported = 1 << BF_HOOK_OPT_CGROUP | 1 << BF_HOOK_OPT_NAME |
+                         1 << BF_HOOK_OPT_ATTACH,
+        },
+    [BF_HOOK_CGROUP_UDP4_SENDMSG] =
+        {
+            .required = 1 << BF_HOOK_OPT_CGROUP,
+            .supported = 1 << BF_HOOK_OPT_CGROUP | 1 << BF_HOOK_OPT_NAME |
+                         1 << BF_HOOK_OPT_ATTACH,
+        },
+    [BF_HOOK_CGROUP_UDP6_SENDMSG] =
+        {
+            .required = 1 << BF_HOOK_OPT_CGROUP,
+            .supported = 1 << BF_HOOK_OPT_CGROUP | 1 << BF_HOOK_OPT_NAME |
                          1 << BF_HOOK_OPT_ATTACH,
         },
 };
@@ -321,6 +448,18 @@ static struct bf_hook_opt_ops
         .parse = _bf_hook_opt_attach_parse,
         .dump = _bf_hook_opt_attach_dump,
     },
+    {
+        .name = "priority",
+        .opt = BF_HOOK_OPT_PRIORITY,
+        .parse = _bf_hook_opt_priority_parse,
+        .dump = _bf_hook_opt_priority_dump,
+    },
+    {
+        .name = "mode",
+        .opt = BF_HOOK_OPT_MODE,
+        .parse = _bf_hook_opt_mode_parse,
+        .dump = _bf_hook_opt_mode_dump,
+    },
 };
 
 static_assert(ARRAY_SIZE(_bf_hook_opt_ops) == _BF_HOOK_OPT_MAX,
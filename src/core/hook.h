@@ -33,6 +33,10 @@ enum bf_hook
     BF_HOOK_NF_LOCAL_OUT,
     BF_HOOK_NF_POST_ROUTING,
     BF_HOOK_TC_EGRESS,
+    BF_HOOK_CGROUP_INET4_CONNECT,
+    BF_HOOK_CGROUP_INET6_CONNECT,
+    BF_HOOK_CGROUP_UDP4_SENDMSG,
+    BF_HOOK_CGROUP_UDP6_SENDMSG,
     _BF_HOOK_MAX,
 };
 
@@ -42,9 +46,28 @@ enum bf_hook_opt
     BF_HOOK_OPT_CGROUP,
     BF_HOOK_OPT_NAME,
     BF_HOOK_OPT_ATTACH,
+    BF_HOOK_OPT_PRIORITY,
+    BF_HOOK_OPT_MODE,
     _BF_HOOK_OPT_MAX,
 };
 
+/**
+ * How the rules of a chain are evaluated, defined by the @c mode hook option.
+ */
+enum bf_hook_mode
+{
+    /// Each rule is compiled into BPF bytecode.
+    BF_HOOK_MODE_COMPILED,
+    /** The rules are stored in a BPF map and evaluated by a generic program,
+     * see @c bpfilter/cgen/interp.h . */
+    BF_HOOK_MODE_INTERPRETED,
+    /** Runs of rules matching on masked header fields are grouped by mask,
+     * and looked up in a hash map per mask, see @c bpfilter/cgen/tss.h . The
+     * other rules are compiled. */
+    BF_HOOK_MODE_CLASSIFIER,
+    _BF_HOOK_MODE_MAX,
+};
+
 struct bf_hook_opts
 {
     uint32_t used_opts;
@@ -54,6 +77,11 @@ struct bf_hook_opts
     const char *cgroup;
     const char *name;
     bool attach;
+    /** Evaluation order of the chains sharing a Netfilter hook: chains with a
+     * lower priority are evaluated first. */
+    int32_t priority;
+    /// How the chain's rules are evaluated.
+    enum bf_hook_mode mode;
 };
 
 /**
@@ -89,6 +117,28 @@ unsigned int bf_hook_to_bpf_prog_type(enum bf_hook hook);
  */
 enum bpf_attach_type bf_hook_to_attach_type(enum bf_hook hook);
 
+/**
+ * Check whether a hook is a Netfilter hook.
+ *
+ * @param hook The hook to check. Must be a valid hook.
+ * @return True if @p hook is one of the @c BF_HOOK_NF_* hooks, false
+ *         otherwise.
+ */
+bool bf_hook_is_nf(enum bf_hook hook);
+
+/**
+ * Check whether a hook is a cgroup socket address hook.
+ *
+ * Programs attached to those hooks are called once per @c connect() or
+ * @c sendmsg() call, with the destination address of the socket, instead of
+ * once per packet.
+ *
+ * @param hook The hook to check. Must be a valid hook.
+ * @return True if @p hook is a @c BF_HOOK_CGROUP_*_CONNECT or
+ *         @c BF_HOOK_CGROUP_*_SENDMSG hook, false otherwise.
+ */
+bool bf_hook_is_sock_addr(enum bf_hook hook);
+
 /**
  * Convert a @ref bf_hook value to a @c nf_inet_hooks value.
  *
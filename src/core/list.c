@@ -187,6 +187,40 @@ int bf_list_add_tail(bf_list *list, void *data)
     return 0;
 }
 
+int bf_list_add_before(bf_list *list, bf_list_node *node, void *data)
+{
+    bf_list_node *new_node = NULL;
+    int r;
+
+    bf_assert(list && node);
+
+    if (list->head == node)
+        return bf_list_add_head(list, data);
+
+    r = bf_list_node_new(&new_node, data);
+    if (r < 0)
+        return r;
+
+    new_node->prev = node->prev;
+    new_node->next = node;
+    node->prev->next = new_node;
+    node->prev = new_node;
+
+    ++list->len;
+
+    return 0;
+}
+
+int bf_list_add_after(bf_list *list, bf_list_node *node, void *data)
+{
+    bf_assert(list && node);
+
+    if (list->tail == node)
+        return bf_list_add_tail(list, data);
+
+    return bf_list_add_before(list, node->next, data);
+}
+
 void bf_list_delete(bf_list *list, bf_list_node *node)
 {
     bf_assert(list);
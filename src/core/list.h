@@ -290,6 +290,28 @@ int bf_list_add_head(bf_list *list, void *data);
  */
 int bf_list_add_tail(bf_list *list, void *data);
 
+/**
+ * Insert data in the list, before a given node.
+ *
+ * @param list List to insert the data into. Must be initialised and non-NULL.
+ * @param node Node of @p list to insert the data before. Can't be NULL.
+ * @param data Data to insert into the list. Can be NULL. @p list takes
+ * 	      ownership of the data: it should not be freed.
+ * @return 0 on success or negative errno code on failure.
+ */
+int bf_list_add_before(bf_list *list, bf_list_node *node, void *data);
+
+/**
+ * Insert data in the list, after a given node.
+ *
+ * @param list List to insert the data into. Must be initialised and non-NULL.
+ * @param node Node of @p list to insert the data after. Can't be NULL.
+ * @param data Data to insert into the list. Can be NULL. @p list takes
+ * 	      ownership of the data: it should not be freed.
+ * @return 0 on success or negative errno code on failure.
+ */
+int bf_list_add_after(bf_list *list, bf_list_node *node, void *data);
+
 /**
  * Delete @p node from @p list.
  *
@@ -5,18 +5,445 @@
 
 #include "core/logger.h"
 
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+/// Size of the buffer used to format a message, longer messages are
+/// truncated.
+#define BF_LOG_LINE_MAX 4096
+
+/// Size of the asynchronous logger's buffer. Must be a power of 2.
+#define BF_LOG_RING_SIZE (1 << 20)
+
+/// Number of rate limiting slots, see @ref bf_logger_set_ratelimit .
+#define BF_LOG_RATELIMIT_SLOTS 64
+
+/// Duration of a rate limiting interval, in nanoseconds.
+#define BF_LOG_RATELIMIT_INTERVAL_NS 1000000000ULL
+
 /// If true, log messages will be printed in colors.
 static bool _bf_can_print_color = false;
 
+static enum bf_log_format _bf_log_format = BF_LOG_FORMAT_TEXT;
+
+static const struct
+{
+    const char *str;
+    enum bf_color color;
+    /// syslog priority, used by @ref BF_LOG_FORMAT_JOURNAL .
+    int priority;
+} _bf_log_levels[] = {
+    [BF_LOG_DBG] = {"debug", BF_COLOR_BLUE, 7},
+    [BF_LOG_INFO] = {"info", BF_COLOR_GREEN, 6},
+    [BF_LOG_WARN] = {"warning", BF_COLOR_YELLOW, 4},
+    [BF_LOG_ERR] = {"error", BF_COLOR_RED, 3},
+    [BF_LOG_ABORT] = {"abort", BF_COLOR_RED, 2},
+};
+
+static_assert(ARRAY_SIZE(_bf_log_levels) == _BF_LOG_MAX,
+              "missing entries in the log levels array");
+
+static const char *_bf_log_format_strs[] = {
+    [BF_LOG_FORMAT_TEXT] = "text",
+    [BF_LOG_FORMAT_JSON] = "json",
+    [BF_LOG_FORMAT_JOURNAL] = "journal",
+};
+
+static_assert(ARRAY_SIZE(_bf_log_format_strs) == _BF_LOG_FORMAT_MAX,
+              "missing entries in the log formats array");
+
+/**
+ * Rate limiting state of a call site, identified by its format string.
+ */
+struct bf_log_ratelimit
+{
+    const char *fmt;
+    uint64_t start_ns;
+    unsigned int count;
+    unsigned int dropped;
+};
+
+static unsigned int _bf_log_ratelimit_burst = 0;
+static struct bf_log_ratelimit _bf_log_ratelimits[BF_LOG_RATELIMIT_SLOTS];
+
+/**
+ * Single-producer, single-consumer ring buffer of the asynchronous logger.
+ *
+ * The producer is the thread which started the asynchronous logger, the
+ * consumer is the writer thread. Each record is the length of the message
+ * (as a @c uint32_t ) followed by the message. @c head and @c tail are never
+ * wrapped, only their offset in @c data is.
+ */
+static struct
+{
+    char data[BF_LOG_RING_SIZE];
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    /// Number of messages dropped because the ring was full.
+    _Atomic uint64_t dropped;
+    /// Posted by the producer when a message is available.
+    sem_t sem;
+    pthread_t writer;
+    pthread_t producer;
+    atomic_bool stop;
+    bool running;
+} _bf_log_ring;
+
 void bf_logger_setup(void)
 {
     _bf_can_print_color = isatty(fileno(stdout)) && isatty(fileno(stderr));
 }
 
+void bf_logger_set_format(enum bf_log_format format)
+{
+    bf_assert(0 <= format && format < _BF_LOG_FORMAT_MAX);
+
+    _bf_log_format = format;
+}
+
+int bf_log_format_from_str(const char *str, enum bf_log_format *format)
+{
+    bf_assert(str && format);
+
+    for (size_t i = 0; i < _BF_LOG_FORMAT_MAX; ++i) {
+        if (bf_streq(_bf_log_format_strs[i], str)) {
+            *format = i;
+            return 0;
+        }
+    }
+
+    return -EINVAL;
+}
+
+void bf_logger_set_ratelimit(unsigned int burst)
+{
+    _bf_log_ratelimit_burst = burst;
+    memset(_bf_log_ratelimits, 0, sizeof(_bf_log_ratelimits));
+}
+
+static uint64_t _bf_log_now_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(clock, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void _bf_log_write(const char *line, size_t len);
+
+/**
+ * Format a log message into @p buf , according to the logger's format.
+ *
+ * @return Length of the formatted message, excluding the trailing nul
+ *         character, truncated to the size of @p buf .
+ */
+static size_t _bf_log_format_line(char *buf, size_t size,
+                                  enum bf_log_level level, const char *msg)
+{
+    int len;
+
+    switch (_bf_log_format) {
+    case BF_LOG_FORMAT_JSON: {
+        uint64_t now = _bf_log_now_ns(CLOCK_REALTIME);
+        size_t off;
+
+        len = snprintf(buf, size,
+                       "{\"ts\":%lu.%06lu,\"level\":\"%s\",\"msg\":\"",
+                       now / 1000000000UL, (now % 1000000000UL) / 1000UL,
+                       _bf_log_levels[level].str);
+        off = bf_min((size_t)len, size - 1);
+
+        // Escape the message, and keep room for the closing characters.
+        for (; *msg && off + 10 < size; ++msg) {
+            unsigned char c = *msg;
+
+            if (c == '"' || c == '\\') {
+                buf[off++] = '\\';
+                buf[off++] = c;
+            } else if (c < 0x20) {
+                off += snprintf(buf + off, size - off, "\\u%04x", c);
+            } else {
+                buf[off++] = c;
+            }
+        }
+
+        len = off + snprintf(buf + off, size - off, "\"}\n");
+        break;
+    }
+    case BF_LOG_FORMAT_JOURNAL:
+        len = snprintf(buf, size, "<%d>%s\n", _bf_log_levels[level].priority,
+                       msg);
+        break;
+    case BF_LOG_FORMAT_TEXT:
+    default:
+        len = snprintf(buf, size, "%s%-7s%s: %s\n",
+                       bf_logger_get_color(_bf_log_levels[level].color,
+                                           BF_STYLE_BOLD),
+                       _bf_log_levels[level].str,
+                       bf_logger_get_color(BF_COLOR_RESET, BF_STYLE_RESET),
+                       msg);
+        break;
+    }
+
+    // Truncated messages keep their trailing newline.
+    if ((size_t)len >= size) {
+        len = (int)size - 1;
+        buf[len - 1] = '\n';
+    }
+
+    return len;
+}
+
+/**
+ * Check whether a message should be dropped by the rate limiter.
+ *
+ * If the call site's interval is over and messages have been dropped, the
+ * number of dropped messages is logged.
+ *
+ * @return True if the message should be dropped.
+ */
+static bool _bf_log_ratelimit(enum bf_log_level level, const char *fmt)
+{
+    struct bf_log_ratelimit *slot;
+    uint64_t now;
+
+    if (!_bf_log_ratelimit_burst || level == BF_LOG_DBG ||
+        level == BF_LOG_ABORT)
+        return false;
+
+    slot = &_bf_log_ratelimits[((uintptr_t)fmt >> 4) % BF_LOG_RATELIMIT_SLOTS];
+    now = _bf_log_now_ns(CLOCK_MONOTONIC);
+
+    if (slot->fmt != fmt ||
+        now - slot->start_ns >= BF_LOG_RATELIMIT_INTERVAL_NS) {
+        if (slot->dropped) {
+            char buf[BF_LOG_LINE_MAX];
+            char msg[BF_LOG_LINE_MAX];
+            size_t len;
+
+            (void)snprintf(msg, sizeof(msg),
+                           "rate limit: dropped %u messages like '%s'",
+                           slot->dropped, slot->fmt);
+            len = _bf_log_format_line(buf, sizeof(buf), BF_LOG_WARN, msg);
+            _bf_log_write(buf, len);
+        }
+
+        *slot = (struct bf_log_ratelimit) {.fmt = fmt, .start_ns = now};
+    }
+
+    if (slot->count++ < _bf_log_ratelimit_burst)
+        return false;
+
+    ++slot->dropped;
+
+    return true;
+}
+
+static void _bf_log_ring_copy_in(uint64_t pos, const void *src, size_t len)
+{
+    size_t off = pos & (BF_LOG_RING_SIZE - 1);
+    size_t first = bf_min(len, (size_t)BF_LOG_RING_SIZE - off);
+
+    memcpy(&_bf_log_ring.data[off], src, first);
+    memcpy(_bf_log_ring.data, (const char *)src + first, len - first);
+}
+
+static void _bf_log_ring_copy_out(uint64_t pos, void *dst, size_t len)
+{
+    size_t off = pos & (BF_LOG_RING_SIZE - 1);
+    size_t first = bf_min(len, (size_t)BF_LOG_RING_SIZE - off);
+
+    memcpy(dst, &_bf_log_ring.data[off], first);
+    memcpy((char *)dst + first, _bf_log_ring.data, len - first);
+}
+
+/**
+ * Push a message to the ring, without blocking.
+ *
+ * @return True if the message has been pushed, false if the ring is full.
+ */
+static bool _bf_log_ring_push(const char *line, size_t len)
+{
+    uint32_t rec_len = len;
+    uint64_t head = atomic_load_explicit(&_bf_log_ring.head,
+                                         memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&_bf_log_ring.tail,
+                                         memory_order_acquire);
+
+    if (BF_LOG_RING_SIZE - (head - tail) < sizeof(rec_len) + len) {
+        atomic_fetch_add_explicit(&_bf_log_ring.dropped, 1,
+                                  memory_order_relaxed);
+        return false;
+    }
+
+    _bf_log_ring_copy_in(head, &rec_len, sizeof(rec_len));
+    _bf_log_ring_copy_in(head + sizeof(rec_len), line, len);
+    atomic_store_explicit(&_bf_log_ring.head, head + sizeof(rec_len) + len,
+                          memory_order_release);
+    (void)sem_post(&_bf_log_ring.sem);
+
+    return true;
+}
+
+/**
+ * Write all the messages available in the ring to stderr.
+ *
+ * Messages are copied into a local buffer, so they are written with as few
+ * system calls as possible.
+ */
+static void _bf_log_ring_drain(void)
+{
+    static char out[BF_LOG_RING_SIZE / 16];
+    uint64_t tail = atomic_load_explicit(&_bf_log_ring.tail,
+                                         memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&_bf_log_ring.head,
+                                         memory_order_acquire);
+    uint64_t dropped;
+    size_t out_len = 0;
+
+    while (tail != head) {
+        uint32_t rec_len;
+
+        _bf_log_ring_copy_out(tail, &rec_len, sizeof(rec_len));
+        if (out_len + rec_len > sizeof(out)) {
+            (void)fwrite(out, 1, out_len, stderr);
+            out_len = 0;
+        }
+
+        _bf_log_ring_copy_out(tail + sizeof(rec_len), out + out_len, rec_len);
+        out_len += rec_len;
+        tail += sizeof(rec_len) + rec_len;
+
+        // Release the space as soon as possible.
+        atomic_store_explicit(&_bf_log_ring.tail, tail, memory_order_release);
+    }
+
+    if (out_len)
+        (void)fwrite(out, 1, out_len, stderr);
+
+    dropped = atomic_exchange_explicit(&_bf_log_ring.dropped, 0,
+                                       memory_order_relaxed);
+    if (dropped) {
+        char msg[64];
+
+        (void)snprintf(msg, sizeof(msg),
+                       "logger buffer full, dropped %lu messages", dropped);
+        out_len = _bf_log_format_line(out, sizeof(out), BF_LOG_WARN, msg);
+        (void)fwrite(out, 1, out_len, stderr);
+    }
+}
+
+static void *_bf_log_writer(void *arg)
+{
+    UNUSED(arg);
+
+    while (true) {
+        while (sem_wait(&_bf_log_ring.sem) < 0 && errno == EINTR)
+            ;
+
+        _bf_log_ring_drain();
+
+        if (atomic_load(&_bf_log_ring.stop)) {
+            // Messages could have been pushed before the stop flag was set.
+            _bf_log_ring_drain();
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void _bf_log_write(const char *line, size_t len)
+{
+    if (_bf_log_ring.running &&
+        pthread_equal(pthread_self(), _bf_log_ring.producer)) {
+        (void)_bf_log_ring_push(line, len);
+        return;
+    }
+
+    (void)fwrite(line, 1, len, stderr);
+}
+
+void bf_log_v(enum bf_log_level level, const char *fmt, va_list args)
+{
+    char msg[BF_LOG_LINE_MAX];
+    char buf[BF_LOG_LINE_MAX];
+    size_t len;
+
+    bf_assert(0 <= level && level < _BF_LOG_MAX);
+    bf_assert(fmt);
+
+    if (_bf_log_ratelimit(level, fmt))
+        return;
+
+    (void)vsnprintf(msg, sizeof(msg), fmt, args);
+    len = _bf_log_format_line(buf, sizeof(buf), level, msg);
+
+    // The process is about to abort: write all the pending messages first.
+    if (level == BF_LOG_ABORT)
+        bf_logger_teardown();
+
+    _bf_log_write(buf, len);
+}
+
+void bf_log(enum bf_log_level level, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    bf_log_v(level, fmt, args);
+    va_end(args);
+}
+
+int bf_logger_start_async(void)
+{
+    int r;
+
+    if (_bf_log_ring.running)
+        return 0;
+
+    if (sem_init(&_bf_log_ring.sem, 0, 0) < 0)
+        return -errno;
+
+    atomic_store(&_bf_log_ring.stop, false);
+    _bf_log_ring.producer = pthread_self();
+
+    r = pthread_create(&_bf_log_ring.writer, NULL, _bf_log_writer, NULL);
+    if (r) {
+        (void)sem_destroy(&_bf_log_ring.sem);
+        return -r;
+    }
+
+    _bf_log_ring.running = true;
+
+    // Messages logged right before exiting should not be lost.
+    (void)atexit(bf_logger_teardown);
+
+    return 0;
+}
+
+void bf_logger_teardown(void)
+{
+    if (!_bf_log_ring.running)
+        return;
+
+    atomic_store(&_bf_log_ring.stop, true);
+    (void)sem_post(&_bf_log_ring.sem);
+    (void)pthread_join(_bf_log_ring.writer, NULL);
+    (void)sem_destroy(&_bf_log_ring.sem);
+
+    _bf_log_ring.running = false;
+}
+
 const char *bf_logger_get_color(enum bf_color color, enum bf_style style)
 {
     if (!_bf_can_print_color) {
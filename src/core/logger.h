@@ -5,7 +5,9 @@
 
 #pragma once
 
-#include <stdio.h> // NOLINT: fprintf is used
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h> // NOLINT: abort() and abs() are used
 
 #include "core/helper.h"
 #include "core/opts.h" // NOLINT: bf_opts_verbose() is used
@@ -43,105 +45,127 @@ enum bf_style
 };
 
 /**
- * Log an error message to stderr.
+ * Log levels.
+ */
+enum bf_log_level
+{
+    BF_LOG_DBG,
+    BF_LOG_INFO,
+    BF_LOG_WARN,
+    BF_LOG_ERR,
+    BF_LOG_ABORT,
+    _BF_LOG_MAX,
+};
+
+/**
+ * Format of the log messages.
+ */
+enum bf_log_format
+{
+    /// Level prefix followed by the message, colored if printed to a TTY.
+    BF_LOG_FORMAT_TEXT,
+    /// One JSON object per line, with a timestamp, the level, and the message.
+    BF_LOG_FORMAT_JSON,
+    /** Message prefixed with its syslog priority (e.g. @c <6> ), which
+     * systemd-journald uses as the message's priority. */
+    BF_LOG_FORMAT_JOURNAL,
+    _BF_LOG_FORMAT_MAX,
+};
+
+/**
+ * Log a message.
  *
- * @param level Log level, as a string. Will prefix the log message.
- * @param color Color to print the prefix with, as a @ref bf_color .
+ * The message is formatted according to the logger's format, see
+ * @ref bf_logger_set_format , and written to stderr: directly, or by the
+ * logger's writer thread if @ref bf_logger_start_async has been called.
+ *
+ * @param level Log level of the message.
  * @param fmt Format string.
  * @param ... Format arguments.
  */
-#define _bf_log_impl(level, color, fmt, ...)                                   \
-    (void)fprintf(stderr, "%s%-7s%s: " fmt "\n",                               \
-                  bf_logger_get_color((color), BF_STYLE_BOLD), (level),        \
-                  bf_logger_get_color(BF_COLOR_RESET, BF_STYLE_RESET),         \
-                  ##__VA_ARGS__)
+void bf_log(enum bf_log_level level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * Identical to @ref bf_log but for @p va_list arguments.
+ *
+ * @param level Log level of the message.
+ * @param fmt Format string.
+ * @param args @p va_list of arguments.
+ */
+void bf_log_v(enum bf_log_level level, const char *fmt, va_list args);
+
+/**
+ * Log a message.
+ *
+ * @param level Log level, as a @ref bf_log_level .
+ * @param fmt Format string.
+ * @param ... Format arguments.
+ */
+#define _bf_log_impl(level, fmt, ...) bf_log((level), fmt, ##__VA_ARGS__)
 
 #define bf_abort(fmt, ...)                                                     \
     ({                                                                         \
-        _bf_log_impl("abort", BF_COLOR_RED, fmt, ##__VA_ARGS__);               \
+        _bf_log_impl(BF_LOG_ABORT, fmt, ##__VA_ARGS__);                        \
         abort();                                                               \
     })
 
-#define bf_err(fmt, ...) _bf_log_impl("error", BF_COLOR_RED, fmt, ##__VA_ARGS__)
+#define bf_err(fmt, ...) _bf_log_impl(BF_LOG_ERR, fmt, ##__VA_ARGS__)
 
-#define bf_warn(fmt, ...)                                                      \
-    _bf_log_impl("warning", BF_COLOR_YELLOW, fmt, ##__VA_ARGS__)
+#define bf_warn(fmt, ...) _bf_log_impl(BF_LOG_WARN, fmt, ##__VA_ARGS__)
 
-#define bf_info(fmt, ...)                                                      \
-    _bf_log_impl("info", BF_COLOR_GREEN, fmt, ##__VA_ARGS__)
+#define bf_info(fmt, ...) _bf_log_impl(BF_LOG_INFO, fmt, ##__VA_ARGS__)
 
 #define bf_dbg(fmt, ...)                                                       \
     ({                                                                         \
         if (bf_opts_is_verbose(BF_VERBOSE_DEBUG))                              \
-            _bf_log_impl("debug", BF_COLOR_BLUE, fmt, ##__VA_ARGS__);          \
+            _bf_log_impl(BF_LOG_DBG, fmt, ##__VA_ARGS__);                      \
     })
 
 /**
- * Log an error message to stderr, append the detail of the error code
- * provided and return the given error code.
+ * Log an error message, append the detail of the error code provided and
+ * return the given error code.
  *
  * Convenience function to be used during error checks. It will log the error
- * message to stderr, append the detail of the error code provided and return
- * the given error code as a negative value. For example:
+ * message, append the detail of the error code provided and return the given
+ * error code as a negative value. For example:
  *
  * @code{.c}
  *  if (ret < 0)
  *    return bf_err_r(ret, "failed to do something");
  * @endcode
  *
- * @param level Log level, as a string. Will prefix the log message.
- * @param color Color to print the prefix with, as a @ref bf_color .
+ * @param level Log level, as a @ref bf_log_level .
  * @param code Error code, can be positive or negative.
  * @param fmt Format string.
  * @param ... Format arguments.
  * @return The given error code, as a negative value.
  */
-#define _bf_log_code_impl(level, color, code, fmt, ...)                        \
+#define _bf_log_code_impl(level, code, fmt, ...)                               \
     ({                                                                         \
-        fprintf(stderr, "%s%-7s%s: " fmt ": %s\n",                             \
-                bf_logger_get_color((color), BF_STYLE_BOLD), (level),          \
-                bf_logger_get_color(BF_COLOR_RESET, BF_STYLE_RESET),           \
-                ##__VA_ARGS__, bf_strerror(code));                             \
+        bf_log((level), fmt ": %s", ##__VA_ARGS__, bf_strerror(code));         \
         -abs(code);                                                            \
     })
 
 #define bf_err_r(code, fmt, ...)                                               \
-    _bf_log_code_impl("error", BF_COLOR_RED, code, fmt, ##__VA_ARGS__)
+    _bf_log_code_impl(BF_LOG_ERR, code, fmt, ##__VA_ARGS__)
 
 #define bf_warn_r(code, fmt, ...)                                              \
-    _bf_log_code_impl("warning", BF_COLOR_YELLOW, code, fmt, ##__VA_ARGS__)
+    _bf_log_code_impl(BF_LOG_WARN, code, fmt, ##__VA_ARGS__)
 
 #define bf_info_r(code, fmt, ...)                                              \
-    _bf_log_code_impl("info", BF_COLOR_GREEN, code, fmt, ##__VA_ARGS__)
+    _bf_log_code_impl(BF_LOG_INFO, code, fmt, ##__VA_ARGS__)
 
 #define bf_dbg_r(code, fmt, ...)                                               \
-    _bf_log_code_impl("debug", BF_COLOR_BLUE, code, fmt, ##__VA_ARGS__)
-
-/**
- * Identical to @ref _bf_log_impl but for @p va_list arguments.
- *
- * @param level Log level, as a string. Will prefix the log message.
- * @param color Color to print the prefix with, as a @ref bf_color .
- * @param fmt Format string.
- * @param vargs @p va_list of arguments.
- */
-#define _bf_log_v_impl(level, color, fmt, vargs)                               \
-    do {                                                                       \
-        (void)fprintf(                                                         \
-            stderr, "%s%-7s%s: ", bf_logger_get_color((color), BF_STYLE_BOLD), \
-            (level), bf_logger_get_color(BF_COLOR_RESET, BF_STYLE_RESET));     \
-        (void)vfprintf(stderr, (fmt), (vargs));                                \
-        (void)fprintf(stderr, "\n");                                           \
-    } while (0)
+    _bf_log_code_impl(BF_LOG_DBG, code, fmt, ##__VA_ARGS__)
 
-#define bf_err_v(fmt, vargs) _bf_log_v_impl("error", BF_COLOR_RED, fmt, vargs)
+#define bf_err_v(fmt, vargs) bf_log_v(BF_LOG_ERR, fmt, vargs)
 
-#define bf_warn_v(fmt, vargs)                                                  \
-    _bf_log_v_impl("warning", BF_COLOR_YELLOW, fmt, vargs)
+#define bf_warn_v(fmt, vargs) bf_log_v(BF_LOG_WARN, fmt, vargs)
 
-#define bf_info_v(fmt, vargs) _bf_log_v_impl("info", BF_COLOR_GREEN, fmt, vargs)
+#define bf_info_v(fmt, vargs) bf_log_v(BF_LOG_INFO, fmt, vargs)
 
-#define bf_dbg_v(fmt, vargs) _bf_log_v_impl("debug", BF_COLOR_BLUE, fmt, vargs)
+#define bf_dbg_v(fmt, vargs) bf_log_v(BF_LOG_DBG, fmt, vargs)
 
 /**
  * Initialise the logging system.
@@ -163,3 +187,56 @@ void bf_logger_setup(void);
  * @return Style string.
  */
 const char *bf_logger_get_color(enum bf_color color, enum bf_style style);
+
+/**
+ * Set the format of the log messages.
+ *
+ * @param format Format to use. Must be valid.
+ */
+void bf_logger_set_format(enum bf_log_format format);
+
+/**
+ * Convert a string into a log format.
+ *
+ * @param str String to convert: "text", "json", or "journal". Can't be NULL.
+ * @param format On success, contains the log format. Can't be NULL.
+ * @return 0 on success, or -EINVAL if @p str is not a valid log format.
+ */
+int bf_log_format_from_str(const char *str, enum bf_log_format *format);
+
+/**
+ * Limit the number of identical messages logged per second.
+ *
+ * Messages are identified by their format string, so each call site is rate
+ * limited independently. Once @p burst messages have been logged by a call
+ * site during a 1 second interval, its following messages are dropped until
+ * the end of the interval. The number of dropped messages is logged with the
+ * call site's next message. Debug messages are never rate limited.
+ *
+ * @param burst Maximum number of messages logged per call site and per
+ *        second. If 0, rate limiting is disabled.
+ */
+void bf_logger_set_ratelimit(unsigned int burst);
+
+/**
+ * Write the log messages from a background thread.
+ *
+ * The messages logged by the calling thread are formatted, then pushed to a
+ * lock-free buffer, drained by a writer thread: the calling thread doesn't
+ * wait for the messages to be written. If the buffer is full, messages are
+ * dropped and the number of dropped messages is logged. Messages logged by
+ * other threads are written directly.
+ *
+ * The remaining messages are written when @ref bf_logger_teardown is called,
+ * which happens automatically when the process exits.
+ *
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_logger_start_async(void);
+
+/**
+ * Write the pending log messages and stop the writer thread.
+ *
+ * Does nothing if @ref bf_logger_start_async hasn't been called.
+ */
+void bf_logger_teardown(void);
@@ -149,6 +149,7 @@ static const char *_bf_matcher_type_strs[] = {
     [BF_MATCHER_UDP_DPORT] = "udp.dport",
     [BF_MATCHER_SET_SRCIP6PORT] = "set.srcip6port",
     [BF_MATCHER_SET_SRCIP6] = "set.srcip6",
+    [BF_MATCHER_CT_STATE] = "ct.state",
 };
 
 static_assert(ARRAY_SIZE(_bf_matcher_type_strs) == _BF_MATCHER_TYPE_MAX,
@@ -235,3 +236,36 @@ int bf_matcher_tcp_flag_from_str(const char *str,
 
     return -EINVAL;
 }
+
+static const char *_bf_matcher_ct_states_strs[] = {
+    [BF_MATCHER_CT_STATE_NEW] = "new",
+    [BF_MATCHER_CT_STATE_ESTABLISHED] = "established",
+    [BF_MATCHER_CT_STATE_RELATED] = "related",
+    [BF_MATCHER_CT_STATE_INVALID] = "invalid",
+};
+
+static_assert(ARRAY_SIZE(_bf_matcher_ct_states_strs) ==
+              _BF_MATCHER_CT_STATE_MAX);
+
+const char *bf_matcher_ct_state_to_str(enum bf_matcher_ct_state state)
+{
+    bf_assert(0 <= state && state < _BF_MATCHER_CT_STATE_MAX);
+
+    return _bf_matcher_ct_states_strs[state];
+}
+
+int bf_matcher_ct_state_from_str(const char *str,
+                                 enum bf_matcher_ct_state *state)
+{
+    bf_assert(str);
+    bf_assert(state);
+
+    for (size_t i = 0; i < _BF_MATCHER_CT_STATE_MAX; ++i) {
+        if (bf_streq(_bf_matcher_ct_states_strs[i], str)) {
+            *state = i;
+            return 0;
+        }
+    }
+
+    return -EINVAL;
+}
@@ -77,6 +77,8 @@ enum bf_matcher_type
     BF_MATCHER_SET_SRCIP6PORT,
     /// Matches the source IPv6 address against a set
     BF_MATCHER_SET_SRCIP6,
+    /// Matches the connection tracking state of the packet
+    BF_MATCHER_CT_STATE,
     _BF_MATCHER_TYPE_MAX,
 };
 
@@ -117,6 +119,26 @@ enum bf_matcher_tcp_flag
     _BF_MATCHER_TCP_FLAG_MAX,
 };
 
+/**
+ * Define the connection tracking states values as number of shifts of 1.
+ *
+ * The payload of @ref BF_MATCHER_CT_STATE is a bitmask of the states to
+ * match.
+ */
+enum bf_matcher_ct_state
+{
+    /// The packet starts a new connection.
+    BF_MATCHER_CT_STATE_NEW = 0,
+    /// The packet is part of a connection which has seen packets in both
+    /// directions.
+    BF_MATCHER_CT_STATE_ESTABLISHED = 1,
+    /// The packet starts a new connection, related to an existing one.
+    BF_MATCHER_CT_STATE_RELATED = 2,
+    /// The packet can't be associated to any connection.
+    BF_MATCHER_CT_STATE_INVALID = 3,
+    _BF_MATCHER_CT_STATE_MAX,
+};
+
 /**
  * Matcher comparison operator.
  *
@@ -261,3 +283,21 @@ const char *bf_matcher_tcp_flag_to_str(enum bf_matcher_tcp_flag flag);
  */
 int bf_matcher_tcp_flag_from_str(const char *str,
                                  enum bf_matcher_tcp_flag *flag);
+
+/**
+ * Convert a connection tracking state to a string.
+ *
+ * @param state Connection tracking state to convert.
+ * @return String representation of the connection tracking state.
+ */
+const char *bf_matcher_ct_state_to_str(enum bf_matcher_ct_state state);
+
+/**
+ * Convert a string to the corresponding connection tracking state.
+ *
+ * @param str String containing the name of the connection tracking state.
+ * @param state Connection tracking state value, if the parsing succeeds.
+ * @return 0 on success, or negative errno value on failure.
+ */
+int bf_matcher_ct_state_from_str(const char *str,
+                                 enum bf_matcher_ct_state *state);
@@ -23,6 +23,13 @@ enum
     BF_OPT_NO_IPTABLES_KEY,
     BF_OPT_NO_NFTABLES_KEY,
     BF_OPT_NO_CLI_KEY,
+    BF_OPT_TELEMETRY_KEY,
+    BF_OPT_PROFILE_KEY,
+    BF_OPT_PROFILE_BLOCK_KEY,
+    BF_OPT_METRICS_KEY,
+    BF_OPT_LOG_FORMAT_KEY,
+    BF_OPT_LOG_ASYNC_KEY,
+    BF_OPT_LOG_RATELIMIT_KEY,
     BF_OPT_VERSION,
 };
 
@@ -70,11 +77,37 @@ static struct bf_options
      * - @c debug Print all the debug logs.
      * - @c bpf Add debug log messages in the generated BPF programs. */
     uint16_t verbose;
+
+    /** If true, the generated BPF programs update a per-CPU telemetry map
+     * with the number of packets per protocol, and the reason for errors.
+     * See @ref bf_telemetry . */
+    bool telemetry;
+
+    /** If non-zero, the generated BPF programs sample 1 packet out of
+     * @c profile_rate and record the time spent in the program's prologue and
+     * in each block of @c profile_block rules. */
+    unsigned int profile_rate;
+
+    /** Number of rules per profiling block. */
+    unsigned int profile_block;
+
+    /** If true, the daemon serves statistics in the OpenMetrics text format
+     * on @ref BF_METRICS_SOCKET_PATH . */
+    bool metrics;
+
+    /** If true, log messages are written by a background thread, see
+     * @ref bf_logger_start_async . */
+    bool log_async;
 } _bf_opts = {
     .transient = false,
     .bpf_log_buf_len_pow = 16,
     .fronts = 0xffff,
     .verbose = 0,
+    .telemetry = false,
+    .profile_rate = 0,
+    .profile_block = 8,
+    .metrics = false,
+    .log_async = false,
 };
 
 static struct argp_option options[] = {
@@ -89,6 +122,25 @@ static struct argp_option options[] = {
     {"no-nftables", BF_OPT_NO_NFTABLES_KEY, 0, 0, "Disable nftables support",
      0},
     {"no-cli", BF_OPT_NO_CLI_KEY, 0, 0, "Disable CLI support", 0},
+    {"telemetry", BF_OPT_TELEMETRY_KEY, 0, 0,
+     "Count packets per protocol and errors per reason in the BPF programs",
+     0},
+    {"profile", BF_OPT_PROFILE_KEY, "RATE", 0,
+     "Record the processing time of 1 packet out of RATE in the BPF programs. Default: 0 (disabled).",
+     0},
+    {"profile-block", BF_OPT_PROFILE_BLOCK_KEY, "N_RULES", 0,
+     "Number of rules per profiling block (only used with --profile). Default: 8.",
+     0},
+    {"metrics", BF_OPT_METRICS_KEY, 0, 0,
+     "Serve statistics in the OpenMetrics text format on a dedicated socket",
+     0},
+    {"log-format", BF_OPT_LOG_FORMAT_KEY, "FORMAT", 0,
+     "Format of the log messages: text, json, or journal. Default: text.", 0},
+    {"log-async", BF_OPT_LOG_ASYNC_KEY, 0, 0,
+     "Write the log messages from a background thread", 0},
+    {"log-ratelimit", BF_OPT_LOG_RATELIMIT_KEY, "BURST", 0,
+     "Maximum number of identical log messages per second. Default: 0 (disabled).",
+     0},
     {"verbose", 'v', "VERBOSE_FLAG", 0,
      "Verbose flags to enable. Can be used more than once.", 0},
     {"version", BF_OPT_VERSION, 0, 0, "Print the version and return.", 0},
@@ -100,6 +152,37 @@ static struct argp_option options[] = {
  *
  * @return 0 on succcess, non-zero on failure.
  */
+/**
+ * Convert a command line argument into an unsigned integer.
+ *
+ * @param opt Name of the option, used for logging. Can't be NULL.
+ * @param arg Argument to convert. Can't be NULL.
+ * @param value On success, contains the converted value. Can't be NULL.
+ * @param allow_zero If true, 0 is a valid value.
+ * @return 0 on success, or a positive errno value on failure, as expected by
+ *         argp.
+ */
+static error_t _bf_opts_parse_uint(const char *opt, const char *arg,
+                                   unsigned int *value, bool allow_zero)
+{
+    unsigned long _value;
+    char *end;
+
+    bf_assert(opt && arg && value);
+
+    errno = 0;
+    _value = strtoul(arg, &end, 0);
+    if (errno || *end != '\0' || end == arg || arg[0] == '-' ||
+        _value > UINT_MAX)
+        return bf_err_r(EINVAL, "invalid value '%s' for --%s", arg, opt);
+    if (!allow_zero && !_value)
+        return bf_err_r(EINVAL, "--%s can't be 0", opt);
+
+    *value = (unsigned int)_value;
+
+    return 0;
+}
+
 static error_t _bf_opts_parser(int key, char *arg, struct argp_state *state)
 {
     UNUSED(arg);
@@ -141,6 +224,51 @@ static error_t _bf_opts_parser(int key, char *arg, struct argp_state *state)
         bf_info("disabling CLI support");
         args->fronts &= ~(1 << BF_FRONT_CLI);
         break;
+    case BF_OPT_TELEMETRY_KEY:
+        bf_info("enabling datapath telemetry");
+        args->telemetry = true;
+        break;
+    case BF_OPT_PROFILE_KEY:
+        r = _bf_opts_parse_uint("profile", arg, &args->profile_rate, true);
+        if (r)
+            return r;
+        if (args->profile_rate)
+            bf_info("profiling 1 packet out of %u", args->profile_rate);
+        break;
+    case BF_OPT_PROFILE_BLOCK_KEY:
+        r = _bf_opts_parse_uint("profile-block", arg, &args->profile_block,
+                                false);
+        if (r)
+            return r;
+        break;
+    case BF_OPT_METRICS_KEY:
+        bf_info("enabling metrics socket");
+        args->metrics = true;
+        break;
+    case BF_OPT_LOG_FORMAT_KEY: {
+        enum bf_log_format format;
+
+        if (bf_log_format_from_str(arg, &format) < 0) {
+            return bf_err_r(
+                EINVAL,
+                "unknown --log-format '%s', valid formats: [text, json, journal]",
+                arg);
+        }
+        bf_logger_set_format(format);
+        break;
+    }
+    case BF_OPT_LOG_ASYNC_KEY:
+        args->log_async = true;
+        break;
+    case BF_OPT_LOG_RATELIMIT_KEY: {
+        unsigned int burst;
+
+        r = _bf_opts_parse_uint("log-ratelimit", arg, &burst, true);
+        if (r)
+            return r;
+        bf_logger_set_ratelimit(burst);
+        break;
+    }
     case 'v':
         r = bf_verbose_to_str(arg, &opt);
         if (r < 0)
@@ -188,6 +316,31 @@ bool bf_opts_is_verbose(enum bf_verbose opt)
     return _bf_opts.verbose & (1 << opt);
 }
 
+bool bf_opts_telemetry(void)
+{
+    return _bf_opts.telemetry;
+}
+
+unsigned int bf_opts_profile_rate(void)
+{
+    return _bf_opts.profile_rate;
+}
+
+unsigned int bf_opts_profile_block(void)
+{
+    return _bf_opts.profile_block;
+}
+
+bool bf_opts_metrics(void)
+{
+    return _bf_opts.metrics;
+}
+
+bool bf_opts_log_async(void)
+{
+    return _bf_opts.log_async;
+}
+
 void bf_opts_set_verbose(enum bf_verbose opt)
 {
     _bf_opts.verbose |= (1 << opt);
@@ -22,4 +22,9 @@ bool bf_opts_transient(void);
 unsigned int bf_opts_bpf_log_buf_len_pow(void);
 bool bf_opts_is_front_enabled(enum bf_front front);
 bool bf_opts_is_verbose(enum bf_verbose opt);
+bool bf_opts_telemetry(void);
+unsigned int bf_opts_profile_rate(void);
+unsigned int bf_opts_profile_block(void);
+bool bf_opts_metrics(void);
+bool bf_opts_log_async(void);
 void bf_opts_set_verbose(enum bf_verbose opt);
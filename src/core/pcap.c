@@ -0,0 +1,265 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "core/pcap.h"
+
+#include <linux/if_ether.h>
+
+#include <arpa/inet.h>
+#include <byteswap.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/helper.h"
+#include "core/logger.h"
+
+#define BF_PCAP_MAGIC_US 0xa1b2c3d4
+#define BF_PCAP_MAGIC_NS 0xa1b23c4d
+#define BF_PCAPNG_MAGIC 0x0a0d0d0a
+
+#define BF_PCAP_LINKTYPE_ETHERNET 1
+#define BF_PCAP_LINKTYPE_RAW 101
+#define BF_PCAP_LINKTYPE_LINUX_SLL 113
+#define BF_PCAP_LINKTYPE_IPV4 228
+#define BF_PCAP_LINKTYPE_IPV6 229
+
+/// Size of the Linux cooked capture header, the protocol is the last field.
+#define BF_PCAP_SLL_HDR_LEN 16
+
+struct bf_pcap_hdr
+{
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} bf_packed;
+
+struct bf_pcap_rec_hdr
+{
+    uint32_t ts_sec;
+    uint32_t ts_frac;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} bf_packed;
+
+static inline uint32_t _bf_pcap_u32(uint32_t value, bool swapped)
+{
+    return swapped ? bswap_32(value) : value;
+}
+
+/**
+ * Get the EtherType of a packet which doesn't start with an Ethernet header.
+ *
+ * @param linktype Link type of the capture.
+ * @param data Packet data, starting with the link-layer header. Can't be NULL.
+ * @param len Length of @p data , in bytes.
+ * @param ethertype On success, contains the EtherType of the packet, in
+ *        network byte order. Can't be NULL.
+ * @param skip On success, contains the size of the link-layer header to
+ *        replace with an Ethernet header. Can't be NULL.
+ * @return 0 on success, or -ENOTSUP if the packet's protocol can't be
+ *         defined.
+ */
+static int _bf_pcap_get_ethertype(uint32_t linktype, const uint8_t *data,
+                                  size_t len, uint16_t *ethertype,
+                                  size_t *skip)
+{
+    bf_assert(data && ethertype && skip);
+
+    switch (linktype) {
+    case BF_PCAP_LINKTYPE_RAW:
+    case BF_PCAP_LINKTYPE_IPV4:
+    case BF_PCAP_LINKTYPE_IPV6:
+        if (!len)
+            return -ENOTSUP;
+
+        *skip = 0;
+        if (data[0] >> 4 == 4)
+            *ethertype = htons(ETH_P_IP);
+        else if (data[0] >> 4 == 6)
+            *ethertype = htons(ETH_P_IPV6);
+        else
+            return -ENOTSUP;
+        break;
+    case BF_PCAP_LINKTYPE_LINUX_SLL:
+        if (len < BF_PCAP_SLL_HDR_LEN)
+            return -ENOTSUP;
+
+        *skip = BF_PCAP_SLL_HDR_LEN;
+        memcpy(ethertype, &data[BF_PCAP_SLL_HDR_LEN - sizeof(*ethertype)],
+               sizeof(*ethertype));
+        break;
+    default:
+        return -ENOTSUP;
+    }
+
+    return 0;
+}
+
+int bf_pcap_parse(const void *buf, size_t len, void **pkts, size_t *pkts_len,
+                  size_t *n_pkts)
+{
+    _cleanup_free_ uint8_t *_pkts = NULL;
+    struct bf_pcap_hdr hdr;
+    size_t n_skipped = 0;
+    size_t _n_pkts = 0;
+    size_t offset;
+    size_t out = 0;
+    bool swapped;
+    uint32_t linktype;
+
+    bf_assert(buf && pkts && pkts_len && n_pkts);
+
+    if (len < sizeof(uint32_t))
+        return bf_err_r(-EINVAL, "capture file is too small");
+
+    memcpy(&hdr.magic, buf, sizeof(hdr.magic));
+    if (hdr.magic == BF_PCAPNG_MAGIC) {
+        return bf_err_r(-ENOTSUP,
+                        "pcapng captures are not supported, convert the "
+                        "capture with 'editcap -F pcap'");
+    }
+
+    if (hdr.magic == BF_PCAP_MAGIC_US || hdr.magic == BF_PCAP_MAGIC_NS)
+        swapped = false;
+    else if (hdr.magic == bswap_32(BF_PCAP_MAGIC_US) ||
+             hdr.magic == bswap_32(BF_PCAP_MAGIC_NS))
+        swapped = true;
+    else
+        return bf_err_r(-EINVAL, "invalid pcap magic number 0x%08x", hdr.magic);
+
+    if (len < sizeof(hdr))
+        return bf_err_r(-EINVAL, "capture file is too small");
+    memcpy(&hdr, buf, sizeof(hdr));
+
+    linktype = _bf_pcap_u32(hdr.linktype, swapped);
+    if (linktype != BF_PCAP_LINKTYPE_ETHERNET &&
+        linktype != BF_PCAP_LINKTYPE_RAW &&
+        linktype != BF_PCAP_LINKTYPE_LINUX_SLL &&
+        linktype != BF_PCAP_LINKTYPE_IPV4 && linktype != BF_PCAP_LINKTYPE_IPV6)
+        return bf_err_r(-ENOTSUP, "unsupported pcap link type %u", linktype);
+
+    /* Each record has a 16 bytes header, replaced with the packet's length
+     * (4 bytes) and possibly an Ethernet header (14 bytes): the packets can't
+     * use more than 1/8 more space than the capture file. */
+    _pkts = malloc(len + (len / 8) + 1);
+    if (!_pkts)
+        return -ENOMEM;
+
+    offset = sizeof(hdr);
+    while (offset < len) {
+        struct bf_pcap_rec_hdr rec;
+        struct bf_pcap_pkt pkt;
+        const uint8_t *data;
+        uint16_t ethertype = 0;
+        size_t skip = 0;
+        uint32_t incl_len;
+
+        if (len - offset < sizeof(rec)) {
+            bf_warn("capture file is truncated, ignoring the last packet");
+            break;
+        }
+
+        memcpy(&rec, (const uint8_t *)buf + offset, sizeof(rec));
+        offset += sizeof(rec);
+
+        incl_len = _bf_pcap_u32(rec.incl_len, swapped);
+        if (incl_len > len - offset) {
+            bf_warn("capture file is truncated, ignoring the last packet");
+            break;
+        }
+
+        data = (const uint8_t *)buf + offset;
+        offset += incl_len;
+
+        if (linktype != BF_PCAP_LINKTYPE_ETHERNET &&
+            _bf_pcap_get_ethertype(linktype, data, incl_len, &ethertype,
+                                   &skip)) {
+            ++n_skipped;
+            continue;
+        }
+
+        if (incl_len - skip == 0) {
+            ++n_skipped;
+            continue;
+        }
+
+        pkt.len = incl_len - skip;
+        if (linktype != BF_PCAP_LINKTYPE_ETHERNET)
+            pkt.len += sizeof(struct ethhdr);
+
+        memcpy(&_pkts[out], &pkt, sizeof(pkt));
+        out += sizeof(pkt);
+
+        if (linktype != BF_PCAP_LINKTYPE_ETHERNET) {
+            struct ethhdr ethhdr = {
+                .h_proto = ethertype,
+            };
+
+            memcpy(&_pkts[out], &ethhdr, sizeof(ethhdr));
+            out += sizeof(ethhdr);
+        }
+
+        memcpy(&_pkts[out], data + skip, incl_len - skip);
+        out += incl_len - skip;
+        ++_n_pkts;
+    }
+
+    if (n_skipped)
+        bf_warn("ignored %lu packets with an unknown protocol", n_skipped);
+
+    *pkts = TAKE_PTR(_pkts);
+    *pkts_len = out;
+    *n_pkts = _n_pkts;
+
+    return 0;
+}
+
+int bf_pcap_read(const char *path, void **pkts, size_t *pkts_len,
+                 size_t *n_pkts)
+{
+    _cleanup_free_ void *buf = NULL;
+    size_t len;
+    int r;
+
+    bf_assert(path && pkts && pkts_len && n_pkts);
+
+    r = bf_read_file(path, &buf, &len);
+    if (r)
+        return bf_err_r(r, "failed to read capture file %s", path);
+
+    r = bf_pcap_parse(buf, len, pkts, pkts_len, n_pkts);
+    if (r)
+        return bf_err_r(r, "failed to parse capture file %s", path);
+
+    return 0;
+}
+
+const struct bf_pcap_pkt *bf_pcap_pkt_next(const void *pkts, size_t pkts_len,
+                                           const struct bf_pcap_pkt *pkt)
+{
+    size_t offset = 0;
+    const struct bf_pcap_pkt *next;
+
+    bf_assert(pkts);
+
+    if (pkt)
+        offset = (size_t)((const uint8_t *)pkt - (const uint8_t *)pkts) +
+                 sizeof(*pkt) + pkt->len;
+
+    if (offset >= pkts_len || pkts_len - offset < sizeof(*next))
+        return NULL;
+
+    next = (const void *)((const uint8_t *)pkts + offset);
+    if (next->len > pkts_len - offset - sizeof(*next))
+        return NULL;
+
+    return next;
+}
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "core/helper.h"
+
+/**
+ * @file pcap.h
+ *
+ * Read packets from a capture file in the pcap format, to replay them through
+ * a BPF program with @c BPF_PROG_TEST_RUN .
+ *
+ * Only the classic pcap format is supported (not pcapng), with microsecond or
+ * nanosecond timestamps, in either byte order. The programs expect packets
+ * starting with an Ethernet header: captures of raw IP packets
+ * (@c LINKTYPE_RAW , @c LINKTYPE_IPV4 , @c LINKTYPE_IPV6 ) and Linux cooked
+ * captures (@c LINKTYPE_LINUX_SLL , used by @c "tcpdump -i any" ) get a
+ * synthetic Ethernet header instead of their link-layer header.
+ *
+ * Packets are stored back to back in a buffer, each packet prefixed with its
+ * length, see @ref bf_pcap_pkt . The buffer can be sent to the daemon as-is.
+ */
+
+/**
+ * Packet read from a capture file.
+ */
+struct bf_pcap_pkt
+{
+    /// Length of the packet, in bytes.
+    uint32_t len;
+    /// Packet data, starting with the Ethernet header.
+    uint8_t data[];
+} bf_packed;
+
+/**
+ * Parse a capture file's content.
+ *
+ * @param buf Content of the capture file. Can't be NULL.
+ * @param len Size of @p buf , in bytes.
+ * @param pkts On success, points to a buffer containing the packets. Owned by
+ *        the caller. Can't be NULL.
+ * @param pkts_len On success, contains the size of @p pkts , in bytes. Can't
+ *        be NULL.
+ * @param n_pkts On success, contains the number of packets in @p pkts . Can't
+ *        be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_pcap_parse(const void *buf, size_t len, void **pkts, size_t *pkts_len,
+                  size_t *n_pkts);
+
+/**
+ * Read the packets of a capture file.
+ *
+ * @param path Path to the capture file. Can't be NULL.
+ * @param pkts On success, points to a buffer containing the packets. Owned by
+ *        the caller. Can't be NULL.
+ * @param pkts_len On success, contains the size of @p pkts , in bytes. Can't
+ *        be NULL.
+ * @param n_pkts On success, contains the number of packets in @p pkts . Can't
+ *        be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_pcap_read(const char *path, void **pkts, size_t *pkts_len,
+                 size_t *n_pkts);
+
+/**
+ * Get the next packet of a packets buffer.
+ *
+ * Use this function to iterate over the packets of a buffer, which might
+ * come from an untrusted source: packets which are not fully contained in
+ * the buffer are not returned.
+ *
+ * @param pkts Buffer containing the packets. Can't be NULL.
+ * @param pkts_len Size of @p pkts , in bytes.
+ * @param pkt Current packet, or NULL to get the first packet.
+ * @return The packet following @p pkt , or NULL if there is no packet left.
+ */
+const struct bf_pcap_pkt *bf_pcap_pkt_next(const void *pkts, size_t pkts_len,
+                                           const struct bf_pcap_pkt *pkt);
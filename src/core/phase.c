@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "core/phase.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "core/helper.h"
+
+static const char *_bf_phase_strs[] = {
+    [BF_PHASE_XLATE] = "xlate",   [BF_PHASE_GENERATE] = "generate",
+    [BF_PHASE_SETS] = "sets",     [BF_PHASE_LOAD] = "load",
+    [BF_PHASE_ATTACH] = "attach", [BF_PHASE_PIN] = "pin",
+    [BF_PHASE_SAVE] = "save",
+};
+
+static_assert(ARRAY_SIZE(_bf_phase_strs) == _BF_PHASE_MAX,
+              "missing entries in the phase array");
+
+/// Accumulated duration of each phase, in nanoseconds.
+static uint64_t _bf_phase_durations[_BF_PHASE_MAX];
+
+uint64_t bf_phase_now_ns(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+const char *bf_phase_to_str(enum bf_phase phase)
+{
+    bf_assert(0 <= phase && phase < _BF_PHASE_MAX);
+
+    return _bf_phase_strs[phase];
+}
+
+void bf_phase_reset(void)
+{
+    memset(_bf_phase_durations, 0, sizeof(_bf_phase_durations));
+}
+
+void bf_phase_get(uint64_t *durations)
+{
+    bf_assert(durations);
+
+    memcpy(durations, _bf_phase_durations, sizeof(_bf_phase_durations));
+}
+
+struct bf_phase_timer bf_phase_timer_start(enum bf_phase phase)
+{
+    bf_assert(0 <= phase && phase < _BF_PHASE_MAX);
+
+    return (struct bf_phase_timer) {
+        .phase = phase,
+        .start_ns = bf_phase_now_ns(),
+    };
+}
+
+void bf_phase_timer_stop(struct bf_phase_timer *timer)
+{
+    bf_assert(timer);
+
+    _bf_phase_durations[timer->phase] += bf_phase_now_ns() - timer->start_ns;
+}
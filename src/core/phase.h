@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @file phase.h
+ *
+ * Control-plane phase timing. The daemon measures the time spent in each
+ * phase of a request (translating the rules, generating the program, loading
+ * it, ...) using a monotonic clock. The durations are accumulated from the
+ * moment @ref bf_phase_reset is called, as a request can go through the same
+ * phase multiple times (e.g. to generate multiple programs).
+ *
+ * Phases are timed using a scoped timer, stopped when it goes out of scope:
+ *
+ * @code{.c}
+ *  {
+ *      _cleanup_bf_phase_timer_ struct bf_phase_timer _ =
+ *          bf_phase_timer_start(BF_PHASE_GENERATE);
+ *
+ *      // Generate the program...
+ *  }
+ * @endcode
+ *
+ * Phases are not expected to be nested: a nested phase would be accounted
+ * for in both phases.
+ */
+
+#define _cleanup_bf_phase_timer_                                               \
+    __attribute__((cleanup(bf_phase_timer_stop)))
+
+/**
+ * Control-plane phases.
+ */
+enum bf_phase
+{
+    /// Translate the front-specific request into chains.
+    BF_PHASE_XLATE,
+    /// Generate the BPF bytecode.
+    BF_PHASE_GENERATE,
+    /// Create the set maps and fill them.
+    BF_PHASE_SETS,
+    /// Load the BPF program, including the verifier.
+    BF_PHASE_LOAD,
+    /// Attach the BPF program to its hook.
+    BF_PHASE_ATTACH,
+    /// Pin the BPF objects to the filesystem.
+    BF_PHASE_PIN,
+    /// Save the daemon's runtime context to the filesystem.
+    BF_PHASE_SAVE,
+    _BF_PHASE_MAX,
+};
+
+/**
+ * Scoped phase timer, see @ref bf_phase_timer_start .
+ */
+struct bf_phase_timer
+{
+    enum bf_phase phase;
+    uint64_t start_ns;
+};
+
+/**
+ * Convert a phase into a string.
+ *
+ * @param phase Phase to convert. Must be valid.
+ * @return String representation of the phase.
+ */
+const char *bf_phase_to_str(enum bf_phase phase);
+
+/**
+ * Get the current time of the monotonic clock used to time the phases.
+ *
+ * @return Current time, in nanoseconds.
+ */
+uint64_t bf_phase_now_ns(void);
+
+/**
+ * Reset the accumulated durations of all the phases.
+ */
+void bf_phase_reset(void);
+
+/**
+ * Get the accumulated durations of all the phases.
+ *
+ * @param durations Array of @ref _BF_PHASE_MAX durations to fill, in
+ *        nanoseconds, indexed by @ref bf_phase . Can't be NULL.
+ */
+void bf_phase_get(uint64_t *durations);
+
+/**
+ * Start timing a phase.
+ *
+ * The returned timer should be declared with @ref _cleanup_bf_phase_timer_ ,
+ * so the phase's duration is accumulated when the timer goes out of scope.
+ *
+ * @param phase Phase to time. Must be valid.
+ * @return A running timer for @p phase .
+ */
+struct bf_phase_timer bf_phase_timer_start(enum bf_phase phase);
+
+/**
+ * Stop a phase timer, and add the elapsed time to the phase's duration.
+ *
+ * @param timer Timer to stop. Can't be NULL.
+ */
+void bf_phase_timer_stop(struct bf_phase_timer *timer);
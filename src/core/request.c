@@ -7,12 +7,17 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "core/helper.h"
 
+static_assert(offsetof(struct bf_request, data_len) ==
+                  4 * sizeof(uint32_t),
+              "bf_request::flags must not change the layout of bf_request");
+
 int bf_request_new(struct bf_request **request, const void *data,
                    size_t data_len)
 {
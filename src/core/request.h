@@ -6,6 +6,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "core/front.h"
 #include "core/helper.h"
@@ -22,6 +23,12 @@
  *  Custom request: only the front this request is targeted to is able to
  *  understand what is the actual command. Allows for fronts to implement
  *  new commands.
+ *
+ * New commands are added at the end of the enumeration, after
+ * @c BF_REQ_CUSTOM , so the values of the existing commands don't change.
+ * This doesn't make the protocol backward compatible: the serialized objects
+ * sent by the clients are not versioned, so a client and the daemon must be
+ * built from the same version of bpfilter.
  */
 enum bf_request_cmd
 {
@@ -33,9 +40,37 @@ enum bf_request_cmd
     BF_REQ_COUNTERS_SET,
     BF_REQ_COUNTERS_GET,
     BF_REQ_CUSTOM,
+    /* Patch a single rule of an existing chain: insert, delete, or replace a
+     * rule identified by its handle. */
+    BF_REQ_RULES_PATCH,
+    /* Get the elements of a set with the highest per-element counters. */
+    BF_REQ_SET_COUNTERS_GET,
+    /* Get the profiling histograms of a chain, see --profile. */
+    BF_REQ_PROFILE_GET,
+    /* Get the kernel's runtime statistics of the programs of a front. */
+    BF_REQ_PROG_STATS_GET,
+    /* Run packets through a chain which is loaded but not attached, see
+     * core/sim.h. */
+    BF_REQ_RULESET_SIMULATE,
+    /* Generate a chain's program, and optionally verify it, without
+     * attaching it, see core/check.h. */
+    BF_REQ_RULESET_CHECK,
     _BF_REQ_CMD_MAX,
 };
 
+/**
+ * Flags of a request, see @ref bf_request::flags .
+ *
+ * @var bf_request_flag::BF_REQ_FLAG_TIMINGS
+ *  Append the time spent by the daemon in each control-plane phase to the
+ *  response's data, see @ref bf_response_add_timings . Ignored if the
+ *  request fails.
+ */
+enum bf_request_flag
+{
+    BF_REQ_FLAG_TIMINGS = 1 << 0,
+};
+
 /**
  * @struct bf_request
  *
@@ -47,6 +82,11 @@ enum bf_request_cmd
  *  Command.
  * @var bf_request::ipt_cmd
  *  Custom command for the IPT front.
+ * @var bf_request::flags
+ *  Bitmask of @ref bf_request_flag values. It fits in the padding between
+ *  the custom command and @c data_len , so the layout of the request is
+ *  unchanged, and requests allocated with @ref bf_request_new default to no
+ *  flag.
  * @var bf_request::data_len
  *  Length of the client-specific data.
  * @var bf_request::data
@@ -65,6 +105,7 @@ struct bf_request
         };
     };
 
+    uint32_t flags;
     size_t data_len;
     char data[];
 };
@@ -9,8 +9,10 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "core/helper.h"
+#include "core/phase.h"
 
 int bf_response_new_raw(struct bf_response **response, size_t data_len)
 {
@@ -85,3 +87,42 @@ int bf_response_copy(struct bf_response **dest, const struct bf_response *src)
 
     return 0;
 }
+
+int bf_response_add_timings(struct bf_response **response,
+                            const uint64_t *timings)
+{
+    _cleanup_bf_response_ struct bf_response *_response = NULL;
+    const size_t timings_len = _BF_PHASE_MAX * sizeof(*timings);
+    int r;
+
+    bf_assert(response && *response && timings);
+    bf_assert((*response)->type == BF_RES_SUCCESS);
+
+    r = bf_response_new_raw(&_response, (*response)->data_len + timings_len);
+    if (r)
+        return r;
+
+    _response->data_len = (*response)->data_len + timings_len;
+    bf_memcpy(_response->data, (*response)->data, (*response)->data_len);
+    memcpy(_response->data + (*response)->data_len, timings, timings_len);
+
+    bf_response_free(response);
+    *response = TAKE_PTR(_response);
+
+    return 0;
+}
+
+int bf_response_take_timings(struct bf_response *response, uint64_t *timings)
+{
+    const size_t timings_len = _BF_PHASE_MAX * sizeof(*timings);
+
+    bf_assert(response && timings);
+
+    if (response->type != BF_RES_SUCCESS || response->data_len < timings_len)
+        return -EINVAL;
+
+    response->data_len -= timings_len;
+    memcpy(timings, response->data + response->data_len, timings_len);
+
+    return 0;
+}
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "core/helper.h"
 
@@ -123,3 +124,33 @@ static inline size_t bf_response_size(const struct bf_response *response)
     return sizeof(struct bf_response) +
            (response->type == BF_RES_SUCCESS ? response->data_len : 0);
 }
+
+/**
+ * Append the control-plane timings of a request to a successful response.
+ *
+ * The timings are only sent to the clients which requested them with
+ * @ref BF_REQ_FLAG_TIMINGS : they are appended to the response's data, after
+ * the front-specific payload. Failure responses don't carry timings.
+ *
+ * @param response Successful response to append the timings to. It is
+ *        reallocated on success. Can't be NULL.
+ * @param timings Duration of each control-plane phase, in nanoseconds,
+ *        indexed by @ref bf_phase . Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_response_add_timings(struct bf_response **response,
+                            const uint64_t *timings);
+
+/**
+ * Remove the control-plane timings from a successful response.
+ *
+ * Reverse operation of @ref bf_response_add_timings : the timings are copied
+ * into @p timings , and removed from the response's data.
+ *
+ * @param response Successful response to take the timings from. Can't be
+ *        NULL.
+ * @param timings Array of @ref _BF_PHASE_MAX entries to fill with the
+ *        duration of each phase, in nanoseconds. Can't be NULL.
+ * @return 0 on success, or -EINVAL if @p response doesn't contain timings.
+ */
+int bf_response_take_timings(struct bf_response *response, uint64_t *timings);
@@ -66,6 +66,10 @@ int bf_rule_marsh(const struct bf_rule *rule, struct bf_marsh **marsh)
     if (r < 0)
         return r;
 
+    r = bf_marsh_add_child_raw(&_marsh, &rule->handle, sizeof(rule->handle));
+    if (r < 0)
+        return r;
+
     {
         _cleanup_bf_marsh_ struct bf_marsh *child = NULL;
 
@@ -82,6 +86,11 @@ int bf_rule_marsh(const struct bf_rule *rule, struct bf_marsh **marsh)
                                 sizeof(rule->counters));
     r |= bf_marsh_add_child_raw(&_marsh, &rule->verdict,
                                 sizeof(enum bf_verdict));
+    r |= bf_marsh_add_child_raw(&_marsh, &rule->target, sizeof(rule->target));
+    r |= bf_marsh_add_child_raw(&_marsh, &rule->set_add,
+                                sizeof(rule->set_add));
+    r |= bf_marsh_add_child_raw(&_marsh, &rule->set_index,
+                                sizeof(rule->set_index));
     if (r)
         return bf_err_r(r, "Failed to serialize rule");
 
@@ -107,6 +116,10 @@ int bf_rule_unmarsh(const struct bf_marsh *marsh, struct bf_rule **rule)
         return -EINVAL;
     memcpy(&_rule->index, rule_elem->data, sizeof(_rule->index));
 
+    if (!(rule_elem = bf_marsh_next_child(marsh, rule_elem)))
+        return -EINVAL;
+    memcpy(&_rule->handle, rule_elem->data, sizeof(_rule->handle));
+
     if (!(rule_elem = bf_marsh_next_child(marsh, rule_elem)))
         return -EINVAL;
 
@@ -136,6 +149,18 @@ int bf_rule_unmarsh(const struct bf_marsh *marsh, struct bf_rule **rule)
         return -EINVAL;
     memcpy(&_rule->verdict, rule_elem->data, sizeof(_rule->verdict));
 
+    if (!(rule_elem = bf_marsh_next_child(marsh, rule_elem)))
+        return -EINVAL;
+    memcpy(&_rule->target, rule_elem->data, sizeof(_rule->target));
+
+    if (!(rule_elem = bf_marsh_next_child(marsh, rule_elem)))
+        return -EINVAL;
+    memcpy(&_rule->set_add, rule_elem->data, sizeof(_rule->set_add));
+
+    if (!(rule_elem = bf_marsh_next_child(marsh, rule_elem)))
+        return -EINVAL;
+    memcpy(&_rule->set_index, rule_elem->data, sizeof(_rule->set_index));
+
     if (bf_marsh_next_child(marsh, rule_elem))
         bf_warn("codegen marsh has more children than expected");
 
@@ -154,6 +179,7 @@ void bf_rule_dump(const struct bf_rule *rule, prefix_t *prefix)
     bf_dump_prefix_push(prefix);
 
     DUMP(prefix, "index: %u", rule->index);
+    DUMP(prefix, "handle: %u", rule->handle);
 
     // Matchers
     DUMP(prefix, "matchers: %lu", bf_list_size(&rule->matchers));
@@ -169,8 +195,10 @@ void bf_rule_dump(const struct bf_rule *rule, prefix_t *prefix)
     bf_dump_prefix_pop(prefix);
 
     DUMP(prefix, "counters: %s", rule->counters ? "yes" : "no");
-    DUMP(bf_dump_prefix_last(prefix), "verdict: %s",
-         bf_verdict_to_str(rule->verdict));
+    DUMP(prefix, "verdict: %s", bf_verdict_to_str(rule->verdict));
+    DUMP(prefix, "target: %u", rule->target);
+    DUMP(bf_dump_prefix_last(prefix), "set_add: %s (set %u)",
+         rule->set_add ? "yes" : "no", rule->set_index);
 
     bf_dump_prefix_pop(prefix);
 }
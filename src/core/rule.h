@@ -34,13 +34,30 @@ struct bf_marsh;
  *
  * @var bf_rule::index
  *  Rule's index. Identifies the rule's within other rules from the same front.
+ * @var bf_rule::handle
+ *  Rule's handle. Unlike @p index , the handle of a rule doesn't change when
+ *  other rules are inserted or removed from the chain, so it can be used to
+ *  identify a rule to patch. Assigned by the chain the rule is added to.
+ * @var bf_rule::target
+ *  Index of the sub-chain to evaluate if the rule matches, in
+ *  @ref bf_chain::subchains . Only used if the rule's verdict is
+ *  @c BF_VERDICT_JUMP or @c BF_VERDICT_GOTO .
+ * @var bf_rule::set_add
+ *  If true, the packet's source is added to the set at index
+ *  @c bf_rule::set_index in the chain's sets when the rule matches. The set
+ *  must be dynamic, its type defines the key added to the set (e.g. the
+ *  source IPv4 address for @c BF_SET_IP4 ).
  */
 struct bf_rule
 {
     uint32_t index;
+    uint32_t handle;
     bf_list matchers;
     bool counters;
     enum bf_verdict verdict;
+    uint32_t target;
+    bool set_add;
+    uint32_t set_index;
 };
 
 /**
@@ -41,6 +41,9 @@ int bf_set_new(struct bf_set **set, enum bf_set_type type)
 
     (*set)->type = type;
     (*set)->elem_size = _bf_set_type_elem_size(type);
+    (*set)->max_elems = 0;
+    (*set)->timeout = 0;
+    (*set)->counters = false;
     bf_list_init(&(*set)->elems,
                  (bf_list_ops[]) {{.free = (bf_list_ops_free)freep}});
 
@@ -81,6 +84,18 @@ int bf_set_new_from_marsh(struct bf_set **set, const struct bf_marsh *marsh)
         TAKE_PTR(elem);
     }
 
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return -EINVAL;
+    memcpy(&_set->max_elems, child->data, sizeof(_set->max_elems));
+
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return -EINVAL;
+    memcpy(&_set->timeout, child->data, sizeof(_set->timeout));
+
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return -EINVAL;
+    memcpy(&_set->counters, child->data, sizeof(_set->counters));
+
     *set = TAKE_PTR(_set);
 
     return 0;
@@ -130,6 +145,19 @@ int bf_set_marsh(const struct bf_set *set, struct bf_marsh **marsh)
     if (r < 0)
         return r;
 
+    r = bf_marsh_add_child_raw(&_marsh, &set->max_elems,
+                               sizeof(set->max_elems));
+    if (r < 0)
+        return r;
+
+    r = bf_marsh_add_child_raw(&_marsh, &set->timeout, sizeof(set->timeout));
+    if (r < 0)
+        return r;
+
+    r = bf_marsh_add_child_raw(&_marsh, &set->counters, sizeof(set->counters));
+    if (r < 0)
+        return r;
+
     *marsh = TAKE_PTR(_marsh);
 
     return 0;
@@ -144,6 +172,9 @@ void bf_set_dump(const struct bf_set *set, prefix_t *prefix)
 
     DUMP(prefix, "type: %s", bf_set_type_to_str(set->type));
     DUMP(prefix, "elem_size: %lu", set->elem_size);
+    DUMP(prefix, "max_elems: %u", set->max_elems);
+    DUMP(prefix, "timeout: %u", set->timeout);
+    DUMP(prefix, "counters: %s", set->counters ? "yes" : "no");
     DUMP(bf_dump_prefix_last(prefix), "elems: bf_list<bytes>[%lu]",
          bf_list_size(&set->elems));
 
@@ -162,6 +193,13 @@ void bf_set_dump(const struct bf_set *set, prefix_t *prefix)
     bf_dump_prefix_pop(prefix);
 }
 
+bool bf_set_is_dynamic(const struct bf_set *set)
+{
+    bf_assert(set);
+
+    return set->max_elems != 0;
+}
+
 int bf_set_add_elem(struct bf_set *set, void *elem)
 {
     _cleanup_free_ void *_elem = NULL;
@@ -185,6 +223,22 @@ int bf_set_add_elem(struct bf_set *set, void *elem)
     return 0;
 }
 
+int bf_set_remove_elem(struct bf_set *set, const void *elem)
+{
+    bf_assert(set);
+    bf_assert(elem);
+
+    bf_list_foreach (&set->elems, elem_node) {
+        if (memcmp(bf_list_node_get_data(elem_node), elem, set->elem_size))
+            continue;
+
+        bf_list_delete(&set->elems, elem_node);
+        return 0;
+    }
+
+    return -ENOENT;
+}
+
 static const char *_bf_set_type_strs[] = {
     [BF_SET_IP4] = "BF_SET_IP4",
     [BF_SET_SRCIP6PORT] = "BF_SET_SRCIP6PORT",
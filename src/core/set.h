@@ -5,7 +5,9 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "core/dump.h"
 #include "core/list.h"
@@ -65,6 +67,21 @@ struct bf_set
     enum bf_set_type type;
     size_t elem_size;
     bf_list elems;
+
+    /** Maximum number of elements in the set. If 0, the set is static: it is
+     * sized to fit its elements, and only userspace can modify it. Otherwise,
+     * the set is dynamic: rules can add the packet's source to the set (see
+     * @ref bf_rule::set_add ), and the least recently used elements are
+     * evicted when the set is full. */
+    uint32_t max_elems;
+
+    /** Number of seconds an element added by a rule remains in the set. If 0,
+     * the elements never expire. Only used by dynamic sets. */
+    uint32_t timeout;
+
+    /** If true, the number of packets and bytes matching each element of the
+     * set is counted. Only supported by static sets. */
+    bool counters;
 };
 
 int bf_set_new(struct bf_set **set, enum bf_set_type type);
@@ -73,7 +90,27 @@ void bf_set_free(struct bf_set **set);
 int bf_set_marsh(const struct bf_set *set, struct bf_marsh **marsh);
 void bf_set_dump(const struct bf_set *set, prefix_t *prefix);
 
+/**
+ * Check whether a set is dynamic.
+ *
+ * @param set Set to check. Can't be NULL.
+ * @return True if elements can be added to @p set by the rules, false
+ *         otherwise.
+ */
+bool bf_set_is_dynamic(const struct bf_set *set);
+
 int bf_set_add_elem(struct bf_set *set, void *elem);
 
+/**
+ * Remove an element from a set.
+ *
+ * @param set Set to remove the element from. Can't be NULL.
+ * @param elem Element to remove, must be @c set->elem_size bytes long. Can't
+ *        be NULL.
+ * @return 0 on success, or a negative errno value on failure. If @p elem is
+ *         not part of the set, @c -ENOENT is returned.
+ */
+int bf_set_remove_elem(struct bf_set *set, const void *elem);
+
 const char *bf_set_type_to_str(enum bf_set_type type);
 int bf_set_type_from_str(const char *str, enum bf_set_type *type);
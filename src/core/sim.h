@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "core/helper.h"
+
+/**
+ * @file sim.h
+ *
+ * Ruleset simulation: a chain is generated and loaded by the daemon, but
+ * never attached nor stored in the daemon's context. Packets (see
+ * @ref bf_pcap_pkt ) are then replayed through the program using
+ * @c BPF_PROG_TEST_RUN , which doesn't require the network interface the
+ * chain would be attached to.
+ */
+
+/// Default number of times each packet is run through the program.
+#define BF_SIM_DEFAULT_REPEAT 100
+
+/**
+ * Result of the simulation of a single packet.
+ */
+struct bf_sim_result
+{
+    /// Return value of the program. Only valid if @c error is 0.
+    uint32_t retval;
+    /// Average duration of a run of the program, in nanoseconds.
+    uint32_t duration;
+    /** Verdict matching the return value of the program, or
+     * @c _BF_VERDICT_MAX if the return value doesn't match a verdict, or if
+     * the program couldn't be run. */
+    int32_t verdict;
+    /** 0 if the program has been run, or a negative errno value if
+     * @c BPF_PROG_TEST_RUN failed for this packet (e.g. the packet is too
+     * large for the program's flavor). */
+    int32_t error;
+} bf_packed;
@@ -0,0 +1,173 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "core/subchain.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/dump.h"
+#include "core/helper.h"
+#include "core/list.h"
+#include "core/logger.h"
+#include "core/marsh.h"
+#include "core/rule.h"
+
+int bf_subchain_new(struct bf_subchain **subchain, const char *name,
+                    bf_list *rules)
+{
+    _cleanup_bf_subchain_ struct bf_subchain *_subchain = NULL;
+    int r;
+
+    bf_assert(subchain && name);
+
+    _subchain = calloc(1, sizeof(*_subchain));
+    if (!_subchain)
+        return -ENOMEM;
+
+    _subchain->rules = bf_rule_list();
+
+    _subchain->name = strdup(name);
+    if (!_subchain->name)
+        return -ENOMEM;
+
+    if (rules) {
+        bf_list_foreach (rules, rule_node) {
+            r = bf_subchain_add_rule(_subchain,
+                                     bf_list_node_get_data(rule_node));
+            if (r)
+                return r;
+
+            bf_list_node_take_data(rule_node);
+        }
+    }
+
+    *subchain = TAKE_PTR(_subchain);
+
+    return 0;
+}
+
+int bf_subchain_new_from_marsh(struct bf_subchain **subchain,
+                               const struct bf_marsh *marsh)
+{
+    _cleanup_bf_subchain_ struct bf_subchain *_subchain = NULL;
+    struct bf_marsh *child = NULL;
+    struct bf_marsh *rule_elem = NULL;
+    int r;
+
+    bf_assert(subchain && marsh);
+
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return -EINVAL;
+    if (!child->data_len || child->data[child->data_len - 1] != '\0')
+        return bf_err_r(-EINVAL, "invalid serialized sub-chain name");
+
+    r = bf_subchain_new(&_subchain, child->data, NULL);
+    if (r)
+        return r;
+
+    if (!(child = bf_marsh_next_child(marsh, child)))
+        return -EINVAL;
+    while ((rule_elem = bf_marsh_next_child(child, rule_elem))) {
+        _cleanup_bf_rule_ struct bf_rule *rule = NULL;
+
+        r = bf_rule_unmarsh(rule_elem, &rule);
+        if (r)
+            return r;
+
+        r = bf_list_add_tail(&_subchain->rules, rule);
+        if (r)
+            return r;
+
+        TAKE_PTR(rule);
+    }
+
+    if (bf_marsh_next_child(marsh, child))
+        bf_warn("serialized sub-chain has more children than expected");
+
+    *subchain = TAKE_PTR(_subchain);
+
+    return 0;
+}
+
+void bf_subchain_free(struct bf_subchain **subchain)
+{
+    bf_assert(subchain);
+
+    if (!*subchain)
+        return;
+
+    bf_list_clean(&(*subchain)->rules);
+    free((*subchain)->name);
+    freep((void *)subchain);
+}
+
+int bf_subchain_marsh(const struct bf_subchain *subchain,
+                      struct bf_marsh **marsh)
+{
+    _cleanup_bf_marsh_ struct bf_marsh *_marsh = NULL;
+    int r;
+
+    bf_assert(subchain && marsh);
+
+    r = bf_marsh_new(&_marsh, NULL, 0);
+    if (r)
+        return r;
+
+    // Include the nul termination character to simplify deserialization.
+    r = bf_marsh_add_child_raw(&_marsh, subchain->name,
+                               strlen(subchain->name) + 1);
+    if (r)
+        return r;
+
+    {
+        _cleanup_bf_marsh_ struct bf_marsh *child = NULL;
+
+        r = bf_list_marsh(&subchain->rules, &child);
+        if (r)
+            return r;
+
+        r = bf_marsh_add_child_obj(&_marsh, child);
+        if (r)
+            return r;
+    }
+
+    *marsh = TAKE_PTR(_marsh);
+
+    return 0;
+}
+
+void bf_subchain_dump(const struct bf_subchain *subchain, prefix_t *prefix)
+{
+    bf_assert(subchain && prefix);
+
+    DUMP(prefix, "struct bf_subchain at %p", subchain);
+
+    bf_dump_prefix_push(prefix);
+    DUMP(prefix, "name: %s", subchain->name);
+    DUMP(bf_dump_prefix_last(prefix), "rules: bf_list<bf_rule>[%lu]",
+         bf_list_size(&subchain->rules));
+    bf_dump_prefix_push(prefix);
+    bf_list_foreach (&subchain->rules, rule_node) {
+        struct bf_rule *rule = bf_list_node_get_data(rule_node);
+
+        if (bf_list_is_tail(&subchain->rules, rule_node))
+            bf_dump_prefix_last(prefix);
+
+        bf_rule_dump(rule, prefix);
+    }
+    bf_dump_prefix_pop(prefix);
+    bf_dump_prefix_pop(prefix);
+}
+
+int bf_subchain_add_rule(struct bf_subchain *subchain, struct bf_rule *rule)
+{
+    bf_assert(subchain && rule);
+
+    rule->index = bf_list_size(&subchain->rules);
+
+    return bf_list_add_tail(&subchain->rules, rule);
+}
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "core/dump.h"
+#include "core/list.h"
+
+/**
+ * @file subchain.h
+ *
+ * A sub-chain is a user-defined list of rules, not attached to any hook. A
+ * sub-chain belongs to a @ref bf_chain , and is only evaluated when a rule of
+ * the chain (or of another sub-chain of the same chain) matches and has a
+ * @c BF_VERDICT_JUMP or @c BF_VERDICT_GOTO verdict.
+ *
+ * Sub-chains have no policy: if none of their rules apply a terminal verdict,
+ * the packet is returned to the calling chain.
+ */
+
+struct bf_marsh;
+struct bf_rule;
+
+#define _cleanup_bf_subchain_ __attribute__((__cleanup__(bf_subchain_free)))
+
+/**
+ * Convenience macro to initialize a list of @ref bf_subchain .
+ *
+ * @return An initialized @ref bf_list that can contain @ref bf_subchain
+ *         objects.
+ */
+#define bf_subchain_list()                                                     \
+    ((bf_list) {.ops = {.free = (bf_list_ops_free)bf_subchain_free,            \
+                        .marsh = (bf_list_ops_marsh)bf_subchain_marsh}})
+
+struct bf_subchain
+{
+    /// Name of the sub-chain, unique within its chain.
+    char *name;
+    bf_list rules;
+};
+
+/**
+ * Allocate and initialize a new sub-chain.
+ *
+ * @param subchain On success, points to the new sub-chain. Can't be NULL.
+ * @param name Name of the sub-chain. Can't be NULL.
+ * @param rules List of rules of the sub-chain. The content of the list is
+ *        stolen by the sub-chain. Can be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_subchain_new(struct bf_subchain **subchain, const char *name,
+                    bf_list *rules);
+
+/**
+ * Allocate a new sub-chain and initialize it from serialized data.
+ *
+ * @param subchain On success, points to the new sub-chain. Can't be NULL.
+ * @param marsh Serialized sub-chain. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_subchain_new_from_marsh(struct bf_subchain **subchain,
+                               const struct bf_marsh *marsh);
+
+/**
+ * Deinitialize and deallocate a sub-chain.
+ *
+ * @param subchain Sub-chain to free. Can't be NULL. If @p *subchain is NULL,
+ *        nothing is done.
+ */
+void bf_subchain_free(struct bf_subchain **subchain);
+
+/**
+ * Serialize a sub-chain.
+ *
+ * @param subchain Sub-chain to serialize. Can't be NULL.
+ * @param marsh On success, contains the serialized sub-chain. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_subchain_marsh(const struct bf_subchain *subchain,
+                      struct bf_marsh **marsh);
+
+void bf_subchain_dump(const struct bf_subchain *subchain, prefix_t *prefix);
+
+/**
+ * Add a rule at the end of a sub-chain.
+ *
+ * The sub-chain owns the rule on success. The rule's index is updated to
+ * its position in the sub-chain.
+ *
+ * @param subchain Sub-chain to add the rule to. Can't be NULL.
+ * @param rule Rule to add. Can't be NULL.
+ * @return 0 on success, or a negative errno value on failure.
+ */
+int bf_subchain_add_rule(struct bf_subchain *subchain, struct bf_rule *rule);
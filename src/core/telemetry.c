@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "core/telemetry.h"
+
+#include "core/helper.h"
+
+static const char *_bf_telemetry_strs[] = {
+    [BF_TELEMETRY_ERR_DYNPTR] = "err_dynptr",
+    [BF_TELEMETRY_ERR_L2_SLICE] = "err_l2_slice",
+    [BF_TELEMETRY_ERR_L3_SLICE] = "err_l3_slice",
+    [BF_TELEMETRY_ERR_L4_SLICE] = "err_l4_slice",
+    [BF_TELEMETRY_L3_UNSUPPORTED] = "l3_unsupported",
+    [BF_TELEMETRY_L3_IPV4] = "l3_ipv4",
+    [BF_TELEMETRY_L3_IPV6] = "l3_ipv6",
+    [BF_TELEMETRY_L4_UNSUPPORTED] = "l4_unsupported",
+    [BF_TELEMETRY_L4_TCP] = "l4_tcp",
+    [BF_TELEMETRY_L4_UDP] = "l4_udp",
+    [BF_TELEMETRY_L4_ICMP] = "l4_icmp",
+    [BF_TELEMETRY_L4_ICMPV6] = "l4_icmpv6",
+};
+
+static_assert(ARRAY_SIZE(_bf_telemetry_strs) == _BF_TELEMETRY_MAX,
+              "missing entries in the telemetry array");
+
+const char *bf_telemetry_to_str(enum bf_telemetry telemetry)
+{
+    bf_assert(0 <= telemetry && telemetry < _BF_TELEMETRY_MAX);
+
+    return _bf_telemetry_strs[telemetry];
+}
@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @file telemetry.h
+ *
+ * Datapath telemetry counters. When the daemon is started with
+ * @c --telemetry , each program gets a per-CPU telemetry map, updated by the
+ * program's prologue (see @c cgen/stub.c ) for every packet: one counter for
+ * each reason to skip the rules (a failure to access the packet's data, or
+ * an unsupported protocol), and one counter for each supported L3 and L4
+ * protocol.
+ *
+ * Errors counters are updated in addition to the error counter of the
+ * program, which is kept for backward compatibility.
+ */
+
+/**
+ * Telemetry counters, used as index in the telemetry map.
+ */
+enum bf_telemetry
+{
+    /// Failed to create the packet's dynamic pointer.
+    BF_TELEMETRY_ERR_DYNPTR,
+    /// Failed to access the L2 header.
+    BF_TELEMETRY_ERR_L2_SLICE,
+    /// Failed to access the L3 header.
+    BF_TELEMETRY_ERR_L3_SLICE,
+    /// Failed to access the L4 header.
+    BF_TELEMETRY_ERR_L4_SLICE,
+    /// L3 protocol not supported, L3 and L4 rules are skipped.
+    BF_TELEMETRY_L3_UNSUPPORTED,
+    BF_TELEMETRY_L3_IPV4,
+    BF_TELEMETRY_L3_IPV6,
+    /// L4 protocol not supported, L4 rules are skipped.
+    BF_TELEMETRY_L4_UNSUPPORTED,
+    BF_TELEMETRY_L4_TCP,
+    BF_TELEMETRY_L4_UDP,
+    BF_TELEMETRY_L4_ICMP,
+    BF_TELEMETRY_L4_ICMPV6,
+    _BF_TELEMETRY_MAX,
+};
+
+/**
+ * Convert a telemetry counter into a string.
+ *
+ * @param telemetry Telemetry counter to convert. Must be valid.
+ * @return String representation of the telemetry counter.
+ */
+const char *bf_telemetry_to_str(enum bf_telemetry telemetry);
+
+/**
+ * Number of buckets in a profiling histogram.
+ *
+ * When the daemon is started with @c --profile , the programs record the
+ * time spent in their prologue and in each block of rules for the sampled
+ * packets. Each block has a histogram of @ref BF_PROFILE_N_BUCKETS buckets:
+ * bucket @c i counts the samples which took between @c 2^i and @c 2^(i+1)
+ * nanoseconds, the first bucket also counts the samples which took less than
+ * 1 nanosecond, and the last bucket counts all the samples above
+ * @c 2^(BF_PROFILE_N_BUCKETS-1) nanoseconds.
+ */
+#define BF_PROFILE_N_BUCKETS 32
+
+/**
+ * Runtime statistics of a BPF program, as reported by the kernel.
+ *
+ * @c run_cnt and @c run_time_ns are only updated while the
+ * @c kernel.bpf_stats_enabled sysctl is set.
+ */
+struct bf_prog_stats
+{
+    /// ID of the BPF program.
+    uint32_t id;
+    /// Number of instructions of the program, as rewritten by the verifier.
+    uint32_t n_insns;
+    /// Size of the JITed program, in bytes. 0 if the program is not JITed.
+    uint32_t jited_size;
+    /// Number of instructions processed by the verifier.
+    uint32_t verified_insns;
+    /// Number of times the program ran.
+    uint64_t run_cnt;
+    /// Total time spent running the program, in nanoseconds.
+    uint64_t run_time_ns;
+    /// Estimated memory used by the program's maps, in bytes.
+    uint64_t maps_size;
+};
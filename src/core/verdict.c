@@ -14,6 +14,9 @@ static const char *_bf_verdict_strs[] = {
     [BF_VERDICT_ACCEPT] = "ACCEPT",
     [BF_VERDICT_DROP] = "DROP",
     [BF_VERDICT_CONTINUE] = "CONTINUE",
+    [BF_VERDICT_JUMP] = "JUMP",
+    [BF_VERDICT_GOTO] = "GOTO",
+    [BF_VERDICT_RETURN] = "RETURN",
 };
 
 static_assert(ARRAY_SIZE(_bf_verdict_strs) == _BF_VERDICT_MAX,
@@ -19,6 +19,17 @@ enum bf_verdict
     /** Non-terminal verdicts that allow further packet processing. */
     /** Continue processing the next rule. */
     BF_VERDICT_CONTINUE,
+    /** Evaluate the rules of a sub-chain, then continue processing the next
+     * rule if the sub-chain didn't apply a terminal verdict. */
+    BF_VERDICT_JUMP,
+    /** Evaluate the rules of a sub-chain, but do not return to the current
+     * chain: if the sub-chain doesn't apply a terminal verdict, processing
+     * continues from the chain that called the current chain. */
+    BF_VERDICT_GOTO,
+    /** Stop processing the current sub-chain, and continue with the rule
+     * following the @c BF_VERDICT_JUMP in the calling chain. Only valid in
+     * sub-chains. */
+    BF_VERDICT_RETURN,
     _BF_VERDICT_MAX,
     _BF_TERMINAL_VERDICT_MAX = BF_VERDICT_CONTINUE,
 };
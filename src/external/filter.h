@@ -300,6 +300,15 @@ static inline bool insn_is_zext(const struct bpf_insn *insn)
                         .off = OFF,                                            \
                         .imm = 0})
 
+/* Unconditional jumps, gotol pc + imm32 */
+
+#define BPF_JMP32_A(IMM)                                                       \
+    ((struct bpf_insn) {.code = BPF_JMP32 | BPF_JA,                            \
+                        .dst_reg = 0,                                          \
+                        .src_reg = 0,                                          \
+                        .off = 0,                                              \
+                        .imm = IMM})
+
 /* Relative call */
 
 #define BPF_CALL_REL(TGT)                                                      \
@@ -5,9 +5,20 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 struct bf_chain;
+struct bf_check_report;
+struct bf_counter;
+struct bf_prog_stats;
+struct bf_set;
+struct bf_sim_result;
 struct ipt_getinfo;
 struct ipt_get_entries;
 struct ipt_replace;
@@ -31,11 +42,236 @@ int bf_cli_ruleset_flush(void);
 /**
  * Send a chain to the daemon.
  *
+ * If the daemon already has an identical chain for the same hook, the chain
+ * is not reloaded.
+ *
  * @param chain Chain to send to the daemon. Can't be NULL.
  * @return 0 on success, or a negative errno value on error.
  */
 int bf_cli_set_chain(const struct bf_chain *chain);
 
+/**
+ * Send a chain to the daemon, and report whether it has been reloaded.
+ *
+ * See @ref bf_cli_set_chain .
+ *
+ * @param chain Chain to send to the daemon. Can't be NULL.
+ * @param changed If not NULL, on success, set to false if an identical chain
+ *        was already loaded by the daemon, or true otherwise.
+ * @param timings If not NULL, the daemon is requested to send back the time
+ *        spent in each control-plane phase (translation, program generation,
+ *        set maps, program load, attach, pin, and save). On success, the
+ *        @c _BF_PHASE_MAX entries of @p timings are filled with the duration
+ *        of each phase, in nanoseconds, indexed by @c bf_phase .
+ * @return 0 on success, or a negative errno value on error.
+ */
+int bf_cli_set_chain_changed(const struct bf_chain *chain, bool *changed,
+                             uint64_t *timings);
+
+/**
+ * Insert a rule into an existing chain.
+ *
+ * Only the rule is sent to the daemon, which updates the chain in place
+ * instead of replacing it. Rules are identified by a handle, assigned
+ * sequentially (starting from 1) to the rules of a chain when it is created,
+ * and to new rules when they are inserted.
+ *
+ * The inserted rule can't use sets: the daemon rejects a chain containing sets
+ * with -ENOTSUP. Use @ref bf_cli_set_chain to update rules matching on sets.
+ *
+ * @param chain Chain to insert the rule into: its hook and hook options
+ *        identify the chain to update on the daemon side. It must contain
+ *        the rule to insert, and only this rule. Can't be NULL.
+ * @param handle Handle of the rule to insert the new rule next to. If 0, the
+ *        new rule is inserted at the end of the chain (or the beginning of the
+ *        chain if @p after is true).
+ * @param after If true, insert the new rule after the rule @p handle ,
+ *        otherwise insert it before.
+ * @param new_handle On success, contains the handle of the new rule. Can be
+ *        NULL.
+ * @param timings If not NULL, on success, filled with the time spent by the
+ *        daemon in each control-plane phase, see
+ *        @ref bf_cli_set_chain_changed .
+ * @return 0 on success, or a negative errno value on error.
+ */
+int bf_cli_insert_rule(const struct bf_chain *chain, uint32_t handle,
+                       bool after, uint32_t *new_handle, uint64_t *timings);
+
+/**
+ * Delete a rule from an existing chain.
+ *
+ * See @ref bf_cli_insert_rule for details about rule handles.
+ *
+ * @param chain Chain to delete the rule from: its hook and hook options
+ *        identify the chain to update on the daemon side. Can't be NULL.
+ * @param handle Handle of the rule to delete.
+ * @param timings If not NULL, on success, filled with the time spent by the
+ *        daemon in each control-plane phase, see
+ *        @ref bf_cli_set_chain_changed .
+ * @return 0 on success, or a negative errno value on error.
+ */
+int bf_cli_delete_rule(const struct bf_chain *chain, uint32_t handle,
+                       uint64_t *timings);
+
+/**
+ * Replace a rule of an existing chain.
+ *
+ * The new rule keeps the handle of the rule it replaces. As for
+ * @ref bf_cli_insert_rule , the new rule can't use sets. See
+ * @ref bf_cli_insert_rule for details about rule handles.
+ *
+ * @param chain Chain to update: its hook and hook options identify the chain
+ *        to update on the daemon side. It must contain the new rule, and only
+ *        this rule. Can't be NULL.
+ * @param handle Handle of the rule to replace.
+ * @param timings If not NULL, on success, filled with the time spent by the
+ *        daemon in each control-plane phase, see
+ *        @ref bf_cli_set_chain_changed .
+ * @return 0 on success, or a negative errno value on error.
+ */
+int bf_cli_replace_rule(const struct bf_chain *chain, uint32_t handle,
+                        uint64_t *timings);
+
+/**
+ * Get the elements of a set with the highest per-element counters.
+ *
+ * The set must have been defined with per-element counters.
+ *
+ * @param chain Chain containing the set: its hook and hook options identify
+ *        the chain on the daemon side. Can't be NULL.
+ * @param set_index Index of the set in the chain.
+ * @param limit Maximum number of elements to get. If 0, all the elements of
+ *        the set are returned.
+ * @param by_bytes If true, sort the elements by number of bytes, otherwise
+ *        sort them by number of packets.
+ * @param set On success, points to a new set containing the elements, sorted
+ *        by decreasing counter value. Owned by the caller. Can't be NULL.
+ * @param counters On success, points to an array containing the counters of
+ *        each element of @p set , in the same order. Owned by the caller.
+ *        Can't be NULL.
+ * @return 0 on success, or a negative errno value on error.
+ */
+int bf_cli_get_set_counters(const struct bf_chain *chain, uint32_t set_index,
+                            uint32_t limit, bool by_bytes, struct bf_set **set,
+                            struct bf_counter **counters);
+
+/**
+ * Get the counters of a chain, and the datapath telemetry counters.
+ *
+ * @p counters contains one counter per rule of the chain (in the order the
+ * rules are defined), followed by the policy counter, and the errors counter.
+ * @p telemetry is indexed by @c bf_telemetry , and is empty if the daemon
+ * doesn't run with @c --telemetry .
+ *
+ * @param chain Chain to get the counters for: its hook and hook options
+ *        identify the chain on the daemon side. Can't be NULL.
+ * @param counters On success, points to an array of counters. Owned by the
+ *        caller. Can't be NULL.
+ * @param n_counters On success, contains the number of counters in
+ *        @p counters . Can't be NULL.
+ * @param telemetry On success, points to an array of telemetry counters.
+ *        Owned by the caller. Can't be NULL.
+ * @param n_telemetry On success, contains the number of counters in
+ *        @p telemetry . Can't be NULL.
+ * @return 0 on success, or a negative errno value on error.
+ */
+int bf_cli_get_counters(const struct bf_chain *chain,
+                        struct bf_counter **counters, size_t *n_counters,
+                        struct bf_counter **telemetry, size_t *n_telemetry);
+
+/**
+ * Get the profiling histograms of a chain.
+ *
+ * The daemon must be started with @c --profile . @p hist contains
+ * @p n_blocks histograms of @c BF_PROFILE_N_BUCKETS buckets each: the first
+ * one is the program's prologue, followed by one histogram per block of
+ * @p block_size rules of the chain. Bucket @c i counts the sampled packets
+ * which spent between @c 2^i and @c 2^(i+1) nanoseconds in the block.
+ *
+ * @param chain Chain to get the profiling histograms for: its hook and hook
+ *        options identify the chain on the daemon side. Can't be NULL.
+ * @param block_size On success, contains the number of rules per profiling
+ *        block. Can't be NULL.
+ * @param hist On success, points to the histograms. Owned by the caller.
+ *        Can't be NULL.
+ * @param n_blocks On success, contains the number of histograms in @p hist .
+ *        Can't be NULL.
+ * @return 0 on success, or a negative errno value on error. Returns
+ *         @c -ENOENT if the daemon doesn't run with @c --profile .
+ */
+int bf_cli_get_profile(const struct bf_chain *chain, uint32_t *block_size,
+                       uint64_t **hist, size_t *n_blocks);
+
+/**
+ * Get the kernel's runtime statistics of the programs defined by @c bfcli .
+ *
+ * The kernel only updates the run count and run time of the programs while
+ * the @c kernel.bpf_stats_enabled sysctl is set.
+ *
+ * @param chains On success, points to an array containing the chains defined
+ *        with @c bfcli . Only the hook and hook options of the chains are
+ *        relevant. The array and the chains are owned by the caller. Can't
+ *        be NULL.
+ * @param stats On success, points to an array containing the statistics of
+ *        the program of each chain in @p chains , in the same order. Owned by
+ *        the caller. Can't be NULL.
+ * @param n_chains On success, contains the number of chains in @p chains .
+ *        Can't be NULL.
+ * @return 0 on success, or a negative errno value on error.
+ */
+int bf_cli_get_prog_stats(struct bf_chain ***chains,
+                          struct bf_prog_stats **stats, size_t *n_chains);
+
+/**
+ * Simulate a chain: run packets through the chain's program, without
+ * attaching it.
+ *
+ * The daemon generates and loads a program for @p chain , and runs each
+ * packet through it @p repeat times using @c BPF_PROG_TEST_RUN . The program
+ * is never attached, and doesn't replace any existing chain. Counters are
+ * enabled for every rule of the chain.
+ *
+ * @param chain Chain to simulate. Can't be NULL.
+ * @param pkts Packets to run through the program, in the format defined by
+ *        @c bf_pcap_pkt . Can't be NULL.
+ * @param pkts_len Size of @p pkts , in bytes.
+ * @param repeat Number of times to run each packet through the program.
+ * @param results On success, points to an array containing the result of
+ *        each packet, in the same order as @p pkts . Owned by the caller.
+ *        Can't be NULL.
+ * @param n_results On success, contains the number of results. Can't be
+ *        NULL.
+ * @param counters On success, points to an array containing the number of
+ *        packets matched by each rule (in the order the rules are defined),
+ *        followed by the policy counter, and the errors counter. Owned by the
+ *        caller. Can't be NULL.
+ * @param n_counters On success, contains the number of counters in
+ *        @p counters . Can't be NULL.
+ * @return 0 on success, or a negative errno value on error.
+ */
+int bf_cli_simulate(const struct bf_chain *chain, const void *pkts,
+                    size_t pkts_len, uint32_t repeat,
+                    struct bf_sim_result **results, size_t *n_results,
+                    struct bf_counter **counters, size_t *n_counters);
+
+/**
+ * Check a chain: generate its program, and estimate its cost, without
+ * attaching it.
+ *
+ * The daemon translates @p chain and generates its program, which is never
+ * attached, and doesn't replace any existing chain. If @p verify is true, the
+ * program is also loaded, so it goes through the verifier, then unloaded. A
+ * program rejected by the verifier is not an error: the error is reported in
+ * @p report .
+ *
+ * @param chain Chain to check. Can't be NULL.
+ * @param verify If true, load the program to verify it.
+ * @param report On success, contains the check report. Can't be NULL.
+ * @return 0 on success, or a negative errno value on error.
+ */
+int bf_cli_check(const struct bf_chain *chain, bool verify,
+                 struct bf_check_report *report);
+
 /**
  * Send iptable's ipt_replace data to bpfilter daemon.
  *
@@ -103,3 +339,7 @@ int bf_nft_send(const void *data, size_t len);
  */
 int bf_nft_sendrecv(const struct nlmsghdr *req, size_t req_len,
                     struct nlmsghdr *res, size_t *res_len);
+
+#ifdef __cplusplus
+}
+#endif
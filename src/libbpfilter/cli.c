@@ -3,15 +3,24 @@
  * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
  */
 
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "core/chain.h"
+#include "core/check.h"
+#include "core/counter.h"
 #include "core/front.h"
 #include "core/logger.h"
 #include "core/marsh.h"
 #include "core/request.h"
 #include "core/response.h"
+#include "core/set.h"
+#include "core/sim.h"
+#include "core/telemetry.h"
 #include "libbpfilter/generic.h"
 
 int bf_cli_ruleset_flush(void)
@@ -34,7 +43,8 @@ int bf_cli_ruleset_flush(void)
     return response->type == BF_RES_FAILURE ? response->error : 0;
 }
 
-int bf_cli_set_chain(const struct bf_chain *chain)
+int bf_cli_set_chain_changed(const struct bf_chain *chain, bool *changed,
+                             uint64_t *timings)
 {
     _cleanup_bf_request_ struct bf_request *request = NULL;
     _cleanup_bf_response_ struct bf_response *response = NULL;
@@ -51,10 +61,531 @@ int bf_cli_set_chain(const struct bf_chain *chain)
 
     request->front = BF_FRONT_CLI;
     request->cmd = BF_REQ_RULES_SET;
+    if (timings)
+        request->flags |= BF_REQ_FLAG_TIMINGS;
 
     r = bf_send(request, &response);
     if (r)
         return bf_err_r(r, "failed to send chain to the daemon");
 
-    return response->type == BF_RES_FAILURE ? response->error : 0;
+    if (response->type == BF_RES_FAILURE)
+        return response->error;
+
+    if (timings) {
+        r = bf_response_take_timings(response, timings);
+        if (r)
+            return bf_err_r(r, "daemon didn't send the request timings");
+    }
+
+    if (changed) {
+        *changed = response->data_len == sizeof(bool) ?
+                       *(bool *)response->data :
+                       true;
+    }
+
+    return 0;
+}
+
+int bf_cli_set_chain(const struct bf_chain *chain)
+{
+    return bf_cli_set_chain_changed(chain, NULL, NULL);
+}
+
+/**
+ * Send a rule patch request for a chain to the daemon.
+ *
+ * @param chain Chain to patch, containing the rule to insert, if any. Can't
+ *        be NULL.
+ * @param op Patch operation.
+ * @param handle Handle of the rule to patch.
+ * @param new_handle On success, contains the handle returned by the daemon.
+ *        Can be NULL.
+ * @param timings On success, contains the time spent by the daemon in each
+ *        control-plane phase. Can be NULL.
+ * @return 0 on success, or a negative errno value on error.
+ */
+static int _bf_cli_patch_chain(const struct bf_chain *chain,
+                               enum bf_chain_patch_op op, uint32_t handle,
+                               uint32_t *new_handle, uint64_t *timings)
+{
+    _cleanup_bf_request_ struct bf_request *request = NULL;
+    _cleanup_bf_response_ struct bf_response *response = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *chain_marsh = NULL;
+    int r;
+
+    bf_assert(chain);
+
+    r = bf_marsh_new(&marsh, NULL, 0);
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, &op, sizeof(op));
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, &handle, sizeof(handle));
+    if (r)
+        return r;
+
+    r = bf_chain_marsh(chain, &chain_marsh);
+    if (r)
+        return bf_err_r(r, "failed to marsh chain");
+
+    r = bf_marsh_add_child_obj(&marsh, chain_marsh);
+    if (r)
+        return r;
+
+    r = bf_request_new(&request, marsh, bf_marsh_size(marsh));
+    if (r)
+        return bf_err_r(r, "failed to create request for chain patch");
+
+    request->front = BF_FRONT_CLI;
+    request->cmd = BF_REQ_RULES_PATCH;
+    if (timings)
+        request->flags |= BF_REQ_FLAG_TIMINGS;
+
+    r = bf_send(request, &response);
+    if (r)
+        return bf_err_r(r, "failed to send chain patch to the daemon");
+
+    if (response->type == BF_RES_FAILURE)
+        return response->error;
+
+    if (timings) {
+        r = bf_response_take_timings(response, timings);
+        if (r)
+            return bf_err_r(r, "daemon didn't send the request timings");
+    }
+
+    if (new_handle && response->data_len == sizeof(*new_handle))
+        memcpy(new_handle, response->data, sizeof(*new_handle));
+
+    return 0;
+}
+
+int bf_cli_insert_rule(const struct bf_chain *chain, uint32_t handle,
+                       bool after, uint32_t *new_handle, uint64_t *timings)
+{
+    return _bf_cli_patch_chain(chain,
+                               after ? BF_CHAIN_PATCH_INSERT_AFTER :
+                                       BF_CHAIN_PATCH_INSERT_BEFORE,
+                               handle, new_handle, timings);
+}
+
+int bf_cli_delete_rule(const struct bf_chain *chain, uint32_t handle,
+                       uint64_t *timings)
+{
+    return _bf_cli_patch_chain(chain, BF_CHAIN_PATCH_DELETE, handle, NULL,
+                               timings);
+}
+
+int bf_cli_replace_rule(const struct bf_chain *chain, uint32_t handle,
+                        uint64_t *timings)
+{
+    return _bf_cli_patch_chain(chain, BF_CHAIN_PATCH_REPLACE, handle, NULL,
+                               timings);
+}
+
+int bf_cli_get_set_counters(const struct bf_chain *chain, uint32_t set_index,
+                            uint32_t limit, bool by_bytes, struct bf_set **set,
+                            struct bf_counter **counters)
+{
+    _cleanup_bf_request_ struct bf_request *request = NULL;
+    _cleanup_bf_response_ struct bf_response *response = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *chain_marsh = NULL;
+    _cleanup_bf_set_ struct bf_set *_set = NULL;
+    _cleanup_free_ struct bf_counter *_counters = NULL;
+    struct bf_marsh *child = NULL;
+    int r;
+
+    bf_assert(chain && set && counters);
+
+    r = bf_marsh_new(&marsh, NULL, 0);
+    if (r)
+        return r;
+
+    r = bf_chain_marsh(chain, &chain_marsh);
+    if (r)
+        return bf_err_r(r, "failed to marsh chain");
+
+    r = bf_marsh_add_child_obj(&marsh, chain_marsh);
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, &set_index, sizeof(set_index));
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, &limit, sizeof(limit));
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, &by_bytes, sizeof(by_bytes));
+    if (r)
+        return r;
+
+    r = bf_request_new(&request, marsh, bf_marsh_size(marsh));
+    if (r)
+        return bf_err_r(r, "failed to create request for set counters");
+
+    request->front = BF_FRONT_CLI;
+    request->cmd = BF_REQ_SET_COUNTERS_GET;
+
+    r = bf_send(request, &response);
+    if (r)
+        return bf_err_r(r, "failed to send set counters request to the daemon");
+
+    if (response->type == BF_RES_FAILURE)
+        return response->error;
+
+    if (response->data_len < sizeof(struct bf_marsh))
+        return bf_err_r(-EINVAL, "invalid set counters response");
+
+    if (!(child = bf_marsh_next_child((void *)response->data, child)))
+        return -EINVAL;
+    r = bf_set_new_from_marsh(&_set, child);
+    if (r)
+        return bf_err_r(r, "failed to parse set from response");
+
+    if (!(child = bf_marsh_next_child((void *)response->data, child)))
+        return -EINVAL;
+    if (child->data_len != bf_list_size(&_set->elems) * sizeof(**counters))
+        return bf_err_r(-EINVAL, "set and counters size mismatch");
+
+    _counters = malloc(child->data_len ?: 1);
+    if (!_counters)
+        return -ENOMEM;
+    memcpy(_counters, child->data, child->data_len);
+
+    *set = TAKE_PTR(_set);
+    *counters = TAKE_PTR(_counters);
+
+    return 0;
+}
+
+int bf_cli_get_counters(const struct bf_chain *chain,
+                        struct bf_counter **counters, size_t *n_counters,
+                        struct bf_counter **telemetry, size_t *n_telemetry)
+{
+    _cleanup_bf_request_ struct bf_request *request = NULL;
+    _cleanup_bf_response_ struct bf_response *response = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+    _cleanup_free_ struct bf_counter *_counters = NULL;
+    _cleanup_free_ struct bf_counter *_telemetry = NULL;
+    struct bf_marsh *child = NULL;
+    int r;
+
+    bf_assert(chain && counters && n_counters && telemetry && n_telemetry);
+
+    r = bf_chain_marsh(chain, &marsh);
+    if (r)
+        return bf_err_r(r, "failed to marsh chain");
+
+    r = bf_request_new(&request, marsh, bf_marsh_size(marsh));
+    if (r)
+        return bf_err_r(r, "failed to create request for counters");
+
+    request->front = BF_FRONT_CLI;
+    request->cmd = BF_REQ_COUNTERS_GET;
+
+    r = bf_send(request, &response);
+    if (r)
+        return bf_err_r(r, "failed to send counters request to the daemon");
+
+    if (response->type == BF_RES_FAILURE)
+        return response->error;
+
+    if (response->data_len < sizeof(struct bf_marsh))
+        return bf_err_r(-EINVAL, "invalid counters response");
+
+    if (!(child = bf_marsh_next_child((void *)response->data, child)))
+        return -EINVAL;
+    if (child->data_len % sizeof(**counters))
+        return bf_err_r(-EINVAL, "invalid counters size in response");
+
+    _counters = malloc(child->data_len ?: 1);
+    if (!_counters)
+        return -ENOMEM;
+    memcpy(_counters, child->data, child->data_len);
+    *n_counters = child->data_len / sizeof(**counters);
+
+    if (!(child = bf_marsh_next_child((void *)response->data, child)))
+        return -EINVAL;
+    if (child->data_len % sizeof(**telemetry))
+        return bf_err_r(-EINVAL, "invalid telemetry size in response");
+
+    _telemetry = malloc(child->data_len ?: 1);
+    if (!_telemetry)
+        return -ENOMEM;
+    memcpy(_telemetry, child->data, child->data_len);
+    *n_telemetry = child->data_len / sizeof(**telemetry);
+
+    *counters = TAKE_PTR(_counters);
+    *telemetry = TAKE_PTR(_telemetry);
+
+    return 0;
+}
+
+int bf_cli_get_profile(const struct bf_chain *chain, uint32_t *block_size,
+                       uint64_t **hist, size_t *n_blocks)
+{
+    _cleanup_bf_request_ struct bf_request *request = NULL;
+    _cleanup_bf_response_ struct bf_response *response = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+    _cleanup_free_ uint64_t *_hist = NULL;
+    struct bf_marsh *child = NULL;
+    size_t hist_size = BF_PROFILE_N_BUCKETS * sizeof(**hist);
+    int r;
+
+    bf_assert(chain && block_size && hist && n_blocks);
+
+    r = bf_chain_marsh(chain, &marsh);
+    if (r)
+        return bf_err_r(r, "failed to marsh chain");
+
+    r = bf_request_new(&request, marsh, bf_marsh_size(marsh));
+    if (r)
+        return bf_err_r(r, "failed to create request for profiling");
+
+    request->front = BF_FRONT_CLI;
+    request->cmd = BF_REQ_PROFILE_GET;
+
+    r = bf_send(request, &response);
+    if (r)
+        return bf_err_r(r, "failed to send profiling request to the daemon");
+
+    if (response->type == BF_RES_FAILURE)
+        return response->error;
+
+    if (response->data_len < sizeof(struct bf_marsh))
+        return bf_err_r(-EINVAL, "invalid profiling response");
+
+    if (!(child = bf_marsh_next_child((void *)response->data, child)))
+        return -EINVAL;
+    if (child->data_len != sizeof(*block_size))
+        return bf_err_r(-EINVAL, "invalid profiling block size in response");
+    memcpy(block_size, child->data, sizeof(*block_size));
+
+    if (!(child = bf_marsh_next_child((void *)response->data, child)))
+        return -EINVAL;
+    if (!child->data_len || child->data_len % hist_size)
+        return bf_err_r(-EINVAL, "invalid histograms size in response");
+
+    _hist = malloc(child->data_len);
+    if (!_hist)
+        return -ENOMEM;
+    memcpy(_hist, child->data, child->data_len);
+
+    *n_blocks = child->data_len / hist_size;
+    *hist = TAKE_PTR(_hist);
+
+    return 0;
+}
+
+int bf_cli_get_prog_stats(struct bf_chain ***chains,
+                          struct bf_prog_stats **stats, size_t *n_chains)
+{
+    _cleanup_bf_request_ struct bf_request *request = NULL;
+    _cleanup_bf_response_ struct bf_response *response = NULL;
+    _cleanup_free_ struct bf_chain **_chains = NULL;
+    _cleanup_free_ struct bf_prog_stats *_stats = NULL;
+    struct bf_marsh *child = NULL;
+    size_t n = 0;
+    size_t i = 0;
+    int r;
+
+    bf_assert(chains && stats && n_chains);
+
+    r = bf_request_new(&request, NULL, 0);
+    if (r)
+        return bf_err_r(r, "failed to create request for program statistics");
+
+    request->front = BF_FRONT_CLI;
+    request->cmd = BF_REQ_PROG_STATS_GET;
+
+    r = bf_send(request, &response);
+    if (r)
+        return bf_err_r(r, "failed to send statistics request to the daemon");
+
+    if (response->type == BF_RES_FAILURE)
+        return response->error;
+
+    if (response->data_len < sizeof(struct bf_marsh))
+        return bf_err_r(-EINVAL, "invalid statistics response");
+
+    while ((child = bf_marsh_next_child((void *)response->data, child)))
+        ++n;
+
+    _chains = calloc(n ?: 1, sizeof(*_chains));
+    _stats = calloc(n ?: 1, sizeof(*_stats));
+    if (!_chains || !_stats)
+        return -ENOMEM;
+
+    while ((child = bf_marsh_next_child((void *)response->data, child))) {
+        struct bf_marsh *elem = NULL;
+
+        if (!(elem = bf_marsh_next_child(child, elem))) {
+            r = -EINVAL;
+            goto err_free_chains;
+        }
+
+        r = bf_chain_new_from_marsh(&_chains[i], elem);
+        if (r)
+            goto err_free_chains;
+
+        if (!(elem = bf_marsh_next_child(child, elem)) ||
+            elem->data_len != sizeof(*_stats)) {
+            r = bf_err_r(-EINVAL, "invalid statistics size in response");
+            goto err_free_chains;
+        }
+        memcpy(&_stats[i], elem->data, sizeof(*_stats));
+
+        ++i;
+    }
+
+    *chains = TAKE_PTR(_chains);
+    *stats = TAKE_PTR(_stats);
+    *n_chains = n;
+
+    return 0;
+
+err_free_chains:
+    for (size_t j = 0; j < n; ++j)
+        bf_chain_free(&_chains[j]);
+
+    return r;
+}
+
+int bf_cli_simulate(const struct bf_chain *chain, const void *pkts,
+                    size_t pkts_len, uint32_t repeat,
+                    struct bf_sim_result **results, size_t *n_results,
+                    struct bf_counter **counters, size_t *n_counters)
+{
+    _cleanup_bf_request_ struct bf_request *request = NULL;
+    _cleanup_bf_response_ struct bf_response *response = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *chain_marsh = NULL;
+    _cleanup_free_ struct bf_sim_result *_results = NULL;
+    _cleanup_free_ struct bf_counter *_counters = NULL;
+    struct bf_marsh *child = NULL;
+    int r;
+
+    bf_assert(chain && pkts && results && n_results && counters &&
+              n_counters);
+
+    r = bf_marsh_new(&marsh, NULL, 0);
+    if (r)
+        return r;
+
+    r = bf_chain_marsh(chain, &chain_marsh);
+    if (r)
+        return bf_err_r(r, "failed to marsh chain");
+
+    r = bf_marsh_add_child_obj(&marsh, chain_marsh);
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, &repeat, sizeof(repeat));
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, pkts, pkts_len);
+    if (r)
+        return r;
+
+    r = bf_request_new(&request, marsh, bf_marsh_size(marsh));
+    if (r)
+        return bf_err_r(r, "failed to create request for simulation");
+
+    request->front = BF_FRONT_CLI;
+    request->cmd = BF_REQ_RULESET_SIMULATE;
+
+    r = bf_send(request, &response);
+    if (r)
+        return bf_err_r(r, "failed to send simulation request to the daemon");
+
+    if (response->type == BF_RES_FAILURE)
+        return response->error;
+
+    if (response->data_len < sizeof(struct bf_marsh))
+        return bf_err_r(-EINVAL, "invalid simulation response");
+
+    if (!(child = bf_marsh_next_child((void *)response->data, child)))
+        return -EINVAL;
+    if (child->data_len % sizeof(**results))
+        return bf_err_r(-EINVAL, "invalid results size in response");
+
+    _results = malloc(child->data_len ?: 1);
+    if (!_results)
+        return -ENOMEM;
+    memcpy(_results, child->data, child->data_len);
+    *n_results = child->data_len / sizeof(**results);
+
+    if (!(child = bf_marsh_next_child((void *)response->data, child)))
+        return -EINVAL;
+    if (child->data_len % sizeof(**counters))
+        return bf_err_r(-EINVAL, "invalid counters size in response");
+
+    _counters = malloc(child->data_len ?: 1);
+    if (!_counters)
+        return -ENOMEM;
+    memcpy(_counters, child->data, child->data_len);
+    *n_counters = child->data_len / sizeof(**counters);
+
+    *results = TAKE_PTR(_results);
+    *counters = TAKE_PTR(_counters);
+
+    return 0;
+}
+
+int bf_cli_check(const struct bf_chain *chain, bool verify,
+                 struct bf_check_report *report)
+{
+    _cleanup_bf_request_ struct bf_request *request = NULL;
+    _cleanup_bf_response_ struct bf_response *response = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *chain_marsh = NULL;
+    uint8_t _verify = verify;
+    int r;
+
+    bf_assert(chain && report);
+
+    r = bf_marsh_new(&marsh, NULL, 0);
+    if (r)
+        return r;
+
+    r = bf_chain_marsh(chain, &chain_marsh);
+    if (r)
+        return bf_err_r(r, "failed to marsh chain");
+
+    r = bf_marsh_add_child_obj(&marsh, chain_marsh);
+    if (r)
+        return r;
+
+    r = bf_marsh_add_child_raw(&marsh, &_verify, sizeof(_verify));
+    if (r)
+        return r;
+
+    r = bf_request_new(&request, marsh, bf_marsh_size(marsh));
+    if (r)
+        return bf_err_r(r, "failed to create request for check");
+
+    request->front = BF_FRONT_CLI;
+    request->cmd = BF_REQ_RULESET_CHECK;
+
+    r = bf_send(request, &response);
+    if (r)
+        return bf_err_r(r, "failed to send check request to the daemon");
+
+    if (response->type == BF_RES_FAILURE)
+        return response->error;
+
+    if (response->data_len != sizeof(*report))
+        return bf_err_r(-EINVAL, "invalid check response");
+
+    memcpy(report, response->data, sizeof(*report));
+
+    return 0;
 }
@@ -9,6 +9,7 @@
 
 #include "opts.h"
 #include "core/bpf.h"
+#include "core/hook.h"
 #include "core/logger.h"
 #include "harness/daemon.h"
 #include "harness/test.h"
@@ -70,6 +71,10 @@ int bft_e2e_test(struct bf_chain *chain, enum bf_verdict expect,
         const struct bft_prog_run_args *arg = &args[hook];
         int r, test_ret;
 
+        // BPF_PROG_RUN doesn't support socket address programs
+        if (bf_hook_is_sock_addr(hook))
+            continue;
+
         r = bf_test_daemon_init(&daemon, bft_e2e_bpfilter_path(),
                                 BF_TEST_DAEMON_TRANSIENT |
                                 BF_TEST_DAEMON_NO_IPTABLES |
@@ -110,6 +115,8 @@ int bft_e2e_test(struct bf_chain *chain, enum bf_verdict expect,
 
     if (!success) {
         for (enum bf_hook hook = BF_HOOK_XDP; hook < _BF_HOOK_MAX; ++hook) {
+            if (bf_hook_is_sock_addr(hook))
+                continue;
             if (_bf_progtype_verdict[chain->hook][expect] == retval[hook])
                 continue;
 
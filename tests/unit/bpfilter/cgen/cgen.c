@@ -91,3 +91,109 @@ Test(cgen, invalid_chain_policy)
 {
     expect_assert_failure(bf_test_chain(BF_HOOK_XDP, BF_VERDICT_CONTINUE));
 }
+
+Test(cgen, chain_hash)
+{
+    _cleanup_bf_cgen_ struct bf_cgen *cgen = NULL;
+    _cleanup_bf_chain_ struct bf_chain *chain = bf_test_chain_quick();
+    _cleanup_bf_chain_ struct bf_chain *same = bf_test_chain_quick();
+    _cleanup_bf_chain_ struct bf_chain *other =
+        bf_test_chain(BF_HOOK_XDP, BF_VERDICT_DROP);
+
+    expect_assert_failure(bf_cgen_is_chain_current(NULL, NOT_NULL));
+    expect_assert_failure(bf_cgen_is_chain_current(NOT_NULL, NULL));
+
+    assert_success(bf_cgen_new(&cgen, BF_FRONT_CLI, &chain));
+    assert_true(bf_cgen_is_chain_current(cgen, same));
+    assert_false(bf_cgen_is_chain_current(cgen, other));
+}
+
+static void _check_patched_handles(bf_list *patched, const uint32_t *handles,
+                                   size_t n_handles)
+{
+    size_t i = 0;
+
+    assert_int_equal(bf_list_size(patched), n_handles);
+    bf_list_foreach (patched, rule_node) {
+        struct bf_rule *rule = bf_list_node_get_data(rule_node);
+        assert_int_equal(rule->handle, handles[i++]);
+    }
+
+    _bf_cgen_release_rules(patched);
+}
+
+Test(cgen, patch_rules)
+{
+    _cleanup_bf_chain_ struct bf_chain *chain = bf_test_chain_quick();
+    _cleanup_bf_rule_ struct bf_rule *rule = NULL;
+    struct bf_rule *removed;
+    bf_list patched;
+
+    for (int i = 0; i < 3; ++i) {
+        struct bf_rule *tmp;
+
+        assert_success(bf_rule_new(&tmp));
+        assert_success(bf_chain_add_rule(chain, tmp));
+    }
+
+    assert_success(bf_rule_new(&rule));
+    rule->handle = 10;
+
+    {
+        const uint32_t handles[] = {1, 10, 2, 3};
+
+        patched = bf_rule_list();
+        assert_success(_bf_cgen_patch_rules(
+            chain, BF_CHAIN_PATCH_INSERT_BEFORE, 2, rule, &patched, &removed));
+        assert_null(removed);
+        _check_patched_handles(&patched, handles, ARRAY_SIZE(handles));
+    }
+
+    {
+        const uint32_t handles[] = {1, 2, 3, 10};
+
+        patched = bf_rule_list();
+        assert_success(_bf_cgen_patch_rules(
+            chain, BF_CHAIN_PATCH_INSERT_BEFORE, 0, rule, &patched, &removed));
+        _check_patched_handles(&patched, handles, ARRAY_SIZE(handles));
+    }
+
+    {
+        const uint32_t handles[] = {10, 1, 2, 3};
+
+        patched = bf_rule_list();
+        assert_success(_bf_cgen_patch_rules(
+            chain, BF_CHAIN_PATCH_INSERT_AFTER, 0, rule, &patched, &removed));
+        _check_patched_handles(&patched, handles, ARRAY_SIZE(handles));
+    }
+
+    {
+        const uint32_t handles[] = {1, 3};
+
+        patched = bf_rule_list();
+        assert_success(_bf_cgen_patch_rules(chain, BF_CHAIN_PATCH_DELETE, 2,
+                                            NULL, &patched, &removed));
+        assert_int_equal(removed->handle, 2);
+        _check_patched_handles(&patched, handles, ARRAY_SIZE(handles));
+    }
+
+    {
+        const uint32_t handles[] = {1, 2, 10};
+
+        patched = bf_rule_list();
+        assert_success(_bf_cgen_patch_rules(chain, BF_CHAIN_PATCH_REPLACE, 3,
+                                            rule, &patched, &removed));
+        assert_int_equal(removed->handle, 3);
+        _check_patched_handles(&patched, handles, ARRAY_SIZE(handles));
+    }
+
+    patched = bf_rule_list();
+    assert_int_equal(-ENOENT,
+                     _bf_cgen_patch_rules(chain, BF_CHAIN_PATCH_DELETE, 42,
+                                          NULL, &patched, &removed));
+    _bf_cgen_release_rules(&patched);
+
+    // The chain itself is never modified
+    assert_int_equal(bf_list_size(&chain->rules), 3);
+    assert_int_equal(chain->next_handle, 4);
+}
@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "bpfilter/cgen/interp.c"
+
+#include "fake.h"
+#include "harness/test.h"
+#include "harness/mock.h"
+
+Test(interp, rule_encode)
+{
+    _cleanup_bf_rule_ struct bf_rule *rule = NULL;
+    struct bf_matcher_ip4_addr addr = {
+        .addr = htobe32(0x0a000001),
+        .mask = htobe32(0xffffff00),
+    };
+    uint16_t port = 22;
+    struct bf_interp_rule record;
+
+    expect_assert_failure(bf_interp_rule_encode(NULL, NOT_NULL, 0));
+    expect_assert_failure(bf_interp_rule_encode(NOT_NULL, NULL, 0));
+
+    assert_success(bf_rule_new(&rule));
+    rule->verdict = BF_VERDICT_DROP;
+    rule->counters = true;
+    assert_success(bf_rule_add_matcher(rule, BF_MATCHER_IP4_SRC_ADDR,
+                                       BF_MATCHER_EQ, &addr, sizeof(addr)));
+    assert_success(bf_rule_add_matcher(rule, BF_MATCHER_TCP_DPORT,
+                                       BF_MATCHER_NE, &port, sizeof(port)));
+
+    assert_success(bf_interp_rule_encode(&record, rule, 7));
+    assert_int_equal(record.flags, BF_INTERP_RULE_COUNTERS);
+    assert_int_equal(record.n_conds, 2);
+    assert_int_equal(record.verdict, BF_VERDICT_DROP);
+    assert_int_equal(record.counter, 7);
+
+    // The value is masked, as the field will be
+    assert_int_equal(record.conds[0].field, BF_MATCHER_IP4_SRC_ADDR);
+    assert_int_equal(record.conds[0].op, BF_MATCHER_EQ);
+    assert_int_equal(record.conds[0].value[0], addr.addr & addr.mask);
+    assert_int_equal(record.conds[0].mask[0], addr.mask);
+    assert_int_equal(record.conds[0].mask[1], 0);
+
+    assert_int_equal(record.conds[1].field, BF_MATCHER_TCP_DPORT);
+    assert_int_equal(record.conds[1].op, BF_MATCHER_NE);
+    assert_int_equal(record.conds[1].value[0], htobe16(port));
+    assert_int_equal(record.conds[1].mask[0], UINT64_MAX);
+}
+
+Test(interp, rule_encode_unsupported)
+{
+    struct bf_interp_rule record;
+    uint16_t port = 22;
+
+    {
+        // Jumping to a sub-chain is not supported
+        _cleanup_bf_rule_ struct bf_rule *rule = NULL;
+
+        assert_success(bf_rule_new(&rule));
+        rule->verdict = BF_VERDICT_JUMP;
+        assert_error(bf_interp_rule_encode(&record, rule, 0));
+    }
+
+    {
+        // Only EQ and NE are supported
+        _cleanup_bf_rule_ struct bf_rule *rule = NULL;
+
+        assert_success(bf_rule_new(&rule));
+        rule->verdict = BF_VERDICT_ACCEPT;
+        assert_success(bf_rule_add_matcher(rule, BF_MATCHER_TCP_DPORT,
+                                           BF_MATCHER_RANGE, &port,
+                                           sizeof(port)));
+        assert_error(bf_interp_rule_encode(&record, rule, 0));
+    }
+
+    {
+        // Too many matchers
+        _cleanup_bf_rule_ struct bf_rule *rule = NULL;
+
+        assert_success(bf_rule_new(&rule));
+        rule->verdict = BF_VERDICT_ACCEPT;
+        for (int i = 0; i <= BF_INTERP_MAX_CONDS; ++i) {
+            assert_success(bf_rule_add_matcher(rule, BF_MATCHER_TCP_DPORT,
+                                               BF_MATCHER_EQ, &port,
+                                               sizeof(port)));
+        }
+        assert_error(bf_interp_rule_encode(&record, rule, 0));
+    }
+}
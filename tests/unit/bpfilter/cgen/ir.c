@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "bpfilter/cgen/ir.c"
+
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+
+#include <endian.h>
+
+#include "external/filter.h"
+#include "fake.h"
+#include "harness/test.h"
+#include "harness/mock.h"
+
+Test(ir, new_invalid)
+{
+    _cleanup_bf_ir_ struct bf_ir *ir = NULL;
+
+    {
+        // Jump out of the image
+        struct bpf_insn img[] = {
+            BPF_JMP_A(4),
+            BPF_EXIT_INSN(),
+        };
+
+        assert_error(bf_ir_new(&ir, img, ARRAY_SIZE(img)));
+    }
+
+    {
+        // Jump into the second half of a BPF_LD_IMM64
+        struct bpf_insn img[] = {
+            BPF_JMP_A(1),
+            BPF_LD_MAP_FD(BPF_REG_1, 0),
+            BPF_EXIT_INSN(),
+        };
+
+        assert_error(bf_ir_new(&ir, img, ARRAY_SIZE(img)));
+    }
+
+    expect_assert_failure(bf_ir_new(NULL, NOT_NULL, 0));
+    expect_assert_failure(bf_ir_new(NOT_NULL, NULL, 0));
+}
+
+Test(ir, path_cost)
+{
+    _cleanup_bf_ir_ struct bf_ir *ir = NULL;
+    struct bpf_insn img[] = {
+        BPF_MOV64_IMM(BPF_REG_7, 0),
+        BPF_LDX_MEM(BPF_H, BPF_REG_7, BPF_REG_1, 12),
+        BPF_JMP_IMM(BPF_JNE, BPF_REG_7, htobe16(ETH_P_IP), 2),
+        BPF_MOV64_IMM(BPF_REG_0, 1),
+        BPF_MOV64_IMM(BPF_REG_0, 2),
+        BPF_JMP_IMM(BPF_JEQ, BPF_REG_1, 0, 1),
+        BPF_MOV64_IMM(BPF_REG_0, 0),
+        BPF_EXIT_INSN(),
+    };
+    uint64_t best;
+    uint64_t worst;
+
+    assert_success(bf_ir_new(&ir, img, ARRAY_SIZE(img)));
+
+    // r7 is the L3 protocol ID, the IPv4 branch is taken
+    assert_success(
+        bf_ir_path_cost(ir, htobe16(ETH_P_IP), IPPROTO_TCP, &best, &worst));
+    assert_int_equal(best, 7);
+    assert_int_equal(worst, 8);
+
+    assert_success(
+        bf_ir_path_cost(ir, htobe16(ETH_P_IPV6), IPPROTO_TCP, &best, &worst));
+    assert_int_equal(best, 5);
+    assert_int_equal(worst, 6);
+
+    expect_assert_failure(bf_ir_path_cost(NULL, 0, 0, NOT_NULL, NOT_NULL));
+    expect_assert_failure(bf_ir_path_cost(NOT_NULL, 0, 0, NULL, NOT_NULL));
+    expect_assert_failure(bf_ir_path_cost(NOT_NULL, 0, 0, NOT_NULL, NULL));
+}
+
+Test(ir, path_cost_calls_and_loops)
+{
+    _cleanup_bf_ir_ struct bf_ir *ir = NULL;
+    uint64_t best;
+    uint64_t worst;
+
+    {
+        // The called function's instructions are counted
+        struct bpf_insn img[] = {
+            BPF_CALL_REL(1),
+            BPF_EXIT_INSN(),
+            BPF_MOV64_IMM(BPF_REG_0, 0),
+            BPF_EXIT_INSN(),
+        };
+
+        assert_success(bf_ir_new(&ir, img, ARRAY_SIZE(img)));
+        assert_success(bf_ir_path_cost(ir, 0, 0, &best, &worst));
+        assert_int_equal(best, 4);
+        assert_int_equal(worst, 4);
+        bf_ir_free(&ir);
+    }
+
+    {
+        struct bpf_insn img[] = {
+            BPF_MOV64_IMM(BPF_REG_0, 0),
+            BPF_JMP_IMM(BPF_JEQ, BPF_REG_1, 0, -2),
+            BPF_EXIT_INSN(),
+        };
+
+        assert_success(bf_ir_new(&ir, img, ARRAY_SIZE(img)));
+        assert_int_equal(bf_ir_path_cost(ir, 0, 0, &best, &worst), -ENOTSUP);
+    }
+}
@@ -196,3 +196,20 @@ Test(map, bpf_map_type_to_from)
 
     assert_error(bf_map_bpf_type_from_str("invalid", &type));
 }
+
+Test(map, mem_size_assert)
+{
+    expect_assert_failure(bf_map_mem_size(NULL));
+}
+
+Test(map, mem_size)
+{
+    _cleanup_bf_map_ struct bf_map *map = NULL;
+    _clean_bf_test_mock_ bf_test_mock _ = bf_test_mock_get(bf_bpf, 16);
+
+    assert_success(bf_map_new(&map, "suffix", BF_MAP_TYPE_SET, BF_MAP_BPF_TYPE_ARRAY, 1, 1, 1));
+    assert_success(bf_map_create(map, 0));
+
+    // The mocked bpf() doesn't fill the map's info
+    assert_int_equal(bf_map_mem_size(map), 0);
+}
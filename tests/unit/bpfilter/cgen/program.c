@@ -44,3 +44,74 @@ Test(program, can_get_flavor_from_hook)
     for (int i = 0; i < _BF_HOOK_MAX; ++i)
         assert_non_null(bf_flavor_ops_get(i));
 }
+
+Test(program, add_chain)
+{
+    _cleanup_bf_chain_ struct bf_chain *chain0 = bf_test_chain_quick();
+    _cleanup_bf_chain_ struct bf_chain *chain1 = bf_test_chain_quick();
+    _cleanup_bf_program_ struct bf_program *program = NULL;
+
+    for (int i = 0; i < 3; ++i) {
+        struct bf_rule *rule;
+
+        assert_success(bf_rule_new(&rule));
+        assert_success(bf_chain_add_rule(chain0, rule));
+    }
+
+    expect_assert_failure(bf_program_add_chain(NULL, chain1));
+
+    assert_success(bf_program_new(&program, BF_HOOK_NF_LOCAL_IN,
+                                  BF_FRONT_CLI, chain0));
+    expect_assert_failure(bf_program_add_chain(program, NULL));
+    assert_success(bf_program_add_chain(program, chain1));
+
+    assert_int_equal(program->n_sections, 2);
+    assert_int_equal(bf_list_size(&program->runtime.chains), 2);
+
+    // 3 rules and the policy
+    assert_int_equal(program->sections[0].counters_offset, 0);
+    assert_int_equal(program->sections[0].n_counters, 4);
+
+    // Only the policy
+    assert_int_equal(program->sections[1].counters_offset, 4);
+    assert_int_equal(program->sections[1].n_counters, 1);
+}
+
+Test(program, counters_out_of_bounds)
+{
+    _cleanup_bf_chain_ struct bf_chain *chain = bf_test_chain_quick();
+    _cleanup_bf_program_ struct bf_program *program = NULL;
+    struct bf_counter counter = {};
+
+    assert_success(bf_program_new(&program, BF_HOOK_NF_LOCAL_IN,
+                                  BF_FRONT_CLI, chain));
+    program->num_counters = 2;
+
+    // Out of bounds accesses are rejected before the map is accessed
+    assert_success(bf_program_get_counters(program, 4, 0, &counter));
+    assert_error(bf_program_get_counters(program, 1, 2, &counter));
+    assert_error(bf_program_get_counter(program, 2, &counter));
+    assert_error(bf_program_set_counter(program, 2, &counter));
+}
+
+Test(program, add_chain_interpreted)
+{
+    _cleanup_bf_chain_ struct bf_chain *chain0 = bf_test_chain_quick();
+    _cleanup_bf_chain_ struct bf_chain *chain1 = bf_test_chain_quick();
+    _cleanup_bf_program_ struct bf_program *program = NULL;
+
+    chain1->hook_opts.mode = BF_HOOK_MODE_INTERPRETED;
+
+    assert_success(bf_program_new(&program, BF_HOOK_NF_LOCAL_IN,
+                                  BF_FRONT_CLI, chain0));
+    assert_null(program->rmap);
+    assert_int_equal(program->sections[0].n_rules, 0);
+
+    assert_success(bf_program_add_chain(program, chain1));
+    assert_non_null(program->rmap);
+
+    // Records and counters are reserved to add rules later
+    assert_int_equal(program->sections[1].rules_offset, 0);
+    assert_int_equal(program->sections[1].n_rules, 64);
+    assert_int_equal(program->sections[1].n_counters, 65);
+}
@@ -0,0 +1,153 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "bpfilter/cgen/tss.c"
+
+#include "fake.h"
+#include "harness/test.h"
+#include "harness/mock.h"
+
+static struct bf_rule *_bf_tss_test_rule(uint32_t index, uint32_t addr,
+                                         uint32_t mask, uint16_t port)
+{
+    struct bf_matcher_ip4_addr ip4 = {
+        .addr = htobe32(addr),
+        .mask = htobe32(mask),
+    };
+    struct bf_rule *rule;
+
+    assert_success(bf_rule_new(&rule));
+    rule->index = index;
+    rule->verdict = BF_VERDICT_DROP;
+    assert_success(bf_rule_add_matcher(rule, BF_MATCHER_IP4_SRC_ADDR,
+                                       BF_MATCHER_EQ, &ip4, sizeof(ip4)));
+    assert_success(bf_rule_add_matcher(rule, BF_MATCHER_TCP_DPORT,
+                                       BF_MATCHER_EQ, &port, sizeof(port)));
+
+    return rule;
+}
+
+Test(tss, rule_encode)
+{
+    _cleanup_bf_rule_ struct bf_rule *rule =
+        _bf_tss_test_rule(0, 0x0a000001, 0xffffff00, 22);
+    struct bf_tss_key mask;
+    struct bf_tss_key key;
+    uint32_t flags;
+
+    expect_assert_failure(bf_tss_rule_encode(NULL, NOT_NULL, NOT_NULL,
+                                             NOT_NULL));
+    expect_assert_failure(bf_tss_rule_encode(NOT_NULL, NULL, NOT_NULL,
+                                             NOT_NULL));
+    expect_assert_failure(bf_tss_rule_encode(NOT_NULL, NOT_NULL, NULL,
+                                             NOT_NULL));
+    expect_assert_failure(bf_tss_rule_encode(NOT_NULL, NOT_NULL, NOT_NULL,
+                                             NULL));
+
+    assert_success(bf_tss_rule_encode(rule, &key, &mask, &flags));
+    assert_int_equal(flags, BF_TSS_TUPLE_IP4);
+
+    // The key is masked, the TCP port implies the L4 protocol
+    assert_int_equal(key.saddr, htobe32(0x0a000000));
+    assert_int_equal(mask.saddr, htobe32(0xffffff00));
+    assert_int_equal(key.daddr, 0);
+    assert_int_equal(mask.daddr, 0);
+    assert_int_equal(key.dport, htobe16(22));
+    assert_int_equal(mask.dport, 0xffff);
+    assert_int_equal(mask.sport, 0);
+    assert_int_equal(key.l4_proto, IPPROTO_TCP);
+    assert_int_equal(mask.l4_proto, 0xff);
+}
+
+Test(tss, rule_encode_unsupported)
+{
+    struct bf_tss_key mask;
+    struct bf_tss_key key;
+    uint8_t proto = IPPROTO_UDP;
+    uint16_t port = 22;
+    uint32_t flags;
+
+    {
+        // Only ACCEPT and DROP are supported
+        _cleanup_bf_rule_ struct bf_rule *rule = NULL;
+
+        assert_success(bf_rule_new(&rule));
+        rule->verdict = BF_VERDICT_CONTINUE;
+        assert_error(bf_tss_rule_encode(rule, &key, &mask, &flags));
+    }
+
+    {
+        // Only EQ is supported
+        _cleanup_bf_rule_ struct bf_rule *rule = NULL;
+
+        assert_success(bf_rule_new(&rule));
+        rule->verdict = BF_VERDICT_ACCEPT;
+        assert_success(bf_rule_add_matcher(rule, BF_MATCHER_TCP_DPORT,
+                                           BF_MATCHER_NE, &port,
+                                           sizeof(port)));
+        assert_error(bf_tss_rule_encode(rule, &key, &mask, &flags));
+    }
+
+    {
+        // Conflicting L4 protocols
+        _cleanup_bf_rule_ struct bf_rule *rule = NULL;
+
+        assert_success(bf_rule_new(&rule));
+        rule->verdict = BF_VERDICT_ACCEPT;
+        assert_success(bf_rule_add_matcher(rule, BF_MATCHER_IP4_PROTO,
+                                           BF_MATCHER_EQ, &proto,
+                                           sizeof(proto)));
+        assert_success(bf_rule_add_matcher(rule, BF_MATCHER_TCP_DPORT,
+                                           BF_MATCHER_EQ, &port,
+                                           sizeof(port)));
+        assert_error(bf_tss_rule_encode(rule, &key, &mask, &flags));
+    }
+
+    {
+        // Port 0 can't be distinguished from a packet without ports
+        _cleanup_bf_rule_ struct bf_rule *rule = NULL;
+
+        port = 0;
+        assert_success(bf_rule_new(&rule));
+        rule->verdict = BF_VERDICT_ACCEPT;
+        assert_success(bf_rule_add_matcher(rule, BF_MATCHER_META_DPORT,
+                                           BF_MATCHER_EQ, &port,
+                                           sizeof(port)));
+        assert_error(bf_tss_rule_encode(rule, &key, &mask, &flags));
+    }
+}
+
+Test(tss, add_rule)
+{
+    _clean_bf_list_ bf_list tuples = bf_tss_tuple_list();
+    const struct bf_tss_tuple *tuple;
+
+    expect_assert_failure(bf_tss_add_rule(NULL, NOT_NULL, 0));
+    expect_assert_failure(bf_tss_add_rule(NOT_NULL, NULL, 0));
+
+    // Rules with the same masks share a tuple
+    for (uint32_t i = 0; i < 40; ++i) {
+        _cleanup_bf_rule_ struct bf_rule *rule = _bf_tss_test_rule(
+            i, 0x0a000000 + (i << 8), i % 2 ? 0xffffff00 : 0xffff0000, 22);
+
+        assert_success(bf_tss_add_rule(&tuples, rule, 100 + i));
+    }
+
+    assert_int_equal(bf_list_size(&tuples), 2);
+
+    tuple = bf_list_get_at(&tuples, 0);
+    assert_int_equal(tuple->min_priority, 0);
+    assert_int_equal(tuple->n_elems, 20);
+    assert_int_equal(tuple->mask.saddr, htobe32(0xffff0000));
+    assert_int_equal(tuple->values[1].priority, 2);
+    assert_int_equal(tuple->values[1].counter, 102);
+    assert_int_equal(tuple->values[1].verdict, BF_VERDICT_DROP);
+    assert_int_equal(tuple->values[1].flags, 0);
+
+    tuple = bf_list_get_at(&tuples, 1);
+    assert_int_equal(tuple->min_priority, 1);
+    assert_int_equal(tuple->n_elems, 20);
+    assert_int_equal(tuple->keys[0].saddr, htobe32(0x0a000100));
+}
@@ -7,6 +7,7 @@
 
 #include <stdbool.h>
 
+#include "fake.h"
 #include "harness/test.h"
 #include "harness/mock.h"
 
@@ -43,3 +44,48 @@ Test(ctx, create_delete)
     assert_null(ctx2);
     _bf_ctx_free(&ctx2);
 }
+
+static struct bf_cgen *_bf_test_nf_cgen(int32_t priority)
+{
+    struct bf_cgen *cgen;
+    struct bf_chain *chain =
+        bf_test_chain(BF_HOOK_NF_LOCAL_IN, BF_VERDICT_ACCEPT);
+
+    chain->hook_opts.used_opts |= 1 << BF_HOOK_OPT_PRIORITY;
+    chain->hook_opts.priority = priority;
+    assert_success(bf_cgen_new(&cgen, BF_FRONT_CLI, &chain));
+
+    return cgen;
+}
+
+Test(ctx, nf_cgens_sorted_by_priority)
+{
+    _cleanup_bf_ctx_ struct bf_ctx *ctx = NULL;
+    _cleanup_bf_cgen_ struct bf_cgen *dup = _bf_test_nf_cgen(10);
+    const int32_t priorities[] = {-5, 0, 10, 20};
+    const struct bf_hook_opts opts = {.priority = 20};
+    size_t i = 0;
+
+    assert_success(_bf_ctx_new(&ctx));
+
+    assert_success(_bf_ctx_set_cgen(ctx, _bf_test_nf_cgen(10)));
+    assert_success(_bf_ctx_set_cgen(ctx, _bf_test_nf_cgen(-5)));
+    assert_success(_bf_ctx_set_cgen(ctx, _bf_test_nf_cgen(20)));
+    assert_success(_bf_ctx_set_cgen(ctx, _bf_test_nf_cgen(0)));
+    assert_int_equal(-EEXIST, _bf_ctx_set_cgen(ctx, dup));
+
+    bf_list_foreach (&ctx->cgens[BF_HOOK_NF_LOCAL_IN], cgen_node) {
+        struct bf_cgen *cgen = bf_list_node_get_data(cgen_node);
+
+        assert_int_equal(cgen->chain->hook_opts.priority, priorities[i++]);
+    }
+
+    assert_int_equal(
+        _bf_ctx_get_cgen(ctx, BF_HOOK_NF_LOCAL_IN, &opts)->chain->hook_opts
+            .priority,
+        20);
+    assert_int_equal(
+        _bf_ctx_get_cgen(ctx, BF_HOOK_NF_LOCAL_IN, NULL)->chain->hook_opts
+            .priority,
+        0);
+}
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "bpfilter/metrics.c"
+
+#include "harness/test.h"
+#include "harness/mock.h"
+
+Test(metrics, record_request_assert)
+{
+    uint64_t timings[_BF_PHASE_MAX] = {};
+
+    expect_assert_failure(bf_metrics_record_request(-1, false, 0, timings));
+    expect_assert_failure(
+        bf_metrics_record_request(_BF_FRONT_MAX, false, 0, timings));
+    expect_assert_failure(
+        bf_metrics_record_request(BF_FRONT_CLI, false, 0, NULL));
+    expect_assert_failure(bf_metrics_write(NULL));
+}
+
+Test(metrics, write_requests)
+{
+    uint64_t timings[_BF_PHASE_MAX] = {[BF_PHASE_LOAD] = 1500000000};
+    _cleanup_free_ char *buf = NULL;
+    size_t len;
+    FILE *file;
+
+    memset(_bf_metrics_requests, 0, sizeof(_bf_metrics_requests));
+    memset(_bf_metrics_phases_ns, 0, sizeof(_bf_metrics_phases_ns));
+
+    bf_metrics_record_request(BF_FRONT_CLI, false, 2000000, timings);
+    bf_metrics_record_request(BF_FRONT_CLI, true, 10000000000, timings);
+
+    assert_int_equal(_bf_metrics_requests[BF_FRONT_CLI].count, 2);
+    assert_int_equal(_bf_metrics_requests[BF_FRONT_CLI].failures, 1);
+    assert_int_equal(_bf_metrics_requests[BF_FRONT_CLI].buckets[1], 1);
+
+    file = open_memstream(&buf, &len);
+    assert_non_null(file);
+    _bf_metrics_write_requests(file);
+    assert_int_equal(fclose(file), 0);
+
+    assert_non_null(strstr(
+        buf, "bpfilter_requests_failed_total{front=\"cli\"} 1\n"));
+    assert_non_null(strstr(
+        buf,
+        "bpfilter_request_duration_seconds_bucket{front=\"cli\","
+        "le=\"0.001000000\"} 0\n"));
+    assert_non_null(strstr(
+        buf,
+        "bpfilter_request_duration_seconds_bucket{front=\"cli\","
+        "le=\"0.005000000\"} 1\n"));
+    assert_non_null(strstr(
+        buf,
+        "bpfilter_request_duration_seconds_bucket{front=\"cli\","
+        "le=\"+Inf\"} 2\n"));
+    assert_non_null(strstr(
+        buf, "bpfilter_request_duration_seconds_count{front=\"cli\"} 2\n"));
+    assert_non_null(strstr(
+        buf,
+        "bpfilter_phase_duration_seconds_total{phase=\"load\"} 3.000000000\n"));
+}
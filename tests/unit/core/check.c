@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "core/check.c"
+
+#include "harness/test.h"
+#include "harness/mock.h"
+
+Test(check, class_to_str)
+{
+    expect_assert_failure(bf_check_class_to_str(-1));
+    expect_assert_failure(bf_check_class_to_str(_BF_CHECK_CLASS_MAX));
+
+    for (int i = 0; i < _BF_CHECK_CLASS_MAX; ++i)
+        assert_non_null(bf_check_class_to_str(i));
+}
@@ -60,3 +60,66 @@ Test(hook, can_get_attach_type_from_hook)
         // to build.
     }
 }
+
+Test(hook, opts_priority)
+{
+    _clean_bf_list_ bf_list raw_opts = bf_list_default(NULL, NULL);
+    _clean_bf_list_ bf_list bad_opts = bf_list_default(NULL, NULL);
+    struct bf_hook_opts opts;
+
+    assert_success(bf_list_add_tail(&raw_opts, (void *)"priority=-5"));
+    assert_success(bf_list_add_tail(&bad_opts, (void *)"priority=high"));
+
+    assert_success(bf_hook_opts_init(&opts, BF_HOOK_NF_LOCAL_IN, NULL));
+    assert_int_equal(opts.priority, 0);
+
+    assert_success(
+        bf_hook_opts_init(&opts, BF_HOOK_NF_LOCAL_IN, &raw_opts));
+    assert_int_equal(opts.priority, -5);
+    assert_true(opts.used_opts & (1 << BF_HOOK_OPT_PRIORITY));
+
+    assert_error(bf_hook_opts_init(&opts, BF_HOOK_NF_LOCAL_IN, &bad_opts));
+    assert_error(bf_hook_opts_init(&opts, BF_HOOK_CGROUP_INGRESS, &raw_opts));
+
+    assert_true(bf_hook_is_nf(BF_HOOK_NF_POST_ROUTING));
+    assert_false(bf_hook_is_nf(BF_HOOK_XDP));
+}
+
+Test(hook, opts_mode)
+{
+    _clean_bf_list_ bf_list raw_opts = bf_list_default(NULL, NULL);
+    _clean_bf_list_ bf_list bad_opts = bf_list_default(NULL, NULL);
+    _clean_bf_list_ bf_list tss_opts = bf_list_default(NULL, NULL);
+    struct bf_hook_opts opts;
+
+    assert_success(bf_list_add_tail(&raw_opts, (void *)"mode=interpreted"));
+    assert_success(bf_list_add_tail(&tss_opts, (void *)"mode=classifier"));
+    assert_success(bf_list_add_tail(&bad_opts, (void *)"mode=jit"));
+
+    assert_success(bf_hook_opts_init(&opts, BF_HOOK_NF_LOCAL_IN, NULL));
+    assert_int_equal(opts.mode, BF_HOOK_MODE_COMPILED);
+
+    assert_success(bf_hook_opts_init(&opts, BF_HOOK_NF_LOCAL_IN, &raw_opts));
+    assert_int_equal(opts.mode, BF_HOOK_MODE_INTERPRETED);
+    assert_true(opts.used_opts & (1 << BF_HOOK_OPT_MODE));
+
+    assert_success(bf_hook_opts_init(&opts, BF_HOOK_NF_LOCAL_IN, &tss_opts));
+    assert_int_equal(opts.mode, BF_HOOK_MODE_CLASSIFIER);
+
+    assert_error(bf_hook_opts_init(&opts, BF_HOOK_NF_LOCAL_IN, &bad_opts));
+    assert_error(
+        bf_hook_opts_init(&opts, BF_HOOK_CGROUP_INET4_CONNECT, &raw_opts));
+}
+
+Test(hook, is_sock_addr)
+{
+    expect_assert_failure(bf_hook_is_sock_addr(-1));
+    expect_assert_failure(bf_hook_is_sock_addr(_BF_HOOK_MAX));
+
+    assert_true(bf_hook_is_sock_addr(BF_HOOK_CGROUP_INET4_CONNECT));
+    assert_true(bf_hook_is_sock_addr(BF_HOOK_CGROUP_INET6_CONNECT));
+    assert_true(bf_hook_is_sock_addr(BF_HOOK_CGROUP_UDP4_SENDMSG));
+    assert_true(bf_hook_is_sock_addr(BF_HOOK_CGROUP_UDP6_SENDMSG));
+    assert_false(bf_hook_is_sock_addr(BF_HOOK_CGROUP_EGRESS));
+    assert_false(bf_hook_is_sock_addr(BF_HOOK_XDP));
+}
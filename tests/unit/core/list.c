@@ -417,3 +417,40 @@ Test(list, node_take_data)
         }
     }
 }
+
+Test(list, add_before_after)
+{
+    bf_list l;
+    bf_list_ops noop_ops = bf_list_ops_default(NULL, NULL);
+    int values[] = {0, 1, 2, 3, 4, 5};
+    size_t i = 0;
+
+    bf_list_init(&l, &noop_ops);
+
+    expect_assert_failure(bf_list_add_before(NULL, NOT_NULL, NULL));
+    expect_assert_failure(bf_list_add_before(&l, NULL, NULL));
+    expect_assert_failure(bf_list_add_after(NULL, NOT_NULL, NULL));
+    expect_assert_failure(bf_list_add_after(&l, NULL, NULL));
+
+    assert_success(bf_list_add_tail(&l, &values[2]));
+
+    // Insert before the head and after the tail
+    assert_success(bf_list_add_before(&l, bf_list_get_head(&l), &values[0]));
+    assert_success(bf_list_add_after(&l, bf_list_get_tail(&l), &values[5]));
+
+    // Insert in the middle of the list
+    assert_success(bf_list_add_after(&l, bf_list_get_head(&l), &values[1]));
+    assert_success(bf_list_add_before(&l, bf_list_get_tail(&l), &values[4]));
+    assert_success(bf_list_add_before(
+        &l, bf_list_node_prev(bf_list_get_tail(&l)), &values[3]));
+
+    assert_int_equal(bf_list_size(&l), ARRAY_SIZE(values));
+    bf_list_foreach (&l, node)
+        assert_int_equal(*(int *)bf_list_node_get_data(node), values[i++]);
+
+    i = ARRAY_SIZE(values);
+    bf_list_foreach_rev (&l, node)
+        assert_int_equal(*(int *)bf_list_node_get_data(node), values[--i]);
+
+    bf_list_clean(&l);
+}
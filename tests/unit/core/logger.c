@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "core/logger.c"
+
+#include "harness/test.h"
+#include "harness/mock.h"
+
+Test(logger, format_from_str)
+{
+    enum bf_log_format format;
+
+    expect_assert_failure(bf_log_format_from_str(NULL, &format));
+    expect_assert_failure(bf_log_format_from_str("text", NULL));
+    expect_assert_failure(bf_logger_set_format(_BF_LOG_FORMAT_MAX));
+
+    assert_int_equal(bf_log_format_from_str("xml", &format), -EINVAL);
+
+    for (int i = 0; i < _BF_LOG_FORMAT_MAX; ++i) {
+        assert_success(bf_log_format_from_str(_bf_log_format_strs[i], &format));
+        assert_int_equal(format, i);
+    }
+}
+
+Test(logger, format_line)
+{
+    char buf[64];
+    size_t len;
+
+    bf_logger_set_format(BF_LOG_FORMAT_JOURNAL);
+    len = _bf_log_format_line(buf, sizeof(buf), BF_LOG_WARN, "hello");
+    assert_string_equal(buf, "<4>hello\n");
+    assert_int_equal(len, strlen(buf));
+
+    bf_logger_set_format(BF_LOG_FORMAT_JSON);
+    len = _bf_log_format_line(buf, sizeof(buf), BF_LOG_ERR, "\"a\"\n");
+    assert_non_null(strstr(buf, "\"level\":\"error\""));
+    assert_non_null(strstr(buf, "\"msg\":\"\\\"a\\\"\\u000a\"}\n"));
+    assert_int_equal(len, strlen(buf));
+
+    // Truncated messages still end with a newline.
+    bf_logger_set_format(BF_LOG_FORMAT_JOURNAL);
+    len = _bf_log_format_line(
+        buf, sizeof(buf), BF_LOG_INFO,
+        "a message which is too long to fit into the 64 bytes buffer");
+    assert_int_equal(len, sizeof(buf) - 1);
+    assert_int_equal(buf[len - 1], '\n');
+
+    bf_logger_set_format(BF_LOG_FORMAT_TEXT);
+}
+
+Test(logger, ratelimit)
+{
+    const char *fmt = "rate limited message";
+
+    bf_logger_set_ratelimit(0);
+    for (int i = 0; i < 10; ++i)
+        assert_false(_bf_log_ratelimit(BF_LOG_ERR, fmt));
+
+    bf_logger_set_ratelimit(2);
+    assert_false(_bf_log_ratelimit(BF_LOG_ERR, fmt));
+    assert_false(_bf_log_ratelimit(BF_LOG_ERR, fmt));
+    assert_true(_bf_log_ratelimit(BF_LOG_ERR, fmt));
+    assert_true(_bf_log_ratelimit(BF_LOG_INFO, fmt));
+
+    // Debug messages are never rate limited.
+    assert_false(_bf_log_ratelimit(BF_LOG_DBG, fmt));
+
+    bf_logger_set_ratelimit(0);
+}
+
+Test(logger, ring)
+{
+    char out[16];
+
+    atomic_store(&_bf_log_ring.head, BF_LOG_RING_SIZE - 2);
+    atomic_store(&_bf_log_ring.tail, BF_LOG_RING_SIZE - 2);
+
+    // Records can wrap around the end of the ring.
+    _bf_log_ring_copy_in(BF_LOG_RING_SIZE - 2, "abcdef", 6);
+    _bf_log_ring_copy_out(BF_LOG_RING_SIZE - 2, out, 6);
+    assert_memory_equal(out, "abcdef", 6);
+
+    atomic_store(&_bf_log_ring.head, 0);
+    atomic_store(&_bf_log_ring.tail, 0);
+}
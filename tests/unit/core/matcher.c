@@ -128,3 +128,25 @@ Test(matcher, can_get_str_from_matcher_op)
     for (int i = 0; i < _BF_MATCHER_OP_MAX; ++i)
         assert_non_null(bf_matcher_op_to_str(i));
 }
+
+Test(matcher, ct_state_to_str_to_ct_state)
+{
+    enum bf_matcher_ct_state state;
+
+    expect_assert_failure(bf_matcher_ct_state_to_str(-1));
+    expect_assert_failure(
+        bf_matcher_ct_state_to_str(_BF_MATCHER_CT_STATE_MAX));
+    expect_assert_failure(bf_matcher_ct_state_from_str(NULL, NOT_NULL));
+    expect_assert_failure(bf_matcher_ct_state_from_str(NOT_NULL, NULL));
+
+    for (int i = 0; i < _BF_MATCHER_CT_STATE_MAX; ++i) {
+        const char *str = bf_matcher_ct_state_to_str(i);
+
+        assert_non_null(str);
+        assert_int_equal(0, bf_matcher_ct_state_from_str(str, &state));
+        assert_int_equal(state, i);
+    }
+
+    assert_int_not_equal(0, bf_matcher_ct_state_from_str("", &state));
+    assert_int_not_equal(0, bf_matcher_ct_state_from_str("unknown", &state));
+}
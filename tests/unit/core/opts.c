@@ -17,3 +17,31 @@ Test(opts, no_nftables)
     assert_success(bf_opts_init(ARRAY_SIZE(opt0), opt0));
     assert(0 == (_bf_opts.fronts & (1 << BF_FRONT_NFT)));
 }
+
+Test(opts, telemetry)
+{
+    char *opt0[] = {"tests_unit", "--telemetry"};
+
+    _bf_opts.telemetry = false;
+    assert_false(bf_opts_telemetry());
+    assert_success(bf_opts_init(ARRAY_SIZE(opt0), opt0));
+    assert_true(bf_opts_telemetry());
+    _bf_opts.telemetry = false;
+}
+
+Test(opts, profile)
+{
+    char *opt0[] = {"tests_unit", "--profile", "100", "--profile-block", "4"};
+    char *opt1[] = {"tests_unit", "--profile-block", "0"};
+    char *opt2[] = {"tests_unit", "--profile", "-1"};
+
+    assert_success(bf_opts_init(ARRAY_SIZE(opt0), opt0));
+    assert_int_equal(bf_opts_profile_rate(), 100);
+    assert_int_equal(bf_opts_profile_block(), 4);
+
+    assert_int_not_equal(0, bf_opts_init(ARRAY_SIZE(opt1), opt1));
+    assert_int_not_equal(0, bf_opts_init(ARRAY_SIZE(opt2), opt2));
+
+    _bf_opts.profile_rate = 0;
+    _bf_opts.profile_block = 8;
+}
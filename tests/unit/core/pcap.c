@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "core/pcap.c"
+
+#include "harness/test.h"
+#include "harness/mock.h"
+
+/**
+ * Append a pcap record to a buffer.
+ *
+ * @return Offset of the end of the record in @p buf .
+ */
+static size_t _bf_test_pcap_add(uint8_t *buf, size_t offset,
+                                const void *data, uint32_t len, bool swapped)
+{
+    struct bf_pcap_rec_hdr rec = {
+        .incl_len = _bf_pcap_u32(len, swapped),
+        .orig_len = _bf_pcap_u32(len, swapped),
+    };
+
+    memcpy(&buf[offset], &rec, sizeof(rec));
+    memcpy(&buf[offset + sizeof(rec)], data, len);
+
+    return offset + sizeof(rec) + len;
+}
+
+static size_t _bf_test_pcap_hdr(uint8_t *buf, uint32_t magic,
+                                uint32_t linktype, bool swapped)
+{
+    struct bf_pcap_hdr hdr = {
+        .magic = _bf_pcap_u32(magic, swapped),
+        .version_major = swapped ? bswap_16(2) : 2,
+        .version_minor = swapped ? bswap_16(4) : 4,
+        .snaplen = _bf_pcap_u32(65535, swapped),
+        .linktype = _bf_pcap_u32(linktype, swapped),
+    };
+
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    return sizeof(hdr);
+}
+
+Test(pcap, parse_invalid)
+{
+    _cleanup_free_ void *pkts = NULL;
+    uint8_t buf[128] = {};
+    size_t pkts_len;
+    size_t n_pkts;
+    uint32_t magic;
+
+    expect_assert_failure(bf_pcap_parse(NULL, 0, NOT_NULL, NOT_NULL, NOT_NULL));
+    expect_assert_failure(bf_pcap_parse(NOT_NULL, 0, NULL, NOT_NULL, NOT_NULL));
+    expect_assert_failure(bf_pcap_parse(NOT_NULL, 0, NOT_NULL, NULL, NOT_NULL));
+    expect_assert_failure(bf_pcap_parse(NOT_NULL, 0, NOT_NULL, NOT_NULL, NULL));
+
+    // Too small to contain a magic number or a header
+    assert_int_equal(-EINVAL, bf_pcap_parse(buf, 2, &pkts, &pkts_len, &n_pkts));
+    (void)_bf_test_pcap_hdr(buf, BF_PCAP_MAGIC_US, 1, false);
+    assert_int_equal(-EINVAL, bf_pcap_parse(buf, 8, &pkts, &pkts_len, &n_pkts));
+
+    // pcapng is rejected
+    magic = BF_PCAPNG_MAGIC;
+    memcpy(buf, &magic, sizeof(magic));
+    assert_int_equal(-ENOTSUP, bf_pcap_parse(buf, sizeof(buf), &pkts, &pkts_len,
+                                             &n_pkts));
+
+    // Unknown magic number
+    magic = 0xdeadbeef;
+    memcpy(buf, &magic, sizeof(magic));
+    assert_int_equal(-EINVAL, bf_pcap_parse(buf, sizeof(buf), &pkts, &pkts_len,
+                                            &n_pkts));
+
+    // Unsupported link type
+    (void)_bf_test_pcap_hdr(buf, BF_PCAP_MAGIC_US, 147, false);
+    assert_int_equal(-ENOTSUP, bf_pcap_parse(buf, sizeof(buf), &pkts, &pkts_len,
+                                             &n_pkts));
+}
+
+Test(pcap, parse_ethernet)
+{
+    _cleanup_free_ void *pkts = NULL;
+    const struct bf_pcap_pkt *pkt = NULL;
+    uint8_t eth[64];
+    uint8_t buf[512];
+    size_t offset;
+    size_t pkts_len;
+    size_t n_pkts;
+
+    for (size_t i = 0; i < sizeof(eth); ++i)
+        eth[i] = (uint8_t)i;
+
+    // Native byte order, the last record is truncated
+    offset = _bf_test_pcap_hdr(buf, BF_PCAP_MAGIC_US, 1, false);
+    offset = _bf_test_pcap_add(buf, offset, eth, sizeof(eth), false);
+    offset = _bf_test_pcap_add(buf, offset, eth, 20, false);
+    offset = _bf_test_pcap_add(buf, offset, eth, sizeof(eth), false);
+
+    assert_int_equal(0, bf_pcap_parse(buf, offset - 1, &pkts, &pkts_len,
+                                      &n_pkts));
+    assert_int_equal(n_pkts, 2);
+    assert_int_equal(pkts_len, 2 * sizeof(*pkt) + sizeof(eth) + 20);
+
+    assert_non_null(pkt = bf_pcap_pkt_next(pkts, pkts_len, pkt));
+    assert_int_equal(pkt->len, sizeof(eth));
+    assert_memory_equal(pkt->data, eth, sizeof(eth));
+    assert_non_null(pkt = bf_pcap_pkt_next(pkts, pkts_len, pkt));
+    assert_int_equal(pkt->len, 20);
+    assert_memory_equal(pkt->data, eth, 20);
+    assert_null(bf_pcap_pkt_next(pkts, pkts_len, pkt));
+
+    // A packet which is not fully contained in the buffer is not returned
+    assert_non_null(pkt = bf_pcap_pkt_next(pkts, pkts_len - 1, NULL));
+    assert_null(bf_pcap_pkt_next(pkts, pkts_len - 1, pkt));
+    assert_null(bf_pcap_pkt_next(pkts, 2, NULL));
+
+    freep((void *)&pkts);
+
+    // Swapped byte order, nanosecond timestamps
+    offset = _bf_test_pcap_hdr(buf, BF_PCAP_MAGIC_NS, 1, true);
+    offset = _bf_test_pcap_add(buf, offset, eth, sizeof(eth), true);
+
+    assert_int_equal(0, bf_pcap_parse(buf, offset, &pkts, &pkts_len, &n_pkts));
+    assert_int_equal(n_pkts, 1);
+    assert_non_null(pkt = bf_pcap_pkt_next(pkts, pkts_len, NULL));
+    assert_int_equal(pkt->len, sizeof(eth));
+    assert_memory_equal(pkt->data, eth, sizeof(eth));
+}
+
+Test(pcap, parse_raw)
+{
+    _cleanup_free_ void *pkts = NULL;
+    const struct bf_pcap_pkt *pkt = NULL;
+    const struct ethhdr *ethhdr;
+    uint8_t ip4[20] = {0x45};
+    uint8_t ip6[40] = {0x60};
+    uint8_t invalid[20] = {0x10};
+    uint8_t buf[512];
+    size_t offset;
+    size_t pkts_len;
+    size_t n_pkts;
+
+    offset = _bf_test_pcap_hdr(buf, BF_PCAP_MAGIC_US, 101, false);
+    offset = _bf_test_pcap_add(buf, offset, ip4, sizeof(ip4), false);
+    offset = _bf_test_pcap_add(buf, offset, invalid, sizeof(invalid), false);
+    offset = _bf_test_pcap_add(buf, offset, ip6, sizeof(ip6), false);
+
+    // Packets with an unknown IP version are skipped
+    assert_int_equal(0, bf_pcap_parse(buf, offset, &pkts, &pkts_len, &n_pkts));
+    assert_int_equal(n_pkts, 2);
+
+    assert_non_null(pkt = bf_pcap_pkt_next(pkts, pkts_len, pkt));
+    assert_int_equal(pkt->len, sizeof(*ethhdr) + sizeof(ip4));
+    ethhdr = (const struct ethhdr *)pkt->data;
+    assert_int_equal(ethhdr->h_proto, htons(ETH_P_IP));
+    assert_memory_equal(&pkt->data[sizeof(*ethhdr)], ip4, sizeof(ip4));
+
+    assert_non_null(pkt = bf_pcap_pkt_next(pkts, pkts_len, pkt));
+    assert_int_equal(pkt->len, sizeof(*ethhdr) + sizeof(ip6));
+    ethhdr = (const struct ethhdr *)pkt->data;
+    assert_int_equal(ethhdr->h_proto, htons(ETH_P_IPV6));
+    assert_memory_equal(&pkt->data[sizeof(*ethhdr)], ip6, sizeof(ip6));
+
+    assert_null(bf_pcap_pkt_next(pkts, pkts_len, pkt));
+}
+
+Test(pcap, parse_linux_sll)
+{
+    _cleanup_free_ void *pkts = NULL;
+    const struct bf_pcap_pkt *pkt;
+    const struct ethhdr *ethhdr;
+    uint8_t sll[BF_PCAP_SLL_HDR_LEN + 20] = {};
+    uint8_t buf[512];
+    size_t offset;
+    size_t pkts_len;
+    size_t n_pkts;
+    uint16_t proto = htons(ETH_P_IP);
+
+    memcpy(&sll[BF_PCAP_SLL_HDR_LEN - sizeof(proto)], &proto, sizeof(proto));
+    sll[BF_PCAP_SLL_HDR_LEN] = 0x45;
+
+    offset = _bf_test_pcap_hdr(buf, BF_PCAP_MAGIC_US, 113, false);
+    offset = _bf_test_pcap_add(buf, offset, sll, sizeof(sll), false);
+
+    assert_int_equal(0, bf_pcap_parse(buf, offset, &pkts, &pkts_len, &n_pkts));
+    assert_int_equal(n_pkts, 1);
+
+    assert_non_null(pkt = bf_pcap_pkt_next(pkts, pkts_len, NULL));
+    assert_int_equal(pkt->len, sizeof(*ethhdr) + 20);
+    ethhdr = (const struct ethhdr *)pkt->data;
+    assert_int_equal(ethhdr->h_proto, htons(ETH_P_IP));
+    assert_int_equal(pkt->data[sizeof(*ethhdr)], 0x45);
+}
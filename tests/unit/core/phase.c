@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "core/phase.c"
+
+#include "harness/test.h"
+#include "harness/mock.h"
+
+Test(phase, phase_to_str)
+{
+    expect_assert_failure(bf_phase_to_str(-1));
+    expect_assert_failure(bf_phase_to_str(_BF_PHASE_MAX));
+
+    for (int i = 0; i < _BF_PHASE_MAX; ++i)
+        assert_non_null(bf_phase_to_str(i));
+}
+
+Test(phase, timer)
+{
+    uint64_t durations[_BF_PHASE_MAX];
+
+    expect_assert_failure(bf_phase_get(NULL));
+    expect_assert_failure(bf_phase_timer_start(_BF_PHASE_MAX));
+    expect_assert_failure(bf_phase_timer_stop(NULL));
+
+    bf_phase_reset();
+
+    {
+        _cleanup_bf_phase_timer_ struct bf_phase_timer _ =
+            bf_phase_timer_start(BF_PHASE_LOAD);
+        struct timespec ts = {.tv_nsec = 1000};
+
+        (void)nanosleep(&ts, NULL);
+    }
+
+    bf_phase_get(durations);
+    for (int i = 0; i < _BF_PHASE_MAX; ++i) {
+        if (i == BF_PHASE_LOAD)
+            assert_true(durations[i] >= 1000);
+        else
+            assert_int_equal(durations[i], 0);
+    }
+
+    bf_phase_reset();
+    bf_phase_get(durations);
+    for (int i = 0; i < _BF_PHASE_MAX; ++i)
+        assert_int_equal(durations[i], 0);
+}
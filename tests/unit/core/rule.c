@@ -50,14 +50,20 @@ Test(rule, marsh_unmarsh)
         _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
 
         assert_non_null(rule0);
+        rule0->set_add = true;
+        rule0->set_index = 2;
         assert_int_equal(0, bf_rule_marsh(rule0, &marsh));
         assert_int_equal(0, bf_rule_unmarsh(marsh, &rule1));
 
         assert_int_equal(rule0->index, rule1->index);
+        assert_int_equal(rule0->handle, rule1->handle);
         assert_int_equal(bf_list_size(&rule0->matchers),
                          bf_list_size(&rule1->matchers));
         assert_int_equal(rule0->counters, rule1->counters);
         assert_int_equal(rule0->verdict, rule1->verdict);
+        assert_int_equal(rule0->target, rule1->target);
+        assert_int_equal(rule0->set_add, rule1->set_add);
+        assert_int_equal(rule0->set_index, rule1->set_index);
     }
 
     // Failed serialisation
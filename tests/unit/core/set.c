@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "core/set.c"
+
+#include "fake.h"
+#include "harness/test.h"
+#include "harness/mock.h"
+
+Test(set, add_remove_elem)
+{
+    _cleanup_bf_set_ struct bf_set *set = NULL;
+    uint32_t elems[] = {0x0100007f, 0x0200007f};
+
+    expect_assert_failure(bf_set_remove_elem(NULL, NOT_NULL));
+    expect_assert_failure(bf_set_remove_elem(NOT_NULL, NULL));
+
+    assert_success(bf_set_new(&set, BF_SET_IP4));
+    assert_success(bf_set_add_elem(set, &elems[0]));
+    assert_success(bf_set_add_elem(set, &elems[1]));
+    assert_int_equal(2, bf_list_size(&set->elems));
+
+    assert_success(bf_set_remove_elem(set, &elems[0]));
+    assert_int_equal(1, bf_list_size(&set->elems));
+    assert_int_equal(-ENOENT, bf_set_remove_elem(set, &elems[0]));
+
+    assert_success(bf_set_remove_elem(set, &elems[1]));
+    assert_true(bf_list_is_empty(&set->elems));
+}
+
+Test(set, dynamic_marsh_unmarsh)
+{
+    _cleanup_bf_set_ struct bf_set *set0 = NULL;
+    _cleanup_bf_set_ struct bf_set *set1 = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+    uint32_t elem = 0x0100007f;
+
+    assert_success(bf_set_new(&set0, BF_SET_IP4));
+    assert_false(bf_set_is_dynamic(set0));
+
+    set0->max_elems = 1024;
+    set0->timeout = 60;
+    assert_true(bf_set_is_dynamic(set0));
+    assert_success(bf_set_add_elem(set0, &elem));
+
+    assert_success(bf_set_marsh(set0, &marsh));
+    assert_success(bf_set_new_from_marsh(&set1, marsh));
+
+    assert_int_equal(set0->type, set1->type);
+    assert_int_equal(set0->max_elems, set1->max_elems);
+    assert_int_equal(set0->timeout, set1->timeout);
+    assert_int_equal(1, bf_list_size(&set1->elems));
+    assert_true(bf_set_is_dynamic(set1));
+}
+
+Test(set, counters_marsh_unmarsh)
+{
+    _cleanup_bf_set_ struct bf_set *set0 = NULL;
+    _cleanup_bf_set_ struct bf_set *set1 = NULL;
+    _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+
+    assert_success(bf_set_new(&set0, BF_SET_SRCIP6));
+    assert_false(set0->counters);
+
+    set0->counters = true;
+    assert_success(bf_set_marsh(set0, &marsh));
+    assert_success(bf_set_new_from_marsh(&set1, marsh));
+
+    assert_true(set1->counters);
+    assert_false(bf_set_is_dynamic(set1));
+}
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "core/subchain.c"
+
+#include "fake.h"
+#include "harness/test.h"
+#include "harness/mock.h"
+
+Test(subchain, new_and_free)
+{
+    expect_assert_failure(bf_subchain_new(NULL, NOT_NULL, NULL));
+    expect_assert_failure(bf_subchain_new(NOT_NULL, NULL, NULL));
+    expect_assert_failure(bf_subchain_free(NULL));
+
+    {
+        _cleanup_bf_subchain_ struct bf_subchain *subchain = NULL;
+
+        assert_success(bf_subchain_new(&subchain, "user_chain", NULL));
+        assert_string_equal(subchain->name, "user_chain");
+        assert_true(bf_list_is_empty(&subchain->rules));
+
+        bf_subchain_free(&subchain);
+        assert_null(subchain);
+        bf_subchain_free(&subchain);
+    }
+
+    // malloc failure
+    {
+        _clean_bf_test_mock_ bf_test_mock _ = bf_test_mock_get(calloc, NULL);
+        struct bf_subchain *subchain;
+
+        assert_error(bf_subchain_new(&subchain, "user_chain", NULL));
+    }
+}
+
+Test(subchain, add_rule)
+{
+    _cleanup_bf_subchain_ struct bf_subchain *subchain = NULL;
+
+    expect_assert_failure(bf_subchain_add_rule(NULL, NOT_NULL));
+    expect_assert_failure(bf_subchain_add_rule(NOT_NULL, NULL));
+
+    assert_success(bf_subchain_new(&subchain, "user_chain", NULL));
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        struct bf_rule *rule = bf_test_get_rule(2);
+
+        assert_non_null(rule);
+        assert_success(bf_subchain_add_rule(subchain, rule));
+        assert_int_equal(i, rule->index);
+    }
+
+    assert_int_equal(3, bf_list_size(&subchain->rules));
+}
+
+Test(subchain, marsh_unmarsh)
+{
+    expect_assert_failure(bf_subchain_marsh(NULL, NOT_NULL));
+    expect_assert_failure(bf_subchain_marsh(NOT_NULL, NULL));
+    expect_assert_failure(bf_subchain_new_from_marsh(NULL, NOT_NULL));
+    expect_assert_failure(bf_subchain_new_from_marsh(NOT_NULL, NULL));
+
+    {
+        _cleanup_bf_subchain_ struct bf_subchain *subchain0 = NULL;
+        _cleanup_bf_subchain_ struct bf_subchain *subchain1 = NULL;
+        _cleanup_bf_marsh_ struct bf_marsh *marsh = NULL;
+
+        assert_success(bf_subchain_new(&subchain0, "user_chain", NULL));
+        assert_success(bf_subchain_add_rule(subchain0, bf_test_get_rule(4)));
+        assert_success(bf_subchain_add_rule(subchain0, bf_test_get_rule(2)));
+
+        assert_success(bf_subchain_marsh(subchain0, &marsh));
+        assert_success(bf_subchain_new_from_marsh(&subchain1, marsh));
+
+        assert_string_equal(subchain0->name, subchain1->name);
+        assert_int_equal(bf_list_size(&subchain0->rules),
+                         bf_list_size(&subchain1->rules));
+    }
+}
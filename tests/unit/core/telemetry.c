@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
+ */
+
+#include "core/telemetry.c"
+
+#include "harness/test.h"
+#include "harness/mock.h"
+
+Test(telemetry, telemetry_to_str)
+{
+    expect_assert_failure(bf_telemetry_to_str(-1));
+    expect_assert_failure(bf_telemetry_to_str(_BF_TELEMETRY_MAX));
+
+    for (int i = 0; i < _BF_TELEMETRY_MAX; ++i)
+        assert_non_null(bf_telemetry_to_str(i));
+}
@@ -6,6 +6,11 @@
 #include "benchmark.hpp"
 
 #include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/x_tables.h>
+#include <linux/netfilter_ipv4/ip_tables.h>
+#include <linux/pkt_cls.h>
 
 #include <argp.h>
 #include <array>
@@ -18,8 +23,10 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <endian.h>
 #include <fcntl.h>
 #include <format>
+#include <fstream>
 #include <git2/commit.h>
 #include <git2/errors.h>
 #include <git2/global.h>
@@ -30,11 +37,15 @@
 #include <git2/types.h>
 #include <initializer_list>
 #include <iostream> // NOLINT
+#include <iterator>
+#include <map>
 #include <optional>
 #include <signal.h> // NOLINT: otherwise kill() is not found
 #include <span>
+#include <sstream>
 #include <stdlib.h> // NOLINT
 #include <string>
+#include <string_view>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <thread>
@@ -43,6 +54,13 @@
 #include <utility>
 #include <vector>
 
+extern "C" {
+#include "core/hook.h"
+#include "core/list.h"
+#include "core/phase.h"
+#include "libbpfilter/bpfilter.h"
+}
+
 namespace benchmark
 {
 extern bool FLAGS_benchmark_list_tests;
@@ -70,13 +88,40 @@ using TimePoint = std::chrono::steady_clock::time_point;
 using time = std::chrono::steady_clock;
 using seconds = std::chrono::seconds;
 
-constexpr int CGROUP_DROP = 0;
-constexpr int CGROUP_ACCEPT = 1;
+namespace
+{
+// Ether(src=0x01, dst=0x02)
+// IP(src='127.2.10.10', dst='127.2.10.11')
+// TCP(sport=31337, dport=31415, flags='S')
+constexpr std::array<uint8_t, 54> pkt_ip4_tcp {
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x08, 0x00, 0x45, 0x00, 0x00, 0x28, 0x00, 0x01, 0x00, 0x00,
+    0x40, 0x06, 0x68, 0xb6, 0x7f, 0x02, 0x0a, 0x0a, 0x7f, 0x02, 0x0a,
+    0x0b, 0x7a, 0x69, 0x7a, 0xb7, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x50, 0x02, 0x20, 0x00, 0x88, 0xa8, 0x00, 0x00};
+
+// Ether(src=0x01, dst=0x02)
+// IP(src='127.2.10.10', dst='127.2.10.11')
+// UDP(sport=31337, dport=31415)
+constexpr std::array<uint8_t, 42> pkt_ip4_udp {
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x08, 0x00, 0x45, 0x00, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00,
+    0x40, 0x11, 0x68, 0xb7, 0x7f, 0x02, 0x0a, 0x0a, 0x7f, 0x02, 0x0a,
+    0x0b, 0x7a, 0x69, 0x7a, 0xb7, 0x00, 0x08, 0xf8, 0xa3};
+
+// Ether(src=0x01, dst=0x02)
+// IP(src='127.2.10.10', dst='127.2.10.11')
+// ICMP()
+constexpr std::array<uint8_t, 42> pkt_ip4_icmp {
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x08, 0x00, 0x45, 0x00, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00,
+    0x40, 0x01, 0x68, 0xc7, 0x7f, 0x02, 0x0a, 0x0a, 0x7f, 0x02, 0x0a,
+    0x0b, 0x08, 0x00, 0xf7, 0xff, 0x00, 0x00, 0x00, 0x00};
 
 // Ether(src=0x01, dst=0x02)
 // IPv6(src='::1', dst='::2')
 // TCP(sport=31337, dport=31415, flags='S')
-constexpr std::array<uint8_t, 80> pkt_local_ip6_tcp {
+constexpr std::array<uint8_t, 74> pkt_ip6_tcp {
     0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
     0x00, 0x86, 0xdd, 0x60, 0x00, 0x00, 0x00, 0x00, 0x14, 0x06, 0x40,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -85,14 +130,70 @@ constexpr std::array<uint8_t, 80> pkt_local_ip6_tcp {
     0x69, 0x7a, 0xb7, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
     0x50, 0x02, 0x20, 0x00, 0x9a, 0xbf, 0x00, 0x00};
 
+// Ether(src=0x01, dst=0x02)
+// IPv6(src='::1', dst='::2')
+// UDP(sport=31337, dport=31415)
+constexpr std::array<uint8_t, 62> pkt_ip6_udp {
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x86, 0xdd, 0x60, 0x00, 0x00, 0x00, 0x00, 0x08, 0x11, 0x40,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x7a,
+    0x69, 0x7a, 0xb7, 0x00, 0x08, 0x0a, 0xbb};
+
+// Ether(src=0x01, dst=0x02)
+// IPv6(src='::1', dst='::2')
+// ICMPv6EchoRequest()
+constexpr std::array<uint8_t, 62> pkt_ip6_icmp {
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x86, 0xdd, 0x60, 0x00, 0x00, 0x00, 0x00, 0x08, 0x3a, 0x40,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x80,
+    0x00, 0x7f, 0xba, 0x00, 0x00, 0x00, 0x00};
+} // namespace
+
+const std::vector<Hook> hooks {
+    {"xdp", "BF_HOOK_XDP", "ifindex=1", XDP_PASS, XDP_DROP, std::nullopt},
+    {"tc_ingress", "BF_HOOK_TC_INGRESS", "ifindex=1", TC_ACT_OK, TC_ACT_SHOT,
+     std::nullopt},
+    {"tc_egress", "BF_HOOK_TC_EGRESS", "ifindex=1", TC_ACT_OK, TC_ACT_SHOT,
+     std::nullopt},
+    {"nf_pre_routing", "BF_HOOK_NF_PRE_ROUTING", "", NF_ACCEPT, NF_DROP,
+     NF_INET_PRE_ROUTING},
+    {"nf_local_in", "BF_HOOK_NF_LOCAL_IN", "", NF_ACCEPT, NF_DROP,
+     NF_INET_LOCAL_IN},
+    {"nf_forward", "BF_HOOK_NF_FORWARD", "", NF_ACCEPT, NF_DROP,
+     NF_INET_FORWARD},
+    {"nf_local_out", "BF_HOOK_NF_LOCAL_OUT", "", NF_ACCEPT, NF_DROP,
+     NF_INET_LOCAL_OUT},
+    {"nf_post_routing", "BF_HOOK_NF_POST_ROUTING", "", NF_ACCEPT, NF_DROP,
+     NF_INET_POST_ROUTING},
+    {"cgroup_ingress", "BF_HOOK_CGROUP_INGRESS", "cgroup=/sys/fs/cgroup",
+     SK_PASS, SK_DROP, std::nullopt},
+    {"cgroup_egress", "BF_HOOK_CGROUP_EGRESS", "cgroup=/sys/fs/cgroup",
+     SK_PASS, SK_DROP, std::nullopt},
+};
+
+const std::vector<Packet> packets {
+    {"ip4_tcp", "ipv4", "tcp", NFPROTO_IPV4, pkt_ip4_tcp},
+    {"ip4_udp", "ipv4", "udp", NFPROTO_IPV4, pkt_ip4_udp},
+    {"ip4_icmp", "ipv4", "icmp", NFPROTO_IPV4, pkt_ip4_icmp},
+    {"ip6_tcp", "ipv6", "tcp", NFPROTO_IPV6, pkt_ip6_tcp},
+    {"ip6_udp", "ipv6", "udp", NFPROTO_IPV6, pkt_ip6_udp},
+    {"ip6_icmp", "ipv6", "icmpv6", NFPROTO_IPV6, pkt_ip6_icmp},
+};
+
 constexpr int progRunRepeat = 1000000;
+constexpr int pcapRunRepeat = 1000;
 
 Config config = {};
+::std::optional<Daemon> benchDaemon;
 
 namespace
 {
 constexpr int waitForDaemonTimeoutS = 5;
-constexpr int waitForDaemonSleepMs = 10;
+constexpr int waitForDaemonSleepMs = 1;
 constexpr int maxCommitHashLen = 7;
 
 enum
@@ -100,14 +201,25 @@ enum
     OPT_KEY_ADHOC,
     OPT_KEY_ADHOC_REPEAT,
     OPT_KEY_NO_DAEMON,
+    OPT_KEY_FILTER,
+    OPT_KEY_PCAP,
+    OPT_KEY_NFT,
+    OPT_KEY_CLI_EXEC,
 };
 
 const ::std::string help = "\v\
 --adhoc option is used to run an adhoc benchmark. When used, pre-defined \
 benchmarks will be skipped, and only the adhoc benchmark will be run. --adhoc \
-benchmarks won't create any output file.";
-
-constexpr std::array<struct argp_option, 8> options {{
+benchmarks won't create any output file.\n\n\
+Benchmarks are run for every hook and packet, and named \
+BENCHMARK/HOOK/PACKET (e.g. firstRuleDropCounter/xdp/ip4_tcp). Use --filter to \
+run a subset of the benchmarks, e.g. --filter '/(xdp|tc_ingress)/'.\n\n\
+--pcap option replays every packet of a pcap capture through the chain, for \
+each hook. The chain contains the --adhoc rules, if any. The per-packet \
+latency percentiles and the verdicts are reported as counters. Pre-defined \
+benchmarks are skipped, and no output file is created.";
+
+constexpr std::array<struct argp_option, 12> options {{
     {"cli", 'c', "CLI", 0,
      "Path to the bfcli binary. Defaults to 'bfcli' in $PATH.", 0},
     {"daemon", 'd', "DAEMON", 0,
@@ -125,6 +237,17 @@ constexpr std::array<struct argp_option, 8> options {{
     {"no-daemon", OPT_KEY_NO_DAEMON, NULL, OPTION_ARG_OPTIONAL,
      "If set, the benchmark will assume a daemon is already running and won't start one.",
      0},
+    {"filter", OPT_KEY_FILTER, "REGEX", 0,
+     "Only run the benchmarks matching REGEX. Defaults to all the benchmarks.",
+     0},
+    {"pcap", OPT_KEY_PCAP, "PCAP_FILE", 0,
+     "Replay the packets of PCAP_FILE, skip all the predefined benchmarks.", 0},
+    {"nft", OPT_KEY_NFT, "NFT", 0,
+     "Path to the nft binary built with bpfilter support, used by the nftables benchmarks. nftables benchmarks are skipped if not set.",
+     0},
+    {"cli-exec", OPT_KEY_CLI_EXEC, nullptr, 0,
+     "Send the chains of the control-plane benchmarks by running bfcli, instead of using libbpfilter from the benchmark's process. The measured latency includes bfcli's startup and parsing time.",
+     0},
     {nullptr},
 }};
 
@@ -148,6 +271,18 @@ int optsParser(int key, char *arg, struct ::argp_state *state)
     case OPT_KEY_NO_DAEMON:
         config->runDaemon = false;
         break;
+    case OPT_KEY_FILTER:
+        config->filter = ::std::string(arg);
+        break;
+    case OPT_KEY_PCAP:
+        config->pcap = ::std::string(arg);
+        break;
+    case OPT_KEY_NFT:
+        config->nft = ::std::string(arg);
+        break;
+    case OPT_KEY_CLI_EXEC:
+        config->cliExec = true;
+        break;
     case 'c':
         config->bfcli = ::std::string(arg);
         break;
@@ -284,6 +419,39 @@ run(::std::string bin, const ::std::vector<::std::string> &args)
     return {WEXITSTATUS(status), logOut ? *logOut : noLog,
             logErr ? *logErr : noLog};
 }
+/**
+ * Sum the "<name>_ns=<value>" pairs of @p out , indexed by name.
+ *
+ * If @p prefix is not empty, only the lines containing @p prefix are parsed.
+ */
+::std::map<::std::string, uint64_t> parseTimings(const ::std::string &out,
+                                                 ::std::string_view prefix = {})
+{
+    constexpr ::std::string_view suffix = "_ns";
+    ::std::map<::std::string, uint64_t> timings;
+    ::std::istringstream lines(out);
+    ::std::string line;
+
+    while (::std::getline(lines, line)) {
+        if (!prefix.empty() && line.find(prefix) == ::std::string::npos)
+            continue;
+
+        ::std::istringstream stream(line);
+        ::std::string token;
+
+        while (stream >> token) {
+            const auto sep = token.find('=');
+            if (sep == ::std::string::npos || sep < suffix.size() ||
+                token.compare(sep - suffix.size(), suffix.size(), suffix) != 0)
+                continue;
+
+            timings[token.substr(0, sep - suffix.size())] +=
+                ::std::strtoull(token.c_str() + sep + 1, nullptr, 10);
+        }
+    }
+
+    return timings;
+}
 } // namespace
 
 int setup(std::span<char *> args)
@@ -321,12 +489,26 @@ int setup(std::span<char *> args)
     ::benchmark::AddCustomContext("bpfilter", config.bpfilter);
     ::benchmark::AddCustomContext("srcdir", config.srcdir);
     ::benchmark::AddCustomContext("runDaemon", ::std::to_string(config.runDaemon));
+    ::benchmark::AddCustomContext("cliExec", ::std::to_string(config.cliExec));
 
-    if (config.adhoc) {
+    if (config.pcap) {
+        ::benchmark::AddCustomContext("pcap", *config.pcap);
+        if (config.adhoc) {
+            ::benchmark::AddCustomContext("adhoc", *config.adhoc);
+            ::benchmark::AddCustomContext("adhocRepeat", ::std::to_string(config.adhocRepeat));
+        }
+        ::benchmark::FLAGS_benchmark_filter = config.pcapBenchName;
+        if (config.filter)
+            ::benchmark::FLAGS_benchmark_filter += "/.*(" + *config.filter + ")";
+    } else if (config.adhoc) {
         ::benchmark::AddCustomContext("adhoc", *config.adhoc);
         ::benchmark::AddCustomContext("adhocRepeat", ::std::to_string(config.adhocRepeat));
         ::benchmark::FLAGS_benchmark_filter = config.adhocBenchName;
+        if (config.filter)
+            ::benchmark::FLAGS_benchmark_filter += "/.*(" + *config.filter + ")";
     } else {
+        if (config.filter)
+            ::benchmark::FLAGS_benchmark_filter = *config.filter;
         ::benchmark::AddCustomContext("outfile", config.outfile);
         ::benchmark::FLAGS_benchmark_out = config.outfile;
         ::benchmark::FLAGS_benchmark_out_format = "json";
@@ -436,6 +618,112 @@ bool Sources::isDirty() const
     return count != 0;
 }
 
+Capture::Capture(const ::std::string &path)
+{
+    constexpr uint32_t magicUs = 0xa1b2c3d4;
+    constexpr uint32_t magicNs = 0xa1b23c4d;
+    constexpr ::std::size_t hdrLen = 24;
+    constexpr ::std::size_t recHdrLen = 16;
+    constexpr ::std::size_t sllHdrLen = 16;
+
+    ::std::ifstream file(path, ::std::ios::binary);
+    if (!file)
+        abort("failed to open capture file '{}'", path);
+
+    const ::std::vector<uint8_t> buf {::std::istreambuf_iterator<char>(file),
+                                      ::std::istreambuf_iterator<char>()};
+    if (buf.size() < hdrLen)
+        abort("capture file '{}' is too small", path);
+
+    auto u32 = [&buf](::std::size_t offset, bool swapped) {
+        uint32_t value;
+        ::std::memcpy(&value, &buf[offset], sizeof(value));
+        return swapped ? __builtin_bswap32(value) : value;
+    };
+
+    bool swapped;
+    const uint32_t magic = u32(0, false);
+    if (magic == magicUs || magic == magicNs)
+        swapped = false;
+    else if (magic == __builtin_bswap32(magicUs) ||
+             magic == __builtin_bswap32(magicNs))
+        swapped = true;
+    else
+        abort("'{}' is not a pcap capture (pcapng is not supported)", path);
+
+    const uint32_t linktype = u32(20, swapped);
+
+    for (::std::size_t offset = hdrLen; buf.size() - offset >= recHdrLen;) {
+        const uint32_t inclLen = u32(offset + 8, swapped);
+        offset += recHdrLen;
+        if (inclLen > buf.size() - offset)
+            break;
+
+        ::std::span<const uint8_t> data(&buf[offset], inclLen);
+        offset += inclLen;
+
+        ::std::vector<uint8_t> pkt;
+        uint16_t ethertype = 0;
+
+        switch (linktype) {
+        case 1: // LINKTYPE_ETHERNET
+            if (data.size() >= ETH_HLEN)
+                ethertype = (uint16_t)(data[12] << 8 | data[13]);
+            break;
+        case 101: // LINKTYPE_RAW
+        case 228: // LINKTYPE_IPV4
+        case 229: // LINKTYPE_IPV6
+            if (data.empty())
+                continue;
+            if (data[0] >> 4 == 4)
+                ethertype = ETH_P_IP;
+            else if (data[0] >> 4 == 6)
+                ethertype = ETH_P_IPV6;
+            else
+                continue;
+            break;
+        case 113: // LINKTYPE_LINUX_SLL
+            if (data.size() < sllHdrLen)
+                continue;
+            ethertype =
+                (uint16_t)(data[sllHdrLen - 2] << 8 | data[sllHdrLen - 1]);
+            data = data.subspan(sllHdrLen);
+            break;
+        default:
+            abort("unsupported pcap link type {} in '{}'", linktype, path);
+        }
+
+        if (linktype != 1) {
+            pkt.resize(ETH_HLEN);
+            pkt[12] = ethertype >> 8;
+            pkt[13] = ethertype & 0xff;
+        }
+
+        pkt.insert(pkt.end(), data.begin(), data.end());
+        if (pkt.size() < ETH_HLEN)
+            continue;
+
+        data_.push_back(::std::move(pkt));
+        packets_.push_back({
+            .name = "pcap",
+            .l3Proto = "",
+            .l4Proto = "",
+            .family = ethertype == ETH_P_IP     ? (uint8_t)NFPROTO_IPV4 :
+                      ethertype == ETH_P_IPV6 ? (uint8_t)NFPROTO_IPV6 :
+                                                (uint8_t)NFPROTO_UNSPEC,
+            .data = data_.back(),
+        });
+    }
+
+    if (packets_.empty())
+        abort("no packet found in capture file '{}'", path);
+}
+
+const ::std::vector<Packet> &Capture::packets() const
+{
+    return packets_;
+}
+
 Fd::Fd(int fd):
     fd_ {fd}
 {}
@@ -542,6 +830,9 @@ Daemon::Daemon(Daemon &&other) noexcept(false)
     if (pid_)
         abort("calling ::bf::Daemon(::bf::Daemon &&) on an active daemon!");
 
+    path_ = ::std::move(other.path_);
+    options_ = ::std::move(other.options_);
+    startupTimings_ = ::std::move(other.startupTimings_);
     other.pid_.swap(pid_);
     stdoutFd_ = ::std::move(other.stdoutFd_);
     stderrFd_ = ::std::move(other.stderrFd_);
@@ -553,6 +844,9 @@ Daemon &Daemon::operator=(Daemon &&other) noexcept(false)
         abort(
             "calling ::bf::Daemon::operator=(::fd::Daemon &&) on an active daemon!");
 
+    path_ = ::std::move(other.path_);
+    options_ = ::std::move(other.options_);
+    startupTimings_ = ::std::move(other.startupTimings_);
     other.pid_.swap(pid_);
     stdoutFd_ = ::std::move(other.stdoutFd_);
     stderrFd_ = ::std::move(other.stderrFd_);
@@ -593,6 +887,7 @@ int Daemon::start()
     }
 
     const TimePoint begin = time::now();
+    ::std::string logs;
 
     while (true) {
         int status;
@@ -611,8 +906,9 @@ int Daemon::start()
         }
 
         auto data = readFd(stderrFd);
-        if (data &&
-            data->find("waiting for requests...") != ::std::string::npos)
+        if (data)
+            logs += *data;
+        if (logs.find("waiting for requests...") != ::std::string::npos)
             break;
 
         if (std::chrono::duration_cast<seconds>(time::now() - begin).count() >
@@ -632,6 +928,7 @@ int Daemon::start()
     pid_ = ::std::optional<int>(pid);
     stdoutFd_ = std::move(stdoutFd);
     stderrFd_ = std::move(stderrFd);
+    startupTimings_ = parseTimings(logs, "startup timings:");
 
     return 0;
 }
@@ -654,9 +951,39 @@ int Daemon::stop()
         return -errno;
     }
 
+    pid_.reset();
+    stdoutFd_.close();
+    stderrFd_.close();
+
     return 0;
 }
 
+int Daemon::restart()
+{
+    const int r = stop();
+    if (r < 0)
+        return r;
+
+    return start();
+}
+
+const ::std::map<::std::string, uint64_t> &Daemon::startupTimings() const
+{
+    return startupTimings_;
+}
+
+::std::map<::std::string, uint64_t> Daemon::requestTimings()
+{
+    const auto logs = readFd(stderrFd_);
+
+    return parseTimings(logs ? *logs : "", "request timings:");
+}
+
+Daemon::Options defaultDaemonOptions()
+{
+    return Daemon::Options().transient().noIptables().noNftables();
+}
+
 Program::Program(std::string name):
     name_ {::std::move(name)}
 {
@@ -706,10 +1033,57 @@ Program::~Program() noexcept(false)
     return prog_info.xlated_prog_len / sizeof(struct bpf_insn);
 }
 
-int Program::run(int expect, const std::span<const uint8_t> &pkt) const
+int Program::run(const Hook &hook, const Packet &pkt, int expect) const
 {
-    LIBBPF_OPTS(bpf_test_run_opts, opts, .data_in = (const void *)pkt.data(),
-                .data_size_in = (uint32_t)pkt.size(), .repeat = progRunRepeat);
+    uint32_t retval;
+    uint32_t duration;
+
+    const int r = testRun(hook, pkt, progRunRepeat, retval, duration);
+    if (r < 0)
+        return r;
+
+    if ((int)retval != expect) {
+        err("unexpected test run return value: {}", retval);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+int Program::testRun(const Hook &hook, const Packet &pkt, uint32_t repeat,
+                     uint32_t &retval, uint32_t &duration) const
+{
+    /* Context of the Netfilter programs, only the hook and the protocol
+     * family are used by BPF_PROG_RUN. */
+    struct
+    {
+        uint8_t hook;
+        uint8_t pf;
+        void *in;
+        void *out;
+        void *sk;
+        void *net;
+        void *okfn;
+    } nfCtx = {};
+    auto data = pkt.data;
+
+    LIBBPF_OPTS(bpf_test_run_opts, opts, .repeat = repeat);
+
+    if (hook.nfHook) {
+        nfCtx.hook = *hook.nfHook;
+        nfCtx.pf = pkt.family;
+        opts.ctx_in = &nfCtx;
+        opts.ctx_size_in = sizeof(nfCtx);
+
+        /* bpf_prog_test_run_nf() doesn't reset the network header for
+         * NF_INET_LOCAL_OUT: the data is expected to start with the network
+         * header. */
+        if (*hook.nfHook == NF_INET_LOCAL_OUT)
+            data = data.subspan(ETH_HLEN);
+    }
+
+    opts.data_in = (const void *)data.data();
+    opts.data_size_in = (uint32_t)data.size();
 
     const int r = bpf_prog_test_run_opts(fd_, &opts);
     if (r < 0) {
@@ -717,10 +1091,8 @@ int Program::run(int expect, const std::span<const uint8_t> &pkt) const
         return r;
     }
 
-    if (opts.retval != expect) {
-        err("unexpected test run return value: {}", opts.retval);
-        return -EINVAL;
-    }
+    retval = opts.retval;
+    duration = opts.duration;
 
     return 0;
 }
@@ -780,7 +1152,15 @@ int Program::open()
 
 Chain::Chain(::std::string bin, ::std::string name):
     bin_ {::std::move(bin)},
-    name_ {::std::move(name)}
+    name_ {::std::move(name)},
+    hookOpts_ {"cgroup=" + name_}
+{}
+
+Chain::Chain(::std::string bin, const Hook &hook, ::std::string name):
+    bin_ {::std::move(bin)},
+    name_ {::std::move(name)},
+    hook_ {hook.hook},
+    hookOpts_ {hook.opts}
 {}
 
 Chain::Chain(::std::initializer_list<::std::string> rules)
@@ -804,20 +1184,100 @@ Chain &Chain::repeat(const ::std::string &rule, ::std::size_t count)
 
 int Chain::apply()
 {
-    ::std::string chain = "chain BF_HOOK_CGROUP_INGRESS{cgroup=" + name_ +
-                          ",name=" + name_ + ",attach=no} policy DROP ";
+    ::std::string chain = header();
 
     for (const auto &rule: rules_)
         chain += rule + " ";
 
-    const ::std::vector<::std::string> args {"ruleset", "set", "--str", chain};
+    return send({"ruleset", "set"}, chain);
+}
+
+int Chain::insertRule(const ::std::string &rule, uint32_t handle, bool after)
+{
+    return send({"rule", "insert", after ? "--after" : "--before",
+                 ::std::to_string(handle)},
+                header() + rule);
+}
+
+int Chain::deleteRule(uint32_t handle)
+{
+    return send({"rule", "delete", "--handle", ::std::to_string(handle)},
+                header());
+}
+
+int Chain::replaceRule(uint32_t handle, const ::std::string &rule)
+{
+    return send({"rule", "replace", "--handle", ::std::to_string(handle)},
+                header() + rule);
+}
+
+int Chain::flush()
+{
+    const auto [r, out, err] = run(bin_, {"ruleset", "flush"});
+    if (r != 0)
+        abort("failed to flush the ruleset: {}\nError logs: {}", r, err);
+
+    timings_.clear();
+    if (benchDaemon)
+        (void)benchDaemon->requestTimings();
+
+    return 0;
+}
+
+::std::string Chain::header() const
+{
+    const ::std::string opts = hookOpts_.empty() ? "" : hookOpts_ + ",";
+
+    return "chain " + hook_ + "{" + opts + "name=" + name_ +
+           ",attach=no} policy DROP ";
+}
+
+int Chain::send(::std::vector<::std::string> args, const ::std::string &chain)
+{
+    /* Large chains can't be passed as a command line argument (which is
+     * limited to MAX_ARG_STRLEN), write them to a temporary file instead. */
+    constexpr ::std::size_t maxArgLen = 64 * 1024;
+    ::std::string path;
+
+    if (chain.size() > maxArgLen) {
+        char tmpl[] = "/tmp/bf_bench_chain_XXXXXX";
+        Fd fd(mkstemp(tmpl));
+        if (fd.get() < 0)
+            abort("failed to create temporary file: {}", errStr(errno));
+
+        path = tmpl;
+        if (write(fd.get(), chain.data(), chain.size()) !=
+            static_cast<ssize_t>(chain.size())) {
+            (void)unlink(path.c_str());
+            abort("failed to write chain to '{}'", path);
+        }
+
+        args.insert(args.end(), {"--file", path});
+    } else {
+        args.insert(args.end(), {"--str", chain});
+    }
+
+    args.emplace_back("--timings");
 
     const auto [r, out, err] = run(bin_, args);
+
+    if (!path.empty())
+        (void)unlink(path.c_str());
+
     if (r != 0) {
         abort("failed to exec '{}': {}\nError logs: {}", bin_, r, err);
         return r;
     }
 
+    /* bfcli prints the timings as "<phase>_ns=<value>" pairs, with one line
+     * per chain sent to the daemon: sum them up. */
+    timings_ = parseTimings(out);
+
+    /* The daemon logs each request it receives, drain its logs so the pipe
+     * doesn't fill up and block the daemon. */
+    if (benchDaemon)
+        (void)benchDaemon->requestTimings();
+
     return 0;
 }
 
@@ -826,4 +1286,350 @@ Program Chain::getProgram() const
     return {name_};
 }
 
+const ::std::map<::std::string, uint64_t> &Chain::timings() const
+{
+    return timings_;
+}
+
+Rule::Rule(enum bf_verdict verdict, bool counters)
+{
+    struct bf_rule *rule;
+
+    if (bf_rule_new(&rule) < 0)
+        abort("failed to create a new rule");
+
+    rule_.reset(rule);
+    rule_->verdict = verdict;
+    rule_->counters = counters;
+}
+
+Rule &Rule::match(enum bf_matcher_type type, enum bf_matcher_op op,
+                  const void *payload, ::std::size_t len)
+{
+    const int r = bf_rule_add_matcher(rule_.get(), type, op, payload, len);
+    if (r < 0)
+        abort("failed to add matcher to rule: {}", errStr(r));
+
+    return *this;
+}
+
+struct bf_rule *Rule::release()
+{
+    return rule_.release();
+}
+
+Set::Set(enum bf_set_type type)
+{
+    struct bf_set *set;
+
+    if (bf_set_new(&set, type) < 0)
+        abort("failed to create a new set");
+
+    set_.reset(set);
+}
+
+Set &Set::add(const void *elem)
+{
+    // bf_set_add_elem() copies the element, it's not modified.
+    const int r = bf_set_add_elem(set_.get(), const_cast<void *>(elem));
+    if (r < 0)
+        abort("failed to add element to set: {}", errStr(r));
+
+    return *this;
+}
+
+struct bf_set *Set::release()
+{
+    return set_.release();
+}
+
+LibChain::LibChain(const Hook &hook, ::std::string name):
+    hook_ {hook},
+    name_ {::std::move(name)},
+    chain_ {newChain()}
+{}
+
+LibChain &LibChain::operator<<(Rule rule)
+{
+    struct bf_rule *raw = rule.release();
+
+    const int r = bf_chain_add_rule(chain_.get(), raw);
+    if (r < 0) {
+        bf_rule_free(&raw);
+        abort("failed to add rule to chain: {}", errStr(r));
+    }
+
+    return *this;
+}
+
+uint32_t LibChain::addSet(Set set)
+{
+    struct bf_set *raw = set.release();
+    const auto index = static_cast<uint32_t>(bf_list_size(&chain_->sets));
+
+    const int r = bf_list_add_tail(&chain_->sets, raw);
+    if (r < 0) {
+        bf_set_free(&raw);
+        abort("failed to add set to chain: {}", errStr(r));
+    }
+
+    return index;
+}
+
+int LibChain::apply()
+{
+    ::std::array<uint64_t, _BF_PHASE_MAX> timings;
+
+    const int r =
+        bf_cli_set_chain_changed(chain_.get(), nullptr, timings.data());
+    if (r < 0)
+        abort("failed to apply chain: {}", errStr(r));
+
+    readTimings(timings);
+
+    return 0;
+}
+
+int LibChain::insertRule(Rule rule, uint32_t handle, bool after)
+{
+    auto patch = newChain();
+    struct bf_rule *raw = rule.release();
+
+    int r = bf_chain_add_rule(patch.get(), raw);
+    if (r < 0) {
+        bf_rule_free(&raw);
+        abort("failed to add rule to chain: {}", errStr(r));
+    }
+
+    ::std::array<uint64_t, _BF_PHASE_MAX> timings;
+
+    r = bf_cli_insert_rule(patch.get(), handle, after, nullptr,
+                           timings.data());
+    if (r < 0)
+        abort("failed to insert rule: {}", errStr(r));
+
+    readTimings(timings);
+
+    return 0;
+}
+
+int LibChain::deleteRule(uint32_t handle)
+{
+    ::std::array<uint64_t, _BF_PHASE_MAX> timings;
+
+    const int r = bf_cli_delete_rule(chain_.get(), handle, timings.data());
+    if (r < 0)
+        abort("failed to delete rule {}: {}", handle, errStr(r));
+
+    readTimings(timings);
+
+    return 0;
+}
+
+int LibChain::replaceRule(uint32_t handle, Rule rule)
+{
+    auto patch = newChain();
+    struct bf_rule *raw = rule.release();
+
+    int r = bf_chain_add_rule(patch.get(), raw);
+    if (r < 0) {
+        bf_rule_free(&raw);
+        abort("failed to add rule to chain: {}", errStr(r));
+    }
+
+    ::std::array<uint64_t, _BF_PHASE_MAX> timings;
+
+    r = bf_cli_replace_rule(patch.get(), handle, timings.data());
+    if (r < 0)
+        abort("failed to replace rule {}: {}", handle, errStr(r));
+
+    readTimings(timings);
+
+    return 0;
+}
+
+int LibChain::flush()
+{
+    const int r = bf_cli_ruleset_flush();
+    if (r < 0)
+        abort("failed to flush the ruleset: {}", errStr(r));
+
+    timings_.clear();
+    if (benchDaemon)
+        (void)benchDaemon->requestTimings();
+
+    return 0;
+}
+
+Program LibChain::getProgram() const
+{
+    return {name_};
+}
+
+const ::std::map<::std::string, uint64_t> &LibChain::timings() const
+{
+    return timings_;
+}
+
+CPtr<struct bf_chain, bf_chain_free> LibChain::newChain() const
+{
+    struct bf_chain *chain;
+    enum bf_hook hook;
+    // The options are owned by opts, not by the list.
+    const bf_list_ops rawOptsOps = {};
+    bf_list rawOpts;
+    int r;
+
+    if (bf_hook_from_str(hook_.hook.c_str(), &hook) < 0)
+        abort("unknown hook '{}'", hook_.hook);
+
+    r = bf_chain_new(&chain, hook, BF_VERDICT_DROP, nullptr, nullptr);
+    if (r < 0)
+        abort("failed to create a new chain: {}", errStr(r));
+
+    CPtr<struct bf_chain, bf_chain_free> owned(chain);
+
+    // Same options as the chains sent by bfcli, see Chain::header().
+    ::std::vector<::std::string> opts {"name=" + name_, "attach=no"};
+    if (!hook_.opts.empty())
+        opts.push_back(hook_.opts);
+
+    bf_list_init(&rawOpts, &rawOptsOps);
+    for (const auto &opt: opts) {
+        r = bf_list_add_tail(&rawOpts, const_cast<char *>(opt.c_str()));
+        if (r < 0) {
+            bf_list_clean(&rawOpts);
+            abort("failed to add hook option: {}", errStr(r));
+        }
+    }
+
+    r = bf_hook_opts_init(&owned->hook_opts, hook, &rawOpts);
+    bf_list_clean(&rawOpts);
+    if (r < 0)
+        abort("failed to parse hook options: {}", errStr(r));
+
+    return owned;
+}
+
+void LibChain::readTimings(
+    const ::std::array<uint64_t, _BF_PHASE_MAX> &timings)
+{
+    timings_.clear();
+    for (::std::size_t i = 0; i < timings.size(); ++i)
+        timings_[bf_phase_to_str(static_cast<enum bf_phase>(i))] = timings[i];
+
+    // The daemon logs each request, drain its logs, see Chain::send().
+    if (benchDaemon)
+        (void)benchDaemon->requestTimings();
+}
+
+IptTable::IptTable(::std::size_t nRules)
+{
+    constexpr ::std::array<int, 3> nfHooks {NF_INET_LOCAL_IN, NF_INET_FORWARD,
+                                            NF_INET_LOCAL_OUT};
+    constexpr ::std::size_t ruleSize =
+        sizeof(struct ipt_entry) + XT_ALIGN(sizeof(struct xt_standard_target));
+    constexpr ::std::size_t errorSize =
+        sizeof(struct ipt_entry) + XT_ALIGN(sizeof(struct xt_error_target));
+
+    // INPUT rules, one policy per chain, and the final ERROR entry.
+    const ::std::size_t size = (nRules + nfHooks.size()) * ruleSize + errorSize;
+
+    replace_.resize(sizeof(struct ipt_replace) + size);
+
+    auto *replace = reinterpret_cast<struct ipt_replace *>(replace_.data());
+    ::std::strncpy(replace->name, "filter", sizeof(replace->name) - 1);
+    replace->num_entries = nRules + nfHooks.size() + 1;
+    replace->num_counters = replace->num_entries;
+    replace->size = size;
+
+    auto *entries = reinterpret_cast<uint8_t *>(replace->entries);
+    ::std::size_t offset = 0;
+
+    auto addRule = [&](uint32_t saddr, int verdict) {
+        auto *entry = reinterpret_cast<struct ipt_entry *>(&entries[offset]);
+        auto *target = reinterpret_cast<struct xt_standard_target *>(
+            &entries[offset + sizeof(*entry)]);
+
+        if (saddr) {
+            entry->ip.src.s_addr = htobe32(saddr);
+            entry->ip.smsk.s_addr = 0xffffffff;
+        }
+        entry->target_offset = sizeof(*entry);
+        entry->next_offset = ruleSize;
+        target->target.u.user.target_size =
+            XT_ALIGN(sizeof(struct xt_standard_target));
+        target->verdict = -verdict - 1;
+
+        offset += ruleSize;
+    };
+
+    for (const int hook: nfHooks) {
+        replace->valid_hooks |= 1 << hook;
+        replace->hook_entry[hook] = offset;
+
+        if (hook == NF_INET_LOCAL_IN) {
+            // 10.0.0.0/8 addresses, which shouldn't match any local traffic
+            for (::std::size_t i = 0; i < nRules; ++i)
+                addRule(0x0a000001 + i, NF_ACCEPT);
+        }
+
+        replace->underflow[hook] = offset;
+        addRule(0, NF_ACCEPT);
+    }
+
+    auto *entry = reinterpret_cast<struct ipt_entry *>(&entries[offset]);
+    auto *target = reinterpret_cast<struct xt_error_target *>(
+        &entries[offset + sizeof(*entry)]);
+    entry->target_offset = sizeof(*entry);
+    entry->next_offset = errorSize;
+    target->target.u.user.target_size =
+        XT_ALIGN(sizeof(struct xt_error_target));
+    ::std::strncpy(target->target.u.user.name, XT_ERROR_TARGET,
+                   sizeof(target->target.u.user.name) - 1);
+    ::std::strncpy(target->errorname, XT_ERROR_TARGET,
+                   sizeof(target->errorname) - 1);
+}
+
+int IptTable::restore()
+{
+    // The daemon sends the ipt_replace structure back, don't modify ours.
+    ::std::vector<uint8_t> replace = replace_;
+
+    const int r =
+        bf_ipt_replace(reinterpret_cast<struct ipt_replace *>(replace.data()));
+    if (r < 0) {
+        err("failed to restore iptables ruleset: {}", errStr(r));
+        return r;
+    }
+
+    return 0;
+}
+
+NftChain::NftChain(::std::string bin):
+    bin_ {::std::move(bin)}
+{
+    if (send("add table ip bpfilter") < 0 ||
+        send("add chain ip bpfilter prerouting { type filter hook prerouting "
+             "priority 0; policy accept; }") < 0)
+        abort("failed to create the nftables chain");
+}
+
+int NftChain::addRule(const ::std::string &rule)
+{
+    return send("add rule ip bpfilter prerouting " + rule);
+}
+
+int NftChain::send(const ::std::string &cmd)
+{
+    const auto [r, out, errLogs] = run(bin_, {"--bpf", cmd});
+    if (r != 0) {
+        err("failed to run '{} --bpf {}': {}\nError logs: {}", bin_, cmd, r,
+            errLogs);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
 } // namespace bf
@@ -11,31 +11,83 @@
 #include <git2/types.h>
 #include <initializer_list>
 #include <iostream> // NOLINT: used by the logging macros
+#include <map>
+#include <memory>
 #include <optional>
 #include <span>
 #include <string>
 #include <sys/types.h> // NOLINT: for pid_t
 #include <vector>
 
+extern "C" {
+#include "core/chain.h"
+#include "core/matcher.h"
+#include "core/phase.h"
+#include "core/rule.h"
+#include "core/set.h"
+#include "core/verdict.h"
+}
+
 #pragma once
 
 namespace bf
 {
 
-extern const int CGROUP_DROP;
-extern const int CGROUP_ACCEPT;
-
 /**
- * Dummy network packet, created using Python's @c scapy and the following
- * definition:
+ * Hook to benchmark a chain on.
  *
- *  Ether(src=0x01, dst=0x02)/
- *  IPv6(src='::1', dst='::2')/
- *  TCP(sport=31337, dport=31415, flags='S')
+ * Each program flavor has its own return values and prologue: benchmarks are
+ * run on every hook, so the programs generated for each flavor can be
+ * compared.
+ */
+struct Hook
+{
+    /// Short name of the hook, used in the benchmarks name and label.
+    ::std::string name;
+    /// Name of the hook, as expected by @c bfcli .
+    ::std::string hook;
+    /// Hook options required by the hook, in @c bfcli format.
+    ::std::string opts;
+    /// Value returned by the program to accept the packet.
+    int accept;
+    /// Value returned by the program to drop the packet.
+    int drop;
+    /// Netfilter hook (@c NF_INET_* ), only defined for Netfilter hooks.
+    ::std::optional<uint8_t> nfHook;
+};
+
+/**
+ * Hooks the benchmarks are run on.
+ */
+extern const ::std::vector<Hook> hooks;
+
+/**
+ * Dummy network packet, created using Python's @c scapy .
  *
- * This packet defines an Ethernet, IPv6, and TCP header.
+ * All the packets have an Ethernet header ( @c Ether(src=0x01,dst=0x02) ),
+ * and an IPv4 ( @c IP(src='127.2.10.10',dst='127.2.10.11') ) or IPv6
+ * ( @c IPv6(src='::1',dst='::2') ) header. TCP and UDP packets go from port
+ * 31337 to port 31415, TCP packets have the @c SYN flag set. ICMP packets are
+ * echo requests.
  */
-extern const std::array<uint8_t, 80> pkt_local_ip6_tcp;
+struct Packet
+{
+    /// Short name of the packet, used in the benchmarks name and label.
+    ::std::string name;
+    /// L3 protocol of the packet, as expected by @c meta.l3_proto .
+    ::std::string l3Proto;
+    /// L4 protocol of the packet, as expected by @c meta.l4_proto .
+    ::std::string l4Proto;
+    /// Netfilter protocol family of the packet (@c NFPROTO_* ).
+    uint8_t family;
+    /// Raw packet, starting with the Ethernet header.
+    ::std::span<const uint8_t> data;
+};
+
+/**
+ * Packets the benchmarks are run with.
+ */
+extern const ::std::vector<Packet> packets;
 
 /**
  * Number of iterations to run the program for.
@@ -52,6 +104,15 @@ extern const std::array<uint8_t, 80> pkt_local_ip6_tcp;
  */
 extern const int progRunRepeat;
 
+/**
+ * Number of iterations to run the program for, for each packet of a capture.
+ *
+ * Captures can contain many packets: running each packet @c progRunRepeat
+ * times would take too long. The duration reported by @c BPF_PROG_TEST_RUN
+ * is averaged over @c pcapRunRepeat runs of the packet.
+ */
+extern const int pcapRunRepeat;
+
 #define abort(fmt, ...)                                                        \
     throw ::std::runtime_error(::std::format(fmt, ##__VA_ARGS__))
 
@@ -81,10 +142,15 @@ public:
     ::std::string outfile = "results.json";
     ::std::string gitrev = "<unknown>";
     ::std::optional<::std::string> adhoc;
+    ::std::optional<::std::string> filter;
+    ::std::optional<::std::string> pcap;
+    ::std::optional<::std::string> nft;
     int adhocRepeat = 1;
     const ::std::string adhocBenchName = "bf_adhoc";
+    const ::std::string pcapBenchName = "bf_pcap";
     int64_t gitdate = 0;
     bool runDaemon = true;
+    bool cliExec = false;
 
     Config() noexcept = default;
 };
@@ -114,6 +180,30 @@ private:
     git_repository *repo_ = nullptr;
 };
 
+/**
+ * Packets read from a pcap capture file.
+ *
+ * Only the classic pcap format is supported (not pcapng). Packets captured
+ * without an Ethernet header (raw IP or Linux cooked captures) get a
+ * synthetic Ethernet header, as the programs expect one.
+ */
+class Capture
+{
+public:
+    Capture(const ::std::string &path);
+    Capture(Capture &other) = delete;
+    Capture(Capture &&other) = delete;
+
+    Capture &operator=(Capture &other) = delete;
+    Capture &operator=(Capture &&other) = delete;
+
+    [[nodiscard]] const ::std::vector<Packet> &packets() const;
+
+private:
+    ::std::vector<::std::vector<uint8_t>> data_;
+    ::std::vector<Packet> packets_;
+};
+
 class Fd
 {
 public:
@@ -158,17 +248,56 @@ public:
     Daemon &operator=(Daemon &other) = delete;
     Daemon &operator=(Daemon &&other) noexcept(false);
 
+    /**
+     * Stop the daemon, and start it again with the same options.
+     *
+     * Unless the daemon is transient, it restores its runtime context from
+     * the filesystem when it starts.
+     */
+    [[nodiscard]] int restart();
+
+    /**
+     * Time spent by the daemon to start, in nanoseconds, indexed by step
+     * name ("restore" and "total"), as logged by the daemon.
+     */
+    [[nodiscard]] const ::std::map<::std::string, uint64_t> &
+    startupTimings() const;
+
+    /**
+     * Time spent by the daemon in each control-plane phase to process the
+     * requests received since the last call, in nanoseconds, indexed by
+     * phase name. The timings are read from the daemon's logs, so they are
+     * available for every front-end, but only if the daemon has been started
+     * with @c --verbose debug .
+     */
+    [[nodiscard]] ::std::map<::std::string, uint64_t> requestTimings();
+
 private:
     ::std::string path_;
     Options options_;
     std::optional<pid_t> pid_;
     Fd stdoutFd_;
     Fd stderrFd_;
+    ::std::map<::std::string, uint64_t> startupTimings_;
 
     [[nodiscard]] int start();
     int stop();
 };
 
+/**
+ * Options of the daemon started by the benchmark binary.
+ */
+Daemon::Options defaultDaemonOptions();
+
+/**
+ * Daemon started by the benchmark binary, unset if @c --no-daemon is used.
+ *
+ * Benchmarks requiring a daemon with different options (e.g. with the
+ * @c iptables front-end enabled) can stop it and start their own daemon,
+ * then restore it.
+ */
+extern ::std::optional<Daemon> benchDaemon;
+
 class Program
 {
 public:
@@ -181,8 +310,30 @@ public:
     Program &operator=(Program &&other) noexcept(false);
 
     [[nodiscard]] ::std::size_t nInsn() const;
-    [[nodiscard]] int run(int expect,
-                          const std::span<const uint8_t> &pkt) const;
+
+    /**
+     * Run the program @c progRunRepeat times with @p pkt .
+     *
+     * @p hook defines the context to run the program with: Netfilter
+     * programs require a context, see @c bpf_prog_test_run_nf() .
+     *
+     * @return 0 if the program returned @p expect , or a negative errno value
+     *         otherwise.
+     */
+    [[nodiscard]] int run(const Hook &hook, const Packet &pkt,
+                          int expect) const;
+
+    /**
+     * Run the program @p repeat times with @p pkt .
+     *
+     * @param retval On success, contains the value returned by the program.
+     * @param duration On success, contains the average duration of a run of
+     *        the program, in nanoseconds.
+     * @return 0 on success, or a negative errno value on failure.
+     */
+    [[nodiscard]] int testRun(const Hook &hook, const Packet &pkt,
+                              uint32_t repeat, uint32_t &retval,
+                              uint32_t &duration) const;
     int close();
 
 private:
@@ -196,17 +347,231 @@ class Chain
 {
 public:
     Chain(::std::string bin = "bfcli", ::std::string name = "bf_bench");
+    Chain(::std::string bin, const Hook &hook,
+          ::std::string name = "bf_bench");
     Chain(::std::initializer_list<::std::string> rules);
 
     Chain &operator<<(const ::std::string &rule);
     Chain &repeat(const ::std::string &rule, ::std::size_t count);
     int apply();
+
+    /**
+     * Insert a single rule into the chain applied to the daemon.
+     *
+     * Rules are identified by their handle: rules of the chain are numbered
+     * from 1 when the chain is applied, and inserted rules get the next
+     * available handle. Use a handle of 0 to append the rule.
+     */
+    int insertRule(const ::std::string &rule, uint32_t handle,
+                   bool after = false);
+    int deleteRule(uint32_t handle);
+    int replaceRule(uint32_t handle, const ::std::string &rule);
+
+    /**
+     * Flush the ruleset: remove every chain defined with @c bfcli , not only
+     * this one.
+     */
+    int flush();
     [[nodiscard]] Program getProgram() const;
 
+    /**
+     * Time spent by the daemon in each control-plane phase to process the
+     * last request, in nanoseconds, indexed by phase name.
+     */
+    [[nodiscard]] const ::std::map<::std::string, uint64_t> &timings() const;
+
 private:
     ::std::string bin_;
     ::std::string name_;
+    ::std::string hook_ = "BF_HOOK_CGROUP_INGRESS";
+    ::std::string hookOpts_;
     ::std::vector<::std::string> rules_;
+    ::std::map<::std::string, uint64_t> timings_;
+
+    [[nodiscard]] ::std::string header() const;
+    int send(::std::vector<::std::string> args, const ::std::string &chain);
+};
+
+/**
+ * Deleter for objects allocated by @c bpfilter 's core library, which are
+ * freed with a @c bf_xxx_free(T **) function.
+ */
+template<typename T, void (*Free)(T **)>
+struct CDeleter
+{
+    void operator()(T *ptr) const
+    {
+        Free(&ptr);
+    }
+};
+
+template<typename T, void (*Free)(T **)>
+using CPtr = ::std::unique_ptr<T, CDeleter<T, Free>>;
+
+/**
+ * Rule, built programmatically instead of parsed by @c bfcli .
+ */
+class Rule
+{
+public:
+    Rule(enum bf_verdict verdict = BF_VERDICT_ACCEPT, bool counters = false);
+
+    /**
+     * Add a matcher to the rule.
+     *
+     * @param payload Payload of the matcher, in the format expected by the
+     *        daemon for @p type (e.g. a @c uint16_t for a port, or a
+     *        @c uint32_t set index for the @c in operator).
+     */
+    Rule &match(enum bf_matcher_type type, enum bf_matcher_op op,
+                const void *payload, ::std::size_t len);
+
+    template<typename T>
+    Rule &match(enum bf_matcher_type type, enum bf_matcher_op op,
+                const T &payload)
+    {
+        return match(type, op, &payload, sizeof(payload));
+    }
+
+    /**
+     * Release the ownership of the underlying @c bf_rule .
+     */
+    [[nodiscard]] struct bf_rule *release();
+
+private:
+    CPtr<struct bf_rule, bf_rule_free> rule_;
+};
+
+/**
+ * Set, built programmatically instead of parsed by @c bfcli .
+ */
+class Set
+{
+public:
+    Set(enum bf_set_type type);
+
+    /**
+     * Add an element to the set. @p elem must be the size of the set's
+     * elements (e.g. 4 bytes for @c BF_SET_IP4 ), in network byte order.
+     */
+    Set &add(const void *elem);
+
+    [[nodiscard]] struct bf_set *release();
+
+private:
+    CPtr<struct bf_set, bf_set_free> set_;
+};
+
+/**
+ * Chain built programmatically, and sent to the daemon using @c libbpfilter
+ * from the benchmark's process.
+ *
+ * Unlike @c Chain , the requests don't include the time required to start
+ * @c bfcli and parse the chain, so the measured latency is the latency of
+ * the daemon (and of the communication with it). The chain is defined with
+ * the same hook options and name as @c Chain .
+ */
+class LibChain
+{
+public:
+    LibChain(const Hook &hook, ::std::string name = "bf_bench");
+
+    LibChain &operator<<(Rule rule);
+
+    /**
+     * Add a set to the chain.
+     *
+     * @return Index of the set, to be used as the payload of the matchers
+     *         using the @c in operator.
+     */
+    uint32_t addSet(Set set);
+
+    int apply();
+
+    /**
+     * Insert, delete, or replace a single rule of the chain applied to the
+     * daemon, see @c Chain::insertRule .
+     */
+    int insertRule(Rule rule, uint32_t handle, bool after = false);
+    int deleteRule(uint32_t handle);
+    int replaceRule(uint32_t handle, Rule rule);
+
+    /**
+     * Flush the ruleset: remove every chain, not only this one.
+     */
+    int flush();
+    [[nodiscard]] Program getProgram() const;
+
+    /**
+     * Time spent by the daemon in each control-plane phase to process the
+     * last request, in nanoseconds, indexed by phase name.
+     */
+    [[nodiscard]] const ::std::map<::std::string, uint64_t> &timings() const;
+
+private:
+    Hook hook_;
+    ::std::string name_;
+    CPtr<struct bf_chain, bf_chain_free> chain_;
+    ::std::map<::std::string, uint64_t> timings_;
+
+    [[nodiscard]] CPtr<struct bf_chain, bf_chain_free> newChain() const;
+    void readTimings(const ::std::array<uint64_t, _BF_PHASE_MAX> &timings);
+};
+
+/**
+ * iptables @c filter table, sent to the daemon as @c iptables-restore would.
+ *
+ * @c iptables-restore replaces a whole table at once: this class generates
+ * the @c ipt_replace structure of a table containing @c INPUT rules matching
+ * different source IPv4 addresses, and sends it to the daemon using
+ * @c libbpfilter , as the @c iptables binary built with @c bpfilter support
+ * would.
+ */
+class IptTable
+{
+public:
+    IptTable(::std::size_t nRules);
+
+    /**
+     * Send the table to the daemon.
+     *
+     * @return 0 on success, or a negative errno value on failure.
+     */
+    int restore();
+
+private:
+    ::std::vector<uint8_t> replace_;
+};
+
+/**
+ * nftables chain, created using the @c nft binary built with @c bpfilter
+ * support.
+ *
+ * The chain is "prerouting", in the table "bpfilter", as required by the
+ * @c nftables front-end.
+ */
+class NftChain
+{
+public:
+    /**
+     * Create the table and the chain, with an ACCEPT policy.
+     *
+     * @param bin Path to the @c nft binary.
+     */
+    NftChain(::std::string bin);
+
+    /**
+     * Append a rule to the chain.
+     *
+     * @param rule Rule, in @c nft format (e.g. "ip saddr 10.0.0.1 accept").
+     * @return 0 on success, or a negative errno value on failure.
+     */
+    int addRule(const ::std::string &rule);
+
+private:
+    ::std::string bin_;
+
+    int send(const ::std::string &cmd);
 };
 
 } // namespace bf
@@ -3,40 +3,69 @@
  * Copyright (c) 2023 Meta Platforms, Inc. and affiliates.
  */
 
+#include <linux/netfilter.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <benchmark/benchmark.h>
+#include <chrono>
 #include <cerrno>
 #include <cstring>
+#include <endian.h>
 #include <exception>
 #include <format>
+#include <functional>
+#include <latch>
+#include <map>
+#include <optional>
+#include <pthread.h>
+#include <sched.h>
 #include <span>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <unistd.h>
+#include <utility>
+#include <vector>
 
 #include "benchmark.hpp"
 
 namespace
 {
 
-void firstRuleDropCounter(::benchmark::State &state)
+/**
+ * Label the benchmark with the hook and the packet it runs with, so they can
+ * be filtered in the results.
+ */
+void setLabel(::benchmark::State &state, const ::bf::Hook &hook,
+              const ::bf::Packet &pkt)
+{
+    state.SetLabel(std::format("hook={} pkt={}", hook.name, pkt.name));
+}
+
+void firstRuleDropCounter(::benchmark::State &state, const ::bf::Hook &hook,
+                          const ::bf::Packet &pkt)
 {
-    ::bf::Chain chain(::bf::config.bfcli);
-    chain << "rule meta.l3_proto ipv6 counter DROP";
+    ::bf::Chain chain(::bf::config.bfcli, hook);
+    chain << std::format("rule meta.l3_proto {} counter DROP", pkt.l3Proto);
     chain.apply();
     auto prog = chain.getProgram();
 
     benchLoop(state)
     {
-        if (prog.run(::bf::CGROUP_DROP, ::bf::pkt_local_ip6_tcp) < 0)
+        if (prog.run(hook, pkt, hook.drop) < 0)
             state.SkipWithError("benchmark run failed");
     }
 
+    setLabel(state, hook, pkt);
     state.counters["nInsn"] = prog.nInsn();
 }
 
-BENCHMARK(firstRuleDropCounter);
-
-void dropAfterXRules(::benchmark::State &state)
+void dropAfterXRules(::benchmark::State &state, const ::bf::Hook &hook,
+                     const ::bf::Packet &pkt)
 {
-    ::bf::Chain chain(::bf::config.bfcli);
+    ::bf::Chain chain(::bf::config.bfcli, hook);
 
     for (int i = 0; i < state.range(0); ++i)
         chain << std::format("rule meta.dport {} counter ACCEPT", i + 1);
@@ -46,37 +75,801 @@ void dropAfterXRules(::benchmark::State &state)
 
     benchLoop(state)
     {
-        if (prog.run(::bf::CGROUP_DROP, ::bf::pkt_local_ip6_tcp) < 0)
+        if (prog.run(hook, pkt, hook.drop) < 0)
             state.SkipWithError("benchmark run failed");
     }
 
+    setLabel(state, hook, pkt);
     state.counters["nInsn"] = prog.nInsn();
 }
 
-BENCHMARK(dropAfterXRules)
-    ->Arg(8)
-    ->Arg(32)
-    ->Arg(128)
-    ->Arg(512)
-    ->Arg(2048);
-} // namespace
+/**
+ * CPUs the benchmark is allowed to run on.
+ */
+std::vector<int> allowedCpus()
+{
+    std::vector<int> cpus;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) < 0)
+        return cpus;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+    }
+
+    return cpus;
+}
+
+/**
+ * Run @p prog with @p pkt from @c state.range(0) threads concurrently.
+ *
+ * Each thread is pinned to a different CPU, and runs the program
+ * @c progRunRepeat times per iteration. The iteration time is the time
+ * required by every thread to complete, so the benchmark must use
+ * @c UseManualTime() . The aggregate throughput is reported as "Mpps", and
+ * the average time spent by a thread to process a packet (as measured by
+ * the kernel) as "nsPerPkt", with the slowest thread as "nsPerPktMax".
+ */
+void runConcurrently(::benchmark::State &state, const ::bf::Program &prog,
+                     const ::bf::Hook &hook, const ::bf::Packet &pkt)
+{
+    const auto nThreads = static_cast<std::size_t>(state.range(0));
+    const auto cpus = allowedCpus();
+    double sumNs = 0;
+    double maxNs = 0;
+
+    if (cpus.size() < nThreads) {
+        state.SkipWithError("not enough CPUs to run the threads");
+        return;
+    }
+
+    for (auto _: state) {
+        std::vector<std::thread> threads;
+        std::vector<uint32_t> durations(nThreads);
+        std::atomic<bool> failed = false;
+        std::latch ready(static_cast<std::ptrdiff_t>(nThreads));
+        std::latch start(1);
+
+        for (std::size_t i = 0; i < nThreads; ++i) {
+            threads.emplace_back([&, i]() {
+                cpu_set_t set;
+                uint32_t retval;
+
+                CPU_ZERO(&set);
+                CPU_SET(cpus[i], &set);
+                if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+                    failed = true;
+
+                ready.count_down();
+                start.wait();
+
+                if (prog.testRun(hook, pkt, ::bf::progRunRepeat, retval,
+                                 durations[i]) < 0 ||
+                    (int)retval != hook.drop)
+                    failed = true;
+            });
+        }
+
+        ready.wait();
+        const auto begin = std::chrono::steady_clock::now();
+        start.count_down();
+
+        for (auto &thread: threads)
+            thread.join();
+
+        state.SetIterationTime(std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - begin)
+                                   .count());
+
+        if (failed) {
+            state.SkipWithError("benchmark run failed");
+            return;
+        }
+
+        for (const auto duration: durations) {
+            sumNs += duration;
+            maxNs = std::max(maxNs, static_cast<double>(duration));
+        }
+    }
+
+    setLabel(state, hook, pkt);
+    state.counters["nInsn"] = prog.nInsn();
+    state.counters["nThreads"] = static_cast<double>(nThreads);
+    state.counters["Mpps"] = ::benchmark::Counter(
+        static_cast<double>(nThreads) * ::bf::progRunRepeat / 1e6,
+        ::benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["nsPerPkt"] =
+        sumNs / static_cast<double>(state.iterations() * nThreads);
+    state.counters["nsPerPktMax"] = maxNs;
+}
+
+/**
+ * Run a chain updating the same counters for every packet from multiple
+ * threads, to expose the contention on the counters map.
+ *
+ * The packet matches every rule, each rule has a counter and continues to
+ * the next rule, the packet is dropped by the chain's policy.
+ */
+void contendedCounters(::benchmark::State &state, const ::bf::Hook &hook,
+                       const ::bf::Packet &pkt)
+{
+    ::bf::Chain chain(::bf::config.bfcli, hook);
+    chain.repeat(
+        std::format("rule meta.l3_proto {} counter CONTINUE", pkt.l3Proto),
+        16);
+    chain.apply();
+
+    runConcurrently(state, chain.getProgram(), hook, pkt);
+}
+
+/**
+ * Run a chain looking up the packet's source address in a set from multiple
+ * threads, to expose the contention on the set maps.
+ *
+ * The set contains 1024 addresses, including the packet's source address:
+ * the packet is dropped by the rule.
+ */
+void contendedSetLookup(::benchmark::State &state, const ::bf::Hook &hook,
+                        const ::bf::Packet &pkt)
+{
+    ::bf::Chain chain(::bf::config.bfcli, hook);
+    std::string set = "127.2.10.10";
+
+    for (int i = 1; i < 1024; ++i)
+        set += std::format(",10.0.{}.{}", i >> 8, i & 0xff);
+
+    chain << std::format("rule ip4.saddr in {{{}}} DROP", set);
+    chain.apply();
+
+    runConcurrently(state, chain.getProgram(), hook, pkt);
+}
+
+/**
+ * Accumulate per-phase timings in nanoseconds, as returned by the daemon for
+ * a request, into @p timings .
+ */
+void addTimings(std::map<std::string, double> &timings,
+                const std::map<std::string, uint64_t> &phases)
+{
+    for (const auto &[phase, ns]: phases)
+        timings[phase] += static_cast<double>(ns);
+}
+
+/**
+ * Replace the benchmark's daemon with a daemon started with different
+ * options, for the lifetime of the object. The default daemon is restarted
+ * on destruction.
+ */
+class DaemonOverride
+{
+public:
+    DaemonOverride(const ::bf::Daemon::Options &options)
+    {
+        ::bf::benchDaemon.reset();
+        ::bf::benchDaemon.emplace(::bf::config.bpfilter, options);
+    }
+
+    DaemonOverride(const DaemonOverride &other) = delete;
+    DaemonOverride &operator=(const DaemonOverride &other) = delete;
+
+    ~DaemonOverride() noexcept(false)
+    {
+        ::bf::benchDaemon.reset();
+        ::bf::benchDaemon.emplace(::bf::config.bpfilter,
+                                  ::bf::defaultDaemonOptions());
+    }
+
+    ::bf::Daemon &daemon()
+    {
+        return *::bf::benchDaemon;
+    }
+};
+
+/**
+ * Report the accumulated per-phase timings as per-iteration counters, in
+ * milliseconds, named "<phase>Ms".
+ */
+void reportTimings(::benchmark::State &state,
+                   const std::map<std::string, double> &timings)
+{
+    for (const auto &[phase, ns]: timings) {
+        state.counters[phase + "Ms"] = ::benchmark::Counter(
+            ns / 1e6, ::benchmark::Counter::kAvgIterations);
+    }
+}
+
+/**
+ * Create a chain for the control-plane benchmarks.
+ *
+ * @c Chain sends the chain by running @c bfcli , @c LibChain uses
+ * @c libbpfilter from the benchmark's process.
+ */
+template<typename C>
+C newChain(const ::bf::Hook &hook)
+{
+    if constexpr (std::is_same_v<C, ::bf::Chain>)
+        return ::bf::Chain(::bf::config.bfcli, hook);
+    else
+        return C(hook);
+}
+
+/**
+ * Rule accepting the packets with the destination port @p port , in the
+ * format expected by @p chain .
+ */
+std::string dportRule(const ::bf::Chain & /* chain */, uint16_t port)
+{
+    return std::format("rule meta.dport {} ACCEPT", port);
+}
+
+::bf::Rule dportRule(const ::bf::LibChain & /* chain */, uint16_t port)
+{
+    return std::move(::bf::Rule(BF_VERDICT_ACCEPT)
+                         .match(BF_MATCHER_META_DPORT, BF_MATCHER_EQ, port));
+}
+
+/**
+ * Add a rule accepting the packets with a source address in a set of
+ * @p nElems IPv4 addresses (10.0.0.0/8) to @p chain .
+ */
+void addSetRule(::bf::Chain &chain, int64_t nElems)
+{
+    std::string set;
+
+    for (int64_t i = 0; i < nElems; ++i) {
+        set += std::format("{}10.{}.{}.{}", i ? "," : "", (i >> 16) & 0xff,
+                           (i >> 8) & 0xff, i & 0xff);
+    }
+
+    chain << std::format("rule ip4.saddr in {{{}}} ACCEPT", set);
+}
+
+void addSetRule(::bf::LibChain &chain, int64_t nElems)
+{
+    ::bf::Set set(BF_SET_IP4);
+
+    for (int64_t i = 0; i < nElems; ++i) {
+        const uint32_t addr = htobe32(0x0a000000 | (i & 0xffffff));
+        set.add(&addr);
+    }
+
+    const uint32_t index = chain.addSet(std::move(set));
+    chain << std::move(::bf::Rule(BF_VERDICT_ACCEPT)
+                           .match(BF_MATCHER_IP4_SRC_ADDR, BF_MATCHER_IN,
+                                  index));
+}
+
+/**
+ * Measure the latency of updating a single rule of a large chain.
+ *
+ * The first rule of the chain is replaced using a rule patch request, the
+ * rest of the chain is unchanged. The rule's port alternates on each
+ * iteration, so each request is an actual change. The measured time includes
+ * the daemon regenerating and loading the program, and running @c bfcli if
+ * @c --cli-exec is used. The time spent by the daemon in each phase is
+ * reported as counters.
+ */
+template<typename C>
+void patchRuleLatency(::benchmark::State &state, const ::bf::Hook &hook)
+{
+    auto chain = newChain<C>(hook);
+    std::map<std::string, double> timings;
+    int port = 0;
+
+    for (int i = 0; i < state.range(0); ++i)
+        chain << dportRule(chain, i + 1);
+
+    chain.apply();
+
+    for (auto _: state) {
+        chain.replaceRule(1, dportRule(chain, 1 + (port++ % 2)));
+        addTimings(timings, chain.timings());
+    }
+
+    state.SetLabel(std::format("hook={}", hook.name));
+    state.counters["nInsn"] = chain.getProgram().nInsn();
+    reportTimings(state, timings);
+}
+
+/**
+ * Measure the latency of updating a single rule of a large chain by sending
+ * the whole chain, to compare with @c patchRuleLatency .
+ */
+template<typename C>
+void reloadRuleLatency(::benchmark::State &state, const ::bf::Hook &hook)
+{
+    std::array<C, 2> chains {newChain<C>(hook), newChain<C>(hook)};
+    std::map<std::string, double> timings;
+    int iter = 0;
+
+    for (std::size_t c = 0; c < chains.size(); ++c) {
+        chains[c] << dportRule(chains[c], 1 + c);
+        for (int i = 1; i < state.range(0); ++i)
+            chains[c] << dportRule(chains[c], i + 1);
+    }
+
+    chains[0].apply();
+
+    for (auto _: state) {
+        auto &chain = chains[++iter % 2];
+        chain.apply();
+        addTimings(timings, chain.timings());
+    }
+
+    state.SetLabel(std::format("hook={}", hook.name));
+    state.counters["nInsn"] = chains[0].getProgram().nInsn();
+    reportTimings(state, timings);
+}
+
+/**
+ * Measure the latency of applying a whole ruleset, when no ruleset is
+ * defined yet.
+ *
+ * The ruleset is flushed before each iteration, so each request creates the
+ * chain, instead of replacing it (see @c reloadRuleLatency ).
+ */
+template<typename C>
+void applyLatency(::benchmark::State &state, const ::bf::Hook &hook)
+{
+    auto chain = newChain<C>(hook);
+    std::map<std::string, double> timings;
+
+    for (int i = 0; i < state.range(0); ++i)
+        chain << dportRule(chain, 1 + (i % 65535));
+
+    for (auto _: state) {
+        state.PauseTiming();
+        chain.flush();
+        state.ResumeTiming();
+
+        chain.apply();
+        addTimings(timings, chain.timings());
+    }
 
-void adhocBenchmark(::benchmark::State &state, const ::std::string &ruleset)
+    chain.flush();
+
+    state.SetLabel(std::format("hook={}", hook.name));
+    reportTimings(state, timings);
+}
+
+/**
+ * Measure the latency of applying a chain containing a single rule, matching
+ * the packets against a set of @c state.range(0) IPv4 addresses.
+ */
+template<typename C>
+void applySetLatency(::benchmark::State &state, const ::bf::Hook &hook)
+{
+    auto chain = newChain<C>(hook);
+    std::map<std::string, double> timings;
+
+    addSetRule(chain, state.range(0));
+
+    for (auto _: state) {
+        state.PauseTiming();
+        chain.flush();
+        state.ResumeTiming();
+
+        chain.apply();
+        addTimings(timings, chain.timings());
+    }
+
+    chain.flush();
+
+    state.SetLabel(std::format("hook={}", hook.name));
+    reportTimings(state, timings);
+}
+
+/**
+ * Measure the latency of flushing the ruleset, when it contains a single
+ * chain of @c state.range(0) rules.
+ */
+template<typename C>
+void flushLatency(::benchmark::State &state, const ::bf::Hook &hook)
+{
+    auto chain = newChain<C>(hook);
+
+    for (int i = 0; i < state.range(0); ++i)
+        chain << dportRule(chain, 1 + (i % 65535));
+
+    for (auto _: state) {
+        state.PauseTiming();
+        chain.apply();
+        state.ResumeTiming();
+
+        chain.flush();
+    }
+
+    state.SetLabel(std::format("hook={}", hook.name));
+}
+
+/**
+ * Measure the latency of replacing the iptables @c filter table, as
+ * @c iptables-restore does, with @c state.range(0) rules in @c INPUT .
+ *
+ * The benchmark is run with a dedicated daemon, with the @c iptables
+ * front-end enabled. The time spent by the daemon in each phase is read from
+ * its logs.
+ */
+void iptablesRestoreLatency(::benchmark::State &state)
 {
-    ::bf::Chain chain(::bf::config.bfcli);
+    if (!::bf::config.runDaemon) {
+        state.SkipWithError("requires the benchmark to start the daemon");
+        return;
+    }
+
+    // The request timings are only logged at debug level.
+    DaemonOverride override(
+        ::bf::Daemon::Options().transient().noNftables().verbose("debug"));
+    ::bf::IptTable table(state.range(0));
+    std::map<std::string, double> timings;
+
+    for (auto _: state) {
+        if (table.restore() < 0) {
+            state.SkipWithError("failed to restore the iptables ruleset");
+            return;
+        }
+
+        state.PauseTiming();
+        addTimings(timings, override.daemon().requestTimings());
+        state.ResumeTiming();
+    }
+
+    reportTimings(state, timings);
+}
+
+/**
+ * Measure the latency of adding a rule to an nftables chain already
+ * containing @c state.range(0) rules.
+ *
+ * The benchmark is run with a dedicated daemon, with the @c nftables
+ * front-end enabled, and requires the @c nft binary (see @c --nft ). Each
+ * iteration adds a new rule, so the chain grows during the benchmark.
+ */
+void nftRuleAddLatency(::benchmark::State &state)
+{
+    if (!::bf::config.runDaemon) {
+        state.SkipWithError("requires the benchmark to start the daemon");
+        return;
+    }
+
+    // The request timings are only logged at debug level.
+    DaemonOverride override(
+        ::bf::Daemon::Options().transient().noIptables().verbose("debug"));
+    ::bf::NftChain chain(*::bf::config.nft);
+    std::map<std::string, double> timings;
+    uint32_t addr = 0x0a000001;
+
+    auto rule = [&addr]() {
+        const uint32_t a = addr++;
+        return std::format("ip saddr {}.{}.{}.{} accept", a >> 24,
+                           (a >> 16) & 0xff, (a >> 8) & 0xff, a & 0xff);
+    };
+
+    for (int i = 0; i < state.range(0); ++i) {
+        if (chain.addRule(rule()) < 0) {
+            state.SkipWithError("failed to fill the nftables chain");
+            return;
+        }
+    }
+    (void)override.daemon().requestTimings();
+
+    for (auto _: state) {
+        if (chain.addRule(rule()) < 0) {
+            state.SkipWithError("failed to add an nftables rule");
+            return;
+        }
+
+        state.PauseTiming();
+        addTimings(timings, override.daemon().requestTimings());
+        state.ResumeTiming();
+    }
+
+    reportTimings(state, timings);
+}
+
+/**
+ * Measure the latency of restarting the daemon, when its runtime context
+ * contains a chain of @c state.range(0) rules.
+ *
+ * The benchmark is run with a dedicated, non-transient, daemon: it restores
+ * its runtime context from the filesystem when it starts. The time spent
+ * restoring the context, and the total startup time, are reported as
+ * counters.
+ */
+void restartLatency(::benchmark::State &state)
+{
+    if (!::bf::config.runDaemon) {
+        state.SkipWithError("requires the benchmark to start the daemon");
+        return;
+    }
+
+    DaemonOverride override(::bf::Daemon::Options().noIptables().noNftables());
+    ::bf::Chain chain(::bf::config.bfcli, ::bf::hooks[0]);
+    std::map<std::string, double> timings;
+
+    for (int i = 0; i < state.range(0); ++i)
+        chain << std::format("rule meta.dport {} ACCEPT", 1 + (i % 65535));
+
+    // Start from an empty context, even if a previous run was interrupted.
+    chain.flush();
+    if (state.range(0))
+        chain.apply();
+
+    for (auto _: state) {
+        if (override.daemon().restart() < 0) {
+            state.SkipWithError("failed to restart the daemon");
+            return;
+        }
+
+        addTimings(timings, override.daemon().startupTimings());
+    }
+
+    chain.flush();
+
+    reportTimings(state, timings);
+}
+
+void adhocBenchmark(::benchmark::State &state, const ::std::string &ruleset,
+                    const ::bf::Hook &hook, const ::bf::Packet &pkt)
+{
+    ::bf::Chain chain(::bf::config.bfcli, hook);
     chain.repeat(ruleset, ::bf::config.adhocRepeat);
     chain.apply();
     auto prog = chain.getProgram();
 
     benchLoop(state)
     {
-        if (prog.run(::bf::CGROUP_DROP, ::bf::pkt_local_ip6_tcp) < 0)
+        if (prog.run(hook, pkt, hook.drop) < 0)
             state.SkipWithError("benchmark run failed");
     }
 
+    setLabel(state, hook, pkt);
     state.counters["nInsn"] = prog.nInsn();
 }
 
+/**
+ * Replay every packet of a capture through a chain.
+ *
+ * Each iteration runs every packet of the capture @c pcapRunRepeat times. The
+ * percentiles of the per-packet average run time are reported as counters,
+ * as well as the number of packets accepted, dropped, or for which the
+ * program returned another value. Netfilter programs only process IPv4 and
+ * IPv6 packets, other packets are skipped.
+ */
+void pcapBenchmark(::benchmark::State &state, const ::bf::Hook &hook,
+                   const ::bf::Capture &capture)
+{
+    ::bf::Chain chain(::bf::config.bfcli, hook);
+    if (::bf::config.adhoc)
+        chain.repeat(*::bf::config.adhoc, ::bf::config.adhocRepeat);
+    chain.apply();
+    auto prog = chain.getProgram();
+
+    ::std::vector<uint32_t> durations;
+    int64_t nAccept = 0;
+    int64_t nDrop = 0;
+    int64_t nOther = 0;
+
+    for (auto _: state) {
+        durations.clear();
+        nAccept = nDrop = nOther = 0;
+
+        for (const auto &pkt: capture.packets()) {
+            uint32_t retval;
+            uint32_t duration;
+
+            if (hook.nfHook && pkt.family == NFPROTO_UNSPEC)
+                continue;
+
+            if (prog.testRun(hook, pkt, ::bf::pcapRunRepeat, retval,
+                             duration) < 0) {
+                state.SkipWithError("benchmark run failed");
+                return;
+            }
+
+            durations.push_back(duration);
+            if ((int)retval == hook.accept)
+                ++nAccept;
+            else if ((int)retval == hook.drop)
+                ++nDrop;
+            else
+                ++nOther;
+        }
+    }
+
+    if (durations.empty()) {
+        state.SkipWithError("no packet can be processed by this hook");
+        return;
+    }
+
+    ::std::sort(durations.begin(), durations.end());
+    auto percentile = [&durations](::std::size_t p) {
+        return durations[(durations.size() - 1) * p / 100];
+    };
+
+    state.SetLabel(std::format("hook={} pkt=pcap", hook.name));
+    state.SetItemsProcessed(state.iterations() * (int64_t)durations.size() *
+                            ::bf::pcapRunRepeat);
+    state.counters["nInsn"] = prog.nInsn();
+    state.counters["nPkts"] = (double)durations.size();
+    state.counters["p50Ns"] = percentile(50);
+    state.counters["p90Ns"] = percentile(90);
+    state.counters["p99Ns"] = percentile(99);
+    state.counters["accept"] = (double)nAccept;
+    state.counters["drop"] = (double)nDrop;
+    state.counters["other"] = (double)nOther;
+}
+
+/**
+ * Copy of @p hook evaluating its chains in interpreted mode, named
+ * "<hook>_interp", to compare both modes on the same benchmarks.
+ */
+::bf::Hook interpreted(const ::bf::Hook &hook)
+{
+    ::bf::Hook interp = hook;
+
+    interp.name += "_interp";
+    interp.opts += interp.opts.empty() ? "mode=interpreted" :
+                                         ",mode=interpreted";
+
+    return interp;
+}
+
+/**
+ * Register the control-plane benchmarks using chains of type @p C for
+ * @p hook .
+ */
+template<typename C>
+void registerChainBenchmarks(const ::bf::Hook &hook)
+{
+    const auto suffix = std::format("/{}", hook.name);
+
+    ::benchmark::RegisterBenchmark(("patchRuleLatency" + suffix).c_str(),
+                                   patchRuleLatency<C>, hook)
+        ->Arg(1000)
+        ->Arg(10000)
+        ->Arg(50000)
+        ->Unit(::benchmark::kMillisecond);
+    ::benchmark::RegisterBenchmark(("reloadRuleLatency" + suffix).c_str(),
+                                   reloadRuleLatency<C>, hook)
+        ->Arg(50000)
+        ->Unit(::benchmark::kMillisecond);
+    ::benchmark::RegisterBenchmark(("applyLatency" + suffix).c_str(),
+                                   applyLatency<C>, hook)
+        ->Arg(100)
+        ->Arg(1000)
+        ->Arg(10000)
+        ->Arg(50000)
+        ->Unit(::benchmark::kMillisecond);
+    ::benchmark::RegisterBenchmark(("applySetLatency" + suffix).c_str(),
+                                   applySetLatency<C>, hook)
+        ->Arg(1000)
+        ->Arg(10000)
+        ->Arg(100000)
+        ->Unit(::benchmark::kMillisecond);
+    ::benchmark::RegisterBenchmark(("flushLatency" + suffix).c_str(),
+                                   flushLatency<C>, hook)
+        ->Arg(1000)
+        ->Arg(50000)
+        ->Unit(::benchmark::kMillisecond);
+}
+
+/**
+ * Register the benchmarks.
+ *
+ * Datapath benchmarks are registered for every hook and packet, as
+ * "<benchmark>/<hook>/<packet>". Control-plane benchmarks don't process
+ * packets, they are registered for every hook, as "<benchmark>/<hook>",
+ * except the benchmarks running their own daemon.
+ */
+void registerBenchmarks()
+{
+    for (const auto &hook: ::bf::hooks) {
+        for (const auto &pkt: ::bf::packets) {
+            const auto suffix = std::format("/{}/{}", hook.name, pkt.name);
+
+            ::benchmark::RegisterBenchmark(
+                ("firstRuleDropCounter" + suffix).c_str(),
+                firstRuleDropCounter, hook, pkt);
+            ::benchmark::RegisterBenchmark(("dropAfterXRules" + suffix).c_str(),
+                                           dropAfterXRules, hook, pkt)
+                ->Arg(8)
+                ->Arg(32)
+                ->Arg(128)
+                ->Arg(512)
+                ->Arg(2048);
+        }
+    }
+
+    /* Interpreted chains: the per-packet cost of evaluating the rules from a
+     * map, and the latency of updating a rule without loading a program, to
+     * compare with dropAfterXRules and patchRuleLatency. */
+    for (const auto &hook: ::bf::hooks) {
+        const auto interp = interpreted(hook);
+
+        for (const auto &pkt: ::bf::packets) {
+            const auto suffix = std::format("/{}/{}", interp.name, pkt.name);
+
+            ::benchmark::RegisterBenchmark(("dropAfterXRules" + suffix).c_str(),
+                                           dropAfterXRules, interp, pkt)
+                ->Arg(8)
+                ->Arg(32)
+                ->Arg(128)
+                ->Arg(512)
+                ->Arg(2048);
+        }
+
+        ::benchmark::RegisterBenchmark(
+            std::format("patchRuleLatency/{}", interp.name).c_str(),
+            ::bf::config.cliExec ? patchRuleLatency<::bf::Chain> :
+                                   patchRuleLatency<::bf::LibChain>,
+            interp)
+            ->Arg(1000)
+            ->Arg(10000)
+            ->Arg(50000)
+            ->Unit(::benchmark::kMillisecond);
+    }
+
+    /* Multi-threaded benchmarks, from 1 thread up to the number of CPUs
+     * available. They only run with IPv4 TCP packets, as the set lookup
+     * matches on the IPv4 source address. */
+    const auto &pkt = *std::find_if(
+        ::bf::packets.begin(), ::bf::packets.end(),
+        [](const ::bf::Packet &p) { return p.name == "ip4_tcp"; });
+    const auto nCpus = static_cast<int64_t>(allowedCpus().size());
+
+    for (const auto &hook: ::bf::hooks) {
+        const auto suffix = std::format("/{}/{}", hook.name, pkt.name);
+
+        for (auto *bench:
+             {::benchmark::RegisterBenchmark(
+                  ("contendedCounters" + suffix).c_str(), contendedCounters,
+                  hook, pkt),
+              ::benchmark::RegisterBenchmark(
+                  ("contendedSetLookup" + suffix).c_str(), contendedSetLookup,
+                  hook, pkt)}) {
+            bench->ArgName("threads")->UseManualTime();
+            for (int64_t n = 1; n < nCpus; n *= 2)
+                bench->Arg(n);
+
+            // Always measure the fully contended case.
+            bench->Arg(nCpus);
+        }
+    }
+
+    for (const auto &hook: ::bf::hooks) {
+        if (::bf::config.cliExec)
+            registerChainBenchmarks<::bf::Chain>(hook);
+        else
+            registerChainBenchmarks<::bf::LibChain>(hook);
+    }
+
+    // The following benchmarks start their own daemon, they are not run for
+    // every hook.
+    ::benchmark::RegisterBenchmark("iptablesRestoreLatency",
+                                   iptablesRestoreLatency)
+        ->Arg(100)
+        ->Arg(1000)
+        ->Arg(10000)
+        ->Unit(::benchmark::kMillisecond);
+    ::benchmark::RegisterBenchmark("restartLatency", restartLatency)
+        ->Arg(0)
+        ->Arg(1000)
+        ->Arg(50000)
+        ->Unit(::benchmark::kMillisecond);
+
+    if (::bf::config.nft) {
+        ::benchmark::RegisterBenchmark("nftRuleAddLatency", nftRuleAddLatency)
+            ->Arg(100)
+            ->Arg(1000)
+            ->Unit(::benchmark::kMillisecond);
+    }
+}
+} // namespace
+
 int main(int argc, char *argv[])
 {
     if (geteuid() != 0) {
@@ -89,23 +882,47 @@ int main(int argc, char *argv[])
 
     ::benchmark::Initialize(&argc, argv, nullptr);
 
-    if (!::bf::config.adhoc)
+    if (!::bf::config.adhoc && !::bf::config.pcap)
         ::bf::restorePermissions(::bf::config.outfile);
 
-    if (::bf::config.adhoc) {
-        ::benchmark::RegisterBenchmark("bf_adhoc", adhocBenchmark,
-                                       *::bf::config.adhoc);
+    ::std::optional<::bf::Capture> capture;
+
+    if (::bf::config.pcap) {
+        try {
+            capture.emplace(*::bf::config.pcap);
+        } catch (const ::std::exception &e) {
+            err("failed to read capture: {}", e.what());
+            return -1;
+        }
+
+        for (const auto &hook: ::bf::hooks) {
+            ::benchmark::RegisterBenchmark(
+                std::format("{}/{}", ::bf::config.pcapBenchName, hook.name)
+                    .c_str(),
+                pcapBenchmark, hook, ::std::cref(*capture));
+        }
+    } else if (::bf::config.adhoc) {
+        for (const auto &hook: ::bf::hooks) {
+            for (const auto &pkt: ::bf::packets) {
+                ::benchmark::RegisterBenchmark(
+                    std::format("{}/{}/{}", ::bf::config.adhocBenchName,
+                                hook.name, pkt.name)
+                        .c_str(),
+                    adhocBenchmark, *::bf::config.adhoc, hook, pkt);
+            }
+        }
+    } else {
+        registerBenchmarks();
     }
 
     try {
         if (::bf::config.runDaemon) {
-            auto daemon = bf::Daemon(
-                ::bf::config.bpfilter,
-                bf::Daemon::Options().transient().noIptables().noNftables());
-            ::benchmark::RunSpecifiedBenchmarks();
-        } else {
-            ::benchmark::RunSpecifiedBenchmarks();
+            ::bf::benchDaemon.emplace(::bf::config.bpfilter,
+                                      ::bf::defaultDaemonOptions());
         }
+
+        ::benchmark::RunSpecifiedBenchmarks();
+        ::bf::benchDaemon.reset();
     } catch (const ::std::exception &e) {
         err("failed to run benchmark: {}", e.what());
         return -1;